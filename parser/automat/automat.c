@@ -11,11 +11,19 @@
 
 #include "config.h"
 #include "automat.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "automat_mman.h"
 #include "patriciatrie.h"
 #include "foreach.h"
 #include "utf8.h"
+#include "cpufeature.h"
 #include "test_errortimer.h"
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 typedef uint32_t char32_t;
 
@@ -38,6 +46,14 @@ struct rangemap_t;
 struct rangemap_iter_t;
 struct statevector_block_t;
 struct statevector_t;
+struct lazystate_t;
+struct dfapar_item_t;
+struct dfapar_shard_t;
+struct dfapar_worker_t;
+struct dfapar_t;
+struct partition_t;
+struct refinement_t;
+struct hopcroft_t;
 
 #ifdef KONFIG_UNITTEST
 // forward
@@ -96,12 +112,9 @@ typedef struct state_t {
    size_t   nrrangetrans; // number of range transitions
    slist_t  emptylist;    // list of empty transitions
    slist_t  rangelist;    // list of range transitions (every node contains multiple rangestate_t)
+   size_t   nr;           // position in list of states (start == 0), valid in every automaton (see <numberstates_automat>)
    union {
-      struct {
-         uint8_t        isused; // used to mark a state as inserted or used
-         uint8_t        nrdfa;  // used to inidicate to which automaton state belongs
-      };
-      size_t            nr;     // used to assign numbers to states for printing
+      uint8_t           nrdfa;  // used to inidicate to which automaton state belongs
       struct state_t*   dest;   // used in copy operations
    };
 } state_t;
@@ -112,6 +125,12 @@ typedef struct state_t {
 #define state_SIZE_EMPTYTRANS(nrtrans) ((nrtrans) * sizeof(empty_transition_t))
 #define state_SIZE_RANGETRANS(nrtrans) ((nrtrans) * sizeof(rangestate_t) + sizeof(range_transition_t))
 
+/* define: matchid_CHAR
+ * Das Zeichen, mit dem <opmatchid_automat> die Muster-ID matchid markiert.
+ * Diese Zeichen liegen oberhalb von <maxchar_utf8> und kommen in keinem gültigen Text vor.
+ * matchid_CHAR(<automat_MAXMATCHID>) liegt unterhalb von <automat_MINTAGCHAR>. */
+#define matchid_CHAR(matchid)          ((char32_t)0x80000000 + (char32_t)(matchid))
+
 // group: type support
 
 /* define: YYY_statelist
@@ -1555,6 +1574,23 @@ static inline void startend_automat(const automat_t* ndfa, /*out*/state_t ** sta
    *end   = last;
 }
 
+// group: helper
+
+/* function: numberstates_automat
+ * Weist jedem Zustand seine Position in der Liste aller Zustände als <state_t.nr> zu.
+ * Wird von allen Funktionen aufgerufen, die Zustände eines Automaten erzeugen oder umordnen.
+ * Die Matchfunktionen und <initcopy_automat> bzw. <initreverse_automat> speichern Markierungen
+ * in einem über nr indizierten Array statt im Zustand selbst. Ein Automat wird von ihnen deshalb
+ * nur gelesen und kann von mehreren Threads gleichzeitig genutzt werden.
+ * <state_t.dest> und <state_t.nrdfa> überschreiben nr nicht. */
+static void numberstates_automat(automat_t* ndfa)
+{
+   size_t nr = 0;
+   foreach (_statelist, s, &ndfa->states) {
+      s->nr = nr++;
+   }
+}
+
 // group: lifetime
 
 int free_automat(automat_t* ndfa)
@@ -1611,6 +1647,7 @@ int initempty_automat(/*out*/automat_t* ndfa, struct automat_t* use_mman)
    ndfa->allocated = SIZE;
    initsingle_statelist(&ndfa->states, endstate);
    insertfirst_statelist(&ndfa->states, startstate);
+   numberstates_automat(ndfa);
 
    return 0;
 ONERR:
@@ -1653,6 +1690,7 @@ int initmatch_automat(/*out*/automat_t* ndfa, struct automat_t* use_mman, uint8_
    ndfa->allocated = SIZE;
    initsingle_statelist(&ndfa->states, endstate);
    insertfirst_statelist(&ndfa->states, startstate);
+   numberstates_automat(ndfa);
 
    return 0;
 ONERR:
@@ -1667,6 +1705,7 @@ int initcopy_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa, con
 {
    int err;
    automat_mman_t * mman;
+   state_t ** dest = 0; // dest[src_state->nr] is the copy of src_state, src_ndfa is only read
    slist_t dest_states = slist_INIT;
 
    if (use_mman) {
@@ -1678,6 +1717,12 @@ int initcopy_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa, con
       if (err) goto ONERR;
    }
 
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      dest = malloc(src_ndfa->nrstate * sizeof(state_t*));
+      err = dest ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+
    // allocate space for every state with transitions in dest_ndfa
    foreach (_statelist, src_state, &src_ndfa->states) {
       void * dest_state;
@@ -1685,7 +1730,7 @@ int initcopy_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa, con
          err = malloc_automatmman(mman, state_SIZE, &dest_state);
       }
       if (err) goto ONERR;
-      src_state->dest = dest_state;
+      dest[src_state->nr] = dest_state;
       insertlast_statelist(&dest_states, (state_t*)dest_state);
       ((state_t*)dest_state)->nremptytrans = src_state->nremptytrans;
       ((state_t*)dest_state)->nrrangetrans = src_state->nrrangetrans;
@@ -1719,21 +1764,21 @@ int initcopy_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa, con
    foreach (_statelist, src_state, &src_ndfa->states) {
       {
          empty_transition_t* src_trans  = last_emptylist(&src_state->emptylist);
-         empty_transition_t* dest_trans = last_emptylist(&src_state->dest->emptylist);
+         empty_transition_t* dest_trans = last_emptylist(&dest[src_state->nr]->emptylist);
          for (size_t i = 0; i < src_state->nremptytrans; ++i) {
-            dest_trans->state = src_trans->state->dest;
+            dest_trans->state = dest[src_trans->state->nr];
             src_trans  = next_emptylist(src_trans);
             dest_trans = next_emptylist(dest_trans);
          }
       }
       {
          range_transition_t* src_trans  = last_rangelist(&src_state->rangelist);
-         range_transition_t* dest_trans = last_rangelist(&src_state->dest->rangelist);
+         range_transition_t* dest_trans = last_rangelist(&dest[src_state->nr]->rangelist);
          for (size_t i = 0; i < src_state->nrrangetrans; ) {
             for (size_t s = 0; s < src_trans->size; ++s) {
                dest_trans->array[s].from  = src_trans->array[s].from;
                dest_trans->array[s].to    = src_trans->array[s].to;
-               dest_trans->array[s].state = src_trans->array[s].state->dest;
+               dest_trans->array[s].state = dest[src_trans->array[s].state->nr];
             }
             i += src_trans->size;
             src_trans  = next_rangelist(src_trans);
@@ -1749,9 +1794,12 @@ int initcopy_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa, con
    dest_ndfa->allocated = src_ndfa->allocated;
    dest_ndfa->states  = dest_states;
    dest_ndfa->isDFA   = src_ndfa->isDFA;
+   numberstates_automat(dest_ndfa);
+   free(dest);
 
    return 0;
 ONERR:
+   free(dest);
    if (! use_mman) {
       delete_automatmman(&mman);
    }
@@ -1763,6 +1811,7 @@ int initreverse_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa,
 {
    int err;
    automat_mman_t *mman;
+   state_t ** dest = 0; // dest[src_state->nr] is the reversed src_state, src_ndfa is only read
    size_t  allocated   = 0;
    slist_t dest_states = slist_INIT;
 
@@ -1780,6 +1829,12 @@ int initreverse_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa,
       goto ONERR;
    }
 
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      dest = malloc(src_ndfa->nrstate * sizeof(state_t*));
+      err = dest ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+
    // dest_ndfa: allocate space for every state but without transitions
    foreach (_statelist, src_state, &src_ndfa->states) {
       void * dest_state;
@@ -1788,7 +1843,7 @@ int initreverse_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa,
       }
       if (err) goto ONERR;
       allocated += state_SIZE;
-      src_state->dest = dest_state;
+      dest[src_state->nr] = dest_state;
       ((state_t*)dest_state)->nremptytrans = 0;
       ((state_t*)dest_state)->nrrangetrans = 0;
       ((state_t*)dest_state)->emptylist    = (slist_t) slist_INIT;
@@ -1803,10 +1858,10 @@ int initreverse_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa,
          err = malloc_automatmman(mman, state_SIZE_EMPTYTRANS(1), &dest_trans);
          if (err) goto ONERR;
          allocated += state_SIZE_EMPTYTRANS(1);
-         state_t* dest_state = src_trans->state->dest;
+         state_t* dest_state = dest[src_trans->state->nr];
          ++ dest_state->nremptytrans;
          insertlast_emptylist(&dest_state->emptylist, (empty_transition_t*)dest_trans);
-         ((empty_transition_t*)dest_trans)->state = src_state->dest;
+         ((empty_transition_t*)dest_trans)->state = dest[src_state->nr];
       }
       foreach (_rangelist, src_trans, &src_state->rangelist) {
          for (size_t s = 0; s < src_trans->size; ++s) {
@@ -1814,13 +1869,13 @@ int initreverse_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa,
             err = malloc_automatmman(mman, state_SIZE_RANGETRANS(1), &dest_trans);
             if (err) goto ONERR;
             allocated += state_SIZE_RANGETRANS(1);
-            state_t* dest_state = src_trans->array[s].state->dest;
+            state_t* dest_state = dest[src_trans->array[s].state->nr];
             ++ dest_state->nrrangetrans;
             insertlast_rangelist(&dest_state->rangelist, (range_transition_t*)dest_trans);
             ((range_transition_t*)dest_trans)->size = 1;
             ((range_transition_t*)dest_trans)->array[0].from  = src_trans->array[s].from;
             ((range_transition_t*)dest_trans)->array[0].to    = src_trans->array[s].to;
-            ((range_transition_t*)dest_trans)->array[0].state = src_state->dest;
+            ((range_transition_t*)dest_trans)->array[0].state = dest[src_state->nr];
          }
       }
    }
@@ -1844,9 +1899,12 @@ int initreverse_automat(/*out*/automat_t* dest_ndfa, const automat_t* src_ndfa,
    dest_ndfa->allocated = allocated;
    dest_ndfa->states  = dest_states;
    dest_ndfa->isDFA   = 0;
+   numberstates_automat(dest_ndfa);
+   free(dest);
 
    return 0;
 ONERR:
+   free(dest);
    if (! use_mman) {
       delete_automatmman(&mman);
    }
@@ -1882,86 +1940,96 @@ int iserrorstate_automat(const automat_t* ndfa, size_t statenr)
    return 1; /* every state not in range 0..nrstate-1 is considered an error state */
 }
 
-static size_t matchchar32_dfa_automat(const automat_t* ndfa, size_t len, const char32_t str[len], bool matchLongest)
+/* function: findrange_rangelist
+ * Gibt den <rangestate_t> aus rangelist zurück, dessen Bereich chr enthält.
+ * Der Wert 0 wird zurückgegeben, falls kein solcher Bereich existiert.
+ *
+ * Unchecked Precondition:
+ * - Die Bereiche aller rangestate_t in rangelist sind aufsteigend sortiert
+ *   und überschneiden sich nicht (wie in einem DFA) */
+static inline rangestate_t* findrange_rangelist(const slist_t* rangelist, char32_t chr)
+{
+   foreach (_rangelist, range_trans, (slist_t*)rangelist) {
+      if (chr <= range_trans->array[range_trans->size/*>0*/-1].to) {
+         size_t high = range_trans->size;
+         size_t low  = 0;
+         do {
+            size_t mid = (high + low)/2;
+            if (chr < range_trans->array[mid].from) {
+               high = mid;
+            } else if (chr > range_trans->array[mid].to) {
+               low = mid+1;
+            } else {
+               return &range_trans->array[mid];
+            }
+         } while (low < high);
+         break;
+      }
+   }
+
+   return 0;
+}
+
+/* function: nextstate_dfa
+ * Gibt den Folgezustand von state zurück, der beim Lesen von chr erreicht wird.
+ * Der Wert 0 wird zurückgegeben, falls kein Übergang existiert.
+ *
+ * Unchecked Precondition:
+ * - state ist Teil eines DFA, d.h. die Bereiche aller rangestate_t sind aufsteigend sortiert
+ *   und überschneiden sich nicht */
+static inline state_t* nextstate_dfa(const state_t* state, char32_t chr)
+{
+   rangestate_t* range = findrange_rangelist(&state->rangelist, chr);
+   return range ? range->state : 0;
+}
+
+/* function: match_dfa_automat
+ * Implementiert <matchchar32_automat> für einen DFA und <matchutf8_automat>.
+ * Ist isUTF8 gesetzt, zeigt str auf len Bytes, sonst auf len Zeichen vom Typ char32_t.
+ * Der Parameter isUTF8 ist in beiden Aufrufen konstant, so dass der Compiler je eine Version erzeugt. */
+static inline size_t match_dfa_automat(const automat_t* ndfa, size_t len, const void* str, bool isUTF8, bool matchLongest)
 {
-   int err;
-   int isEnd;
-   state_t * start;
-   state_t * end;
    state_t * next;
-   size_t    stroffset = 0;
+   state_t * end;
    size_t    matchedlen = 0;
-   statearray_t  states = statearray_FREE;
-   statearray_iter_t iter;
 
-   startend_automat(ndfa, &start, &end);
-   err = init_statearray(&states);
-   if (err) goto ONERR;
-   err = insert1_statearray(&states, start);
-   if (err) goto ONERR;
+   startend_automat(ndfa, &next, &end);
    // start has empty transition to end state?
-   isEnd = (start->nremptytrans != 0);
+   if (next->nremptytrans != 0 && ! matchLongest) return 0;
 
-   for (;;) {
-      // === check end of match reached ===
-      if (isEnd) {
-         isEnd = 0;
+   for (size_t stroffset = 0; stroffset < len; ) {
+      const char32_t chr = isUTF8 ? ((const uint8_t*)str)[stroffset] : ((const char32_t*)str)[stroffset];
+      next = nextstate_dfa(next, chr);
+      if (!next) break;
+      ++ stroffset;
+      if (next->nremptytrans != 0) {
          matchedlen = stroffset;
          if (! matchLongest) break; // use first match
       }
+   }
 
-      // === check end of string reached ===
-      if (stroffset >= len) break;
-
-      // === match next single character ===
-      swap1and2_statearray(&states);
-      if (remove2_statearray(&states, &next)) break/*ENODATA*/;
+   return matchedlen;
+}
 
-      do {
-         // loop over range-transitions of state (stored in variable next)
-         // add range targets if they match str[stroffset]
-         foreach (_rangelist, range_trans, &next->rangelist) {
-            if (str[stroffset] <= range_trans->array[range_trans->size/*>0*/-1].to) {
-               size_t high = range_trans->size;
-               size_t low  = 0;
-               do {
-                  size_t mid = (high + low)/2;
-                  if (str[stroffset] < range_trans->array[mid].from) {
-                     high = mid;
-                  } else if (str[stroffset] > range_trans->array[mid].to) {
-                     low = mid+1;
-                  } else {
-                     state_t *target = range_trans->array[mid].state;
-                     if (! target->isused) {
-                        target->isused = 1;
-                        isEnd |= (target->nremptytrans != 0);
-                        err = insert1_statearray(&states, target);
-                        if (err) goto ONERR;
-                     }
-                     break;
-                  }
-               } while (low < high);
-               break;
-            }
-         }
-      } while (0 == remove2_statearray(&states, &next));
+/* function: reserve_automatscratch
+ * Vergrößert scratch->mem auf mindestens size Bytes. Der bisherige Inhalt bleibt erhalten.
+ * Der Speicher wird mindestens verdoppelt, damit wachsende Aufrufer nur selten kopieren. */
+static int reserve_automatscratch(automat_scratch_t* scratch, size_t size)
+{
+   int err;
 
-      // === reset: clear insert flags ===
-      init_statearrayiter(&iter, &states);
-      while (next_statearrayiter(&iter, &states, &next)) {
-         next->isused = 0;
-      }
+   if (size <= scratch->size) return 0;
 
-      ++ stroffset;
+   size_t newsize = scratch->size < SIZE_MAX / 2 && 2 * scratch->size > size ? 2 * scratch->size : size;
+   void*  mem     = 0;
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      mem = realloc(scratch->mem, newsize);
+      err = mem ? 0 : ENOMEM;
    }
+   if (err) return err;
+   scratch->mem  = mem;
+   scratch->size = newsize;
 
-   err = free_statearray(&states);
-   if (err) goto ONERR;
-
-   return matchedlen;
-ONERR:
-   free_statearray(&states);
-   TRACEEXIT_ERRLOG(err);
    return 0;
 }
 
@@ -1975,26 +2043,30 @@ size_t matchchar32_automat(const automat_t* ndfa, size_t len, const char32_t str
    size_t    matchedlen = 0;
    statearray_t  states = statearray_FREE;
    statearray_iter_t iter;
+   automat_scratch_t scratch = automat_scratch_FREE;
+   uint8_t * isused; // isused[state->nr] != 0 ==> state is in states, ndfa is only read
 
    if (!ndfa->mman) {
       err = EINVAL;
       goto ONERR;
    }
 
-   foreach (_statelist, s, &ndfa->states) {
-      s->isused = 0;
-   }
-
    if (ndfa->isDFA) {
-      return matchchar32_dfa_automat(ndfa, len, str, matchLongest);
+      // read only access
+      return match_dfa_automat(ndfa, len, str, false, matchLongest);
    }
 
+   err = reserve_automatscratch(&scratch, ndfa->nrstate);
+   if (err) goto ONERR;
+   isused = scratch.mem;
+   memset(isused, 0, ndfa->nrstate);
+
    startend_automat(ndfa, &start, &end);
    err = init_statearray(&states);
    if (err) goto ONERR;
    err = insert1_statearray(&states, start);
    if (err) goto ONERR;
-   start->isused = 1;
+   isused[start->nr] = 1;
 
    for (;;) {
       // === extend list of states with empty transition targets ===
@@ -2002,8 +2074,8 @@ size_t matchchar32_automat(const automat_t* ndfa, size_t len, const char32_t str
       while (next_statearrayiter(&iter, &states, &next)) {
          foreach (_emptylist, empty_trans, &next->emptylist) {
             state_t * target = empty_trans->state;
-            if (! target->isused) {
-               target->isused = 1;
+            if (! isused[target->nr]) {
+               isused[target->nr] = 1;
                err = insert1_statearray(&states, target);
                if (err) goto ONERR;
                // now target is returned by one of the next calls to next_statearrayiter
@@ -2013,12 +2085,12 @@ size_t matchchar32_automat(const automat_t* ndfa, size_t len, const char32_t str
       }
 
       // set of states includes end state ?
-      const unsigned isEnd = end->isused;
+      const unsigned isEnd = isused[end->nr];
 
       // === reset: clear insert flags ===
       init_statearrayiter(&iter, &states);
       while (next_statearrayiter(&iter, &states, &next)) {
-         next->isused = 0;
+         isused[next->nr] = 0;
       }
 
       // === check end of match reached ===
@@ -2040,9 +2112,9 @@ size_t matchchar32_automat(const automat_t* ndfa, size_t len, const char32_t str
          foreach (_rangelist, range_trans, &next->rangelist) {
             for (size_t s = 0; s < range_trans->size; ++s) {
                state_t *target = range_trans->array[s].state;
-               if (! target->isused
+               if (! isused[target->nr]
                   && range_trans->array[s].from <= str[stroffset] && str[stroffset] <= range_trans->array[s].to) {
-                  target->isused = 1;
+                  isused[target->nr] = 1;
                   err = insert1_statearray(&states, target);
                   if (err) goto ONERR;
                }
@@ -2054,15 +2126,263 @@ size_t matchchar32_automat(const automat_t* ndfa, size_t len, const char32_t str
    }
 
    err = free_statearray(&states);
+   (void) free_automatscratch(&scratch);
    if (err) goto ONERR;
 
    return matchedlen;
 ONERR:
    free_statearray(&states);
+   free_automatscratch(&scratch);
+   TRACEEXIT_ERRLOG(err);
+   return 0;
+}
+
+size_t matchutf8_automat(const automat_t* ndfa, size_t len, const uint8_t str[len], bool matchLongest)
+{
+   int err;
+
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   return match_dfa_automat(ndfa, len, str, true, matchLongest);
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return 0;
+}
+
+int search_automat(const automat_t* ndfa, size_t len, const char32_t str[len], /*out*/size_t* matchstart, /*out*/size_t* matchend)
+{
+   int err;
+   automat_search_t search = automat_search_FREE;
+
+   err = init_automatsearch(&search, ndfa);
+   if (err) return err;
+   err = find_automatsearch(&search, len, str, matchstart, matchend);
+   (void) free_automatsearch(&search);
+
+   return err;
+}
+
+int searchall_automat(const automat_t* ndfa, size_t len, const char32_t str[len], automat_matchspan_f matchspan, void* context)
+{
+   int err;
+   automat_search_t search = automat_search_FREE;
+
+   err = init_automatsearch(&search, ndfa);
+   if (err) return err;
+   err = findall_automatsearch(&search, len, str, matchspan, context);
+   (void) free_automatsearch(&search);
+
+   return err;
+}
+
+size_t matchids_automat(const automat_t* ndfa, size_t len, const char32_t str[len], size_t nrid, /*out*/bool ismatch[nrid])
+{
+   int err;
+   state_t* next;
+   state_t* end;
+   size_t   nrmatch = 0;
+
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   memset(ismatch, 0, nrid * sizeof(bool));
+   startend_automat(ndfa, &next, &end);
+
+   for (size_t stroffset = 0; ; ++stroffset) {
+      // === collect ids of matched patterns (transitions for id chars are sorted last) ===
+      foreach (_rangelist, range_trans, &next->rangelist) {
+         if (range_trans->array[range_trans->size-1].to < matchid_CHAR(0)) continue;
+         for (size_t i = range_trans->size; i > 0; ) {
+            rangestate_t* range = &range_trans->array[--i];
+            if (range->to < matchid_CHAR(0)) break;
+            if (range->state->nremptytrans == 0) continue; // no end state
+            char32_t from = range->from < matchid_CHAR(0) ? 0 : range->from - matchid_CHAR(0);
+            char32_t to   = range->to - matchid_CHAR(0);
+            for (size_t id = from; id <= to && id < nrid; ++id) {
+               nrmatch += ! ismatch[id];
+               ismatch[id] = true;
+            }
+         }
+      }
+
+      // === match next single character ===
+      if (stroffset >= len) break;
+      next = nextstate_dfa(next, str[stroffset]);
+      if (!next) break;
+   }
+
+   return nrmatch;
+ONERR:
    TRACEEXIT_ERRLOG(err);
    return 0;
 }
 
+/* struct: tagentry_t
+ * Ein Knoten des Pfadgraphen, den <matchtags_automat> aufbaut.
+ * Alle Knoten derselben Eingabeposition liegen hintereinander im Array <matchtags_t.entry>. */
+typedef struct tagentry_t {
+   state_t* state;
+   size_t   parent; // index of previous entry; SIZE_MAX if state is start state
+   char32_t chr;    // char or tag of transition from parent to state
+   bool     isTag;
+} tagentry_t;
+
+/* struct: matchtags_t
+ * Speichert den Pfadgraphen von <matchtags_automat> im Speicher eines <automat_scratch_t>.
+ * Der Speicher beginnt mit level[nrstate], danach folgen die Knoten entry[capacity].
+ * Jeder Zustand wird pro Eingabeposition höchstens einmal eingefügt,
+ * der Speicherbedarf ist daher O(len * nrstate). */
+typedef struct matchtags_t {
+   automat_scratch_t* scratch;
+   size_t*     level;  // level[state->nr] == pos+1 ==> state inserted at input position pos
+   tagentry_t* entry;
+   size_t      nrstate;
+   size_t      size;
+   size_t      capacity;
+} matchtags_t;
+
+static int init_matchtags(/*out*/matchtags_t* mt, automat_scratch_t* scratch, const automat_t* ndfa)
+{
+   int err;
+   const size_t levelsize = ndfa->nrstate * sizeof(size_t);
+
+   if (ndfa->nrstate >= SIZE_MAX / sizeof(size_t)) return ENOMEM;
+   err = reserve_automatscratch(scratch, levelsize);
+   if (err) return err;
+
+   mt->scratch  = scratch;
+   mt->level    = scratch->mem;
+   mt->entry    = (tagentry_t*) ((uint8_t*)scratch->mem + levelsize);
+   mt->nrstate  = ndfa->nrstate;
+   mt->size     = 0;
+   mt->capacity = (scratch->size - levelsize) / sizeof(tagentry_t);
+   memset(mt->level, 0, levelsize);
+
+   return 0;
+}
+
+/* function: insert_matchtags
+ * Fügt state als Knoten der Eingabeposition pos ein, falls er dort noch nicht vorkommt. */
+static int insert_matchtags(matchtags_t* mt, size_t pos, state_t* state, size_t parent, char32_t chr, bool isTag)
+{
+   int err;
+   size_t* level = &mt->level[state->nr];
+
+   if (*level == pos+1) return 0;
+
+   if (mt->size == mt->capacity) {
+      const size_t levelsize = mt->nrstate * sizeof(size_t);
+      const size_t newcap    = mt->capacity ? 2 * mt->capacity : 64;
+      if (newcap >= (SIZE_MAX - levelsize) / sizeof(tagentry_t)) return ENOMEM;
+      // keeps content of level and entry
+      err = reserve_automatscratch(mt->scratch, levelsize + newcap * sizeof(tagentry_t));
+      if (err) return err;
+      level        = (size_t*) mt->scratch->mem + state->nr;
+      mt->level    = mt->scratch->mem;
+      mt->entry    = (tagentry_t*) ((uint8_t*)mt->scratch->mem + levelsize);
+      mt->capacity = (mt->scratch->size - levelsize) / sizeof(tagentry_t);
+   }
+
+   *level = pos+1;
+   mt->entry[mt->size++] = (tagentry_t) { state, parent, chr, isTag };
+
+   return 0;
+}
+
+int matchtags_automat(const automat_t* rdfa, automat_scratch_t* scratch, size_t len, const char32_t str[len], char32_t tagfrom, size_t nrtag, /*out*/size_t tagpos[nrtag])
+{
+   int err;
+   matchtags_t mt;
+   state_t*    start;
+   state_t*    end;
+
+   if (!rdfa->mman || !rdfa->isDFA || nrtag == 0 || nrtag-1 > (char32_t)-1 - tagfrom) {
+      err = EINVAL;
+      goto ONERR;
+   }
+   const char32_t tagto = tagfrom + (char32_t) (nrtag-1);
+
+   err = init_matchtags(&mt, scratch, rdfa);
+   if (err) goto ONERR;
+
+   // === read str backwards (rdfa matches the reversed tagged string) ===
+   startend_automat(rdfa, &start, &end);
+   size_t levelstart = 0;
+   err = insert_matchtags(&mt, len, start, SIZE_MAX, 0, false);
+   if (err) goto ONERR;
+
+   for (size_t pos = len; ; --pos) {
+      // === follow tag transitions (they do not consume input) ===
+      for (size_t e = levelstart; e < mt.size; ++e) {
+         state_t* state = mt.entry[e].state;
+         foreach (_rangelist, range_trans, &state->rangelist) {
+            if (range_trans->array[range_trans->size-1].to < tagfrom) continue;
+            for (size_t i = 0; i < range_trans->size; ++i) {
+               rangestate_t* range = &range_trans->array[i];
+               if (range->to < tagfrom || range->from > tagto) continue;
+               char32_t from = range->from < tagfrom ? tagfrom : range->from;
+               char32_t to   = range->to > tagto ? tagto : range->to;
+               for (char32_t tag = from; ; ++tag) {
+                  err = insert_matchtags(&mt, pos, range->state, e, tag, true);
+                  if (err) goto ONERR;
+                  if (tag == to) break;
+               }
+            }
+         }
+      }
+
+      if (pos == 0) break;
+
+      // === match str[pos-1] ===
+      const size_t nextstart = mt.size;
+      for (size_t e = levelstart; e < nextstart; ++e) {
+         state_t* next = nextstate_dfa(mt.entry[e].state, str[pos-1]);
+         if (next) {
+            err = insert_matchtags(&mt, pos-1, next, e, str[pos-1], false);
+            if (err) goto ONERR;
+         }
+      }
+      levelstart = nextstart;
+      if (levelstart == mt.size) {
+         err = ESRCH;
+         goto ONERR;
+      }
+   }
+
+   // === find first end state at position 0 ===
+   size_t found = levelstart;
+   while (found < mt.size && mt.entry[found].state->nremptytrans == 0) ++found;
+   if (found == mt.size) {
+      err = ESRCH;
+      goto ONERR;
+   }
+
+   // === following the parents visits the tagged string in forward order ===
+   for (size_t k = 0; k < nrtag; ++k) {
+      tagpos[k] = SIZE_MAX;
+   }
+   size_t pos = 0;
+   for (size_t e = found; mt.entry[e].parent != SIZE_MAX; e = mt.entry[e].parent) {
+      if (mt.entry[e].isTag) {
+         tagpos[mt.entry[e].chr - tagfrom] = pos;
+      } else {
+         ++ pos;
+      }
+   }
+
+   return 0;
+ONERR:
+   if (err != ESRCH) {
+      TRACEEXIT_ERRLOG(err);
+   }
+   return err;
+}
+
 void print_automat(automat_t const* ndfa)
 {
    size_t nr = 0;
@@ -2182,6 +2502,7 @@ int opsequence_automat(automat_t* ndfa, automat_t* ndfa2/*freed after return*/)
    insertlastPlist_slist(&ndfa->states, &ndfa2cpy->states);
    insertlast_statelist(&ndfa->states, endstate);
    insertfirst_statelist(&ndfa->states, startstate);
+   numberstates_automat(ndfa);
 
    // fast free
    decruse_automatmman(ndfa2cpy->mman);
@@ -2233,6 +2554,7 @@ int oprepeat_automat(/*out*/automat_t* ndfa, bool isAtLeastOneTime)
       startstate = (void*) ((uint8_t*)endstate + (state_SIZE + state_SIZE_EMPTYTRANS(1)));
       insertfirst_statelist(&ndfa->states, startstate);
    }
+   numberstates_automat(ndfa);
 
    return 0;
 ONERR:
@@ -2240,72 +2562,259 @@ ONERR:
    return err;
 }
 
-int opor_automat(/*out*/automat_t* ndfa, automat_t* ndfa2/*freed after return*/)
+/* function: repeatchain_automat
+ * Implementiert <oprepeatrange_automat> für einen Automaten ndfa, dessen Startzustand
+ * nur Bereichsübergänge zum Endzustand besitzt. Erzeugt die Kette s_0 -> s_1 -> ... -> s_k,
+ * wobei jeder Zustand s_i mit i >= mincount ein Endzustand ist. Bei unbegrenzter Wiederholung
+ * ist k == mincount und s_k besitzt zusätzlich Übergänge zu sich selbst. */
+static int repeatchain_automat(automat_t* ndfa, size_t mincount, size_t maxcount)
 {
    int err;
-   void * endstate;
-   automat_t copy;
-   automat_t * ndfa2cpy = ndfa2;
-
-   if (ndfa->nrstate < 2 || ndfa2->nrstate < 2) {
-      err = EINVAL;
-      goto ONERR;
-   }
+   void * addr;
+   state_t * start1, * end1;
+   startend_automat(ndfa, &start1, &end1);
 
-   if (ndfa->mman != ndfa2->mman) {
-      err = initcopy_automat(&copy, ndfa2, ndfa);
-      if (err) goto ONERR;
-      ndfa2cpy = &copy; // (ndfa2cpy != ndfa2) ==> copy is marked as used
-      err = free_automat(ndfa2);
-      PROCESS_testerrortimer(&s_automat_errtimer, &err);
-      if (err) goto ONERR;
-   }
+   const bool   isInf   = (maxcount == automat_REPEATINF);
+   const size_t k       = isInf ? mincount : maxcount;
+   const size_t nrrange = start1->nrrangetrans;
+   const size_t SIZE    = (k+2) * state_SIZE + (k+2-mincount) * state_SIZE_EMPTYTRANS(1)
+                        + (isInf ? k+1 : k) * state_SIZE_RANGETRANS(nrrange);
+   slist_t      states  = slist_INIT;
 
-   const size_t SIZE = 2*state_SIZE + state_SIZE_EMPTYTRANS(3);
    if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
-      err = malloc_automatmman(ndfa->mman, SIZE, &endstate);
+      err = malloc_automatmman(ndfa->mman, SIZE, &addr);
    }
    if (err) goto ONERR;
 
-   state_t * startstate = (void*) ((uint8_t*)endstate + (state_SIZE + state_SIZE_EMPTYTRANS(1)));
-   state_t * start1, * end1;
-   startend_automat(ndfa, &start1, &end1);
-   state_t * start2, * end2;
-   startend_automat(ndfa2cpy, &start2, &end2);
-
+   // layout: endstate, s_0, s_1, ..., s_k
+   state_t * endstate = addr;
    initempty_state(endstate, endstate);
-   initempty2_state(startstate, start1, start2);
-   last_emptylist(&end1->emptylist)->state = endstate;
-   last_emptylist(&end2->emptylist)->state = endstate;
+   uint8_t * next = (uint8_t*)endstate + state_SIZE + state_SIZE_EMPTYTRANS(1);
+   for (size_t i = 0; i <= k; ++i) {
+      state_t * state = (state_t*) next;
+      next += state_SIZE;
+      if (i >= mincount) {
+         initempty_state(state, endstate);
+         next += state_SIZE_EMPTYTRANS(1);
+      } else {
+         init_state(state);
+      }
+      if (i < k || isInf) {
+         range_transition_t* trans = (range_transition_t*) next;
+         next += state_SIZE_RANGETRANS(nrrange);
+         state_t * target = (i < k) ? (state_t*) next : state;
+         state->nrrangetrans = nrrange;
+         insertlast_rangelist(&state->rangelist, trans);
+         trans->size = 0;
+         foreach (_rangelist, src_trans, &start1->rangelist) {
+            for (size_t r = 0; r < src_trans->size; ++r) {
+               trans->array[trans->size].from  = src_trans->array[r].from;
+               trans->array[trans->size].to    = src_trans->array[r].to;
+               trans->array[trans->size].state = target;
+               ++ trans->size;
+            }
+         }
+      }
+      insertlast_statelist(&states, state);
+   }
+   insertlast_statelist(&states, endstate);
 
    // set out
-   ndfa->nrstate = 2 + ndfa->nrstate + ndfa2cpy->nrstate;
-   ndfa->allocated = SIZE + ndfa->allocated + ndfa2cpy->allocated;
-   ndfa->isDFA = 0;
-   insertlastPlist_slist(&ndfa->states, &ndfa2cpy->states);
-   insertlast_statelist(&ndfa->states, endstate);
-   insertfirst_statelist(&ndfa->states, startstate);
-
-   // fast free
-   decruse_automatmman(ndfa2cpy->mman);
-   if (ndfa2cpy == ndfa2) *ndfa2 = (automat_t) automat_FREE;
+   incrwasted_automatmman(ndfa->mman, ndfa->allocated);
+   ndfa->nrstate   = k + 2;
+   ndfa->allocated = SIZE;
+   ndfa->states    = states;
+   ndfa->isDFA     = 0;
+   numberstates_automat(ndfa);
 
    return 0;
 ONERR:
-   if (ndfa2cpy != ndfa2) {
-      initmove_automat(ndfa2, ndfa2cpy);
-   }
    TRACEEXIT_ERRLOG(err);
    return err;
 }
 
-// group: optimize
-
-static int follow_empty_transition(multistate_t *multistate, automat_mman_t *mman)
+/* function: ischarset_automat
+ * Liefert true, falls ndfa nur aus Start- und Endzustand besteht und der Startzustand
+ * nur Bereichsübergänge zum Endzustand besitzt, so wie es <initmatch_automat> erzeugt. */
+static bool ischarset_automat(const automat_t* ndfa)
 {
-   int err;
-   multistate_iter_t iter;
-   state_t          *next;
+   if (ndfa->nrstate != 2) return false;
+   state_t * start, * end;
+   startend_automat(ndfa, &start, &end);
+   if (start->nremptytrans != 0 || start->nrrangetrans == 0 || start->nrrangetrans > 256) return false;
+   if (end->nrrangetrans != 0 || end->nremptytrans != 1) return false;
+   foreach (_rangelist, trans, &start->rangelist) {
+      for (size_t i = 0; i < trans->size; ++i) {
+         if (trans->array[i].state != end) return false;
+      }
+   }
+   return true;
+}
+
+int oprepeatrange_automat(automat_t* ndfa, size_t mincount, size_t maxcount)
+{
+   int err;
+   automat_t result = automat_FREE;
+   automat_t copy   = automat_FREE;
+   automat_t empty  = automat_FREE;
+   size_t    nrmandatory = mincount;
+
+   if (  ndfa->nrstate < 2 || mincount > maxcount || mincount > automat_MAXREPEAT
+         || (maxcount > automat_MAXREPEAT && maxcount != automat_REPEATINF)) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   if (ischarset_automat(ndfa)) {
+      // counted loop: linear chain of states
+      err = repeatchain_automat(ndfa, mincount, maxcount);
+      if (err) goto ONERR;
+      return 0;
+   }
+
+   // === build optional part (result) ===
+   if (maxcount == automat_REPEATINF) {
+      // X{m,} == X{m-1}X+
+      err = initcopy_automat(&result, ndfa, ndfa);
+      if (err) goto ONERR;
+      err = oprepeat_automat(&result, mincount > 0);
+      if (err) goto ONERR;
+      if (mincount) -- nrmandatory;
+   } else if (maxcount == mincount) {
+      if (mincount) {
+         err = initcopy_automat(&result, ndfa, ndfa);
+         -- nrmandatory;
+      } else {
+         err = initempty_automat(&result, ndfa);
+      }
+      if (err) goto ONERR;
+   } else {
+      // X{0,n} == (X(X(X)?)?)?
+      for (size_t i = mincount; i < maxcount; ++i) {
+         err = initcopy_automat(&copy, ndfa, ndfa);
+         if (err) goto ONERR;
+         if (i != mincount) {
+            err = opsequence_automat(&copy, &result);
+            if (err) goto ONERR;
+         }
+         err = initempty_automat(&empty, ndfa);
+         if (err) goto ONERR;
+         err = opor_automat(&copy, &empty);
+         if (err) goto ONERR;
+         initmove_automat(&result, &copy);
+      }
+   }
+
+   // === prepend mandatory part ===
+   for (size_t i = 0; i < nrmandatory; ++i) {
+      err = initcopy_automat(&copy, ndfa, ndfa);
+      if (err) goto ONERR;
+      err = opsequence_automat(&copy, &result);
+      if (err) goto ONERR;
+      initmove_automat(&result, &copy);
+   }
+
+   // set out
+   err = free_automat(ndfa);
+   initmove_automat(ndfa, &result);
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   (void) free_automat(&result);
+   (void) free_automat(&copy);
+   (void) free_automat(&empty);
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int opor_automat(/*out*/automat_t* ndfa, automat_t* ndfa2/*freed after return*/)
+{
+   int err;
+   void * endstate;
+   automat_t copy;
+   automat_t * ndfa2cpy = ndfa2;
+
+   if (ndfa->nrstate < 2 || ndfa2->nrstate < 2) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   if (ndfa->mman != ndfa2->mman) {
+      err = initcopy_automat(&copy, ndfa2, ndfa);
+      if (err) goto ONERR;
+      ndfa2cpy = &copy; // (ndfa2cpy != ndfa2) ==> copy is marked as used
+      err = free_automat(ndfa2);
+      PROCESS_testerrortimer(&s_automat_errtimer, &err);
+      if (err) goto ONERR;
+   }
+
+   const size_t SIZE = 2*state_SIZE + state_SIZE_EMPTYTRANS(3);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      err = malloc_automatmman(ndfa->mman, SIZE, &endstate);
+   }
+   if (err) goto ONERR;
+
+   state_t * startstate = (void*) ((uint8_t*)endstate + (state_SIZE + state_SIZE_EMPTYTRANS(1)));
+   state_t * start1, * end1;
+   startend_automat(ndfa, &start1, &end1);
+   state_t * start2, * end2;
+   startend_automat(ndfa2cpy, &start2, &end2);
+
+   initempty_state(endstate, endstate);
+   initempty2_state(startstate, start1, start2);
+   last_emptylist(&end1->emptylist)->state = endstate;
+   last_emptylist(&end2->emptylist)->state = endstate;
+
+   // set out
+   ndfa->nrstate = 2 + ndfa->nrstate + ndfa2cpy->nrstate;
+   ndfa->allocated = SIZE + ndfa->allocated + ndfa2cpy->allocated;
+   ndfa->isDFA = 0;
+   insertlastPlist_slist(&ndfa->states, &ndfa2cpy->states);
+   insertlast_statelist(&ndfa->states, endstate);
+   insertfirst_statelist(&ndfa->states, startstate);
+   numberstates_automat(ndfa);
+
+   // fast free
+   decruse_automatmman(ndfa2cpy->mman);
+   if (ndfa2cpy == ndfa2) *ndfa2 = (automat_t) automat_FREE;
+
+   return 0;
+ONERR:
+   if (ndfa2cpy != ndfa2) {
+      initmove_automat(ndfa2, ndfa2cpy);
+   }
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int opmatchid_automat(automat_t* ndfa, uint32_t matchid)
+{
+   int err;
+   automat_t idmatch = automat_FREE;
+   char32_t  idchar  = matchid_CHAR(matchid);
+
+   VALIDATE_INPARAM_TEST(ndfa->mman && matchid <= automat_MAXMATCHID, ONERR, );
+
+   err = initmatch_automat(&idmatch, ndfa, 1, &idchar, &idchar);
+   if (err) goto ONERR;
+   err = opsequence_automat(ndfa, &idmatch);
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   (void) free_automat(&idmatch);
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+// group: optimize
+
+static int follow_empty_transition(multistate_t *multistate, automat_mman_t *mman)
+{
+   int err;
+   multistate_iter_t iter;
+   state_t          *next;
    statearray_t      stateemptylist = statearray_FREE;
 
    err = init_statearray(&stateemptylist);
@@ -2636,6 +3145,7 @@ int makedfa_automat(automat_t* ndfa)
    ndfa->allocated = allocated;
    ndfa->states = dfa_states;
    ndfa->isDFA  = 1;
+   numberstates_automat(ndfa);
    if (err) goto ONERR;
 
    return 0;
@@ -2647,37 +3157,192 @@ ONERR:
    return err;
 }
 
-int minimize_automat(automat_t* ndfa)
+/* define: dfapar_NRSHARD
+ * Anzahl unabhängig gesperrter Teilindizes in <dfapar_t.shard>. */
+#define dfapar_NRSHARD 64
+
+/* define: dfapar_MAXTHREAD
+ * Maximale Anzahl an Threads, die <makedfapar_automat> verwendet. */
+#define dfapar_MAXTHREAD 64
+
+/* define: dfapar_MAXTRANSPERBLOCK
+ * Maximale Anzahl an <rangestate_t> in einem von <expand_dfapar> allokierten <range_transition_t>. */
+#define dfapar_MAXTRANSPERBLOCK 1024
+
+/* struct: dfapar_item_t
+ * Ein noch nicht bearbeiteter Multi-Zustand der aktuellen Ebene.
+ * Die Felder isendstate, nrtrans und translist werden parallel von <expand_dfapar> berechnet.
+ * Die Ziele in translist zeigen auf eindeutige <statevector_t> aus dem Index. */
+typedef struct dfapar_item_t {
+   statevector_t* svec;
+   bool           isendstate;
+   size_t         nrtrans;
+   slist_t        translist; // list of range_transition_t
+} dfapar_item_t;
+
+/* struct: dfapar_shard_t
+ * Ein Teil des Index aller <statevector_t>. Der Teil wird über den Hashwert des Vektors ausgewählt. */
+typedef struct dfapar_shard_t {
+   pthread_mutex_t lock;
+   patriciatrie_t  index;
+} dfapar_shard_t;
+
+/* struct: dfapar_worker_t
+ * Threadlokale Daten. Jeder Thread allokiert nur aus seinen eigenen <automat_mman_t>. */
+typedef struct dfapar_worker_t {
+   pthread_t        thread;
+   struct dfapar_t* par;
+   int              err;
+   automat_mman_t*  mman[4]; // STATEVEC, RANGEMAP, MULTISTATE, TRANS
+} dfapar_worker_t;
+
+/* struct: dfapar_t
+ * Gemeinsame Daten aller Threads von <makedfapar_automat>. */
+typedef struct dfapar_t {
+   state_t*         endstate;  // endstate of ndfa
+   size_t           nritem;    // number of items in current level
+   dfapar_item_t*   item;      // array of items of current level
+   size_t           nextitem;  // next unprocessed item (incremented atomically)
+   int              err;       // != 0 ==> stop processing
+   dfapar_shard_t   shard[dfapar_NRSHARD];
+} dfapar_t;
+
+enum { DFAPAR_STATEVEC, DFAPAR_RANGEMAP, DFAPAR_MULTISTATE, DFAPAR_TRANS };
+
+/* function: shard_dfapar
+ * Liefert den Teilindex, in dem svec gespeichert wird (FNV-1a über die Zustandszeiger). */
+static dfapar_shard_t* shard_dfapar(dfapar_t* par, const statevector_t* svec)
+{
+   uint64_t hash = 14695981039346656037u;
+   foreach (_stateblocklist, block, &svec->blocklist) {
+      for (size_t i = 0; i < block->nrstate; ++i) {
+         hash ^= (uintptr_t) block->state[i];
+         hash *= 1099511628211u;
+      }
+   }
+   return &par->shard[(hash ^ (hash >> 32)) % dfapar_NRSHARD];
+}
+
+/* function: insert_dfapar
+ * Fügt svec in den Index ein oder gibt in *existing den schon vorhandenen gleichen Vektor zurück.
+ *
+ * Returns:
+ * 0      - svec eingefügt.
+ * EEXIST - Gleicher Vektor schon vorhanden. *existing zeigt auf ihn. */
+static int insert_dfapar(dfapar_t* par, statevector_t* svec, /*out*/statevector_t** existing)
 {
    int err;
-   automat_t ndfa2 = automat_FREE;
-   automat_t ndfa3 = automat_FREE;
+   patriciatrie_node_t* existing_node;
+   dfapar_shard_t*      shard = shard_dfapar(par, svec);
 
-   err = initreverse_automat(&ndfa2, ndfa, 0);
-   if (err) goto ONERR;
-   err = makedfa_automat(&ndfa2);
-   if (err) goto ONERR;
-   err = initreverse_automat(&ndfa3, &ndfa2, 0);
-   if (err) goto ONERR;
-   err = free_automat(&ndfa2);
-   if (err) goto ONERR;
-   err = makedfa_automat(&ndfa3);
-   if (err) goto ONERR;
-   err = free_automat(ndfa);
-   initmove_automat(ndfa, &ndfa3);
+   pthread_mutex_lock(&shard->lock);
+   err = insert_patriciatrie(&shard->index, &svec->index, &existing_node);
+   pthread_mutex_unlock(&shard->lock);
+
+   if (err == EEXIST) {
+      *existing = (void*) ((uintptr_t)existing_node - offsetof(statevector_t, index));
+   }
+
+   return err;
+}
+
+/* function: expand_dfapar
+ * Berechnet alle Übergänge des Multi-Zustandes item->svec.
+ * Die Ziel-Multi-Zustände werden durch leere Übergänge erweitert und
+ * über den gemeinsamen Index eindeutig gemacht. */
+static int expand_dfapar(dfapar_worker_t* worker, dfapar_item_t* item)
+{
+   int err;
+   void* addr;
+   dfapar_t*          par  = worker->par;
+   automat_mman_t**   mman = worker->mman;
+   rangemap_t         rmap;
+   range_transition_t *trans = 0;
+   size_t             nrfree = 0;
+
+   err = build_rangemap_from_statevector(&rmap, mman[DFAPAR_RANGEMAP], item->svec);
    if (err) goto ONERR;
 
+   item->isendstate = iscontained_statevector(item->svec, par->endstate);
+   item->nrtrans    = rmap.size;
+   item->translist  = (slist_t) slist_INIT;
+
+   range_t *range;
+   rangemap_iter_t iter;
+   init_rangemapiter(&iter, &rmap);
+   while (next_rangemapiter(&iter, &range)) {
+      statevector_t* new_statevec;
+      err = follow_empty_transition(&range->multistate, mman[DFAPAR_MULTISTATE]);
+      if (err) goto ONERR;
+      automat_mman_state_t oldstate;
+      storestate_automatmman(mman[DFAPAR_STATEVEC], &oldstate); // statevector_t makes more than one allocation !
+      err = init_statevector(&new_statevec, statevector_MAXSTATEPERBLOCK, mman[DFAPAR_STATEVEC], &range->multistate);
+      if (err) goto ONERR;
+      reset_automatmman(mman[DFAPAR_MULTISTATE]);
+      statevector_t* existing;
+      err = insert_dfapar(par, new_statevec, &existing);
+      if (err) {
+         if (err != EEXIST) goto ONERR;
+         restore_automatmman(mman[DFAPAR_STATEVEC], &oldstate);
+         new_statevec = existing;
+      }
+      if (! nrfree) {
+         nrfree = rmap.size < dfapar_MAXTRANSPERBLOCK ? rmap.size : dfapar_MAXTRANSPERBLOCK;
+         err = malloc_automatmman(mman[DFAPAR_TRANS], state_SIZE_RANGETRANS(nrfree), &addr);
+         if (err) goto ONERR;
+         trans = addr;
+         trans->size = 0;
+         insertlast_rangelist(&item->translist, trans);
+      }
+      -- nrfree;
+      trans->array[trans->size].from  = range->from;
+      trans->array[trans->size].to    = range->to;
+      trans->array[trans->size].state = (state_t*) new_statevec;
+      ++ trans->size;
+   }
+   reset_automatmman(mman[DFAPAR_RANGEMAP]);
+
    return 0;
 ONERR:
-   (void) free_automat(&ndfa2);
-   (void) free_automat(&ndfa3);
    TRACEEXIT_ERRLOG(err);
    return err;
 }
 
-typedef enum { OP_AND, OP_AND_NOT } op_e;
+/* function: main_dfapar
+ * Threadfunktion. Bearbeitet solange <dfapar_item_t> der aktuellen Ebene,
+ * bis alle vergeben sind oder ein anderer Thread einen Fehler gemeldet hat. */
+static void* main_dfapar(void* arg)
+{
+   dfapar_worker_t* worker = arg;
+   dfapar_t*        par    = worker->par;
+
+   while (0 == __atomic_load_n(&par->err, __ATOMIC_RELAXED)) {
+      size_t i = __atomic_fetch_add(&par->nextitem, 1, __ATOMIC_RELAXED);
+      if (i >= par->nritem) break;
+      worker->err = expand_dfapar(worker, &par->item[i]);
+      if (worker->err) {
+         __atomic_store_n(&par->err, worker->err, __ATOMIC_RELAXED);
+         break;
+      }
+   }
 
-static int makedfa2_automat(automat_t* ndfa, op_e op, automat_t* ndfa2)
+   return 0;
+}
+
+/* function: makedfapar_automat
+ * Implementiert <makedfa_automat> mit nrthread Threads.
+ *
+ * Die Multi-Zustände werden ebenenweise (Breitensuche) bearbeitet.
+ * Alle Multi-Zustände einer Ebene werden parallel expandiert (siehe <expand_dfapar>).
+ * Jeder Thread allokiert nur aus seinen eigenen <automat_mman_t>.
+ * Der Index bereits bekannter Multi-Zustände ist in <dfapar_NRSHARD> Teile zerlegt,
+ * von denen jeder durch eine eigene Sperre geschützt ist.
+ *
+ * Danach werden die DFA Zustände der Ebene von einem einzigen Thread in der Reihenfolge
+ * der Ebene erzeugt. Die Multi-Zustände der nächsten Ebene werden in der Reihenfolge
+ * ihres ersten Auftretens in den Übergängen eingereiht. Deshalb ist der erzeugte Automat
+ * unabhängig von der Anzahl der Threads und gleicht dem von <makedfa_automat> erzeugten. */
+int makedfapar_automat(automat_t* ndfa, unsigned nrthread)
 {
    int err;
    void* addr;
@@ -2686,172 +3351,186 @@ static int makedfa2_automat(automat_t* ndfa, op_e op, automat_t* ndfa2)
    slist_t         dfa_states = slist_INIT;
    multistate_t    multistate = multistate_INIT;
    statevector_t   * new_statevec = 0;
-   automat_mman_t  * mman[4] = { 0 };
+   automat_mman_t  * dfa_mman = 0;
+   dfapar_t        * par = 0;
+   dfapar_worker_t * worker = 0;
+   size_t          maxitem = 0;
    slist_t         unprocessed;
-   patriciatrie_t  svec_index;
-   enum { DFA, STATEVEC, RANGEMAP, MULTISTATE };
-   state_t *startstate,  *endstate;
-   state_t *startstate2, *endstate2;
+   size_t          nrunprocessed;
+   unsigned        nrshard = 0;
+   unsigned        nrworker = 0;
+   state_t *startstate;
 
-   if (! ndfa->mman || !ndfa2->mman) {
+   if (nrthread == 0) {
+      long nrcpu = sysconf(_SC_NPROCESSORS_ONLN);
+      nrthread = nrcpu > 0 ? (unsigned) nrcpu : 1;
+   }
+   if (nrthread > dfapar_MAXTHREAD) nrthread = dfapar_MAXTHREAD;
+
+   if (! ndfa->mman) {
       err = EINVAL;
       goto ONERR;
    }
 
    remove_single_empty_transitions(ndfa);
-   remove_single_empty_transitions(ndfa2);
 
    // init local var
-   init_patriciatrie(&svec_index, keyadapter_statevector());
-   startend_automat(ndfa, &startstate, &endstate);
-   startend_automat(ndfa2, &startstate2, &endstate2);
-   for (size_t i = 0; i < lengthof(mman); ++i) {
-      err = new_automatmman(&mman[i]);
-      if (err) goto ONERR;
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      par    = calloc(1, sizeof(dfapar_t));
+      worker = malloc(nrthread * sizeof(dfapar_worker_t));
+      err = par && worker ? 0 : ENOMEM;
    }
-
-   // flag used to discriminate between the owner automaton of the state
-   foreach (_statelist, s, &ndfa->states) {
-      s->nrdfa = 1;
+   if (err) goto ONERR;
+   startend_automat(ndfa, &startstate, &par->endstate);
+   for (; nrshard < dfapar_NRSHARD; ++nrshard) {
+      err = pthread_mutex_init(&par->shard[nrshard].lock, 0);
+      if (err) goto ONERR;
+      init_patriciatrie(&par->shard[nrshard].index, keyadapter_statevector());
    }
-   foreach (_statelist, s, &ndfa2->states) {
-      s->nrdfa = 2;
+   for (; nrworker < nrthread; ++nrworker) {
+      worker[nrworker].par = par;
+      worker[nrworker].err = 0;
+      memset(worker[nrworker].mman, 0, sizeof(worker[nrworker].mman));
+      for (size_t i = 0; i < lengthof(worker[nrworker].mman); ++i) {
+         err = new_automatmman(&worker[nrworker].mman[i]);
+         if (err) { ++ nrworker; goto ONERR; }
+      }
    }
+   err = new_automatmman(&dfa_mman);
+   if (err) goto ONERR;
 
    // generate start state of type statevector_t
-   err = add_multistate(&multistate, mman[MULTISTATE], startstate);
+   automat_mman_t** mman = worker[0].mman;
+   err = add_multistate(&multistate, mman[DFAPAR_MULTISTATE], startstate);
    if (err) goto ONERR;
-   err = add_multistate(&multistate, mman[MULTISTATE], startstate2);
+   err = follow_empty_transition(&multistate, mman[DFAPAR_MULTISTATE]);
    if (err) goto ONERR;
-   err = follow_empty_transition(&multistate, mman[MULTISTATE]);
+   err = init_statevector(&new_statevec, statevector_MAXSTATEPERBLOCK, mman[DFAPAR_STATEVEC], &multistate);
    if (err) goto ONERR;
-   // convert type from multistate_t into statevector_t
-   err = init_statevector(&new_statevec, statevector_MAXSTATEPERBLOCK, mman[STATEVEC], &multistate);
+   reset_automatmman(mman[DFAPAR_MULTISTATE]);
+   statevector_t* existing;
+   err = insert_dfapar(par, new_statevec, &existing);
    if (err) goto ONERR;
-   // store start state in list of unprocessed states and in index
    initsingle_stateveclist(&unprocessed, new_statevec);
-   err = insert_patriciatrie(&svec_index, &new_statevec->index, 0);
-   if (err) goto ONERR;
-   reset_automatmman(mman[MULTISTATE]);
+   nrunprocessed = 1;
 
    void* dfa_endstate;
    allocated = state_SIZE + state_SIZE_EMPTYTRANS(1);
    if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
-      err = malloc_automatmman(mman[DFA], allocated, &dfa_endstate);
+      err = malloc_automatmman(dfa_mman, allocated, &dfa_endstate);
    }
    if (err) goto ONERR;
    ++ nrstate;
    initempty_state(dfa_endstate, dfa_endstate);
 
-   // process all unprocessed statevector_t
-   //   (every statevecor_t is a single state in the new build dfa)
-   // the first processed state is also the start state
-   while (! isempty_slist(&unprocessed)) {
-      statevector_t *statevec = removefirst_stateveclist(&unprocessed);
-
-      // build rangemap_t from statevec
-      // For every r in ranges:
-      //  extend r.state with all reachable states by following empty transitions
-      //  convert r.state of type multistate_t into type statevector_t
-      //  add r as transition to new dfa-state with pointer to converted statevector
-
-      rangemap_t rmap;
-      err = build_rangemap_from_statevector(&rmap, mman[RANGEMAP], statevec);
-      if (err) goto ONERR;
-
-      const bool isendstate = iscontained_statevector(statevec, endstate)
-                              && ((op == OP_AND && iscontained_statevector(statevec, endstate2))
-                                  || (op == OP_AND_NOT && ! iscontained_statevector(statevec, endstate2)));
-
-      if (isendstate && rmap.size == 0 && nrstate != 1/*not start state*/) {
-         // optimization if state is only an end state (except for start state)
-         // do not generate state which contains only a single empty transition to end state
-         statevec->dfa = dfa_endstate;
-         continue; // while (! isempty_slist(&unprocessed))
-      }
+   // process all levels of unprocessed statevector_t
+   //   (statevector_t->next != 0 marks a statevector_t which was queued once)
+   while (nrunprocessed) {
 
-      state_t *dfastate;
-      {
-         const size_t SIZE = state_SIZE + (isendstate ? state_SIZE_EMPTYTRANS(1) : 0);
+      // === copy level into par->item ===
+      if (nrunprocessed > maxitem) {
+         void* newitem = 0;
          if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
-            err = malloc_automatmman(mman[DFA], SIZE, &addr);
+            newitem = realloc(par->item, 2 * nrunprocessed * sizeof(dfapar_item_t));
+            err = newitem ? 0 : ENOMEM;
          }
          if (err) goto ONERR;
-         allocated += SIZE;
-         dfastate = addr;
-         if (isendstate) {
-            initempty_state(dfastate, dfa_endstate);
-         } else {
-            init_state(dfastate);
+         par->item = newitem;
+         maxitem = 2 * nrunprocessed;
+      }
+      par->nritem = 0;
+      foreach (_stateveclist, statevec, &unprocessed) {
+         par->item[par->nritem++].svec = statevec;
+      }
+      par->nextitem = 0;
+      unprocessed   = (slist_t) slist_INIT;
+      nrunprocessed = 0;
+
+      // === expand all items of level in parallel ===
+      // small levels are processed by the calling thread
+      unsigned nrstarted = 0;
+      if (nrthread > 1 && par->nritem >= 2*nrthread) {
+         for (; nrstarted < nrthread-1; ++nrstarted) {
+            if (pthread_create(&worker[1+nrstarted].thread, 0, &main_dfapar, &worker[1+nrstarted])) break;
          }
       }
+      main_dfapar(&worker[0]);
+      for (unsigned i = 1; i <= nrstarted; ++i) {
+         pthread_join(worker[i].thread, 0);
+      }
+      err = par->err;
+      if (err) goto ONERR;
 
-      range_transition_t dummytrans = { .size = 1 };
-      range_transition_t *prevtrans = &dummytrans;
+      // === build dfa states of level in order ===
+      for (size_t itemnr = 0; itemnr < par->nritem; ++itemnr) {
+         dfapar_item_t* item = &par->item[itemnr];
 
-      range_t *range;
-      rangemap_iter_t iter;
-      init_rangemapiter(&iter, &rmap);
-      while (next_rangemapiter(&iter, &range)) {
-         err = follow_empty_transition(&range->multistate, mman[MULTISTATE]);
-         if (err) goto ONERR;
-         automat_mman_state_t oldstate;
-         storestate_automatmman(mman[STATEVEC], &oldstate); // statevector_t makes more than one allocation !
-         err = init_statevector(&new_statevec, statevector_MAXSTATEPERBLOCK, mman[STATEVEC], &range->multistate);
-         if (err) goto ONERR;
-         reset_automatmman(mman[MULTISTATE]);
-         if (! isnrdfa12_statevector(new_statevec, op == OP_AND)) {
-            // Optimization: end state can not be reached by new_statevec
-            //               ==> do not add any transition
-            restore_automatmman(mman[STATEVEC], &oldstate);
+         if (item->isendstate && item->nrtrans == 0 && nrstate != 1/*not start state*/) {
+            // optimization if state is only an end state (except for start state)
+            // do not generate state which contains only a single empty transition to end state
+            item->svec->dfa = dfa_endstate;
             continue;
          }
-         patriciatrie_node_t *existing_node;
-         err = insert_patriciatrie(&svec_index, &new_statevec->index, &existing_node);
-         if (! err) {
-            insertlast_stateveclist(&unprocessed, new_statevec);
-         } else {
-            if (err != EEXIST) goto ONERR;
-            restore_automatmman(mman[STATEVEC], &oldstate);
-            new_statevec = (void*) ((uintptr_t)existing_node - offsetof(statevector_t, index));
-         }
-         if (  (state_t*)new_statevec == prevtrans->array[prevtrans->size-1].state
-               && range->from == prevtrans->array[prevtrans->size-1].to+1) {
-            // transition optimizer
-            prevtrans->array[prevtrans->size-1].to = range->to;
-         } else {
-            // add new transition
-            err = malloc_automatmman(mman[DFA], state_SIZE_RANGETRANS(1), &addr);
+
+         state_t* dfastate;
+         {
+            const size_t SIZE = state_SIZE + (item->isendstate ? state_SIZE_EMPTYTRANS(1) : 0);
+            if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+               err = malloc_automatmman(dfa_mman, SIZE, &addr);
+            }
             if (err) goto ONERR;
-            if (addr == &prevtrans->array[prevtrans->size]) {
-               allocated += state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0);
-               err = mfreelast_automatmman(mman[DFA], (uint8_t*)addr + (state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0)));
-               if (err) goto ONERR;
-               prevtrans->size += 1;
+            allocated += SIZE;
+            dfastate = addr;
+            if (item->isendstate) {
+               initempty_state(dfastate, dfa_endstate);
             } else {
-               allocated += state_SIZE_RANGETRANS(1);
-               prevtrans = addr;
-               insertlast_rangelist(&dfastate->rangelist, prevtrans);
-               prevtrans->size = 1;
+               init_state(dfastate);
             }
-            ++ dfastate->nrrangetrans;
-            prevtrans->array[prevtrans->size-1].from  = range->from;
-            prevtrans->array[prevtrans->size-1].to    = range->to;
-            prevtrans->array[prevtrans->size-1].state = (state_t*) new_statevec;
          }
-      }
-      reset_automatmman(mman[RANGEMAP]);
-      if (! dfastate->nrrangetrans && isendstate && nrstate != 1/*not start state*/) {
-         // remove empty state
-         const size_t SIZE = state_SIZE + state_SIZE_EMPTYTRANS(1);
-         statevec->dfa = dfa_endstate;
-         err = mfreelast_automatmman(mman[DFA], dfastate);
-         if (err) goto ONERR;
-         allocated -= SIZE;
-      } else {
-         statevec->dfa = dfastate;
+
+         item->svec->dfa = dfastate;
          ++ nrstate;
          insertlast_statelist(&dfa_states, dfastate);
+
+         range_transition_t dummytrans = { .size = 1 };
+         range_transition_t *prevtrans = &dummytrans;
+
+         foreach (_rangelist, trans, &item->translist) {
+            for (size_t s = 0; s < trans->size; ++s) {
+               rangestate_t* range = &trans->array[s];
+               statevector_t* target = (statevector_t*) range->state;
+               if (! target->next) {
+                  insertlast_stateveclist(&unprocessed, target);
+                  ++ nrunprocessed;
+               }
+               if (  range->state == prevtrans->array[prevtrans->size-1].state
+                     && range->from == prevtrans->array[prevtrans->size-1].to+1) {
+                  // transition optimizer
+                  prevtrans->array[prevtrans->size-1].to = range->to;
+               } else {
+                  // add new transition
+                  err = malloc_automatmman(dfa_mman, state_SIZE_RANGETRANS(1), &addr);
+                  if (err) goto ONERR;
+                  if (addr == &prevtrans->array[prevtrans->size]) {
+                     allocated += state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0);
+                     err = mfreelast_automatmman(dfa_mman, (uint8_t*)addr + (state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0)));
+                     if (err) goto ONERR;
+                     prevtrans->size += 1;
+                  } else {
+                     allocated += state_SIZE_RANGETRANS(1);
+                     prevtrans = addr;
+                     insertlast_rangelist(&dfastate->rangelist, prevtrans);
+                     prevtrans->size = 1;
+                  }
+                  ++ dfastate->nrrangetrans;
+                  prevtrans->array[prevtrans->size-1] = *range;
+               }
+            }
+         }
+      }
+
+      for (unsigned i = 0; i < nrthread; ++i) {
+         reset_automatmman(worker[i].mman[DFAPAR_TRANS]);
       }
    }
 
@@ -2868,15 +3547,22 @@ static int makedfa2_automat(automat_t* ndfa, op_e op, automat_t* ndfa2)
       }
    }
 
-   for (size_t i = 0; i < lengthof(mman); ++i) {
-      if (i == DFA) continue;
-      err = delete_automatmman(&mman[i]);
-      if (err) goto ONERR;
+   for (unsigned i = 0; i < nrthread; ++i) {
+      for (size_t m = 0; m < lengthof(worker[i].mman); ++m) {
+         err = delete_automatmman(&worker[i].mman[m]);
+         if (err) goto ONERR;
+      }
    }
-   automat_mman_t * dfa_mman = mman[DFA];
-   mman[DFA] = 0;
+   for (unsigned i = 0; i < dfapar_NRSHARD; ++i) {
+      pthread_mutex_destroy(&par->shard[i].lock);
+   }
+   free(par->item);
+   free(par);
+   free(worker);
+   par = 0;
+   worker = 0;
 
-   // set out (change ndfa even in case of error in free to valid state)
+   // set out (change ndfa even in case of error to valid state)
    incruse_automatmman(dfa_mman);
    err = free_automat(ndfa);
    ndfa->mman = dfa_mman;
@@ -2884,1725 +3570,4314 @@ static int makedfa2_automat(automat_t* ndfa, op_e op, automat_t* ndfa2)
    ndfa->allocated = allocated;
    ndfa->states = dfa_states;
    ndfa->isDFA  = 1;
+   numberstates_automat(ndfa);
+   dfa_mman = 0;
    if (err) goto ONERR;
 
    return 0;
 ONERR:
-   for (size_t i = 0; i < lengthof(mman); ++i) {
-      delete_automatmman(&mman[i]);
+   delete_automatmman(&dfa_mman);
+   if (worker) {
+      for (unsigned i = 0; i < nrworker; ++i) {
+         for (size_t m = 0; m < lengthof(worker[i].mman); ++m) {
+            delete_automatmman(&worker[i].mman[m]);
+         }
+      }
    }
+   if (par) {
+      for (unsigned i = 0; i < nrshard; ++i) {
+         pthread_mutex_destroy(&par->shard[i].lock);
+      }
+      free(par->item);
+   }
+   free(par);
+   free(worker);
    TRACEEXIT_ERRLOG(err);
    return err;
 }
 
-int opand_automat(automat_t* restrict ndfa, automat_t* restrict ndfa2)
+int minimize_automat(automat_t* ndfa)
 {
    int err;
+   automat_t ndfa2 = automat_FREE;
+   automat_t ndfa3 = automat_FREE;
 
-   err = makedfa2_automat(ndfa, OP_AND, ndfa2);
+   err = initreverse_automat(&ndfa2, ndfa, 0);
    if (err) goto ONERR;
-   err = free_automat(ndfa2);
+   err = makedfa_automat(&ndfa2);
+   if (err) goto ONERR;
+   err = initreverse_automat(&ndfa3, &ndfa2, 0);
+   if (err) goto ONERR;
+   err = free_automat(&ndfa2);
+   if (err) goto ONERR;
+   err = makedfa_automat(&ndfa3);
+   if (err) goto ONERR;
+   err = free_automat(ndfa);
+   initmove_automat(ndfa, &ndfa3);
    if (err) goto ONERR;
 
    return 0;
 ONERR:
+   (void) free_automat(&ndfa2);
+   (void) free_automat(&ndfa3);
    TRACEEXIT_ERRLOG(err);
    return err;
 }
 
-int opandnot_automat(automat_t* restrict ndfa, automat_t* restrict ndfa2)
+/* struct: partition_t
+ * Zerlegung der Menge {0..size-1} in disjunkte Teilmengen.
+ * Die Elemente der Teilmenge s liegen in elem[first[s]..past[s]-1].
+ * Wird von <minimizehopcroft_automat> für die Zerlegung der Zustände in Blöcke verwendet.
+ * Siehe auch: A. Valmari, P. Lehtinen: Efficient minimization of DFAs with partial transition functions (2008). */
+typedef struct partition_t {
+   uint32_t  nrset;  // number of sets
+   uint32_t* elem;   // elements ordered by set
+   uint32_t* loc;    // elem[loc[e]] == e
+   uint32_t* set;    // set[e] == number of set containing e
+   uint32_t* first;  // elem[first[s]] == first element of set s
+   uint32_t* past;   // elem[past[s]-1] == last element of set s
+} partition_t;
+
+/* struct: refinement_t
+ * Gemeinsame Hilfsdaten zum Verfeinern von <partition_t>.
+ * Die Felder sind nur zwischen <mark_partition> und <split_partition> ungleich 0. */
+typedef struct refinement_t {
+   uint32_t* nrmarked;  // nrmarked[s] == number of marked elements in set s
+   uint32_t* touched;   // stack of sets which contain marked elements
+   uint32_t  nrtouched; // size of stack touched
+} refinement_t;
+
+// group: lifetime
+
+static void init_partition(/*out*/partition_t* part, uint32_t size, uint32_t mem[5*size])
 {
-   int err;
+   part->nrset = (size != 0);
+   part->elem  = mem;
+   part->loc   = mem + size;
+   part->set   = mem + 2*size;
+   part->first = mem + 3*size;
+   part->past  = mem + 4*size;
+   for (uint32_t i = 0; i < size; ++i) {
+      part->elem[i] = part->loc[i] = i;
+      part->set[i]  = 0;
+   }
+   if (size) {
+      part->first[0] = 0;
+      part->past[0]  = size;
+   }
+}
 
-   err = makedfa2_automat(ndfa, OP_AND_NOT, ndfa2);
-   if (err) goto ONERR;
-   err = free_automat(ndfa2);
-   if (err) goto ONERR;
+// group: update
 
-   return 0;
-ONERR:
-   TRACEEXIT_ERRLOG(err);
-   return err;
+/* function: mark_partition
+ * Verschiebt e an den Anfang seiner Teilmenge und merkt diese zum Aufspalten vor. */
+static inline void mark_partition(partition_t* part, refinement_t* ref, uint32_t e)
+{
+   uint32_t s = part->set[e];
+   uint32_t i = part->loc[e];
+   uint32_t j = part->first[s] + ref->nrmarked[s];
+   part->elem[i] = part->elem[j];
+   part->loc[part->elem[i]] = i;
+   part->elem[j] = e;
+   part->loc[e]  = j;
+   if (! ref->nrmarked[s]++) {
+      ref->touched[ref->nrtouched++] = s;
+   }
 }
 
-int opnot_automat(automat_t* restrict ndfa)
+/* function: split_partition
+ * Spaltet jede teilweise markierte Teilmenge in markierte und unmarkierte Elemente auf.
+ * Die kleinere Hälfte erhält eine neue Nummer. */
+static void split_partition(partition_t* part, refinement_t* ref)
 {
-   int err;
-   automat_t all = automat_FREE;
+   while (ref->nrtouched) {
+      uint32_t s = ref->touched[--ref->nrtouched];
+      uint32_t j = part->first[s] + ref->nrmarked[s];
+      if (j == part->past[s]) {
+         ref->nrmarked[s] = 0;
+         continue;
+      }
+      uint32_t z = part->nrset++;
+      if (ref->nrmarked[s] <= part->past[s] - j) {
+         part->first[z] = part->first[s];
+         part->past[z]  = part->first[s] = j;
+      } else {
+         part->past[z]  = part->past[s];
+         part->first[z] = part->past[s] = j;
+      }
+      for (uint32_t i = part->first[z]; i < part->past[z]; ++i) {
+         part->set[part->elem[i]] = z;
+      }
+      ref->nrmarked[s] = ref->nrmarked[z] = 0;
+   }
+}
 
-   if (ndfa->mman == 0) {
-      err = EINVAL;
-      goto ONERR;
+/* struct: hopcroft_t
+ * Alle Arrays von <minimizehopcroft_automat>.
+ * Die Übergänge t == 0..nrtrans-1 führen von Zustand tail[t] über die Zeichen lower[t]..upper[t] nach head[t].
+ * Sie sind nach (tail, lower) sortiert, so wie sie in den Zuständen gespeichert sind. */
+typedef struct hopcroft_t {
+   uint32_t     nrstate;
+   uint32_t     nrtrans;
+   uint32_t     nrreached; // number of states moved to front of block 0 by reach_hopcroft
+   uint32_t*    tail;
+   char32_t*    lower;
+   char32_t*    upper;
+   uint32_t*    head;
+   uint32_t*    adj;       // adj[adjstart[q]..adjstart[q+1]-1] == transitions adjacent to state q
+   uint32_t*    adjstart;
+   uint32_t*    intrans;   // transitions into the current splitter
+   char32_t*    sigrange;  // merged ranges of all signatures of the current splitter
+   struct
+   hopcroft_signature_t*
+                sig;       // signatures of all tail states of intrans
+   uint32_t*    queue;     // stack of blocks which are waiting to be used as splitter
+   uint32_t     nrqueue;
+   partition_t  block;     // partition of states
+   refinement_t ref;
+} hopcroft_t;
+
+/* struct: hopcroft_signature_t
+ * Die Zeichen, mit denen ein Zustand state in den aktuellen Splitter-Block übergeht.
+ * Die Zeichenbereiche range[2*i]..range[2*i+1] (i < nrrange) sind aufsteigend sortiert
+ * und benachbarte Bereiche sind zusammengefasst, so dass gleiche Zeichenmengen gleiche Signaturen haben. */
+typedef struct hopcroft_signature_t {
+   const char32_t* range;
+   uint32_t        nrrange;
+   uint32_t        block;   // block containing state
+   uint32_t        state;
+} hopcroft_signature_t;
+
+/* function: makeadjacent_hopcroft
+ * Berechnet adj und adjstart, so dass alle Übergänge mit state[t] == q in
+ * adj[adjstart[q]..adjstart[q+1]-1] liegen. */
+static void makeadjacent_hopcroft(hopcroft_t* hop, const uint32_t state[])
+{
+   for (uint32_t q = 0; q <= hop->nrstate; ++q) hop->adjstart[q] = 0;
+   for (uint32_t t = 0; t < hop->nrtrans; ++t) ++ hop->adjstart[state[t]];
+   for (uint32_t q = 0; q < hop->nrstate; ++q) hop->adjstart[q+1] += hop->adjstart[q];
+   for (uint32_t t = hop->nrtrans; t--; ) hop->adj[--hop->adjstart[state[t]]] = t;
+}
+
+/* function: reach_hopcroft
+ * Verschiebt Zustand q in den Bereich der schon erreichten Zustände. */
+static inline void reach_hopcroft(hopcroft_t* hop, uint32_t q)
+{
+   partition_t* B = &hop->block;
+   uint32_t     i = B->loc[q];
+   if (i >= hop->nrreached) {
+      B->elem[i] = B->elem[hop->nrreached];
+      B->loc[B->elem[i]] = i;
+      B->elem[hop->nrreached] = q;
+      B->loc[q] = hop->nrreached++;
    }
+}
 
-   err = initmatch_automat(&all, ndfa, 1, (char32_t[]){0}, (char32_t[]){maxchar_utf8()});
-   if (err) goto ONERR;
-   err = oprepeat_automat(&all, 0);
-   if (err) goto ONERR;
-   err = makedfa2_automat(&all, OP_AND_NOT, ndfa);
-   if (err) goto ONERR;
-   err = free_automat(ndfa);
-   initmove_automat(ndfa, &all);
-   if (err) goto ONERR;
+/* function: removeunreachable_hopcroft
+ * Erweitert die erreichten Zustände um alle von ihnen über from->to erreichbaren
+ * und entfernt alle Übergänge, deren Zustand from nicht erreicht wurde.
+ * Aufruf mit (tail, head) entfernt vom Start unerreichbare Zustände,
+ * Aufruf mit (head, tail) Zustände, von denen kein Endzustand erreichbar ist. */
+static void removeunreachable_hopcroft(hopcroft_t* hop, uint32_t from[], uint32_t to[])
+{
+   partition_t* B = &hop->block;
+   makeadjacent_hopcroft(hop, from);
+   for (uint32_t i = 0; i < hop->nrreached; ++i) {
+      uint32_t q = B->elem[i];
+      for (uint32_t j = hop->adjstart[q]; j < hop->adjstart[q+1]; ++j) {
+         reach_hopcroft(hop, to[hop->adj[j]]);
+      }
+   }
+   uint32_t j = 0;
+   for (uint32_t t = 0; t < hop->nrtrans; ++t) {
+      if (B->loc[from[t]] < hop->nrreached) {
+         to[j] = to[t];
+         hop->lower[j] = hop->lower[t];
+         hop->upper[j] = hop->upper[t];
+         from[j] = from[t];
+         ++ j;
+      }
+   }
+   hop->nrtrans = j;
+   B->past[0] = hop->nrreached;
+   hop->nrreached = 0;
+}
+
+static int compare_uint32(const void* left, const void* right)
+{
+   uint32_t l = *(const uint32_t*)left;
+   uint32_t r = *(const uint32_t*)right;
+   return l < r ? -1 : l > r;
+}
+
+static int compare_uint64(const void* left, const void* right)
+{
+   uint64_t l = *(const uint64_t*)left;
+   uint64_t r = *(const uint64_t*)right;
+   return l < r ? -1 : l > r;
+}
 
+/* function: compare_hopcroftsignature
+ * Ordnet Signaturen nach Block und danach nach den Zeichenbereichen.
+ * Gleiche Signaturen desselben Blocks liegen nach dem Sortieren hintereinander. */
+static int compare_hopcroftsignature(const void* left, const void* right)
+{
+   const hopcroft_signature_t* l = left;
+   const hopcroft_signature_t* r = right;
+   if (l->block != r->block) return l->block < r->block ? -1 : 1;
+   if (l->nrrange != r->nrrange) return l->nrrange < r->nrrange ? -1 : 1;
+   for (uint32_t i = 0; i < 2*l->nrrange; ++i) {
+      if (l->range[i] != r->range[i]) return l->range[i] < r->range[i] ? -1 : 1;
+   }
    return 0;
-ONERR:
-   (void) free_automat(&all);
-   TRACEEXIT_ERRLOG(err);
-   return err;
 }
 
+/* function: endgroup_hopcroft
+ * Liefert den Index nach der letzten Signatur, die gleich sig[i] ist. */
+static inline uint32_t endgroup_hopcroft(uint32_t nrsig, const hopcroft_signature_t sig[nrsig], uint32_t i)
+{
+   uint32_t g = i+1;
+   while (g < nrsig && 0 == compare_hopcroftsignature(&sig[i], &sig[g])) ++g;
+   return g;
+}
 
+/* function: splitblock_hopcroft
+ * Teilt Block b auf, so dass nur Zustände mit gleicher Signatur in einem Block verbleiben.
+ * sig[0..nrsig-1] sind die sortierten Signaturen der Zustände von b, die in den Splitter übergehen.
+ * Alle übrigen Zustände von b bilden eine eigene Gruppe. Die größte Gruppe behält die Nummer b,
+ * alle anderen erhalten neue Nummern und werden in die Warteschlange der Splitter gestellt.
+ * Das genügt (Hopcroft): Ist b schon in der Warteschlange, bezeichnet b danach die größte Gruppe,
+ * ansonsten wurde b schon als Splitter verwendet und die größte Gruppe ist durch die anderen bestimmt. */
+static void splitblock_hopcroft(hopcroft_t* hop, uint32_t b, uint32_t nrsig, const hopcroft_signature_t sig[nrsig])
+{
+   partition_t* B = &hop->block;
+   const uint32_t first = B->first[b];
+   const uint32_t past  = B->past[b];
+
+   // move states of sig to front of block in sorted order
+   for (uint32_t i = 0; i < nrsig; ++i) {
+      uint32_t q = sig[i].state;
+      uint32_t j = B->loc[q];
+      uint32_t k = first + i;
+      B->elem[j] = B->elem[k];
+      B->loc[B->elem[j]] = j;
+      B->elem[k] = q;
+      B->loc[q]  = k;
+   }
+
+   // groups: equal signatures sig[i..g-1] and the rest of the block (no transition into splitter)
+   uint32_t largest = nrsig; // index of largest group (nrsig: rest of block)
+   uint32_t maxsize = past - first - nrsig;
+   uint32_t nrgroup = (maxsize != 0);
+   for (uint32_t i = 0, g; i < nrsig; i = g) {
+      g = endgroup_hopcroft(nrsig, sig, i);
+      ++ nrgroup;
+      if (g - i > maxsize) {
+         maxsize = g - i;
+         largest = i;
+      }
+   }
+   if (nrgroup <= 1) return;
+
+   // assign new block numbers to all groups except the largest
+   for (uint32_t i = 0, g; i <= nrsig; i = g) {
+      g = i < nrsig ? endgroup_hopcroft(nrsig, sig, i) : nrsig+1;
+      const uint32_t gfirst = first + i;
+      const uint32_t gpast  = i < nrsig ? first + g : past;
+      if (gfirst == gpast) continue; // rest of block is empty
+      if (i == largest) {
+         B->first[b] = gfirst;
+         B->past[b]  = gpast;
+      } else {
+         uint32_t z = B->nrset++;
+         B->first[z] = gfirst;
+         B->past[z]  = gpast;
+         for (uint32_t j = gfirst; j < gpast; ++j) {
+            B->set[B->elem[j]] = z;
+         }
+         hop->queue[hop->nrqueue++] = z;
+      }
+   }
+}
 
-// section: Functions
+/* function: refine_hopcroft
+ * Verfeinert die Blöcke bis alle Zustände eines Blocks gleichwertig sind.
+ * Für jeden Splitter b aus der Warteschlange werden die Zeichen bestimmt, mit denen jeder Zustand
+ * in b übergeht (Signatur), und jeder Block wird nach gleichen Signaturen aufgeteilt.
+ * Die Übergänge bleiben dabei Zeichenbereiche, sie werden nicht in Zeichenklassen zerlegt
+ * (Hopcroft für symbolische Automaten, siehe M. Veanes et al.: Minimization of symbolic automata, 2014).
+ * Jeder Übergang wird O(log n) mal betrachtet. */
+static void refine_hopcroft(hopcroft_t* hop)
+{
+   partition_t* B = &hop->block;
 
-// group: test
+   makeadjacent_hopcroft(hop, hop->head);
 
-#ifdef KONFIG_UNITTEST
+   while (hop->nrqueue) {
+      const uint32_t b = hop->queue[--hop->nrqueue];
 
-/* function: build1_multistate
- * Build level 1 b-tree (root + nrchild leaves).
+      // collect transitions into b ordered by (tail, lower)
+      uint32_t nrin = 0;
+      for (uint32_t i = B->first[b]; i < B->past[b]; ++i) {
+         uint32_t q = B->elem[i];
+         for (uint32_t j = hop->adjstart[q]; j < hop->adjstart[q+1]; ++j) {
+            hop->intrans[nrin++] = hop->adj[j];
+         }
+      }
+      qsort(hop->intrans, nrin, sizeof(uint32_t), &compare_uint32);
+
+      // compute signature of every tail state
+      uint32_t nrsig = 0;
+      uint32_t nrrange = 0;
+      for (uint32_t i = 0; i < nrin; ++i) {
+         const uint32_t t = hop->intrans[i];
+         if (!i || hop->tail[hop->intrans[i-1]] != hop->tail[t]) {
+            hop->sig[nrsig++] = (hopcroft_signature_t) { &hop->sigrange[2*nrrange], 0, B->set[hop->tail[t]], hop->tail[t] };
+         } else if (hop->sigrange[2*nrrange-1] + 1 == hop->lower[t]) {
+            // merge adjacent ranges leading to different states of b
+            hop->sigrange[2*nrrange-1] = hop->upper[t];
+            continue;
+         }
+         hop->sigrange[2*nrrange]   = hop->lower[t];
+         hop->sigrange[2*nrrange+1] = hop->upper[t];
+         ++ nrrange;
+         ++ hop->sig[nrsig-1].nrrange;
+      }
+      qsort(hop->sig, nrsig, sizeof(hopcroft_signature_t), &compare_hopcroftsignature);
+
+      // split every block containing a tail state
+      for (uint32_t i = 0, g; i < nrsig; i = g) {
+         for (g = i+1; g < nrsig && hop->sig[g].block == hop->sig[i].block; ) ++g;
+         splitblock_hopcroft(hop, hop->sig[i].block, g - i, &hop->sig[i]);
+      }
+   }
+}
+
+/* function: minimizehopcroft_automat
+ * Minimiert den DFA ndfa durch Verfeinerung der Partition seiner Zustände.
  *
- * Memory Layout:
- * addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... */
-static int build1_multistate(
-   /*out*/multistate_t * mst,
-   automat_mman_t * mman,
-   state_t state[],
-   unsigned step, /*every stepth*/
-   void * ENDMARKER,
-   unsigned nrchild,
-   /*out*/void* addr[nrchild+2],
-   /*out*/void* child[nrchild])
+ * Zuerst werden vom Start unerreichbare und nicht zum Ende führende Zustände entfernt.
+ * Danach werden die Zustände mit <refine_hopcroft> in Klassen gleichwertiger Zustände zerlegt.
+ * Die Übergänge werden dabei nicht in Zeichenklassen aufgeteilt, so dass Automaten mit vielen
+ * Zeichenbereichen nicht zu #Zustände * #Zeichenklassen Übergängen aufgebläht werden.
+ *
+ * Der erzeugte DFA hat dieselbe Struktur wie der von <makedfa_automat> erzeugte:
+ * Der Startzustand ist der erste, der Endzustand der letzte in der Liste.
+ * Die Zustände sind in Breitensuche-Reihenfolge ab Startzustand angeordnet. */
+static int minimizehopcroft_automat(automat_t* ndfa)
 {
-   unsigned S = 0;
-   const size_t SIZE = sizeof(multistate_node_t);
-   TEST(nrchild >= 2);
-   TEST(nrchild <= multistate_NROFCHILD);
+   int err;
+   void*           addr;
+   hopcroft_t      hop;
+   automat_mman_t* mman = 0;
+   uint32_t*       mem  = 0;
+   hopcroft_signature_t* sig = 0;
+   state_t**       state = 0;
+   state_t**       blockstate = 0;
+   size_t          nrtrans = 0;
+   size_t          nrstate = 0;
+   size_t          allocated = 0;
+   slist_t         dfa_states = slist_INIT;
 
-   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-   TEST(0 == malloc_automatmman(mman, SIZE, &mst->root));
-   mst->size = nrchild * multistate_NROFSTATE;
-   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-   ((multistate_node_t*)mst->root)->level = 1;
-   ((multistate_node_t*)mst->root)->size  = (uint8_t) nrchild;
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
 
-   void * prevchild = 0;
-   for (unsigned i = 0; i < nrchild; ++i) {
-      TEST(0 == malloc_automatmman(mman, SIZE, &child[i]));
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[2+i]));
-      if (i) ((multistate_node_t*)mst->root)->key[i-1] = &state[S];
-      ((multistate_node_t*)mst->root)->child[i] = child[i];
-      ((multistate_node_t*)child[i])->level = 0;
-      ((multistate_node_t*)child[i])->size = multistate_NROFSTATE;
-      ((multistate_node_t*)child[i])->next = 0;
-      for (unsigned s = 0; s < multistate_NROFSTATE; ++s, S += step) {
-         ((multistate_node_t*)child[i])->state[s] = &state[S];
+   // === number states ===
+   foreach (_statelist, s, &ndfa->states) {
+      s->nr = nrstate++;
+      nrtrans += s->nrrangetrans;
+   }
+   if (nrstate >= UINT32_MAX/8 || nrtrans >= UINT32_MAX/8) {
+      err = E2BIG;
+      goto ONERR;
+   }
+
+   // === allocate and init arrays ===
+   hop.nrstate   = (uint32_t) nrstate;
+   hop.nrtrans   = (uint32_t) nrtrans;
+   hop.nrreached = 0;
+   hop.nrqueue   = 0;
+   const size_t MEMSIZE = 5*nrstate + 8*nrtrans + 4*(nrstate+1);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      state = malloc(nrstate * sizeof(state_t*));
+      sig   = malloc(nrstate * sizeof(hopcroft_signature_t));
+      mem   = malloc(MEMSIZE * sizeof(uint32_t));
+      err = state && sig && mem ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+   static_assert(sizeof(char32_t) == sizeof(uint32_t), "lower, upper and sigrange are stored in mem");
+   init_partition(&hop.block, hop.nrstate, mem);
+   hop.tail     = mem + 5*nrstate;
+   hop.lower    = hop.tail  + nrtrans;
+   hop.upper    = hop.lower + nrtrans;
+   hop.head     = hop.upper + nrtrans;
+   hop.adj      = hop.head  + nrtrans;
+   hop.intrans  = hop.adj   + nrtrans;
+   hop.sigrange = hop.intrans + nrtrans;
+   hop.adjstart = hop.sigrange + 2*nrtrans;
+   hop.queue    = hop.adjstart + nrstate+1;
+   hop.sig      = sig;
+   hop.ref = (refinement_t) { hop.queue + nrstate+1, hop.queue + 2*(nrstate+1), 0 };
+   memset(hop.ref.nrmarked, 0, (nrstate+1) * sizeof(uint32_t));
+   {
+      uint32_t t = 0;
+      foreach (_statelist, s, &ndfa->states) {
+         state[s->nr] = s;
+         foreach (_rangelist, range_trans, &s->rangelist) {
+            for (size_t i = 0; i < range_trans->size; ++i, ++t) {
+               hop.tail[t]  = (uint32_t) s->nr;
+               hop.lower[t] = range_trans->array[i].from;
+               hop.upper[t] = range_trans->array[i].to;
+               hop.head[t]  = (uint32_t) range_trans->array[i].state->nr;
+            }
+         }
       }
-      if (prevchild) ((multistate_node_t*)prevchild)->next = child[i];
-      prevchild = child[i];
    }
 
-   for (unsigned i = 0; i < nrchild+2; ++i) {
-      *((void**)addr[i]) = ENDMARKER;
+   // === remove useless states ===
+   reach_hopcroft(&hop, 0/*start state*/);
+   removeunreachable_hopcroft(&hop, hop.tail, hop.head);
+   for (uint32_t q = 0; q < hop.nrstate; ++q) {
+      if (state[q]->nremptytrans && hop.block.loc[q] < hop.block.past[0]) {
+         reach_hopcroft(&hop, q);
+      }
    }
+   const uint32_t nrfinal = hop.nrreached;
+   removeunreachable_hopcroft(&hop, hop.head, hop.tail);
+   const uint32_t nrlive = hop.block.past[0];
 
-   return 0;
-ONERR:
-   return EINVAL;
-}
+   // === initial partition: final and non final states (both are splitters) ===
+   hop.ref.nrmarked[0] = nrfinal;
+   if (nrfinal) {
+      hop.ref.touched[hop.ref.nrtouched++] = 0;
+      split_partition(&hop.block, &hop.ref);
+   }
+   for (uint32_t b = 0; nrlive && b < hop.block.nrset; ++b) {
+      hop.queue[hop.nrqueue++] = b;
+   }
 
-/* function: build1_multistate
- * Build level 2 b-tree (root + nrchild nodes + full leaves).
- * Inserted states are generated beginning from (void*)0 up to
- * (void*)(nrchild*multistate_NROFCHILD*step*multistate_NROFSTATE). */
-static int build2_multistate(
-   /*out*/multistate_t * mst,
-   automat_mman_t * mman,
-   unsigned step, /*every stepth*/
-   unsigned nrchild,
-   /*out*/void* child[nrchild])
-{
-   const size_t SIZE = sizeof(multistate_node_t);
-   size_t level1_size = multistate_NROFCHILD*multistate_NROFSTATE;
-   TEST(nrchild >= 2);
-   TEST(nrchild <= multistate_NROFCHILD);
+   // === refine ===
+   refine_hopcroft(&hop);
+   free(sig);
+   sig = 0;
 
-   TEST(0 == malloc_automatmman(mman, SIZE, &mst->root));
-   mst->size = nrchild * level1_size;
-   ((multistate_node_t*)mst->root)->level = 2;
-   ((multistate_node_t*)mst->root)->size  = (uint8_t) nrchild;
+   // === build minimal dfa ===
+   err = new_automatmman(&mman);
+   PROCESS_testerrortimer(&s_automat_errtimer, &err);
+   if (err) goto ONERR;
+   const uint32_t nrblock = nrlive ? hop.block.nrset : 0;
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      blockstate = malloc((nrblock+1) * sizeof(state_t*));
+      err = blockstate ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+   for (uint32_t b = 0; b < nrblock; ++b) blockstate[b] = 0;
 
-   for (uintptr_t i = 0; i < nrchild; ++i) {
-      TEST(0 == malloc_automatmman(mman, SIZE, &child[i]));
-      if (i) ((multistate_node_t*)mst->root)->key[i-1] = (void*)(i*step*level1_size);
-      ((multistate_node_t*)mst->root)->child[i] = child[i];
-      ((multistate_node_t*)child[i])->level = 1;
-      ((multistate_node_t*)child[i])->size  = multistate_NROFCHILD;
+   void* dfa_endstate;
+   allocated = state_SIZE + state_SIZE_EMPTYTRANS(1);
+   err = malloc_automatmman(mman, allocated, &dfa_endstate);
+   if (err) goto ONERR;
+   initempty_state(dfa_endstate, dfa_endstate);
+   nrstate = 1;
+
+   // blocks in breadth first order (reuse ref.touched as queue)
+   uint32_t* queue   = hop.ref.touched;
+   uint32_t  nrqueue = 0;
+   if (hop.block.loc[0] < nrlive) {
+      queue[nrqueue++] = hop.block.set[0];
+      blockstate[hop.block.set[0]] = dfa_endstate; // marks block as queued
+   }
+   for (uint32_t qi = 0; qi < nrqueue; ++qi) {
+      const state_t* rep = state[hop.block.elem[hop.block.first[queue[qi]]]];
+      foreach (_rangelist, range_trans, &rep->rangelist) {
+         for (size_t i = 0; i < range_trans->size; ++i) {
+            uint32_t q = (uint32_t) range_trans->array[i].state->nr;
+            if (hop.block.loc[q] >= nrlive) continue;
+            if (! blockstate[hop.block.set[q]]) {
+               blockstate[hop.block.set[q]] = dfa_endstate;
+               queue[nrqueue++] = hop.block.set[q];
+            }
+         }
+      }
    }
 
-   uintptr_t statenr = 0;
-   void * prevleaf = 0;
-   for (unsigned i = 0; i < nrchild; ++i) {
-      for (unsigned c = 0; c < multistate_NROFCHILD; ++c) {
-         void * leaf;
-         TEST(0 == malloc_automatmman(mman, SIZE, &leaf));
-         ((multistate_node_t*)child[i])->child[c] = leaf;
-         if (c) ((multistate_node_t*)child[i])->key[c-1] = (void*)statenr;
-         ((multistate_node_t*)leaf)->level = 0;
-         ((multistate_node_t*)leaf)->size  = multistate_NROFSTATE;
-         ((multistate_node_t*)leaf)->next  = 0;
-         for (unsigned s = 0; s < multistate_NROFSTATE; ++s, statenr += step) {
-            ((multistate_node_t*)leaf)->state[s] = (void*)statenr;
+   // allocate states
+   for (uint32_t qi = 0; qi < nrqueue || qi == 0; ++qi) {
+      const state_t* rep = qi < nrqueue ? state[hop.block.elem[hop.block.first[queue[qi]]]] : 0;
+      const bool isendstate = rep && rep->nremptytrans;
+      bool istrans = false;
+      if (rep) {
+         foreach (_rangelist, range_trans, &rep->rangelist) {
+            for (size_t i = 0; i < range_trans->size; ++i) {
+               istrans = istrans || hop.block.loc[range_trans->array[i].state->nr] < nrlive;
+            }
          }
-         if (prevleaf) ((multistate_node_t*)prevleaf)->next = leaf;
-         prevleaf = leaf;
+      }
+      if (isendstate && !istrans && qi != 0/*not start state*/) {
+         // state is only an end state ==> use dfa_endstate
+         continue;
+      }
+      const size_t SIZE = state_SIZE + (isendstate ? state_SIZE_EMPTYTRANS(1) : 0);
+      err = malloc_automatmman(mman, SIZE, &addr);
+      if (err) goto ONERR;
+      allocated += SIZE;
+      if (isendstate) {
+         initempty_state(addr, dfa_endstate);
+      } else {
+         init_state(addr);
+      }
+      ++ nrstate;
+      insertlast_statelist(&dfa_states, (state_t*)addr);
+      if (rep) blockstate[queue[qi]] = addr;
+   }
+
+   // add transitions
+   {
+      state_t* dfastate = first_statelist(&dfa_states);
+      for (uint32_t qi = 0; qi < nrqueue; ++qi) {
+         if (blockstate[queue[qi]] == dfa_endstate) continue;
+         const state_t* rep = state[hop.block.elem[hop.block.first[queue[qi]]]];
+         range_transition_t dummytrans = { .size = 1 };
+         range_transition_t *prevtrans = &dummytrans;
+         foreach (_rangelist, range_trans, &rep->rangelist) {
+            for (size_t i = 0; i < range_trans->size; ++i) {
+               uint32_t q = (uint32_t) range_trans->array[i].state->nr;
+               if (hop.block.loc[q] >= nrlive) continue;
+               state_t* target = blockstate[hop.block.set[q]];
+               if (  target == prevtrans->array[prevtrans->size-1].state
+                     && range_trans->array[i].from == prevtrans->array[prevtrans->size-1].to+1) {
+                  // transition optimizer
+                  prevtrans->array[prevtrans->size-1].to = range_trans->array[i].to;
+               } else {
+                  // add new transition
+                  err = malloc_automatmman(mman, state_SIZE_RANGETRANS(1), &addr);
+                  if (err) goto ONERR;
+                  if (addr == &prevtrans->array[prevtrans->size]) {
+                     allocated += state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0);
+                     err = mfreelast_automatmman(mman, (uint8_t*)addr + (state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0)));
+                     if (err) goto ONERR;
+                     prevtrans->size += 1;
+                  } else {
+                     allocated += state_SIZE_RANGETRANS(1);
+                     prevtrans = addr;
+                     insertlast_rangelist(&dfastate->rangelist, prevtrans);
+                     prevtrans->size = 1;
+                  }
+                  ++ dfastate->nrrangetrans;
+                  prevtrans->array[prevtrans->size-1].from  = range_trans->array[i].from;
+                  prevtrans->array[prevtrans->size-1].to    = range_trans->array[i].to;
+                  prevtrans->array[prevtrans->size-1].state = target;
+               }
+            }
+         }
+         dfastate = next_statelist(dfastate);
       }
    }
 
+   // set end state as last state in list
+   insertlast_statelist(&dfa_states, dfa_endstate);
+
+   free(mem);
+   free(state);
+   free(blockstate);
+   mem = 0;
+   state = 0;
+   blockstate = 0;
+
+   // set out (change ndfa even in case of error to valid state)
+   incruse_automatmman(mman);
+   err = free_automat(ndfa);
+   ndfa->mman = mman;
+   ndfa->nrstate = nrstate;
+   ndfa->allocated = allocated;
+   ndfa->states = dfa_states;
+   ndfa->isDFA  = 1;
+   numberstates_automat(ndfa);
+   if (err) goto ONERR;
+
    return 0;
 ONERR:
-   return EINVAL;
+   if (ndfa->mman != mman) delete_automatmman(&mman);
+   free(sig);
+   free(mem);
+   free(state);
+   free(blockstate);
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
-static int build_recursive(
-   /*out*/rangemap_node_t ** root,
-   automat_mman_t * mman,
-   unsigned keyoffset,
-   unsigned level,
-   unsigned interval_per_child,
-   /*inout*/rangemap_node_t ** child)
+int minimize2_automat(automat_t* ndfa, automat_minimize_e algorithm)
 {
-   void * node;
-   const size_t SIZE = sizeof(rangemap_node_t);
-   rangemap_node_t * parent;
-   TEST(level >= 1);
-
-   TEST(0 == malloc_automatmman(mman, SIZE, &node));
-   *root  = node;
-   parent = node;
-   parent->level = (uint8_t) level;
-   parent->size  = 4;
+   int err;
 
-   if (level > 1) {
-      for (unsigned i = 0; i < 4; ++i) {
-         unsigned keyoffset2 = (1u<<(2*(level-1))) * i * interval_per_child;
-         if (i) parent->key[i-1] = keyoffset + keyoffset2;
-         TEST(0 == build_recursive(&parent->child[i], mman, keyoffset + keyoffset2, level-1, interval_per_child, child));
-      }
-   } else {
-      for (unsigned i = 0; i < 4; ++i) {
-         if (i) parent->key[i-1] = keyoffset + i * interval_per_child;
-         parent->child[i] = *child;
-         *child = (*child)->next;
+   switch (algorithm) {
+   case automat_minimize_BRZOZOWSKI:
+      err = minimize_automat(ndfa);
+      if (err) goto ONERR;
+      break;
+   case automat_minimize_HOPCROFT:
+      if (! ndfa->isDFA) {
+         err = makedfa_automat(ndfa);
+         if (err) goto ONERR;
       }
+      err = minimizehopcroft_automat(ndfa);
+      if (err) goto ONERR;
+      break;
+   default:
+      err = EINVAL;
+      goto ONERR;
    }
 
    return 0;
 ONERR:
-   return EINVAL;
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
-/* function: build_rangemap
- * Builds level b-tree.
- * Every node has 4 childs and a leaf a single range entry copied from from[], to[].
- * The interval_per_child is the total interval every leaf is considered
- * to occupy. This value is used to build the key values in the node entries. */
-static int build_rangemap(
-   /*out*/rangemap_t * rmap,
-   automat_mman_t * mman,
-   unsigned level,
-   unsigned from[1<<(2*level)],
-   unsigned to[1<<(2*level)],
-   unsigned interval_per_child,
-   /*out*/rangemap_node_t ** first_child)
+/* struct: utf8range_builder_t
+ * Speichert Parameter für <addutf8range_automat>, die sich während
+ * der Rekursion nicht ändern. */
+typedef struct utf8range_builder_t {
+   automat_mman_t* mman;
+   size_t          allocated;
+   size_t          nrstate;
+   slist_t         states;     // list of additional states between first and last byte
+} utf8range_builder_t;
+
+/* function: addbyteseq_automat
+ * Erzeugt die Übergangskette state --[from[0]..to[0]]--> s1 ... --[from[n-1]..to[n-1]]--> target.
+ * Die n-1 Zwischenzustände werden in builder->states eingefügt. */
+static int addbyteseq_automat(utf8range_builder_t* builder, state_t* state, state_t* target, unsigned n, const uint8_t from[n], const uint8_t to[n])
 {
-   void * node;
-   const size_t SIZE = sizeof(rangemap_node_t);
-   const unsigned S = 1u<<(2*level);
+   int err;
+   void* addr;
 
-   rangemap_node_t * child;
-   rangemap_node_t * prev_child = 0;
-   for (unsigned i = 0; i < S; ++i, prev_child = child) {
-      TEST(0 == malloc_automatmman(mman, SIZE, &node));
-      child = node;
-      if (!i) *first_child = child;
-      else    prev_child->next = child;
-      child->level = 0;
-      child->size  = 1;
-      child->next  = 0;
-      child->range[0] = (range_t) range_INIT(from[i], to[i]);
-      prev_child = child;
+   for (unsigned i = 0; i < n; ++i) {
+      state_t* next = target;
+      if (i < n-1) {
+         if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+            err = malloc_automatmman(builder->mman, state_SIZE, &addr);
+         }
+         if (err) goto ONERR;
+         builder->allocated += state_SIZE;
+         ++ builder->nrstate;
+         next = addr;
+         init_state(next);
+         insertlast_statelist(&builder->states, next);
+      }
+      err = malloc_automatmman(builder->mman, state_SIZE_RANGETRANS(1), &addr);
+      if (err) goto ONERR;
+      builder->allocated += state_SIZE_RANGETRANS(1);
+      char32_t bfrom = from[i], bto = to[i];
+      extendmatch_state(state, next, 1, &bfrom, &bto, addr);
+      state = next;
    }
 
-   child = *first_child;
-   TEST(0 == build_recursive(&rmap->root, mman, 0, level, interval_per_child, &child));
-   TEST(0 == child);
-   rmap->size = S;
-
    return 0;
 ONERR:
-   return EINVAL;
+   return err;
 }
 
-/* function: build1_rangemap
- * Build level 1 b-tree (root + nrchild leaves).
+/* function: addutf8range_automat
+ * Erzeugt Übergänge von state nach target, die alle UTF-8 kodierten Zeichen
+ * aus dem Bereich [from..to] als Bytefolge erkennen.
  *
- * Memory Layout:
- * addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... */
-static int build1_rangemap(
-   /*out*/rangemap_t * rmap,
-   automat_mman_t * mman,
-   unsigned range_width,
-   void * ENDMARKER,
-   unsigned nrchild,
-   /*out*/void* addr[nrchild+2],
-   /*out*/rangemap_node_t* child[nrchild])
+ * Der Bereich wird zuerst nach der Länge der Kodierung aufgeteilt.
+ * Danach werden die Teilbereiche solange aufgespalten, bis jede Bytefolge aus unabhängigen
+ * Bytebereichen besteht, d.h. alle Folgebytes eines Teilbereiches überdecken [0x80..0xBF] vollständig,
+ * nur das erste oder letzte Zeichen eines Teilbereichs weicht davon ab.
+ *
+ * Unchecked Precondition:
+ * - from <= to && to <= maxchar_utf8() */
+static int addutf8range_automat(utf8range_builder_t* builder, state_t* state, state_t* target, char32_t from, char32_t to)
 {
-   void * node;
-   const size_t SIZE = sizeof(rangemap_node_t);
-   TEST(range_width >= 1);
-   TEST(nrchild >= 2);
-   TEST(nrchild <= rangemap_NROFCHILD);
-
-   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-   TEST(0 == malloc_automatmman(mman, SIZE, &node));
-   rmap->root = node;
-   rmap->size = nrchild * rangemap_NROFRANGE;
-   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-   rmap->root->level = 1;
-   rmap->root->size  = (uint8_t) nrchild;
+   int err;
+   static const char32_t maxchar[] = { 0x7f, 0x7ff, 0xffff, 0x1fffff, 0x3ffffff };
 
-   for (unsigned i = 0, f = 0; i < nrchild; ++i) {
-      TEST(0 == malloc_automatmman(mman, SIZE, &node));
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[2+i]));
-      child[i] = node;
-      if (i) {
-         rmap->root->key[i-1] = f;
-         child[i-1]->next = child[i];
-      }
-      rmap->root->child[i] = child[i];
-      child[i]->level = 0;
-      child[i]->size  = rangemap_NROFRANGE;
-      child[i]->next  = 0;
-      for (unsigned r = 0; r < rangemap_NROFRANGE; ++r, f += range_width) {
-         child[i]->range[r] = (range_t) range_INIT(f, f + range_width-1);
+   for (unsigned i = 0; i < lengthof(maxchar); ++i) {
+      if (from <= maxchar[i] && maxchar[i] < to) {
+         err = addutf8range_automat(builder, state, target, from, maxchar[i]);
+         if (err) goto ONERR;
+         return addutf8range_automat(builder, state, target, maxchar[i]+1, to);
       }
    }
 
-   for (unsigned i = 0; i < nrchild+2; ++i) {
-      *((void**)addr[i]) = ENDMARKER;
+   uint8_t bfrom[6];
+   uint8_t bto[6];
+   const unsigned n = encodechar_utf8(from, sizeof(bfrom), bfrom);
+
+   for (unsigned i = 1; i < n; ++i) {
+      const char32_t m = ((char32_t)1 << (6*i)) - 1;
+      if ((from & ~m) != (to & ~m)) {
+         if ((from & m) != 0) {
+            err = addutf8range_automat(builder, state, target, from, from | m);
+            if (err) goto ONERR;
+            return addutf8range_automat(builder, state, target, (from | m) + 1, to);
+         }
+         if ((to & m) != m) {
+            err = addutf8range_automat(builder, state, target, from, (to & ~m) - 1);
+            if (err) goto ONERR;
+            return addutf8range_automat(builder, state, target, to & ~m, to);
+         }
+      }
    }
 
+   (void) encodechar_utf8(to, sizeof(bto), bto);
+   err = addbyteseq_automat(builder, state, target, n, bfrom, bto);
+   if (err) goto ONERR;
+
    return 0;
 ONERR:
-   return EINVAL;
+   return err;
 }
 
-/* function: build2_rangemap
- * Build level 2 b-tree (root + nrchild nodes + full leaves).
- * Inserted ranges are generated beginning from 0 up to
- * (nrchild*range_width*rangemap_NROFCHILD*rangemap_NROFRANGE). */
-static int build2_rangemap(
-   /*out*/rangemap_t * rmap,
-   automat_mman_t * mman,
-   unsigned range_width,
-   unsigned nrchild,
-   /*out*/rangemap_node_t* child[nrchild])
+int makeutf8_automat(automat_t* ndfa)
 {
-   void * node;
-   const size_t SIZE = sizeof(rangemap_node_t);
-   size_t level1_size = rangemap_NROFCHILD*rangemap_NROFRANGE;
-   TEST(nrchild >= 2);
-   TEST(nrchild <= rangemap_NROFCHILD);
-
-   TEST(0 == malloc_automatmman(mman, SIZE, &node));
-   rmap->root = node;
-   rmap->size = nrchild * level1_size;
-   rmap->root->level = 2;
-   rmap->root->size  = (uint8_t) nrchild;
+   int err;
+   void* addr;
+   automat_t  byte_ndfa = automat_FREE;
+   utf8range_builder_t builder = { 0, 0, 0, slist_INIT };
+   slist_t    dest_states = slist_INIT;
+   state_t   *startstate, *endstate;
 
-   for (unsigned i = 0; i < nrchild; ++i) {
-      TEST(0 == malloc_automatmman(mman, SIZE, &node));
-      child[i] = node;
-      if (i) rmap->root->key[i-1] = (char32_t) (i*range_width*level1_size);
-      rmap->root->child[i] = child[i];
-      child[i]->level = 1;
-      child[i]->size  = rangemap_NROFCHILD;
+   if (ndfa->nrstate < 2) {
+      err = EINVAL;
+      goto ONERR;
    }
 
-   unsigned f = 0;
-   rangemap_node_t * prevleaf = 0;
-   for (unsigned i = 0; i < nrchild; ++i) {
-      for (unsigned c = 0; c < rangemap_NROFCHILD; ++c) {
-         TEST(0 == malloc_automatmman(mman, SIZE, &node));
-         rangemap_node_t * leaf = node;
-         if (c) child[i]->key[c-1] = f;
-         child[i]->child[c] = leaf;
-         leaf->level = 0;
-         leaf->size  = rangemap_NROFRANGE;
-         leaf->next  = 0;
-         for (unsigned r = 0; r < rangemap_NROFRANGE; ++r, f += range_width) {
-            leaf->range[r] = (range_t) range_INIT(f, f+range_width-1);
+   err = new_automatmman(&builder.mman);
+   PROCESS_testerrortimer(&s_automat_errtimer, &err);
+   if (err) goto ONERR;
+
+   startend_automat(ndfa, &startstate, &endstate);
+
+   // allocate a copy of every state but without transitions
+   foreach (_statelist, src_state, &ndfa->states) {
+      if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+         err = malloc_automatmman(builder.mman, state_SIZE, &addr);
+      }
+      if (err) goto ONERR;
+      builder.allocated += state_SIZE;
+      src_state->dest = addr;
+      init_state(addr);
+      if (src_state != endstate) {
+         insertlast_statelist(&dest_states, (state_t*)addr);
+      }
+   }
+
+   // copy empty transitions and convert range transitions into byte sequences
+   foreach (_statelist, src_state, &ndfa->states) {
+      state_t* dest_state = src_state->dest;
+      foreach (_emptylist, src_trans, &src_state->emptylist) {
+         err = malloc_automatmman(builder.mman, state_SIZE_EMPTYTRANS(1), &addr);
+         if (err) goto ONERR;
+         builder.allocated += state_SIZE_EMPTYTRANS(1);
+         ++ dest_state->nremptytrans;
+         insertlast_emptylist(&dest_state->emptylist, (empty_transition_t*)addr);
+         ((empty_transition_t*)addr)->state = src_trans->state->dest;
+      }
+      foreach (_rangelist, src_trans, &src_state->rangelist) {
+         for (size_t s = 0; s < src_trans->size; ++s) {
+            char32_t from = src_trans->array[s].from;
+            char32_t to   = src_trans->array[s].to;
+            if (to > maxchar_utf8()) to = maxchar_utf8();
+            if (from > to) continue; // not encodable
+            err = addutf8range_automat(&builder, dest_state, src_trans->array[s].state->dest, from, to);
+            if (err) goto ONERR;
          }
-         if (prevleaf) prevleaf->next = leaf;
-         prevleaf = leaf;
       }
    }
 
+   insertlastPlist_statelist(&dest_states, &builder.states);
+   insertlast_statelist(&dest_states, (state_t*)endstate->dest);
+
+   // byte_ndfa owns builder.mman
+   incruse_automatmman(builder.mman);
+   byte_ndfa.mman      = builder.mman;
+   byte_ndfa.nrstate   = ndfa->nrstate + builder.nrstate;
+   byte_ndfa.allocated = builder.allocated;
+   byte_ndfa.states    = dest_states;
+   builder.mman = 0;
+
+   err = makedfa_automat(&byte_ndfa);
+   if (err) goto ONERR;
+
+   err = free_automat(ndfa);
+   initmove_automat(ndfa, &byte_ndfa);
+   if (err) goto ONERR;
+
    return 0;
 ONERR:
-   return EINVAL;
+   if (builder.mman) {
+      delete_automatmman(&builder.mman);
+   }
+   (void) free_automat(&byte_ndfa);
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
-static int test_state(void)
+int compact_automat(automat_t* ndfa)
 {
-   const unsigned NROFSTATE = 256;
-   state_t        state[NROFSTATE];
-   empty_transition_t* empty_trans = (void*)((uintptr_t)state + state_SIZE);
-   range_transition_t* range_trans = (void*)((uintptr_t)state + state_SIZE);
-   char32_t       from[256];
-   char32_t       to[256];
-
-   // prepare
-   memset(&state, 0, sizeof(state));
-   for (unsigned r = 0; r < 256; ++r) {
-      from[r] = r + 1;
-      to[r] = r + 10;
+   int err;
+   void*           addr;
+   automat_mman_t* mman  = 0;
+   state_t**       order = 0;
+   size_t          nrstate   = 0;
+   size_t          allocated = 0;
+   slist_t         dest_states = slist_INIT;
+   state_t        *startstate, *endstate;
+   const size_t    MAXRANGE  = 256; // max size of a single range_transition_t (far below size of memory page)
+   const bool      isDFA     = ndfa->isDFA;
+
+   if (!ndfa->mman || ndfa->nrstate < 1) {
+      err = EINVAL;
+      goto ONERR;
    }
 
-   // === constants
-
-   // TEST state_SIZE
-   static_assert( state_SIZE == sizeof(state_t), "objectsize");
-
-   // TEST state_SIZE_EMPTYTRANS
-   static_assert( 0 == state_SIZE_EMPTYTRANS(0)
-                  && sizeof(empty_transition_t) == state_SIZE_EMPTYTRANS(1)
-                  && 255*sizeof(empty_transition_t) == state_SIZE_EMPTYTRANS(255),
-                  "calcs size of empty transition"
-                  );
-
-   // TEST state_SIZE_RANGETRANS
-   static_assert( sizeof(range_transition_t) == state_SIZE_RANGETRANS(0)
-                  && sizeof(range_transition_t) + sizeof(rangestate_t) == state_SIZE_RANGETRANS(1)
-                  && sizeof(range_transition_t) + 255*sizeof(rangestate_t) == state_SIZE_RANGETRANS(255),
-                  "calcs size of range transition"
-                  );
-
-   // === type support
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      order = malloc(ndfa->nrstate * sizeof(state_t*));
+      err = order ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
 
-   // TEST slist_IMPLEMENT: _statelist
-   slist_t list = slist_INIT;
-   // test only insertlast_statelist
-   for (unsigned i = 0; i < NROFSTATE; ++i) {
-      insertlast_statelist(&list, &state[i]);
-      // check list
-      TEST(&state[i] == last_statelist(&list));
+   // === order states breadth first, end state stays last ===
+   startend_automat(ndfa, &startstate, &endstate);
+   foreach (_statelist, s, &ndfa->states) {
+      s->dest = 0;
+   }
+   startstate->dest = startstate; // mark as visited
+   endstate->dest   = endstate;
+   order[nrstate++] = startstate;
+   for (size_t next = 0; next < nrstate; ++next) {
+      foreach (_emptylist, empty_trans, &order[next]->emptylist) {
+         if (! empty_trans->state->dest) {
+            empty_trans->state->dest = empty_trans->state;
+            order[nrstate++] = empty_trans->state;
+         }
+      }
+      foreach (_rangelist, range_trans, &order[next]->rangelist) {
+         for (size_t i = 0; i < range_trans->size; ++i) {
+            if (! range_trans->array[i].state->dest) {
+               range_trans->array[i].state->dest = range_trans->array[i].state;
+               order[nrstate++] = range_trans->array[i].state;
+            }
+         }
+      }
    }
-   // check state[]
-   for (unsigned i = 0; i < NROFSTATE; ++i) {
-      TEST(&state[(i+1)%256] == next_statelist(&state[i]));
-      TEST((slist_node_t*)&state[(i+1)%256].next == state[i].next);
+   foreach (_statelist, s, &ndfa->states) {
+      if (! s->dest) {
+         // unreachable
+         s->dest = s;
+         order[nrstate++] = s;
+      }
+   }
+   if (endstate != startstate) {
+      order[nrstate++] = endstate;
    }
 
-   // === lifetime
-
-   // TEST initempty_state
-   memset(&state, 255, sizeof(state[0]));
-   state[0].next = (void*) &state[1].next;
-   initempty_state(&state[0], &state[2]);
-   TEST(state[0].next == (void*) &state[1].next); // unchanged
-   TEST(state[0].nremptytrans == 1);
-   TEST(state[0].nrrangetrans == 0);
-   TEST(state[0].emptylist.last == (slist_node_t*)&empty_trans->next);
-   TEST(state[0].rangelist.last == 0);
-   TEST(state[0].isused    == 255); // unchanged
-   TEST(empty_trans->next  == (slist_node_t*)&empty_trans->next);
-   TEST(empty_trans->state == &state[2]);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      err = new_automatmman(&mman);
+   }
+   if (err) goto ONERR;
 
-   // TEST initempty2_state
-   memset(&state, 255, sizeof(state[0]));
-   state[0].next = (void*) &state[1].next;
-   initempty2_state(&state[0], &state[2], &state[5]);
-   TEST(state[0].next == (void*) &state[1].next); // unchanged
-   TEST(state[0].nremptytrans == 2);
-   TEST(state[0].nrrangetrans == 0);
-   TEST(state[0].emptylist.last == (slist_node_t*)&empty_trans[1].next);
-   TEST(state[0].rangelist.last == 0);
-   TEST(state[0].isused      == 255); // unchanged
-   TEST(empty_trans[0].next  == (slist_node_t*)&empty_trans[1].next);
-   TEST(empty_trans[0].state == &state[2]);
-   TEST(empty_trans[1].next  == (slist_node_t*)&empty_trans[0].next);
-   TEST(empty_trans[1].state == &state[5]);
+   // === copy every state followed by its transitions (targets still point to old states) ===
+   for (size_t nr = 0; nr < nrstate; ++nr) {
+      state_t* src_state = order[nr];
+      if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+         err = malloc_automatmman(mman, state_SIZE, &addr);
+      }
+      if (err) goto ONERR;
+      allocated += state_SIZE;
+      state_t* dest_state = addr;
+      init_state(dest_state);
+      src_state->dest = dest_state;
+      insertlast_statelist(&dest_states, dest_state);
 
-   // TEST initrange_state
-   memset(&state, 255, sizeof(state[0]));
-   state[0].next = (void*) &state[1].next;
-   init_state(&state[0]);
-   TEST(state[0].next == (void*) &state[1].next); // unchanged
-   TEST(state[0].nremptytrans == 0);
-   TEST(state[0].nrrangetrans == 0);
-   TEST(state[0].emptylist.last == 0);
-   TEST(state[0].rangelist.last == 0);
-   TEST(state[0].isused == 255); // unchanged
+      if (src_state->nremptytrans) {
+         err = malloc_automatmman(mman, state_SIZE_EMPTYTRANS(src_state->nremptytrans), &addr);
+         if (err) goto ONERR;
+         allocated += state_SIZE_EMPTYTRANS(src_state->nremptytrans);
+         empty_transition_t* dest_trans = addr;
+         foreach (_emptylist, src_trans, &src_state->emptylist) {
+            dest_trans->state = src_trans->state;
+            insertlast_emptylist(&dest_state->emptylist, dest_trans);
+            ++ dest_trans;
+         }
+         dest_state->nremptytrans = src_state->nremptytrans;
+      }
 
-   // TEST initrange_state
-   static_assert( sizeof(state) > state_SIZE + state_SIZE_RANGETRANS(256),
-                  "initrange_state does not overflow state array");
-   for (unsigned i = 0; i < 256; ++i) {
-      memset(&state, 0, sizeof(state));
-      memset(&state, 255, sizeof(state[0]));
-      state[0].next = (void*) &state[1].next;
-      initrange_state(&state[0], &state[3], (uint8_t)i, from, to);
-      TEST(state[0].next == (void*) &state[1].next); // unchanged
-      TEST(state[0].nremptytrans == 0);
-      TEST(state[0].nrrangetrans == i);
-      TEST(state[0].emptylist.last == 0);
-      TEST(state[0].rangelist.last == (slist_node_t*) &range_trans[0].next);
-      TEST(state[0].isused == 255); // unchanged
-      TEST(range_trans[0].next == (slist_node_t*) &range_trans[0].next);
-      TEST(range_trans[0].size == i);
-      for (unsigned s = 0; s < i; ++s) {
-         TEST(range_trans[0].array[s].from  == (unsigned) (s+1));
-         TEST(range_trans[0].array[s].to    == (unsigned) (s+10));
-         TEST(range_trans[0].array[s].state == &state[3]);
+      // merge range transitions into as few nodes as possible
+      range_transition_t* dest_trans = 0;
+      foreach (_rangelist, src_trans, &src_state->rangelist) {
+         for (size_t i = 0; i < src_trans->size; ++i) {
+            if (!dest_trans || dest_trans->size == MAXRANGE) {
+               size_t size = src_state->nrrangetrans - dest_state->nrrangetrans;
+               if (size > MAXRANGE) size = MAXRANGE;
+               err = malloc_automatmman(mman, state_SIZE_RANGETRANS(size), &addr);
+               if (err) goto ONERR;
+               allocated += state_SIZE_RANGETRANS(size);
+               dest_trans = addr;
+               dest_trans->size = 0;
+               insertlast_rangelist(&dest_state->rangelist, dest_trans);
+            }
+            dest_trans->array[dest_trans->size++] = src_trans->array[i];
+            ++ dest_state->nrrangetrans;
+         }
       }
-      TEST(range_trans[0].array[i].from  == 0);
-      TEST(range_trans[0].array[i].to    == 0);
-      TEST(range_trans[0].array[i].state == 0);
    }
 
-   // TEST initcontinue_state
-   static_assert( sizeof(state) > state_SIZE + 256 * state_SIZE_RANGETRANS(1),
-                  "initcontinue_state does not overflow state array");
-   memset(&state, 0, sizeof(state));
-   state[0].next = (void*) &state[1].next;
-   state[0].nremptytrans = 2;
-   state[0].emptylist.last = (void*)3;
-   range_transition_t *trans = &range_trans[0];
-   for (unsigned i = 1, N = 1; N < 256; ++i, N += i) {
-      extendmatch_state(&state[0], &state[3], (uint8_t)i, from, to, trans);
-      TEST(state[0].next == (void*) &state[1].next);  // unchanged
-      TEST(state[0].nremptytrans == 2);               // unchanged
-      TEST(state[0].nrrangetrans == N);
-      TEST(state[0].emptylist.last == (void*)3);      // unchanged
-      TEST(state[0].rangelist.last == (void*) &trans->next);
-      TEST(trans->next == (void*) &range_trans[0].next);
-      trans = &range_trans[0];
-      for (unsigned S = 1, N2 = 1; N2 <= N; ++S, N2 += S) {
-         range_transition_t *next = (void*) &trans->array[S];
-         TEST(trans->next == (void*) (N2 < N ? &next->next : &range_trans[0].next));
-         TEST(trans->size == S);
-         for (unsigned s = 0; s < S; ++s) {
-            TEST(trans->array[s].from  == s+1u);
-            TEST(trans->array[s].to    == s+10u);
-            TEST(trans->array[s].state == &state[3]);
+   // === let transitions point to copied states ===
+   foreach (_statelist, dest_state, &dest_states) {
+      foreach (_emptylist, dest_trans, &dest_state->emptylist) {
+         dest_trans->state = dest_trans->state->dest;
+      }
+      foreach (_rangelist, dest_trans, &dest_state->rangelist) {
+         for (size_t i = 0; i < dest_trans->size; ++i) {
+            dest_trans->array[i].state = dest_trans->array[i].state->dest;
          }
-         trans = next;
       }
-      TEST(trans->next == 0);
-      TEST(trans->size == 0);
-      TEST(trans->array[0].from  == 0);
-      TEST(trans->array[0].to    == 0);
-      TEST(trans->array[0].state == 0);
    }
 
+   free(order);
+   order = 0;
+
+   // set out (change ndfa even in case of error to valid state)
+   incruse_automatmman(mman);
+   err = free_automat(ndfa);
+   ndfa->mman      = mman;
+   ndfa->nrstate   = nrstate;
+   ndfa->allocated = allocated;
+   ndfa->states    = dest_states;
+   ndfa->isDFA     = isDFA;
+   numberstates_automat(ndfa);
+   if (err) goto ONERR;
+
    return 0;
 ONERR:
-   return EINVAL;
+   if (ndfa->mman != mman) delete_automatmman(&mman);
+   free(order);
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
-static int test_statearray(void)
-{
-   statearray_t arr = statearray_FREE;
-   state_t    * state;
-   size_t       size;
-   size_t       L;
-   statearray_iter_t iter;
+typedef enum { OP_AND, OP_AND_NOT } op_e;
 
-   // prepare
-   for(L = 0; ((L+1)*sizeof(state_t*) + sizeof(statearray_block_t)) <= sizeblock_statearray(); ++L)
-      ;
+static int makedfa2_automat(automat_t* ndfa, op_e op, automat_t* ndfa2)
+{
+   int err;
+   void* addr;
+   size_t          nrstate = 0;
+   size_t          allocated;
+   slist_t         dfa_states = slist_INIT;
+   multistate_t    multistate = multistate_INIT;
+   statevector_t   * new_statevec = 0;
+   automat_mman_t  * mman[4] = { 0 };
+   slist_t         unprocessed;
+   patriciatrie_t  svec_index;
+   enum { DFA, STATEVEC, RANGEMAP, MULTISTATE };
+   state_t *startstate,  *endstate;
+   state_t *startstate2, *endstate2;
 
-   // TEST statearray_FREE
-   TEST( 0 == arr.mman);
-   TEST( 0 == arr.length_of_block);
-   TEST( isempty_slist(&arr.addlist));
-   TEST( isempty_slist(&arr.dellist));
-   TEST( isempty_slist(&arr.freelist));
-   TEST( 0 == arr.addnext);
-   TEST( 0 == arr.addend);
-   TEST( 0 == arr.delblock);
-   TEST( 0 == arr.delnext);
-   TEST( 0 == arr.delend);
+   if (! ndfa->mman || !ndfa2->mman) {
+      err = EINVAL;
+      goto ONERR;
+   }
 
-   // TEST sizeblock_statearray
-   TEST(16384 == sizeblock_statearray());
-
-   // TEST init_statearray
-   memset(&arr, 255, sizeof(arr));
-   arr.mman = 0;
-   size = SIZEALLOCATED_PAGECACHE();
-   // test
-   TEST( 0 == init_statearray(&arr));
-   // check env
-   TEST( size < SIZEALLOCATED_PAGECACHE());
-   // check arr
-   TEST( 0 != arr.mman);
-   TEST( L == arr.length_of_block);
-   TEST( isempty_slist(&arr.addlist));
-   TEST( isempty_slist(&arr.dellist));
-   TEST( isempty_slist(&arr.freelist));
-   TEST( 0 == arr.addnext);
-   TEST( 0 == arr.addend);
-   TEST( 0 == arr.delblock);
-   TEST( 0 == arr.delnext);
-   TEST( 0 == arr.delend);
+   remove_single_empty_transitions(ndfa);
+   remove_single_empty_transitions(ndfa2);
 
-   // TEST free_statearray: frees only mman && double free
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST( 0 == free_statearray(&arr));
-      // check env
-      TEST( size == SIZEALLOCATED_PAGECACHE());
-      // check arr
-      TEST( 0 == arr.mman);
-      TEST( L == arr.length_of_block); // untouched
-      // ...
+   // init local var
+   init_patriciatrie(&svec_index, keyadapter_statevector());
+   startend_automat(ndfa, &startstate, &endstate);
+   startend_automat(ndfa2, &startstate2, &endstate2);
+   for (size_t i = 0; i < lengthof(mman); ++i) {
+      err = new_automatmman(&mman[i]);
+      if (err) goto ONERR;
    }
 
-   // TEST insert1_statearray: addnext == addend == 0 || (addnext < addend)
-   TEST(0 == init_statearray(&arr));
-   for (uintptr_t i = 1; i <= L; ++i) {
-      // test
-      TEST( 0 == insert1_statearray(&arr, (state_t*)i));
-      // check mman
-      TEST( sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
-      // check arr
-      TEST( 0 != arr.mman);
-      TEST( L == arr.length_of_block);
-      statearray_block_t * block = first_blocklist(&arr.addlist);
-      TEST( block != 0);
-      TEST( block == first_blocklist(&arr.addlist));
-      TEST( block == last_blocklist(&arr.addlist))
-      TEST( isempty_slist(&arr.dellist));
-      TEST( isempty_slist(&arr.freelist));
-      TEST( &block->state[i] == arr.addnext);
-      TEST( &block->state[L] == arr.addend);
-      TEST( 0 == arr.delblock);
-      TEST( 0 == arr.delnext);
-      TEST( 0 == arr.delend);
-      // check first_blocklist content
-      TEST( block->next    == (slist_node_t*)block);
-      TEST( block->nrstate == 0);
-      TEST( block->state[i-1] == (state_t*)i);
-      if (i == L) {
-         for (uintptr_t i2 = 0; i2 < L; ++i2) {
-            TEST( block->state[i2] == (state_t*)(1+i2));
-         }
-      }
+   // flag used to discriminate between the owner automaton of the state
+   foreach (_statelist, s, &ndfa->states) {
+      s->nrdfa = 1;
+   }
+   foreach (_statelist, s, &ndfa2->states) {
+      s->nrdfa = 2;
    }
 
-   // TEST insert1_statearray: addnext == addend
-   TEST(0 == free_statearray(&arr));
-   TEST(0 == init_statearray(&arr));
-   TEST(0 == insert1_statearray(&arr, (state_t*)(void*)1));
-   statearray_block_t * block[6] = { first_blocklist(&arr.addlist), 0 };
-   for (uintptr_t i = 2; i <= lengthof(block); ++i) {
-      // test
-      arr.addnext = arr.addend;
-      TEST( 0 == insert1_statearray(&arr, (state_t*)i));
-      // check mman
-      TEST( i*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
-      // check arr
-      block[i-1] = last_blocklist(&arr.addlist);
-      TEST( 0 != arr.mman);
-      TEST( L == arr.length_of_block);
-      TEST( block[0]   == first_blocklist(&arr.addlist));
-      TEST( block[i-1] != block[0]);
-      TEST( isempty_slist(&arr.dellist));
-      TEST( isempty_slist(&arr.freelist));
-      TEST( &block[i-1]->state[1] == arr.addnext);
-      TEST( &block[i-1]->state[L] == arr.addend);
-      TEST( 0 == arr.delblock);
-      TEST( 0 == arr.delnext);
-      TEST( 0 == arr.delend);
-      // check previous last_blocklist content
-      TEST( block[i-2]->next    == (slist_node_t*)block[i-1]);
-      TEST( block[i-2]->nrstate == L);
-      // check last_blocklist content
-      TEST( block[i-1]->next     == (slist_node_t*)block[0]);
-      TEST( block[i-1]->nrstate  == 0);
-      TEST( block[i-1]->state[0] == (state_t*)i);
+   // generate start state of type statevector_t
+   err = add_multistate(&multistate, mman[MULTISTATE], startstate);
+   if (err) goto ONERR;
+   err = add_multistate(&multistate, mman[MULTISTATE], startstate2);
+   if (err) goto ONERR;
+   err = follow_empty_transition(&multistate, mman[MULTISTATE]);
+   if (err) goto ONERR;
+   // convert type from multistate_t into statevector_t
+   err = init_statevector(&new_statevec, statevector_MAXSTATEPERBLOCK, mman[STATEVEC], &multistate);
+   if (err) goto ONERR;
+   // store start state in list of unprocessed states and in index
+   initsingle_stateveclist(&unprocessed, new_statevec);
+   err = insert_patriciatrie(&svec_index, &new_statevec->index, 0);
+   if (err) goto ONERR;
+   reset_automatmman(mman[MULTISTATE]);
+
+   void* dfa_endstate;
+   allocated = state_SIZE + state_SIZE_EMPTYTRANS(1);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      err = malloc_automatmman(mman[DFA], allocated, &dfa_endstate);
    }
+   if (err) goto ONERR;
+   ++ nrstate;
+   initempty_state(dfa_endstate, dfa_endstate);
 
-   // prepare remove2_statearray
-   TEST(0 == free_statearray(&arr));
-   TEST(0 == init_statearray(&arr));
-   for (uintptr_t i = 0; i < lengthof(block); ++i) {
-      for (uintptr_t i2 = 1; i2 <= 7*(i+1); ++i2) {
-         TEST(0 == insert1_statearray(&arr, (state_t*)(i+i2)));
+   // process all unprocessed statevector_t
+   //   (every statevecor_t is a single state in the new build dfa)
+   // the first processed state is also the start state
+   while (! isempty_slist(&unprocessed)) {
+      statevector_t *statevec = removefirst_stateveclist(&unprocessed);
+
+      // build rangemap_t from statevec
+      // For every r in ranges:
+      //  extend r.state with all reachable states by following empty transitions
+      //  convert r.state of type multistate_t into type statevector_t
+      //  add r as transition to new dfa-state with pointer to converted statevector
+
+      rangemap_t rmap;
+      err = build_rangemap_from_statevector(&rmap, mman[RANGEMAP], statevec);
+      if (err) goto ONERR;
+
+      const bool isendstate = iscontained_statevector(statevec, endstate)
+                              && ((op == OP_AND && iscontained_statevector(statevec, endstate2))
+                                  || (op == OP_AND_NOT && ! iscontained_statevector(statevec, endstate2)));
+
+      if (isendstate && rmap.size == 0 && nrstate != 1/*not start state*/) {
+         // optimization if state is only an end state (except for start state)
+         // do not generate state which contains only a single empty transition to end state
+         statevec->dfa = dfa_endstate;
+         continue; // while (! isempty_slist(&unprocessed))
       }
-      block[i] = last_blocklist(&arr.addlist);
-      arr.addend = arr.addnext;
-   }
-   block[lengthof(block)-1]->nrstate = (size_t) (arr.addnext - &block[lengthof(block)-1]->state[0]);
-   TEST(isempty_slist(&arr.dellist));
-   TEST(isempty_slist(&arr.freelist));
-   arr.addend  = 0;
-   arr.addnext = 0;
-   TEST(0 == arr.delblock);
-   TEST(0 == arr.delnext);
-   TEST(0 == arr.delend);
-   arr.dellist = arr.addlist;
-   arr.addlist = (slist_t) slist_INIT;
 
-   // TEST remove2_statearray
-   for (uintptr_t i = 0; i < lengthof(block); ++i) {
-      for (uintptr_t i2 = 1; i2 <= 7*(i+1); ++i2) {
-         // test
-         state_t * removedstate = 0;
-         TEST( 0 == remove2_statearray(&arr, &removedstate));
-         // check mman
-         TEST( lengthof(block)*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
-         // check removedstate
-         TEST( removedstate == (state_t*)(i+i2));
-         // check arr
-         TEST( 0 != arr.mman);
-         TEST( L == arr.length_of_block);
-         TEST( isempty_slist(&arr.addlist));
-         if (i == lengthof(block)-1) {
-            TEST( isempty_slist(&arr.dellist));
-         } else {
-            TEST( ! isempty_slist(&arr.dellist));
-            TEST( block[i+1] == first_blocklist(&arr.dellist));
+      state_t *dfastate;
+      {
+         const size_t SIZE = state_SIZE + (isendstate ? state_SIZE_EMPTYTRANS(1) : 0);
+         if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+            err = malloc_automatmman(mman[DFA], SIZE, &addr);
          }
-         if (i == 0) {
-            TEST( isempty_slist(&arr.freelist));
+         if (err) goto ONERR;
+         allocated += SIZE;
+         dfastate = addr;
+         if (isendstate) {
+            initempty_state(dfastate, dfa_endstate);
          } else {
-            TEST( ! isempty_slist(&arr.freelist));
-            TEST( block[i-1] == last_blocklist(&arr.freelist));
+            init_state(dfastate);
          }
-         TEST( 0 == arr.addnext);
-         TEST( 0 == arr.addend);
-         TEST( block[i] == arr.delblock);
-         TEST( arr.delnext == &arr.delblock->state[i2]);
-         TEST( arr.delend  == &arr.delblock->state[7*(i+1)]);
       }
-   }
 
-   // TEST remove2_statearray: ENODATA (more than one time does not harm)
-   for (unsigned rep = 0; rep < 5; ++rep) {
-      state_t * removedstate = 0;
-      TEST( ENODATA == remove2_statearray(&arr, &removedstate));
-      // check mman
-      TEST( lengthof(block)*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
-      // check removedstate
-      TEST( removedstate == 0);
-      // check arr
-      TEST( 0 != arr.mman);
-      TEST( L == arr.length_of_block);
-      TEST( isempty_slist(&arr.addlist));
-      TEST( isempty_slist(&arr.dellist));
-      TEST( ! isempty_slist(&arr.freelist));
-      TEST( 0 == arr.addnext);
-      TEST( 0 == arr.addend);
-      TEST( 0 == arr.delblock);
-      TEST( arr.delnext == arr.delend);
-      TEST( arr.delend  == &block[lengthof(block)-1]->state[7*lengthof(block)]);
-      // check freelist content
-      size_t i = 0;
-      foreach (_blocklist, b, &arr.freelist) {
-         TEST( i < lengthof(block));
-         TEST( block[i++] == b);
-      }
-   }
+      range_transition_t dummytrans = { .size = 1 };
+      range_transition_t *prevtrans = &dummytrans;
 
-   // prepare swap1and2_statearray
-   TEST(0 == free_statearray(&arr));
-   TEST(0 == init_statearray(&arr));
-   for (size_t i = 0; i < lengthof(block); ++i) {
-      for (uintptr_t i2 = 1; i2 <= 3; ++i2) {
-         TEST(0 == insert1_statearray(&arr, (state_t*)(3*i+i2)));
-      }
-      block[i] = last_blocklist(&arr.addlist);
-      arr.addend = arr.addnext;
-   }
-   for (size_t i = 0; i < lengthof(block)/2; ++i) {
-      statearray_block_t *firstblock;
-      firstblock = removefirst_blocklist(&arr.addlist);
-      insertlast_blocklist(&arr.dellist, firstblock);
-   }
-   for (uintptr_t i = 1; i <= 4; ++i) {
-      TEST(0 == remove2_statearray(&arr, &state));
-      TEST(i == (uintptr_t)state);
-   }
-   TEST(! isempty_slist(&arr.addlist));
-   TEST(last_blocklist(&arr.addlist) == block[lengthof(block)-1]);
-   TEST(0 == block[lengthof(block)-1]->nrstate);
-   TEST(! isempty_slist(&arr.dellist));
-   TEST(! isempty_slist(&arr.freelist));
-   TEST(0 != arr.addend)
-   TEST(0 != arr.addnext);
-   TEST(0 != arr.delblock);
-   TEST(0 != arr.delnext);
-   TEST(0 != arr.delend);
-
-   // TEST swap1and2_statearray
-   swap1and2_statearray(&arr);
-   // check mman
-   TEST( lengthof(block)*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
-   // check arr
-   TEST( 0 != arr.mman);
-   TEST( L == arr.length_of_block);
-   TEST( isempty_slist(&arr.addlist));
-   TEST( ! isempty_slist(&arr.dellist));
-   TEST( ! isempty_slist(&arr.freelist));
-   TEST( 0 == arr.addnext);
-   TEST( 0 == arr.addend);
-   TEST( 0 == arr.delblock);
-   TEST( 0 == arr.delnext);
-   TEST( 0 == arr.delend);
-   // check freelist content (former dellist + delblock)
-   {
-      size_t i = 0;
-      foreach (_blocklist, b, &arr.freelist) {
-         TEST( i < lengthof(block)/2);
-         TEST( 3 == b->nrstate);
-         TEST( b == block[i++]);
+      range_t *range;
+      rangemap_iter_t iter;
+      init_rangemapiter(&iter, &rmap);
+      while (next_rangemapiter(&iter, &range)) {
+         err = follow_empty_transition(&range->multistate, mman[MULTISTATE]);
+         if (err) goto ONERR;
+         automat_mman_state_t oldstate;
+         storestate_automatmman(mman[STATEVEC], &oldstate); // statevector_t makes more than one allocation !
+         err = init_statevector(&new_statevec, statevector_MAXSTATEPERBLOCK, mman[STATEVEC], &range->multistate);
+         if (err) goto ONERR;
+         reset_automatmman(mman[MULTISTATE]);
+         if (! isnrdfa12_statevector(new_statevec, op == OP_AND)) {
+            // Optimization: end state can not be reached by new_statevec
+            //               ==> do not add any transition
+            restore_automatmman(mman[STATEVEC], &oldstate);
+            continue;
+         }
+         patriciatrie_node_t *existing_node;
+         err = insert_patriciatrie(&svec_index, &new_statevec->index, &existing_node);
+         if (! err) {
+            insertlast_stateveclist(&unprocessed, new_statevec);
+         } else {
+            if (err != EEXIST) goto ONERR;
+            restore_automatmman(mman[STATEVEC], &oldstate);
+            new_statevec = (void*) ((uintptr_t)existing_node - offsetof(statevector_t, index));
+         }
+         if (  (state_t*)new_statevec == prevtrans->array[prevtrans->size-1].state
+               && range->from == prevtrans->array[prevtrans->size-1].to+1) {
+            // transition optimizer
+            prevtrans->array[prevtrans->size-1].to = range->to;
+         } else {
+            // add new transition
+            err = malloc_automatmman(mman[DFA], state_SIZE_RANGETRANS(1), &addr);
+            if (err) goto ONERR;
+            if (addr == &prevtrans->array[prevtrans->size]) {
+               allocated += state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0);
+               err = mfreelast_automatmman(mman[DFA], (uint8_t*)addr + (state_SIZE_RANGETRANS(1) - state_SIZE_RANGETRANS(0)));
+               if (err) goto ONERR;
+               prevtrans->size += 1;
+            } else {
+               allocated += state_SIZE_RANGETRANS(1);
+               prevtrans = addr;
+               insertlast_rangelist(&dfastate->rangelist, prevtrans);
+               prevtrans->size = 1;
+            }
+            ++ dfastate->nrrangetrans;
+            prevtrans->array[prevtrans->size-1].from  = range->from;
+            prevtrans->array[prevtrans->size-1].to    = range->to;
+            prevtrans->array[prevtrans->size-1].state = (state_t*) new_statevec;
+         }
       }
-      TEST( i == lengthof(block)/2);
-   }
-   // check dellist content (former addlist)
-   {
-      size_t i = lengthof(block)/2;
-      foreach (_blocklist, b, &arr.dellist) {
-         TEST( i < lengthof(block));
-         TEST( 3 == b->nrstate);
-         TEST( b == block[i++]);
+      reset_automatmman(mman[RANGEMAP]);
+      if (! dfastate->nrrangetrans && isendstate && nrstate != 1/*not start state*/) {
+         // remove empty state
+         const size_t SIZE = state_SIZE + state_SIZE_EMPTYTRANS(1);
+         statevec->dfa = dfa_endstate;
+         err = mfreelast_automatmman(mman[DFA], dfastate);
+         if (err) goto ONERR;
+         allocated -= SIZE;
+      } else {
+         statevec->dfa = dfastate;
+         ++ nrstate;
+         insertlast_statelist(&dfa_states, dfastate);
       }
-      TEST( i == lengthof(block));
-   }
-   for (uintptr_t i = 3*lengthof(block)/2+1; i <= 3*lengthof(block); ++i) {
-      TEST(0 == remove2_statearray(&arr, &state));
-      TEST(i == (uintptr_t)state);
-   }
-   TEST(ENODATA == remove2_statearray(&arr, &state));
-
-   // TEST init_statearrayiter: empty statearray
-   TEST(0 == free_statearray(&arr));
-   TEST(0 == init_statearray(&arr));
-   init_statearrayiter(&iter, &arr);
-   // check iter
-   TEST( 0 == iter.block);
-   TEST( 0 == iter.next);
-   TEST( 0 == iter.end);
-
-   // TEST init_statearrayiter: single allocated page
-   for (uintptr_t i = 0; i < arr.length_of_block; ++i) {
-      TEST(0 == insert1_statearray(&arr, (state_t*)i));
-      init_statearrayiter(&iter, &arr);
-      // check iter
-      TEST( iter.block == first_blocklist(&arr.addlist));
-      TEST( iter.next  == first_blocklist(&arr.addlist)->state);
-      TEST( iter.end   == first_blocklist(&arr.addlist)->state);
-   }
-
-   // TEST init_statearrayiter: multiple allocated pages
-   TEST(0 == insert1_statearray(&arr, (state_t*)0));
-   init_statearrayiter(&iter, &arr);
-   // check iter
-   TEST( iter.block == first_blocklist(&arr.addlist));
-   TEST( iter.next  == first_blocklist(&arr.addlist)->state);
-   TEST( iter.end   == first_blocklist(&arr.addlist)->state + arr.length_of_block);
-   for (uintptr_t nrpage = 2; nrpage < 20; ++nrpage) {
-      // prepare
-      arr.addend = arr.addnext;
-      TEST(0 == insert1_statearray(&arr, (state_t*)nrpage));
-      // test
-      init_statearrayiter(&iter, &arr);
-      // check iter
-      TEST( iter.block == first_blocklist(&arr.addlist));
-      TEST( iter.next  == first_blocklist(&arr.addlist)->state);
-      TEST( iter.end   == first_blocklist(&arr.addlist)->state + arr.length_of_block);
    }
 
-   // TEST next_statearrayiter: empty statearray
-   TEST(0 == free_statearray(&arr));
-   TEST(0 == init_statearray(&arr));
-   init_statearrayiter(&iter, &arr);
-   // test
-   TEST( 0 == next_statearrayiter(&iter, &arr, &state));
-   // check iter
-   TEST( 0 == iter.block);
-   TEST( 0 == iter.next);
-   TEST( 0 == iter.end);
+   // set end state as last state in list
+   insertlast_statelist(&dfa_states, dfa_endstate);
 
-   // TEST next_statearrayiter: single page statearray
-   for (unsigned len = 1, S = 1, S2 = 1; len < 20; ++len, S2 += len) {
-      // prepare
-      for (uintptr_t i = S; i <= S2; ++i) {
-         TEST(0 == insert1_statearray(&arr, (state_t*)i));
-      }
-      if (len == 1) init_statearrayiter(&iter, &arr);
-      for (uintptr_t i = 0; i < len; ++i, ++S) {
-         // test
-         TEST( 1 == next_statearrayiter(&iter, &arr, &state));
-         // check state
-         TEST( S == (uintptr_t)state);
-         // check iter
-         TEST( iter.block == first_blocklist(&arr.addlist));
-         TEST( iter.next  == first_blocklist(&arr.addlist)->state + S);
-         TEST( iter.end   == first_blocklist(&arr.addlist)->state + S2);
+   // convert all pointers of transitions from dfa
+   // from pointing to statevector_t into pointers to state_t
+   foreach (_statelist, dfastate, &dfa_states) {
+      foreach (_rangelist, range_trans, &dfastate->rangelist) {
+         for (size_t s = 0; s < range_trans->size; ++s) {
+            range_trans->array[s].state = ((statevector_t*)range_trans->array[s].state)->dfa;
+         }
       }
-      // test (ENODATA)
-      TEST( 0 == next_statearrayiter(&iter, &arr, &state));
-      // check state (not changed)
-      TEST( S2 == (uintptr_t)state);
-      // check iter (not changed)
-      TEST( iter.block == first_blocklist(&arr.addlist));
-      TEST( iter.next  == first_blocklist(&arr.addlist)->state + S2);
-      TEST( iter.end   == first_blocklist(&arr.addlist)->state + S2);
    }
 
-   // TEST next_statearrayiter: multiple page statearray
-   TEST(0 == free_statearray(&arr));
-   TEST(0 == init_statearray(&arr));
-   TEST(0 == insert1_statearray(&arr, (state_t*)1));
-   init_statearrayiter(&iter, &arr);
-   block[0] = first_blocklist(&arr.addlist);
-   for (uintptr_t nrpage = 2; nrpage < 20; ++nrpage, block[0] = next_blocklist(block[0])) {
-      arr.addend = arr.addnext;
-      TEST(0 == insert1_statearray(&arr, (state_t*)nrpage));
-      // test
-      TEST( 1 == next_statearrayiter(&iter, &arr, &state));
-      // check state
-      TEST( nrpage-1 == (uintptr_t)state);
-      // check iter
-      TEST( last_blocklist(&arr.addlist) == next_blocklist(block[0]));
-      TEST( iter.block == block[0]);
-      TEST( iter.next  == block[0]->state + 1);
-      TEST( iter.end   == block[0]->state + 1);
-   }
-   for (unsigned tc = 1; tc <= 1; --tc) {
-      // test (last + ENODATA)
-      TEST( tc == next_statearrayiter(&iter, &arr, &state));
-      // check state
-      TEST( 19 == (uintptr_t)state);
-      // check iter
-      TEST( last_blocklist(&arr.addlist) == block[0]);
-      TEST( iter.block == block[0]);
-      TEST( iter.next  == block[0]->state + 1);
-      TEST( iter.end   == block[0]->state + 1);
+   for (size_t i = 0; i < lengthof(mman); ++i) {
+      if (i == DFA) continue;
+      err = delete_automatmman(&mman[i]);
+      if (err) goto ONERR;
    }
+   automat_mman_t * dfa_mman = mman[DFA];
+   mman[DFA] = 0;
 
-   // reset
-   TEST(0 == free_statearray(&arr));
+   // set out (change ndfa even in case of error in free to valid state)
+   incruse_automatmman(dfa_mman);
+   err = free_automat(ndfa);
+   ndfa->mman = dfa_mman;
+   ndfa->nrstate = nrstate;
+   ndfa->allocated = allocated;
+   ndfa->states = dfa_states;
+   ndfa->isDFA  = 1;
+   numberstates_automat(ndfa);
+   if (err) goto ONERR;
 
    return 0;
 ONERR:
-   free_statearray(&arr);
-   return EINVAL;
+   for (size_t i = 0; i < lengthof(mman); ++i) {
+      delete_automatmman(&mman[i]);
+   }
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
-static int test_multistate(void)
+int opand_automat(automat_t* restrict ndfa, automat_t* restrict ndfa2)
 {
-   const unsigned NROFSTATE = 256;
-   state_t        state[NROFSTATE];
-   multistate_t   mst = multistate_INIT;
-   automat_mman_t* mman = 0;
-   multistate_iter_t iter;
-   void * const   ENDMARKER = (void*) (uintptr_t) 0x01234567;
-   const unsigned LEVEL1_NROFSTATE = multistate_NROFSTATE * multistate_NROFCHILD;
+   int err;
 
-   static_assert( 2*LEVEL1_NROFSTATE <= NROFSTATE,
-                  "state array big enough to build root node with all possible number of leaves"
-                  "and also supports interleaving (only every 2nd state to support inserting in between)"
-                  );
+   err = makedfa2_automat(ndfa, OP_AND, ndfa2);
+   if (err) goto ONERR;
+   err = free_automat(ndfa2);
+   if (err) goto ONERR;
 
-   // prepare
-   memset(&state, 0, sizeof(state));
-   TEST(0 == new_automatmman(&mman));
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
 
-   // TEST multistate_NROFSTATE
-   TEST( lengthof(((multistate_node_t*)0)->state) == multistate_NROFSTATE);
+int opandnot_automat(automat_t* restrict ndfa, automat_t* restrict ndfa2)
+{
+   int err;
 
-   // TEST multistate_NROFCHILD
-   TEST( lengthof(((multistate_node_t*)0)->child) == multistate_NROFCHILD);
+   err = makedfa2_automat(ndfa, OP_AND_NOT, ndfa2);
+   if (err) goto ONERR;
+   err = free_automat(ndfa2);
+   if (err) goto ONERR;
 
-   // TEST multistate_INIT
-   TEST(0 == mst.size);
-   TEST(0 == mst.root);
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
 
-   // TEST add_multistate: multistate_t.size == 0
-   for (unsigned i = 0; i < NROFSTATE; ++i) {
-      mst = (multistate_t) multistate_INIT;
-      for (unsigned tc = 0; tc <= 1; ++tc) {
-         // test
-         TEST( (tc ? EEXIST : 0) == add_multistate(&mst, mman, &state[i]));
-         // check mman: nothing allocated
-         TEST( 0 == sizeallocated_automatmman(mman));
-         // check mst
-         TEST( 1 == mst.size);
-         TEST( &state[i] == mst.root);
-      }
+int opnot_automat(automat_t* restrict ndfa)
+{
+   int err;
+   automat_t all = automat_FREE;
+
+   if (ndfa->mman == 0) {
+      err = EINVAL;
+      goto ONERR;
    }
 
-   // TEST add_multistate: multistate_t.size == 1
-   for (unsigned i = 0; i < NROFSTATE-1; ++i) {
-      for (unsigned order = 0; order <= 1; ++order) {
-         // prepare
-         mst = (multistate_t) multistate_INIT;
-         TEST(0 == add_multistate(&mst, mman, &state[i + !order]));
-         for (unsigned tc = 0; tc <= 1; ++tc) {
-            // test
-            TEST( (tc ? EEXIST : 0) == add_multistate(&mst, mman, &state[i + order]));
-            // check mman
-            TEST( sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-            // check mst
-            TEST( 0 == invariant_multistate(&mst));
-            TEST( 2 == mst.size);
-            TEST( 0 != mst.root);
-            // check mst.root content
-            TEST( 0 == ((multistate_node_t*)mst.root)->level);
-            TEST( 2 == ((multistate_node_t*)mst.root)->size);
-            TEST( &state[i] == ((multistate_node_t*)mst.root)->state[0]);
-            TEST( &state[i+1] == ((multistate_node_t*)mst.root)->state[1]);
+   err = initmatch_automat(&all, ndfa, 1, (char32_t[]){0}, (char32_t[]){maxchar_utf8()});
+   if (err) goto ONERR;
+   err = oprepeat_automat(&all, 0);
+   if (err) goto ONERR;
+   err = makedfa2_automat(&all, OP_AND_NOT, ndfa);
+   if (err) goto ONERR;
+   err = free_automat(ndfa);
+   initmove_automat(ndfa, &all);
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   (void) free_automat(&all);
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+// group: persistence
+
+/* function: checksum_automatimage
+ * Berechnet FNV-1a (64 Bit) über data[0..size-1]. */
+static uint64_t checksum_automatimage(size_t size, const uint8_t data[size])
+{
+   uint64_t hash = 0xcbf29ce484222325;
+   for (size_t i = 0; i < size; ++i) {
+      hash ^= data[i];
+      hash *= 0x100000001b3;
+   }
+   return hash;
+}
+
+/* function: save2_automat
+ * Implementiert <save_automat> und <saveutf8_automat>.
+ * flags wird in <automat_image_header_t.flags> gespeichert. */
+static int save2_automat(const automat_t* ndfa, const char* filename, uint32_t flags)
+{
+   int err;
+   int fd = -1;
+   char*    tmpname = 0;
+   bool     isTmpfile = false;
+   uint8_t* image = 0;
+   size_t   nrstate = 0;
+   size_t   nrrange = 0;
+
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   // state->nr is the number of the state (read only access)
+   foreach (_statelist, s, &ndfa->states) {
+      ++ nrstate;
+      nrrange += s->nrrangetrans;
+   }
+
+   if (nrstate > UINT32_MAX-1 || nrrange > UINT32_MAX) {
+      err = E2BIG;
+      goto ONERR;
+   }
+
+   const size_t SIZE = sizeof(automat_image_header_t)
+                     + (nrstate+1) * sizeof(automat_image_state_t)
+                     + nrrange * sizeof(automat_image_range_t);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      image = malloc(SIZE);
+      err = image ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+
+   automat_image_header_t* header = (automat_image_header_t*) image;
+   automat_image_state_t*  states = (automat_image_state_t*) (header + 1);
+   automat_image_range_t*  ranges = (automat_image_range_t*) (states + nrstate + 1);
+   size_t r = 0;
+   foreach (_statelist, s, &ndfa->states) {
+      states[s->nr] = (automat_image_state_t) { (uint32_t)r, s->nremptytrans != 0 };
+      foreach (_rangelist, range_trans, &s->rangelist) {
+         for (size_t i = 0; i < range_trans->size; ++i, ++r) {
+            ranges[r] = (automat_image_range_t) {
+               range_trans->array[i].from, range_trans->array[i].to, (uint32_t)range_trans->array[i].state->nr
+            };
          }
-         // reset
-         reset_automatmman(mman);
       }
    }
+   states[nrstate] = (automat_image_state_t) { (uint32_t)r, 0 };
 
-   // TEST add_multistate: single leaf && add states ascending/descending
-   for (unsigned asc = 0; asc <= 1; ++asc) {
-      void * addr = 0;
-      mst = (multistate_t) multistate_INIT;
-      for (unsigned i = 0; i < multistate_NROFSTATE; ++i) {
-         // test
-         TEST( 0 == add_multistate(&mst, mman, &state[asc ? i : multistate_NROFSTATE-1-i]));
-         if (1 == i) {  // set end marker at end of node
-            TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr));
-            *((void**)addr) = ENDMARKER;
-            // check that end marker is effective !!
-            TEST(addr == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
-         }
-         // check mman
-         TEST( (i > 0 ? sizeof(void*)+sizeof(multistate_node_t) : 0) == sizeallocated_automatmman(mman));
-         // check mst
-         TEST( 0 == invariant_multistate(&mst));
-         TEST( i+1 == mst.size);
-         TEST( 0   != mst.root);
-         // check mst.root content
-         if (i >= 1) {
-            TEST( 0   == ((multistate_node_t*)mst.root)->level);
-            TEST( i+1 == ((multistate_node_t*)mst.root)->size);
-            for (unsigned s = 0; s <= i; ++s) {
-               TEST( &state[asc ? s : multistate_NROFSTATE-1-i+s] == ((multistate_node_t*)mst.root)->state[s]);
+   *header = (automat_image_header_t) {
+      .magic = automat_image_MAGIC, .version = automat_image_VERSION,
+      .headersize = sizeof(automat_image_header_t),
+      .nrstate = (uint32_t)nrstate, .nrrange = (uint32_t)nrrange,
+      .flags = flags, .reserved = 0,
+      .checksum = checksum_automatimage(SIZE - sizeof(automat_image_header_t), (uint8_t*)states)
+   };
+
+   // write temporary file "<filename>.XXXXXX" in the same directory (rename is atomic only within a filesystem)
+   const size_t namelen = strlen(filename);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      tmpname = malloc(namelen + sizeof(".XXXXXX"));
+      err = tmpname ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+   memcpy(tmpname, filename, namelen);
+   memcpy(tmpname + namelen, ".XXXXXX", sizeof(".XXXXXX"));
+   fd = mkstemp(tmpname);
+   if (fd == -1) {
+      err = errno;
+      goto ONERR;
+   }
+   isTmpfile = true;
+   if (fchmod(fd, 0644)) {
+      err = errno;
+      goto ONERR;
+   }
+   for (size_t written = 0; written < SIZE; ) {
+      ssize_t bytes = write(fd, image + written, SIZE - written);
+      if (bytes < 0) {
+         if (errno == EINTR) continue;
+         err = errno;
+         goto ONERR;
+      }
+      written += (size_t) bytes;
+   }
+   if (fsync(fd)) {
+      err = errno;
+      goto ONERR;
+   }
+   if (close(fd)) {
+      fd = -1;
+      err = errno;
+      goto ONERR;
+   }
+   fd = -1;
+   // replace filename (mapped images of the old file stay valid)
+   if (rename(tmpname, filename)) {
+      err = errno;
+      goto ONERR;
+   }
+   free(tmpname);
+   free(image);
+
+   return 0;
+ONERR:
+   if (fd != -1) close(fd);
+   if (isTmpfile) unlink(tmpname);
+   free(tmpname);
+   free(image);
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int save_automat(const automat_t* ndfa, const char* filename)
+{
+   return save2_automat(ndfa, filename, 0);
+}
+
+int saveutf8_automat(const automat_t* ndfa, const char* filename)
+{
+   return save2_automat(ndfa, filename, automat_image_UTF8);
+}
+
+
+// section: automat_lazydfa_t
+
+/* struct: lazystate_t
+ * Ein Zustand des bei Bedarf erzeugten DFA.
+ * Die Übergänge werden beim Erzeugen des Zustandes nur in nicht überlappende
+ * Bereiche aufgeteilt, die Zielzustände werden erst beim ersten Durchlaufen berechnet.
+ * Ein <rangestate_t.state> mit Wert 0 bedeutet, dass der Zielzustand noch nicht berechnet wurde,
+ * ansonsten zeigt er auf einen <lazystate_t>. */
+typedef struct lazystate_t {
+   statevector_t * svec;      // set of ndfa states represented by this dfa state
+   bool            isend;     // svec contains end state of ndfa
+   size_t          nrrangetrans; // number of range transitions
+   slist_t         rangelist; // sorted list of range_transition_t
+} lazystate_t;
+
+/* struct: automat_lazydfa_t
+ * Cache aller bisher erzeugten <lazystate_t>. */
+struct automat_lazydfa_t {
+   const automat_t*  ndfa;
+   automat_mman_t*   mman[3];
+   patriciatrie_t    svec_index;
+   lazystate_t*      start;
+   size_t            maxcachesize;
+   size_t            nrstate;
+   size_t            nrflush;
+};
+
+enum { LAZYDFA_CACHE, LAZYDFA_RANGEMAP, LAZYDFA_MULTISTATE };
+
+// group: constants
+
+/* define: lazydfa_MAXRANGEPERBLOCK
+ * Maximale Anzahl an <rangestate_t>, die in einem einzigen <range_transition_t>
+ * eines <lazystate_t> gespeichert werden. */
+#define lazydfa_MAXRANGEPERBLOCK \
+         ((65536 - sizeof(range_transition_t)) / sizeof(rangestate_t))
+
+// group: helper
+
+/* function: flush_automatlazydfa
+ * Verwirft alle erzeugten <lazystate_t>. */
+static void flush_automatlazydfa(automat_lazydfa_t* lazy)
+{
+   reset_automatmman(lazy->mman[LAZYDFA_CACHE]);
+   init_patriciatrie(&lazy->svec_index, keyadapter_statevector());
+   lazy->start   = 0;
+   lazy->nrstate = 0;
+   ++ lazy->nrflush;
+}
+
+/* function: newstate_automatlazydfa
+ * Liefert den <lazystate_t> zu der Menge an ndfa Zuständen aus multistate.
+ * Falls er noch nicht existiert, wird er erzeugt. Ist der Cache voll, wird er vorher
+ * mit <flush_automatlazydfa> geleert. Alle vorher gelieferten <lazystate_t> sind dann ungültig.
+ *
+ * Unchecked Precondition:
+ * - multistate is not empty and contains all states reachable by empty transitions */
+static int newstate_automatlazydfa(automat_lazydfa_t* lazy, multistate_t* multistate, /*out*/lazystate_t** lstate)
+{
+   int err;
+   void* addr;
+   statevector_t* svec;
+   patriciatrie_node_t* existing_node;
+   automat_mman_t* mman = lazy->mman[LAZYDFA_CACHE];
+   automat_mman_state_t oldstate;
+   state_t *startstate, *endstate;
+
+   if (sizeallocated_automatmman(mman) >= lazy->maxcachesize) {
+      flush_automatlazydfa(lazy);
+   }
+
+   storestate_automatmman(mman, &oldstate);
+   err = init_statevector(&svec, statevector_MAXSTATEPERBLOCK, mman, multistate);
+   if (err) goto ONERR;
+   err = insert_patriciatrie(&lazy->svec_index, &svec->index, &existing_node);
+   if (err) {
+      if (err != EEXIST) goto ONERR;
+      restore_automatmman(mman, &oldstate);
+      svec = (void*) ((uintptr_t)existing_node - offsetof(statevector_t, index));
+      *lstate = (lazystate_t*) svec->dfa;
+      return 0;
+   }
+
+   // new state: split ranges of all ndfa states into non overlapping ranges
+   rangemap_t rmap = rangemap_INIT;
+   foreach (_stateblocklist, block, &svec->blocklist) {
+      for (size_t i = 0; i < block->nrstate; ++i) {
+         foreach (_rangelist, range_trans, &block->state[i]->rangelist) {
+            for (size_t s = 0; s < range_trans->size; ++s) {
+               err = addrange_rangemap(&rmap, lazy->mman[LAZYDFA_RANGEMAP], range_trans->array[s].from, range_trans->array[s].to);
+               if (err) goto ONERR;
             }
-            TEST( ENDMARKER == *((void**)addr)); // no overflow into following memory block
          }
       }
-      // reset
-      reset_automatmman(mman);
    }
 
-   // TEST add_multistate: single leaf && add states unordered
-   for (unsigned S = 3; S < multistate_NROFSTATE; ++S) {
-      for (unsigned pos = 0; pos < S; ++pos) {
-         // prepare
-         mst = (multistate_t) multistate_INIT;
-         for (unsigned i = 0; i < S; ++i) {
-            if (i != pos) { TEST(0 == add_multistate(&mst, mman, &state[i])); }
-         }
-         void * addr = 0;
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr));
-         *((void**)addr) = ENDMARKER;
-         TEST(addr == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
-         // test
-         TEST( 0 == add_multistate(&mst, mman, &state[pos]));
-         // check: mman
-         TEST( sizeof(void*)+sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-         // check: mst
-         TEST( 0 == invariant_multistate(&mst));
-         TEST( S == mst.size);
-         TEST( 0 != mst.root);
-         // check: mst.root content
-         TEST( 0 == ((multistate_node_t*)mst.root)->level);
-         TEST( S == ((multistate_node_t*)mst.root)->size);
-         for (unsigned i = 0; i < S; ++i) {
-            TEST( &state[i] == ((multistate_node_t*)mst.root)->state[i]);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      err = malloc_automatmman(mman, sizeof(lazystate_t), &addr);
+   }
+   if (err) goto ONERR;
+   lazystate_t* newstate = addr;
+   startend_automat(lazy->ndfa, &startstate, &endstate);
+   newstate->svec  = svec;
+   newstate->isend = iscontained_statevector(svec, endstate);
+   newstate->nrrangetrans = rmap.size;
+   newstate->rangelist = (slist_t) slist_INIT;
+   svec->dfa = (state_t*) newstate;
+
+   range_t* range;
+   rangemap_iter_t iter;
+   init_rangemapiter(&iter, &rmap);
+   for (size_t nrrange = rmap.size; nrrange; ) {
+      const size_t size = nrrange < lazydfa_MAXRANGEPERBLOCK ? nrrange : lazydfa_MAXRANGEPERBLOCK;
+      err = malloc_automatmman(mman, state_SIZE_RANGETRANS(size), &addr);
+      if (err) goto ONERR;
+      range_transition_t* trans = addr;
+      trans->size = size;
+      for (size_t i = 0; i < size; ++i) {
+         if (! next_rangemapiter(&iter, &range)) {
+            err = EINVAL;
+            goto ONERR;
          }
-         // check: no overflow into following memory block
-         TEST( ENDMARKER == *((void**)addr));
-         // reset
-         reset_automatmman(mman);
+         trans->array[i] = (rangestate_t) { range->from, range->to, 0 };
       }
+      insertlast_rangelist(&newstate->rangelist, trans);
+      nrrange -= size;
    }
+   reset_automatmman(lazy->mman[LAZYDFA_RANGEMAP]);
+   ++ lazy->nrstate;
 
-   // TEST add_multistate: single leaf: EEXIST
-   {
-      // prepare
-      mst = (multistate_t) multistate_INIT;
-      for (unsigned i = 0; i < multistate_NROFSTATE; ++i) {
-         TEST(0 == add_multistate(&mst, mman, &state[i]));
-      }
-      void * addr = 0;
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr));
-      *((void**)addr) = ENDMARKER;
-      TEST(addr == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
-      for (unsigned i = 0; i < multistate_NROFSTATE; ++i) {
-         // test
-         TEST( EEXIST == add_multistate(&mst, mman, &state[i]));
-         // check mman
-         TEST( sizeof(void*)+sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-         // check mst
-         TEST( multistate_NROFSTATE == mst.size);
-         TEST( 0 != mst.root);
-         // check mst.root content
-         TEST( 0 == ((multistate_node_t*)mst.root)->level);
-         TEST( multistate_NROFSTATE == ((multistate_node_t*)mst.root)->size);
-         TEST( 0 == ((multistate_node_t*)mst.root)->next);
-         for (unsigned s = 0; s < multistate_NROFSTATE; ++s) {
-            TEST( &state[s] == ((multistate_node_t*)mst.root)->state[s]);
-         }
-         TEST( ENDMARKER == *((void**)addr)); // no overflow into following memory block
-      }
-      // reset
-      reset_automatmman(mman);
+   *lstate = newstate;
+
+   return 0;
+ONERR:
+   // cache could contain partially initialized state
+   flush_automatlazydfa(lazy);
+   reset_automatmman(lazy->mman[LAZYDFA_RANGEMAP]);
+   return err;
+}
+
+/* function: startstate_automatlazydfa
+ * Liefert den Startzustand. Er wird erzeugt, falls er nicht im Cache liegt. */
+static int startstate_automatlazydfa(automat_lazydfa_t* lazy, /*out*/lazystate_t** lstate)
+{
+   int err;
+   multistate_t multistate = multistate_INIT;
+   state_t *startstate, *endstate;
+
+   if (!lazy->start) {
+      startend_automat(lazy->ndfa, &startstate, &endstate);
+      err = add_multistate(&multistate, lazy->mman[LAZYDFA_MULTISTATE], startstate);
+      if (err) goto ONERR;
+      err = follow_empty_transition(&multistate, lazy->mman[LAZYDFA_MULTISTATE]);
+      if (err) goto ONERR;
+      err = newstate_automatlazydfa(lazy, &multistate, &lazy->start);
+      if (err) goto ONERR;
+      reset_automatmman(lazy->mman[LAZYDFA_MULTISTATE]);
    }
 
-   // TEST add_multistate: split leaf node (level 0) ==> build root (level 1) ==> 3 nodes total
-   for (unsigned splitidx = 0; splitidx <= multistate_NROFSTATE; ++splitidx) {
-      void * addr[2] = { 0 };
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-      *((void**)addr[0]) = ENDMARKER;
-      // prepare
-      mst = (multistate_t) multistate_INIT;
-      for (unsigned i = 0, next = 0; i < multistate_NROFSTATE; ++i, ++next) {
-         if (next == splitidx) ++next;
-         TEST(0 == add_multistate(&mst, mman, &state[next]));
-      }
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-      *((void**)addr[1]) = ENDMARKER;
-      TEST(addr[1] == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
-      TEST(addr[0] == &((void**)mst.root)[-1]);
-      // test
-      void * oldroot = mst.root;
-      TEST( 2*sizeof(void*)+sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-      TEST( 0 == add_multistate(&mst, mman, &state[splitidx]));
-      // check: mman
-      TEST( 2*sizeof(void*)+3*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-      // check: mst
-      TEST( 0 == invariant_multistate(&mst));
-      TEST( mst.size == multistate_NROFSTATE+1);
-      TEST( mst.root != 0);
-      TEST( mst.root != oldroot);
-      TEST( mst.root == ((uint8_t*)addr[1]) + sizeof(void*) + sizeof(multistate_node_t));
-      // check: mst.root content
-      TEST( ((multistate_node_t*)mst.root)->level == 1);
-      TEST( ((multistate_node_t*)mst.root)->size  == 2);
-      TEST( ((multistate_node_t*)mst.root)->child[0] == oldroot);
-      TEST( ((multistate_node_t*)mst.root)->child[1] == (multistate_node_t*) (((uint8_t*)addr[1]) + sizeof(void*)));
-      TEST( ((multistate_node_t*)mst.root)->key[0]   == ((multistate_node_t*)mst.root)->child[1]->state[0]);
-      // check: leaf1 content
-      multistate_node_t* leaf1 = ((multistate_node_t*)mst.root)->child[0];
-      multistate_node_t* leaf2 = ((multistate_node_t*)mst.root)->child[1];
-      TEST( leaf1->level == 0);
-      TEST( leaf1->size  == multistate_NROFSTATE/2 + 1);
-      TEST( leaf1->next  == leaf2);
-      for (unsigned i = 0; i < leaf1->size; ++i) {
-         TEST( &state[i] == leaf1->state[i]);
-      }
-      // check: leaf2 content
-      TEST( leaf2->level == 0);
-      TEST( leaf2->size  == multistate_NROFSTATE/2);
-      TEST( leaf2->next  == 0);
-      for (unsigned i = 0; i < leaf2->size; ++i) {
-         TEST( &state[leaf1->size+i] == leaf2->state[i]);
-      }
-      // check: no overflow into surrounding memory
-      for (size_t i = 0; i < lengthof(addr); ++i) {
-         TEST( ENDMARKER == *((void**)addr[i]));
-      }
-      // reset
-      reset_automatmman(mman);
+   *lstate = lazy->start;
+
+   return 0;
+ONERR:
+   reset_automatmman(lazy->mman[LAZYDFA_MULTISTATE]);
+   return err;
+}
+
+/* function: nextstate_automatlazydfa
+ * Liefert den Folgezustand von lstate beim Lesen von chr.
+ * Der Wert 0 wird in *next zurückgegeben, falls kein Übergang existiert.
+ * Falls der Folgezustand erst berechnet werden muss und dabei der Cache geleert wird,
+ * ist lstate nach Rückkehr ungültig. */
+static int nextstate_automatlazydfa(automat_lazydfa_t* lazy, lazystate_t* lstate, char32_t chr, /*out*/lazystate_t** next)
+{
+   int err;
+   multistate_t multistate = multistate_INIT;
+
+   rangestate_t* range = findrange_rangelist(&lstate->rangelist, chr);
+   if (!range) {
+      *next = 0;
+      return 0;
+   }
+   if (range->state) {
+      *next = (lazystate_t*) range->state;
+      return 0;
    }
 
-   // TEST add_multistate: build root node (level 1) + many leafs (level 0) ascending/descending
-   for (unsigned desc = 0; desc <= 1; ++desc) {
-      void * child[multistate_NROFCHILD] = { 0 };
-      void * addr[multistate_NROFCHILD] = { 0 };
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-      *((void**)addr[0]) = ENDMARKER;
-      child[0] = (uint8_t*)addr[0] + sizeof(void*);
-      child[1] = (uint8_t*)child[0] + sizeof(multistate_node_t);
-      void * root = (uint8_t*)child[1] + sizeof(multistate_node_t);
-      // prepare
-      mst = (multistate_t) multistate_INIT;
-      for (unsigned i = 0; i < multistate_NROFSTATE+1; ++i) {
-         TEST(0 == add_multistate(&mst, mman, &state[desc?NROFSTATE-1-i:i]));
-      }
-      unsigned SIZE = multistate_NROFSTATE+1;
-      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-      *((void**)addr[1]) = ENDMARKER;
-      for (unsigned nrchild = 2; nrchild <= multistate_NROFCHILD; ) {
-         for (unsigned nrstate = 1; nrstate <= multistate_NROFSTATE/2+(desc==0); ++nrstate) {
-            const unsigned isSplit = (nrstate == multistate_NROFSTATE/2+(desc==0));
-            if (isSplit && nrchild==multistate_NROFCHILD) {
-               // fill only last but do not split it else root would overflow
-               // this is checked in next test case
-               ++nrchild;
-               break;
-            }
-            // test add to last(desc==0)/first(desc==1) leaf
-            TEST( 0 == add_multistate(&mst, mman, &state[desc?NROFSTATE-1-SIZE:SIZE]));
-            if (isSplit) {
-               if (desc) memmove(&child[2], &child[1], (nrchild-1)*sizeof(child[0]));
-               child[desc?1:nrchild] = (uint8_t*)addr[nrchild-1] + sizeof(void*);
-               TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[nrchild]));
-               *((void**)addr[nrchild]) = ENDMARKER;
-               ++ nrchild;
-            }
-            // check: mman
-            TEST( nrchild*sizeof(void*)+(nrchild+1)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-            // check: mst
-            TEST( 0 == invariant_multistate(&mst));
-            ++ SIZE;
-            TEST( SIZE == mst.size);
-            TEST( root == mst.root);
-            // check mst.root content
-            TEST( 1       == ((multistate_node_t*)mst.root)->level);
-            TEST( nrchild == ((multistate_node_t*)mst.root)->size);
-            for (unsigned i = 0; i < nrchild; ++i) {
-               TEST( child[i] == ((multistate_node_t*)mst.root)->child[i]);
-               if (i) {
-                  state_t * key = &state[ desc ? NROFSTATE-nrchild*(multistate_NROFSTATE/2) + i*(multistate_NROFSTATE/2)
-                                : i*(multistate_NROFSTATE/2+1)];
-                  TEST( key == ((multistate_node_t*)mst.root)->key[i-1]);
-               }
-            }
-            // check: leaf content
-            for (unsigned i = 0, istate=desc?NROFSTATE-SIZE:0; i < nrchild; ++i) {
-               const unsigned isLast = desc?i==0:i==nrchild-1;
-               const unsigned S = (multistate_NROFSTATE/2+(desc?isLast:(unsigned)!isLast)) + nrstate*isLast*(!isSplit);
-               TEST( 0 == ((multistate_node_t*)child[i])->level);
-               TEST( S == ((multistate_node_t*)child[i])->size);
-               TEST( (i==nrchild-1?0:child[i+1]) == ((multistate_node_t*)child[i])->next);
-               for (unsigned s = 0; s < S; ++s, ++istate) {
-                  TEST( &state[istate] == ((multistate_node_t*)child[i])->state[s]);
+   // compute target: all ndfa states reachable by reading chr
+   foreach (_stateblocklist, block, &lstate->svec->blocklist) {
+      for (size_t i = 0; i < block->nrstate; ++i) {
+         foreach (_rangelist, range_trans, &block->state[i]->rangelist) {
+            for (size_t s = 0; s < range_trans->size; ++s) {
+               if (range_trans->array[s].from <= chr && chr <= range_trans->array[s].to) {
+                  err = add_multistate(&multistate, lazy->mman[LAZYDFA_MULTISTATE], range_trans->array[s].state);
+                  if (err && err != EEXIST) goto ONERR;
                }
             }
-            // check: no overflow into surrounding memory
-            for (unsigned i = 0; i < nrchild; ++i) {
-               TEST( ENDMARKER == *((void**)addr[i]));
-            }
          }
       }
-      // reset
-      reset_automatmman(mman);
    }
+   err = follow_empty_transition(&multistate, lazy->mman[LAZYDFA_MULTISTATE]);
+   if (err) goto ONERR;
 
-   // TEST add_multistate: build root node (level 1) + many leafs (level 0) unordered
-   for (unsigned nrchild=2; nrchild < multistate_NROFCHILD; ++nrchild) {
-      for (unsigned pos = 0; pos < nrchild; ++pos) {
-         void * child[multistate_NROFCHILD] = { 0 };
-         void * addr[multistate_NROFCHILD+1] = { 0 };
-         // addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... splitchild
-         TEST(0 == build1_multistate(&mst, mman, state, 2/*every 2nd*/, ENDMARKER, nrchild, addr, child));
-         void *   const root = mst.root;
-         unsigned const SIZE = nrchild * multistate_NROFSTATE + 1;
-         // test add single state ==> split check split
-         TEST( 0 == add_multistate(&mst, mman, &state[1+pos*(2*multistate_NROFSTATE)]));
-         // check: mman
-         TEST( (nrchild+2)*sizeof(void*)+(nrchild+2)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-         // check: mst
-         TEST( 0 == invariant_multistate(&mst));
-         TEST( SIZE == mst.size);
-         TEST( root == mst.root);
-         // check mst.root content
-         TEST( 1         == ((multistate_node_t*)mst.root)->level);
-         TEST( nrchild+1 == ((multistate_node_t*)mst.root)->size);
-         memmove(&child[pos+2], &child[pos+1], (nrchild-1-pos)*sizeof(child[0]));
-         child[pos+1] = (uint8_t*)addr[1+nrchild] + sizeof(void*);
-         TEST( child[0] == ((multistate_node_t*)mst.root)->child[0]);
-         for (unsigned i = 1; i < nrchild+1; ++i) {
-            state_t * key = &state[(i-(i>pos))*(2*multistate_NROFSTATE)+(i==pos+1)*multistate_NROFSTATE];
-            TEST( ((multistate_node_t*)mst.root)->key[i-1] == key);
-            TEST( ((multistate_node_t*)mst.root)->child[i] == child[i]);
-         }
-         // check: leaf content
-         for (unsigned i = 0, istate=0; i < nrchild+1; ++i) {
-            unsigned const S = i == pos ? multistate_NROFSTATE/2+1 : i == pos+1 ? multistate_NROFSTATE/2 : multistate_NROFSTATE;
-            TEST( 0 == ((multistate_node_t*)child[i])->level);
-            TEST( S == ((multistate_node_t*)child[i])->size);
-            TEST( (i==nrchild?0:child[i+1]) == ((multistate_node_t*)child[i])->next);
-            for (unsigned s = 0; s < S; ++s, istate += (s<=2&&i==pos?1:2)) {
-               TEST( &state[istate] == ((multistate_node_t*)child[i])->state[s]);
-            }
-         }
-         // check: no overflow into surrounding memory
-         for (unsigned i = 0; i < nrchild+2; ++i) {
-            TEST( ENDMARKER == *((void**)addr[i]));
-         }
-         // reset
-         malloc_automatmman(mman, 0, &addr[1]);
-         memset(addr[0], 0, (uintptr_t)addr[1] - (uintptr_t)addr[0]);
-         reset_automatmman(mman);
+   const size_t nrflush = lazy->nrflush;
+   err = newstate_automatlazydfa(lazy, &multistate, next);
+   if (err) goto ONERR;
+   reset_automatmman(lazy->mman[LAZYDFA_MULTISTATE]);
+
+   if (nrflush == lazy->nrflush) {
+      // memoize transition (lstate is still valid)
+      range->state = (state_t*) *next;
+   }
+
+   return 0;
+ONERR:
+   reset_automatmman(lazy->mman[LAZYDFA_MULTISTATE]);
+   return err;
+}
+
+// group: lifetime
+
+int new_automatlazydfa(/*out*/automat_lazydfa_t** lazy, const automat_t* ndfa, size_t maxcachesize)
+{
+   int err;
+   automat_lazydfa_t* newlazy = 0;
+
+   if (ndfa->nrstate < 2) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      newlazy = malloc(sizeof(automat_lazydfa_t));
+      err = newlazy ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+
+   *newlazy = (automat_lazydfa_t) { .ndfa = ndfa, .maxcachesize = maxcachesize };
+   init_patriciatrie(&newlazy->svec_index, keyadapter_statevector());
+   for (size_t i = 0; i < lengthof(newlazy->mman); ++i) {
+      err = new_automatmman(&newlazy->mman[i]);
+      if (err) goto ONERR;
+   }
+
+   *lazy = newlazy;
+
+   return 0;
+ONERR:
+   if (newlazy) {
+      delete_automatlazydfa(&newlazy);
+   }
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int delete_automatlazydfa(automat_lazydfa_t** lazy)
+{
+   int err = 0;
+   automat_lazydfa_t* dellazy = *lazy;
+
+   if (dellazy) {
+      *lazy = 0;
+      for (size_t i = 0; i < lengthof(dellazy->mman); ++i) {
+         int err2 = delete_automatmman(&dellazy->mman[i]);
+         if (err2) err = err2;
       }
+      free(dellazy);
+
+      if (err) goto ONERR;
    }
 
-   // TEST add_multistate: split root node (level 1)
-   for (unsigned pos = 0; pos < multistate_NROFCHILD; ++pos) {
-      void * child[multistate_NROFCHILD+1] = { 0 };
-      void * addr[multistate_NROFCHILD+2] = { 0 };
-      // addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... splitchild splitroot new-root
-      TEST(0 == build1_multistate(&mst, mman, state, 2/*every 2nd*/, ENDMARKER, multistate_NROFCHILD, addr, child));
-      void *   const oldroot = mst.root;
-      void *   const splitchild = (uint8_t*)addr[multistate_NROFCHILD+1] + sizeof(void*);
-      void *   const splitroot = (uint8_t*)splitchild + sizeof(multistate_node_t);
-      void *   const root = (uint8_t*)splitroot + sizeof(multistate_node_t);
-      size_t const SIZE = multistate_NROFCHILD * multistate_NROFSTATE + 1;
-      state_t* const splitchild_key = &state[pos*(2*multistate_NROFSTATE)+multistate_NROFSTATE];
-      state_t* const splitroot_key  = pos < multistate_NROFCHILD/2 ? &state[(multistate_NROFCHILD/2)*(2*multistate_NROFSTATE)]
-                                    : pos == multistate_NROFCHILD/2 ? splitchild_key
-                                    : &state[(multistate_NROFCHILD/2+1)*(2*multistate_NROFSTATE)];
-      memmove(&child[pos+2], &child[pos+1], (multistate_NROFCHILD-1-pos)*sizeof(child[0]));
-      child[pos+1] = splitchild;
-      // test add single state ==> split check split
-      TEST( 0 == add_multistate(&mst, mman, &state[1+pos*(2*multistate_NROFSTATE)]));
-      // check: mman
-      TEST( (multistate_NROFCHILD+2)*sizeof(void*)+(multistate_NROFCHILD+4)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-      // check: mst
-      TEST( 0 == invariant_multistate(&mst));
-      TEST( SIZE == mst.size);
-      TEST( root == mst.root);
-      // check mst.root content
-      TEST( 2 == ((multistate_node_t*)mst.root)->level);
-      TEST( 2 == ((multistate_node_t*)mst.root)->size);
-      TEST( splitroot_key == ((multistate_node_t*)mst.root)->key[0]);
-      TEST( oldroot   == ((multistate_node_t*)mst.root)->child[0]);
-      TEST( splitroot == ((multistate_node_t*)mst.root)->child[1]);
-      // check oldroot / splitroot content
-      for (unsigned i = 0, ichild = 0; i < 2; ++i) {
-         const unsigned S = multistate_NROFCHILD/2+1-i;
-         TEST( 1 == ((multistate_node_t*)mst.root)->child[i]->level);
-         TEST( S == ((multistate_node_t*)mst.root)->child[i]->size);
-         for (unsigned s = 0; s < S; ++s, ++ichild) {
-            TEST( child[ichild] == ((multistate_node_t*)mst.root)->child[i]->child[s]);
-            if (s) {
-               state_t * key = ((multistate_node_t*)child[ichild])->state[0];
-               TEST( key == ((multistate_node_t*)mst.root)->child[i]->key[s-1]);
-            }
-         }
-      }
-      // check: leaf content
-      for (unsigned i = 0, istate=0; i < multistate_NROFCHILD+1; ++i) {
-         unsigned const S = i == pos ? multistate_NROFSTATE/2+1 : i == pos+1 ? multistate_NROFSTATE/2 : multistate_NROFSTATE;
-         TEST( 0 == ((multistate_node_t*)child[i])->level);
-         TEST( S == ((multistate_node_t*)child[i])->size);
-         TEST( (i==multistate_NROFCHILD?0:child[i+1]) == ((multistate_node_t*)child[i])->next);
-         for (unsigned s = 0; s < S; ++s, istate += (s<=2&&i==pos?1:2)) {
-            TEST( &state[istate] == ((multistate_node_t*)child[i])->state[s]);
-         }
-      }
-      // check: no overflow into surrounding memory
-      for (unsigned i = 0; i < multistate_NROFCHILD+2; ++i) {
-         TEST( ENDMARKER == *((void**)addr[i]));
-      }
-      // reset
-      malloc_automatmman(mman, 0, &addr[1]);
-      memset(addr[0], 0, (uintptr_t)addr[1] - (uintptr_t)addr[0]);
-      reset_automatmman(mman);
-   }
+   return 0;
+ONERR:
+   TRACEEXITFREE_ERRLOG(err);
+   return err;
+}
 
-   // TEST add_multistate: (level 2) split child(level 1) and add to root
-   for (unsigned nrchild=2; nrchild < multistate_NROFCHILD; ++nrchild) {
-      for (uintptr_t pos = 0; pos < nrchild; ++pos) {
-         void * addr[2];
-         void * child[multistate_NROFCHILD] = { 0 };
-         size_t SIZE = nrchild * LEVEL1_NROFSTATE + 1;
-         TEST(0 == malloc_automatmman(mman, 0, &addr[0]));
-         TEST(0 == build2_multistate(&mst, mman, 2, nrchild, child));
-         void * root = mst.root;
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-         void * splitchild = (uint8_t*)addr[1] + sizeof(void*) + sizeof(multistate_node_t)/*leaf*/;
-         // test add single state ==> split check split
-         TEST( 0 == add_multistate(&mst, mman, (void*)(1+pos*(2*LEVEL1_NROFSTATE))));
-         // check: mman
-         TEST( sizeof(void*)+(1+2+nrchild+nrchild*multistate_NROFCHILD)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
-         // check: mst
-         TEST( 0 == invariant_multistate(&mst));
-         TEST( SIZE == mst.size);
-         TEST( root == mst.root);
-         // check mst.root content
-         TEST( 2         == ((multistate_node_t*)mst.root)->level);
-         TEST( nrchild+1 == ((multistate_node_t*)mst.root)->size);
-         state_t * key;
-         for (uintptr_t i = 0; i <= pos; ++i) {
-            key = (state_t*)(void*)(i*(2*LEVEL1_NROFSTATE));
-            if (i) TEST( key == ((multistate_node_t*)mst.root)->key[i-1]);
-            TEST( child[i] == ((multistate_node_t*)mst.root)->child[i]);
-         }
-         key = (state_t*)(void*)(pos*(2*LEVEL1_NROFSTATE)+LEVEL1_NROFSTATE);
-         TEST( key == ((multistate_node_t*)mst.root)->key[pos]);
-         TEST( splitchild == ((multistate_node_t*)mst.root)->child[pos+1]);
-         for (uintptr_t i = pos+2; i < nrchild; ++i) {
-            key = (state_t*)(void*)((i-1)*(2*LEVEL1_NROFSTATE));
-            TEST( key == ((multistate_node_t*)mst.root)->key[i-1]);
-            TEST( child[i-1] == ((multistate_node_t*)mst.root)->child[i]);
-         }
-         // check node/leaf content
-         TEST( EEXIST == add_multistate(&mst, mman, (void*)(1+pos*(2*LEVEL1_NROFSTATE))));
-         for (uintptr_t i = 0; i < LEVEL1_NROFSTATE*nrchild; ++i) {
-            TEST(EEXIST == add_multistate(&mst, mman, (void*)(2*i)));
-         }
-         // reset
-         malloc_automatmman(mman, 0, &addr[1]);
-         memset(addr[0], 0, (uintptr_t)addr[1] - (uintptr_t)addr[0]);
-         reset_automatmman(mman);
+// group: query
+
+size_t nrstate_automatlazydfa(const automat_lazydfa_t* lazy)
+{
+   return lazy->nrstate;
+}
+
+size_t nrflush_automatlazydfa(const automat_lazydfa_t* lazy)
+{
+   return lazy->nrflush;
+}
+
+size_t matchchar32_automatlazydfa(automat_lazydfa_t* lazy, size_t len, const char32_t str[len], bool matchLongest)
+{
+   int err;
+   lazystate_t* next;
+   size_t matchedlen = 0;
+
+   err = startstate_automatlazydfa(lazy, &next);
+   if (err) goto ONERR;
+
+   if (next->isend && ! matchLongest) return 0;
+
+   for (size_t stroffset = 0; stroffset < len; ) {
+      err = nextstate_automatlazydfa(lazy, next, str[stroffset], &next);
+      if (err) goto ONERR;
+      if (!next) break;
+      ++ stroffset;
+      if (next->isend) {
+         matchedlen = stroffset;
+         if (! matchLongest) break; // use first match
       }
    }
 
-   // TEST init_multistateiter: multistate_INIT
-   mst = (multistate_t) multistate_INIT;
-   memset(&iter, 255, sizeof(iter));
-   init_multistateiter(&iter, &mst);
-   // check iter
-   TEST(0 == iter.next_node);
-   TEST(0 == iter.next_state);
-   TEST(0 == iter.is_single);
-
-   // TEST next_multistateiter: multistate_INIT
-   state_t * next = 0;
-   TEST(0 == next_multistateiter(&iter, &next));
-   // check next (unchanged)
-   TEST(0 == next);
-   // check iter
-   TEST(0 == iter.next_node);
-   TEST(0 == iter.next_state);
-   TEST(0 == iter.is_single);
+   return matchedlen;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return 0;
+}
 
-   // TEST init_multistateiter: single entry
-   TEST(0 == add_multistate(&mst, mman, (void*)5));
-   memset(&iter, 255, sizeof(iter));
-   init_multistateiter(&iter, &mst);
-   // check iter
-   TEST(5 == (uintptr_t)iter.next_node);
-   TEST(0 == iter.next_state);
-   TEST(1 == iter.is_single);
 
-   // TEST next_multistateiter: single entry
-   // test
-   TEST(1 == next_multistateiter(&iter, &next));
-   // check next
-   TEST(5 == (uintptr_t)next);
-   // check iter
-   TEST(0 == iter.next_node);
-   TEST(0 == iter.next_state);
-   TEST(0 == iter.is_single);
+// section: automat_image_t
 
-   multistate_node_t * F = 0;
-   for (uintptr_t i=6; i <= 2*LEVEL1_NROFSTATE; ++i) {
-      // TEST init_multistateiter: one or more pages
-      TEST(0 == add_multistate(&mst, mman, (void*)i));
-      if (i == 6) F = mst.root;
-      memset(&iter, 255, sizeof(iter));
-      init_multistateiter(&iter, &mst);
-      // check iter
-      TEST(F == iter.next_node);
-      TEST(0 == iter.next_state);
-      TEST(0 == iter.is_single);
+// group: lifetime
 
-      // TEST next_multistateiter: one or more pages
-      multistate_node_t * N = F;
-      for (uintptr_t i2 = 5, O = 1; i2 <= i; ++i2, O++) {
-         if (O > N->size) { O = 1; N = N->next; }
-         TEST(1 == next_multistateiter(&iter, &next));
-         // check next
-         TEST(i2 == (uintptr_t)next);
-         // check iter
-         TEST(N == iter.next_node);
-         TEST(O == iter.next_state);
-         TEST(0 == iter.is_single);
+int load_automatimage(/*out*/automat_image_t* img, const char* filename, bool isChecksum)
+{
+   int err;
+   int fd;
+   void* addr = MAP_FAILED;
+   size_t size = 0;
+   struct stat st;
+
+   fd = open(filename, O_RDONLY|O_CLOEXEC);
+   if (fd == -1) {
+      err = errno;
+      goto ONERR;
+   }
+   if (fstat(fd, &st)) {
+      err = errno;
+      goto ONERR;
+   }
+   if (  (uintmax_t)st.st_size < sizeof(automat_image_header_t)
+         || (uintmax_t)st.st_size > SIZE_MAX) {
+      err = EINVAL;
+      goto ONERR;
+   }
+   size = (size_t) st.st_size;
+   addr = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+   if (addr == MAP_FAILED) {
+      err = errno;
+      goto ONERR;
+   }
+   close(fd);
+   fd = -1;
+
+   // === validate format ===
+   const automat_image_header_t* header = addr;
+   if (  header->magic != automat_image_MAGIC
+         || header->version != automat_image_VERSION
+         || header->headersize != sizeof(automat_image_header_t)
+         || (header->flags & ~automat_image_UTF8) != 0
+         || header->reserved != 0
+         || header->nrstate < 2
+         || header->nrstate > UINT32_MAX-1) {
+      err = EINVAL;
+      goto ONERR;
+   }
+   const size_t nrstate = header->nrstate;
+   const size_t nrrange = header->nrrange;
+   if (size != sizeof(automat_image_header_t) + (nrstate+1) * sizeof(automat_image_state_t) + nrrange * sizeof(automat_image_range_t)) {
+      err = EINVAL;
+      goto ONERR;
+   }
+   const automat_image_state_t* states = (const automat_image_state_t*) (header + 1);
+   const automat_image_range_t* ranges = (const automat_image_range_t*) (states + nrstate + 1);
+   if (  isChecksum
+         && header->checksum != checksum_automatimage(size - sizeof(automat_image_header_t), (const uint8_t*)states)) {
+      err = EINVAL;
+      goto ONERR;
+   }
+   // ranges are sorted and point to valid states (matching depends on it)
+   if (states[0].range != 0 || states[nrstate].range != nrrange) {
+      err = EINVAL;
+      goto ONERR;
+   }
+   for (size_t s = 0; s < nrstate; ++s) {
+      if (states[s].range > states[s+1].range) {
+         err = EINVAL;
+         goto ONERR;
+      }
+      for (size_t r = states[s].range; r < states[s+1].range; ++r) {
+         if (  ranges[r].from > ranges[r].to || ranges[r].state >= nrstate
+               || (r > states[s].range && ranges[r-1].to >= ranges[r].from)) {
+            err = EINVAL;
+            goto ONERR;
+         }
       }
-      // test end of chain
-      TEST(0 == next_multistateiter(&iter, &next));
-      // check iter: reached end
-      TEST(0 == iter.next_node);
-      TEST(0 == iter.next_state);
-      TEST(0 == iter.is_single);
    }
 
-   // free resources
-   TEST(0 == delete_automatmman(&mman));
+   // set out
+   img->addr    = addr;
+   img->size    = size;
+   img->nrstate = nrstate;
+   img->states  = states;
+   img->ranges  = ranges;
+   img->flags   = header->flags;
 
    return 0;
 ONERR:
-   delete_automatmman(&mman);
-   return EINVAL;
+   if (addr != MAP_FAILED) munmap(addr, size);
+   if (fd != -1) close(fd);
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
-static int test_rangemap(void)
+int free_automatimage(automat_image_t* img)
 {
-   rangemap_t      rmap = rangemap_INIT;
-   automat_mman_t *mman = 0;
-   rangemap_iter_t iter;
-   void * const    ENDMARKER = (void*) (uintptr_t) 0x01234567;
-
-   // prepare
-   TEST(0 == new_automatmman(&mman));
+   int err;
 
-   // TEST rangemap_NROFRANGE
-   TEST( lengthof(((rangemap_node_t*)0)->range) == rangemap_NROFRANGE);
+   if (img->addr) {
+      err = munmap((void*)(uintptr_t)img->addr, img->size);
+      *img = (automat_image_t) automat_image_FREE;
+      if (err) {
+         err = errno;
+         goto ONERR;
+      }
+   }
 
-   // TEST rangemap_NROFCHILD
-   TEST( lengthof(((rangemap_node_t*)0)->child) == rangemap_NROFCHILD);
+   return 0;
+ONERR:
+   TRACEEXITFREE_ERRLOG(err);
+   return err;
+}
 
-   // TEST rangemap_INIT
-   TEST(0 == rmap.size);
-   TEST(0 == rmap.root);
+// group: query
 
-   // TEST addrange_rangemap: EINVAL
-   TEST( EINVAL == addrange_rangemap(&rmap, mman, 1, 0));
-   TEST( EINVAL == addrange_rangemap(&rmap, mman, UINT32_MAX, 0));
+/* function: nextstate_automatimage
+ * Gibt die Nummer des Folgezustandes von state beim Lesen von chr zurück.
+ * Der Wert <nrstate_automatimage> wird zurückgegeben, falls kein Übergang existiert. */
+static inline size_t nextstate_automatimage(const automat_image_t* img, size_t state, char32_t chr)
+{
+   size_t low  = img->states[state].range;
+   size_t high = img->states[state+1].range;
 
-   // TEST addrange_rangemap: multistate_t.size == 0
-   for (unsigned from = 0; from < 256; from += 16) {
-      for (unsigned to = from; to < 256; to += 32) {
-         void * addr[2];
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-         // assumes big blocks + no free block header stored in free memory
-         addr[1] = (uint8_t*)addr[0] + sizeof(rangemap_node_t);
-         for (unsigned i = 0; i < lengthof(addr); ++i) {
-            *(void**)addr[i] = ENDMARKER;
-         }
-         // test
-         rmap = (rangemap_t) rangemap_INIT;
-         TEST( 0 == addrange_rangemap(&rmap, mman, from, to));
-         // check mman: root allocated
-         TEST( sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
-         // check rmap
-         TEST( rmap.size == 1);
-         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
-         // check mst.root content
-         TEST( 0 == rmap.root->level);
-         TEST( 1 == rmap.root->size);
-         TEST( 0 == rmap.root->next);
-         TEST( from == rmap.root->range[0].from);
-         TEST( to == rmap.root->range[0].to);
-         TEST( 0  == rmap.root->range[0].multistate.size);
-         // no overflow to adjacent block
-         for (unsigned i = 0; i < lengthof(addr); ++i) {
-            TEST( ENDMARKER == *(void**)addr[i]);
-         }
-         // reset
-         reset_automatmman(mman);
+   while (low < high) {
+      size_t mid = (high + low)/2;
+      if (chr < img->ranges[mid].from) {
+         high = mid;
+      } else if (chr > img->ranges[mid].to) {
+         low = mid+1;
+      } else {
+         return img->ranges[mid].state;
       }
    }
 
-   // TEST addrange_rangemap: insert non-overlapping ranges into single node
-   for (unsigned S = 2; S <= rangemap_NROFRANGE; ++S) {
-      for (unsigned pos = 0; pos < S; ++pos) {
-         // prepare
-         void * addr[2];
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-         *(void**)addr[0] = ENDMARKER;
-         rmap = (rangemap_t) rangemap_INIT;
-         for (unsigned i = 0; i < S; ++i) {
-            if (i == pos) continue;
-            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)i, (char32_t)i));
-         }
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-         *(void**)addr[1] = ENDMARKER;
-         // test
-         TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)pos, (char32_t)pos));
-         // check mman: only root allocated
-         TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
-         // check rmap
-         TEST( rmap.size == S);
-         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
-         // check mst.root content
-         TEST( 0 == rmap.root->level);
-         TEST( S == rmap.root->size);
-         TEST( 0 == rmap.root->next);
-         for (unsigned i = 0; i < S; ++i) {
-            TEST( i == rmap.root->range[i].from);
-            TEST( i == rmap.root->range[i].to);
-            TEST( 0 == rmap.root->range[i].multistate.size);
-         }
-         // no overflow to adjacent block
-         for (size_t i = 0; i < lengthof(addr); ++i) {
-            TEST( ENDMARKER == *(void**)addr[i]);
-         }
-         // reset
-         reset_automatmman(mman);
+   return img->nrstate;
+}
+
+/* function: match_automatimage
+ * Implementiert <matchchar32_automatimage> und <matchutf8_automatimage>.
+ * Ist isUTF8 gesetzt, zeigt str auf len Bytes, sonst auf len Zeichen vom Typ char32_t.
+ * Der Parameter isUTF8 ist in beiden Aufrufen konstant, so dass der Compiler je eine Version erzeugt. */
+static inline size_t match_automatimage(const automat_image_t* img, size_t len, const void* str, bool isUTF8, bool matchLongest)
+{
+   size_t state = 0;
+   size_t matchedlen = 0;
+
+   if (!img->addr || isUTF8 != (0 != (img->flags & automat_image_UTF8))) return 0;
+
+   if (img->states[0].isend && ! matchLongest) return 0;
+
+   for (size_t stroffset = 0; stroffset < len; ) {
+      const char32_t chr = isUTF8 ? ((const uint8_t*)str)[stroffset] : ((const char32_t*)str)[stroffset];
+      state = nextstate_automatimage(img, state, chr);
+      if (state == img->nrstate) break;
+      ++ stroffset;
+      if (img->states[state].isend) {
+         matchedlen = stroffset;
+         if (! matchLongest) break; // use first match
       }
    }
 
-   // TEST addrange_rangemap: insert range overlapping with ranges and holes
-   for (unsigned S = 1; S <= rangemap_NROFRANGE/2-1; ++S) {
-      for (unsigned from = 0; from <= 2*S; ++from) {
-         for (unsigned to = from; to <= 2*S; ++to) {
-            // prepare
-            void * addr[2];
-            TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-            *(void**)addr[0] = ENDMARKER;
-            rmap = (rangemap_t) rangemap_INIT;
-            for (unsigned i = 0; i < S; ++i) {
-               TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(1+2*i), (char32_t)(1+2*i)));
-            }
-            TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-            *(void**)addr[1] = ENDMARKER;
-            // test
-            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)from, (char32_t)to));
-            // check mman
-            TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
-            // check rmap
-            unsigned const D = to-from+1;
-            unsigned const S2 = S + D/2 + (D&1?!(from&1):0);
-            TESTP( rmap.size == S2, "rmap.size:%zd S2:%d S:%d to:%d from:%d", rmap.size, S2, S, to, from);
-            TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
-            // check mst.root content
-            TEST( 0  == rmap.root->level);
-            TEST( S2 == rmap.root->size);
-            TEST( 0  == rmap.root->next);
-            for (unsigned i = 0, N = from < 1 ? from : 1; i < S2; ++i, ++N) {
-               N += !(N&1) && (N < from || N > to);
-               TESTP( N == rmap.root->range[i].from, "from:%d to:%d N:%d != [%d]:%d", from, to, N, i, rmap.root->range[i].from);
-               TEST( N == rmap.root->range[i].to);
-               TEST( 0 == rmap.root->range[i].multistate.size);
-            }
-            // no overflow to adjacent block
-            for (unsigned i = 0; i < lengthof(addr); ++i) {
-               TEST( ENDMARKER == *(void**)addr[i]);
-            }
-            // reset
-            reset_automatmman(mman);
-         }
+   return matchedlen;
+}
+
+size_t matchchar32_automatimage(const automat_image_t* img, size_t len, const char32_t str[len], bool matchLongest)
+{
+   return match_automatimage(img, len, str, false, matchLongest);
+}
+
+size_t matchutf8_automatimage(const automat_image_t* img, size_t len, const uint8_t str[len], bool matchLongest)
+{
+   return match_automatimage(img, len, str, true, matchLongest);
+}
+
+
+// section: automat_prefilter_t
+
+// group: helper
+
+/* function: findscalar_automatprefilter
+ * Sucht ab str[offset] das erste Zeichen, das in einem der Bereiche filter->from[i]..filter->to[i] liegt.
+ * Liefert len, falls keines gefunden wurde. */
+static size_t findscalar_automatprefilter(const automat_prefilter_t* filter, size_t offset, size_t len, const char32_t str[len])
+{
+   for (size_t i = offset; i < len; ++i) {
+      for (unsigned r = 0; r < filter->nrrange; ++r) {
+         if (str[i] - filter->from[r] <= filter->to[r] - filter->from[r]) return i;
       }
    }
+   return len;
+}
 
-   // TEST addrange_rangemap: insert range fully overlapping with one or more ranges
-   for (unsigned from = 0; from < rangemap_NROFRANGE; ++from) {
-      for (unsigned to = from; to < rangemap_NROFRANGE; ++to) {
-         const unsigned S = rangemap_NROFRANGE;
-         // prepare
-         void * addr[2];
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-         *(void**)addr[0] = ENDMARKER;
-         rmap = (rangemap_t) rangemap_INIT;
-         for (unsigned i = 0; i < rangemap_NROFRANGE; ++i) {
-            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(4*i), (char32_t)(3+4*i)));
-         }
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-         *(void**)addr[1] = ENDMARKER;
-         // test
-         TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(4*from), (char32_t)(4*to+3)));
-         // check mman: unchanged
-         TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
-         // check rmap: unchanged
-         TEST( rmap.size == S);
-         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
-         // check mst.root content: unchanged
-         TEST( 0 == rmap.root->level);
-         TEST( S == rmap.root->size);
-         TEST( 0 == rmap.root->next);
-         for (unsigned i = 0; i < S; ++i) {
-            TEST( 4*i   == rmap.root->range[i].from);
-            TEST( 4*i+3 == rmap.root->range[i].to);
-            TEST( 0 == rmap.root->range[i].multistate.size);
-         }
-         // no overflow to adjacent block
-         for (size_t i = 0; i < lengthof(addr); ++i) {
-            TEST( ENDMARKER == *(void**)addr[i]);
-         }
-         // reset
-         reset_automatmman(mman);
-      }
+#ifdef __SSE2__
+
+/* function: findsse2_automatprefilter
+ * Wie <findscalar_automatprefilter>, vergleicht aber 4 Zeichen pro Schritt. */
+static size_t findsse2_automatprefilter(const automat_prefilter_t* filter, size_t offset, size_t len, const char32_t str[len])
+{
+   const __m128i bias = _mm_set1_epi32((int)0x80000000);
+   __m128i from[automat_prefilter_MAXRANGE];
+   __m128i size[automat_prefilter_MAXRANGE]; // (to - from) ^ bias
+
+   for (unsigned r = 0; r < filter->nrrange; ++r) {
+      from[r] = _mm_set1_epi32((int)filter->from[r]);
+      size[r] = _mm_xor_si128(_mm_set1_epi32((int)(filter->to[r] - filter->from[r])), bias);
    }
 
-   // TEST addrange_rangemap: insert range partially overlapping with one or more ranges
-   for (unsigned from = 0; from < 3*4; ++from) {
-      for (unsigned to = from; to < 3*4; ++to) {
-         const unsigned S = 3u + (0 != from % 4) + (3 != to % 4);
-         // prepare
-         void * addr[2];
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
-         *(void**)addr[0] = ENDMARKER;
-         rmap = (rangemap_t) rangemap_INIT;
-         for (unsigned i = 0; i < 3; ++i) {
-            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(4*i), (char32_t)(3+4*i)));
-         }
-         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
-         *(void**)addr[1] = ENDMARKER;
-         // test
-         TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)from, (char32_t)to));
-         // check mman: unchanged
-         TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
-         // check rmap: unchanged
-         TEST( rmap.size == S);
-         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
-         // check mst.root content: unchanged
-         TEST( 0 == rmap.root->level);
-         TEST( S == rmap.root->size);
-         TEST( 0 == rmap.root->next);
-         for (unsigned i = 0, f = 0, next_t = 3, t; i < S; ++i, f = t+1, next_t += (t == next_t)?4:0) {
-            t = (f < from && from <= next_t) ? from-1 : (f <= to && to < next_t) ? to : next_t;
-            TEST( f == rmap.root->range[i].from);
-            TEST( t == rmap.root->range[i].to);
-            TEST( 0 == rmap.root->range[i].multistate.size);
-         }
-         // no overflow to adjacent block
-         for (size_t i = 0; i < lengthof(addr); ++i) {
-            TEST( ENDMARKER == *(void**)addr[i]);
-         }
-         // reset
-         reset_automatmman(mman);
+   size_t i = offset;
+   for (; i + 4 <= len; i += 4) {
+      __m128i chr = _mm_loadu_si128((const __m128i*)&str[i]);
+      __m128i out = _mm_setzero_si128(); // lanes with char out of all ranges are set to -1
+      out = _mm_cmpeq_epi32(out, out);
+      for (unsigned r = 0; r < filter->nrrange; ++r) {
+         // (chr - from) <= (to - from) (unsigned) <==> ! ((chr - from) ^ bias > size ^ bias) (signed)
+         __m128i diff = _mm_xor_si128(_mm_sub_epi32(chr, from[r]), bias);
+         out = _mm_and_si128(out, _mm_cmpgt_epi32(diff, size[r]));
       }
+      int mask = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xf;
+      if (mask) return i + (size_t) __builtin_ctz((unsigned)mask);
    }
 
-   // TEST addrange_rangemap: insert overlapping range in tree with root->level > 0
-   for (unsigned level = 1; level <= 4; ++level) {
-      // range 0..8 overlaps 3..5
-      unsigned const S = 1u<<(2*level);
-      unsigned from[256];
-      unsigned to[256];
-      for (unsigned i = 0; i < S; ++i) {
-         from[i] = 3 + 9*i;
-         to[i]   = 5 + 9*i;
-      }
-      rangemap_node_t * child = 0;
-      TEST(0 == build_rangemap(&rmap, mman, level, from, to, 9, &child));
-      void * const root = rmap.root;
-      size_t const MMSIZE = sizeallocated_automatmman(mman);
-      TEST(S == rmap.size);
-      // test
-      TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)0, (char32_t)(S*9-1)));
-      // check mman: unchanged
-      TEST( MMSIZE == sizeallocated_automatmman(mman));
-      // check rmap
-      TEST( rmap.size == 3/*two additional range per child node*/*S);
-      TEST( rmap.root == root);
-      // check chain of child content
-      for (unsigned c = 0; c < S; ++c, child = child->next) {
-         TEST( 0 != child); // value from child->next
-         TEST( 0 == child->level);
-         TEST( 3 == child->size);
-         for (unsigned i = 0, f = 9*c; i < 3; ++i, f += 3) {
-            TEST( f   == child->range[i].from);
-            TEST( f+2 == child->range[i].to);
-            TEST( 0   == child->range[i].multistate.size);
-         }
+   return findscalar_automatprefilter(filter, i, len, str);
+}
+
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+/* variable: s_automatprefilter_isavx2
+ * Ist true, falls <findavx2_automatprefilter> verwendet werden kann. */
+cpufeature_IMPLEMENT_AVX2(automatprefilter)
+
+/* function: findavx2_automatprefilter
+ * Wie <findsse2_automatprefilter>, vergleicht aber 8 Zeichen pro Schritt.
+ * Wird nur aufgerufen, falls der Prozessor AVX2 unterstützt. */
+__attribute__((target("avx2")))
+static size_t findavx2_automatprefilter(const automat_prefilter_t* filter, size_t offset, size_t len, const char32_t str[len])
+{
+   const __m256i bias = _mm256_set1_epi32((int)0x80000000);
+   __m256i from[automat_prefilter_MAXRANGE];
+   __m256i size[automat_prefilter_MAXRANGE]; // (to - from) ^ bias
+
+   for (unsigned r = 0; r < filter->nrrange; ++r) {
+      from[r] = _mm256_set1_epi32((int)filter->from[r]);
+      size[r] = _mm256_xor_si256(_mm256_set1_epi32((int)(filter->to[r] - filter->from[r])), bias);
+   }
+
+   size_t i = offset;
+   for (; i + 8 <= len; i += 8) {
+      __m256i chr = _mm256_loadu_si256((const __m256i*)&str[i]);
+      __m256i out = _mm256_cmpeq_epi32(chr, chr); // lanes with char out of all ranges are set to -1
+      for (unsigned r = 0; r < filter->nrrange; ++r) {
+         __m256i diff = _mm256_xor_si256(_mm256_sub_epi32(chr, from[r]), bias);
+         out = _mm256_and_si256(out, _mm256_cmpgt_epi32(diff, size[r]));
       }
-      TEST( 0 == child);   // value from child->next
-      // reset
-      reset_automatmman(mman);
+      int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xff;
+      if (mask) return i + (size_t) __builtin_ctz((unsigned)mask);
    }
 
-   // TEST addrange_rangemap: insert overlapping range in tree with root->level > 0
-   for (unsigned level = 1; level <= 4; ++level) {
-      for (unsigned tc = 1; tc <= 2; ++tc) {
+   return findscalar_automatprefilter(filter, i, len, str);
+}
+
+#endif
+
+/* function: findfirst_automatprefilter
+ * Sucht ab str[offset] das erste Zeichen aus der Menge der Anfangszeichen.
+ * Verwendet AVX2, falls vom Prozessor unterstützt, sonst SSE2 oder einen skalaren Vergleich. */
+static size_t findfirst_automatprefilter(const automat_prefilter_t* filter, size_t offset, size_t len, const char32_t str[len])
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+   if (s_automatprefilter_isavx2) return findavx2_automatprefilter(filter, offset, len, str);
+#endif
+#ifdef __SSE2__
+   return findsse2_automatprefilter(filter, offset, len, str);
+#else
+   return findscalar_automatprefilter(filter, offset, len, str);
+#endif
+}
+
+// group: lifetime
+
+int init_automatprefilter(/*out*/automat_prefilter_t* filter, const automat_t* ndfa)
+{
+   int err;
+   state_t* start;
+   state_t* end;
+
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   *filter = (automat_prefilter_t) automat_prefilter_FREE;
+   startend_automat(ndfa, &start, &end);
+
+   // empty string matches at every position ==> no prefilter
+   if (start->nremptytrans || start->nrrangetrans > automat_prefilter_MAXRANGE) return 0;
+
+   // === set of first characters (ranges of start state are sorted) ===
+   foreach (_rangelist, range_trans, &start->rangelist) {
+      for (size_t i = 0; i < range_trans->size; ++i) {
+         if (filter->nrrange && filter->to[filter->nrrange-1]+1 == range_trans->array[i].from) {
+            filter->to[filter->nrrange-1] = range_trans->array[i].to;
+         } else {
+            filter->from[filter->nrrange] = range_trans->array[i].from;
+            filter->to[filter->nrrange]   = range_trans->array[i].to;
+            ++ filter->nrrange;
+         }
+      }
+   }
+
+   // === required literal: chain of states with a single character transition ===
+   for (const state_t* state = start; filter->nrliteral < automat_prefilter_MAXLITERAL; ) {
+      if (state->nremptytrans || state->nrrangetrans != 1) break;
+      const rangestate_t* range = &first_rangelist(&state->rangelist)->array[0];
+      if (range->from != range->to) break;
+      filter->literal[filter->nrliteral++] = range->from;
+      state = range->state;
+   }
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+// group: query
+
+size_t find_automatprefilter(const automat_prefilter_t* filter, size_t offset, size_t len, const char32_t str[len])
+{
+   if (!filter->nrrange) return offset < len ? offset : len;
+
+   for (size_t i = offset; i < len; ++i) {
+      i = findfirst_automatprefilter(filter, i, len, str);
+      if (filter->nrliteral <= 1) return i;
+      if (filter->nrliteral > len - i) break;
+      if (0 == memcmp(&str[i+1], &filter->literal[1], (filter->nrliteral-1) * sizeof(char32_t))) return i;
+   }
+
+   return len;
+}
+
+
+// section: automat_matcher_t
+
+// group: lifetime
+
+int init_automatmatcher(/*out*/automat_matcher_t* matcher, const automat_t* ndfa, bool matchLongest)
+{
+   int err;
+   state_t* start;
+   state_t* end;
+
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   startend_automat(ndfa, &start, &end);
+   *matcher = (automat_matcher_t) {
+      .ndfa = ndfa, .state = start, .offset = 0, .matchedlen = 0,
+      .isMatch = (start->nremptytrans != 0), .isLongest = matchLongest
+   };
+   if (matcher->isMatch && ! matchLongest) {
+      matcher->state = 0; // use first match
+   }
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int finish_automatmatcher(automat_matcher_t* matcher, /*out*/size_t* matchedlen)
+{
+   const bool isMatch = matcher->isMatch;
+
+   if (isMatch) *matchedlen = matcher->matchedlen;
+   *matcher = (automat_matcher_t) automat_matcher_FREE;
+
+   return isMatch ? 0 : ESRCH;
+}
+
+// group: query
+
+bool isdone_automatmatcher(const automat_matcher_t* matcher)
+{
+   return matcher->state == 0;
+}
+
+// group: update
+
+/* function: feedchunk_automatmatcher
+ * Implementiert <feed_automatmatcher> und <feedutf8_automatmatcher>.
+ * Ist isUTF8 gesetzt, zeigt chunk auf len Bytes, sonst auf len Zeichen vom Typ char32_t.
+ * Der Parameter isUTF8 ist in beiden Aufrufen konstant, so dass der Compiler je eine Version erzeugt. */
+static inline size_t feedchunk_automatmatcher(automat_matcher_t* matcher, size_t len, const void* chunk, bool isUTF8)
+{
+   const size_t   offset = matcher->offset;
+   const state_t* next   = matcher->state;
+   size_t i = 0;
+
+   while (next && i < len) {
+      const char32_t chr = isUTF8 ? ((const uint8_t*)chunk)[i] : ((const char32_t*)chunk)[i];
+      next = nextstate_dfa(next, chr);
+      if (!next) break; // chr is not consumed
+      ++ i;
+      if (next->nremptytrans != 0) {
+         matcher->isMatch    = true;
+         matcher->matchedlen = offset + i;
+         if (! matcher->isLongest) next = 0; // use first match
+      }
+   }
+
+   matcher->state   = next;
+   matcher->offset += i;
+
+   return i;
+}
+
+size_t feed_automatmatcher(automat_matcher_t* matcher, size_t len, const char32_t chunk[len])
+{
+   return feedchunk_automatmatcher(matcher, len, chunk, false);
+}
+
+size_t feedutf8_automatmatcher(automat_matcher_t* matcher, size_t len, const uint8_t chunk[len])
+{
+   return feedchunk_automatmatcher(matcher, len, chunk, true);
+}
+
+
+
+// section: automat_scratch_t
+
+// group: lifetime
+
+int free_automatscratch(automat_scratch_t* scratch)
+{
+   free(scratch->mem);
+   scratch->mem  = 0;
+   scratch->size = 0;
+
+   return 0;
+}
+
+
+
+// section: automat_search_t
+
+// group: static variables
+
+#ifdef KONFIG_UNITTEST
+/* variable: s_automatsearch_nrread
+ * Zählt die von <next_automatsearch> vorwärts und rückwärts gelesenen Zeichen. */
+static size_t              s_automatsearch_nrread = 0;
+#endif
+
+/* struct: searchtuple_t
+ * Ein Zustand des Such-DFA <automat_search_t.prefix> während seiner Konstruktion.
+ * Er beschreibt die aktiven Suchen als geordnetes Tupel von Zuständen des DFA, die Suche mit dem
+ * am weitesten links liegenden Start zuerst. Zwei Suchen im selben Zustand werden zusammengefasst,
+ * behalten wird die weiter links beginnende.
+ *
+ * Ist ein Zustand des Tupels ein Endzustand, wird das Tupel nach dem ersten solchen Zustand
+ * abgeschnitten und als matched markiert. Alle weiter rechts beginnenden Suchen können keinen
+ * Treffer mehr liefern, der am weitesten links beginnt. In einem markierten Tupel werden
+ * keine neuen Suchen mehr gestartet. Daher ist ein Tupel genau dann ein Endzustand,
+ * wenn sein letzter Zustand ein Endzustand ist.
+ *
+ * Der Schlüssel key[0..size/4-1] enthält in key[0] die Anzahl der Zustände (Bit 31: matched)
+ * und danach die Nummern <state_t.nr> der Zustände. Da die Länge am Anfang steht, ist kein
+ * Schlüssel der Präfix eines anderen. */
+typedef struct searchtuple_t {
+   patriciatrie_node_t  index;   // permits storing in index of type patriciatrie_t
+   slist_node_t       * next;    // links to next unprocessed searchtuple_t
+   state_t            * dfa;     // assigned state of prefix dfa
+   size_t               size;    // size of key in bytes
+   uint32_t             key[];
+} searchtuple_t;
+
+// group: constants
+
+/* define: searchtuple_MATCHED
+ * Bit in key[0], das ein markiertes Tupel kennzeichnet. */
+#define searchtuple_MATCHED \
+         ((uint32_t)0x80000000)
+
+// group: types
+
+/* define: YYY_searchtuplelist
+ * Verwaltet <searchtuple_t> als Liste. */
+slist_IMPLEMENT(_searchtuplelist, searchtuple_t, next)
+
+// group: query
+
+/* function: getkey_searchtuple
+ * Gibt Schlüssel zurück, über den der <searchtuple_t> indiziert wird.
+ * Der Schlüssel besteht aus einem einzigen Block. */
+static void getkey_searchtuple(/*inout*/getkey_data_t *key, size_t offset)
+{
+   searchtuple_t *tuple = key->object;
+   (void) offset;
+   init2_getkeydata(key, tuple->size, tuple->size, (const uint8_t*) tuple->key);
+}
+
+static inline getkey_adapter_t keyadapter_searchtuple(void)
+{
+   return (getkey_adapter_t) getkey_adapter_INIT(offsetof(searchtuple_t, index), &getkey_searchtuple);
+}
+
+// group: helper
+
+/* struct: searchbuilder_t
+ * Speicher für <build_automatsearch>. */
+typedef struct searchbuilder_t {
+   automat_mman_t*   mman;    // allocates searchtuple_t
+   patriciatrie_t    index;   // index of all searchtuple_t
+   slist_t           unprocessed;
+   state_t**         state;   // state[nr] is the state with number nr
+   size_t*           seen;    // seen[nr] == gen ==> state nr is contained in key
+   size_t            gen;
+   uint32_t*         key;     // key of next tuple, nrstate+1 entries
+   uint64_t*         bound;   // boundaries of character ranges, 2*nrrange+2 entries
+   rangestate_t*     trans;   // transitions of a single state, 2*nrrange+1 entries
+} searchbuilder_t;
+
+/* function: addtuple_searchbuilder
+ * Sucht das Tupel builder->key[0..] im Index oder fügt es als unbearbeitet ein. */
+static int addtuple_searchbuilder(searchbuilder_t* builder, /*out*/searchtuple_t** tuple)
+{
+   int err;
+   void* addr;
+   automat_mman_state_t oldstate;
+   const size_t size = sizeof(uint32_t) * (1 + (builder->key[0] & ~searchtuple_MATCHED));
+
+   storestate_automatmman(builder->mman, &oldstate);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      err = malloc_automatmman(builder->mman, sizeof(searchtuple_t) + size, &addr);
+   }
+   if (err) goto ONERR;
+   searchtuple_t* newtuple = addr;
+   newtuple->index = (patriciatrie_node_t) patriciatrie_node_INIT;
+   newtuple->next  = 0;
+   newtuple->dfa   = 0;
+   newtuple->size  = size;
+   memcpy(newtuple->key, builder->key, size);
+
+   patriciatrie_node_t* existing_node;
+   err = insert_patriciatrie(&builder->index, &newtuple->index, &existing_node);
+   if (! err) {
+      insertlast_searchtuplelist(&builder->unprocessed, newtuple);
+   } else {
+      if (err != EEXIST) goto ONERR;
+      restore_automatmman(builder->mman, &oldstate);
+      newtuple = (void*) ((uintptr_t)existing_node - offsetof(searchtuple_t, index));
+   }
+
+   *tuple = newtuple;
+
+   return 0;
+ONERR:
+   return err;
+}
+
+/* function: addstate_searchbuilder
+ * Hängt Zustand state an builder->key an, falls er noch nicht enthalten ist. */
+static inline void addstate_searchbuilder(searchbuilder_t* builder, const state_t* state)
+{
+   if (builder->seen[state->nr] != builder->gen) {
+      builder->seen[state->nr] = builder->gen;
+      builder->key[++builder->key[0]] = (uint32_t) state->nr;
+   }
+}
+
+/* function: endtuple_searchbuilder
+ * Schneidet builder->key nach dem ersten Endzustand ab und markiert es in diesem Fall als matched.
+ * Vorher darf key[0] noch nicht markiert sein. */
+static inline void endtuple_searchbuilder(searchbuilder_t* builder, bool isMatched)
+{
+   for (uint32_t i = 1; i <= builder->key[0]; ++i) {
+      if (builder->state[builder->key[i]]->nremptytrans != 0) {
+         builder->key[0] = i;
+         isMatched = true;
+         break;
+      }
+   }
+   if (isMatched) builder->key[0] |= searchtuple_MATCHED;
+}
+
+/* function: build_automatsearch
+ * Erzeugt prefix, einen DFA für ".*(dfa)", der zusätzlich die Reihenfolge der aktiven Suchen kennt.
+ * Jeder Zustand von prefix entspricht einem <searchtuple_t>. Die Konstruktion folgt <makedfa_automat>:
+ * Beginnend mit dem Tupel aus dem Startzustand von dfa werden für jedes unbearbeitete Tupel die
+ * Zeichenbereiche seiner Zustände in Klassen zerlegt und für jede Klasse das Folgetupel gebildet.
+ * Benachbarte Klassen mit demselben Folgetupel werden zu einem Übergang zusammengefasst.
+ *
+ * Die Anzahl der Tupel kann wie bei <makedfa_automat> im schlechtesten Fall exponentiell
+ * in der Anzahl der Zustände von dfa wachsen. */
+static int build_automatsearch(/*out*/automat_t* prefix, const automat_t* dfa)
+{
+   int err;
+   void*           addr;
+   size_t          nrstate   = 0;
+   size_t          nrrange   = 0;
+   size_t          allocated = 0;
+   slist_t         dfa_states = slist_INIT;
+   automat_mman_t* dfa_mman  = 0;
+   searchbuilder_t builder   = { .mman = 0, .unprocessed = slist_INIT, .gen = 0 };
+   state_t*        startstate;
+   state_t*        endstate;
+   searchtuple_t*  tuple;
+
+   init_patriciatrie(&builder.index, keyadapter_searchtuple());
+   startend_automat(dfa, &startstate, &endstate);
+   foreach (_statelist, s, &dfa->states) {
+      nrrange += s->nrrangetrans;
+   }
+   if (dfa->nrstate >= UINT32_MAX/2 || nrrange >= SIZE_MAX / (2*sizeof(uint64_t)) - 1) {
+      err = ENOMEM;
+      goto ONERR;
+   }
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      builder.state = malloc(dfa->nrstate * sizeof(state_t*));
+      builder.seen  = calloc(dfa->nrstate, sizeof(size_t));
+      builder.key   = malloc((dfa->nrstate+1) * sizeof(uint32_t));
+      builder.bound = malloc((2*nrrange+2) * sizeof(uint64_t));
+      builder.trans = malloc((2*nrrange+1) * sizeof(rangestate_t));
+      err = builder.state && builder.seen && builder.key && builder.bound && builder.trans ? 0 : ENOMEM;
+   }
+   if (err) goto ONERR;
+   foreach (_statelist, s, &dfa->states) {
+      builder.state[s->nr] = s;
+   }
+   err = new_automatmman(&builder.mman);
+   if (err) goto ONERR;
+   err = new_automatmman(&dfa_mman);
+   if (err) goto ONERR;
+
+   // === start tuple contains only the search starting at the first position ===
+   ++ builder.gen;
+   builder.key[0] = 0;
+   addstate_searchbuilder(&builder, startstate);
+   endtuple_searchbuilder(&builder, false);
+   err = addtuple_searchbuilder(&builder, &tuple);
+   if (err) goto ONERR;
+
+   void* dfa_endstate;
+   allocated = state_SIZE + state_SIZE_EMPTYTRANS(1);
+   if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+      err = malloc_automatmman(dfa_mman, allocated, &dfa_endstate);
+   }
+   if (err) goto ONERR;
+   ++ nrstate;
+   initempty_state(dfa_endstate, dfa_endstate);
+
+   while (! isempty_slist(&builder.unprocessed)) {
+      tuple = removefirst_searchtuplelist(&builder.unprocessed);
+      const uint32_t nrelem    = tuple->key[0] & ~searchtuple_MATCHED;
+      const bool     isMatched = (tuple->key[0] & searchtuple_MATCHED) != 0;
+      const bool     isEnd     = nrelem && builder.state[tuple->key[nrelem]]->nremptytrans != 0;
+
+      // === allocate dfa state ===
+      state_t* dfastate;
+      {
+         const size_t SIZE = state_SIZE + (isEnd ? state_SIZE_EMPTYTRANS(1) : 0);
+         if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+            err = malloc_automatmman(dfa_mman, SIZE, &addr);
+         }
+         if (err) goto ONERR;
+         allocated += SIZE;
+         dfastate = addr;
+         if (isEnd) {
+            initempty_state(dfastate, dfa_endstate);
+         } else {
+            init_state(dfastate);
+         }
+      }
+      tuple->dfa = dfastate;
+      ++ nrstate;
+      insertlast_statelist(&dfa_states, dfastate);
+
+      // === split characters into classes with same successor for every state of tuple ===
+      size_t nrbound = 0;
+      builder.bound[nrbound++] = 0;
+      builder.bound[nrbound++] = (uint64_t)UINT32_MAX + 1;
+      for (uint32_t i = 1; i <= nrelem; ++i) {
+         foreach (_rangelist, range_trans, &builder.state[tuple->key[i]]->rangelist) {
+            for (size_t r = 0; r < range_trans->size; ++r) {
+               builder.bound[nrbound++] = range_trans->array[r].from;
+               builder.bound[nrbound++] = (uint64_t)range_trans->array[r].to + 1;
+            }
+         }
+      }
+      qsort(builder.bound, nrbound, sizeof(uint64_t), &compare_uint64);
+
+      // === compute successor tuple for every class ===
+      size_t nrtrans = 0;
+      for (size_t b = 0; b+1 < nrbound; ++b) {
+         if (builder.bound[b] == builder.bound[b+1]) continue;
+         const char32_t from = (char32_t) builder.bound[b];
+         const char32_t to   = (char32_t) (builder.bound[b+1] - 1);
+         ++ builder.gen;
+         builder.key[0] = 0;
+         for (uint32_t i = 1; i <= nrelem; ++i) {
+            state_t* next = nextstate_dfa(builder.state[tuple->key[i]], from);
+            if (next) addstate_searchbuilder(&builder, next);
+         }
+         // start a new search at the following position
+         if (! isMatched) addstate_searchbuilder(&builder, startstate);
+         endtuple_searchbuilder(&builder, isMatched);
+         if (! (builder.key[0] & ~searchtuple_MATCHED)) continue; // no active search
+         searchtuple_t* next;
+         err = addtuple_searchbuilder(&builder, &next);
+         if (err) goto ONERR;
+         if (nrtrans && builder.trans[nrtrans-1].state == (state_t*)next && builder.trans[nrtrans-1].to+1 == from) {
+            builder.trans[nrtrans-1].to = to;
+         } else {
+            builder.trans[nrtrans++] = (rangestate_t) { from, to, (state_t*)next };
+         }
+      }
+
+      // === add transitions to dfa state (in blocks of at most 256 to fit into a memory page) ===
+      for (size_t t = 0; t < nrtrans; ) {
+         const size_t size = nrtrans - t > 256 ? 256 : nrtrans - t;
+         if (! PROCESS_testerrortimer(&s_automat_errtimer, &err)) {
+            err = malloc_automatmman(dfa_mman, state_SIZE_RANGETRANS(size), &addr);
+         }
+         if (err) goto ONERR;
+         allocated += state_SIZE_RANGETRANS(size);
+         range_transition_t* range_trans = addr;
+         range_trans->size = size;
+         memcpy(range_trans->array, &builder.trans[t], size * sizeof(rangestate_t));
+         insertlast_rangelist(&dfastate->rangelist, range_trans);
+         t += size;
+      }
+      dfastate->nrrangetrans = nrtrans;
+   }
+
+   // set end state as last state in list
+   insertlast_statelist(&dfa_states, dfa_endstate);
+
+   // convert all pointers of transitions from searchtuple_t into state_t
+   foreach (_statelist, dfastate, &dfa_states) {
+      foreach (_rangelist, range_trans, &dfastate->rangelist) {
+         for (size_t s = 0; s < range_trans->size; ++s) {
+            range_trans->array[s].state = ((searchtuple_t*)range_trans->array[s].state)->dfa;
+         }
+      }
+   }
+
+   err = delete_automatmman(&builder.mman);
+   if (err) goto ONERR;
+   free(builder.state);
+   free(builder.seen);
+   free(builder.key);
+   free(builder.bound);
+   free(builder.trans);
+
+   // set out
+   incruse_automatmman(dfa_mman);
+   prefix->mman      = dfa_mman;
+   prefix->nrstate   = nrstate;
+   prefix->allocated = allocated;
+   prefix->states    = dfa_states;
+   prefix->isDFA     = 1;
+   numberstates_automat(prefix);
+
+   return 0;
+ONERR:
+   delete_automatmman(&builder.mman);
+   delete_automatmman(&dfa_mman);
+   free(builder.state);
+   free(builder.seen);
+   free(builder.key);
+   free(builder.bound);
+   free(builder.trans);
+   return err;
+}
+
+// group: lifetime
+
+int init_automatsearch(/*out*/automat_search_t* search, const automat_t* ndfa)
+{
+   int err;
+   automat_t prefix  = automat_FREE;
+   automat_t reverse = automat_FREE;
+
+   if (!ndfa->mman || !ndfa->isDFA) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   err = build_automatsearch(&prefix, ndfa);
+   if (err) goto ONERR;
+   err = initreverse_automat(&reverse, ndfa, 0);
+   if (err) goto ONERR;
+   err = minimize_automat(&reverse);
+   if (err) goto ONERR;
+   err = init_automatprefilter(&search->filter, ndfa);
+   if (err) goto ONERR;
+
+   // set out
+   initmove_automat(&search->prefix, &prefix);
+   initmove_automat(&search->reverse, &reverse);
+
+   return 0;
+ONERR:
+   (void) free_automat(&prefix);
+   (void) free_automat(&reverse);
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int free_automatsearch(automat_search_t* search)
+{
+   int err;
+
+   err = free_automat(&search->prefix);
+   int err2 = free_automat(&search->reverse);
+   if (err2) err = err2;
+   search->filter = (automat_prefilter_t) automat_prefilter_FREE;
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   TRACEEXITFREE_ERRLOG(err);
+   return err;
+}
+
+// group: search
+
+/* function: next_automatsearch
+ * Sucht ab str[offset] nach dem am weitesten links beginnenden und davon nach dem längsten Treffer.
+ * Der DFA search->prefix wird vorwärts gelesen, bis er keinen Folgezustand mehr hat. Der letzte
+ * erreichte Endzustand liefert das Ende des Treffers. Danach wird search->reverse ab diesem Ende
+ * rückwärts bis höchstens offset gelesen, der am weitesten links erreichte Endzustand liefert den Start.
+ * Jedes Zeichen wird höchstens einmal vorwärts und einmal rückwärts gelesen.
+ *
+ * Returns:
+ * 0      - Treffer str[*matchstart .. *matchend-1] gefunden.
+ * ESRCH  - Kein Treffer in str[offset..len-1]. */
+static int next_automatsearch(const automat_search_t* search, size_t offset, size_t len, const char32_t str[len], /*out*/size_t* matchstart, /*out*/size_t* matchend)
+{
+   state_t* start;
+   state_t* end;
+   state_t* state;
+   size_t   i;
+   size_t   bestend   = SIZE_MAX;
+   size_t   beststart = SIZE_MAX;
+
+   // === forward: find end of leftmost-longest match ===
+   startend_automat(&search->prefix, &start, &end);
+   state = start;
+   for (i = offset; ; ++i) {
+      if (state == start) {
+         // no active search ==> skip positions which could not start a match
+         i = find_automatprefilter(&search->filter, i, len, str);
+      }
+      if (state->nremptytrans != 0) bestend = i;
+      if (i >= len) break;
+      state = nextstate_dfa(state, str[i]);
+      if (!state) break;
+   }
+#ifdef KONFIG_UNITTEST
+   s_automatsearch_nrread += (i < len ? i+1 : len) - offset;
+#endif
+
+   if (bestend == SIZE_MAX) return ESRCH;
+
+   // === backward: find leftmost start of a match ending at bestend ===
+   startend_automat(&search->reverse, &start, &end);
+   state = start;
+   for (i = bestend; ; --i) {
+      if (state->nremptytrans != 0) beststart = i;
+      if (i == offset) break;
+      state = nextstate_dfa(state, str[i-1]);
+      if (!state) break;
+   }
+#ifdef KONFIG_UNITTEST
+   s_automatsearch_nrread += bestend - i + (i != offset);
+#endif
+
+   *matchstart = beststart;
+   *matchend   = bestend;
+   return 0;
+}
+
+int find_automatsearch(const automat_search_t* search, size_t len, const char32_t str[len], /*out*/size_t* matchstart, /*out*/size_t* matchend)
+{
+   int err;
+
+   if (! search->prefix.mman) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   return next_automatsearch(search, 0, len, str, matchstart, matchend);
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int findall_automatsearch(const automat_search_t* search, size_t len, const char32_t str[len], automat_matchspan_f matchspan, void* context)
+{
+   int err = 0;
+   size_t matchstart;
+   size_t matchend;
+
+   if (! search->prefix.mman) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   for (size_t offset = 0; offset <= len; ) {
+      if (next_automatsearch(search, offset, len, str, &matchstart, &matchend)) break/*ESRCH*/;
+      err = matchspan(context, matchstart, matchend);
+      if (err) break;
+      // an empty match is followed by a match which starts at least one character behind it
+      offset = matchend + (matchstart == matchend);
+   }
+
+   return err;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+// section: Functions
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+
+/* function: build1_multistate
+ * Build level 1 b-tree (root + nrchild leaves).
+ *
+ * Memory Layout:
+ * addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... */
+static int build1_multistate(
+   /*out*/multistate_t * mst,
+   automat_mman_t * mman,
+   state_t state[],
+   unsigned step, /*every stepth*/
+   void * ENDMARKER,
+   unsigned nrchild,
+   /*out*/void* addr[nrchild+2],
+   /*out*/void* child[nrchild])
+{
+   unsigned S = 0;
+   const size_t SIZE = sizeof(multistate_node_t);
+   TEST(nrchild >= 2);
+   TEST(nrchild <= multistate_NROFCHILD);
+
+   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+   TEST(0 == malloc_automatmman(mman, SIZE, &mst->root));
+   mst->size = nrchild * multistate_NROFSTATE;
+   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+   ((multistate_node_t*)mst->root)->level = 1;
+   ((multistate_node_t*)mst->root)->size  = (uint8_t) nrchild;
+
+   void * prevchild = 0;
+   for (unsigned i = 0; i < nrchild; ++i) {
+      TEST(0 == malloc_automatmman(mman, SIZE, &child[i]));
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[2+i]));
+      if (i) ((multistate_node_t*)mst->root)->key[i-1] = &state[S];
+      ((multistate_node_t*)mst->root)->child[i] = child[i];
+      ((multistate_node_t*)child[i])->level = 0;
+      ((multistate_node_t*)child[i])->size = multistate_NROFSTATE;
+      ((multistate_node_t*)child[i])->next = 0;
+      for (unsigned s = 0; s < multistate_NROFSTATE; ++s, S += step) {
+         ((multistate_node_t*)child[i])->state[s] = &state[S];
+      }
+      if (prevchild) ((multistate_node_t*)prevchild)->next = child[i];
+      prevchild = child[i];
+   }
+
+   for (unsigned i = 0; i < nrchild+2; ++i) {
+      *((void**)addr[i]) = ENDMARKER;
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+/* function: build1_multistate
+ * Build level 2 b-tree (root + nrchild nodes + full leaves).
+ * Inserted states are generated beginning from (void*)0 up to
+ * (void*)(nrchild*multistate_NROFCHILD*step*multistate_NROFSTATE). */
+static int build2_multistate(
+   /*out*/multistate_t * mst,
+   automat_mman_t * mman,
+   unsigned step, /*every stepth*/
+   unsigned nrchild,
+   /*out*/void* child[nrchild])
+{
+   const size_t SIZE = sizeof(multistate_node_t);
+   size_t level1_size = multistate_NROFCHILD*multistate_NROFSTATE;
+   TEST(nrchild >= 2);
+   TEST(nrchild <= multistate_NROFCHILD);
+
+   TEST(0 == malloc_automatmman(mman, SIZE, &mst->root));
+   mst->size = nrchild * level1_size;
+   ((multistate_node_t*)mst->root)->level = 2;
+   ((multistate_node_t*)mst->root)->size  = (uint8_t) nrchild;
+
+   for (uintptr_t i = 0; i < nrchild; ++i) {
+      TEST(0 == malloc_automatmman(mman, SIZE, &child[i]));
+      if (i) ((multistate_node_t*)mst->root)->key[i-1] = (void*)(i*step*level1_size);
+      ((multistate_node_t*)mst->root)->child[i] = child[i];
+      ((multistate_node_t*)child[i])->level = 1;
+      ((multistate_node_t*)child[i])->size  = multistate_NROFCHILD;
+   }
+
+   uintptr_t statenr = 0;
+   void * prevleaf = 0;
+   for (unsigned i = 0; i < nrchild; ++i) {
+      for (unsigned c = 0; c < multistate_NROFCHILD; ++c) {
+         void * leaf;
+         TEST(0 == malloc_automatmman(mman, SIZE, &leaf));
+         ((multistate_node_t*)child[i])->child[c] = leaf;
+         if (c) ((multistate_node_t*)child[i])->key[c-1] = (void*)statenr;
+         ((multistate_node_t*)leaf)->level = 0;
+         ((multistate_node_t*)leaf)->size  = multistate_NROFSTATE;
+         ((multistate_node_t*)leaf)->next  = 0;
+         for (unsigned s = 0; s < multistate_NROFSTATE; ++s, statenr += step) {
+            ((multistate_node_t*)leaf)->state[s] = (void*)statenr;
+         }
+         if (prevleaf) ((multistate_node_t*)prevleaf)->next = leaf;
+         prevleaf = leaf;
+      }
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int build_recursive(
+   /*out*/rangemap_node_t ** root,
+   automat_mman_t * mman,
+   unsigned keyoffset,
+   unsigned level,
+   unsigned interval_per_child,
+   /*inout*/rangemap_node_t ** child)
+{
+   void * node;
+   const size_t SIZE = sizeof(rangemap_node_t);
+   rangemap_node_t * parent;
+   TEST(level >= 1);
+
+   TEST(0 == malloc_automatmman(mman, SIZE, &node));
+   *root  = node;
+   parent = node;
+   parent->level = (uint8_t) level;
+   parent->size  = 4;
+
+   if (level > 1) {
+      for (unsigned i = 0; i < 4; ++i) {
+         unsigned keyoffset2 = (1u<<(2*(level-1))) * i * interval_per_child;
+         if (i) parent->key[i-1] = keyoffset + keyoffset2;
+         TEST(0 == build_recursive(&parent->child[i], mman, keyoffset + keyoffset2, level-1, interval_per_child, child));
+      }
+   } else {
+      for (unsigned i = 0; i < 4; ++i) {
+         if (i) parent->key[i-1] = keyoffset + i * interval_per_child;
+         parent->child[i] = *child;
+         *child = (*child)->next;
+      }
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+/* function: build_rangemap
+ * Builds level b-tree.
+ * Every node has 4 childs and a leaf a single range entry copied from from[], to[].
+ * The interval_per_child is the total interval every leaf is considered
+ * to occupy. This value is used to build the key values in the node entries. */
+static int build_rangemap(
+   /*out*/rangemap_t * rmap,
+   automat_mman_t * mman,
+   unsigned level,
+   unsigned from[1<<(2*level)],
+   unsigned to[1<<(2*level)],
+   unsigned interval_per_child,
+   /*out*/rangemap_node_t ** first_child)
+{
+   void * node;
+   const size_t SIZE = sizeof(rangemap_node_t);
+   const unsigned S = 1u<<(2*level);
+
+   rangemap_node_t * child;
+   rangemap_node_t * prev_child = 0;
+   for (unsigned i = 0; i < S; ++i, prev_child = child) {
+      TEST(0 == malloc_automatmman(mman, SIZE, &node));
+      child = node;
+      if (!i) *first_child = child;
+      else    prev_child->next = child;
+      child->level = 0;
+      child->size  = 1;
+      child->next  = 0;
+      child->range[0] = (range_t) range_INIT(from[i], to[i]);
+      prev_child = child;
+   }
+
+   child = *first_child;
+   TEST(0 == build_recursive(&rmap->root, mman, 0, level, interval_per_child, &child));
+   TEST(0 == child);
+   rmap->size = S;
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+/* function: build1_rangemap
+ * Build level 1 b-tree (root + nrchild leaves).
+ *
+ * Memory Layout:
+ * addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... */
+static int build1_rangemap(
+   /*out*/rangemap_t * rmap,
+   automat_mman_t * mman,
+   unsigned range_width,
+   void * ENDMARKER,
+   unsigned nrchild,
+   /*out*/void* addr[nrchild+2],
+   /*out*/rangemap_node_t* child[nrchild])
+{
+   void * node;
+   const size_t SIZE = sizeof(rangemap_node_t);
+   TEST(range_width >= 1);
+   TEST(nrchild >= 2);
+   TEST(nrchild <= rangemap_NROFCHILD);
+
+   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+   TEST(0 == malloc_automatmman(mman, SIZE, &node));
+   rmap->root = node;
+   rmap->size = nrchild * rangemap_NROFRANGE;
+   TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+   rmap->root->level = 1;
+   rmap->root->size  = (uint8_t) nrchild;
+
+   for (unsigned i = 0, f = 0; i < nrchild; ++i) {
+      TEST(0 == malloc_automatmman(mman, SIZE, &node));
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[2+i]));
+      child[i] = node;
+      if (i) {
+         rmap->root->key[i-1] = f;
+         child[i-1]->next = child[i];
+      }
+      rmap->root->child[i] = child[i];
+      child[i]->level = 0;
+      child[i]->size  = rangemap_NROFRANGE;
+      child[i]->next  = 0;
+      for (unsigned r = 0; r < rangemap_NROFRANGE; ++r, f += range_width) {
+         child[i]->range[r] = (range_t) range_INIT(f, f + range_width-1);
+      }
+   }
+
+   for (unsigned i = 0; i < nrchild+2; ++i) {
+      *((void**)addr[i]) = ENDMARKER;
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+/* function: build2_rangemap
+ * Build level 2 b-tree (root + nrchild nodes + full leaves).
+ * Inserted ranges are generated beginning from 0 up to
+ * (nrchild*range_width*rangemap_NROFCHILD*rangemap_NROFRANGE). */
+static int build2_rangemap(
+   /*out*/rangemap_t * rmap,
+   automat_mman_t * mman,
+   unsigned range_width,
+   unsigned nrchild,
+   /*out*/rangemap_node_t* child[nrchild])
+{
+   void * node;
+   const size_t SIZE = sizeof(rangemap_node_t);
+   size_t level1_size = rangemap_NROFCHILD*rangemap_NROFRANGE;
+   TEST(nrchild >= 2);
+   TEST(nrchild <= rangemap_NROFCHILD);
+
+   TEST(0 == malloc_automatmman(mman, SIZE, &node));
+   rmap->root = node;
+   rmap->size = nrchild * level1_size;
+   rmap->root->level = 2;
+   rmap->root->size  = (uint8_t) nrchild;
+
+   for (unsigned i = 0; i < nrchild; ++i) {
+      TEST(0 == malloc_automatmman(mman, SIZE, &node));
+      child[i] = node;
+      if (i) rmap->root->key[i-1] = (char32_t) (i*range_width*level1_size);
+      rmap->root->child[i] = child[i];
+      child[i]->level = 1;
+      child[i]->size  = rangemap_NROFCHILD;
+   }
+
+   unsigned f = 0;
+   rangemap_node_t * prevleaf = 0;
+   for (unsigned i = 0; i < nrchild; ++i) {
+      for (unsigned c = 0; c < rangemap_NROFCHILD; ++c) {
+         TEST(0 == malloc_automatmman(mman, SIZE, &node));
+         rangemap_node_t * leaf = node;
+         if (c) child[i]->key[c-1] = f;
+         child[i]->child[c] = leaf;
+         leaf->level = 0;
+         leaf->size  = rangemap_NROFRANGE;
+         leaf->next  = 0;
+         for (unsigned r = 0; r < rangemap_NROFRANGE; ++r, f += range_width) {
+            leaf->range[r] = (range_t) range_INIT(f, f+range_width-1);
+         }
+         if (prevleaf) prevleaf->next = leaf;
+         prevleaf = leaf;
+      }
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int test_state(void)
+{
+   const unsigned NROFSTATE = 256;
+   state_t        state[NROFSTATE];
+   empty_transition_t* empty_trans = (void*)((uintptr_t)state + state_SIZE);
+   range_transition_t* range_trans = (void*)((uintptr_t)state + state_SIZE);
+   char32_t       from[256];
+   char32_t       to[256];
+
+   // prepare
+   memset(&state, 0, sizeof(state));
+   for (unsigned r = 0; r < 256; ++r) {
+      from[r] = r + 1;
+      to[r] = r + 10;
+   }
+
+   // === constants
+
+   // TEST state_SIZE
+   static_assert( state_SIZE == sizeof(state_t), "objectsize");
+
+   // TEST state_SIZE_EMPTYTRANS
+   static_assert( 0 == state_SIZE_EMPTYTRANS(0)
+                  && sizeof(empty_transition_t) == state_SIZE_EMPTYTRANS(1)
+                  && 255*sizeof(empty_transition_t) == state_SIZE_EMPTYTRANS(255),
+                  "calcs size of empty transition"
+                  );
+
+   // TEST state_SIZE_RANGETRANS
+   static_assert( sizeof(range_transition_t) == state_SIZE_RANGETRANS(0)
+                  && sizeof(range_transition_t) + sizeof(rangestate_t) == state_SIZE_RANGETRANS(1)
+                  && sizeof(range_transition_t) + 255*sizeof(rangestate_t) == state_SIZE_RANGETRANS(255),
+                  "calcs size of range transition"
+                  );
+
+   // === type support
+
+   // TEST slist_IMPLEMENT: _statelist
+   slist_t list = slist_INIT;
+   // test only insertlast_statelist
+   for (unsigned i = 0; i < NROFSTATE; ++i) {
+      insertlast_statelist(&list, &state[i]);
+      // check list
+      TEST(&state[i] == last_statelist(&list));
+   }
+   // check state[]
+   for (unsigned i = 0; i < NROFSTATE; ++i) {
+      TEST(&state[(i+1)%256] == next_statelist(&state[i]));
+      TEST((slist_node_t*)&state[(i+1)%256].next == state[i].next);
+   }
+
+   // === lifetime
+
+   // TEST initempty_state
+   memset(&state, 255, sizeof(state[0]));
+   state[0].next = (void*) &state[1].next;
+   initempty_state(&state[0], &state[2]);
+   TEST(state[0].next == (void*) &state[1].next); // unchanged
+   TEST(state[0].nremptytrans == 1);
+   TEST(state[0].nrrangetrans == 0);
+   TEST(state[0].emptylist.last == (slist_node_t*)&empty_trans->next);
+   TEST(state[0].rangelist.last == 0);
+   TEST(state[0].nrdfa     == 255); // unchanged
+   TEST(empty_trans->next  == (slist_node_t*)&empty_trans->next);
+   TEST(empty_trans->state == &state[2]);
+
+   // TEST initempty2_state
+   memset(&state, 255, sizeof(state[0]));
+   state[0].next = (void*) &state[1].next;
+   initempty2_state(&state[0], &state[2], &state[5]);
+   TEST(state[0].next == (void*) &state[1].next); // unchanged
+   TEST(state[0].nremptytrans == 2);
+   TEST(state[0].nrrangetrans == 0);
+   TEST(state[0].emptylist.last == (slist_node_t*)&empty_trans[1].next);
+   TEST(state[0].rangelist.last == 0);
+   TEST(state[0].nrdfa       == 255); // unchanged
+   TEST(empty_trans[0].next  == (slist_node_t*)&empty_trans[1].next);
+   TEST(empty_trans[0].state == &state[2]);
+   TEST(empty_trans[1].next  == (slist_node_t*)&empty_trans[0].next);
+   TEST(empty_trans[1].state == &state[5]);
+
+   // TEST initrange_state
+   memset(&state, 255, sizeof(state[0]));
+   state[0].next = (void*) &state[1].next;
+   init_state(&state[0]);
+   TEST(state[0].next == (void*) &state[1].next); // unchanged
+   TEST(state[0].nremptytrans == 0);
+   TEST(state[0].nrrangetrans == 0);
+   TEST(state[0].emptylist.last == 0);
+   TEST(state[0].rangelist.last == 0);
+   TEST(state[0].nrdfa  == 255); // unchanged
+
+   // TEST initrange_state
+   static_assert( sizeof(state) > state_SIZE + state_SIZE_RANGETRANS(256),
+                  "initrange_state does not overflow state array");
+   for (unsigned i = 0; i < 256; ++i) {
+      memset(&state, 0, sizeof(state));
+      memset(&state, 255, sizeof(state[0]));
+      state[0].next = (void*) &state[1].next;
+      initrange_state(&state[0], &state[3], (uint8_t)i, from, to);
+      TEST(state[0].next == (void*) &state[1].next); // unchanged
+      TEST(state[0].nremptytrans == 0);
+      TEST(state[0].nrrangetrans == i);
+      TEST(state[0].emptylist.last == 0);
+      TEST(state[0].rangelist.last == (slist_node_t*) &range_trans[0].next);
+      TEST(state[0].nrdfa  == 255); // unchanged
+      TEST(range_trans[0].next == (slist_node_t*) &range_trans[0].next);
+      TEST(range_trans[0].size == i);
+      for (unsigned s = 0; s < i; ++s) {
+         TEST(range_trans[0].array[s].from  == (unsigned) (s+1));
+         TEST(range_trans[0].array[s].to    == (unsigned) (s+10));
+         TEST(range_trans[0].array[s].state == &state[3]);
+      }
+      TEST(range_trans[0].array[i].from  == 0);
+      TEST(range_trans[0].array[i].to    == 0);
+      TEST(range_trans[0].array[i].state == 0);
+   }
+
+   // TEST initcontinue_state
+   static_assert( sizeof(state) > state_SIZE + 256 * state_SIZE_RANGETRANS(1),
+                  "initcontinue_state does not overflow state array");
+   memset(&state, 0, sizeof(state));
+   state[0].next = (void*) &state[1].next;
+   state[0].nremptytrans = 2;
+   state[0].emptylist.last = (void*)3;
+   range_transition_t *trans = &range_trans[0];
+   for (unsigned i = 1, N = 1; N < 256; ++i, N += i) {
+      extendmatch_state(&state[0], &state[3], (uint8_t)i, from, to, trans);
+      TEST(state[0].next == (void*) &state[1].next);  // unchanged
+      TEST(state[0].nremptytrans == 2);               // unchanged
+      TEST(state[0].nrrangetrans == N);
+      TEST(state[0].emptylist.last == (void*)3);      // unchanged
+      TEST(state[0].rangelist.last == (void*) &trans->next);
+      TEST(trans->next == (void*) &range_trans[0].next);
+      trans = &range_trans[0];
+      for (unsigned S = 1, N2 = 1; N2 <= N; ++S, N2 += S) {
+         range_transition_t *next = (void*) &trans->array[S];
+         TEST(trans->next == (void*) (N2 < N ? &next->next : &range_trans[0].next));
+         TEST(trans->size == S);
+         for (unsigned s = 0; s < S; ++s) {
+            TEST(trans->array[s].from  == s+1u);
+            TEST(trans->array[s].to    == s+10u);
+            TEST(trans->array[s].state == &state[3]);
+         }
+         trans = next;
+      }
+      TEST(trans->next == 0);
+      TEST(trans->size == 0);
+      TEST(trans->array[0].from  == 0);
+      TEST(trans->array[0].to    == 0);
+      TEST(trans->array[0].state == 0);
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int test_statearray(void)
+{
+   statearray_t arr = statearray_FREE;
+   state_t    * state;
+   size_t       size;
+   size_t       L;
+   statearray_iter_t iter;
+
+   // prepare
+   for(L = 0; ((L+1)*sizeof(state_t*) + sizeof(statearray_block_t)) <= sizeblock_statearray(); ++L)
+      ;
+
+   // TEST statearray_FREE
+   TEST( 0 == arr.mman);
+   TEST( 0 == arr.length_of_block);
+   TEST( isempty_slist(&arr.addlist));
+   TEST( isempty_slist(&arr.dellist));
+   TEST( isempty_slist(&arr.freelist));
+   TEST( 0 == arr.addnext);
+   TEST( 0 == arr.addend);
+   TEST( 0 == arr.delblock);
+   TEST( 0 == arr.delnext);
+   TEST( 0 == arr.delend);
+
+   // TEST sizeblock_statearray
+   TEST(16384 == sizeblock_statearray());
+
+   // TEST init_statearray
+   memset(&arr, 255, sizeof(arr));
+   arr.mman = 0;
+   size = SIZEALLOCATED_PAGECACHE();
+   // test
+   TEST( 0 == init_statearray(&arr));
+   // check env
+   TEST( size < SIZEALLOCATED_PAGECACHE());
+   // check arr
+   TEST( 0 != arr.mman);
+   TEST( L == arr.length_of_block);
+   TEST( isempty_slist(&arr.addlist));
+   TEST( isempty_slist(&arr.dellist));
+   TEST( isempty_slist(&arr.freelist));
+   TEST( 0 == arr.addnext);
+   TEST( 0 == arr.addend);
+   TEST( 0 == arr.delblock);
+   TEST( 0 == arr.delnext);
+   TEST( 0 == arr.delend);
+
+   // TEST free_statearray: frees only mman && double free
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      TEST( 0 == free_statearray(&arr));
+      // check env
+      TEST( size == SIZEALLOCATED_PAGECACHE());
+      // check arr
+      TEST( 0 == arr.mman);
+      TEST( L == arr.length_of_block); // untouched
+      // ...
+   }
+
+   // TEST insert1_statearray: addnext == addend == 0 || (addnext < addend)
+   TEST(0 == init_statearray(&arr));
+   for (uintptr_t i = 1; i <= L; ++i) {
+      // test
+      TEST( 0 == insert1_statearray(&arr, (state_t*)i));
+      // check mman
+      TEST( sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
+      // check arr
+      TEST( 0 != arr.mman);
+      TEST( L == arr.length_of_block);
+      statearray_block_t * block = first_blocklist(&arr.addlist);
+      TEST( block != 0);
+      TEST( block == first_blocklist(&arr.addlist));
+      TEST( block == last_blocklist(&arr.addlist))
+      TEST( isempty_slist(&arr.dellist));
+      TEST( isempty_slist(&arr.freelist));
+      TEST( &block->state[i] == arr.addnext);
+      TEST( &block->state[L] == arr.addend);
+      TEST( 0 == arr.delblock);
+      TEST( 0 == arr.delnext);
+      TEST( 0 == arr.delend);
+      // check first_blocklist content
+      TEST( block->next    == (slist_node_t*)block);
+      TEST( block->nrstate == 0);
+      TEST( block->state[i-1] == (state_t*)i);
+      if (i == L) {
+         for (uintptr_t i2 = 0; i2 < L; ++i2) {
+            TEST( block->state[i2] == (state_t*)(1+i2));
+         }
+      }
+   }
+
+   // TEST insert1_statearray: addnext == addend
+   TEST(0 == free_statearray(&arr));
+   TEST(0 == init_statearray(&arr));
+   TEST(0 == insert1_statearray(&arr, (state_t*)(void*)1));
+   statearray_block_t * block[6] = { first_blocklist(&arr.addlist), 0 };
+   for (uintptr_t i = 2; i <= lengthof(block); ++i) {
+      // test
+      arr.addnext = arr.addend;
+      TEST( 0 == insert1_statearray(&arr, (state_t*)i));
+      // check mman
+      TEST( i*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
+      // check arr
+      block[i-1] = last_blocklist(&arr.addlist);
+      TEST( 0 != arr.mman);
+      TEST( L == arr.length_of_block);
+      TEST( block[0]   == first_blocklist(&arr.addlist));
+      TEST( block[i-1] != block[0]);
+      TEST( isempty_slist(&arr.dellist));
+      TEST( isempty_slist(&arr.freelist));
+      TEST( &block[i-1]->state[1] == arr.addnext);
+      TEST( &block[i-1]->state[L] == arr.addend);
+      TEST( 0 == arr.delblock);
+      TEST( 0 == arr.delnext);
+      TEST( 0 == arr.delend);
+      // check previous last_blocklist content
+      TEST( block[i-2]->next    == (slist_node_t*)block[i-1]);
+      TEST( block[i-2]->nrstate == L);
+      // check last_blocklist content
+      TEST( block[i-1]->next     == (slist_node_t*)block[0]);
+      TEST( block[i-1]->nrstate  == 0);
+      TEST( block[i-1]->state[0] == (state_t*)i);
+   }
+
+   // prepare remove2_statearray
+   TEST(0 == free_statearray(&arr));
+   TEST(0 == init_statearray(&arr));
+   for (uintptr_t i = 0; i < lengthof(block); ++i) {
+      for (uintptr_t i2 = 1; i2 <= 7*(i+1); ++i2) {
+         TEST(0 == insert1_statearray(&arr, (state_t*)(i+i2)));
+      }
+      block[i] = last_blocklist(&arr.addlist);
+      arr.addend = arr.addnext;
+   }
+   block[lengthof(block)-1]->nrstate = (size_t) (arr.addnext - &block[lengthof(block)-1]->state[0]);
+   TEST(isempty_slist(&arr.dellist));
+   TEST(isempty_slist(&arr.freelist));
+   arr.addend  = 0;
+   arr.addnext = 0;
+   TEST(0 == arr.delblock);
+   TEST(0 == arr.delnext);
+   TEST(0 == arr.delend);
+   arr.dellist = arr.addlist;
+   arr.addlist = (slist_t) slist_INIT;
+
+   // TEST remove2_statearray
+   for (uintptr_t i = 0; i < lengthof(block); ++i) {
+      for (uintptr_t i2 = 1; i2 <= 7*(i+1); ++i2) {
+         // test
+         state_t * removedstate = 0;
+         TEST( 0 == remove2_statearray(&arr, &removedstate));
+         // check mman
+         TEST( lengthof(block)*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
+         // check removedstate
+         TEST( removedstate == (state_t*)(i+i2));
+         // check arr
+         TEST( 0 != arr.mman);
+         TEST( L == arr.length_of_block);
+         TEST( isempty_slist(&arr.addlist));
+         if (i == lengthof(block)-1) {
+            TEST( isempty_slist(&arr.dellist));
+         } else {
+            TEST( ! isempty_slist(&arr.dellist));
+            TEST( block[i+1] == first_blocklist(&arr.dellist));
+         }
+         if (i == 0) {
+            TEST( isempty_slist(&arr.freelist));
+         } else {
+            TEST( ! isempty_slist(&arr.freelist));
+            TEST( block[i-1] == last_blocklist(&arr.freelist));
+         }
+         TEST( 0 == arr.addnext);
+         TEST( 0 == arr.addend);
+         TEST( block[i] == arr.delblock);
+         TEST( arr.delnext == &arr.delblock->state[i2]);
+         TEST( arr.delend  == &arr.delblock->state[7*(i+1)]);
+      }
+   }
+
+   // TEST remove2_statearray: ENODATA (more than one time does not harm)
+   for (unsigned rep = 0; rep < 5; ++rep) {
+      state_t * removedstate = 0;
+      TEST( ENODATA == remove2_statearray(&arr, &removedstate));
+      // check mman
+      TEST( lengthof(block)*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
+      // check removedstate
+      TEST( removedstate == 0);
+      // check arr
+      TEST( 0 != arr.mman);
+      TEST( L == arr.length_of_block);
+      TEST( isempty_slist(&arr.addlist));
+      TEST( isempty_slist(&arr.dellist));
+      TEST( ! isempty_slist(&arr.freelist));
+      TEST( 0 == arr.addnext);
+      TEST( 0 == arr.addend);
+      TEST( 0 == arr.delblock);
+      TEST( arr.delnext == arr.delend);
+      TEST( arr.delend  == &block[lengthof(block)-1]->state[7*lengthof(block)]);
+      // check freelist content
+      size_t i = 0;
+      foreach (_blocklist, b, &arr.freelist) {
+         TEST( i < lengthof(block));
+         TEST( block[i++] == b);
+      }
+   }
+
+   // prepare swap1and2_statearray
+   TEST(0 == free_statearray(&arr));
+   TEST(0 == init_statearray(&arr));
+   for (size_t i = 0; i < lengthof(block); ++i) {
+      for (uintptr_t i2 = 1; i2 <= 3; ++i2) {
+         TEST(0 == insert1_statearray(&arr, (state_t*)(3*i+i2)));
+      }
+      block[i] = last_blocklist(&arr.addlist);
+      arr.addend = arr.addnext;
+   }
+   for (size_t i = 0; i < lengthof(block)/2; ++i) {
+      statearray_block_t *firstblock;
+      firstblock = removefirst_blocklist(&arr.addlist);
+      insertlast_blocklist(&arr.dellist, firstblock);
+   }
+   for (uintptr_t i = 1; i <= 4; ++i) {
+      TEST(0 == remove2_statearray(&arr, &state));
+      TEST(i == (uintptr_t)state);
+   }
+   TEST(! isempty_slist(&arr.addlist));
+   TEST(last_blocklist(&arr.addlist) == block[lengthof(block)-1]);
+   TEST(0 == block[lengthof(block)-1]->nrstate);
+   TEST(! isempty_slist(&arr.dellist));
+   TEST(! isempty_slist(&arr.freelist));
+   TEST(0 != arr.addend)
+   TEST(0 != arr.addnext);
+   TEST(0 != arr.delblock);
+   TEST(0 != arr.delnext);
+   TEST(0 != arr.delend);
+
+   // TEST swap1and2_statearray
+   swap1and2_statearray(&arr);
+   // check mman
+   TEST( lengthof(block)*sizeblock_statearray() == sizeallocated_automatmman(arr.mman));
+   // check arr
+   TEST( 0 != arr.mman);
+   TEST( L == arr.length_of_block);
+   TEST( isempty_slist(&arr.addlist));
+   TEST( ! isempty_slist(&arr.dellist));
+   TEST( ! isempty_slist(&arr.freelist));
+   TEST( 0 == arr.addnext);
+   TEST( 0 == arr.addend);
+   TEST( 0 == arr.delblock);
+   TEST( 0 == arr.delnext);
+   TEST( 0 == arr.delend);
+   // check freelist content (former dellist + delblock)
+   {
+      size_t i = 0;
+      foreach (_blocklist, b, &arr.freelist) {
+         TEST( i < lengthof(block)/2);
+         TEST( 3 == b->nrstate);
+         TEST( b == block[i++]);
+      }
+      TEST( i == lengthof(block)/2);
+   }
+   // check dellist content (former addlist)
+   {
+      size_t i = lengthof(block)/2;
+      foreach (_blocklist, b, &arr.dellist) {
+         TEST( i < lengthof(block));
+         TEST( 3 == b->nrstate);
+         TEST( b == block[i++]);
+      }
+      TEST( i == lengthof(block));
+   }
+   for (uintptr_t i = 3*lengthof(block)/2+1; i <= 3*lengthof(block); ++i) {
+      TEST(0 == remove2_statearray(&arr, &state));
+      TEST(i == (uintptr_t)state);
+   }
+   TEST(ENODATA == remove2_statearray(&arr, &state));
+
+   // TEST init_statearrayiter: empty statearray
+   TEST(0 == free_statearray(&arr));
+   TEST(0 == init_statearray(&arr));
+   init_statearrayiter(&iter, &arr);
+   // check iter
+   TEST( 0 == iter.block);
+   TEST( 0 == iter.next);
+   TEST( 0 == iter.end);
+
+   // TEST init_statearrayiter: single allocated page
+   for (uintptr_t i = 0; i < arr.length_of_block; ++i) {
+      TEST(0 == insert1_statearray(&arr, (state_t*)i));
+      init_statearrayiter(&iter, &arr);
+      // check iter
+      TEST( iter.block == first_blocklist(&arr.addlist));
+      TEST( iter.next  == first_blocklist(&arr.addlist)->state);
+      TEST( iter.end   == first_blocklist(&arr.addlist)->state);
+   }
+
+   // TEST init_statearrayiter: multiple allocated pages
+   TEST(0 == insert1_statearray(&arr, (state_t*)0));
+   init_statearrayiter(&iter, &arr);
+   // check iter
+   TEST( iter.block == first_blocklist(&arr.addlist));
+   TEST( iter.next  == first_blocklist(&arr.addlist)->state);
+   TEST( iter.end   == first_blocklist(&arr.addlist)->state + arr.length_of_block);
+   for (uintptr_t nrpage = 2; nrpage < 20; ++nrpage) {
+      // prepare
+      arr.addend = arr.addnext;
+      TEST(0 == insert1_statearray(&arr, (state_t*)nrpage));
+      // test
+      init_statearrayiter(&iter, &arr);
+      // check iter
+      TEST( iter.block == first_blocklist(&arr.addlist));
+      TEST( iter.next  == first_blocklist(&arr.addlist)->state);
+      TEST( iter.end   == first_blocklist(&arr.addlist)->state + arr.length_of_block);
+   }
+
+   // TEST next_statearrayiter: empty statearray
+   TEST(0 == free_statearray(&arr));
+   TEST(0 == init_statearray(&arr));
+   init_statearrayiter(&iter, &arr);
+   // test
+   TEST( 0 == next_statearrayiter(&iter, &arr, &state));
+   // check iter
+   TEST( 0 == iter.block);
+   TEST( 0 == iter.next);
+   TEST( 0 == iter.end);
+
+   // TEST next_statearrayiter: single page statearray
+   for (unsigned len = 1, S = 1, S2 = 1; len < 20; ++len, S2 += len) {
+      // prepare
+      for (uintptr_t i = S; i <= S2; ++i) {
+         TEST(0 == insert1_statearray(&arr, (state_t*)i));
+      }
+      if (len == 1) init_statearrayiter(&iter, &arr);
+      for (uintptr_t i = 0; i < len; ++i, ++S) {
+         // test
+         TEST( 1 == next_statearrayiter(&iter, &arr, &state));
+         // check state
+         TEST( S == (uintptr_t)state);
+         // check iter
+         TEST( iter.block == first_blocklist(&arr.addlist));
+         TEST( iter.next  == first_blocklist(&arr.addlist)->state + S);
+         TEST( iter.end   == first_blocklist(&arr.addlist)->state + S2);
+      }
+      // test (ENODATA)
+      TEST( 0 == next_statearrayiter(&iter, &arr, &state));
+      // check state (not changed)
+      TEST( S2 == (uintptr_t)state);
+      // check iter (not changed)
+      TEST( iter.block == first_blocklist(&arr.addlist));
+      TEST( iter.next  == first_blocklist(&arr.addlist)->state + S2);
+      TEST( iter.end   == first_blocklist(&arr.addlist)->state + S2);
+   }
+
+   // TEST next_statearrayiter: multiple page statearray
+   TEST(0 == free_statearray(&arr));
+   TEST(0 == init_statearray(&arr));
+   TEST(0 == insert1_statearray(&arr, (state_t*)1));
+   init_statearrayiter(&iter, &arr);
+   block[0] = first_blocklist(&arr.addlist);
+   for (uintptr_t nrpage = 2; nrpage < 20; ++nrpage, block[0] = next_blocklist(block[0])) {
+      arr.addend = arr.addnext;
+      TEST(0 == insert1_statearray(&arr, (state_t*)nrpage));
+      // test
+      TEST( 1 == next_statearrayiter(&iter, &arr, &state));
+      // check state
+      TEST( nrpage-1 == (uintptr_t)state);
+      // check iter
+      TEST( last_blocklist(&arr.addlist) == next_blocklist(block[0]));
+      TEST( iter.block == block[0]);
+      TEST( iter.next  == block[0]->state + 1);
+      TEST( iter.end   == block[0]->state + 1);
+   }
+   for (unsigned tc = 1; tc <= 1; --tc) {
+      // test (last + ENODATA)
+      TEST( tc == next_statearrayiter(&iter, &arr, &state));
+      // check state
+      TEST( 19 == (uintptr_t)state);
+      // check iter
+      TEST( last_blocklist(&arr.addlist) == block[0]);
+      TEST( iter.block == block[0]);
+      TEST( iter.next  == block[0]->state + 1);
+      TEST( iter.end   == block[0]->state + 1);
+   }
+
+   // reset
+   TEST(0 == free_statearray(&arr));
+
+   return 0;
+ONERR:
+   free_statearray(&arr);
+   return EINVAL;
+}
+
+static int test_multistate(void)
+{
+   const unsigned NROFSTATE = 256;
+   state_t        state[NROFSTATE];
+   multistate_t   mst = multistate_INIT;
+   automat_mman_t* mman = 0;
+   multistate_iter_t iter;
+   void * const   ENDMARKER = (void*) (uintptr_t) 0x01234567;
+   const unsigned LEVEL1_NROFSTATE = multistate_NROFSTATE * multistate_NROFCHILD;
+
+   static_assert( 2*LEVEL1_NROFSTATE <= NROFSTATE,
+                  "state array big enough to build root node with all possible number of leaves"
+                  "and also supports interleaving (only every 2nd state to support inserting in between)"
+                  );
+
+   // prepare
+   memset(&state, 0, sizeof(state));
+   TEST(0 == new_automatmman(&mman));
+
+   // TEST multistate_NROFSTATE
+   TEST( lengthof(((multistate_node_t*)0)->state) == multistate_NROFSTATE);
+
+   // TEST multistate_NROFCHILD
+   TEST( lengthof(((multistate_node_t*)0)->child) == multistate_NROFCHILD);
+
+   // TEST multistate_INIT
+   TEST(0 == mst.size);
+   TEST(0 == mst.root);
+
+   // TEST add_multistate: multistate_t.size == 0
+   for (unsigned i = 0; i < NROFSTATE; ++i) {
+      mst = (multistate_t) multistate_INIT;
+      for (unsigned tc = 0; tc <= 1; ++tc) {
+         // test
+         TEST( (tc ? EEXIST : 0) == add_multistate(&mst, mman, &state[i]));
+         // check mman: nothing allocated
+         TEST( 0 == sizeallocated_automatmman(mman));
+         // check mst
+         TEST( 1 == mst.size);
+         TEST( &state[i] == mst.root);
+      }
+   }
+
+   // TEST add_multistate: multistate_t.size == 1
+   for (unsigned i = 0; i < NROFSTATE-1; ++i) {
+      for (unsigned order = 0; order <= 1; ++order) {
+         // prepare
+         mst = (multistate_t) multistate_INIT;
+         TEST(0 == add_multistate(&mst, mman, &state[i + !order]));
+         for (unsigned tc = 0; tc <= 1; ++tc) {
+            // test
+            TEST( (tc ? EEXIST : 0) == add_multistate(&mst, mman, &state[i + order]));
+            // check mman
+            TEST( sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+            // check mst
+            TEST( 0 == invariant_multistate(&mst));
+            TEST( 2 == mst.size);
+            TEST( 0 != mst.root);
+            // check mst.root content
+            TEST( 0 == ((multistate_node_t*)mst.root)->level);
+            TEST( 2 == ((multistate_node_t*)mst.root)->size);
+            TEST( &state[i] == ((multistate_node_t*)mst.root)->state[0]);
+            TEST( &state[i+1] == ((multistate_node_t*)mst.root)->state[1]);
+         }
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST add_multistate: single leaf && add states ascending/descending
+   for (unsigned asc = 0; asc <= 1; ++asc) {
+      void * addr = 0;
+      mst = (multistate_t) multistate_INIT;
+      for (unsigned i = 0; i < multistate_NROFSTATE; ++i) {
+         // test
+         TEST( 0 == add_multistate(&mst, mman, &state[asc ? i : multistate_NROFSTATE-1-i]));
+         if (1 == i) {  // set end marker at end of node
+            TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr));
+            *((void**)addr) = ENDMARKER;
+            // check that end marker is effective !!
+            TEST(addr == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
+         }
+         // check mman
+         TEST( (i > 0 ? sizeof(void*)+sizeof(multistate_node_t) : 0) == sizeallocated_automatmman(mman));
+         // check mst
+         TEST( 0 == invariant_multistate(&mst));
+         TEST( i+1 == mst.size);
+         TEST( 0   != mst.root);
+         // check mst.root content
+         if (i >= 1) {
+            TEST( 0   == ((multistate_node_t*)mst.root)->level);
+            TEST( i+1 == ((multistate_node_t*)mst.root)->size);
+            for (unsigned s = 0; s <= i; ++s) {
+               TEST( &state[asc ? s : multistate_NROFSTATE-1-i+s] == ((multistate_node_t*)mst.root)->state[s]);
+            }
+            TEST( ENDMARKER == *((void**)addr)); // no overflow into following memory block
+         }
+      }
+      // reset
+      reset_automatmman(mman);
+   }
+
+   // TEST add_multistate: single leaf && add states unordered
+   for (unsigned S = 3; S < multistate_NROFSTATE; ++S) {
+      for (unsigned pos = 0; pos < S; ++pos) {
+         // prepare
+         mst = (multistate_t) multistate_INIT;
+         for (unsigned i = 0; i < S; ++i) {
+            if (i != pos) { TEST(0 == add_multistate(&mst, mman, &state[i])); }
+         }
+         void * addr = 0;
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr));
+         *((void**)addr) = ENDMARKER;
+         TEST(addr == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
+         // test
+         TEST( 0 == add_multistate(&mst, mman, &state[pos]));
+         // check: mman
+         TEST( sizeof(void*)+sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+         // check: mst
+         TEST( 0 == invariant_multistate(&mst));
+         TEST( S == mst.size);
+         TEST( 0 != mst.root);
+         // check: mst.root content
+         TEST( 0 == ((multistate_node_t*)mst.root)->level);
+         TEST( S == ((multistate_node_t*)mst.root)->size);
+         for (unsigned i = 0; i < S; ++i) {
+            TEST( &state[i] == ((multistate_node_t*)mst.root)->state[i]);
+         }
+         // check: no overflow into following memory block
+         TEST( ENDMARKER == *((void**)addr));
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST add_multistate: single leaf: EEXIST
+   {
+      // prepare
+      mst = (multistate_t) multistate_INIT;
+      for (unsigned i = 0; i < multistate_NROFSTATE; ++i) {
+         TEST(0 == add_multistate(&mst, mman, &state[i]));
+      }
+      void * addr = 0;
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr));
+      *((void**)addr) = ENDMARKER;
+      TEST(addr == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
+      for (unsigned i = 0; i < multistate_NROFSTATE; ++i) {
+         // test
+         TEST( EEXIST == add_multistate(&mst, mman, &state[i]));
+         // check mman
+         TEST( sizeof(void*)+sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+         // check mst
+         TEST( multistate_NROFSTATE == mst.size);
+         TEST( 0 != mst.root);
+         // check mst.root content
+         TEST( 0 == ((multistate_node_t*)mst.root)->level);
+         TEST( multistate_NROFSTATE == ((multistate_node_t*)mst.root)->size);
+         TEST( 0 == ((multistate_node_t*)mst.root)->next);
+         for (unsigned s = 0; s < multistate_NROFSTATE; ++s) {
+            TEST( &state[s] == ((multistate_node_t*)mst.root)->state[s]);
+         }
+         TEST( ENDMARKER == *((void**)addr)); // no overflow into following memory block
+      }
+      // reset
+      reset_automatmman(mman);
+   }
+
+   // TEST add_multistate: split leaf node (level 0) ==> build root (level 1) ==> 3 nodes total
+   for (unsigned splitidx = 0; splitidx <= multistate_NROFSTATE; ++splitidx) {
+      void * addr[2] = { 0 };
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+      *((void**)addr[0]) = ENDMARKER;
+      // prepare
+      mst = (multistate_t) multistate_INIT;
+      for (unsigned i = 0, next = 0; i < multistate_NROFSTATE; ++i, ++next) {
+         if (next == splitidx) ++next;
+         TEST(0 == add_multistate(&mst, mman, &state[next]));
+      }
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+      *((void**)addr[1]) = ENDMARKER;
+      TEST(addr[1] == &((multistate_node_t*)mst.root)->state[multistate_NROFSTATE]);
+      TEST(addr[0] == &((void**)mst.root)[-1]);
+      // test
+      void * oldroot = mst.root;
+      TEST( 2*sizeof(void*)+sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+      TEST( 0 == add_multistate(&mst, mman, &state[splitidx]));
+      // check: mman
+      TEST( 2*sizeof(void*)+3*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+      // check: mst
+      TEST( 0 == invariant_multistate(&mst));
+      TEST( mst.size == multistate_NROFSTATE+1);
+      TEST( mst.root != 0);
+      TEST( mst.root != oldroot);
+      TEST( mst.root == ((uint8_t*)addr[1]) + sizeof(void*) + sizeof(multistate_node_t));
+      // check: mst.root content
+      TEST( ((multistate_node_t*)mst.root)->level == 1);
+      TEST( ((multistate_node_t*)mst.root)->size  == 2);
+      TEST( ((multistate_node_t*)mst.root)->child[0] == oldroot);
+      TEST( ((multistate_node_t*)mst.root)->child[1] == (multistate_node_t*) (((uint8_t*)addr[1]) + sizeof(void*)));
+      TEST( ((multistate_node_t*)mst.root)->key[0]   == ((multistate_node_t*)mst.root)->child[1]->state[0]);
+      // check: leaf1 content
+      multistate_node_t* leaf1 = ((multistate_node_t*)mst.root)->child[0];
+      multistate_node_t* leaf2 = ((multistate_node_t*)mst.root)->child[1];
+      TEST( leaf1->level == 0);
+      TEST( leaf1->size  == multistate_NROFSTATE/2 + 1);
+      TEST( leaf1->next  == leaf2);
+      for (unsigned i = 0; i < leaf1->size; ++i) {
+         TEST( &state[i] == leaf1->state[i]);
+      }
+      // check: leaf2 content
+      TEST( leaf2->level == 0);
+      TEST( leaf2->size  == multistate_NROFSTATE/2);
+      TEST( leaf2->next  == 0);
+      for (unsigned i = 0; i < leaf2->size; ++i) {
+         TEST( &state[leaf1->size+i] == leaf2->state[i]);
+      }
+      // check: no overflow into surrounding memory
+      for (size_t i = 0; i < lengthof(addr); ++i) {
+         TEST( ENDMARKER == *((void**)addr[i]));
+      }
+      // reset
+      reset_automatmman(mman);
+   }
+
+   // TEST add_multistate: build root node (level 1) + many leafs (level 0) ascending/descending
+   for (unsigned desc = 0; desc <= 1; ++desc) {
+      void * child[multistate_NROFCHILD] = { 0 };
+      void * addr[multistate_NROFCHILD] = { 0 };
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+      *((void**)addr[0]) = ENDMARKER;
+      child[0] = (uint8_t*)addr[0] + sizeof(void*);
+      child[1] = (uint8_t*)child[0] + sizeof(multistate_node_t);
+      void * root = (uint8_t*)child[1] + sizeof(multistate_node_t);
+      // prepare
+      mst = (multistate_t) multistate_INIT;
+      for (unsigned i = 0; i < multistate_NROFSTATE+1; ++i) {
+         TEST(0 == add_multistate(&mst, mman, &state[desc?NROFSTATE-1-i:i]));
+      }
+      unsigned SIZE = multistate_NROFSTATE+1;
+      TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+      *((void**)addr[1]) = ENDMARKER;
+      for (unsigned nrchild = 2; nrchild <= multistate_NROFCHILD; ) {
+         for (unsigned nrstate = 1; nrstate <= multistate_NROFSTATE/2+(desc==0); ++nrstate) {
+            const unsigned isSplit = (nrstate == multistate_NROFSTATE/2+(desc==0));
+            if (isSplit && nrchild==multistate_NROFCHILD) {
+               // fill only last but do not split it else root would overflow
+               // this is checked in next test case
+               ++nrchild;
+               break;
+            }
+            // test add to last(desc==0)/first(desc==1) leaf
+            TEST( 0 == add_multistate(&mst, mman, &state[desc?NROFSTATE-1-SIZE:SIZE]));
+            if (isSplit) {
+               if (desc) memmove(&child[2], &child[1], (nrchild-1)*sizeof(child[0]));
+               child[desc?1:nrchild] = (uint8_t*)addr[nrchild-1] + sizeof(void*);
+               TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[nrchild]));
+               *((void**)addr[nrchild]) = ENDMARKER;
+               ++ nrchild;
+            }
+            // check: mman
+            TEST( nrchild*sizeof(void*)+(nrchild+1)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+            // check: mst
+            TEST( 0 == invariant_multistate(&mst));
+            ++ SIZE;
+            TEST( SIZE == mst.size);
+            TEST( root == mst.root);
+            // check mst.root content
+            TEST( 1       == ((multistate_node_t*)mst.root)->level);
+            TEST( nrchild == ((multistate_node_t*)mst.root)->size);
+            for (unsigned i = 0; i < nrchild; ++i) {
+               TEST( child[i] == ((multistate_node_t*)mst.root)->child[i]);
+               if (i) {
+                  state_t * key = &state[ desc ? NROFSTATE-nrchild*(multistate_NROFSTATE/2) + i*(multistate_NROFSTATE/2)
+                                : i*(multistate_NROFSTATE/2+1)];
+                  TEST( key == ((multistate_node_t*)mst.root)->key[i-1]);
+               }
+            }
+            // check: leaf content
+            for (unsigned i = 0, istate=desc?NROFSTATE-SIZE:0; i < nrchild; ++i) {
+               const unsigned isLast = desc?i==0:i==nrchild-1;
+               const unsigned S = (multistate_NROFSTATE/2+(desc?isLast:(unsigned)!isLast)) + nrstate*isLast*(!isSplit);
+               TEST( 0 == ((multistate_node_t*)child[i])->level);
+               TEST( S == ((multistate_node_t*)child[i])->size);
+               TEST( (i==nrchild-1?0:child[i+1]) == ((multistate_node_t*)child[i])->next);
+               for (unsigned s = 0; s < S; ++s, ++istate) {
+                  TEST( &state[istate] == ((multistate_node_t*)child[i])->state[s]);
+               }
+            }
+            // check: no overflow into surrounding memory
+            for (unsigned i = 0; i < nrchild; ++i) {
+               TEST( ENDMARKER == *((void**)addr[i]));
+            }
+         }
+      }
+      // reset
+      reset_automatmman(mman);
+   }
+
+   // TEST add_multistate: build root node (level 1) + many leafs (level 0) unordered
+   for (unsigned nrchild=2; nrchild < multistate_NROFCHILD; ++nrchild) {
+      for (unsigned pos = 0; pos < nrchild; ++pos) {
+         void * child[multistate_NROFCHILD] = { 0 };
+         void * addr[multistate_NROFCHILD+1] = { 0 };
+         // addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... splitchild
+         TEST(0 == build1_multistate(&mst, mman, state, 2/*every 2nd*/, ENDMARKER, nrchild, addr, child));
+         void *   const root = mst.root;
+         unsigned const SIZE = nrchild * multistate_NROFSTATE + 1;
+         // test add single state ==> split check split
+         TEST( 0 == add_multistate(&mst, mman, &state[1+pos*(2*multistate_NROFSTATE)]));
+         // check: mman
+         TEST( (nrchild+2)*sizeof(void*)+(nrchild+2)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+         // check: mst
+         TEST( 0 == invariant_multistate(&mst));
+         TEST( SIZE == mst.size);
+         TEST( root == mst.root);
+         // check mst.root content
+         TEST( 1         == ((multistate_node_t*)mst.root)->level);
+         TEST( nrchild+1 == ((multistate_node_t*)mst.root)->size);
+         memmove(&child[pos+2], &child[pos+1], (nrchild-1-pos)*sizeof(child[0]));
+         child[pos+1] = (uint8_t*)addr[1+nrchild] + sizeof(void*);
+         TEST( child[0] == ((multistate_node_t*)mst.root)->child[0]);
+         for (unsigned i = 1; i < nrchild+1; ++i) {
+            state_t * key = &state[(i-(i>pos))*(2*multistate_NROFSTATE)+(i==pos+1)*multistate_NROFSTATE];
+            TEST( ((multistate_node_t*)mst.root)->key[i-1] == key);
+            TEST( ((multistate_node_t*)mst.root)->child[i] == child[i]);
+         }
+         // check: leaf content
+         for (unsigned i = 0, istate=0; i < nrchild+1; ++i) {
+            unsigned const S = i == pos ? multistate_NROFSTATE/2+1 : i == pos+1 ? multistate_NROFSTATE/2 : multistate_NROFSTATE;
+            TEST( 0 == ((multistate_node_t*)child[i])->level);
+            TEST( S == ((multistate_node_t*)child[i])->size);
+            TEST( (i==nrchild?0:child[i+1]) == ((multistate_node_t*)child[i])->next);
+            for (unsigned s = 0; s < S; ++s, istate += (s<=2&&i==pos?1:2)) {
+               TEST( &state[istate] == ((multistate_node_t*)child[i])->state[s]);
+            }
+         }
+         // check: no overflow into surrounding memory
+         for (unsigned i = 0; i < nrchild+2; ++i) {
+            TEST( ENDMARKER == *((void**)addr[i]));
+         }
+         // reset
+         malloc_automatmman(mman, 0, &addr[1]);
+         memset(addr[0], 0, (uintptr_t)addr[1] - (uintptr_t)addr[0]);
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST add_multistate: split root node (level 1)
+   for (unsigned pos = 0; pos < multistate_NROFCHILD; ++pos) {
+      void * child[multistate_NROFCHILD+1] = { 0 };
+      void * addr[multistate_NROFCHILD+2] = { 0 };
+      // addr[0] root addr[1] child[0] addr[2] child[1] addr[3] ... splitchild splitroot new-root
+      TEST(0 == build1_multistate(&mst, mman, state, 2/*every 2nd*/, ENDMARKER, multistate_NROFCHILD, addr, child));
+      void *   const oldroot = mst.root;
+      void *   const splitchild = (uint8_t*)addr[multistate_NROFCHILD+1] + sizeof(void*);
+      void *   const splitroot = (uint8_t*)splitchild + sizeof(multistate_node_t);
+      void *   const root = (uint8_t*)splitroot + sizeof(multistate_node_t);
+      size_t const SIZE = multistate_NROFCHILD * multistate_NROFSTATE + 1;
+      state_t* const splitchild_key = &state[pos*(2*multistate_NROFSTATE)+multistate_NROFSTATE];
+      state_t* const splitroot_key  = pos < multistate_NROFCHILD/2 ? &state[(multistate_NROFCHILD/2)*(2*multistate_NROFSTATE)]
+                                    : pos == multistate_NROFCHILD/2 ? splitchild_key
+                                    : &state[(multistate_NROFCHILD/2+1)*(2*multistate_NROFSTATE)];
+      memmove(&child[pos+2], &child[pos+1], (multistate_NROFCHILD-1-pos)*sizeof(child[0]));
+      child[pos+1] = splitchild;
+      // test add single state ==> split check split
+      TEST( 0 == add_multistate(&mst, mman, &state[1+pos*(2*multistate_NROFSTATE)]));
+      // check: mman
+      TEST( (multistate_NROFCHILD+2)*sizeof(void*)+(multistate_NROFCHILD+4)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+      // check: mst
+      TEST( 0 == invariant_multistate(&mst));
+      TEST( SIZE == mst.size);
+      TEST( root == mst.root);
+      // check mst.root content
+      TEST( 2 == ((multistate_node_t*)mst.root)->level);
+      TEST( 2 == ((multistate_node_t*)mst.root)->size);
+      TEST( splitroot_key == ((multistate_node_t*)mst.root)->key[0]);
+      TEST( oldroot   == ((multistate_node_t*)mst.root)->child[0]);
+      TEST( splitroot == ((multistate_node_t*)mst.root)->child[1]);
+      // check oldroot / splitroot content
+      for (unsigned i = 0, ichild = 0; i < 2; ++i) {
+         const unsigned S = multistate_NROFCHILD/2+1-i;
+         TEST( 1 == ((multistate_node_t*)mst.root)->child[i]->level);
+         TEST( S == ((multistate_node_t*)mst.root)->child[i]->size);
+         for (unsigned s = 0; s < S; ++s, ++ichild) {
+            TEST( child[ichild] == ((multistate_node_t*)mst.root)->child[i]->child[s]);
+            if (s) {
+               state_t * key = ((multistate_node_t*)child[ichild])->state[0];
+               TEST( key == ((multistate_node_t*)mst.root)->child[i]->key[s-1]);
+            }
+         }
+      }
+      // check: leaf content
+      for (unsigned i = 0, istate=0; i < multistate_NROFCHILD+1; ++i) {
+         unsigned const S = i == pos ? multistate_NROFSTATE/2+1 : i == pos+1 ? multistate_NROFSTATE/2 : multistate_NROFSTATE;
+         TEST( 0 == ((multistate_node_t*)child[i])->level);
+         TEST( S == ((multistate_node_t*)child[i])->size);
+         TEST( (i==multistate_NROFCHILD?0:child[i+1]) == ((multistate_node_t*)child[i])->next);
+         for (unsigned s = 0; s < S; ++s, istate += (s<=2&&i==pos?1:2)) {
+            TEST( &state[istate] == ((multistate_node_t*)child[i])->state[s]);
+         }
+      }
+      // check: no overflow into surrounding memory
+      for (unsigned i = 0; i < multistate_NROFCHILD+2; ++i) {
+         TEST( ENDMARKER == *((void**)addr[i]));
+      }
+      // reset
+      malloc_automatmman(mman, 0, &addr[1]);
+      memset(addr[0], 0, (uintptr_t)addr[1] - (uintptr_t)addr[0]);
+      reset_automatmman(mman);
+   }
+
+   // TEST add_multistate: (level 2) split child(level 1) and add to root
+   for (unsigned nrchild=2; nrchild < multistate_NROFCHILD; ++nrchild) {
+      for (uintptr_t pos = 0; pos < nrchild; ++pos) {
+         void * addr[2];
+         void * child[multistate_NROFCHILD] = { 0 };
+         size_t SIZE = nrchild * LEVEL1_NROFSTATE + 1;
+         TEST(0 == malloc_automatmman(mman, 0, &addr[0]));
+         TEST(0 == build2_multistate(&mst, mman, 2, nrchild, child));
+         void * root = mst.root;
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+         void * splitchild = (uint8_t*)addr[1] + sizeof(void*) + sizeof(multistate_node_t)/*leaf*/;
+         // test add single state ==> split check split
+         TEST( 0 == add_multistate(&mst, mman, (void*)(1+pos*(2*LEVEL1_NROFSTATE))));
+         // check: mman
+         TEST( sizeof(void*)+(1+2+nrchild+nrchild*multistate_NROFCHILD)*sizeof(multistate_node_t) == sizeallocated_automatmman(mman));
+         // check: mst
+         TEST( 0 == invariant_multistate(&mst));
+         TEST( SIZE == mst.size);
+         TEST( root == mst.root);
+         // check mst.root content
+         TEST( 2         == ((multistate_node_t*)mst.root)->level);
+         TEST( nrchild+1 == ((multistate_node_t*)mst.root)->size);
+         state_t * key;
+         for (uintptr_t i = 0; i <= pos; ++i) {
+            key = (state_t*)(void*)(i*(2*LEVEL1_NROFSTATE));
+            if (i) TEST( key == ((multistate_node_t*)mst.root)->key[i-1]);
+            TEST( child[i] == ((multistate_node_t*)mst.root)->child[i]);
+         }
+         key = (state_t*)(void*)(pos*(2*LEVEL1_NROFSTATE)+LEVEL1_NROFSTATE);
+         TEST( key == ((multistate_node_t*)mst.root)->key[pos]);
+         TEST( splitchild == ((multistate_node_t*)mst.root)->child[pos+1]);
+         for (uintptr_t i = pos+2; i < nrchild; ++i) {
+            key = (state_t*)(void*)((i-1)*(2*LEVEL1_NROFSTATE));
+            TEST( key == ((multistate_node_t*)mst.root)->key[i-1]);
+            TEST( child[i-1] == ((multistate_node_t*)mst.root)->child[i]);
+         }
+         // check node/leaf content
+         TEST( EEXIST == add_multistate(&mst, mman, (void*)(1+pos*(2*LEVEL1_NROFSTATE))));
+         for (uintptr_t i = 0; i < LEVEL1_NROFSTATE*nrchild; ++i) {
+            TEST(EEXIST == add_multistate(&mst, mman, (void*)(2*i)));
+         }
+         // reset
+         malloc_automatmman(mman, 0, &addr[1]);
+         memset(addr[0], 0, (uintptr_t)addr[1] - (uintptr_t)addr[0]);
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST init_multistateiter: multistate_INIT
+   mst = (multistate_t) multistate_INIT;
+   memset(&iter, 255, sizeof(iter));
+   init_multistateiter(&iter, &mst);
+   // check iter
+   TEST(0 == iter.next_node);
+   TEST(0 == iter.next_state);
+   TEST(0 == iter.is_single);
+
+   // TEST next_multistateiter: multistate_INIT
+   state_t * next = 0;
+   TEST(0 == next_multistateiter(&iter, &next));
+   // check next (unchanged)
+   TEST(0 == next);
+   // check iter
+   TEST(0 == iter.next_node);
+   TEST(0 == iter.next_state);
+   TEST(0 == iter.is_single);
+
+   // TEST init_multistateiter: single entry
+   TEST(0 == add_multistate(&mst, mman, (void*)5));
+   memset(&iter, 255, sizeof(iter));
+   init_multistateiter(&iter, &mst);
+   // check iter
+   TEST(5 == (uintptr_t)iter.next_node);
+   TEST(0 == iter.next_state);
+   TEST(1 == iter.is_single);
+
+   // TEST next_multistateiter: single entry
+   // test
+   TEST(1 == next_multistateiter(&iter, &next));
+   // check next
+   TEST(5 == (uintptr_t)next);
+   // check iter
+   TEST(0 == iter.next_node);
+   TEST(0 == iter.next_state);
+   TEST(0 == iter.is_single);
+
+   multistate_node_t * F = 0;
+   for (uintptr_t i=6; i <= 2*LEVEL1_NROFSTATE; ++i) {
+      // TEST init_multistateiter: one or more pages
+      TEST(0 == add_multistate(&mst, mman, (void*)i));
+      if (i == 6) F = mst.root;
+      memset(&iter, 255, sizeof(iter));
+      init_multistateiter(&iter, &mst);
+      // check iter
+      TEST(F == iter.next_node);
+      TEST(0 == iter.next_state);
+      TEST(0 == iter.is_single);
+
+      // TEST next_multistateiter: one or more pages
+      multistate_node_t * N = F;
+      for (uintptr_t i2 = 5, O = 1; i2 <= i; ++i2, O++) {
+         if (O > N->size) { O = 1; N = N->next; }
+         TEST(1 == next_multistateiter(&iter, &next));
+         // check next
+         TEST(i2 == (uintptr_t)next);
+         // check iter
+         TEST(N == iter.next_node);
+         TEST(O == iter.next_state);
+         TEST(0 == iter.is_single);
+      }
+      // test end of chain
+      TEST(0 == next_multistateiter(&iter, &next));
+      // check iter: reached end
+      TEST(0 == iter.next_node);
+      TEST(0 == iter.next_state);
+      TEST(0 == iter.is_single);
+   }
+
+   // free resources
+   TEST(0 == delete_automatmman(&mman));
+
+   return 0;
+ONERR:
+   delete_automatmman(&mman);
+   return EINVAL;
+}
+
+static int test_rangemap(void)
+{
+   rangemap_t      rmap = rangemap_INIT;
+   automat_mman_t *mman = 0;
+   rangemap_iter_t iter;
+   void * const    ENDMARKER = (void*) (uintptr_t) 0x01234567;
+
+   // prepare
+   TEST(0 == new_automatmman(&mman));
+
+   // TEST rangemap_NROFRANGE
+   TEST( lengthof(((rangemap_node_t*)0)->range) == rangemap_NROFRANGE);
+
+   // TEST rangemap_NROFCHILD
+   TEST( lengthof(((rangemap_node_t*)0)->child) == rangemap_NROFCHILD);
+
+   // TEST rangemap_INIT
+   TEST(0 == rmap.size);
+   TEST(0 == rmap.root);
+
+   // TEST addrange_rangemap: EINVAL
+   TEST( EINVAL == addrange_rangemap(&rmap, mman, 1, 0));
+   TEST( EINVAL == addrange_rangemap(&rmap, mman, UINT32_MAX, 0));
+
+   // TEST addrange_rangemap: multistate_t.size == 0
+   for (unsigned from = 0; from < 256; from += 16) {
+      for (unsigned to = from; to < 256; to += 32) {
+         void * addr[2];
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+         // assumes big blocks + no free block header stored in free memory
+         addr[1] = (uint8_t*)addr[0] + sizeof(rangemap_node_t);
+         for (unsigned i = 0; i < lengthof(addr); ++i) {
+            *(void**)addr[i] = ENDMARKER;
+         }
+         // test
+         rmap = (rangemap_t) rangemap_INIT;
+         TEST( 0 == addrange_rangemap(&rmap, mman, from, to));
+         // check mman: root allocated
+         TEST( sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
+         // check rmap
+         TEST( rmap.size == 1);
+         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
+         // check mst.root content
+         TEST( 0 == rmap.root->level);
+         TEST( 1 == rmap.root->size);
+         TEST( 0 == rmap.root->next);
+         TEST( from == rmap.root->range[0].from);
+         TEST( to == rmap.root->range[0].to);
+         TEST( 0  == rmap.root->range[0].multistate.size);
+         // no overflow to adjacent block
+         for (unsigned i = 0; i < lengthof(addr); ++i) {
+            TEST( ENDMARKER == *(void**)addr[i]);
+         }
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST addrange_rangemap: insert non-overlapping ranges into single node
+   for (unsigned S = 2; S <= rangemap_NROFRANGE; ++S) {
+      for (unsigned pos = 0; pos < S; ++pos) {
+         // prepare
+         void * addr[2];
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+         *(void**)addr[0] = ENDMARKER;
+         rmap = (rangemap_t) rangemap_INIT;
+         for (unsigned i = 0; i < S; ++i) {
+            if (i == pos) continue;
+            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)i, (char32_t)i));
+         }
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+         *(void**)addr[1] = ENDMARKER;
+         // test
+         TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)pos, (char32_t)pos));
+         // check mman: only root allocated
+         TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
+         // check rmap
+         TEST( rmap.size == S);
+         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
+         // check mst.root content
+         TEST( 0 == rmap.root->level);
+         TEST( S == rmap.root->size);
+         TEST( 0 == rmap.root->next);
+         for (unsigned i = 0; i < S; ++i) {
+            TEST( i == rmap.root->range[i].from);
+            TEST( i == rmap.root->range[i].to);
+            TEST( 0 == rmap.root->range[i].multistate.size);
+         }
+         // no overflow to adjacent block
+         for (size_t i = 0; i < lengthof(addr); ++i) {
+            TEST( ENDMARKER == *(void**)addr[i]);
+         }
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST addrange_rangemap: insert range overlapping with ranges and holes
+   for (unsigned S = 1; S <= rangemap_NROFRANGE/2-1; ++S) {
+      for (unsigned from = 0; from <= 2*S; ++from) {
+         for (unsigned to = from; to <= 2*S; ++to) {
+            // prepare
+            void * addr[2];
+            TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+            *(void**)addr[0] = ENDMARKER;
+            rmap = (rangemap_t) rangemap_INIT;
+            for (unsigned i = 0; i < S; ++i) {
+               TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(1+2*i), (char32_t)(1+2*i)));
+            }
+            TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+            *(void**)addr[1] = ENDMARKER;
+            // test
+            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)from, (char32_t)to));
+            // check mman
+            TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
+            // check rmap
+            unsigned const D = to-from+1;
+            unsigned const S2 = S + D/2 + (D&1?!(from&1):0);
+            TESTP( rmap.size == S2, "rmap.size:%zd S2:%d S:%d to:%d from:%d", rmap.size, S2, S, to, from);
+            TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
+            // check mst.root content
+            TEST( 0  == rmap.root->level);
+            TEST( S2 == rmap.root->size);
+            TEST( 0  == rmap.root->next);
+            for (unsigned i = 0, N = from < 1 ? from : 1; i < S2; ++i, ++N) {
+               N += !(N&1) && (N < from || N > to);
+               TESTP( N == rmap.root->range[i].from, "from:%d to:%d N:%d != [%d]:%d", from, to, N, i, rmap.root->range[i].from);
+               TEST( N == rmap.root->range[i].to);
+               TEST( 0 == rmap.root->range[i].multistate.size);
+            }
+            // no overflow to adjacent block
+            for (unsigned i = 0; i < lengthof(addr); ++i) {
+               TEST( ENDMARKER == *(void**)addr[i]);
+            }
+            // reset
+            reset_automatmman(mman);
+         }
+      }
+   }
+
+   // TEST addrange_rangemap: insert range fully overlapping with one or more ranges
+   for (unsigned from = 0; from < rangemap_NROFRANGE; ++from) {
+      for (unsigned to = from; to < rangemap_NROFRANGE; ++to) {
+         const unsigned S = rangemap_NROFRANGE;
+         // prepare
+         void * addr[2];
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+         *(void**)addr[0] = ENDMARKER;
+         rmap = (rangemap_t) rangemap_INIT;
+         for (unsigned i = 0; i < rangemap_NROFRANGE; ++i) {
+            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(4*i), (char32_t)(3+4*i)));
+         }
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+         *(void**)addr[1] = ENDMARKER;
+         // test
+         TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(4*from), (char32_t)(4*to+3)));
+         // check mman: unchanged
+         TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
+         // check rmap: unchanged
+         TEST( rmap.size == S);
+         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
+         // check mst.root content: unchanged
+         TEST( 0 == rmap.root->level);
+         TEST( S == rmap.root->size);
+         TEST( 0 == rmap.root->next);
+         for (unsigned i = 0; i < S; ++i) {
+            TEST( 4*i   == rmap.root->range[i].from);
+            TEST( 4*i+3 == rmap.root->range[i].to);
+            TEST( 0 == rmap.root->range[i].multistate.size);
+         }
+         // no overflow to adjacent block
+         for (size_t i = 0; i < lengthof(addr); ++i) {
+            TEST( ENDMARKER == *(void**)addr[i]);
+         }
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST addrange_rangemap: insert range partially overlapping with one or more ranges
+   for (unsigned from = 0; from < 3*4; ++from) {
+      for (unsigned to = from; to < 3*4; ++to) {
+         const unsigned S = 3u + (0 != from % 4) + (3 != to % 4);
+         // prepare
+         void * addr[2];
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[0]));
+         *(void**)addr[0] = ENDMARKER;
+         rmap = (rangemap_t) rangemap_INIT;
+         for (unsigned i = 0; i < 3; ++i) {
+            TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)(4*i), (char32_t)(3+4*i)));
+         }
+         TEST(0 == malloc_automatmman(mman, sizeof(void*), &addr[1]));
+         *(void**)addr[1] = ENDMARKER;
+         // test
+         TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)from, (char32_t)to));
+         // check mman: unchanged
+         TEST( 2*sizeof(void*) + sizeof(rangemap_node_t) == sizeallocated_automatmman(mman));
+         // check rmap: unchanged
+         TEST( rmap.size == S);
+         TEST( rmap.root == (rangemap_node_t*)((uint8_t*)addr[0] + sizeof(void*)));
+         // check mst.root content: unchanged
+         TEST( 0 == rmap.root->level);
+         TEST( S == rmap.root->size);
+         TEST( 0 == rmap.root->next);
+         for (unsigned i = 0, f = 0, next_t = 3, t; i < S; ++i, f = t+1, next_t += (t == next_t)?4:0) {
+            t = (f < from && from <= next_t) ? from-1 : (f <= to && to < next_t) ? to : next_t;
+            TEST( f == rmap.root->range[i].from);
+            TEST( t == rmap.root->range[i].to);
+            TEST( 0 == rmap.root->range[i].multistate.size);
+         }
+         // no overflow to adjacent block
+         for (size_t i = 0; i < lengthof(addr); ++i) {
+            TEST( ENDMARKER == *(void**)addr[i]);
+         }
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // TEST addrange_rangemap: insert overlapping range in tree with root->level > 0
+   for (unsigned level = 1; level <= 4; ++level) {
+      // range 0..8 overlaps 3..5
+      unsigned const S = 1u<<(2*level);
+      unsigned from[256];
+      unsigned to[256];
+      for (unsigned i = 0; i < S; ++i) {
+         from[i] = 3 + 9*i;
+         to[i]   = 5 + 9*i;
+      }
+      rangemap_node_t * child = 0;
+      TEST(0 == build_rangemap(&rmap, mman, level, from, to, 9, &child));
+      void * const root = rmap.root;
+      size_t const MMSIZE = sizeallocated_automatmman(mman);
+      TEST(S == rmap.size);
+      // test
+      TEST( 0 == addrange_rangemap(&rmap, mman, (char32_t)0, (char32_t)(S*9-1)));
+      // check mman: unchanged
+      TEST( MMSIZE == sizeallocated_automatmman(mman));
+      // check rmap
+      TEST( rmap.size == 3/*two additional range per child node*/*S);
+      TEST( rmap.root == root);
+      // check chain of child content
+      for (unsigned c = 0; c < S; ++c, child = child->next) {
+         TEST( 0 != child); // value from child->next
+         TEST( 0 == child->level);
+         TEST( 3 == child->size);
+         for (unsigned i = 0, f = 9*c; i < 3; ++i, f += 3) {
+            TEST( f   == child->range[i].from);
+            TEST( f+2 == child->range[i].to);
+            TEST( 0   == child->range[i].multistate.size);
+         }
+      }
+      TEST( 0 == child);   // value from child->next
+      // reset
+      reset_automatmman(mman);
+   }
+
+   // TEST addrange_rangemap: insert overlapping range in tree with root->level > 0
+   for (unsigned level = 1; level <= 4; ++level) {
+      for (unsigned tc = 1; tc <= 2; ++tc) {
          // range 0..9 overlaps 0..4 or 5..9
          unsigned const S = 1u<<(2*level);
          unsigned from[256];
@@ -5377,317 +8652,697 @@ static int test_statevector(void)
          for (unsigned i = 1; i < (nrstate+2)/3; ++i) {
             blocks[i] = next_stateblocklist(blocks[i-1]); // ignore tc == 0; always fill array
          }
-         TEST(blocks[(nrstate+2)/3-1] == last_stateblocklist(&svec->blocklist));
+         TEST(blocks[(nrstate+2)/3-1] == last_stateblocklist(&svec->blocklist));
+
+         // TEST iscontained_statevector: nrstate != 0
+         for (unsigned i = 0; i < nrstate; ++i) {
+            TEST( 1 == iscontained_statevector(svec, &states[i]));
+            TEST( 0 == iscontained_statevector(svec, (void*)(1+(uint8_t*)&states[i])));
+         }
+
+         // TEST isnrdfa12_statevector
+         for (unsigned nr = 1; nr <= 2; ++nr) {
+            for (unsigned i = 0; i < nrstate; ++i) {
+               states[i].nrdfa = (uint8_t) nr;
+            }
+            for (unsigned pos = 0; pos < nrstate; ++pos) {
+               states[pos].nrdfa = (uint8_t) (3-nr); // (nr==1?2:1)
+               if (nrstate > 1) {
+                  TEST( isnrdfa12_statevector(svec, false) == 1);
+                  TEST( isnrdfa12_statevector(svec, true)  == 1);
+               }
+               states[pos].nrdfa = (uint8_t) nr;
+               TEST( isnrdfa12_statevector(svec, false) == (nr==1));
+               TEST( isnrdfa12_statevector(svec, true)  == 0);
+            }
+         }
+
+         // TEST getkey_statevector: init
+         memset(&key, 255, sizeof(key));
+         init1_getkeydata(&key, &getkey_statevector, svec);
+         // check key
+         TEST( key.addr   == (uint8_t*) first_stateblocklist(&svec->blocklist)->state);
+         TEST( key.offset == 0);
+         TEST( key.endoffset  == (!tc || nrstate < 3 ? nrstate : 3)*sizeof(void*));
+         TEST( key.streamsize == nrstate*sizeof(void*));
+         TEST( key.object   == svec);
+         TEST( key.impl_ptr == first_stateblocklist(&svec->blocklist));
+
+         // TEST getkey_statevector: move up
+         for (size_t offset = 0; offset < nrstate*sizeof(void*); ++offset) {
+            init1_getkeydata(&key, &getkey_statevector, svec);
+            // test
+            getkey_statevector(&key, offset);
+            // check key
+            TEST( key.addr   == (uint8_t*) blocks[!tc?0:offset/(3*sizeof(void*))]->state);
+            TEST( key.offset == (!tc ? 0 : offset - offset % (3*sizeof(void*))));
+            TEST( key.endoffset  == key.offset + (!tc?nrstate:(key.streamsize-key.offset) < 3*sizeof(void*)?nrstate%3:3)*sizeof(void*));
+            TEST( key.streamsize == nrstate*sizeof(void*));
+            TEST( key.object   == svec);
+            TEST( key.impl_ptr == blocks[!tc?0:offset/(3*sizeof(void*))]);
+         }
+
+         // TEST getkey_statevector: move down
+         for (size_t offset = 0; offset < nrstate*sizeof(void*); ++offset) {
+            init1_getkeydata(&key, &getkey_statevector, svec);
+            getkey_statevector(&key, nrstate*sizeof(void*)-1);
+            // test
+            getkey_statevector(&key, offset);
+            // check key
+            TEST( key.addr   == (uint8_t*) blocks[!tc?0:offset/(3*sizeof(void*))]->state);
+            TEST( key.offset == (!tc ? 0 : offset - offset % (3*sizeof(void*))));
+            TEST( key.endoffset  == key.offset + (!tc?nrstate:(key.streamsize-key.offset) < 3*sizeof(void*)?nrstate%3:3)*sizeof(void*));
+            TEST( key.streamsize == nrstate*sizeof(void*));
+            TEST( key.object   == svec);
+            TEST( key.impl_ptr == blocks[!tc?0:offset/(3*sizeof(void*))]);
+         }
+
+         // reset
+         reset_automatmman(mman);
+      }
+   }
+
+   // free resources
+   TEST(0 == delete_automatmman(&mman));
+
+   return 0;
+ONERR:
+   delete_automatmman(&mman);
+   return EINVAL;
+}
+
+static int helper_get_states(automat_t * ndfa, size_t maxsize, /*out*/state_t * states[maxsize])
+{
+   size_t i = 0;
+
+   foreach (_statelist, s, &ndfa->states) {
+      if (i >= maxsize) return ENOMEM;
+      states[i++] = s;
+   }
+
+   return (i == ndfa->nrstate) ? 0 : EINVAL;
+}
+
+typedef enum {
+   state_EMPTY,
+   state_RANGE,
+   state_RANGE_ENDSTATE,
+} state_type_e;
+
+typedef struct {
+   uint8_t type;  // value from state_e
+   uint8_t nrtrans;
+   size_t * target_state;  // [nrtrans]: array of state indizes beginning from 0
+   char32_t * from;        // [nrtrans]: array of from chars describing range transtiions
+   char32_t * to;          // [nrtrans]: array of to chars describing range transtiions
+} helper_state_t;
+
+static void set_readmark(automat_t * ndfa)
+{
+   foreach (_statelist, s, &ndfa->states) {
+      s->dest = s;
+   }
+}
+
+static int check_readmark(automat_t * ndfa)
+{
+   size_t nr = 0;
+   foreach (_statelist, s, &ndfa->states) {
+      TEST(s == s->dest);
+      TEST(nr == s->nr);
+      ++ nr;
+   }
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int helper_compare_states(automat_t * ndfa, size_t nrstate, const helper_state_t helperstate[nrstate])
+{
+   state_t * ndfa_state[258]; // allows indexing of states by number [0..nrstate-1]
+   size_t    allocated = nrstate * state_SIZE;
+
+   TEST(nrstate == ndfa->nrstate);
+   TEST(0 == helper_get_states(ndfa, lengthof(ndfa_state), ndfa_state));
+
+   for (size_t i = 0; i < nrstate; ++i) {
+      TEST(i == ndfa_state[i]->nr);
+      if (helperstate[i].type == state_EMPTY) {
+         allocated += state_SIZE_EMPTYTRANS(helperstate[i].nrtrans);
+         TEST(ndfa_state[i]->nremptytrans == helperstate[i].nrtrans);
+         TEST(ndfa_state[i]->nrrangetrans == 0);
+      } else if (helperstate[i].type == state_RANGE) {
+         allocated += !helperstate[i].nrtrans && !isempty_rangelist(&ndfa_state[i]->rangelist)
+                      ? state_SIZE_RANGETRANS(0) : 0;
+         TEST(ndfa_state[i]->nremptytrans == 0);
+         TEST(ndfa_state[i]->nrrangetrans == helperstate[i].nrtrans);
+      } else { // type == state_RANGE_ENDSTATE
+         allocated += state_SIZE_EMPTYTRANS(1);
+         TEST(ndfa_state[i]->nremptytrans == 1);
+         TEST(ndfa_state[i]->nrrangetrans == helperstate[i].nrtrans);
+      }
+      // check transitions
+      empty_transition_t* empty_trans = first_emptylist(&ndfa_state[i]->emptylist);
+      range_transition_t* range_trans = first_rangelist(&ndfa_state[i]->rangelist);
+      if (helperstate[i].type == state_RANGE_ENDSTATE) {
+         TESTP(ndfa_state[nrstate-1] == empty_trans->state, "expected endstate i:%d", i);
+         TEST(empty_trans == next_emptylist(empty_trans));
+      }
+      size_t s = 0;
+      for (unsigned t = 0; t < helperstate[i].nrtrans; ++t) {
+         const size_t state_idx = helperstate[i].target_state[t];
+         TEST(state_idx < nrstate);
+         if (helperstate[i].type == state_EMPTY) {
+            TESTP(ndfa_state[state_idx] == empty_trans->state, "i:%d", i);
+            empty_trans = next_emptylist(empty_trans);
+         } else {
+            TEST(s < range_trans->size);
+            TEST(ndfa_state[state_idx]  == range_trans->array[s].state);
+            TEST(helperstate[i].from[t] == range_trans->array[s].from);
+            TEST(helperstate[i].to[t]   == range_trans->array[s].to);
+            if ((++s) == range_trans->size) {
+               allocated += state_SIZE_RANGETRANS(s);
+               range_trans = next_rangelist(range_trans);
+               s = 0;
+            }
+         }
+      }
+      // check complete cycle
+      TEST(s == 0);
+      TEST(range_trans == first_rangelist(&ndfa_state[i]->rangelist));
+   }
+
+   TEST(allocated == ndfa->allocated);
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int helper_compare_copy(automat_t *dest_ndfa, automat_t *src_ndfa)
+{
+   void*     end_addr;
+   size_t    nrstates = 0;
+   size_t    allocated = 0;
+   state_t * d = first_statelist(&dest_ndfa->states);
+
+   TEST(0 == malloc_automatmman(dest_ndfa->mman, 0, &end_addr));
+
+   // initcopy only reads src_ndfa ==> set dest of src states
+   TEST(0 == check_readmark(src_ndfa));
+   size_t nr = 0;
+   foreach (_statelist, s, &src_ndfa->states) {
+      TEST(nr == d->nr);
+      s->dest = d;
+      d = next_statelist(d);
+      ++ nr;
+   }
+
+   foreach (_statelist, s, &src_ndfa->states) {
+      TEST(d == (void*) ((uintptr_t)end_addr + allocated - dest_ndfa->allocated));
+      ++ nrstates;
+      TEST(d->nremptytrans == s->nremptytrans);
+      TEST(d->nrrangetrans == s->nrrangetrans);
+      TEST(isempty_slist(&d->emptylist) ==isempty_slist(&s->emptylist));
+      TEST(isempty_slist(&d->rangelist) ==isempty_slist(&s->rangelist));
+      TEST(d == s->dest);
+      allocated += state_SIZE + state_SIZE_EMPTYTRANS(d->nremptytrans);
+      empty_transition_t* d_empty_trans = last_emptylist(&d->emptylist);
+      foreach (_emptylist, s_empty_trans, &s->emptylist) {
+         d_empty_trans = next_emptylist(d_empty_trans);
+         TEST(s_empty_trans->state->dest == d_empty_trans->state);
+      }
+      range_transition_t* d_range_trans = last_rangelist(&d->rangelist);
+      foreach (_rangelist, s_range_trans, &s->rangelist) {
+         d_range_trans = next_rangelist(d_range_trans);
+         allocated += state_SIZE_RANGETRANS(s_range_trans->size);
+         TEST(s_range_trans->size == d_range_trans->size);
+         for (size_t r = 0; r < s_range_trans->size; ++r) {
+            TEST(s_range_trans->array[r].from == d_range_trans->array[r].from);
+            TEST(s_range_trans->array[r].to   == d_range_trans->array[r].to);
+            TEST(s_range_trans->array[r].state->dest == d_range_trans->array[r].state);
+         }
+      }
+      TEST(d_range_trans == last_rangelist(&d->rangelist));
+      d = next_statelist(d);
+   }
+   TEST(d == first_statelist(&dest_ndfa->states));
+   TEST(dest_ndfa->mman != src_ndfa->mman);
+   TEST(allocated == sizeallocated_automatmman(dest_ndfa->mman));
+   TEST(nrstates == src_ndfa->nrstate);
+   TEST(nrstates == dest_ndfa->nrstate);
+   TEST(allocated == src_ndfa->allocated);
+   TEST(allocated == dest_ndfa->allocated);
+   TEST(src_ndfa->isDFA == dest_ndfa->isDFA);
 
-         // TEST iscontained_statevector: nrstate != 0
-         for (unsigned i = 0; i < nrstate; ++i) {
-            TEST( 1 == iscontained_statevector(svec, &states[i]));
-            TEST( 0 == iscontained_statevector(svec, (void*)(1+(uint8_t*)&states[i])));
-         }
+   return 0;
+ONERR:
+   return EINVAL;
+}
 
-         // TEST isnrdfa12_statevector
-         for (unsigned nr = 1; nr <= 2; ++nr) {
-            for (unsigned i = 0; i < nrstate; ++i) {
-               states[i].nrdfa = (uint8_t) nr;
-            }
-            for (unsigned pos = 0; pos < nrstate; ++pos) {
-               states[pos].nrdfa = (uint8_t) (3-nr); // (nr==1?2:1)
-               if (nrstate > 1) {
-                  TEST( isnrdfa12_statevector(svec, false) == 1);
-                  TEST( isnrdfa12_statevector(svec, true)  == 1);
-               }
-               states[pos].nrdfa = (uint8_t) nr;
-               TEST( isnrdfa12_statevector(svec, false) == (nr==1));
-               TEST( isnrdfa12_statevector(svec, true)  == 0);
-            }
-         }
+static int helper_compare_reverse(automat_t* dest_ndfa, automat_t* src_ndfa, automat_t* use_mman)
+{
+   void*  end_addr;
+   size_t nrstates = 0;
+   size_t allocated = 0;
 
-         // TEST getkey_statevector: init
-         memset(&key, 255, sizeof(key));
-         init1_getkeydata(&key, &getkey_statevector, svec);
-         // check key
-         TEST( key.addr   == (uint8_t*) first_stateblocklist(&svec->blocklist)->state);
-         TEST( key.offset == 0);
-         TEST( key.endoffset  == (!tc || nrstate < 3 ? nrstate : 3)*sizeof(void*));
-         TEST( key.streamsize == nrstate*sizeof(void*));
-         TEST( key.object   == svec);
-         TEST( key.impl_ptr == first_stateblocklist(&svec->blocklist));
+   TEST(0 == malloc_automatmman(dest_ndfa->mman, 0, &end_addr));
 
-         // TEST getkey_statevector: move up
-         for (size_t offset = 0; offset < nrstate*sizeof(void*); ++offset) {
-            init1_getkeydata(&key, &getkey_statevector, svec);
-            // test
-            getkey_statevector(&key, offset);
-            // check key
-            TEST( key.addr   == (uint8_t*) blocks[!tc?0:offset/(3*sizeof(void*))]->state);
-            TEST( key.offset == (!tc ? 0 : offset - offset % (3*sizeof(void*))));
-            TEST( key.endoffset  == key.offset + (!tc?nrstate:(key.streamsize-key.offset) < 3*sizeof(void*)?nrstate%3:3)*sizeof(void*));
-            TEST( key.streamsize == nrstate*sizeof(void*));
-            TEST( key.object   == svec);
-            TEST( key.impl_ptr == blocks[!tc?0:offset/(3*sizeof(void*))]);
+   // check mman
+   if (use_mman) {
+      TEST(dest_ndfa->mman == use_mman->mman);
+      TEST(refcount_automatmman(dest_ndfa->mman) >= 2);
+      TEST(dest_ndfa->allocated <= sizeallocated_automatmman(dest_ndfa->mman));
+   } else {
+      TEST(dest_ndfa->mman != src_ndfa->mman);
+      TEST(refcount_automatmman(dest_ndfa->mman) == 1);
+      TEST(dest_ndfa->allocated == sizeallocated_automatmman(dest_ndfa->mman));
+   }
+   void* start_addr = (void*) ((uintptr_t)end_addr - dest_ndfa->allocated);
+   // initreverse only reads src_ndfa ==> compute dest from allocation order
+   TEST(0 == check_readmark(src_ndfa));
+   size_t nr = 0;
+   foreach (_statelist, s, &src_ndfa->states) {
+      s->dest = (state_t*) ((uintptr_t)start_addr + nr * state_SIZE);
+      ++ nr;
+   }
+   // start and end state swapped
+   state_t *dstart, *sstart, *dend, *send;
+   startend_automat(dest_ndfa, &dstart, &dend);
+   startend_automat(src_ndfa, &sstart, &send);
+   TEST(dstart == send->dest);
+   TEST(dend   == sstart->dest);
+   // contains empty self trans as last entry
+   TEST(dend->nremptytrans > 0);
+   TEST(dend == last_emptylist(&dend->emptylist)->state);
+   // check allocation order of states of dest_ndfa and calculate size of memory
+   void* trans_addr = (void*) ((uintptr_t)start_addr + dest_ndfa->nrstate * state_SIZE);
+   foreach (_statelist, d, &dest_ndfa->states) {
+      d->dest = 0; // set to defined value (unset in initreverse)
+      nrstates  += 1;
+      allocated += state_SIZE + state_SIZE_EMPTYTRANS(d->nremptytrans) + d->nrrangetrans * state_SIZE_RANGETRANS(1);
+      TEST( d == (void*) ((uintptr_t)trans_addr - nrstates * state_SIZE));
+      size_t trans_count = 0;
+      foreach (_emptylist, trans, &d->emptylist) {
+         ++trans_count;
+         TEST(trans_addr <= (void*)trans && (void*)trans < end_addr);
+         TEST(start_addr <= (void*)trans->state && (void*)trans->state < trans_addr);
+         TEST(((uintptr_t)trans->state - (uintptr_t)start_addr) % state_SIZE == 0);
+      }
+      TEST(trans_count == d->nremptytrans);
+      trans_count = 0;
+      foreach (_rangelist, trans, &d->rangelist) {
+         ++trans_count;
+         TEST(trans->size == 1);
+         TEST(trans_addr <= (void*)trans && (void*)&trans->array[1] <= end_addr);
+         TEST(start_addr <= (void*)trans->array[0].state && (void*)trans->array[0].state < trans_addr);
+         TEST(((uintptr_t)trans->array[0].state - (uintptr_t)start_addr) % state_SIZE == 0);
+      }
+      TEST(trans_count == d->nrrangetrans);
+   }
+   // check size of memory
+   TEST(nrstates == src_ndfa->nrstate);
+   TEST(nrstates == dest_ndfa->nrstate);
+   TEST(allocated  > src_ndfa->allocated);
+   TEST(allocated == dest_ndfa->allocated);
+   TEST(0         == dest_ndfa->isDFA);
+   // check src_state->dest is ok
+   size_t statenr = 0;
+   foreach (_statelist, s, &src_ndfa->states) {
+      TEST( s->dest == (void*) ((uintptr_t)start_addr + statenr * state_SIZE));
+      statenr ++;
+      s->dest->dest = s; // set back pointer
+   }
+   // check every transition in src is in dest
+   foreach (_statelist, s, &src_ndfa->states) {
+      foreach (_emptylist, trans, &s->emptylist) {
+         state_t* d = trans->state->dest;
+         size_t found = 0;
+         foreach (_emptylist, dtrans, &d->emptylist) {
+            found += (dtrans->state->dest == s);
          }
-
-         // TEST getkey_statevector: move down
-         for (size_t offset = 0; offset < nrstate*sizeof(void*); ++offset) {
-            init1_getkeydata(&key, &getkey_statevector, svec);
-            getkey_statevector(&key, nrstate*sizeof(void*)-1);
-            // test
-            getkey_statevector(&key, offset);
-            // check key
-            TEST( key.addr   == (uint8_t*) blocks[!tc?0:offset/(3*sizeof(void*))]->state);
-            TEST( key.offset == (!tc ? 0 : offset - offset % (3*sizeof(void*))));
-            TEST( key.endoffset  == key.offset + (!tc?nrstate:(key.streamsize-key.offset) < 3*sizeof(void*)?nrstate%3:3)*sizeof(void*));
-            TEST( key.streamsize == nrstate*sizeof(void*));
-            TEST( key.object   == svec);
-            TEST( key.impl_ptr == blocks[!tc?0:offset/(3*sizeof(void*))]);
+         TEST( 1 <= found);
+      }
+      foreach (_rangelist, trans, &s->rangelist) {
+         for (size_t r = 0; r < trans->size; ++r) {
+            state_t* d = trans->array[r].state->dest;
+            size_t found = 0;
+            foreach (_rangelist, dtrans, &d->rangelist) {
+               found += (dtrans->array[0].state->dest == s && dtrans->array[0].from == trans->array[r].from && dtrans->array[0].to == trans->array[r].to);
+            }
+            TEST( 1 <= found);
          }
-
-         // reset
-         reset_automatmman(mman);
       }
    }
 
-   // free resources
-   TEST(0 == delete_automatmman(&mman));
-
    return 0;
 ONERR:
-   delete_automatmman(&mman);
    return EINVAL;
 }
 
-static int helper_get_states(automat_t * ndfa, size_t maxsize, /*out*/state_t * states[maxsize])
+static int test_initfree(void)
 {
-   size_t i = 0;
+   automat_t      ndfa  = automat_FREE;
+   automat_t      ndfa1 = automat_FREE;
+   automat_t      ndfa2 = automat_FREE;
+   size_t         S;
+   automat_mman_t*mman = 0;
+   automat_mman_t*mman2 = 0;
+   automat_t      use_mman = automat_FREE;
+   automat_t      use_mman2 = automat_FREE;
+   char32_t       from[256];
+   char32_t       to[256];
+   helper_state_t helperstate[10];
+   size_t         target_state[256];
 
-   foreach (_statelist, s, &ndfa->states) {
-      if (i >= maxsize) return ENOMEM;
-      states[i++] = s;
+   // prepare
+   TEST(0 == new_automatmman(&mman));
+   TEST(0 == new_automatmman(&mman2));
+   use_mman.mman  = mman;
+   use_mman2.mman = mman2;
+   incruse_automatmman(mman);
+   incruse_automatmman(mman2);
+   for (size_t i = 0; i < lengthof(target_state); ++i) {
+      target_state[i] = 1;
+   }
+   for (size_t i = 0; i < lengthof(from); ++i) {
+      from[i] = i;
+      to[i]   = 3*i;
    }
 
-   return (i == ndfa->nrstate) ? 0 : EINVAL;
-}
-
-typedef enum {
-   state_EMPTY,
-   state_RANGE,
-   state_RANGE_ENDSTATE,
-} state_type_e;
+   // TEST automat_FREE
+   TEST( 0 == ndfa.mman);
+   TEST( 0 == ndfa.nrstate);
+   TEST( 0 == ndfa.allocated);
+   TEST( 1 == isempty_slist(&ndfa.states));
+   TEST( 0 == ndfa.isDFA);
 
-typedef struct {
-   uint8_t type;  // value from state_e
-   uint8_t nrtrans;
-   size_t * target_state;  // [nrtrans]: array of state indizes beginning from 0
-   char32_t * from;        // [nrtrans]: array of from chars describing range transtiions
-   char32_t * to;          // [nrtrans]: array of to chars describing range transtiions
-} helper_state_t;
+   for (size_t i = 0; i < 256; ++i) {
+      for (unsigned tc = 0; tc <= 1; ++tc) {
+         size_t const SIZE_PAGE = SIZEALLOCATED_PAGECACHE();
 
-static int helper_compare_states(automat_t * ndfa, size_t nrstate, const helper_state_t helperstate[nrstate])
-{
-   state_t * ndfa_state[258]; // allows indexing of states by number [0..nrstate-1]
-   size_t    allocated = nrstate * state_SIZE;
+         // TEST initmatch_automat
+         TESTP( 0 == initmatch_automat(&ndfa, tc ? &use_mman : 0, (uint8_t) i, from, to), "i:%zd", i);
+         automat_mman_t * mm = ndfa.mman;
+         TEST( 0 != mm);
+         // check mman
+         TEST( (1+tc) == refcount_automatmman(mm));
+         S = 2*sizeof(state_t) + sizeof(empty_transition_t) + i*sizeof(rangestate_t)+sizeof(range_transition_t);
+         TEST( S == sizeallocated_automatmman(mm));
+         // check ndfa
+         TEST( ndfa.mman      == (tc ? mman : mm));
+         TEST( ndfa.nrstate   == 2);
+         TEST( ndfa.allocated == S);
+         TEST( ! isempty_slist(&ndfa.states));
+         TEST( ndfa.isDFA     == 0);
+         // check ndfa.states
+         helperstate[0] = (helper_state_t) { state_RANGE, (uint8_t) i, target_state, from, to };
+         helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+         TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
 
-   TEST(nrstate == ndfa->nrstate);
-   TEST(0 == helper_get_states(ndfa, lengthof(ndfa_state), ndfa_state));
+         // TEST free_automat: free and double free
+         // prepare
+         if (mm != mman) incruse_automatmman(mm);
+         for (unsigned r = 0; r <= 1; ++r) {
+            // test
+            TEST( 0 == free_automat(&ndfa));
+            // check mman
+            TEST( refcount_automatmman(mm) == 1);
+            TEST( sizeallocated_automatmman(mm) == S);
+            TEST( wasted_automatmman(mm) == S);
+            // check ndfa
+            TEST( ndfa.mman    == 0);
+            TEST( ndfa.nrstate == 0);
+            TEST( ndfa.allocated == 0);
+            TEST( isempty_slist(&ndfa.states));
+         }
 
-   for (size_t i = 0; i < nrstate; ++i) {
-      if (helperstate[i].type == state_EMPTY) {
-         allocated += state_SIZE_EMPTYTRANS(helperstate[i].nrtrans);
-         TEST(ndfa_state[i]->nremptytrans == helperstate[i].nrtrans);
-         TEST(ndfa_state[i]->nrrangetrans == 0);
-      } else if (helperstate[i].type == state_RANGE) {
-         allocated += !helperstate[i].nrtrans && !isempty_rangelist(&ndfa_state[i]->rangelist)
-                      ? state_SIZE_RANGETRANS(0) : 0;
-         TEST(ndfa_state[i]->nremptytrans == 0);
-         TEST(ndfa_state[i]->nrrangetrans == helperstate[i].nrtrans);
-      } else { // type == state_RANGE_ENDSTATE
-         allocated += state_SIZE_EMPTYTRANS(1);
-         TEST(ndfa_state[i]->nremptytrans == 1);
-         TEST(ndfa_state[i]->nrrangetrans == helperstate[i].nrtrans);
-      }
-      // check transitions
-      empty_transition_t* empty_trans = first_emptylist(&ndfa_state[i]->emptylist);
-      range_transition_t* range_trans = first_rangelist(&ndfa_state[i]->rangelist);
-      if (helperstate[i].type == state_RANGE_ENDSTATE) {
-         TESTP(ndfa_state[nrstate-1] == empty_trans->state, "expected endstate i:%d", i);
-         TEST(empty_trans == next_emptylist(empty_trans));
-      }
-      size_t s = 0;
-      for (unsigned t = 0; t < helperstate[i].nrtrans; ++t) {
-         const size_t state_idx = helperstate[i].target_state[t];
-         TEST(state_idx < nrstate);
-         if (helperstate[i].type == state_EMPTY) {
-            TESTP(ndfa_state[state_idx] == empty_trans->state, "i:%d", i);
-            empty_trans = next_emptylist(empty_trans);
-         } else {
-            TEST(s < range_trans->size);
-            TEST(ndfa_state[state_idx]  == range_trans->array[s].state);
-            TEST(helperstate[i].from[t] == range_trans->array[s].from);
-            TEST(helperstate[i].to[t]   == range_trans->array[s].to);
-            if ((++s) == range_trans->size) {
-               allocated += state_SIZE_RANGETRANS(s);
-               range_trans = next_rangelist(range_trans);
-               s = 0;
-            }
+         if (mm != mman) {
+            // TEST free_automat: free deletes memory manager if refcount == 0
+            ndfa.mman = mm;
+            // test
+            TEST( 0 == free_automat(&ndfa));
+            // check ndfa
+            TEST( 0 == ndfa.mman);
+            // check env (mm freed)
+            TEST( SIZE_PAGE == SIZEALLOCATED_PAGECACHE());
          }
+         // reset
+         reset_automatmman(mman);
       }
-      // check complete cycle
-      TEST(s == 0);
-      TEST(range_trans == first_rangelist(&ndfa_state[i]->rangelist));
    }
 
-   TEST(allocated == ndfa->allocated);
+   // TEST free_automat: simulated ERROR
+   decruse_automatmman(mman);
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      size_t const SIZE_PAGE = SIZEALLOCATED_PAGECACHE();
+      TEST( 0 == initmatch_automat(&ndfa, tc ? &use_mman : 0, 3, from, to));
+      automat_mman_t * mm = ndfa.mman;
+      // test
+      init_testerrortimer(&s_automat_errtimer, 1u, EINVAL);
+      TEST( EINVAL == free_automat(&ndfa));
+      // check env
+      TEST( 0 == refcount_automatmman(mm));
+      if (mm != mman) TEST(0 == delete_automatmman(&mm))/*simulated error prevented deletion*/;
+      TEST( SIZE_PAGE == SIZEALLOCATED_PAGECACHE());
+      // check ndfa
+      TEST( ndfa.mman      == 0);
+      TEST( ndfa.nrstate   == 0);
+      TEST( ndfa.allocated == 0);
+      TEST( isempty_slist(&ndfa.states));
+   }
+   // reset
+   incruse_automatmman(mman);
 
-   return 0;
-ONERR:
-   return EINVAL;
-}
+   // TEST initempty_automat
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      // test
+      TEST( 0 == initempty_automat(&ndfa, tc ? &use_mman : 0));
+      automat_mman_t * mm = ndfa.mman;
+      TEST( 0 != mm);
+      // check mman
+      TEST( (1+tc) == refcount_automatmman(mm));
+      S = 2*sizeof(state_t) + 2*sizeof(empty_transition_t);
+      TEST( S == sizeallocated_automatmman(mm));
+      // check ndfa
+      TEST( ndfa.mman      == (tc ? mman : mm));
+      TEST( ndfa.nrstate   == 2);
+      TEST( ndfa.allocated == S);
+      TEST( ! isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == 0);
+      // check ndfa.states
+      helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
+      // reset
+      TEST( 0 == free_automat(&ndfa));
+      reset_automatmman(mman);
+   }
 
-static int helper_compare_copy(automat_t *dest_ndfa, automat_t *src_ndfa)
-{
-   void*     end_addr;
-   size_t    nrstates = 0;
-   size_t    allocated = 0;
-   state_t * d = first_statelist(&dest_ndfa->states);
+   // === simulated ERROR
 
-   TEST(0 == malloc_automatmman(dest_ndfa->mman, 0, &end_addr));
+   TEST(0 == initempty_automat(&ndfa2, &use_mman2));
+   for (unsigned tc = 0; tc <= 8; ++tc) {
+      // prepare
+      int err = (int) (tc+4);
+      S = sizeallocated_automatmman(mman);
+      init_testerrortimer(&s_automat_errtimer, 1, (int) err);
+      switch (tc) {
+      case 0:  // TEST initmatch_automat: simulated ERROR
+               TEST( err == initempty_automat(&ndfa, &use_mman));
+               break;
+      case 1:  // TEST initmatch_automat: simulated ERROR
+               TEST( err == initempty_automat(&ndfa, 0));
+               break;
+      case 2:  // TEST initmatch_automat: simulated ERROR
+               TEST( err == initmatch_automat(&ndfa, &use_mman, 1, from, to));
+               break;
+      case 3:  // TEST initmatch_automat: simulated ERROR
+               TEST( err == initmatch_automat(&ndfa, 0, 1, from, to));
+               break;
+      case 4:  // TEST initcopy_automat: simulated ERROR
+               TEST( err == initcopy_automat(&ndfa, &ndfa2, &use_mman));
+               break;
+      case 5:  // TEST initcopy_automat: simulated ERROR
+               TEST( err == initcopy_automat(&ndfa, &ndfa2, 0));
+               break;
+      case 6:  // TEST initreverse_automat: simulated ERROR
+               TEST( err == initreverse_automat(&ndfa, &ndfa2, &use_mman));
+               break;
+      case 7:  // TEST initreverse_automat: simulated ERROR
+               TEST( err == initreverse_automat(&ndfa, &ndfa2, 0));
+               break;
+      case 8:  // TEST initreverse_automat: EINVAL
+               free_testerrortimer(&s_automat_errtimer);
+               TEST( EINVAL == initreverse_automat(&ndfa, &ndfa, 0));
+               break;
+      }
+      // check ndfa
+      TEST( ndfa.mman      == 0);
+      TEST( ndfa.nrstate   == 0);
+      TEST( ndfa.allocated == 0);
+      TEST( isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == 0);
+      // check mman
+      TEST( 0 == wasted_automatmman(mman));
+      TEST( S == sizeallocated_automatmman(mman));
+      TEST( 1 == refcount_automatmman(mman));
+      // reset
+      reset_automatmman(mman);
+   }
+   TEST(0 == free_automat(&ndfa2));
 
-   foreach (_statelist, s, &src_ndfa->states) {
-      TEST(d == (void*) ((uintptr_t)end_addr + allocated - dest_ndfa->allocated));
-      ++ nrstates;
-      TEST(d->nremptytrans == s->nremptytrans);
-      TEST(d->nrrangetrans == s->nrrangetrans);
-      TEST(isempty_slist(&d->emptylist) ==isempty_slist(&s->emptylist));
-      TEST(isempty_slist(&d->rangelist) ==isempty_slist(&s->rangelist));
-      TEST(d == s->dest);
-      allocated += state_SIZE + state_SIZE_EMPTYTRANS(d->nremptytrans);
-      empty_transition_t* d_empty_trans = last_emptylist(&d->emptylist);
-      foreach (_emptylist, s_empty_trans, &s->emptylist) {
-         d_empty_trans = next_emptylist(d_empty_trans);
-         TEST(s_empty_trans->state->dest == d_empty_trans->state);
+   // TEST initmove_automat
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 3000 } ));
+      ndfa1.isDFA = (tc != 0);
+      // test
+      S = sizeallocated_automatmman(mman);
+      initmove_automat(&ndfa, &ndfa1);
+      // check mman
+      TEST( 2 == refcount_automatmman(mman));
+      TEST( S == sizeallocated_automatmman(mman));
+      // check ndfa1
+      TEST( isfree_automat(&ndfa1));
+      // check ndfa
+      TEST( ndfa.mman      == mman);
+      TEST( ndfa.nrstate   == 2);
+      TEST( ndfa.allocated == S);
+      TEST( ! isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == (tc != 0));
+      // check ndfa.states
+      helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 1 }, (char32_t[]) { 3000 } };
+      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
+      // reset
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
+   }
+
+   // TEST initcopy_automat
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 11 } ));
+   for (unsigned i = 1; i <= 3; ++i) {
+      TEST(0 == extendmatch_automat(&ndfa, (uint8_t)i, (char32_t[]) { 2, 3, 4 }, (char32_t[]) { 12, 13, 14 } ));
+   }
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]) { 5 }, (char32_t[]) { 15 } ));
+   for (unsigned i = 1; i <= 3; ++i) {
+      TEST(0 == extendmatch_automat(&ndfa2, (uint8_t)i, (char32_t[]) { 6, 7, 8 }, (char32_t[]) { 16, 17, 18 } ));
+   }
+   TEST(0 == opor_automat(&ndfa, &ndfa2));
+   S = sizeallocated_automatmman(ndfa.mman);
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      const size_t SIZE_PAGE = SIZEALLOCATED_PAGECACHE();
+      // test
+      ndfa.isDFA = (tc != 0);
+      set_readmark(&ndfa);
+      TEST(0 == initcopy_automat(&ndfa2, &ndfa, tc ? &use_mman2 : 0));
+      // check env
+      if (!tc) {
+         TEST( SIZE_PAGE < SIZEALLOCATED_PAGECACHE());
       }
-      range_transition_t* d_range_trans = last_rangelist(&d->rangelist);
-      foreach (_rangelist, s_range_trans, &s->rangelist) {
-         d_range_trans = next_rangelist(d_range_trans);
-         allocated += state_SIZE_RANGETRANS(s_range_trans->size);
-         TEST(s_range_trans->size == d_range_trans->size);
-         for (size_t r = 0; r < s_range_trans->size; ++r) {
-            TEST(s_range_trans->array[r].from == d_range_trans->array[r].from);
-            TEST(s_range_trans->array[r].to   == d_range_trans->array[r].to);
-            TEST(s_range_trans->array[r].state->dest == d_range_trans->array[r].state);
-         }
+      // check ndfa
+      TEST( S == sizeallocated_automatmman(ndfa.mman));
+      // check ndfa2
+      TEST( ndfa2.mman == (tc ? mman2 : ndfa2.mman));
+      TEST( helper_compare_copy(&ndfa2, &ndfa) == 0);
+      TEST( refcount_automatmman(ndfa2.mman)   == (1+tc));
+      helperstate[0] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1, 3 }, 0, 0 }; // ndfa
+      // ndfa1
+      helperstate[1] = (helper_state_t) { state_RANGE, 7, (size_t[]) { 2,2,2,2,2,2,2 }, (char32_t[]) { 1, 2, 2, 3, 2, 3, 4 }, (char32_t[]) { 11, 12, 12, 13, 12, 13, 14 } };
+      helperstate[2] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+      // ndfa2
+      helperstate[3] = (helper_state_t) { state_RANGE, 7, (size_t[]) { 4,4,4,4,4,4,4 }, (char32_t[]) { 5, 6, 6, 7, 6, 7, 8 }, (char32_t[]) { 15, 16, 16, 17, 16, 17, 18 } };
+      helperstate[4] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+      helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 }; // ndfa
+      TEST( 0 == helper_compare_states(&ndfa2, 6, helperstate))
+      // reset
+      TEST(0 == free_automat(&ndfa2));
+      reset_automatmman(mman2);
+      TEST(SIZE_PAGE == SIZEALLOCATED_PAGECACHE());
+   }
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
+
+   // TEST initreverse_automat: empty automat
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      TEST(0 == initempty_automat(&ndfa, &use_mman));
+      // test
+      ndfa.isDFA = 1;
+      set_readmark(&ndfa);
+      TEST( 0 == initreverse_automat(&ndfa2, &ndfa, tc ? &use_mman : 0));
+      // check ndfa2
+      TEST( 0 == helper_compare_reverse(&ndfa2, &ndfa, tc ? &use_mman : 0));
+      helperstate[0] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1, 0 }, 0, 0 }; // start state contains empty self trans of former end state
+      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };    // added empty self trans to end state
+      TEST( 0 == helper_compare_states(&ndfa2, 2, helperstate))
+      // reset
+      TEST(0 == free_automat(&ndfa2));
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
+   }
+
+   // TEST initreverse_automat: more complex automat
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
+      for (unsigned i = 1; i < 10; ++i) {
+         TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]) { 3*i }, (char32_t[]) { 4*i } ));
+         TEST(0 == opor_automat(&ndfa, &ndfa2));
+         TEST(0 == oprepeat_automat(&ndfa, 0));
       }
-      TEST(d_range_trans == last_rangelist(&d->rangelist));
-      d = next_statelist(d);
+      // test
+      ndfa.isDFA = 1;
+      set_readmark(&ndfa);
+      TEST( 0 == initreverse_automat(&ndfa2, &ndfa, tc ? &use_mman : 0));
+      // check ndfa2
+      TEST( 0 == helper_compare_reverse(&ndfa2, &ndfa, tc ? &use_mman : 0));
+      // reset
+      TEST(0 == free_automat(&ndfa2));
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
    }
-   TEST(d == first_statelist(&dest_ndfa->states));
-   TEST(dest_ndfa->mman != src_ndfa->mman);
-   TEST(allocated == sizeallocated_automatmman(dest_ndfa->mman));
-   TEST(nrstates == src_ndfa->nrstate);
-   TEST(nrstates == dest_ndfa->nrstate);
-   TEST(allocated == src_ndfa->allocated);
-   TEST(allocated == dest_ndfa->allocated);
-   TEST(src_ndfa->isDFA == dest_ndfa->isDFA);
+
+   // reset
+   TEST(0 == delete_automatmman(&mman));
+   TEST(0 == delete_automatmman(&mman2));
 
    return 0;
 ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa1);
+   free_automat(&ndfa2);
+   delete_automatmman(&mman);
+   delete_automatmman(&mman2);
    return EINVAL;
 }
 
-static int helper_compare_reverse(automat_t* dest_ndfa, automat_t* src_ndfa, automat_t* use_mman)
+static int check_dfa_endstate(automat_t* ndfa, /*out*/void** end_addr2)
 {
-   void*  end_addr;
-   size_t nrstates = 0;
-   size_t allocated = 0;
+   state_t* start_state;
+   state_t* end_state;
+   void*    end_addr;
 
-   TEST(0 == malloc_automatmman(dest_ndfa->mman, 0, &end_addr));
+   TEST( 1 == refcount_automatmman(ndfa->mman));
+   TEST( 0 == malloc_automatmman(ndfa->mman, 0, &end_addr));
+   startend_automat(ndfa, &start_state, &end_state);
 
-   // check mman
-   if (use_mman) {
-      TEST(dest_ndfa->mman == use_mman->mman);
-      TEST(refcount_automatmman(dest_ndfa->mman) >= 2);
-      TEST(dest_ndfa->allocated <= sizeallocated_automatmman(dest_ndfa->mman));
-   } else {
-      TEST(dest_ndfa->mman != src_ndfa->mman);
-      TEST(refcount_automatmman(dest_ndfa->mman) == 1);
-      TEST(dest_ndfa->allocated == sizeallocated_automatmman(dest_ndfa->mman));
-   }
-   // start and end state swapped
-   state_t *dstart, *sstart, *dend, *send;
-   startend_automat(dest_ndfa, &dstart, &dend);
-   startend_automat(src_ndfa, &sstart, &send);
-   TEST(dstart == send->dest);
-   TEST(dend   == sstart->dest);
-   // contains empty self trans as last entry
-   TEST(dend->nremptytrans > 0);
-   TEST(dend == last_emptylist(&dend->emptylist)->state);
-   // check allocation order of states of dest_ndfa and calculate size of memory
-   void* start_addr = (void*) ((uintptr_t)end_addr - dest_ndfa->allocated);
-   void* trans_addr = (void*) ((uintptr_t)start_addr + dest_ndfa->nrstate * state_SIZE);
-   foreach (_statelist, d, &dest_ndfa->states) {
-      d->dest = 0; // set to defined value (unset in initreverse)
-      nrstates  += 1;
-      allocated += state_SIZE + state_SIZE_EMPTYTRANS(d->nremptytrans) + d->nrrangetrans * state_SIZE_RANGETRANS(1);
-      TEST( d == (void*) ((uintptr_t)trans_addr - nrstates * state_SIZE));
-      size_t trans_count = 0;
-      foreach (_emptylist, trans, &d->emptylist) {
-         ++trans_count;
-         TEST(trans_addr <= (void*)trans && (void*)trans < end_addr);
-         TEST(start_addr <= (void*)trans->state && (void*)trans->state < trans_addr);
-         TEST(((uintptr_t)trans->state - (uintptr_t)start_addr) % state_SIZE == 0);
-      }
-      TEST(trans_count == d->nremptytrans);
-      trans_count = 0;
-      foreach (_rangelist, trans, &d->rangelist) {
-         ++trans_count;
-         TEST(trans->size == 1);
-         TEST(trans_addr <= (void*)trans && (void*)&trans->array[1] <= end_addr);
-         TEST(start_addr <= (void*)trans->array[0].state && (void*)trans->array[0].state < trans_addr);
-         TEST(((uintptr_t)trans->array[0].state - (uintptr_t)start_addr) % state_SIZE == 0);
-      }
-      TEST(trans_count == d->nrrangetrans);
-   }
-   // check size of memory
-   TEST(nrstates == src_ndfa->nrstate);
-   TEST(nrstates == dest_ndfa->nrstate);
-   TEST(allocated  > src_ndfa->allocated);
-   TEST(allocated == dest_ndfa->allocated);
-   TEST(0         == dest_ndfa->isDFA);
-   // check src_state->dest is ok
-   size_t statenr = 0;
-   foreach (_statelist, s, &src_ndfa->states) {
-      TEST( s->dest == (void*) ((uintptr_t)start_addr + statenr * state_SIZE));
-      statenr ++;
-      s->dest->dest = s; // set back pointer
-   }
-   // check every transition in src is in dest
-   foreach (_statelist, s, &src_ndfa->states) {
-      foreach (_emptylist, trans, &s->emptylist) {
-         state_t* d = trans->state->dest;
-         size_t found = 0;
-         foreach (_emptylist, dtrans, &d->emptylist) {
-            found += (dtrans->state->dest == s);
-         }
-         TEST( 1 <= found);
-      }
-      foreach (_rangelist, trans, &s->rangelist) {
-         for (size_t r = 0; r < trans->size; ++r) {
-            state_t* d = trans->array[r].state->dest;
-            size_t found = 0;
-            foreach (_rangelist, dtrans, &d->rangelist) {
-               found += (dtrans->array[0].state->dest == s && dtrans->array[0].from == trans->array[r].from && dtrans->array[0].to == trans->array[r].to);
-            }
-            TEST( 1 <= found);
-         }
-      }
-   }
+   TEST( end_state   == (void*) ((uintptr_t)end_addr - ndfa->allocated));
+   TEST( start_state == (void*) ((uintptr_t)end_state + (state_SIZE + state_SIZE_EMPTYTRANS(1))));
+   TEST( end_state->nremptytrans == 1);
+   TEST( end_state->nrrangetrans == 0);
+   TEST( ! isempty_slist(&end_state->emptylist));
+   TEST( isempty_slist(&end_state->rangelist));
+   TEST( last_emptylist(&end_state->emptylist)->next == last_slist(&end_state->emptylist));
+   TEST( last_emptylist(&end_state->emptylist)->state == end_state);
+
+   if (end_addr2) *end_addr2 = end_addr;
 
    return 0;
 ONERR:
    return EINVAL;
 }
 
-static int test_initfree(void)
+static int test_operations(void)
 {
    automat_t      ndfa  = automat_FREE;
    automat_t      ndfa1 = automat_FREE;
@@ -5710,1462 +9365,2825 @@ static int test_initfree(void)
    incruse_automatmman(mman);
    incruse_automatmman(mman2);
    for (size_t i = 0; i < lengthof(target_state); ++i) {
-      target_state[i] = 1;
+      target_state[i] = 0;
    }
    for (size_t i = 0; i < lengthof(from); ++i) {
       from[i] = i;
       to[i]   = 3*i;
    }
 
-   // TEST automat_FREE
-   TEST( 0 == ndfa.mman);
-   TEST( 0 == ndfa.nrstate);
-   TEST( 0 == ndfa.allocated);
-   TEST( 1 == isempty_slist(&ndfa.states));
-   TEST( 0 == ndfa.isDFA);
-
-   for (size_t i = 0; i < 256; ++i) {
-      for (unsigned tc = 0; tc <= 1; ++tc) {
-         size_t const SIZE_PAGE = SIZEALLOCATED_PAGECACHE();
-
-         // TEST initmatch_automat
-         TESTP( 0 == initmatch_automat(&ndfa, tc ? &use_mman : 0, (uint8_t) i, from, to), "i:%zd", i);
-         automat_mman_t * mm = ndfa.mman;
-         TEST( 0 != mm);
-         // check mman
-         TEST( (1+tc) == refcount_automatmman(mm));
-         S = 2*sizeof(state_t) + sizeof(empty_transition_t) + i*sizeof(rangestate_t)+sizeof(range_transition_t);
-         TEST( S == sizeallocated_automatmman(mm));
-         // check ndfa
-         TEST( ndfa.mman      == (tc ? mman : mm));
-         TEST( ndfa.nrstate   == 2);
-         TEST( ndfa.allocated == S);
-         TEST( ! isempty_slist(&ndfa.states));
-         TEST( ndfa.isDFA     == 0);
-         // check ndfa.states
-         helperstate[0] = (helper_state_t) { state_RANGE, (uint8_t) i, target_state, from, to };
-         helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-         TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
-
-         // TEST free_automat: free and double free
-         // prepare
-         if (mm != mman) incruse_automatmman(mm);
-         for (unsigned r = 0; r <= 1; ++r) {
-            // test
-            TEST( 0 == free_automat(&ndfa));
-            // check mman
-            TEST( refcount_automatmman(mm) == 1);
-            TEST( sizeallocated_automatmman(mm) == S);
-            TEST( wasted_automatmman(mm) == S);
-            // check ndfa
-            TEST( ndfa.mman    == 0);
-            TEST( ndfa.nrstate == 0);
-            TEST( ndfa.allocated == 0);
-            TEST( isempty_slist(&ndfa.states));
-         }
+   // TEST opsequence_automat
+   // prepare
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
+      TEST(0 == initmatch_automat(&ndfa2, tc ? &use_mman2 : &use_mman, 1, (char32_t[]) { 2 }, (char32_t[]) { 2 } ));
+      S = sizeallocated_automatmman(mman) + sizeallocated_automatmman(mman2);
+      // test
+      ndfa.isDFA = ndfa2.isDFA = 1;
+      TEST( 0 == opsequence_automat(&ndfa, &ndfa2));
+      // check mman
+      TEST( 2 == refcount_automatmman(mman));
+      TEST( 1 == refcount_automatmman(mman2)); // is copied or not used
+      S += 2*sizeof(state_t) + 2*sizeof(empty_transition_t);
+      TEST( S == sizeallocated_automatmman(mman));
+      // check ndfa2
+      TEST( isfree_automat(&ndfa2));
+      // check ndfa
+      TEST( ndfa.mman      == mman);
+      TEST( ndfa.nrstate   == 6);
+      TEST( ndfa.allocated == S);
+      TEST( ! isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == 0);
+      // check ndfa.states
+      helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      // ndfa1
+      helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
+      helperstate[2] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0 };
+      // ndfa2
+      helperstate[3] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { 2 }, (char32_t[]) { 2 } };
+      helperstate[4] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };  // ndfa2
+      helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+      TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
+      // reset
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
+      reset_automatmman(mman2);
+   }
 
-         if (mm != mman) {
-            // TEST free_automat: free deletes memory manager if refcount == 0
-            ndfa.mman = mm;
-            // test
-            TEST( 0 == free_automat(&ndfa));
-            // check ndfa
-            TEST( 0 == ndfa.mman);
-            // check env (mm freed)
-            TEST( SIZE_PAGE == SIZEALLOCATED_PAGECACHE());
-         }
-         // reset
-         reset_automatmman(mman);
+   // TEST oprepeat_automat
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      // prepare
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
+      TEST(2 == refcount_automatmman(mman));
+      S = sizeallocated_automatmman(mman);
+      // test
+      ndfa.isDFA = 1;
+      TEST( 0 == oprepeat_automat(&ndfa, tc == 1));
+      // check mman
+      TEST( 2 == refcount_automatmman(mman));
+      S += (tc?3:2)*sizeof(state_t) + (tc?4:3)*sizeof(empty_transition_t);
+      TEST( S == sizeallocated_automatmman(mman));
+      // check ndfa
+      TEST( ndfa.mman      == mman);
+      TEST( ndfa.nrstate   == (tc?5:4));
+      TEST( ndfa.allocated == S);
+      TEST( ! isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == 0);
+      // check ndfa.states
+      if (tc) {
+         helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 2 }, 0, 0 };
       }
+      helperstate[0+tc] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1+tc, 3+tc }, 0, 0 };
+      helperstate[1+tc] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2+tc }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
+      helperstate[2+tc] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { tc }, 0, 0 };
+      helperstate[3+tc] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3+tc }, 0, 0 };
+      TEST(0 == helper_compare_states(&ndfa, (tc?5:4), helperstate))
+      // reset
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
    }
 
-   // TEST free_automat: simulated ERROR
-   decruse_automatmman(mman);
+   // TEST opor_automat
+   // prepare
    for (unsigned tc = 0; tc <= 1; ++tc) {
-      size_t const SIZE_PAGE = SIZEALLOCATED_PAGECACHE();
-      TEST( 0 == initmatch_automat(&ndfa, tc ? &use_mman : 0, 3, from, to));
-      automat_mman_t * mm = ndfa.mman;
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
+      TEST(0 == initmatch_automat(&ndfa2, tc ? &use_mman2 : &use_mman, 1, (char32_t[]) { 2 }, (char32_t[]) { 2 } ));
+      S = sizeallocated_automatmman(mman) + sizeallocated_automatmman(mman2);
       // test
-      init_testerrortimer(&s_automat_errtimer, 1u, EINVAL);
-      TEST( EINVAL == free_automat(&ndfa));
-      // check env
-      TEST( 0 == refcount_automatmman(mm));
-      if (mm != mman) TEST(0 == delete_automatmman(&mm))/*simulated error prevented deletion*/;
-      TEST( SIZE_PAGE == SIZEALLOCATED_PAGECACHE());
+      ndfa.isDFA = ndfa2.isDFA = 1;
+      TEST( 0 == opor_automat(&ndfa, &ndfa2));
+      // check mman
+      TEST( 2 == refcount_automatmman(mman));
+      TEST( 1 == refcount_automatmman(mman2)); // is copied or not used
+      S += 2*sizeof(state_t) + 3*sizeof(empty_transition_t);
+      TEST( S == sizeallocated_automatmman(mman));
+      // check ndfa2
+      TEST( isfree_automat(&ndfa2));
       // check ndfa
-      TEST( ndfa.mman      == 0);
-      TEST( ndfa.nrstate   == 0);
-      TEST( ndfa.allocated == 0);
-      TEST( isempty_slist(&ndfa.states));
+      TEST( ndfa.mman      == mman);
+      TEST( ndfa.nrstate   == 6);
+      TEST( ndfa.allocated == S);
+      TEST( ! isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == 0);
+      // check ndfa.states
+      helperstate[0] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1, 3 }, 0, 0 };
+      // ndfa1
+      helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
+      helperstate[2] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+      // ndfa2
+      helperstate[3] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { 2 }, (char32_t[]) { 2 } };
+      helperstate[4] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+      helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+      TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
+      // reset
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
+      reset_automatmman(mman2);
    }
+
+   // TEST opand_automat: empty automaton
+   TEST(0 == initempty_automat(&ndfa, &use_mman));
+   TEST(0 == initempty_automat(&ndfa1, &use_mman));
+   // test
+   TEST( 0 == opand_automat(&ndfa, &ndfa1));
+   // check ndfa1
+   TEST( 1 == isfree_automat(&ndfa1));
+   // check mman released
+   TEST( 1 == refcount_automatmman(mman));
+   // check ndfa
+   TEST( ndfa.mman      != mman);
+   TEST( ndfa.nrstate   == 2);
+   TEST( ndfa.allocated == 2*state_SIZE + 2*state_SIZE_EMPTYTRANS(1));
+   TEST( ! isempty_slist(&ndfa.states));
+   TEST( ndfa.isDFA     == 1);
+   // check ndfa.states
+   TEST( 0 == check_dfa_endstate(&ndfa, 0));
+   helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+   helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+   TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
    // reset
-   incruse_automatmman(mman);
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
 
-   // TEST initempty_automat
+   // TEST opand_automat: ab*c & abc
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+   TEST(0 == oprepeat_automat(&ndfa2, 0));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));   // ab*c
+   TEST(4 == matchchar32_automat(&ndfa, 4, U"abbc", false));
+   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));   // abc
+   // test
+   TEST( 0 == opand_automat(&ndfa, &ndfa1));
+   // check ndfa1
+   TEST( 1 == isfree_automat(&ndfa1));
+   // check mman released
+   TEST( 1 == refcount_automatmman(mman));
+   // check ndfa
+   TEST( 0 == matchchar32_automat(&ndfa, 4, U"abbc", false));
+   TEST( 3 == matchchar32_automat(&ndfa, 3, U"abc", false));
+   TEST( ndfa.mman      != mman);
+   TEST( ndfa.nrstate   == 4);
+   TEST( ndfa.allocated == 4*state_SIZE + state_SIZE_EMPTYTRANS(1) + 3*state_SIZE_RANGETRANS(1));
+   TEST( ! isempty_slist(&ndfa.states));
+   TEST( ndfa.isDFA     == 1);
+   // check ndfa.states
+   TEST( 0 == check_dfa_endstate(&ndfa, 0));
+   helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 'a' }, (char32_t[]) { 'a' } };
+   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 'b' }, (char32_t[]) { 'b' } };
+   helperstate[2] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 3 }, (char32_t[]) { 'c' }, (char32_t[]) { 'c' } };
+   helperstate[3] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0 };
+   TEST(0 == helper_compare_states(&ndfa, 4, helperstate))
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
+
+   // TEST opandnot_automat
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+   TEST(0 == oprepeat_automat(&ndfa2, 0));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));   // ab*c
+   TEST(4 == matchchar32_automat(&ndfa, 4, U"abbc", false));
+   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));   // abc
+   // test
+   TEST( 0 == opandnot_automat(&ndfa, &ndfa1));
+   // check ndfa1
+   TEST( 1 == isfree_automat(&ndfa1));
+   // check mman released
+   TEST( 1 == refcount_automatmman(mman));
+   // check ndfa
+   TEST( 4 == matchchar32_automat(&ndfa, 4, U"abbc", false));
+   TEST( 2 == matchchar32_automat(&ndfa, 2, U"ac", false));
+   TEST( 0 == matchchar32_automat(&ndfa, 3, U"abc", false));
+   TEST( ndfa.mman      != mman);
+   TEST( ndfa.nrstate   == 6);
+   TEST( ndfa.allocated == 6*state_SIZE + state_SIZE_EMPTYTRANS(1) + 3*state_SIZE_RANGETRANS(2) + state_SIZE_RANGETRANS(1));
+   TEST( ! isempty_slist(&ndfa.states));
+   TEST( ndfa.isDFA     == 1);
+   // check ndfa.states
+   TEST( 0 == check_dfa_endstate(&ndfa, 0));
+   helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 'a' }, (char32_t[]) { 'a' } };
+   helperstate[1] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 2, 5 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' } };
+   helperstate[2] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 3, 4 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' } };
+   helperstate[3] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 3, 5 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' } };
+   helperstate[4] = (helper_state_t) { state_RANGE, 0, 0, 0, 0 }; // error state
+   helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
+   TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
+
+   // TEST opnot_automat
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+   TEST(0 == oprepeat_automat(&ndfa2, 0));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   TEST(3 == matchchar32_automat(&ndfa, 3, U"abb", true));
+   // test: !(ab*)
+   TEST( 0 == opnot_automat(&ndfa))
+   // check mman released
+   TEST( 1 == refcount_automatmman(mman));
+   // check ndfa
+   TEST( 0 == matchchar32_automat(&ndfa, 3, U"abb", true));
+   TEST( 2 == matchchar32_automat(&ndfa, 2, U"bb", true));
+   TEST( 3 == matchchar32_automat(&ndfa, 3, U"abc", true));
+   TEST( ndfa.mman      != mman);
+   TEST( ndfa.nrstate   == 4);
+   TEST( ndfa.allocated == 4*state_SIZE + state_SIZE_EMPTYTRANS(3) + 2*state_SIZE_RANGETRANS(3)+state_SIZE_RANGETRANS(1));
+   TEST( ! isempty_slist(&ndfa.states));
+   TEST( ndfa.isDFA     == 1);
+   // check ndfa.states
+   TEST( 0 == check_dfa_endstate(&ndfa, 0));
+   helperstate[0] = (helper_state_t) { state_RANGE_ENDSTATE, 3, (size_t[]) { 1,2,1 }, (char32_t[]) { 0, 'a', 'b' }, (char32_t[]) { 'a'-1u, 'a', maxchar_utf8()} };
+   helperstate[1] = (helper_state_t) { state_RANGE_ENDSTATE, 1, (size_t[]) { 1 }, (char32_t[]) { 0 }, (char32_t[]) { maxchar_utf8() } };
+   helperstate[2] = (helper_state_t) { state_RANGE, 3, (size_t[]) { 1,2,1 }, (char32_t[]) { 0, 'b', 'c' }, (char32_t[]) { 'a', 'b', maxchar_utf8()} };
+   helperstate[3] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0 };
+   TEST(0 == helper_compare_states(&ndfa, 4, helperstate))
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
+
+   // TEST opnot_automat: not reverses previous not
    for (unsigned tc = 0; tc <= 1; ++tc) {
+      switch (tc) {
+      case 0:
+         TEST(0 == initempty_automat(&ndfa, &use_mman));
+         break;
+      case 1:
+         TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'z' }));
+         break;
+      }
       // test
-      TEST( 0 == initempty_automat(&ndfa, tc ? &use_mman : 0));
-      automat_mman_t * mm = ndfa.mman;
-      TEST( 0 != mm);
-      // check mman
-      TEST( (1+tc) == refcount_automatmman(mm));
-      S = 2*sizeof(state_t) + 2*sizeof(empty_transition_t);
-      TEST( S == sizeallocated_automatmman(mm));
+      TEST( 0 == opnot_automat(&ndfa))
+      TEST( 0 == opnot_automat(&ndfa))
+      TEST( 0 == minimize_automat(&ndfa))
+      // check mman released
+      TEST( 1 == refcount_automatmman(mman));
       // check ndfa
-      TEST( ndfa.mman      == (tc ? mman : mm));
+      TEST( ndfa.mman      != mman);
       TEST( ndfa.nrstate   == 2);
-      TEST( ndfa.allocated == S);
+      TEST( ndfa.allocated == 2*state_SIZE + state_SIZE_EMPTYTRANS(1) + (tc?state_SIZE_RANGETRANS(1):state_SIZE_EMPTYTRANS(1)));
       TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 0);
+      TEST( ndfa.isDFA     == 1);
       // check ndfa.states
-      helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      TEST( 0 == check_dfa_endstate(&ndfa, 0));
+      // no switch: compound literals must live until helper_compare_states is called
+      helperstate[0] = tc ? (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 'a' }, (char32_t[]) { 'z' } }
+                          : (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
       helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-      TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
+      TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
       // reset
-      TEST( 0 == free_automat(&ndfa));
+      TEST(0 == free_automat(&ndfa));
       reset_automatmman(mman);
    }
 
-   // === simulated ERROR
+   // === simulated ERROR in copy operation
+
+   for (unsigned count = 1; count <= 4; ++ count) {
+      for (unsigned tc = 0; tc <= 1; ++tc) {
+         // prepare
+         int err = (int) (3+count);
+         TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
+         TEST(0 == initmatch_automat(&ndfa2, &use_mman2, 1, (char32_t[]) { 2 }, (char32_t[]) { 2 } ));
+         S = sizeallocated_automatmman(mman);
+         init_testerrortimer(&s_automat_errtimer, count, err);
+         switch (tc) {
+         case 0:  // TEST opsequence_automat: ERROR in copy operation
+                  TEST( err == opsequence_automat(&ndfa, &ndfa2));
+                  break;
+         case 1:  // TEST opor_automat: ERROR in copy operation
+                  TEST( err == opor_automat(&ndfa, &ndfa2));
+                  break;
+         }
+         // check ndfa: not changed
+         helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
+         helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+         TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
+         // check ndfa2: not changed
+         helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 2 }, (char32_t[]) { 2 } };
+         helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+         TEST( 0 == helper_compare_states(&ndfa2, 2, helperstate))
+         // check mman, mman2
+         TEST( refcount_automatmman(mman)      == (count <= 3 ? 2 : 3));
+         TEST( sizeallocated_automatmman(mman) <= 2*S);
+         TEST( wasted_automatmman(mman)        == 0);
+         TEST( refcount_automatmman(mman2)     == (count <= 3 ? 2 : 1));
+         TEST( sizeallocated_automatmman(mman2) == S);
+         TEST( wasted_automatmman(mman2)       == (count <= 3 ? 0 : S));
+         // reset
+         TEST(0 == free_automat(&ndfa));
+         TEST(0 == free_automat(&ndfa2));
+         reset_automatmman(mman);
+         reset_automatmman(mman2);
+      }
+   }
+
+   // === simulated ERROR (no copy)
 
-   TEST(0 == initempty_automat(&ndfa2, &use_mman2));
-   for (unsigned tc = 0; tc <= 8; ++tc) {
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, from+1, to+1));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, from+2, to+2));
+   S = sizeallocated_automatmman(mman);
+   for (unsigned tc = 0; tc <= 4; ++tc) {
       // prepare
       int err = (int) (tc+4);
-      S = sizeallocated_automatmman(mman);
       init_testerrortimer(&s_automat_errtimer, 1, (int) err);
       switch (tc) {
-      case 0:  // TEST initmatch_automat: simulated ERROR
-               TEST( err == initempty_automat(&ndfa, &use_mman));
+      case 0:  // TEST opsequence_automat: simulated ERROR
+               TEST( err == opsequence_automat(&ndfa, &ndfa2));
                break;
-      case 1:  // TEST initmatch_automat: simulated ERROR
-               TEST( err == initempty_automat(&ndfa, 0));
+      case 1:  // TEST opor_automat: simulated ERROR
+               TEST( err == opor_automat(&ndfa, &ndfa2));
                break;
-      case 2:  // TEST initmatch_automat: simulated ERROR
-               TEST( err == initmatch_automat(&ndfa, &use_mman, 1, from, to));
+      case 2:  // TEST opand_automat: simulated ERROR
+               TEST( err == opand_automat(&ndfa, &ndfa2));
                break;
-      case 3:  // TEST initmatch_automat: simulated ERROR
-               TEST( err == initmatch_automat(&ndfa, 0, 1, from, to));
+      case 3:  // TEST opandnot_automat: simulated ERROR
+               TEST( err == opandnot_automat(&ndfa, &ndfa2));
                break;
-      case 4:  // TEST initcopy_automat: simulated ERROR
-               TEST( err == initcopy_automat(&ndfa, &ndfa2, &use_mman));
+      case 4:  // TEST opnot_automat: simulated ERROR
+               TEST( err == opnot_automat(&ndfa));
                break;
-      case 5:  // TEST initcopy_automat: simulated ERROR
-               TEST( err == initcopy_automat(&ndfa, &ndfa2, 0));
+      }
+      // check ndfa: not changed
+      helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { from[1] }, (char32_t[]) { to[1] } };
+      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
+      // check ndfa2: not changed
+      helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { from[2] }, (char32_t[]) { to[2] } };
+      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+      TEST( 0 == helper_compare_states(&ndfa2, 2, helperstate))
+      // check mman
+      TEST( 0 == wasted_automatmman(mman));
+      TEST( S == sizeallocated_automatmman(mman));
+      TEST( 3 == refcount_automatmman(mman));
+   }
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == free_automat(&ndfa2));
+   reset_automatmman(mman);
+
+   // === EINVAL
+
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, from+1, to+1));
+   S = sizeallocated_automatmman(mman);
+   for (unsigned tc = 0; tc <= 5; ++tc) {
+      // prepare
+      switch (tc) {
+      case 0:  // TEST opsequence_automat: EINVAL empty ndfa
+               TEST( EINVAL == opsequence_automat(&ndfa,  &ndfa2));
+               TEST( EINVAL == opsequence_automat(&ndfa2, &ndfa));
                break;
-      case 6:  // TEST initreverse_automat: simulated ERROR
-               TEST( err == initreverse_automat(&ndfa, &ndfa2, &use_mman));
+      case 1:  // TEST oprepeat_automat: EINVAL empty ndfa
+               TEST( EINVAL == oprepeat_automat(&ndfa, 0));
                break;
-      case 7:  // TEST initreverse_automat: simulated ERROR
-               TEST( err == initreverse_automat(&ndfa, &ndfa2, 0));
+      case 2:  // TEST opor_automat: EINVAL empty ndfa
+               TEST( EINVAL == opor_automat(&ndfa,  &ndfa2));
+               TEST( EINVAL == opor_automat(&ndfa2, &ndfa));
                break;
-      case 8:  // TEST initreverse_automat: EINVAL
-               free_testerrortimer(&s_automat_errtimer);
-               TEST( EINVAL == initreverse_automat(&ndfa, &ndfa, 0));
+      case 3:  // TEST opand_automat: EINVAL empty ndfa
+               TEST( EINVAL == opand_automat(&ndfa,  &ndfa2));
+               TEST( EINVAL == opand_automat(&ndfa2, &ndfa));
+               break;
+      case 4:  // TEST opandnot_automat: EINVAL empty ndfa
+               TEST( EINVAL == opandnot_automat(&ndfa,  &ndfa2));
+               TEST( EINVAL == opandnot_automat(&ndfa2, &ndfa));
+               break;
+      case 5:  // TEST opnot_automat: EINVAL empty ndfa
+               TEST( EINVAL == opnot_automat(&ndfa));
                break;
       }
-      // check ndfa
-      TEST( ndfa.mman      == 0);
-      TEST( ndfa.nrstate   == 0);
-      TEST( ndfa.allocated == 0);
-      TEST( isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 0);
       // check mman
       TEST( 0 == wasted_automatmman(mman));
       TEST( S == sizeallocated_automatmman(mman));
-      TEST( 1 == refcount_automatmman(mman));
-      // reset
-      reset_automatmman(mman);
+      TEST( 2 == refcount_automatmman(mman));
+      // check ndfa
+      TEST( ndfa.mman    == 0);
+      TEST( ndfa.nrstate == 0);
+      TEST( ndfa.allocated == 0);
+      TEST( isempty_slist(&ndfa.states));
+   }
+   // reset
+   TEST(0 == free_automat(&ndfa2));
+   reset_automatmman(mman);
+
+   // reset
+   TEST(0 == delete_automatmman(&mman));
+   TEST(0 == delete_automatmman(&mman2));
+
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa1);
+   free_automat(&ndfa2);
+   delete_automatmman(&mman);
+   delete_automatmman(&mman2);
+   return EINVAL;
+}
+
+static int test_query(void)
+{
+   automat_t ndfa  = automat_FREE;
+   automat_t ndfa2[5] = { automat_FREE } ;
+   size_t    minchainlen = sizeblock_statearray() / sizeof(state_t*);
+
+   // TEST isfree_automat: automat_FREE
+   TEST(1 == isfree_automat(&ndfa));
+
+   // TEST isfree_automat: mman != 0
+   ndfa.mman = (void*)1;
+   TEST(0 == isfree_automat(&ndfa));
+   ndfa.mman = 0;
+   TEST(1 == isfree_automat(&ndfa));
+
+   // TEST isfree_automat: nrstate != 0
+   ndfa.nrstate = 1;
+   TEST(0 == isfree_automat(&ndfa));
+   ndfa.nrstate = 0;
+   TEST(1 == isfree_automat(&ndfa));
+
+   // TEST isfree_automat: allocated != 0
+   ndfa.allocated = 1;
+   TEST(0 == isfree_automat(&ndfa));
+   ndfa.allocated = 0;
+   TEST(1 == isfree_automat(&ndfa));
+
+   // TEST isfree_automat: states.last != 0
+   ndfa.states.last = (void*) 1;
+   TEST(0 == isfree_automat(&ndfa));
+   ndfa.states.last = 0;
+   TEST(1 == isfree_automat(&ndfa));
+
+   // TEST nrstate_automat: automat_FREE
+   TEST(0 == nrstate_automat(&ndfa));
+
+   // TEST nrstate_automat: returns value of nrstate
+   for (size_t i = 1; i; i <<= 1) {
+      ndfa.nrstate = i;
+      TEST(i == nrstate_automat(&ndfa));
+   }
+
+   for (unsigned l = 1; l < 4; ++l) {
+      // prepare
+      state_t states[4];
+      for (unsigned i = 0; i < l; ++i) {
+         insertlast_statelist(&ndfa.states, &states[i]);
+      }
+      state_t * start;
+      state_t * end;
+
+      // TEST startend_automat: empty statelist
+      startend_automat(&ndfa, &start, &end);
+      // check start
+      TEST(start == &states[0]);
+      // check end
+      TEST(end   == &states[l-1]);
+   }
+
+   // TEST isendstate_automat: nrstate == 0
+   for (size_t i = 1; i; i <<= 1) {
+      TEST( 0 == isendstate_automat(&ndfa, i));
+      // check ndfa
+      TEST( 0 == isfree_automat(&ndfa));
+   }
+   TEST( 0 == isendstate_automat(&ndfa, 0));
+
+   // TEST isendstate_automat: empty state
+   TEST(0 == initempty_automat(&ndfa, 0));
+   // test
+   TEST( 1 == isendstate_automat(&ndfa, 0));
+   TEST( 1 == isendstate_automat(&ndfa, 1));
+   // reset
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST isendstate_automat: match state
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){0}, (char32_t[]){(char32_t)-1}));
+   // test
+   TEST( 0 == isendstate_automat(&ndfa, 0));
+   TEST( 1 == isendstate_automat(&ndfa, 1));
+   // reset
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST iserrorstate_automat: nrstate == 0
+   for (size_t i = 1; i; i <<= 1) {
+      TEST( 1 == iserrorstate_automat(&ndfa, i));
+      // check ndfa
+      TEST( 1 == isfree_automat(&ndfa));
+   }
+   TEST( 1 == iserrorstate_automat(&ndfa, 0));
+
+   // TEST iserrorstate_automat
+   TEST(0 == new_automatmman(&ndfa.mman));
+   incruse_automatmman(ndfa.mman);
+   ndfa.nrstate = 100;
+   for (unsigned i = 0; i < 100; ++i) {
+      void *state;
+      TEST(0 == malloc_automatmman(ndfa.mman, sizeof(state_t), &state));
+      memset(state, 0, sizeof(state_t));
+      ((state_t*)state)->nremptytrans = (i%3);
+      ((state_t*)state)->nrrangetrans = (i%5);
+      insertlast_statelist(&ndfa.states, (state_t*)state);
+   }
+   for (unsigned i = 0; i < 100; ++i) {
+      int isErr = (i%3 == 0) && (i%5 == 0);
+      TEST( isErr == iserrorstate_automat(&ndfa, i));
+   }
+   // reset
+   TEST(0 == free_automat(&ndfa));
+
+   // prepare ndfa with "( | [a-b][a-b]* )"
+   {
+      enum { EMPTY, MATCH1, MATCH2 };
+      TEST(0 == initempty_automat(&ndfa2[EMPTY], 0));
+      TEST(0 == initmatch_automat(&ndfa2[MATCH1], &ndfa2[EMPTY], 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+      TEST(0 == initmatch_automat(&ndfa2[MATCH2], &ndfa2[EMPTY], 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+      TEST(0 == oprepeat_automat(&ndfa2[MATCH2], 0));
+      TEST(0 == opsequence_automat(&ndfa2[MATCH1], &ndfa2[MATCH2]));
+      TEST(0 == opor_automat(&ndfa2[EMPTY], &ndfa2[MATCH1]));
+      initmove_automat(&ndfa, &ndfa2[EMPTY]);
    }
-   TEST(0 == free_automat(&ndfa2));
 
-   // TEST initmove_automat
    for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 3000 } ));
-      ndfa1.isDFA = (tc != 0);
+      // TEST matchchar32_automat: match empty transition as shortest match
+      if (tc) {
+         TEST(0 == makedfa_automat(&ndfa));
+      }
+      set_readmark(&ndfa);
       // test
-      S = sizeallocated_automatmman(mman);
-      initmove_automat(&ndfa, &ndfa1);
-      // check mman
-      TEST( 2 == refcount_automatmman(mman));
-      TEST( S == sizeallocated_automatmman(mman));
-      // check ndfa1
-      TEST( isfree_automat(&ndfa1));
-      // check ndfa
-      TEST( ndfa.mman      == mman);
-      TEST( ndfa.nrstate   == 2);
-      TEST( ndfa.allocated == S);
-      TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == (tc != 0));
-      // check ndfa.states
-      helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 1 }, (char32_t[]) { 3000 } };
-      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-      TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
-      // reset
-      TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
+      TEST( 0 == matchchar32_automat(&ndfa, 1, U"a", false));
+      // check ndfa is only read
+      TEST( 0 == check_readmark(&ndfa));
+
+      // TEST matchchar32_automat: match longest string
+      for (unsigned len = 0; len <= 10; ++len) {
+         set_readmark(&ndfa);
+         // test
+         TEST( len == matchchar32_automat(&ndfa, len, U"ababababab", true));
+         // check ndfa is only read
+         TEST( 0 == check_readmark(&ndfa));
+      }
    }
+   // reset
+   TEST(0 == free_automat(&ndfa));
 
-   // TEST initcopy_automat
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 11 } ));
-   for (unsigned i = 1; i <= 3; ++i) {
-      TEST(0 == extendmatch_automat(&ndfa, (uint8_t)i, (char32_t[]) { 2, 3, 4 }, (char32_t[]) { 12, 13, 14 } ));
+   // TEST matchchar32_automat: follow very long empty states
+   // prepare
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 0 }, (char32_t[]){ 0 }));
+   for (size_t i = 1; i < 2*minchainlen; ++i) {
+      TEST(0 == initmatch_automat(&ndfa2[0], &ndfa, 1, (char32_t[]){ 2*i }, (char32_t[]){ 2*i }));
+      TEST(0 == opor_automat(&ndfa, &ndfa2[0]));
    }
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]) { 5 }, (char32_t[]) { 15 } ));
-   for (unsigned i = 1; i <= 3; ++i) {
-      TEST(0 == extendmatch_automat(&ndfa2, (uint8_t)i, (char32_t[]) { 6, 7, 8 }, (char32_t[]) { 16, 17, 18 } ));
+   for (size_t i = 0; i < 2*minchainlen; i += minchainlen/3) {
+      set_readmark(&ndfa);
+      char32_t c = (char32_t)(2*i);
+      TEST( 1 == matchchar32_automat(&ndfa, 1, &c, false));
+      // check ndfa is only read
+      TEST( 0 == check_readmark(&ndfa));
    }
-   TEST(0 == opor_automat(&ndfa, &ndfa2));
-   S = sizeallocated_automatmman(ndfa.mman);
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      const size_t SIZE_PAGE = SIZEALLOCATED_PAGECACHE();
-      // test
-      ndfa.isDFA = (tc != 0);
-      TEST(0 == initcopy_automat(&ndfa2, &ndfa, tc ? &use_mman2 : 0));
-      // check env
-      if (!tc) {
-         TEST( SIZE_PAGE < SIZEALLOCATED_PAGECACHE());
-      }
-      // check ndfa
-      TEST( S == sizeallocated_automatmman(ndfa.mman));
-      // check ndfa2
-      TEST( ndfa2.mman == (tc ? mman2 : ndfa2.mman));
-      TEST( helper_compare_copy(&ndfa2, &ndfa) == 0);
-      TEST( refcount_automatmman(ndfa2.mman)   == (1+tc));
-      helperstate[0] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1, 3 }, 0, 0 }; // ndfa
-      // ndfa1
-      helperstate[1] = (helper_state_t) { state_RANGE, 7, (size_t[]) { 2,2,2,2,2,2,2 }, (char32_t[]) { 1, 2, 2, 3, 2, 3, 4 }, (char32_t[]) { 11, 12, 12, 13, 12, 13, 14 } };
-      helperstate[2] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-      // ndfa2
-      helperstate[3] = (helper_state_t) { state_RANGE, 7, (size_t[]) { 4,4,4,4,4,4,4 }, (char32_t[]) { 5, 6, 6, 7, 6, 7, 8 }, (char32_t[]) { 15, 16, 16, 17, 16, 17, 18 } };
-      helperstate[4] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-      helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 }; // ndfa
-      TEST( 0 == helper_compare_states(&ndfa2, 6, helperstate))
-      // reset
-      TEST(0 == free_automat(&ndfa2));
-      reset_automatmman(mman2);
-      TEST(SIZE_PAGE == SIZEALLOCATED_PAGECACHE());
+   for (size_t i = 0; i <= 4*minchainlen; i += minchainlen) {
+      char32_t c = (char32_t)(2*i+1);
+      set_readmark(&ndfa);
+      // test (no match for other chars)
+      TEST( 0 == matchchar32_automat(&ndfa, 1, &c, false));
+      // check ndfa is only read
+      TEST( 0 == check_readmark(&ndfa));
    }
    // reset
    TEST(0 == free_automat(&ndfa));
-   reset_automatmman(mman);
 
-   // TEST initreverse_automat: empty automat
+   // TEST matchchar32_automat: state_RANGE_CONTINUE
+   TEST(0 == initmatch_automat(&ndfa, 0, 2, (char32_t[]){ 0, 1 }, (char32_t[]){ 0, 1 }));
+   for (size_t i = 2; i < 2*minchainlen; i += 2) {
+      TEST(0 == extendmatch_automat(&ndfa, 2, (char32_t[]){ 2*i, 2*i+1 }, (char32_t[]){ 2*i, 2*i+1 }));
+   }
    for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initempty_automat(&ndfa, &use_mman));
-      // test
-      ndfa.isDFA = 1;
-      TEST( 0 == initreverse_automat(&ndfa2, &ndfa, tc ? &use_mman : 0));
-      // check ndfa2
-      TEST( 0 == helper_compare_reverse(&ndfa2, &ndfa, tc ? &use_mman : 0));
-      helperstate[0] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1, 0 }, 0, 0 }; // start state contains empty self trans of former end state
-      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };    // added empty self trans to end state
-      TEST( 0 == helper_compare_states(&ndfa2, 2, helperstate))
-      // reset
-      TEST(0 == free_automat(&ndfa2));
-      TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
+      if (tc) {
+         TEST(0 == makedfa_automat(&ndfa));
+      }
+      for (size_t i = 0; i < 2*minchainlen; i += minchainlen/4) {
+         // test
+         set_readmark(&ndfa);
+         for (char32_t c = (char32_t)(2*i); c <= (char32_t)(2*i+1); ++c) {
+            TEST( 1 == matchchar32_automat(&ndfa, 1, &c, false));
+         }
+         // check ndfa is only read
+         TEST( 0 == check_readmark(&ndfa));
+      }
    }
+   // reset
+   TEST(0 == free_automat(&ndfa));
 
-   // TEST initreverse_automat: more complex automat
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
-      for (unsigned i = 1; i < 10; ++i) {
-         TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]) { 3*i }, (char32_t[]) { 4*i } ));
-         TEST(0 == opor_automat(&ndfa, &ndfa2));
-         TEST(0 == oprepeat_automat(&ndfa, 0));
+   // TEST match_dfa_automat: test binary search with different array sizes
+   for (unsigned arrsize = 1; arrsize <= 32; ++arrsize) {
+      // prepare
+      for (unsigned nrofarray = 0; nrofarray < 4; ++nrofarray) {
+         char32_t from[32];
+         char32_t   to[32];
+         for (unsigned i = 0, f = nrofarray*(3*arrsize); i < arrsize; ++i, f += 3) {
+            from[i] = f;
+              to[i] = f+1;
+         }
+         if (nrofarray) {
+            TEST(0 == extendmatch_automat(&ndfa, (uint8_t)arrsize, from, to));
+         } else {
+            TEST(0 == initmatch_automat(&ndfa, 0, (uint8_t)arrsize, from, to));
+         }
       }
-      // test
       ndfa.isDFA = 1;
-      TEST( 0 == initreverse_automat(&ndfa2, &ndfa, tc ? &use_mman : 0));
-      // check ndfa2
-      TEST( 0 == helper_compare_reverse(&ndfa2, &ndfa, tc ? &use_mman : 0));
+      for (char32_t chr = 0; chr < 4*3*arrsize; ++chr) {
+         // test
+         size_t len = matchchar32_automat(&ndfa, 1, &chr, false);
+         // check return value
+         TESTP( len == ((chr % 3) != 2), "len:%zd chr:%d", len, (unsigned)chr);
+      }
       // reset
-      TEST(0 == free_automat(&ndfa2));
       TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
    }
 
-   // reset
-   TEST(0 == delete_automatmman(&mman));
-   TEST(0 == delete_automatmman(&mman2));
+   // free resources
+   TEST(0 == free_automat(&ndfa));
+   for (size_t i = 0; i < lengthof(ndfa2); ++i) {
+      TEST(0 == free_automat(&ndfa2[i]));
+   }
 
    return 0;
 ONERR:
    free_automat(&ndfa);
-   free_automat(&ndfa1);
-   free_automat(&ndfa2);
-   delete_automatmman(&mman);
-   delete_automatmman(&mman2);
+   for (size_t i = 0; i < lengthof(ndfa2); ++i) {
+      free_automat(&ndfa2[i]);
+   }
    return EINVAL;
 }
 
-static int check_dfa_endstate(automat_t* ndfa, /*out*/void** end_addr2)
+static int test_extend(void)
 {
-   state_t* start_state;
-   state_t* end_state;
-   void*    end_addr;
+   automat_t      ndfa = automat_FREE;
+   automat_t      ndfa2 = automat_FREE;
+   automat_mman_t*mman = 0;
+   char32_t       from[256];
+   char32_t       to[256];
+   size_t         target[255];
+   helper_state_t helperstate[3+255];
+   size_t         S;
 
-   TEST( 1 == refcount_automatmman(ndfa->mman));
-   TEST( 0 == malloc_automatmman(ndfa->mman, 0, &end_addr));
-   startend_automat(ndfa, &start_state, &end_state);
+   // prepare
+   for (size_t i = 0; i < lengthof(target); ++i) {
+      target[i] = 1;
+   }
+   for (size_t i = 0; i < lengthof(from); ++i) {
+      from[i] = 1 + i;
+      to[i]   = 1 + 2*i;
+   }
+   TEST(0 == initmatch_automat(&ndfa, 0, 15, from, to));
+   helperstate[0] = (helper_state_t) { state_RANGE, 15, target, from, to };
+   helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
+   TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
+   mman = ndfa.mman;
+   S = sizeallocated_automatmman(mman);
 
-   TEST( end_state   == (void*) ((uintptr_t)end_addr - ndfa->allocated));
-   TEST( start_state == (void*) ((uintptr_t)end_state + (state_SIZE + state_SIZE_EMPTYTRANS(1))));
-   TEST( end_state->nremptytrans == 1);
-   TEST( end_state->nrrangetrans == 0);
-   TEST( ! isempty_slist(&end_state->emptylist));
-   TEST( isempty_slist(&end_state->rangelist));
-   TEST( last_emptylist(&end_state->emptylist)->next == last_slist(&end_state->emptylist));
-   TEST( last_emptylist(&end_state->emptylist)->state == end_state);
+   // TEST extendmatch_automat: EINVAL (freed ndfa)
+   TEST( EINVAL == extendmatch_automat(&ndfa2, 1, from, to));
+   TEST( 1 == refcount_automatmman(mman));
+   TEST( S == sizeallocated_automatmman(mman));
 
-   if (end_addr2) *end_addr2 = end_addr;
+   // TEST extendmatch_automat: EINVAL (nrmatch == 0)
+   TEST( EINVAL == extendmatch_automat(&ndfa, 0, from, to));
+   TEST( mman == ndfa.mman);
+   TEST( 1 == refcount_automatmman(mman));
+   TEST( S == sizeallocated_automatmman(mman));
+
+   // TEST extendmatch_automat: ENOMEM
+   init_testerrortimer(&s_automat_errtimer, 1, ENOMEM);
+   TEST( ENOMEM == extendmatch_automat(&ndfa, 1, from, to));
+   TEST( mman == ndfa.mman);
+   TEST( 1 == refcount_automatmman(mman));
+   TEST( S == sizeallocated_automatmman(mman));
+
+   // TEST extendmatch_automat
+   for (size_t i = 1, off=15; off+i < lengthof(from); off += i, ++i) {
+      ndfa.isDFA = 1;
+      TEST( 0 == extendmatch_automat(&ndfa, (uint8_t)i, from+off, to+off))
+      // check mman
+      S += i * sizeof(rangestate_t) + sizeof(range_transition_t);
+      TEST( 1 == refcount_automatmman(mman));
+      TEST( S == sizeallocated_automatmman(mman));
+      // check ndfa
+      TEST( mman == ndfa.mman);
+      TEST( 2    == ndfa.nrstate);
+      TEST( 0    == isempty_slist(&ndfa.states));
+      TEST( 0    == ndfa.isDFA);
+      // check ndfa.states
+      helperstate[0] = (helper_state_t) { state_RANGE, (uint8_t)(off+i), target, from, to };
+      TESTP( 0 == helper_compare_states(&ndfa, ndfa.nrstate, helperstate), "i:%d", i);
+   }
+
+   // reset
+   TEST(0 == free_automat(&ndfa));
 
    return 0;
 ONERR:
+   free_automat(&ndfa);
    return EINVAL;
 }
 
-static int test_operations(void)
+static int test_optimize(void)
 {
    automat_t      ndfa  = automat_FREE;
    automat_t      ndfa1 = automat_FREE;
-   automat_t      ndfa2 = automat_FREE;
-   size_t         S;
-   automat_mman_t*mman = 0;
-   automat_mman_t*mman2 = 0;
-   automat_t      use_mman = automat_FREE;
-   automat_t      use_mman2 = automat_FREE;
-   char32_t       from[256];
-   char32_t       to[256];
+   automat_t      ndfa2 = automat_FREE;
+   automat_mman_t*mman = 0;
+   automat_t      use_mman;
+   void *         end_addr;
+   void *         next_addr;
+   state_t *      start_state;
+   state_t *      end_state;
    helper_state_t helperstate[10];
-   size_t         target_state[256];
 
    // prepare
-   TEST(0 == new_automatmman(&mman));
-   TEST(0 == new_automatmman(&mman2));
-   use_mman.mman  = mman;
-   use_mman2.mman = mman2;
-   incruse_automatmman(mman);
-   incruse_automatmman(mman2);
-   for (size_t i = 0; i < lengthof(target_state); ++i) {
-      target_state[i] = 0;
-   }
-   for (size_t i = 0; i < lengthof(from); ++i) {
-      from[i] = i;
-      to[i]   = 3*i;
-   }
+   TEST(0 == initempty_automat(&use_mman, 0));
+   mman = use_mman.mman;
+
+   // === convert to deterministic automaton (dfa)
 
-   // TEST opsequence_automat
    // prepare
+   TEST(0 == initmatch_automat(&ndfa1, 0, 1, (char32_t[]){ 0 }, (char32_t[]){ (char32_t)-1 }));
+   TEST(0 == oprepeat_automat(&ndfa1, 0));  // ndfa1 matches ".*"
+
+   // TEST makedfa_automat: 1 empty transition
    for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
-      TEST(0 == initmatch_automat(&ndfa2, tc ? &use_mman2 : &use_mman, 1, (char32_t[]) { 2 }, (char32_t[]) { 2 } ));
-      S = sizeallocated_automatmman(mman) + sizeallocated_automatmman(mman2);
+      TEST(0 == initempty_automat(&ndfa, &use_mman));
+      TEST(2 == refcount_automatmman(mman));
       // test
-      ndfa.isDFA = ndfa2.isDFA = 1;
-      TEST( 0 == opsequence_automat(&ndfa, &ndfa2));
-      // check mman
-      TEST( 2 == refcount_automatmman(mman));
-      TEST( 1 == refcount_automatmman(mman2)); // is copied or not used
-      S += 2*sizeof(state_t) + 2*sizeof(empty_transition_t);
-      TEST( S == sizeallocated_automatmman(mman));
-      // check ndfa2
-      TEST( isfree_automat(&ndfa2));
+      if (tc == 0) {
+         TEST( 0 == makedfa_automat(&ndfa));
+      } else {
+         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
+      }
+      // check mman released
+      TEST( 1 == refcount_automatmman(mman));
       // check ndfa
-      TEST( ndfa.mman      == mman);
-      TEST( ndfa.nrstate   == 6);
-      TEST( ndfa.allocated == S);
+      TEST( ndfa.mman      != mman);
+      TEST( ndfa.nrstate   == 2);
+      TEST( ndfa.allocated == 2*(state_SIZE + state_SIZE_EMPTYTRANS(1)));
       TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 0);
+      TEST( ndfa.isDFA     == 1);
       // check ndfa.states
-      helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-      // ndfa1
-      helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
-      helperstate[2] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0 };
-      // ndfa2
-      helperstate[3] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { 2 }, (char32_t[]) { 2 } };
-      helperstate[4] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };  // ndfa2
-      helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-      TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
+      startend_automat(&ndfa, &start_state, &end_state);
+      TEST( end_state == next_statelist(start_state)); // only 2 in list (end == start->next)
+      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
+      TEST( start_state->nremptytrans == 1);
+      TEST( start_state->nrrangetrans == 0);
+      TEST( ! isempty_slist(&start_state->emptylist));
+      TEST( isempty_slist(&start_state->rangelist));
+      TEST( last_emptylist(&start_state->emptylist)->next == last_slist(&start_state->emptylist));
+      TEST( last_emptylist(&start_state->emptylist)->state == end_state);
       // reset
       TEST(0 == free_automat(&ndfa));
       reset_automatmman(mman);
-      reset_automatmman(mman2);
    }
 
-   // TEST oprepeat_automat
+   // TEST makedfa_automat: overlapping ranges
    for (unsigned tc = 0; tc <= 1; ++tc) {
-      // prepare
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 2, (char32_t[2]){1,500}, (char32_t[2]){1000,2000}));
       TEST(2 == refcount_automatmman(mman));
-      S = sizeallocated_automatmman(mman);
       // test
-      ndfa.isDFA = 1;
-      TEST( 0 == oprepeat_automat(&ndfa, tc == 1));
-      // check mman
-      TEST( 2 == refcount_automatmman(mman));
-      S += (tc?3:2)*sizeof(state_t) + (tc?4:3)*sizeof(empty_transition_t);
-      TEST( S == sizeallocated_automatmman(mman));
+      if (tc == 0) {
+         TEST( 0 == makedfa_automat(&ndfa));
+      } else {
+         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
+      }
+      // check mman released
+      TEST( 1 == refcount_automatmman(mman));
       // check ndfa
-      TEST( ndfa.mman      == mman);
-      TEST( ndfa.nrstate   == (tc?5:4));
-      TEST( ndfa.allocated == S);
+      TEST( ndfa.mman      != mman);
+      TEST( ndfa.nrstate   == 2);
+      TEST( ndfa.allocated == 2*state_SIZE + state_SIZE_EMPTYTRANS(1) + state_SIZE_RANGETRANS(1));
       TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 0);
+      TEST( ndfa.isDFA     == 1);
       // check ndfa.states
-      if (tc) {
-         helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 2 }, 0, 0 };
-      }
-      helperstate[0+tc] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1+tc, 3+tc }, 0, 0 };
-      helperstate[1+tc] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2+tc }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
-      helperstate[2+tc] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { tc }, 0, 0 };
-      helperstate[3+tc] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3+tc }, 0, 0 };
-      TEST(0 == helper_compare_states(&ndfa, (tc?5:4), helperstate))
+      startend_automat(&ndfa, &start_state, &end_state);
+      TEST( end_state == next_statelist(start_state)); // only 2 in list (end == start->next)
+      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
+      TEST( start_state->nremptytrans == 0);
+      TEST( start_state->nrrangetrans == 1);
+      TEST( isempty_slist(&start_state->emptylist));
+      TEST( ! isempty_slist(&start_state->rangelist));
+      TEST( last_rangelist(&start_state->rangelist)->size == 1);
+      TEST( last_rangelist(&start_state->rangelist)->array[0].from  == 1);
+      TEST( last_rangelist(&start_state->rangelist)->array[0].to    == 2000);
+      TEST( last_rangelist(&start_state->rangelist)->array[0].state == end_state);
       // reset
       TEST(0 == free_automat(&ndfa));
       reset_automatmman(mman);
    }
 
-   // TEST opor_automat
-   // prepare
+   // TEST makedfa_automat: 1 range && optimize continuous ranges into single transition
    for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
-      TEST(0 == initmatch_automat(&ndfa2, tc ? &use_mman2 : &use_mman, 1, (char32_t[]) { 2 }, (char32_t[]) { 2 } ));
-      S = sizeallocated_automatmman(mman) + sizeallocated_automatmman(mman2);
+      // prepare
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (uint32_t[]) { 0 }, (uint32_t[]) { 4 }));
+      for (unsigned i = 1; i < 200; ++i) {
+         TEST(0 == extendmatch_automat(&ndfa, 1, (uint32_t[]) { 5*i }, (uint32_t[]) { 5*i+4 }));
+      }
       // test
-      ndfa.isDFA = ndfa2.isDFA = 1;
-      TEST( 0 == opor_automat(&ndfa, &ndfa2));
-      // check mman
-      TEST( 2 == refcount_automatmman(mman));
-      TEST( 1 == refcount_automatmman(mman2)); // is copied or not used
-      S += 2*sizeof(state_t) + 3*sizeof(empty_transition_t);
-      TEST( S == sizeallocated_automatmman(mman));
-      // check ndfa2
-      TEST( isfree_automat(&ndfa2));
+      if (tc == 0) {
+         TEST( 0 == makedfa_automat(&ndfa));
+      } else {
+         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
+      }
+      // check mman released
+      TEST( 1 == refcount_automatmman(mman));
       // check ndfa
-      TEST( ndfa.mman      == mman);
-      TEST( ndfa.nrstate   == 6);
-      TEST( ndfa.allocated == S);
+      TEST( ndfa.mman      != mman);
+      TEST( ndfa.nrstate   == 2);
+      TEST( ndfa.allocated == 2 * state_SIZE + state_SIZE_EMPTYTRANS(1) + state_SIZE_RANGETRANS(1));
       TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 0);
+      TEST( ndfa.isDFA     == 1);
       // check ndfa.states
-      helperstate[0] = (helper_state_t) { state_EMPTY, 2, (size_t[]) { 1, 3 }, 0, 0 };
-      // ndfa1
-      helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
-      helperstate[2] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-      // ndfa2
-      helperstate[3] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { 2 }, (char32_t[]) { 2 } };
-      helperstate[4] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-      helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-      TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
+      startend_automat(&ndfa, &start_state, &end_state);
+      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
+      TEST( start_state->nremptytrans == 0);
+      TEST( start_state->nrrangetrans == 1);
+      TEST( isempty_slist(&start_state->emptylist));
+      TEST( ! isempty_slist(&start_state->rangelist));
+      TEST( last_rangelist(&start_state->rangelist)->next == last_slist(&start_state->rangelist));
+      TEST( last_rangelist(&start_state->rangelist)->size == 1);
+      TEST( last_rangelist(&start_state->rangelist)->array[0].from  == 0);
+      TEST( last_rangelist(&start_state->rangelist)->array[0].to    == 5*200-1);
+      TEST( last_rangelist(&start_state->rangelist)->array[0].state == end_state);
       // reset
       TEST(0 == free_automat(&ndfa));
       reset_automatmman(mman);
-      reset_automatmman(mman2);
    }
 
-   // TEST opand_automat: empty automaton
-   TEST(0 == initempty_automat(&ndfa, &use_mman));
-   TEST(0 == initempty_automat(&ndfa1, &use_mman));
+   // TEST makedfa_automat: or'ed states and repeat
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      // prepare
+      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 0 }, (char32_t[]) { 0 }));
+      for (unsigned i = 1; i < 100; ++i) {
+         TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]) { i }, (char32_t[]) { i }));
+         TEST(0 == opor_automat(&ndfa, &ndfa2));
+      }
+      TEST(0 == oprepeat_automat(&ndfa, 1));
+      // test (slow cause every follow_empty yields more than 200 states iterated 100 times)
+      // if you have 1000 states it is slow, with 10000 very slow and with 100000 you could wait for minutes
+      // ==> OPTIMIZATION: compute follow states per state and store them in state as statevector
+      //                   use bitmap indizes instead of statevector_t
+      //                   use fast sorted multi-insert in btree
+      //                   ==> database should support all these operations with manual intervention
+      if (tc == 0) {
+         TEST( 0 == makedfa_automat(&ndfa));
+      } else {
+         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
+      }
+      // check mman released
+      TEST( 1 == refcount_automatmman(mman));
+      // check ndfa
+      TEST( ndfa.mman      != mman);
+      TEST( ndfa.nrstate   == 3);
+      TEST( ndfa.allocated == 3 * state_SIZE + state_SIZE_EMPTYTRANS(2) + 2*state_SIZE_RANGETRANS(1));
+      TEST( ! isempty_slist(&ndfa.states));
+      TEST( ndfa.isDFA     == 1);
+      // check ndfa.states
+      startend_automat(&ndfa, &start_state, &end_state);
+      state_t *next_state = next_statelist(start_state);
+      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
+      TEST( start_state->nremptytrans == 0);
+      TEST( start_state->nrrangetrans == 1);
+      TEST( isempty_slist(&start_state->emptylist));
+      TEST( ! isempty_slist(&start_state->rangelist));
+      range_transition_t* range_trans = last_rangelist(&start_state->rangelist);
+      TEST( range_trans == last_rangelist(&start_state->rangelist));
+      TEST( range_trans == (void*) ((uintptr_t)start_state + state_SIZE));
+      TEST( range_trans->size == 1);
+      TEST( range_trans->array[0].from  == 0);
+      TEST( range_trans->array[0].to    == 100-1);
+      TEST( range_trans->array[0].state == next_state);
+      TEST( next_state == (void*) &range_trans->array[1]);
+      TEST( next_state->nremptytrans == 1);
+      TEST( next_state->nrrangetrans == 1);
+      empty_transition_t* empty_trans = last_emptylist(&next_state->emptylist);
+      TEST( empty_trans->state == end_state);
+      TEST( empty_trans == (void*) ((uintptr_t)next_state + state_SIZE));
+      range_trans = first_rangelist(&next_state->rangelist);
+      TEST( range_trans == (void*) &empty_trans[1]);
+      TEST( range_trans->size == 1);
+      TEST( range_trans->array[0].from  == 0);
+      TEST( range_trans->array[0].to    == 100-1);
+      TEST( range_trans->array[0].state == next_state);
+      TEST( end_addr == &range_trans->array[1]);
+      // reset
+      TEST(0 == free_automat(&ndfa));
+      reset_automatmman(mman);
+   }
+
+   // reset
+   TEST(0 == free_automat(&ndfa1));
+
+   // === minimize states of automaton (reverse + dfa + reverse + dfa)
+
+   // TEST minimize_automat: empty automaton
+   TEST(0 == initempty_automat(&ndfa, &use_mman));
+   // test
+   TEST( 0 == minimize_automat(&ndfa));
+   // check ndfa
+   TEST( ndfa.mman      != mman);
+   TEST( refcount_automatmman(ndfa.mman) == 1);
+   TEST( ndfa.nrstate   == 2);
+   TEST( ndfa.allocated == 2 * state_SIZE + state_SIZE_EMPTYTRANS(2));
+   TEST( ! isempty_slist(&ndfa.states));
+   TEST( ndfa.isDFA     == 1);
+   helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0};
+   helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0};
+   TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
+
+
+   // TEST minimize_automat: dfa+reverse+dfa+reverse could generate an nfa
+   //                        ==> minimize_automat must call makedfa as last op
+   // prepare
+   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'b'}, (char32_t[]){'b'}));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // xb
+   TEST(0 == oprepeat_automat(&ndfa1, 0));         // (xb)*
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xb)*x
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'n'}, (char32_t[]){'n'}));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xb)*xn
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){'b'}, (char32_t[]){'b'}));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa1));   // b(xb)*xn
+   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'c'}, (char32_t[]){'c'}));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // xc
+   TEST(0 == oprepeat_automat(&ndfa1, 0));         // (xc)*
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xc)*x
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'n'}, (char32_t[]){'n'}));
+   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xc)*xn
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'c'}, (char32_t[]){'c'}));
+   TEST(0 == opsequence_automat(&ndfa2, &ndfa1));  // c(xc)*xn
+   TEST(0 == opor_automat(&ndfa, &ndfa2));         // b(xb)*xn|c(xc)*xn
+   TEST(0 == initcopy_automat(&ndfa1, &ndfa, 0));  // b(xb)*xn|c(xc)*xn
+   // test (simulate minimize_automat) without calling makedfa_automat as last operation
+   TEST( 0 == makedfa_automat(&ndfa));
+   TEST( 0 == initreverse_automat(&ndfa2, &ndfa, &use_mman));
+   TEST( 0 == free_automat(&ndfa));
+   TEST( 0 == makedfa_automat(&ndfa2));
+   TEST( 0 == initreverse_automat(&ndfa, &ndfa2, &use_mman));
+   TEST( 0 == free_automat(&ndfa2));
+   // check ndfa is type nfa and not dfa
+   next_addr = first_statelist(&ndfa.states);
+   for (unsigned i = 0; i < 3; ++i) {
+      next_addr = next_statelist(next_addr);
+   }
+   // check ndfa: 4th state has 2 transition with 'c' ==> no dfa but nfa
+   TEST(2 == ((state_t*)next_addr)->nrrangetrans);
+   TEST(last_rangelist(&((state_t*)next_addr)->rangelist)->size == 1);
+   TEST(first_rangelist(&((state_t*)next_addr)->rangelist)->size == 1);
+   TEST((char32_t)'c' == last_rangelist(&((state_t*)next_addr)->rangelist)->array[0].from);
+   TEST((char32_t)'c' == first_rangelist(&((state_t*)next_addr)->rangelist)->array[0].from);
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   reset_automatmman(mman);
+
+   // TEST minimize_automat: b(xb)*xn|c(xc)*xn
+   TEST(0 == initcopy_automat(&ndfa, &ndfa1, &use_mman));
+   TEST(0 == free_automat(&ndfa1));
    // test
-   TEST( 0 == opand_automat(&ndfa, &ndfa1));
-   // check ndfa1
-   TEST( 1 == isfree_automat(&ndfa1));
-   // check mman released
-   TEST( 1 == refcount_automatmman(mman));
+   TEST( 0 == minimize_automat(&ndfa));
    // check ndfa
    TEST( ndfa.mman      != mman);
-   TEST( ndfa.nrstate   == 2);
-   TEST( ndfa.allocated == 2*state_SIZE + 2*state_SIZE_EMPTYTRANS(1));
+   TEST( refcount_automatmman(ndfa.mman) == 1);
+   TEST( ndfa.nrstate   == 6);
+   TEST( ndfa.allocated == 6 * state_SIZE + state_SIZE_EMPTYTRANS(1) + 2*state_SIZE_RANGETRANS(1)+3*state_SIZE_RANGETRANS(2));
    TEST( ! isempty_slist(&ndfa.states));
    TEST( ndfa.isDFA     == 1);
-   // check ndfa.states
-   TEST( 0 == check_dfa_endstate(&ndfa, 0));
-   helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-   helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-   TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
+   helperstate[0] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 1, 2 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' }};
+   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 3 }, (char32_t[]) { 'x' }, (char32_t[]) { 'x' }};
+   helperstate[2] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { 'x' }, (char32_t[]) { 'x' }};
+   helperstate[3] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 1, 5 }, (char32_t[]) { 'b', 'n' }, (char32_t[]) { 'b', 'n' }};
+   helperstate[4] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 2, 5 }, (char32_t[]) { 'c', 'n' }, (char32_t[]) { 'c', 'n' }};
+   helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0};
+   TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
    // reset
    TEST(0 == free_automat(&ndfa));
    reset_automatmman(mman);
 
-   // TEST opand_automat: ab*c & abc
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
-   TEST(0 == oprepeat_automat(&ndfa2, 0));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa2));   // ab*c
-   TEST(4 == matchchar32_automat(&ndfa, 4, U"abbc", false));
-   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));   // abc
+   // TEST minimize_automat:  a(a12345|b12345)|c12345
+   TEST(0 == initempty_automat(&ndfa1, &use_mman));
+   for (unsigned i = '1'; i <= '5'; ++i) {
+      TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){i}, (char32_t[]){i}));
+      TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
+   }
+   automat_t nabc[3];
+   for (unsigned i = 'a'; i <= 'c'; ++i) {
+      TEST(0 == initmatch_automat(&nabc[i-'a'], &use_mman, 1, (char32_t[]){i}, (char32_t[]){i}));
+      TEST(0 == initcopy_automat(&ndfa2, &ndfa1, &use_mman));
+      TEST(0 == opsequence_automat(&nabc[i-'a'], &ndfa2));
+   }
+   TEST(0 == opor_automat(&nabc[0], &nabc[1]));
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){'a'}, (char32_t[]){'a'}));
+   TEST(0 == opsequence_automat(&ndfa, &nabc[0]));
+   TEST(0 == opor_automat(&ndfa, &nabc[2]));
    // test
-   TEST( 0 == opand_automat(&ndfa, &ndfa1));
-   // check ndfa1
-   TEST( 1 == isfree_automat(&ndfa1));
-   // check mman released
-   TEST( 1 == refcount_automatmman(mman));
+   TEST( 0 == minimize_automat(&ndfa));
    // check ndfa
-   TEST( 0 == matchchar32_automat(&ndfa, 4, U"abbc", false));
-   TEST( 3 == matchchar32_automat(&ndfa, 3, U"abc", false));
    TEST( ndfa.mman      != mman);
-   TEST( ndfa.nrstate   == 4);
-   TEST( ndfa.allocated == 4*state_SIZE + state_SIZE_EMPTYTRANS(1) + 3*state_SIZE_RANGETRANS(1));
+   TEST( refcount_automatmman(ndfa.mman) == 1);
+   TEST( ndfa.nrstate   == 8);
+   TEST( ndfa.allocated == 8 * state_SIZE + state_SIZE_EMPTYTRANS(1) + 6*state_SIZE_RANGETRANS(1)+state_SIZE_RANGETRANS(2));
    TEST( ! isempty_slist(&ndfa.states));
    TEST( ndfa.isDFA     == 1);
-   // check ndfa.states
-   TEST( 0 == check_dfa_endstate(&ndfa, 0));
-   helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 'a' }, (char32_t[]) { 'a' } };
-   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 'b' }, (char32_t[]) { 'b' } };
-   helperstate[2] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 3 }, (char32_t[]) { 'c' }, (char32_t[]) { 'c' } };
-   helperstate[3] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0 };
-   TEST(0 == helper_compare_states(&ndfa, 4, helperstate))
+   helperstate[0] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 1, 2 }, (char32_t[]) { 'a', 'c' }, (char32_t[]) { 'a', 'c' }};
+   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 'a' }, (char32_t[]) { 'b' }};
+   helperstate[2] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 3 }, (char32_t[]) { '1' }, (char32_t[]) { '1' }};
+   helperstate[3] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { '2' }, (char32_t[]) { '2' }};
+   helperstate[4] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 5 }, (char32_t[]) { '3' }, (char32_t[]) { '3' }};
+   helperstate[5] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 6 }, (char32_t[]) { '4' }, (char32_t[]) { '4' }};
+   helperstate[6] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 7 }, (char32_t[]) { '5' }, (char32_t[]) { '5' }};
+   helperstate[7] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 7 }, 0, 0};
+   TEST(0 == helper_compare_states(&ndfa, 8, helperstate))
    // reset
    TEST(0 == free_automat(&ndfa));
+   TEST(0 == free_automat(&ndfa1));
    reset_automatmman(mman);
 
-   // TEST opandnot_automat
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
-   TEST(0 == oprepeat_automat(&ndfa2, 0));
+   // TEST minimize_automat:  (xy(zy)*)*
+   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'y'}, (char32_t[]){'y'}));
    TEST(0 == opsequence_automat(&ndfa, &ndfa2));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa2));   // ab*c
-   TEST(4 == matchchar32_automat(&ndfa, 4, U"abbc", false));
-   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){'z'}, (char32_t[]){'z'}));
+   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'y'}, (char32_t[]){'y'}));
    TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));   // abc
+   TEST(0 == oprepeat_automat(&ndfa1, 0));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa1));
+   TEST(0 == oprepeat_automat(&ndfa, 0));
    // test
-   TEST( 0 == opandnot_automat(&ndfa, &ndfa1));
-   // check ndfa1
-   TEST( 1 == isfree_automat(&ndfa1));
-   // check mman released
-   TEST( 1 == refcount_automatmman(mman));
+   TEST( 0 == minimize_automat(&ndfa));
    // check ndfa
-   TEST( 4 == matchchar32_automat(&ndfa, 4, U"abbc", false));
-   TEST( 2 == matchchar32_automat(&ndfa, 2, U"ac", false));
-   TEST( 0 == matchchar32_automat(&ndfa, 3, U"abc", false));
    TEST( ndfa.mman      != mman);
-   TEST( ndfa.nrstate   == 6);
-   TEST( ndfa.allocated == 6*state_SIZE + state_SIZE_EMPTYTRANS(1) + 3*state_SIZE_RANGETRANS(2) + state_SIZE_RANGETRANS(1));
+   TEST( refcount_automatmman(ndfa.mman) == 1);
+   TEST( ndfa.nrstate   == 4);
+   TEST( ndfa.allocated == 4 * state_SIZE + state_SIZE_EMPTYTRANS(3) + 2*state_SIZE_RANGETRANS(1)+state_SIZE_RANGETRANS(2));
    TEST( ! isempty_slist(&ndfa.states));
    TEST( ndfa.isDFA     == 1);
-   // check ndfa.states
-   TEST( 0 == check_dfa_endstate(&ndfa, 0));
-   helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 'a' }, (char32_t[]) { 'a' } };
-   helperstate[1] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 2, 5 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' } };
-   helperstate[2] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 3, 4 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' } };
-   helperstate[3] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 3, 5 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' } };
-   helperstate[4] = (helper_state_t) { state_RANGE, 0, 0, 0, 0 }; // error state
-   helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0 };
-   TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
+   helperstate[0] = (helper_state_t) { state_RANGE_ENDSTATE, 1, (size_t[]) { 1 }, (char32_t[]) { 'x' }, (char32_t[]) { 'x' }};
+   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 'y' }, (char32_t[]) { 'y' }};
+   helperstate[2] = (helper_state_t) { state_RANGE_ENDSTATE, 2, (size_t[]) { 1, 1 }, (char32_t[]) { 'x', 'z' }, (char32_t[]) { 'x', 'z' }};
+   helperstate[3] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0};
+   TEST(0 == helper_compare_states(&ndfa, 4, helperstate))
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == free_automat(&ndfa1));
+   reset_automatmman(mman);
+
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == free_automat(&ndfa1));
+   TEST(0 == free_automat(&ndfa2));
+   TEST(0 == delete_automatmman(&mman));
+
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa1);
+   free_automat(&ndfa2);
+   delete_automatmman(&mman);
+   return EINVAL;
+}
+
+static int test_makedfapar(void)
+{
+   automat_t ndfa  = automat_FREE;
+   automat_t ndfa2 = automat_FREE;
+   automat_t dfa   = automat_FREE;
+   const size_t N = 10;
+   unsigned  nrthread[] = { 1, 2, 4, 7, 0 };
+
+   // TEST makedfapar_automat: EINVAL
+   TEST( EINVAL == makedfapar_automat(&ndfa, 1));
+
+   // prepare: ndfa = "(a|b)*a(a|b){N}|c(a|b|c)*" (DFA has more than 2^(N+1) states)
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+   TEST(0 == oprepeat_automat(&ndfa, false));
+   TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   for (size_t i = 0; i < N; ++i) {
+      TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+      TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   }
+   TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'c' }));
+   TEST(0 == oprepeat_automat(&ndfa2, false));
+   TEST(0 == initmatch_automat(&dfa, &ndfa, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
+   TEST(0 == opsequence_automat(&dfa, &ndfa2));
+   TEST(0 == opor_automat(&ndfa, &dfa));
+   TEST(0 == initcopy_automat(&dfa, &ndfa, 0));
+   TEST(0 == makedfa_automat(&dfa));
+   TEST(nrstate_automat(&dfa) > ((size_t)2 << N));
+
+   // TEST makedfapar_automat: same result as makedfa_automat for any number of threads
+   for (unsigned i = 0; i < lengthof(nrthread); ++i) {
+      TEST(0 == initcopy_automat(&ndfa2, &ndfa, 0));
+      TEST(0 == makedfapar_automat(&ndfa2, nrthread[i]));
+      TEST(1 == ndfa2.isDFA);
+      TEST(1 == refcount_automatmman(ndfa2.mman));
+      TEST(nrstate_automat(&dfa) == nrstate_automat(&ndfa2));
+      TEST(dfa.allocated == ndfa2.allocated);
+      state_t* s2 = first_statelist(&ndfa2.states);
+      foreach (_statelist, s, &dfa.states) {
+         s->dest = s2;
+         s2 = next_statelist(s2);
+      }
+      foreach (_statelist, s, &dfa.states) {
+         s2 = s->dest;
+         TEST(s->nremptytrans == s2->nremptytrans);
+         TEST(s->nrrangetrans == s2->nrrangetrans);
+         foreach (_emptylist, empty_trans, &s->emptylist) {
+            TEST(empty_trans->state->dest == last_emptylist(&s2->emptylist)->state);
+         }
+         range_transition_t* trans2 = last_rangelist(&s2->rangelist);
+         foreach (_rangelist, trans, &s->rangelist) {
+            trans2 = next_rangelist(trans2);
+            TEST(trans->size == trans2->size);
+            for (size_t r = 0; r < trans->size; ++r) {
+               TEST(trans->array[r].from == trans2->array[r].from);
+               TEST(trans->array[r].to   == trans2->array[r].to);
+               TESTP(trans->array[r].state->dest == trans2->array[r].state, "nrthread:%d", nrthread[i]);
+            }
+         }
+      }
+      TEST(0 == free_automat(&ndfa2));
+   }
+
+   // TEST makedfapar_automat: empty automat
+   TEST(0 == initempty_automat(&ndfa2, 0));
+   TEST(0 == makedfapar_automat(&ndfa2, 4));
+   TEST(1 == ndfa2.isDFA);
+   TEST(2 == nrstate_automat(&ndfa2));
+   TEST(0 == matchchar32_automat(&ndfa2, 1, U"a", true));
+   TEST(0 == free_automat(&ndfa2));
+
+   // TEST makedfapar_automat: ENOMEM
+   for (unsigned timercount = 1; timercount <= 8; ++timercount) {
+      TEST(0 == initcopy_automat(&ndfa2, &ndfa, 0));
+      init_testerrortimer(&s_automat_errtimer, timercount, ENOMEM);
+      size_t oldsize = SIZEALLOCATED_PAGECACHE();
+      int err = makedfapar_automat(&ndfa2, 1);
+      if (err == 0) {
+         free_testerrortimer(&s_automat_errtimer);
+         TEST(1 == ndfa2.isDFA);
+      } else {
+         TEST(ENOMEM == err);
+         TEST(0 == ndfa2.isDFA);
+         TEST(oldsize == SIZEALLOCATED_PAGECACHE());
+      }
+      TEST(0 == free_automat(&ndfa2));
+   }
+
+   // reset
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == free_automat(&dfa));
+
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   free_automat(&dfa);
+   return EINVAL;
+}
+
+static int test_matchutf8(void)
+{
+   automat_t ndfa  = automat_FREE;
+   automat_t ndfa2 = automat_FREE;
+   uint8_t   utf8[6*4];
+   char32_t  chr[4];
+   char32_t  from[8] = { 'a', 0x80, 0x7ff, 0xfff0, 0x10000, 0x7fffffff, 0x3ff0000, 0x1000 };
+   char32_t  to[8]   = { 'z', 0x100, 0x801, 0x10010, 0x10ffff, (char32_t)-1, 0x4000010, 0x1000 };
+   char32_t  probe[] = {
+      0, 'a'-1, 'a', 'z', 'z'+1, 0x7f, 0x80, 0xff, 0x100, 0x101, 0x7fe, 0x7ff, 0x800, 0x801, 0x802,
+      0xfff, 0x1000, 0x1001, 0xffef, 0xfff0, 0xffff, 0x10000, 0x10010, 0x10011, 0x10ffff, 0x110000,
+      0x1fffff, 0x200000, 0x3feffff, 0x3ff0000, 0x3ffffff, 0x4000000, 0x4000010, 0x4000011,
+      0x7ffffffe, 0x7fffffff
+   };
+
+   // TEST matchutf8_automat: EINVAL
+   TEST( 0 == matchutf8_automat(&ndfa, 1, (const uint8_t*)"a", true));
+
+   // TEST makeutf8_automat: EINVAL
+   TEST( EINVAL == makeutf8_automat(&ndfa));
+
+   // TEST makeutf8_automat: single ranges of different encoding sizes
+   for (unsigned r = 0; r < lengthof(from); ++r) {
+      // prepare
+      TEST(0 == initmatch_automat(&ndfa, 0, 1, &from[r], &to[r]));
+      TEST(0 == initcopy_automat(&ndfa2, &ndfa, 0));
+      TEST(0 == makedfa_automat(&ndfa));
+      // test
+      TEST(0 == makeutf8_automat(&ndfa2));
+      TEST(1 == ndfa2.isDFA);
+      TEST(0 == matchutf8_automat(&ndfa2, 0, utf8, true));
+      for (unsigned i = 0; i < lengthof(probe); ++i) {
+         size_t len = encodechar_utf8(probe[i], sizeof(utf8), utf8);
+         TEST(len > 0);
+         size_t ismatch = matchchar32_automat(&ndfa, 1, &probe[i], true);
+         TESTP( ismatch*len == matchutf8_automat(&ndfa2, len, utf8, true), "r:%d i:%d", r, i);
+         // check prefix of multibyte sequence is not matched
+         TEST( 0 == matchutf8_automat(&ndfa2, len-1, utf8, true));
+      }
+      // reset
+      TEST(0 == free_automat(&ndfa));
+      TEST(0 == free_automat(&ndfa2));
+   }
+
+   // TEST makeutf8_automat: all ranges combined (shared prefixes are merged)
+   TEST(0 == initmatch_automat(&ndfa, 0, lengthof(from), from, to));
+   TEST(0 == initcopy_automat(&ndfa2, &ndfa, 0));
+   TEST(0 == makeutf8_automat(&ndfa2));
+   for (unsigned i = 0; i < lengthof(probe); ++i) {
+      size_t len = encodechar_utf8(probe[i], sizeof(utf8), utf8);
+      size_t ismatch = matchchar32_automat(&ndfa, 1, &probe[i], true);
+      TESTP( ismatch*len == matchutf8_automat(&ndfa2, len, utf8, true), "i:%d", i);
+   }
    // reset
    TEST(0 == free_automat(&ndfa));
-   reset_automatmman(mman);
+   TEST(0 == free_automat(&ndfa2));
 
-   // TEST opnot_automat
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
-   TEST(0 == oprepeat_automat(&ndfa2, 0));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
-   TEST(3 == matchchar32_automat(&ndfa, 3, U"abb", true));
-   // test: !(ab*)
-   TEST( 0 == opnot_automat(&ndfa))
-   // check mman released
-   TEST( 1 == refcount_automatmman(mman));
-   // check ndfa
-   TEST( 0 == matchchar32_automat(&ndfa, 3, U"abb", true));
-   TEST( 2 == matchchar32_automat(&ndfa, 2, U"bb", true));
-   TEST( 3 == matchchar32_automat(&ndfa, 3, U"abc", true));
-   TEST( ndfa.mman      != mman);
-   TEST( ndfa.nrstate   == 4);
-   TEST( ndfa.allocated == 4*state_SIZE + state_SIZE_EMPTYTRANS(3) + 2*state_SIZE_RANGETRANS(3)+state_SIZE_RANGETRANS(1));
-   TEST( ! isempty_slist(&ndfa.states));
-   TEST( ndfa.isDFA     == 1);
-   // check ndfa.states
-   TEST( 0 == check_dfa_endstate(&ndfa, 0));
-   helperstate[0] = (helper_state_t) { state_RANGE_ENDSTATE, 3, (size_t[]) { 1,2,1 }, (char32_t[]) { 0, 'a', 'b' }, (char32_t[]) { 'a'-1u, 'a', (char32_t)-1} };
-   helperstate[1] = (helper_state_t) { state_RANGE_ENDSTATE, 1, (size_t[]) { 1 }, (char32_t[]) { 0 }, (char32_t[]) { (char32_t)-1 } };
-   helperstate[2] = (helper_state_t) { state_RANGE, 3, (size_t[]) { 1,2,1 }, (char32_t[]) { 0, 'b', 'c' }, (char32_t[]) { 'a', 'b', (char32_t)-1} };
-   helperstate[3] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0 };
-   TEST(0 == helper_compare_states(&ndfa, 4, helperstate))
+   // TEST matchutf8_automat: longest and shortest match of ([0x80-0x7ff0]|[0x10000])+
+   TEST(0 == initmatch_automat(&ndfa, 0, 2, (char32_t[]){ 0x80, 0x10000 }, (char32_t[]){ 0x7ff0, 0x10000 }));
+   TEST(0 == oprepeat_automat(&ndfa, true));
+   TEST(0 == makeutf8_automat(&ndfa));
+   chr[0] = 0x80; chr[1] = 0x10000; chr[2] = 0x7ff0; chr[3] = 0x7ff1;
+   size_t len = 0;
+   for (unsigned i = 0; i < lengthof(chr); ++i) {
+      len += encodechar_utf8(chr[i], sizeof(utf8)-len, utf8+len);
+   }
+   TEST( 2 == matchutf8_automat(&ndfa, len, utf8, false));
+   TEST( 2+4+3 == matchutf8_automat(&ndfa, len, utf8, true));
+   TEST( 2+4 == matchutf8_automat(&ndfa, 2+4+2, utf8, true));
    // reset
    TEST(0 == free_automat(&ndfa));
-   reset_automatmman(mman);
 
-   // TEST opnot_automat: not reverses previous not
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      switch (tc) {
-      case 0:
-         TEST(0 == initempty_automat(&ndfa, &use_mman));
-         break;
-      case 1:
-         TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'z' }));
-         break;
+   // TEST matchutf8_automat: empty string is matched
+   TEST(0 == initempty_automat(&ndfa, 0));
+   TEST(0 == makeutf8_automat(&ndfa));
+   TEST( 0 == matchutf8_automat(&ndfa, 1, (const uint8_t*)"a", true));
+   // reset
+   TEST(0 == free_automat(&ndfa));
+
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   return EINVAL;
+}
+
+typedef struct helper_matchspan_t {
+   size_t nrmatch;
+   size_t start[64];
+   size_t end[64];
+   int    err;
+} helper_matchspan_t;
+
+static int helper_matchspan(void* context, size_t start, size_t end)
+{
+   helper_matchspan_t* spans = context;
+   if (spans->nrmatch < lengthof(spans->start)) {
+      spans->start[spans->nrmatch] = start;
+      spans->end[spans->nrmatch] = end;
+   }
+   ++ spans->nrmatch;
+   return spans->err;
+}
+
+/* function: helper_build_automat
+ * Erzeugt ndfa aus einem String, der nur aus Kleinbuchstaben besteht.
+ * Die Zeichen '|' und '*' stehen für oder und Wiederholung des vorherigen Zeichens. */
+static int helper_build_automat(/*out*/automat_t* ndfa, const char* def)
+{
+   automat_t seq = automat_FREE;
+   automat_t chr = automat_FREE;
+
+   TEST(0 == initempty_automat(&seq, 0));
+   for (const char* c = def; ; ++c) {
+      if (*c == '|' || *c == 0) {
+         if (isfree_automat(ndfa)) {
+            initmove_automat(ndfa, &seq);
+         } else {
+            TEST(0 == opor_automat(ndfa, &seq));
+         }
+         if (*c == 0) break;
+         TEST(0 == initempty_automat(&seq, ndfa));
+      } else {
+         char32_t ch = (char32_t) *c;
+         TEST(0 == initmatch_automat(&chr, &seq, 1, &ch, &ch));
+         if (c[1] == '*') {
+            ++c;
+            TEST(0 == oprepeat_automat(&chr, false));
+         }
+         TEST(0 == opsequence_automat(&seq, &chr));
       }
-      // test
-      TEST( 0 == opnot_automat(&ndfa))
-      TEST( 0 == opnot_automat(&ndfa))
-      TEST( 0 == minimize_automat(&ndfa))
-      // check mman released
-      TEST( 1 == refcount_automatmman(mman));
-      // check ndfa
-      TEST( ndfa.mman      != mman);
-      TEST( ndfa.nrstate   == 2);
-      TEST( ndfa.allocated == 2*state_SIZE + state_SIZE_EMPTYTRANS(1) + (tc?state_SIZE_RANGETRANS(1):state_SIZE_EMPTYTRANS(1)));
-      TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 1);
-      // check ndfa.states
-      TEST( 0 == check_dfa_endstate(&ndfa, 0));
-      switch (tc) {
-      case 0:
-         helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-         break;
-      case 1:
-         helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 'a' }, (char32_t[]) { 'z' } };
+   }
+   TEST(0 == minimize_automat(ndfa));
+   TEST(0 == free_automat(&seq));
+
+   return 0;
+ONERR:
+   free_automat(&seq);
+   free_automat(&chr);
+   return EINVAL;
+}
+
+static int test_search(void)
+{
+   automat_t ndfa  = automat_FREE;
+   automat_search_t search = automat_search_FREE;
+   helper_matchspan_t spans;
+   size_t    start;
+   size_t    end;
+   char32_t  str[40];
+   const char* pattern[] = { "abcd|c", "a*", "b", "ab*", "abab|bc|a", "cd*c|db*", "a*b*c*d*|dddd" };
+   uint32_t  random = 12345;
+
+   // TEST search_automat: EINVAL
+   TEST( EINVAL == search_automat(&ndfa, 1, U"a", &start, &end));
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST( EINVAL == search_automat(&ndfa, 1, U"a", &start, &end));
+   TEST( EINVAL == searchall_automat(&ndfa, 1, U"a", &helper_matchspan, &spans));
+   TEST( EINVAL == init_automatsearch(&search, &ndfa));
+   TEST( 0 == search.prefix.mman);
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST automat_search_FREE
+   TEST( 0 == search.prefix.mman);
+   TEST( 0 == search.reverse.mman);
+
+   // TEST find_automatsearch, findall_automatsearch: EINVAL (not initialized)
+   TEST( EINVAL == find_automatsearch(&search, 1, U"a", &start, &end));
+   TEST( EINVAL == findall_automatsearch(&search, 1, U"a", &helper_matchspan, &spans));
+
+   // TEST init_automatsearch, free_automatsearch
+   TEST(0 == helper_build_automat(&ndfa, "abcd|c"));
+   TEST( 0 == init_automatsearch(&search, &ndfa));
+   TEST( 0 != search.prefix.mman);
+   TEST( 0 != search.reverse.mman);
+   TEST( 0 == free_automatsearch(&search));
+   TEST( 0 == search.prefix.mman);
+   TEST( 0 == search.reverse.mman);
+   TEST( 0 == free_automatsearch(&search));
+
+   // TEST init_automatsearch: ENOMEM
+   for (unsigned i = 1; i < 10; ++i) {
+      init_testerrortimer(&s_automat_errtimer, i, ENOMEM);
+      int err = init_automatsearch(&search, &ndfa);
+      free_testerrortimer(&s_automat_errtimer);
+      TEST( 0 == err || ENOMEM == err);
+      if (!err) {
+         TEST(0 == free_automatsearch(&search));
          break;
       }
-      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-      TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
-      // reset
-      TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
+      TEST( 0 == search.prefix.mman);
+      TEST( 0 == search.reverse.mman);
    }
 
-   // === simulated ERROR in copy operation
+   // TEST find_automatsearch: search is reusable
+   TEST( 0 == init_automatsearch(&search, &ndfa));
+   for (unsigned r = 0; r < 2; ++r) {
+      TEST( 0 == find_automatsearch(&search, 6, U"xabcdx", &start, &end));
+      TEST( 1 == start);
+      TEST( 5 == end);
+      TEST( ESRCH == find_automatsearch(&search, 4, U"xabx", &start, &end));
+   }
+   TEST( 0 == free_automatsearch(&search));
+   TEST(0 == free_automat(&ndfa));
 
-   for (unsigned count = 1; count <= 3; ++ count) {
-      for (unsigned tc = 0; tc <= 1; ++tc) {
-         // prepare
-         int err = (int) (3+count);
-         TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 1 }, (char32_t[]) { 1 } ));
-         TEST(0 == initmatch_automat(&ndfa2, &use_mman2, 1, (char32_t[]) { 2 }, (char32_t[]) { 2 } ));
-         S = sizeallocated_automatmman(mman);
-         init_testerrortimer(&s_automat_errtimer, count, err);
-         switch (tc) {
-         case 0:  // TEST opsequence_automat: ERROR in copy operation
-                  TEST( err == opsequence_automat(&ndfa, &ndfa2));
-                  break;
-         case 1:  // TEST opor_automat: ERROR in copy operation
-                  TEST( err == opor_automat(&ndfa, &ndfa2));
-                  break;
+   // TEST search_automat: leftmost match is found even if a later match ends first
+   TEST(0 == helper_build_automat(&ndfa, "abcd|c"));
+   TEST( 0 == search_automat(&ndfa, 6, U"xabcdx", &start, &end));
+   TEST( 1 == start);
+   TEST( 5 == end);
+   TEST( 0 == search_automat(&ndfa, 5, U"xabcx", &start, &end));
+   TEST( 3 == start);
+   TEST( 4 == end);
+   TEST( ESRCH == search_automat(&ndfa, 4, U"xabx", &start, &end));
+   TEST( ESRCH == search_automat(&ndfa, 0, U"", &start, &end));
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST searchall_automat: compare with matchchar32_automat at every position
+   for (unsigned p = 0; p < lengthof(pattern); ++p) {
+      TEST(0 == helper_build_automat(&ndfa, pattern[p]));
+      TEST(0 == init_automatsearch(&search, &ndfa));
+      const bool isempty = isendstate_automat(&ndfa, 0);
+      for (unsigned tc = 0; tc < 100; ++tc) {
+         const size_t len = tc % lengthof(str);
+         for (size_t i = 0; i < len; ++i) {
+            random = random * 1103515245 + 12345;
+            str[i] = (char32_t) ('a' + (random >> 16) % 4);
+         }
+         memset(&spans, 0, sizeof(spans));
+         TEST(0 == searchall_automat(&ndfa, len, str, &helper_matchspan, &spans));
+         // findall_automatsearch returns the same matches
+         helper_matchspan_t spans2;
+         memset(&spans2, 0, sizeof(spans2));
+         TEST(0 == findall_automatsearch(&search, len, str, &helper_matchspan, &spans2));
+         TEST(0 == memcmp(&spans, &spans2, sizeof(spans)));
+         size_t nrmatch = 0;
+         for (size_t offset = 0; offset <= len; ) {
+            size_t s = offset;
+            size_t matchlen = 0;
+            for (; s <= len; ++s) {
+               matchlen = matchchar32_automat(&ndfa, len-s, str+s, true);
+               if (matchlen || isempty) break;
+            }
+            if (s > len) break;
+            TEST(nrmatch < spans.nrmatch);
+            TESTP(s == spans.start[nrmatch], "p:%d tc:%d s:%zd start:%zd", p, tc, s, spans.start[nrmatch]);
+            TEST(s+matchlen == spans.end[nrmatch]);
+            if (!nrmatch) {
+               TEST(0 == search_automat(&ndfa, len, str, &start, &end));
+               TEST(s == start && s+matchlen == end);
+            }
+            ++ nrmatch;
+            offset = s + matchlen + (matchlen == 0);
+         }
+         TEST(nrmatch == spans.nrmatch);
+         if (!nrmatch) {
+            TEST(ESRCH == search_automat(&ndfa, len, str, &start, &end));
          }
-         // check ndfa: not changed
-         helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 1 }, (char32_t[]) { 1 } };
-         helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-         TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
-         // check ndfa2: not changed
-         helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { 2 }, (char32_t[]) { 2 } };
-         helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-         TEST( 0 == helper_compare_states(&ndfa2, 2, helperstate))
-         // check mman, mman2
-         TEST( refcount_automatmman(mman)      == (count <= 2 ? 2 : 3));
-         TEST( sizeallocated_automatmman(mman) <= 2*S);
-         TEST( wasted_automatmman(mman)        == 0);
-         TEST( refcount_automatmman(mman2)     == (count <= 2 ? 2 : 1));
-         TEST( sizeallocated_automatmman(mman2) == S);
-         TEST( wasted_automatmman(mman2)       == (count <= 2 ? 0 : S));
-         // reset
-         TEST(0 == free_automat(&ndfa));
-         TEST(0 == free_automat(&ndfa2));
-         reset_automatmman(mman);
-         reset_automatmman(mman2);
       }
+      TEST(0 == free_automatsearch(&search));
+      TEST(0 == free_automat(&ndfa));
    }
 
-   // === simulated ERROR (no copy)
+   // TEST findall_automatsearch: prefix ends behind every match ==> every character is read at most 3 times
+   TEST(0 == helper_build_automat(&ndfa, "ab"));
+   TEST(0 == init_automatsearch(&search, &ndfa));
+   for (size_t i = 0; i < lengthof(str); ++i) {
+      str[i] = (char32_t) (i % 2 ? 'b' : 'a');
+   }
+   memset(&spans, 0, sizeof(spans));
+   s_automatsearch_nrread = 0;
+   TEST(0 == findall_automatsearch(&search, lengthof(str), str, &helper_matchspan, &spans));
+   TEST(lengthof(str)/2 == spans.nrmatch);
+   TEST(s_automatsearch_nrread <= 2*lengthof(str) + spans.nrmatch);
+   TEST(0 == free_automatsearch(&search));
+   TEST(0 == free_automat(&ndfa));
 
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, from+1, to+1));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, from+2, to+2));
-   S = sizeallocated_automatmman(mman);
-   for (unsigned tc = 0; tc <= 4; ++tc) {
-      // prepare
-      int err = (int) (tc+4);
-      init_testerrortimer(&s_automat_errtimer, 1, (int) err);
-      switch (tc) {
-      case 0:  // TEST opsequence_automat: simulated ERROR
-               TEST( err == opsequence_automat(&ndfa, &ndfa2));
-               break;
-      case 1:  // TEST opor_automat: simulated ERROR
-               TEST( err == opor_automat(&ndfa, &ndfa2));
-               break;
-      case 2:  // TEST opand_automat: simulated ERROR
-               TEST( err == opand_automat(&ndfa, &ndfa2));
-               break;
-      case 3:  // TEST opandnot_automat: simulated ERROR
-               TEST( err == opandnot_automat(&ndfa, &ndfa2));
-               break;
-      case 4:  // TEST opnot_automat: simulated ERROR
-               TEST( err == opnot_automat(&ndfa));
-               break;
+   // TEST findall_automatsearch: worst case "a|a*b" reads str behind every match again
+   TEST(0 == helper_build_automat(&ndfa, "a|a*b"));
+   TEST(0 == init_automatsearch(&search, &ndfa));
+   for (size_t len = 1; len <= lengthof(str); ++len) {
+      for (size_t i = 0; i < len; ++i) {
+         str[i] = 'a';
+      }
+      memset(&spans, 0, sizeof(spans));
+      s_automatsearch_nrread = 0;
+      TEST(0 == findall_automatsearch(&search, len, str, &helper_matchspan, &spans));
+      TEST(len == spans.nrmatch);
+      TEST(s_automatsearch_nrread <= len*(len+1)/2 + len);
+      // a 'b' at the end makes the first match the longest ==> linear
+      str[len-1] = 'b';
+      memset(&spans, 0, sizeof(spans));
+      s_automatsearch_nrread = 0;
+      TEST(0 == findall_automatsearch(&search, len, str, &helper_matchspan, &spans));
+      TEST(1 == spans.nrmatch);
+      TEST(s_automatsearch_nrread <= 2*len);
+   }
+   TEST(0 == free_automatsearch(&search));
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST searchall_automat: matchspan returns error
+   TEST(0 == helper_build_automat(&ndfa, "b"));
+   memset(&spans, 0, sizeof(spans));
+   spans.err = EINTR;
+   TEST(EINTR == searchall_automat(&ndfa, 3, U"bbb", &helper_matchspan, &spans));
+   TEST(1 == spans.nrmatch);
+   TEST(0 == free_automat(&ndfa));
+
+   return 0;
+ONERR:
+   free_automatsearch(&search);
+   free_automat(&ndfa);
+   return EINVAL;
+}
+
+static int test_lazydfa(void)
+{
+   automat_t          ndfa  = automat_FREE;
+   automat_t          ndfa2 = automat_FREE;
+   automat_lazydfa_t* lazy  = 0;
+   char32_t           str[64];
+   uint32_t           random = 4711;
+   const size_t       N = 12;
+
+   // prepare: ndfa = "(a|b)*a(a|b){N}" (DFA has 2^(N+1) states)
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+   TEST(0 == oprepeat_automat(&ndfa, false));
+   TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   for (size_t i = 0; i < N; ++i) {
+      TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+      TEST(0 == opsequence_automat(&ndfa, &ndfa2));
+   }
+
+   // TEST new_automatlazydfa: EINVAL
+   TEST( EINVAL == new_automatlazydfa(&lazy, &ndfa2, 0));
+   TEST( 0 == lazy);
+
+   // TEST new_automatlazydfa: ENOMEM
+   init_testerrortimer(&s_automat_errtimer, 1, ENOMEM);
+   TEST( ENOMEM == new_automatlazydfa(&lazy, &ndfa, 0));
+   TEST( 0 == lazy);
+
+   // TEST new_automatlazydfa
+   TEST( 0 == new_automatlazydfa(&lazy, &ndfa, 2*1024*1024));
+   TEST( 0 != lazy);
+   TEST( 0 == nrstate_automatlazydfa(lazy));
+   TEST( 0 == nrflush_automatlazydfa(lazy));
+
+   // TEST delete_automatlazydfa
+   TEST( 0 == delete_automatlazydfa(&lazy));
+   TEST( 0 == lazy);
+   TEST( 0 == delete_automatlazydfa(&lazy));
+   TEST( 0 == lazy);
+
+   // TEST matchchar32_automatlazydfa: same result as matchchar32_automat (with and without flushing)
+   for (unsigned tc = 0; tc <= 2; ++tc) {
+      TEST( 0 == new_automatlazydfa(&lazy, &ndfa, tc == 0 ? (size_t)-1 : tc == 1 ? 0 : 16*1024));
+      for (unsigned i = 0; i < 200; ++i) {
+         const size_t len = i % lengthof(str);
+         for (size_t c = 0; c < len; ++c) {
+            random = random * 1103515245 + 12345;
+            str[c] = (char32_t) ((random >> 16) % 17 ? 'a' + (random >> 20) % 2 : 'c');
+         }
+         for (unsigned isLongest = 0; isLongest <= 1; ++isLongest) {
+            size_t L = matchchar32_automat(&ndfa, len, str, isLongest);
+            TESTP( L == matchchar32_automatlazydfa(lazy, len, str, isLongest), "tc:%d i:%d", tc, i);
+         }
       }
-      // check ndfa: not changed
-      helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { from[1] }, (char32_t[]) { to[1] } };
-      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-      TEST( 0 == helper_compare_states(&ndfa, 2, helperstate))
-      // check ndfa2: not changed
-      helperstate[0] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 1 }, (char32_t[]) { from[2] }, (char32_t[]) { to[2] } };
-      helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-      TEST( 0 == helper_compare_states(&ndfa2, 2, helperstate))
-      // check mman
-      TEST( 0 == wasted_automatmman(mman));
-      TEST( S == sizeallocated_automatmman(mman));
-      TEST( 3 == refcount_automatmman(mman));
+      if (tc == 0) {
+         TEST( 0 == nrflush_automatlazydfa(lazy));
+         TEST( 1 <  nrstate_automatlazydfa(lazy));
+      } else {
+         TEST( 0 <  nrflush_automatlazydfa(lazy));
+      }
+      if (tc == 2) {
+         TEST( 16*1024 + 65536 > sizeallocated_automatmman(lazy->mman[LAZYDFA_CACHE]));
+      }
+      TEST( 0 == delete_automatlazydfa(&lazy));
    }
+
+   // TEST matchchar32_automatlazydfa: ENOMEM
+   TEST( 0 == new_automatlazydfa(&lazy, &ndfa, 0));
+   init_testerrortimer(&s_automat_errtimer, 1, ENOMEM);
+   TEST( 0 == matchchar32_automatlazydfa(lazy, 14, U"aaaaaaaaaaaaaa", true));
+   TEST( 14 == matchchar32_automatlazydfa(lazy, 14, U"aaaaaaaaaaaaaa", true));
+   TEST( 0 == delete_automatlazydfa(&lazy));
+
+   // TEST matchchar32_automatlazydfa: empty string
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == initempty_automat(&ndfa, 0));
+   TEST( 0 == new_automatlazydfa(&lazy, &ndfa, 0));
+   TEST( 0 == matchchar32_automatlazydfa(lazy, 1, U"a", true));
+   TEST( 0 == matchchar32_automatlazydfa(lazy, 1, U"a", false));
+   TEST( 1 == nrstate_automatlazydfa(lazy));
+   TEST( 0 == delete_automatlazydfa(&lazy));
+
    // reset
    TEST(0 == free_automat(&ndfa));
-   TEST(0 == free_automat(&ndfa2));
-   reset_automatmman(mman);
 
-   // === EINVAL
+   return 0;
+ONERR:
+   delete_automatlazydfa(&lazy);
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   return EINVAL;
+}
 
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, from+1, to+1));
-   S = sizeallocated_automatmman(mman);
-   for (unsigned tc = 0; tc <= 5; ++tc) {
-      // prepare
-      switch (tc) {
-      case 0:  // TEST opsequence_automat: EINVAL empty ndfa
-               TEST( EINVAL == opsequence_automat(&ndfa,  &ndfa2));
-               TEST( EINVAL == opsequence_automat(&ndfa2, &ndfa));
-               break;
-      case 1:  // TEST oprepeat_automat: EINVAL empty ndfa
-               TEST( EINVAL == oprepeat_automat(&ndfa, 0));
-               break;
-      case 2:  // TEST opor_automat: EINVAL empty ndfa
-               TEST( EINVAL == opor_automat(&ndfa,  &ndfa2));
-               TEST( EINVAL == opor_automat(&ndfa2, &ndfa));
-               break;
-      case 3:  // TEST opand_automat: EINVAL empty ndfa
-               TEST( EINVAL == opand_automat(&ndfa,  &ndfa2));
-               TEST( EINVAL == opand_automat(&ndfa2, &ndfa));
-               break;
-      case 4:  // TEST opandnot_automat: EINVAL empty ndfa
-               TEST( EINVAL == opandnot_automat(&ndfa,  &ndfa2));
-               TEST( EINVAL == opandnot_automat(&ndfa2, &ndfa));
-               break;
-      case 5:  // TEST opnot_automat: EINVAL empty ndfa
-               TEST( EINVAL == opnot_automat(&ndfa));
-               break;
+static int test_matchids(void)
+{
+   automat_t   ndfa  = automat_FREE;
+   automat_t   ndfa2 = automat_FREE;
+   automat_t   single[7] = { automat_FREE };
+   bool        ismatch[lengthof(single)+1];
+   char32_t    str[16];
+   uint32_t    random = 333;
+   const char* pattern[lengthof(single)] = { "ab", "a*", "abc", "ba|cd", "b*d", "dcba", "c*" };
+
+   // TEST automat_MAXMATCHID: match ids do not overlap tags
+   static_assert(matchid_CHAR(automat_MAXMATCHID) < automat_MINTAGCHAR, "no overlap");
+   static_assert(matchid_CHAR(automat_MAXMATCHID) > matchid_CHAR(0), "no overflow");
+
+   // TEST opmatchid_automat: EINVAL
+   TEST( EINVAL == opmatchid_automat(&ndfa, 0));
+   TEST(0 == initempty_automat(&ndfa, 0));
+   TEST( EINVAL == opmatchid_automat(&ndfa, automat_MAXMATCHID+1));
+
+   // TEST matchids_automat: EINVAL (no DFA)
+   TEST( 0 == opmatchid_automat(&ndfa, automat_MAXMATCHID));
+   ismatch[0] = true;
+   TEST( 0 == matchids_automat(&ndfa, 0, str, 1, ismatch));
+   TEST( true == ismatch[0]);
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST matchids_automat: match id which is out of range is ignored
+   TEST(0 == initempty_automat(&ndfa, 0));
+   TEST( 0 == opmatchid_automat(&ndfa, 1));
+   TEST( 0 == makedfa_automat(&ndfa));
+   TEST( 0 == matchids_automat(&ndfa, 0, str, 1, ismatch));
+   TEST( 1 == matchids_automat(&ndfa, 0, str, 2, ismatch));
+   TEST( false == ismatch[0]);
+   TEST( true  == ismatch[1]);
+   // tagged automaton matches nothing
+   TEST( 0 == matchchar32_automat(&ndfa, 0, str, true));
+   TEST(0 == free_automat(&ndfa));
+
+   // prepare
+   for (unsigned i = 0; i < lengthof(pattern); ++i) {
+      TEST(0 == helper_build_automat(&single[i], pattern[i]));
+      TEST(0 == initcopy_automat(&ndfa2, &single[i], 0));
+      TEST(0 == opmatchid_automat(&ndfa2, i));
+      if (i) {
+         TEST(0 == opor_automat(&ndfa, &ndfa2));
+      } else {
+         initmove_automat(&ndfa, &ndfa2);
+      }
+   }
+
+   for (unsigned tc = 0; tc <= 1; ++tc) {
+      // TEST matchids_automat: makedfa_automat (tc == 0) and minimize_automat (tc == 1) keep ids
+      if (tc == 0) {
+         TEST(0 == makedfa_automat(&ndfa));
+      } else {
+         TEST(0 == minimize_automat(&ndfa));
+      }
+      TEST( 4 == matchids_automat(&ndfa, 3, U"abc", lengthof(ismatch), ismatch));
+      TEST( ismatch[0] && ismatch[1] && ismatch[2] && ismatch[6]);
+      TEST( 2 == matchids_automat(&ndfa, 2, U"ac", lengthof(ismatch), ismatch));
+      TEST( ismatch[1] && ismatch[6]);
+
+      // TEST matchids_automat: compare with single automat
+      for (unsigned i = 0; i < 100; ++i) {
+         const size_t len = i % lengthof(str);
+         for (size_t c = 0; c < len; ++c) {
+            random = random * 1103515245 + 12345;
+            str[c] = (char32_t) ('a' + (random >> 16) % 4);
+         }
+         size_t nrmatch = 0;
+         size_t result  = matchids_automat(&ndfa, len, str, lengthof(ismatch), ismatch);
+         for (unsigned p = 0; p < lengthof(single); ++p) {
+            bool isMatch = isendstate_automat(&single[p], 0) || matchchar32_automat(&single[p], len, str, true);
+            TESTP( isMatch == ismatch[p], "tc:%d i:%d p:%d", tc, i, p);
+            nrmatch += isMatch;
+         }
+         TEST( false == ismatch[lengthof(single)]);
+         TEST( nrmatch == result);
       }
-      // check mman
-      TEST( 0 == wasted_automatmman(mman));
-      TEST( S == sizeallocated_automatmman(mman));
-      TEST( 2 == refcount_automatmman(mman));
-      // check ndfa
-      TEST( ndfa.mman    == 0);
-      TEST( ndfa.nrstate == 0);
-      TEST( ndfa.allocated == 0);
-      TEST( isempty_slist(&ndfa.states));
    }
-   // reset
-   TEST(0 == free_automat(&ndfa2));
-   reset_automatmman(mman);
 
    // reset
-   TEST(0 == delete_automatmman(&mman));
-   TEST(0 == delete_automatmman(&mman2));
+   TEST(0 == free_automat(&ndfa));
+   for (unsigned i = 0; i < lengthof(single); ++i) {
+      TEST(0 == free_automat(&single[i]));
+   }
 
    return 0;
 ONERR:
    free_automat(&ndfa);
-   free_automat(&ndfa1);
    free_automat(&ndfa2);
-   delete_automatmman(&mman);
-   delete_automatmman(&mman2);
+   for (unsigned i = 0; i < lengthof(single); ++i) {
+      free_automat(&single[i]);
+   }
    return EINVAL;
 }
 
-static void set_isuse(automat_t * ndfa)
+/* function: helper_compare_minimal
+ * Prüft Struktur von dfa1 und ob dfa1 und dfa2 dieselbe Sprache erkennen. */
+static int helper_compare_minimal(automat_t* dfa1, automat_t* dfa2, uint32_t* random)
 {
-   foreach (_statelist, s, &ndfa->states) {
-      s->isused = 1;
-   }
-}
+   char32_t str[12];
 
-static int check_isuse(automat_t * ndfa)
-{
-   foreach (_statelist, s, &ndfa->states) {
-      TEST(0 == s->isused);
+   TEST(1 == dfa1->isDFA);
+   TEST(1 == dfa2->isDFA);
+   // check structure: last state is end state and every other end state points to it
+   state_t* endstate = last_statelist(&dfa1->states);
+   TEST(1 == endstate->nremptytrans);
+   TEST(0 == endstate->nrrangetrans);
+   TEST(endstate == last_emptylist(&endstate->emptylist)->state);
+   foreach (_statelist, s, &dfa1->states) {
+      TEST(s->nremptytrans <= 1);
+      if (s->nremptytrans) TEST(endstate == last_emptylist(&s->emptylist)->state);
+   }
+   // compare language
+   for (unsigned i = 0; i < 500; ++i) {
+      const size_t len = i % lengthof(str);
+      for (size_t c = 0; c < len; ++c) {
+         *random = *random * 1103515245 + 12345;
+         str[c] = (char32_t) ('a' + (*random >> 16) % 4);
+      }
+      for (unsigned isLongest = 0; isLongest <= 1; ++isLongest) {
+         TESTP( matchchar32_automat(dfa1, len, str, isLongest) == matchchar32_automat(dfa2, len, str, isLongest), "i:%d", i);
+      }
    }
+
    return 0;
 ONERR:
    return EINVAL;
 }
 
-static int test_query(void)
+static int test_minimize2(void)
 {
    automat_t ndfa  = automat_FREE;
-   automat_t ndfa2[5] = { automat_FREE } ;
-   size_t    minchainlen = sizeblock_statearray() / sizeof(state_t*);
-
-   // TEST isfree_automat: automat_FREE
-   TEST(1 == isfree_automat(&ndfa));
-
-   // TEST isfree_automat: mman != 0
-   ndfa.mman = (void*)1;
-   TEST(0 == isfree_automat(&ndfa));
-   ndfa.mman = 0;
-   TEST(1 == isfree_automat(&ndfa));
-
-   // TEST isfree_automat: nrstate != 0
-   ndfa.nrstate = 1;
-   TEST(0 == isfree_automat(&ndfa));
-   ndfa.nrstate = 0;
-   TEST(1 == isfree_automat(&ndfa));
-
-   // TEST isfree_automat: allocated != 0
-   ndfa.allocated = 1;
-   TEST(0 == isfree_automat(&ndfa));
-   ndfa.allocated = 0;
-   TEST(1 == isfree_automat(&ndfa));
+   automat_t ndfa2 = automat_FREE;
+   automat_t chr   = automat_FREE;
+   automat_t dfa   = automat_FREE;
+   uint32_t  random = 12345;
+   bool      ismatch[3];
+   bool      ismatch2[3];
+
+   // TEST minimize2_automat: EINVAL
+   TEST( EINVAL == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+   TEST(0 == initempty_automat(&ndfa, 0));
+   TEST( EINVAL == minimize2_automat(&ndfa, (automat_minimize_e)2));
+   TEST(0 == free_automat(&ndfa));
 
-   // TEST isfree_automat: states.last != 0
-   ndfa.states.last = (void*) 1;
-   TEST(0 == isfree_automat(&ndfa));
-   ndfa.states.last = 0;
-   TEST(1 == isfree_automat(&ndfa));
+   // TEST minimize2_automat: same number of states and language as minimize_automat
+   for (unsigned tc = 0; tc < 200; ++tc) {
+      // build random ndfa "w1|w2|...|wn" with words over 'a'..'c' (every char is optionally repeated)
+      const unsigned nrword = 1 + tc % 5;
+      for (unsigned w = 0; w < nrword; ++w) {
+         TEST(0 == initempty_automat(&ndfa2, w ? &ndfa : 0));
+         random = random * 1103515245 + 12345;
+         for (unsigned len = (random >> 16) % 6; len; --len) {
+            random = random * 1103515245 + 12345;
+            char32_t from = (char32_t) ('a' + (random >> 16) % 3);
+            char32_t to   = (random >> 20) % 4 ? from : 'c';
+            TEST(0 == initmatch_automat(&chr, &ndfa2, 1, &from, &to));
+            if ((random >> 24) % 3 == 0) TEST(0 == oprepeat_automat(&chr, (random >> 26) % 2));
+            TEST(0 == opsequence_automat(&ndfa2, &chr));
+         }
+         if (w) {
+            TEST(0 == opor_automat(&ndfa, &ndfa2));
+         } else {
+            initmove_automat(&ndfa, &ndfa2);
+         }
+      }
+      if (tc % 4 == 3) TEST(0 == oprepeat_automat(&ndfa, false));
+      TEST(0 == initcopy_automat(&dfa, &ndfa, 0));
+      TEST(0 == minimize2_automat(&dfa, automat_minimize_BRZOZOWSKI));
+      if (tc % 2) {
+         // start from dfa
+         TEST(0 == makedfa_automat(&ndfa));
+      }
+      TEST(0 == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+      TESTP(0 == helper_compare_minimal(&ndfa, &dfa, &random), "tc:%d", tc);
+      // minimize_automat keeps start state separate if it could be merged with another one
+      TEST(nrstate_automat(&ndfa) <= nrstate_automat(&dfa));
+      TEST(nrstate_automat(&ndfa) >= nrstate_automat(&dfa)-1);
+      // minimizing a minimal automaton changes nothing
+      const size_t nrstate = nrstate_automat(&ndfa);
+      TEST(0 == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+      TEST(0 == helper_compare_minimal(&ndfa, &dfa, &random));
+      TEST(nrstate == nrstate_automat(&ndfa));
+      // minimize2_automat(HOPCROFT) after minimize_automat
+      TEST(0 == minimize2_automat(&dfa, automat_minimize_HOPCROFT));
+      TEST(nrstate == nrstate_automat(&dfa));
+      TEST(0 == free_automat(&ndfa));
+      TEST(0 == free_automat(&dfa));
+   }
+
+   // TEST minimize2_automat: overlapping ranges (states split the alphabet differently)
+   for (unsigned tc = 0; tc < 200; ++tc) {
+      // build random ndfa "w1|w2|...|wn", every char of a word is a range [from-to] out of 'a'..'d'
+      const unsigned nrword = 2 + tc % 6;
+      for (unsigned w = 0; w < nrword; ++w) {
+         TEST(0 == initempty_automat(&ndfa2, w ? &ndfa : 0));
+         random = random * 1103515245 + 12345;
+         for (unsigned len = 1 + (random >> 16) % 4; len; --len) {
+            random = random * 1103515245 + 12345;
+            char32_t from = (char32_t) ('a' + (random >> 16) % 4);
+            char32_t to   = from + (char32_t) ((random >> 20) % ('d'+1 - from));
+            TEST(0 == initmatch_automat(&chr, &ndfa2, 1, &from, &to));
+            if ((random >> 24) % 4 == 0) TEST(0 == oprepeat_automat(&chr, false));
+            TEST(0 == opsequence_automat(&ndfa2, &chr));
+         }
+         if (w) {
+            TEST(0 == opor_automat(&ndfa, &ndfa2));
+         } else {
+            initmove_automat(&ndfa, &ndfa2);
+         }
+      }
+      if (tc % 3 == 2) TEST(0 == oprepeat_automat(&ndfa, true));
+      TEST(0 == initcopy_automat(&dfa, &ndfa, 0));
+      TEST(0 == minimize2_automat(&dfa, automat_minimize_BRZOZOWSKI));
+      TEST(0 == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+      TESTP(0 == helper_compare_minimal(&ndfa, &dfa, &random), "tc:%d", tc);
+      TEST(nrstate_automat(&ndfa) <= nrstate_automat(&dfa));
+      TEST(nrstate_automat(&ndfa) >= nrstate_automat(&dfa)-1);
+      TEST(0 == free_automat(&ndfa));
+      TEST(0 == free_automat(&dfa));
+   }
 
-   // TEST nrstate_automat: automat_FREE
-   TEST(0 == nrstate_automat(&ndfa));
+   // TEST minimize2_automat: empty string
+   TEST(0 == initempty_automat(&ndfa, 0));
+   TEST(0 == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+   TEST(2 == nrstate_automat(&ndfa));
+   TEST(1 == isendstate_automat(&ndfa, 0));
+   TEST(0 == matchchar32_automat(&ndfa, 1, U"a", true));
+   TEST(0 == free_automat(&ndfa));
 
-   // TEST nrstate_automat: returns value of nrstate
-   for (size_t i = 1; i; i <<= 1) {
-      ndfa.nrstate = i;
-      TEST(i == nrstate_automat(&ndfa));
-   }
+   // TEST minimize2_automat: empty language
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST(0 == opandnot_automat(&ndfa, &ndfa2));
+   TEST(0 == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+   TEST(2 == nrstate_automat(&ndfa));
+   TEST(0 == isendstate_automat(&ndfa, 0));
+   TEST(0 == matchchar32_automat(&ndfa, 1, U"a", true));
+   TEST(0 == free_automat(&ndfa));
 
-   for (unsigned l = 1; l < 4; ++l) {
-      // prepare
-      state_t states[4];
-      for (unsigned i = 0; i < l; ++i) {
-         insertlast_statelist(&ndfa.states, &states[i]);
+   // TEST minimize2_automat: match ids are kept
+   for (unsigned i = 0; i < lengthof(ismatch); ++i) {
+      TEST(0 == helper_build_automat(&ndfa2, i == 0 ? "ab*" : i == 1 ? "a*|b" : "ba"));
+      TEST(0 == opmatchid_automat(&ndfa2, i));
+      if (i) {
+         TEST(0 == opor_automat(&ndfa, &ndfa2));
+      } else {
+         initmove_automat(&ndfa, &ndfa2);
       }
-      state_t * start;
-      state_t * end;
-
-      // TEST startend_automat: empty statelist
-      startend_automat(&ndfa, &start, &end);
-      // check start
-      TEST(start == &states[0]);
-      // check end
-      TEST(end   == &states[l-1]);
    }
+   TEST(0 == initcopy_automat(&dfa, &ndfa, 0));
+   TEST(0 == minimize2_automat(&dfa, automat_minimize_BRZOZOWSKI));
+   TEST(0 == minimize2_automat(&ndfa, automat_minimize_HOPCROFT));
+   TEST(nrstate_automat(&dfa) >= nrstate_automat(&ndfa));
+   const char32_t* idstr[] = { U"", U"a", U"ab", U"abb", U"b", U"ba", U"bab", U"aa" };
+   for (unsigned i = 0; i < lengthof(idstr); ++i) {
+      size_t len = 0;
+      while (idstr[i][len]) ++len;
+      TEST(matchids_automat(&dfa, len, idstr[i], 3, ismatch) == matchids_automat(&ndfa, len, idstr[i], 3, ismatch2));
+      TEST(0 == memcmp(ismatch, ismatch2, sizeof(ismatch)));
+   }
+   TEST(0 == free_automat(&dfa));
 
-   // TEST isendstate_automat: nrstate == 0
-   for (size_t i = 1; i; i <<= 1) {
-      TEST( 0 == isendstate_automat(&ndfa, i));
-      // check ndfa
-      TEST( 0 == isfree_automat(&ndfa));
+   // TEST minimize2_automat: ENOMEM
+   for (unsigned timercount = 1; timercount <= 4; ++timercount) {
+      TEST(0 == initcopy_automat(&ndfa2, &ndfa, 0));
+      init_testerrortimer(&s_automat_errtimer, timercount, ENOMEM);
+      TEST( ENOMEM == minimize2_automat(&ndfa2, automat_minimize_HOPCROFT));
+      TEST(1 == ndfa2.isDFA);
+      TEST(nrstate_automat(&ndfa) == nrstate_automat(&ndfa2));
+      TEST(0 == free_automat(&ndfa2));
    }
-   TEST( 0 == isendstate_automat(&ndfa, 0));
+   free_testerrortimer(&s_automat_errtimer);
 
-   // TEST isendstate_automat: empty state
-   TEST(0 == initempty_automat(&ndfa, 0));
-   // test
-   TEST( 1 == isendstate_automat(&ndfa, 0));
-   TEST( 1 == isendstate_automat(&ndfa, 1));
    // reset
    TEST(0 == free_automat(&ndfa));
 
-   // TEST isendstate_automat: match state
-   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){0}, (char32_t[]){(char32_t)-1}));
-   // test
-   TEST( 0 == isendstate_automat(&ndfa, 0));
-   TEST( 1 == isendstate_automat(&ndfa, 1));
-   // reset
-   TEST(0 == free_automat(&ndfa));
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   free_automat(&chr);
+   free_automat(&dfa);
+   return EINVAL;
+}
 
-   // TEST iserrorstate_automat: nrstate == 0
-   for (size_t i = 1; i; i <<= 1) {
-      TEST( 1 == iserrorstate_automat(&ndfa, i));
-      // check ndfa
-      TEST( 1 == isfree_automat(&ndfa));
-   }
-   TEST( 1 == iserrorstate_automat(&ndfa, 0));
+static int test_prefilter(void)
+{
+   automat_t           ndfa   = automat_FREE;
+   automat_prefilter_t filter = automat_prefilter_FREE;
+   char32_t            str[200];
+   uint32_t            random = 777;
+   size_t              matchstart, matchend;
+   struct {
+      const char* def;
+      uint8_t     nrrange;
+      const char* first;   // pairs of from, to
+      const char* literal;
+   } testcase[] = {
+      { "abc|abd",   1, "aa",       "ab" },
+      { "xyz",       1, "xx",       "xyz" },
+      { "a*b",       1, "ab",       "" },
+      { "b|d|f|h",   4, "bbddffhh", "" },
+      { "b|c|d|x",   2, "bdxx",     "" },
+      { "b|d|f|h|j", 0, "",         "" },
+      { "x*",        0, "",         "" },
+      { "",          0, "",         "" },
+   };
 
-   // TEST iserrorstate_automat
-   TEST(0 == new_automatmman(&ndfa.mman));
-   incruse_automatmman(ndfa.mman);
-   ndfa.nrstate = 100;
-   for (unsigned i = 0; i < 100; ++i) {
-      void *state;
-      TEST(0 == malloc_automatmman(ndfa.mman, sizeof(state_t), &state));
-      memset(state, 0, sizeof(state_t));
-      ((state_t*)state)->nremptytrans = (i%3);
-      ((state_t*)state)->nrrangetrans = (i%5);
-      insertlast_statelist(&ndfa.states, (state_t*)state);
-   }
-   for (unsigned i = 0; i < 100; ++i) {
-      int isErr = (i%3 == 0) && (i%5 == 0);
-      TEST( isErr == iserrorstate_automat(&ndfa, i));
-   }
-   // reset
+   // TEST automat_prefilter_FREE
+   TEST(0 == filter.nrrange);
+   TEST(0 == filter.nrliteral);
+
+   // TEST init_automatprefilter: EINVAL
+   TEST( EINVAL == init_automatprefilter(&filter, &ndfa));
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST( EINVAL == init_automatprefilter(&filter, &ndfa));
    TEST(0 == free_automat(&ndfa));
 
-   // prepare ndfa with "( | [a-b][a-b]* )"
-   {
-      enum { EMPTY, MATCH1, MATCH2 };
-      TEST(0 == initempty_automat(&ndfa2[EMPTY], 0));
-      TEST(0 == initmatch_automat(&ndfa2[MATCH1], &ndfa2[EMPTY], 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
-      TEST(0 == initmatch_automat(&ndfa2[MATCH2], &ndfa2[EMPTY], 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
-      TEST(0 == oprepeat_automat(&ndfa2[MATCH2], 0));
-      TEST(0 == opsequence_automat(&ndfa2[MATCH1], &ndfa2[MATCH2]));
-      TEST(0 == opor_automat(&ndfa2[EMPTY], &ndfa2[MATCH1]));
-      initmove_automat(&ndfa, &ndfa2[EMPTY]);
-   }
+   for (unsigned tc = 0; tc < lengthof(testcase); ++tc) {
+      TEST(0 == helper_build_automat(&ndfa, testcase[tc].def));
 
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      // TEST matchchar32_automat: match empty transition as shortest match
-      if (tc) {
-         TEST(0 == makedfa_automat(&ndfa));
+      // TEST init_automatprefilter
+      memset(&filter, 255, sizeof(filter));
+      TEST(0 == init_automatprefilter(&filter, &ndfa));
+      TESTP(testcase[tc].nrrange == filter.nrrange, "tc:%d", tc);
+      for (unsigned r = 0; r < filter.nrrange; ++r) {
+         TEST((char32_t)testcase[tc].first[2*r]   == filter.from[r]);
+         TEST((char32_t)testcase[tc].first[2*r+1] == filter.to[r]);
+      }
+      TEST(strlen(testcase[tc].literal) == filter.nrliteral);
+      for (unsigned i = 0; i < filter.nrliteral; ++i) {
+         TEST((char32_t)testcase[tc].literal[i] == filter.literal[i]);
       }
-      set_isuse(&ndfa);
-      // test
-      TEST( 0 == matchchar32_automat(&ndfa, 1, U"a", false));
-      // check ndfa isuse cleared
-      TEST( 0 == check_isuse(&ndfa));
 
-      // TEST matchchar32_automat: match longest string
-      for (unsigned len = 0; len <= 10; ++len) {
-         set_isuse(&ndfa);
-         // test
-         TEST( len == matchchar32_automat(&ndfa, len, U"ababababab", true));
-         // check ndfa isuse cleared
-         TEST( 0 == check_isuse(&ndfa));
+      // TEST find_automatprefilter: same result as scalar check (all offsets and lengths)
+      for (unsigned i = 0; i < 50; ++i) {
+         for (size_t c = 0; c < lengthof(str); ++c) {
+            random = random * 1103515245 + 12345;
+            str[c] = (char32_t) ((random >> 16) % 23 ? 'k' + (random >> 20) % 8 : 'a' + (random >> 20) % 26);
+            if ((random >> 28) == 0) str[c] += 0x80000000; // test unsigned compare
+         }
+         for (size_t len = i % 3; len <= lengthof(str); len += 1 + i % 7) {
+            for (size_t offset = 0; offset <= len && offset < 20; ++offset) {
+               size_t expect = len;
+               for (size_t p = offset; p < len; ++p) {
+                  bool isfirst = (filter.nrrange == 0);
+                  for (unsigned r = 0; r < filter.nrrange; ++r) {
+                     isfirst = isfirst || (filter.from[r] <= str[p] && str[p] <= filter.to[r]);
+                  }
+                  if (  isfirst && filter.nrliteral <= len - p
+                        && (filter.nrliteral == 0 || 0 == memcmp(&str[p+1], &filter.literal[1], (filter.nrliteral-1) * sizeof(char32_t)))) {
+                     expect = p;
+                     break;
+                  }
+               }
+               TESTP(expect == find_automatprefilter(&filter, offset, len, str), "tc:%d len:%zu offset:%zu", tc, len, offset);
+            }
+         }
       }
-   }
-   // reset
-   TEST(0 == free_automat(&ndfa));
 
-   // TEST matchchar32_automat: follow very long empty states
-   // prepare
-   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 0 }, (char32_t[]){ 0 }));
-   for (size_t i = 1; i < 2*minchainlen; ++i) {
-      TEST(0 == initmatch_automat(&ndfa2[0], &ndfa, 1, (char32_t[]){ 2*i }, (char32_t[]){ 2*i }));
-      TEST(0 == opor_automat(&ndfa, &ndfa2[0]));
-   }
-   for (size_t i = 0; i < 2*minchainlen; i += minchainlen/3) {
-      set_isuse(&ndfa);
-      char32_t c = (char32_t)(2*i);
-      TEST( 1 == matchchar32_automat(&ndfa, 1, &c, false));
-      // check ndfa isuse cleared
-      TEST( 0 == check_isuse(&ndfa));
-   }
-   for (size_t i = 0; i <= 4*minchainlen; i += minchainlen) {
-      char32_t c = (char32_t)(2*i+1);
-      set_isuse(&ndfa);
-      // test (no match for other chars)
-      TEST( 0 == matchchar32_automat(&ndfa, 1, &c, false));
-      // check ndfa isuse cleared (if no error)
-      TEST( 0 == check_isuse(&ndfa));
+      // TEST search_automat: prefilter does not change result
+      for (unsigned i = 0; i < 50; ++i) {
+         const size_t len = 10 + i;
+         for (size_t c = 0; c < len; ++c) {
+            random = random * 1103515245 + 12345;
+            str[c] = (char32_t) ('a' + (random >> 16) % 26);
+         }
+         if (i % 2) memcpy(&str[len/2], U"abcxyzabd", 9 * sizeof(char32_t));
+         size_t expectstart = SIZE_MAX, expectend = 0;
+         for (size_t p = 0; p <= len && expectstart == SIZE_MAX; ++p) {
+            // matchchar32_automat returns 0 for empty and for no match
+            size_t L = matchchar32_automat(&ndfa, len-p, &str[p], true);
+            if (L || filter.nrrange == 0) {
+               expectstart = p;
+               expectend   = p + L;
+            }
+         }
+         if (filter.nrrange == 0) continue; // could not compute expected value
+         int err = search_automat(&ndfa, len, str, &matchstart, &matchend);
+         if (expectstart == SIZE_MAX) {
+            TEST(ESRCH == err);
+         } else {
+            TESTP(0 == err, "tc:%d i:%d", tc, i);
+            TEST(expectstart == matchstart);
+            TEST(expectend   == matchend);
+         }
+      }
+
+      TEST(0 == free_automat(&ndfa));
    }
-   // reset
+
+   // TEST search_automat: sparse match in long string
+   TEST(0 == helper_build_automat(&ndfa, "needle|nail"));
+   char32_t* text = malloc(100000 * sizeof(char32_t));
+   TEST(text);
+   for (size_t c = 0; c < 100000; ++c) text[c] = 'a' + c % 13;
+   memcpy(&text[99990], U"nail", 4 * sizeof(char32_t));
+   int err = search_automat(&ndfa, 100000, text, &matchstart, &matchend);
+   free(text);
+   TEST(0 == err);
+   TEST(99990 == matchstart);
+   TEST(99994 == matchend);
    TEST(0 == free_automat(&ndfa));
 
-   // TEST matchchar32_automat: state_RANGE_CONTINUE
-   TEST(0 == initmatch_automat(&ndfa, 0, 2, (char32_t[]){ 0, 1 }, (char32_t[]){ 0, 1 }));
-   for (size_t i = 2; i < 2*minchainlen; i += 2) {
-      TEST(0 == extendmatch_automat(&ndfa, 2, (char32_t[]){ 2*i, 2*i+1 }, (char32_t[]){ 2*i, 2*i+1 }));
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   return EINVAL;
+}
+
+static int test_image(void)
+{
+   automat_t       ndfa  = automat_FREE;
+   automat_t       ndfa2 = automat_FREE;
+   automat_image_t img   = automat_image_FREE;
+   automat_image_t img2  = automat_image_FREE;
+   char            dirname[64];
+   char            filename[80];
+   char32_t        str[32];
+   uint8_t         utf8[4*lengthof(str)];
+   uint32_t        random = 4711;
+   int             fd = -1;
+   struct stat     st;
+
+   // prepare: saved files are the only content of dirname (see reset)
+   snprintf(dirname, sizeof(dirname), "/tmp/test_automat_image.%d", (int)getpid());
+   snprintf(filename, sizeof(filename), "%s/dfa", dirname);
+   TEST(0 == mkdir(dirname, 0700));
+
+   // TEST automat_image_FREE
+   TEST( 0 == img.addr);
+   TEST( 0 == img.size);
+   TEST( 0 == img.nrstate);
+   TEST( 0 == img.states);
+   TEST( 0 == img.ranges);
+   TEST( 0 == img.flags);
+
+   // TEST save_automat, saveutf8_automat: EINVAL
+   TEST( EINVAL == save_automat(&ndfa, filename));
+   TEST( EINVAL == saveutf8_automat(&ndfa, filename));
+   TEST( 0 == helper_build_automat(&ndfa, "a*|ab"));
+   TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+   TEST( EINVAL == save_automat(&ndfa2, filename));
+   TEST( EINVAL == saveutf8_automat(&ndfa2, filename));
+   TEST(0 == free_automat(&ndfa2));
+
+   // TEST save_automat: ENOMEM (temporary file is removed, see reset)
+   for (unsigned i = 1; i <= 2; ++i) {
+      init_testerrortimer(&s_automat_errtimer, i, ENOMEM);
+      TEST( ENOMEM == save_automat(&ndfa, filename));
+      TEST( 0 != stat(filename, &st));
    }
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      if (tc) {
-         TEST(0 == makedfa_automat(&ndfa));
-      }
-      for (size_t i = 0; i < 2*minchainlen; i += minchainlen/4) {
-         // test
-         set_isuse(&ndfa);
-         for (char32_t c = (char32_t)(2*i); c <= (char32_t)(2*i+1); ++c) {
-            TEST( 1 == matchchar32_automat(&ndfa, 1, &c, false));
+
+   // TEST save_automat, load_automatimage, free_automatimage
+   for (unsigned tc = 0; tc <= 3; ++tc) {
+      // prepare
+      TEST(0 == free_automat(&ndfa));
+      switch (tc) {
+      case 0: TEST(0 == initempty_automat(&ndfa, 0)); TEST(0 == makedfa_automat(&ndfa)); break;
+      case 1: TEST(0 == helper_build_automat(&ndfa, "a*|ab")); break;
+      case 2: TEST(0 == helper_build_automat(&ndfa, "abc|ab*c*|c*")); break;
+      case 3: TEST(0 == initmatch_automat(&ndfa, 0, 2, (char32_t[]){ 'a', 0x100 }, (char32_t[]){ 'c', 0x10ffff }));
+              TEST(0 == oprepeat_automat(&ndfa, false));
+              TEST(0 == makeutf8_automat(&ndfa)); break;
+      }
+      if (tc == 3) {
+         TEST(0 == saveutf8_automat(&ndfa, filename));
+      } else {
+         TEST(0 == save_automat(&ndfa, filename));
+      }
+      TEST(0 == load_automatimage(&img, filename, true));
+      TEST(0 != img.addr);
+      TEST((tc == 3 ? automat_image_UTF8 : 0) == img.flags);
+      TEST(0 == stat(filename, &st));
+      TEST((size_t)st.st_size == img.size);
+      TEST(nrstate_automat(&ndfa) == img.nrstate);
+      TEST(0 != img.states);
+      TEST(0 != img.ranges);
+      TEST(automat_image_MAGIC == ((const automat_image_header_t*)img.addr)->magic);
+      TEST(img.flags == ((const automat_image_header_t*)img.addr)->flags);
+      // test matchchar32_automatimage, matchutf8_automatimage: wrong type of image
+      if (tc == 3) {
+         TEST(1 == matchutf8_automatimage(&img, 1, (const uint8_t*)"a", true));
+         TEST(0 == matchchar32_automatimage(&img, 1, U"a", true));
+      } else if (tc == 1) {
+         TEST(1 == matchchar32_automatimage(&img, 1, U"a", true));
+         TEST(0 == matchutf8_automatimage(&img, 1, (const uint8_t*)"a", true));
+      }
+      // test matchchar32_automatimage, matchutf8_automatimage
+      for (unsigned i = 0; i < 300; ++i) {
+         const size_t len = i % lengthof(str);
+         size_t len8 = 0;
+         for (size_t c = 0; c < len; ++c) {
+            random = random * 1103515245 + 12345;
+            str[c] = (char32_t) ((random >> 16) % 13 ? 'a' + (random >> 20) % 3 : 'd');
+            if (tc == 3) {
+               if ((random >> 24) % 5 == 0) str[c] = 0x100 + (random >> 8) % 0x10000;
+               len8 += encodechar_utf8(str[c], sizeof(utf8)-len8, utf8+len8);
+            }
+         }
+         for (unsigned isLongest = 0; isLongest <= 1; ++isLongest) {
+            if (tc == 3) {
+               size_t L = matchutf8_automat(&ndfa, len8, utf8, isLongest);
+               TESTP( L == matchutf8_automatimage(&img, len8, utf8, isLongest), "tc:%d i:%d", tc, i);
+            } else {
+               size_t L = matchchar32_automat(&ndfa, len, str, isLongest);
+               TESTP( L == matchchar32_automatimage(&img, len, str, isLongest), "tc:%d i:%d", tc, i);
+            }
          }
-         // check ndfa isuse cleared
-         TEST( 0 == check_isuse(&ndfa));
       }
+      // test free_automatimage
+      TEST(0 == free_automatimage(&img));
+      TEST(0 == img.addr);
+      TEST(0 == img.size);
+      TEST(0 == img.nrstate);
+      TEST(0 == img.states);
+      TEST(0 == img.ranges);
+      TEST(0 == img.flags);
+      TEST(0 == free_automatimage(&img));
+      TEST(0 == img.addr);
    }
-   // reset
+
+   // TEST save_automat: replacing a file does not change a mapped image
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == helper_build_automat(&ndfa, "ab*"));
+   TEST(0 == save_automat(&ndfa, filename));
+   TEST(0 == load_automatimage(&img, filename, true));
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == helper_build_automat(&ndfa, "c"));
+   TEST(0 == save_automat(&ndfa, filename));
+   TEST(0 == load_automatimage(&img2, filename, true));
+   TEST(3 == matchchar32_automatimage(&img, 3, U"abb", true));
+   TEST(0 == matchchar32_automatimage(&img, 1, U"c", true));
+   TEST(0 == matchchar32_automatimage(&img2, 3, U"abb", true));
+   TEST(1 == matchchar32_automatimage(&img2, 1, U"c", true));
+   TEST(0 == free_automatimage(&img));
+   TEST(0 == free_automatimage(&img2));
+
+   // TEST load_automatimage: ENOENT
+   TEST(0 == unlink(filename));
+   TEST( ENOENT == load_automatimage(&img, filename, false));
+   TEST( 0 == img.addr);
+
+   // TEST load_automatimage: EINVAL (corrupted content)
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == helper_build_automat(&ndfa, "abc|ab*c*|c*"));
+   TEST(0 == save_automat(&ndfa, filename));
+   TEST(0 == stat(filename, &st));
+   for (off_t off = 0; off < st.st_size; off += 7) {
+      uint8_t byte;
+      fd = open(filename, O_RDWR|O_CLOEXEC);
+      TEST(fd != -1);
+      TEST(1 == pread(fd, &byte, 1, off));
+      byte ^= 0x10;
+      TEST(1 == pwrite(fd, &byte, 1, off));
+      TEST( EINVAL == load_automatimage(&img, filename, true));
+      TEST( 0 == img.addr);
+      byte ^= 0x10;
+      TEST(1 == pwrite(fd, &byte, 1, off));
+      TEST(0 == close(fd));
+      fd = -1;
+      TEST( 0 == load_automatimage(&img, filename, true));
+      TEST( 0 == free_automatimage(&img));
+   }
+
+   // TEST load_automatimage: checksum is only checked if isChecksum == true
+   fd = open(filename, O_RDWR|O_CLOEXEC);
+   TEST(fd != -1);
+   const off_t off_checksum = offsetof(automat_image_header_t, checksum);
+   TEST(1 == pwrite(fd, &(uint8_t){ 0xff }, 1, off_checksum) && 1 == pwrite(fd, &(uint8_t){ 0 }, 1, off_checksum+1));
+   TEST( EINVAL == load_automatimage(&img, filename, true));
+   TEST( 0 == load_automatimage(&img, filename, false));
+   TEST( 0 == free_automatimage(&img));
+
+   // TEST load_automatimage: EINVAL (invalid state number is detected without checksum)
+   const off_t off_range = (off_t) (sizeof(automat_image_header_t) + (nrstate_automat(&ndfa)+1) * sizeof(automat_image_state_t));
+   TEST(4 == pwrite(fd, &(uint32_t){ (uint32_t)nrstate_automat(&ndfa) }, 4, off_range + (off_t)offsetof(automat_image_range_t, state)));
+   TEST( EINVAL == load_automatimage(&img, filename, false));
+   TEST( 0 == img.addr);
+   TEST(0 == close(fd));
+   fd = -1;
+
+   // TEST load_automatimage: EINVAL (truncated file)
+   TEST(0 == truncate(filename, st.st_size-1));
+   TEST( EINVAL == load_automatimage(&img, filename, false));
+   TEST( 0 == img.addr);
+   TEST(0 == truncate(filename, 0));
+   TEST( EINVAL == load_automatimage(&img, filename, false));
+   TEST( 0 == img.addr);
+
+   // reset: fails with ENOTEMPTY if a temporary file was left over
+   TEST(0 == unlink(filename));
+   TEST(0 == rmdir(dirname));
+   TEST(0 == free_automat(&ndfa));
+
+   return 0;
+ONERR:
+   if (fd != -1) close(fd);
+   unlink(filename);
+   rmdir(dirname);
+   free_automatimage(&img);
+   free_automatimage(&img2);
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   return EINVAL;
+}
+
+static int test_matcher(void)
+{
+   automat_t         ndfa    = automat_FREE;
+   automat_matcher_t matcher = automat_matcher_FREE;
+   char32_t          str[24];
+   uint8_t           utf8[4*6];
+   size_t            matchedlen;
+   const char*       pattern[] = { "abcd|c", "a*", "b", "ab*", "abab|bc|a", "cd*c|db*", "a*b*c*d*|dddd" };
+   uint32_t          random = 5555;
+
+   // TEST automat_matcher_FREE
+   TEST(0 == matcher.ndfa);
+   TEST(0 == matcher.state);
+   TEST(0 == matcher.isMatch);
+
+   // TEST init_automatmatcher: EINVAL
+   TEST( EINVAL == init_automatmatcher(&matcher, &ndfa, true));
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST( EINVAL == init_automatmatcher(&matcher, &ndfa, true));
    TEST(0 == free_automat(&ndfa));
 
-   // TEST matchchar32_dfa_automat: test binary search with different array sizes
-   for (unsigned arrsize = 1; arrsize <= 32; ++arrsize) {
-      // prepare
-      for (unsigned nrofarray = 0; nrofarray < 4; ++nrofarray) {
-         char32_t from[32];
-         char32_t   to[32];
-         for (unsigned i = 0, f = nrofarray*(3*arrsize); i < arrsize; ++i, f += 3) {
-            from[i] = f;
-              to[i] = f+1;
+   // TEST finish_automatmatcher: ESRCH and empty match are distinguished
+   TEST(0 == helper_build_automat(&ndfa, "b"));
+   TEST(0 == init_automatmatcher(&matcher, &ndfa, true));
+   TEST(&ndfa == matcher.ndfa);
+   TEST(! isdone_automatmatcher(&matcher));
+   TEST(0 == feed_automatmatcher(&matcher, 1, U"a"));
+   TEST(isdone_automatmatcher(&matcher));
+   TEST(0 == feed_automatmatcher(&matcher, 1, U"b"));
+   matchedlen = 99;
+   TEST( ESRCH == finish_automatmatcher(&matcher, &matchedlen));
+   TEST( 99 == matchedlen);
+   TEST( 0 == matcher.ndfa);
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == helper_build_automat(&ndfa, "a*"));
+   TEST(0 == init_automatmatcher(&matcher, &ndfa, false));
+   TEST(isdone_automatmatcher(&matcher));
+   TEST(0 == finish_automatmatcher(&matcher, &matchedlen));
+   TEST( 0 == matchedlen);
+   TEST(0 == free_automat(&ndfa));
+
+   // TEST feed_automatmatcher: input split at every position gives same result as matchchar32_automat
+   for (unsigned p = 0; p < lengthof(pattern); ++p) {
+      TEST(0 == helper_build_automat(&ndfa, pattern[p]));
+      for (unsigned r = 0; r < 50; ++r) {
+         for (unsigned i = 0; i < lengthof(str); ++i) {
+            random = random * 1103515245 + 12345;
+            str[i] = (char32_t) ('a' + (random >> 16) % 4);
          }
-         if (nrofarray) {
-            TEST(0 == extendmatch_automat(&ndfa, (uint8_t)arrsize, from, to));
-         } else {
-            TEST(0 == initmatch_automat(&ndfa, 0, (uint8_t)arrsize, from, to));
+         for (int isLongest = 0; isLongest <= 1; ++isLongest) {
+            size_t expect = matchchar32_automat(&ndfa, lengthof(str), str, isLongest);
+            for (unsigned split = 0; split <= lengthof(str); ++split) {
+               TEST(0 == init_automatmatcher(&matcher, &ndfa, isLongest));
+               size_t n1 = feed_automatmatcher(&matcher, split, str);
+               TEST(n1 == split || isdone_automatmatcher(&matcher));
+               size_t n2 = feed_automatmatcher(&matcher, lengthof(str)-split, str+split);
+               TEST(n2 == lengthof(str)-split || isdone_automatmatcher(&matcher));
+               TEST(matcher.offset == n1 + n2);
+               matchedlen = 0;
+               int err = finish_automatmatcher(&matcher, &matchedlen);
+               TEST(err == 0 || err == ESRCH);
+               TESTP(expect == matchedlen, "p:%d r:%d split:%d", p, r, split);
+            }
          }
       }
-      ndfa.isDFA = 1;
-      for (char32_t chr = 0; chr < 4*3*arrsize; ++chr) {
-         // test
-         size_t len = matchchar32_automat(&ndfa, 1, &chr, false);
-         // check return value
-         TESTP( len == ((chr % 3) != 2), "len:%zd chr:%d", len, (unsigned)chr);
-      }
-      // reset
       TEST(0 == free_automat(&ndfa));
    }
 
-   // free resources
-   TEST(0 == free_automat(&ndfa));
-   for (size_t i = 0; i < lengthof(ndfa2); ++i) {
-      TEST(0 == free_automat(&ndfa2[i]));
+   // TEST feedutf8_automatmatcher: multibyte sequences split between chunks
+   TEST(0 == initmatch_automat(&ndfa, 0, 2, (char32_t[]){ 0x80, 0x10000 }, (char32_t[]){ 0x7ff0, 0x10000 }));
+   TEST(0 == oprepeat_automat(&ndfa, true));
+   TEST(0 == makeutf8_automat(&ndfa));
+   size_t len = 0;
+   len += encodechar_utf8(0x80, sizeof(utf8)-len, utf8+len);
+   len += encodechar_utf8(0x10000, sizeof(utf8)-len, utf8+len);
+   len += encodechar_utf8(0x7ff0, sizeof(utf8)-len, utf8+len);
+   len += encodechar_utf8(0x10001, sizeof(utf8)-len, utf8+len);
+   for (int isLongest = 0; isLongest <= 1; ++isLongest) {
+      size_t expect = matchutf8_automat(&ndfa, len, utf8, isLongest);
+      TEST(expect == (isLongest ? 2u+4u+3u : 2u));
+      for (unsigned split = 0; split <= len; ++split) {
+         TEST(0 == init_automatmatcher(&matcher, &ndfa, isLongest));
+         feedutf8_automatmatcher(&matcher, split, utf8);
+         feedutf8_automatmatcher(&matcher, len-split, utf8+split);
+         TEST(0 == finish_automatmatcher(&matcher, &matchedlen));
+         TESTP(expect == matchedlen, "split:%d", split);
+      }
+      // byte by byte
+      TEST(0 == init_automatmatcher(&matcher, &ndfa, isLongest));
+      for (unsigned i = 0; i < len; ++i) {
+         feedutf8_automatmatcher(&matcher, 1, utf8+i);
+      }
+      TEST(0 == finish_automatmatcher(&matcher, &matchedlen));
+      TEST(expect == matchedlen);
    }
+   TEST(0 == free_automat(&ndfa));
 
    return 0;
 ONERR:
    free_automat(&ndfa);
-   for (size_t i = 0; i < lengthof(ndfa2); ++i) {
-      free_automat(&ndfa2[i]);
-   }
    return EINVAL;
 }
 
-static int test_extend(void)
+/* function: helper_build_reverse
+ * Erzeugt mit <helper_build_automat> einen Automaten und speichert den minimalen DFA
+ * der umgekehrten Sprache in rdfa. Großbuchstaben dienen in <test_matchtags> als Tags. */
+static int helper_build_reverse(/*out*/automat_t* rdfa, const char* def)
 {
-   automat_t      ndfa = automat_FREE;
-   automat_t      ndfa2 = automat_FREE;
-   automat_mman_t*mman = 0;
-   char32_t       from[256];
-   char32_t       to[256];
-   size_t         target[255];
-   helper_state_t helperstate[3+255];
-   size_t         S;
+   automat_t ndfa = automat_FREE;
 
-   // prepare
-   for (size_t i = 0; i < lengthof(target); ++i) {
-      target[i] = 1;
-   }
-   for (size_t i = 0; i < lengthof(from); ++i) {
-      from[i] = 1 + i;
-      to[i]   = 1 + 2*i;
-   }
-   TEST(0 == initmatch_automat(&ndfa, 0, 15, from, to));
-   helperstate[0] = (helper_state_t) { state_RANGE, 15, target, from, to };
-   helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0 };
-   TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
-   mman = ndfa.mman;
-   S = sizeallocated_automatmman(mman);
+   TEST(0 == helper_build_automat(&ndfa, def));
+   TEST(0 == initreverse_automat(rdfa, &ndfa, 0));
+   TEST(0 == minimize_automat(rdfa));
+   TEST(0 == free_automat(&ndfa));
 
-   // TEST extendmatch_automat: EINVAL (freed ndfa)
-   TEST( EINVAL == extendmatch_automat(&ndfa2, 1, from, to));
-   TEST( 1 == refcount_automatmman(mman));
-   TEST( S == sizeallocated_automatmman(mman));
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   return EINVAL;
+}
 
-   // TEST extendmatch_automat: EINVAL (nrmatch == 0)
-   TEST( EINVAL == extendmatch_automat(&ndfa, 0, from, to));
-   TEST( mman == ndfa.mman);
-   TEST( 1 == refcount_automatmman(mman));
-   TEST( S == sizeallocated_automatmman(mman));
+static int test_matchtags(void)
+{
+   automat_t rdfa = automat_FREE;
+   automat_scratch_t scratch = automat_scratch_FREE;
+   size_t    tagpos[4];
+   struct {
+      const char*    def;
+      const char32_t* str;
+      size_t         tagpos[4];
+   } testcase[] = {
+      { "xAyBz",     U"xyz",   { 1, 2, SIZE_MAX, SIZE_MAX } },
+      { "AaB|CbD",   U"a",     { 0, 1, SIZE_MAX, SIZE_MAX } },
+      { "AaB|CbD",   U"b",     { SIZE_MAX, SIZE_MAX, 0, 1 } },
+      // ambiguous: chars are read as early as possible (first group is longest)
+      { "Aa*BCa*D",  U"aa",    { 0, 2, 2, 2 } },
+      { "Aa*B|Ca*D", U"aaa",   { 0, 3, SIZE_MAX, SIZE_MAX } },
+      // repeated tag: last occurrence
+      { "A*aA*b",    U"ab",    { SIZE_MAX, SIZE_MAX, SIZE_MAX, SIZE_MAX } },
+      { "AaA*b",     U"ab",    { 0, SIZE_MAX, SIZE_MAX, SIZE_MAX } },
+      { "AaAb|AaBb", U"ab",    { 1, SIZE_MAX, SIZE_MAX, SIZE_MAX } },
+      { "ab*B",      U"abbb",  { SIZE_MAX, 4, SIZE_MAX, SIZE_MAX } },
+      { "AB",        U"",      { 0, 0, SIZE_MAX, SIZE_MAX } },
+   };
 
-   // TEST extendmatch_automat: ENOMEM
-   init_testerrortimer(&s_automat_errtimer, 1, ENOMEM);
-   TEST( ENOMEM == extendmatch_automat(&ndfa, 1, from, to));
-   TEST( mman == ndfa.mman);
-   TEST( 1 == refcount_automatmman(mman));
-   TEST( S == sizeallocated_automatmman(mman));
+   // TEST automat_scratch_FREE
+   TEST(0 == scratch.size);
+   TEST(0 == scratch.mem);
+
+   // TEST free_automatscratch: double free
+   TEST(0 == helper_build_reverse(&rdfa, "xAyBz"));
+   TEST(0 == matchtags_automat(&rdfa, &scratch, 3, U"xyz", 'A', 2, tagpos));
+   TEST(0 != scratch.size);
+   TEST(0 != scratch.mem);
+   TEST(0 == free_automatscratch(&scratch));
+   TEST(0 == scratch.size);
+   TEST(0 == scratch.mem);
+   TEST(0 == free_automatscratch(&scratch));
+   TEST(0 == free_automat(&rdfa));
+
+   // TEST matchtags_automat: EINVAL
+   TEST( EINVAL == matchtags_automat(&rdfa, &scratch, 0, U"", 'A', 4, tagpos));
+   TEST(0 == initmatch_automat(&rdfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+   TEST( EINVAL == matchtags_automat(&rdfa, &scratch, 1, U"a", 'A', 4, tagpos));
+   TEST(0 == minimize_automat(&rdfa));
+   TEST( EINVAL == matchtags_automat(&rdfa, &scratch, 1, U"a", 'A', 0, tagpos));
+   TEST( EINVAL == matchtags_automat(&rdfa, &scratch, 1, U"a", (char32_t)-1, 2, tagpos));
+   TEST( 0 == matchtags_automat(&rdfa, &scratch, 1, U"a", (char32_t)-1, 1, tagpos));
+   TEST( SIZE_MAX == tagpos[0]);
+   TEST(0 == free_automat(&rdfa));
+
+   for (unsigned tc = 0; tc < lengthof(testcase); ++tc) {
+      TEST(0 == helper_build_reverse(&rdfa, testcase[tc].def));
+      size_t len = 0;
+      while (testcase[tc].str[len]) ++len;
+      // TEST matchtags_automat: tag positions
+      memset(tagpos, 0, sizeof(tagpos));
+      TESTP( 0 == matchtags_automat(&rdfa, &scratch, len, testcase[tc].str, 'A', 4, tagpos), "tc:%d", tc);
+      for (unsigned k = 0; k < 4; ++k) {
+         TESTP( testcase[tc].tagpos[k] == tagpos[k], "tc:%d k:%d pos:%zd", tc, k, tagpos[k]);
+      }
+      // TEST matchtags_automat: ESRCH
+      TEST( ESRCH == matchtags_automat(&rdfa, &scratch, len+1, U"cccccc", 'A', 4, tagpos));
+      TEST(0 == free_automat(&rdfa));
+   }
+
+   // TEST matchtags_automat: ESRCH if prefix of str is matched
+   TEST(0 == helper_build_reverse(&rdfa, "xAyBz"));
+   TEST( ESRCH == matchtags_automat(&rdfa, &scratch, 2, U"xyz", 'A', 4, tagpos));
+   TEST( ESRCH == matchtags_automat(&rdfa, &scratch, 4, U"xyzz", 'A', 4, tagpos));
+
+   // TEST matchtags_automat: scratch is reused
+   TEST( 0 == matchtags_automat(&rdfa, &scratch, 3, U"xyz", 'A', 4, tagpos));
+   void* mem = scratch.mem;
+   for (unsigned i = 0; i < 10; ++i) {
+      init_testerrortimer(&s_automat_errtimer, 1, ENOMEM);
+      TEST( 0 == matchtags_automat(&rdfa, &scratch, 3, U"xyz", 'A', 4, tagpos));
+      TEST( mem == scratch.mem);
+      free_testerrortimer(&s_automat_errtimer);
+   }
+   TEST( 1 == tagpos[0] && 2 == tagpos[1]);
+
+   // TEST matchtags_automat: ENOMEM
+   for (unsigned i = 1; i <= 2; ++i) {
+      TEST(0 == free_automatscratch(&scratch));
+      init_testerrortimer(&s_automat_errtimer, i, ENOMEM);
+      TEST( ENOMEM == matchtags_automat(&rdfa, &scratch, 3, U"xyz", 'A', 4, tagpos));
+   }
+   TEST( 0 == matchtags_automat(&rdfa, &scratch, 3, U"xyz", 'A', 4, tagpos));
+   TEST(0 == free_automat(&rdfa));
+   TEST(0 == free_automatscratch(&scratch));
 
-   // TEST extendmatch_automat
-   for (size_t i = 1, off=15; off+i < lengthof(from); off += i, ++i) {
-      ndfa.isDFA = 1;
-      TEST( 0 == extendmatch_automat(&ndfa, (uint8_t)i, from+off, to+off))
-      // check mman
-      S += i * sizeof(rangestate_t) + sizeof(range_transition_t);
-      TEST( 1 == refcount_automatmman(mman));
-      TEST( S == sizeallocated_automatmman(mman));
-      // check ndfa
-      TEST( mman == ndfa.mman);
-      TEST( 2    == ndfa.nrstate);
-      TEST( 0    == isempty_slist(&ndfa.states));
-      TEST( 0    == ndfa.isDFA);
-      // check ndfa.states
-      helperstate[0] = (helper_state_t) { state_RANGE, (uint8_t)(off+i), target, from, to };
-      TESTP( 0 == helper_compare_states(&ndfa, ndfa.nrstate, helperstate), "i:%d", i);
-   }
+   return 0;
+ONERR:
+   free_automatscratch(&scratch);
+   free_automat(&rdfa);
+   return EINVAL;
+}
 
-   // reset
-   TEST(0 == free_automat(&ndfa));
+/* struct: helper_thread_t
+ * Parameter und Ergebnis eines Threads von <test_threads>. */
+typedef struct helper_thread_t {
+   pthread_t        thread;
+   const automat_t* dfa;
+   const automat_search_t* search;
+   const char32_t*  str;      // nrstr strings of length 32
+   const size_t*    expect;   // 3 values per string: matchlen, matchstart, matchend
+   size_t           nrstr;
+   int              err;
+} helper_thread_t;
+
+static void* helper_thread_main(void* arg)
+{
+   helper_thread_t*  param   = arg;
+   automat_t         own     = automat_FREE;
+   automat_search_t  search  = automat_search_FREE;
+   size_t            matchstart, matchend;
+
+   // build own automaton (uses own automat_mman_t)
+   TEST(0 == helper_build_automat(&own, "ab*c|d*|cd"));
+   TEST(0 == minimize2_automat(&own, automat_minimize_HOPCROFT));
+   TEST(0 == init_automatsearch(&search, &own));
+
+   // match shared automaton (read only)
+   for (unsigned r = 0; r < 20; ++r) {
+      for (size_t i = 0; i < param->nrstr; ++i) {
+         const char32_t* str    = &param->str[32*i];
+         const size_t*   expect = &param->expect[3*i];
+         TEST(expect[0] == matchchar32_automat(param->dfa, 32, str, true));
+         int err = find_automatsearch(param->search, 32, str, &matchstart, &matchend);
+         TEST(err == (expect[1] == SIZE_MAX ? ESRCH : 0));
+         TEST(err || (expect[1] == matchstart && expect[2] == matchend));
+         // own search ("d*" matches the empty string)
+         TEST(0 == find_automatsearch(&search, 32, str, &matchstart, &matchend));
+      }
+   }
+
+   TEST(0 == free_automatsearch(&search));
+   TEST(0 == free_automat(&own));
+   param->err = 0;
 
    return 0;
 ONERR:
-   free_automat(&ndfa);
-   return EINVAL;
+   free_automatsearch(&search);
+   free_automat(&own);
+   param->err = EINVAL;
+   return 0;
 }
 
-static int test_optimize(void)
+static int test_threads(void)
 {
-   automat_t      ndfa  = automat_FREE;
-   automat_t      ndfa1 = automat_FREE;
-   automat_t      ndfa2 = automat_FREE;
-   automat_mman_t*mman = 0;
-   automat_t      use_mman;
-   void *         end_addr;
-   void *         next_addr;
-   state_t *      start_state;
-   state_t *      end_state;
-   helper_state_t helperstate[10];
+   automat_t         dfa     = automat_FREE;
+   automat_search_t  search  = automat_search_FREE;
+   helper_thread_t   param[8];
+   char32_t          str[64*32];
+   size_t            expect[64*3];
+   uint32_t          random  = 999;
+   unsigned          nrstarted = 0;
 
    // prepare
-   TEST(0 == initempty_automat(&use_mman, 0));
-   mman = use_mman.mman;
+   TEST(0 == helper_build_automat(&dfa, "abab|bc*|dddd"));
+   for (unsigned i = 0; i < lengthof(str); ++i) {
+      random = random * 1103515245 + 12345;
+      str[i] = (char32_t) ('a' + (random >> 16) % 4);
+   }
+   for (unsigned i = 0; i < lengthof(expect)/3; ++i) {
+      expect[3*i] = matchchar32_automat(&dfa, 32, &str[32*i], true);
+      if (search_automat(&dfa, 32, &str[32*i], &expect[3*i+1], &expect[3*i+2])) {
+         expect[3*i+1] = SIZE_MAX;
+      }
+   }
 
-   // === convert to deterministic automaton (dfa)
+   TEST(0 == init_automatsearch(&search, &dfa));
 
-   // prepare
-   TEST(0 == initmatch_automat(&ndfa1, 0, 1, (char32_t[]){ 0 }, (char32_t[]){ (char32_t)-1 }));
-   TEST(0 == oprepeat_automat(&ndfa1, 0));  // ndfa1 matches ".*"
+   // TEST find_automatsearch, matchchar32_automat: shared DFA and search used from several threads
+   for (unsigned t = 0; t < lengthof(param); ++t) {
+      param[t] = (helper_thread_t) { .dfa = &dfa, .search = &search, .str = str, .expect = expect, .nrstr = lengthof(expect)/3, .err = EINVAL };
+      TEST(0 == pthread_create(&param[t].thread, 0, &helper_thread_main, &param[t]));
+      ++ nrstarted;
+   }
+   for (; nrstarted > 0; --nrstarted) {
+      TEST(0 == pthread_join(param[nrstarted-1].thread, 0));
+      TEST(0 == param[nrstarted-1].err);
+   }
 
-   // TEST makedfa_automat: 1 empty transition
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initempty_automat(&ndfa, &use_mman));
-      TEST(2 == refcount_automatmman(mman));
-      // test
-      if (tc == 0) {
-         TEST( 0 == makedfa_automat(&ndfa));
-      } else {
-         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
-      }
-      // check mman released
-      TEST( 1 == refcount_automatmman(mman));
-      // check ndfa
-      TEST( ndfa.mman      != mman);
-      TEST( ndfa.nrstate   == 2);
-      TEST( ndfa.allocated == 2*(state_SIZE + state_SIZE_EMPTYTRANS(1)));
-      TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 1);
-      // check ndfa.states
-      startend_automat(&ndfa, &start_state, &end_state);
-      TEST( end_state == next_statelist(start_state)); // only 2 in list (end == start->next)
-      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
-      TEST( start_state->nremptytrans == 1);
-      TEST( start_state->nrrangetrans == 0);
-      TEST( ! isempty_slist(&start_state->emptylist));
-      TEST( isempty_slist(&start_state->rangelist));
-      TEST( last_emptylist(&start_state->emptylist)->next == last_slist(&start_state->emptylist));
-      TEST( last_emptylist(&start_state->emptylist)->state == end_state);
-      // reset
-      TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
+   // reset
+   TEST(0 == free_automatsearch(&search));
+   TEST(0 == free_automat(&dfa));
+
+   return 0;
+ONERR:
+   for (; nrstarted > 0; --nrstarted) {
+      pthread_join(param[nrstarted-1].thread, 0);
    }
+   free_automatsearch(&search);
+   free_automat(&dfa);
+   return EINVAL;
+}
 
-   // TEST makedfa_automat: overlapping ranges
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 2, (char32_t[2]){1,500}, (char32_t[2]){1000,2000}));
-      TEST(2 == refcount_automatmman(mman));
-      // test
-      if (tc == 0) {
-         TEST( 0 == makedfa_automat(&ndfa));
-      } else {
-         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
+/* function: helper_check_compact
+ * Prüft, ob ndfa von <compact_automat> erzeugt wurde: Die Zustände liegen in Breitensuchreihenfolge hintereinander,
+ * jeder gefolgt von seinen Übergängen, und der Heap enthält keinen ungenutzten Speicher. */
+static int helper_check_compact(const automat_t* ndfa)
+{
+   size_t nr = 0;
+   size_t visited = 1; // start state
+
+   TEST(1 == refcount_automatmman(ndfa->mman));
+   TEST(0 == wasted_automatmman(ndfa->mman));
+   TEST(ndfa->allocated == sizeallocated_automatmman(ndfa->mman));
+   foreach (_statelist, s, &ndfa->states) {
+      s->nr = nr++;
+   }
+   TEST(nr == ndfa->nrstate);
+   foreach (_statelist, s, &ndfa->states) {
+      uint8_t* next = (uint8_t*)s + state_SIZE;
+      foreach (_emptylist, empty_trans, &s->emptylist) {
+         TEST(next == (uint8_t*)empty_trans);
+         next += state_SIZE_EMPTYTRANS(1);
+         // breadth first: target is already visited or the next one
+         TEST(empty_trans->state->nr <= visited || empty_trans->state->nr == nr-1);
+         if (empty_trans->state->nr == visited) ++ visited;
+      }
+      size_t nrrange = 0;
+      foreach (_rangelist, range_trans, &s->rangelist) {
+         // next memory page is started if size does not fit
+         if (next == (uint8_t*)range_trans) {
+            next += state_SIZE_RANGETRANS(range_trans->size);
+         }
+         TEST(range_trans->size == (s->nrrangetrans - nrrange > 256 ? 256 : s->nrrangetrans - nrrange));
+         nrrange += range_trans->size;
+         for (size_t i = 0; i < range_trans->size; ++i) {
+            TEST(range_trans->array[i].state->nr <= visited || range_trans->array[i].state->nr == nr-1);
+            if (range_trans->array[i].state->nr == visited) ++ visited;
+         }
       }
-      // check mman released
-      TEST( 1 == refcount_automatmman(mman));
-      // check ndfa
-      TEST( ndfa.mman      != mman);
-      TEST( ndfa.nrstate   == 2);
-      TEST( ndfa.allocated == 2*state_SIZE + state_SIZE_EMPTYTRANS(1) + state_SIZE_RANGETRANS(1));
-      TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 1);
-      // check ndfa.states
-      startend_automat(&ndfa, &start_state, &end_state);
-      TEST( end_state == next_statelist(start_state)); // only 2 in list (end == start->next)
-      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
-      TEST( start_state->nremptytrans == 0);
-      TEST( start_state->nrrangetrans == 1);
-      TEST( isempty_slist(&start_state->emptylist));
-      TEST( ! isempty_slist(&start_state->rangelist));
-      TEST( last_rangelist(&start_state->rangelist)->size == 1);
-      TEST( last_rangelist(&start_state->rangelist)->array[0].from  == 1);
-      TEST( last_rangelist(&start_state->rangelist)->array[0].to    == 2000);
-      TEST( last_rangelist(&start_state->rangelist)->array[0].state == end_state);
-      // reset
-      TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
+      TEST(nrrange == s->nrrangetrans);
    }
 
-   // TEST makedfa_automat: 1 range && optimize continuous ranges into single transition
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      // prepare
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (uint32_t[]) { 0 }, (uint32_t[]) { 4 }));
-      for (unsigned i = 1; i < 200; ++i) {
-         TEST(0 == extendmatch_automat(&ndfa, 1, (uint32_t[]) { 5*i }, (uint32_t[]) { 5*i+4 }));
-      }
-      // test
-      if (tc == 0) {
-         TEST( 0 == makedfa_automat(&ndfa));
-      } else {
-         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
-      }
-      // check mman released
-      TEST( 1 == refcount_automatmman(mman));
-      // check ndfa
-      TEST( ndfa.mman      != mman);
-      TEST( ndfa.nrstate   == 2);
-      TEST( ndfa.allocated == 2 * state_SIZE + state_SIZE_EMPTYTRANS(1) + state_SIZE_RANGETRANS(1));
-      TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 1);
-      // check ndfa.states
-      startend_automat(&ndfa, &start_state, &end_state);
-      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
-      TEST( start_state->nremptytrans == 0);
-      TEST( start_state->nrrangetrans == 1);
-      TEST( isempty_slist(&start_state->emptylist));
-      TEST( ! isempty_slist(&start_state->rangelist));
-      TEST( last_rangelist(&start_state->rangelist)->next == last_slist(&start_state->rangelist));
-      TEST( last_rangelist(&start_state->rangelist)->size == 1);
-      TEST( last_rangelist(&start_state->rangelist)->array[0].from  == 0);
-      TEST( last_rangelist(&start_state->rangelist)->array[0].to    == 5*200-1);
-      TEST( last_rangelist(&start_state->rangelist)->array[0].state == end_state);
-      // reset
-      TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int test_compact(void)
+{
+   automat_t ndfa  = automat_FREE;
+   automat_t ndfa2 = automat_FREE;
+   automat_t copy  = automat_FREE;
+   uint32_t  random = 12345;
+   const char* def[] = { "a", "ab|c*d", "ab*c|b*c*d|dc", "a*|b*|c*|dddd", "abc|abd|abcd|bcd|acd" };
+
+   // TEST compact_automat: EINVAL
+   TEST(EINVAL == compact_automat(&ndfa));
+
+   for (unsigned tc = 0; tc < lengthof(def); ++tc) {
+      for (unsigned isDFA = 0; isDFA <= 1; ++isDFA) {
+         // TEST compact_automat: same language and structure
+         TEST(0 == helper_build_automat(&ndfa2, def[tc]));
+         if (isDFA) {
+            initmove_automat(&ndfa, &ndfa2);
+         } else {
+            // reversed minimal DFA is a NFA
+            TEST(0 == initreverse_automat(&ndfa, &ndfa2, 0));
+            TEST(0 == free_automat(&ndfa2));
+         }
+         TEST(isDFA == ndfa.isDFA);
+         TEST(0 == initcopy_automat(&copy, &ndfa, 0));
+         const size_t nrstate = nrstate_automat(&ndfa);
+         TEST(0 == compact_automat(&ndfa));
+         TEST(nrstate == nrstate_automat(&ndfa));
+         TEST(isDFA == ndfa.isDFA);
+         TEST(0 == helper_check_compact(&ndfa));
+         if (isDFA) {
+            TEST(0 == helper_compare_minimal(&ndfa, &copy, &random));
+            size_t id = 0;
+            foreach (_statelist, s, &ndfa.states) {
+               TEST(id++ == s->nr);
+            }
+         } else {
+            for (unsigned i = 0; i < 100; ++i) {
+               char32_t str[8];
+               const size_t len = i % lengthof(str);
+               for (size_t c = 0; c < len; ++c) {
+                  random = random * 1103515245 + 12345;
+                  str[c] = (char32_t) ('a' + (random >> 16) % 4);
+               }
+               TEST(matchchar32_automat(&ndfa, len, str, true) == matchchar32_automat(&copy, len, str, true));
+               TEST(matchchar32_automat(&ndfa, len, str, false) == matchchar32_automat(&copy, len, str, false));
+            }
+         }
+         // compacting twice changes nothing
+         const size_t allocated = ndfa.allocated;
+         TEST(0 == compact_automat(&ndfa));
+         TEST(allocated == ndfa.allocated);
+         TEST(0 == helper_check_compact(&ndfa));
+         TEST(0 == free_automat(&ndfa));
+         TEST(0 == free_automat(&copy));
+      }
    }
 
-   // TEST makedfa_automat: or'ed states and repeat
-   for (unsigned tc = 0; tc <= 1; ++tc) {
-      // prepare
-      TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]) { 0 }, (char32_t[]) { 0 }));
-      for (unsigned i = 1; i < 100; ++i) {
-         TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]) { i }, (char32_t[]) { i }));
+   // TEST compact_automat: old memory is released
+   {
+      const size_t oldsize = SIZEALLOCATED_PAGECACHE();
+      TEST(0 == helper_build_automat(&ndfa, "abc|abd|abcd|bcd|acd"));
+      for (char32_t c = 'e'; c < 'e' + 200; ++c) {
+         // transient copy on same heap
+         TEST(0 == initcopy_automat(&copy, &ndfa, &ndfa));
+         TEST(0 == free_automat(&copy));
+         TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, &c, &c));
          TEST(0 == opor_automat(&ndfa, &ndfa2));
       }
-      TEST(0 == oprepeat_automat(&ndfa, 1));
-      // test (slow cause every follow_empty yields more than 200 states iterated 100 times)
-      // if you have 1000 states it is slow, with 10000 very slow and with 100000 you could wait for minutes
-      // ==> OPTIMIZATION: compute follow states per state and store them in state as statevector
-      //                   use bitmap indizes instead of statevector_t
-      //                   use fast sorted multi-insert in btree
-      //                   ==> database should support all these operations with manual intervention
-      if (tc == 0) {
-         TEST( 0 == makedfa_automat(&ndfa));
-      } else {
-         TEST( 0 == makedfa2_automat(&ndfa, OP_AND, &ndfa1));
-      }
-      // check mman released
-      TEST( 1 == refcount_automatmman(mman));
-      // check ndfa
-      TEST( ndfa.mman      != mman);
-      TEST( ndfa.nrstate   == 3);
-      TEST( ndfa.allocated == 3 * state_SIZE + state_SIZE_EMPTYTRANS(2) + 2*state_SIZE_RANGETRANS(1));
-      TEST( ! isempty_slist(&ndfa.states));
-      TEST( ndfa.isDFA     == 1);
-      // check ndfa.states
-      startend_automat(&ndfa, &start_state, &end_state);
-      state_t *next_state = next_statelist(start_state);
-      TEST( 0 == check_dfa_endstate(&ndfa, &end_addr));
-      TEST( start_state->nremptytrans == 0);
-      TEST( start_state->nrrangetrans == 1);
-      TEST( isempty_slist(&start_state->emptylist));
-      TEST( ! isempty_slist(&start_state->rangelist));
-      range_transition_t* range_trans = last_rangelist(&start_state->rangelist);
-      TEST( range_trans == last_rangelist(&start_state->rangelist));
-      TEST( range_trans == (void*) ((uintptr_t)start_state + state_SIZE));
-      TEST( range_trans->size == 1);
-      TEST( range_trans->array[0].from  == 0);
-      TEST( range_trans->array[0].to    == 100-1);
-      TEST( range_trans->array[0].state == next_state);
-      TEST( next_state == (void*) &range_trans->array[1]);
-      TEST( next_state->nremptytrans == 1);
-      TEST( next_state->nrrangetrans == 1);
-      empty_transition_t* empty_trans = last_emptylist(&next_state->emptylist);
-      TEST( empty_trans->state == end_state);
-      TEST( empty_trans == (void*) ((uintptr_t)next_state + state_SIZE));
-      range_trans = first_rangelist(&next_state->rangelist);
-      TEST( range_trans == (void*) &empty_trans[1]);
-      TEST( range_trans->size == 1);
-      TEST( range_trans->array[0].from  == 0);
-      TEST( range_trans->array[0].to    == 100-1);
-      TEST( range_trans->array[0].state == next_state);
-      TEST( end_addr == &range_trans->array[1]);
-      // reset
+      TEST(0 < wasted_automatmman(ndfa.mman));
+      const size_t size = SIZEALLOCATED_PAGECACHE();
+      TEST(0 == compact_automat(&ndfa));
+      TEST(0 == helper_check_compact(&ndfa));
+      TEST(SIZEALLOCATED_PAGECACHE() < size);
       TEST(0 == free_automat(&ndfa));
-      reset_automatmman(mman);
-   }
+      TEST(oldsize == SIZEALLOCATED_PAGECACHE());
+   }
+
+   // TEST compact_automat: shared heap is kept for other automaton
+   TEST(0 == helper_build_automat(&ndfa, "ab|c*d"));
+   TEST(0 == initcopy_automat(&ndfa2, &ndfa, &ndfa));
+   TEST(2 == refcount_automatmman(ndfa.mman));
+   automat_mman_t* oldmman = ndfa.mman;
+   TEST(0 == compact_automat(&ndfa));
+   TEST(oldmman != ndfa.mman);
+   TEST(1 == refcount_automatmman(oldmman));
+   TEST(2 == matchchar32_automat(&ndfa2, 2, U"ab", true));
+   TEST(4 == matchchar32_automat(&ndfa, 4, U"cccd", true));
+   TEST(0 == free_automat(&ndfa));
+   TEST(0 == free_automat(&ndfa2));
 
-   // reset
-   TEST(0 == free_automat(&ndfa1));
+   // TEST compact_automat: more than 256 ranges are split into several nodes
+   TEST(0 == initmatch_automat(&ndfa, 0, 1, (char32_t[]){ 0 }, (char32_t[]){ 0 }));
+   for (char32_t c = 2; c < 600; c += 2) {
+      TEST(0 == initmatch_automat(&ndfa2, &ndfa, 1, &c, &c));
+      TEST(0 == opor_automat(&ndfa, &ndfa2));
+   }
+   TEST(0 == makedfa_automat(&ndfa));
+   TEST(300 == first_statelist(&ndfa.states)->nrrangetrans);
+   TEST(0 == compact_automat(&ndfa));
+   TEST(0 == helper_check_compact(&ndfa));
+   TEST(300 == first_statelist(&ndfa.states)->nrrangetrans);
+   {
+      size_t nrnode = 0;
+      foreach (_rangelist, range_trans, &first_statelist(&ndfa.states)->rangelist) {
+         ++ nrnode;
+      }
+      TEST(2 == nrnode);
+   }
+   TEST(1 == matchchar32_automat(&ndfa, 1, (char32_t[]){ 598 }, true));
+   TEST(0 == matchchar32_automat(&ndfa, 1, (char32_t[]){ 599 }, true));
+   TEST(0 == free_automat(&ndfa));
 
-   // === minimize states of automaton (reverse + dfa + reverse + dfa)
+   // TEST compact_automat: simulated ERROR
+   for (int i = 1; i <= 3; ++i) {
+      TEST(0 == helper_build_automat(&ndfa, "ab|c*d"));
+      automat_mman_t* mman = ndfa.mman;
+      const size_t oldsize = SIZEALLOCATED_PAGECACHE();
+      init_testerrortimer(&s_automat_errtimer, (unsigned)i, ENOMEM);
+      TEST(ENOMEM == compact_automat(&ndfa));
+      TEST(mman == ndfa.mman);
+      TEST(oldsize == SIZEALLOCATED_PAGECACHE());
+      TEST(2 == matchchar32_automat(&ndfa, 2, U"ab", true));
+      TEST(0 == free_automat(&ndfa));
+   }
 
-   // TEST minimize_automat: empty automaton
-   TEST(0 == initempty_automat(&ndfa, &use_mman));
-   // test
-   TEST( 0 == minimize_automat(&ndfa));
-   // check ndfa
-   TEST( ndfa.mman      != mman);
-   TEST( refcount_automatmman(ndfa.mman) == 1);
-   TEST( ndfa.nrstate   == 2);
-   TEST( ndfa.allocated == 2 * state_SIZE + state_SIZE_EMPTYTRANS(2));
-   TEST( ! isempty_slist(&ndfa.states));
-   TEST( ndfa.isDFA     == 1);
-   helperstate[0] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0};
-   helperstate[1] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 1 }, 0, 0};
-   TEST(0 == helper_compare_states(&ndfa, 2, helperstate))
-   // reset
-   TEST(0 == free_automat(&ndfa));
-   reset_automatmman(mman);
+   return 0;
+ONERR:
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   free_automat(&copy);
+   return EINVAL;
+}
 
+/* function: helper_build_unit
+ * Erzeugt ndfa = "[ab]" (isCharset) oder ndfa = "ab|c". */
+static int helper_build_unit(/*out*/automat_t* ndfa, bool isCharset)
+{
+   automat_t ndfa2 = automat_FREE;
+   automat_t ndfa3 = automat_FREE;
 
-   // TEST minimize_automat: dfa+reverse+dfa+reverse could generate an nfa
-   //                        ==> minimize_automat must call makedfa as last op
-   // prepare
-   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'b'}, (char32_t[]){'b'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // xb
-   TEST(0 == oprepeat_automat(&ndfa1, 0));         // (xb)*
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xb)*x
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'n'}, (char32_t[]){'n'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xb)*xn
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){'b'}, (char32_t[]){'b'}));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa1));   // b(xb)*xn
-   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'c'}, (char32_t[]){'c'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // xc
-   TEST(0 == oprepeat_automat(&ndfa1, 0));         // (xc)*
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xc)*x
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'n'}, (char32_t[]){'n'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));  // (xc)*xn
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'c'}, (char32_t[]){'c'}));
-   TEST(0 == opsequence_automat(&ndfa2, &ndfa1));  // c(xc)*xn
-   TEST(0 == opor_automat(&ndfa, &ndfa2));         // b(xb)*xn|c(xc)*xn
-   TEST(0 == initcopy_automat(&ndfa1, &ndfa, 0));  // b(xb)*xn|c(xc)*xn
-   // test (simulate minimize_automat) without calling makedfa_automat as last operation
-   TEST( 0 == makedfa_automat(&ndfa));
-   TEST( 0 == initreverse_automat(&ndfa2, &ndfa, &use_mman));
-   TEST( 0 == free_automat(&ndfa));
-   TEST( 0 == makedfa_automat(&ndfa2));
-   TEST( 0 == initreverse_automat(&ndfa, &ndfa2, &use_mman));
-   TEST( 0 == free_automat(&ndfa2));
-   // check ndfa is type nfa and not dfa
-   next_addr = first_statelist(&ndfa.states);
-   for (unsigned i = 0; i < 3; ++i) {
-      next_addr = next_statelist(next_addr);
+   if (isCharset) {
+      TEST(0 == initmatch_automat(ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'b' }));
+   } else {
+      TEST(0 == initmatch_automat(ndfa, 0, 1, (char32_t[]){ 'a' }, (char32_t[]){ 'a' }));
+      TEST(0 == initmatch_automat(&ndfa2, ndfa, 1, (char32_t[]){ 'b' }, (char32_t[]){ 'b' }));
+      TEST(0 == opsequence_automat(ndfa, &ndfa2));
+      TEST(0 == initmatch_automat(&ndfa3, ndfa, 1, (char32_t[]){ 'c' }, (char32_t[]){ 'c' }));
+      TEST(0 == opor_automat(ndfa, &ndfa3));
    }
-   // check ndfa: 4th state has 2 transition with 'c' ==> no dfa but nfa
-   TEST(2 == ((state_t*)next_addr)->nrrangetrans);
-   TEST(last_rangelist(&((state_t*)next_addr)->rangelist)->size == 1);
-   TEST(first_rangelist(&((state_t*)next_addr)->rangelist)->size == 1);
-   TEST((char32_t)'c' == last_rangelist(&((state_t*)next_addr)->rangelist)->array[0].from);
-   TEST((char32_t)'c' == first_rangelist(&((state_t*)next_addr)->rangelist)->array[0].from);
-   // reset
-   TEST(0 == free_automat(&ndfa));
-   reset_automatmman(mman);
 
-   // TEST minimize_automat: b(xb)*xn|c(xc)*xn
-   TEST(0 == initcopy_automat(&ndfa, &ndfa1, &use_mman));
-   TEST(0 == free_automat(&ndfa1));
-   // test
-   TEST( 0 == minimize_automat(&ndfa));
-   // check ndfa
-   TEST( ndfa.mman      != mman);
-   TEST( refcount_automatmman(ndfa.mman) == 1);
-   TEST( ndfa.nrstate   == 6);
-   TEST( ndfa.allocated == 6 * state_SIZE + state_SIZE_EMPTYTRANS(1) + 2*state_SIZE_RANGETRANS(1)+3*state_SIZE_RANGETRANS(2));
-   TEST( ! isempty_slist(&ndfa.states));
-   TEST( ndfa.isDFA     == 1);
-   helperstate[0] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 1, 2 }, (char32_t[]) { 'b', 'c' }, (char32_t[]) { 'b', 'c' }};
-   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 3 }, (char32_t[]) { 'x' }, (char32_t[]) { 'x' }};
-   helperstate[2] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { 'x' }, (char32_t[]) { 'x' }};
-   helperstate[3] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 1, 5 }, (char32_t[]) { 'b', 'n' }, (char32_t[]) { 'b', 'n' }};
-   helperstate[4] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 2, 5 }, (char32_t[]) { 'c', 'n' }, (char32_t[]) { 'c', 'n' }};
-   helperstate[5] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 5 }, 0, 0};
-   TEST(0 == helper_compare_states(&ndfa, 6, helperstate))
-   // reset
+   return 0;
+ONERR:
+   free_automat(&ndfa2);
+   free_automat(&ndfa3);
+   return EINVAL;
+}
+
+static int test_repeatrange(void)
+{
+   automat_t ndfa = automat_FREE;
+   char32_t  str[3*8];
+   size_t    prefixlen[8+1];
+
+   // TEST oprepeatrange_automat: EINVAL
+   TEST(EINVAL == oprepeatrange_automat(&ndfa, 0, 1));
+   TEST(0 == helper_build_unit(&ndfa, false));
+   TEST(EINVAL == oprepeatrange_automat(&ndfa, 2, 1));
+   TEST(EINVAL == oprepeatrange_automat(&ndfa, automat_MAXREPEAT+1, automat_REPEATINF));
+   TEST(EINVAL == oprepeatrange_automat(&ndfa, 0, automat_MAXREPEAT+1));
    TEST(0 == free_automat(&ndfa));
-   reset_automatmman(mman);
 
-   // TEST minimize_automat:  a(a12345|b12345)|c12345
-   TEST(0 == initempty_automat(&ndfa1, &use_mman));
-   for (unsigned i = '1'; i <= '5'; ++i) {
-      TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){i}, (char32_t[]){i}));
-      TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
+   for (unsigned isCharset = 0; isCharset <= 1; ++isCharset) {
+      // str contains 8 units "ab", "c", "ab", ... ("a", "b", "a", ... for charset)
+      size_t len = 0;
+      prefixlen[0] = 0;
+      for (unsigned u = 0; u < 8; ++u) {
+         if (isCharset) {
+            str[len++] = u % 2 ? 'b' : 'a';
+         } else if (u % 2) {
+            str[len++] = 'c';
+         } else {
+            str[len++] = 'a';
+            str[len++] = 'b';
+         }
+         prefixlen[u+1] = len;
+      }
+
+      for (size_t mincount = 0; mincount <= 4; ++mincount) {
+         for (size_t maxcount = mincount; maxcount <= 6; ++maxcount) {
+            const size_t max = (maxcount == 6 ? automat_REPEATINF : maxcount);
+            // TEST oprepeatrange_automat: language
+            TEST(0 == helper_build_unit(&ndfa, isCharset));
+            TEST(0 == oprepeatrange_automat(&ndfa, mincount, max));
+            if (isCharset) {
+               // counted loop: chain of states
+               TEST(ndfa.nrstate == (max == automat_REPEATINF ? mincount : max) + 2);
+            }
+            for (unsigned isDFA = 0; isDFA <= 1; ++isDFA) {
+               if (isDFA) TEST(0 == minimize_automat(&ndfa));
+               for (size_t k = 0; k <= 8; ++k) {
+                  const size_t expect = k < mincount ? 0 : prefixlen[k < max ? k : max];
+                  TESTP(expect == matchchar32_automat(&ndfa, prefixlen[k], str, true), "min:%zu max:%zu k:%zu", mincount, max, k);
+               }
+            }
+            TEST(0 == free_automat(&ndfa));
+         }
+      }
    }
-   automat_t nabc[3];
-   for (unsigned i = 'a'; i <= 'c'; ++i) {
-      TEST(0 == initmatch_automat(&nabc[i-'a'], &use_mman, 1, (char32_t[]){i}, (char32_t[]){i}));
-      TEST(0 == initcopy_automat(&ndfa2, &ndfa1, &use_mman));
-      TEST(0 == opsequence_automat(&nabc[i-'a'], &ndfa2));
+
+   // TEST oprepeatrange_automat: DFA grows linear with maxcount
+   for (unsigned isCharset = 0; isCharset <= 1; ++isCharset) {
+      TEST(0 == helper_build_unit(&ndfa, isCharset));
+      TEST(0 == oprepeatrange_automat(&ndfa, 1, 50));
+      TEST(0 == makedfa_automat(&ndfa));
+      TEST(nrstate_automat(&ndfa) <= 2*50 + 3);
+      TEST(0 == free_automat(&ndfa));
    }
-   TEST(0 == opor_automat(&nabc[0], &nabc[1]));
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){'a'}, (char32_t[]){'a'}));
-   TEST(0 == opsequence_automat(&ndfa, &nabc[0]));
-   TEST(0 == opor_automat(&ndfa, &nabc[2]));
-   // test
-   TEST( 0 == minimize_automat(&ndfa));
-   // check ndfa
-   TEST( ndfa.mman      != mman);
-   TEST( refcount_automatmman(ndfa.mman) == 1);
-   TEST( ndfa.nrstate   == 8);
-   TEST( ndfa.allocated == 8 * state_SIZE + state_SIZE_EMPTYTRANS(1) + 6*state_SIZE_RANGETRANS(1)+state_SIZE_RANGETRANS(2));
-   TEST( ! isempty_slist(&ndfa.states));
-   TEST( ndfa.isDFA     == 1);
-   helperstate[0] = (helper_state_t) { state_RANGE, 2, (size_t[]) { 1, 2 }, (char32_t[]) { 'a', 'c' }, (char32_t[]) { 'a', 'c' }};
-   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 'a' }, (char32_t[]) { 'b' }};
-   helperstate[2] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 3 }, (char32_t[]) { '1' }, (char32_t[]) { '1' }};
-   helperstate[3] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 4 }, (char32_t[]) { '2' }, (char32_t[]) { '2' }};
-   helperstate[4] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 5 }, (char32_t[]) { '3' }, (char32_t[]) { '3' }};
-   helperstate[5] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 6 }, (char32_t[]) { '4' }, (char32_t[]) { '4' }};
-   helperstate[6] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 7 }, (char32_t[]) { '5' }, (char32_t[]) { '5' }};
-   helperstate[7] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 7 }, 0, 0};
-   TEST(0 == helper_compare_states(&ndfa, 8, helperstate))
-   // reset
-   TEST(0 == free_automat(&ndfa));
-   TEST(0 == free_automat(&ndfa1));
-   reset_automatmman(mman);
 
-   // TEST minimize_automat:  (xy(zy)*)*
-   TEST(0 == initmatch_automat(&ndfa, &use_mman, 1, (char32_t[]){'x'}, (char32_t[]){'x'}));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'y'}, (char32_t[]){'y'}));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa2));
-   TEST(0 == initmatch_automat(&ndfa1, &use_mman, 1, (char32_t[]){'z'}, (char32_t[]){'z'}));
-   TEST(0 == initmatch_automat(&ndfa2, &use_mman, 1, (char32_t[]){'y'}, (char32_t[]){'y'}));
-   TEST(0 == opsequence_automat(&ndfa1, &ndfa2));
-   TEST(0 == oprepeat_automat(&ndfa1, 0));
-   TEST(0 == opsequence_automat(&ndfa, &ndfa1));
-   TEST(0 == oprepeat_automat(&ndfa, 0));
-   // test
-   TEST( 0 == minimize_automat(&ndfa));
-   // check ndfa
-   TEST( ndfa.mman      != mman);
-   TEST( refcount_automatmman(ndfa.mman) == 1);
-   TEST( ndfa.nrstate   == 4);
-   TEST( ndfa.allocated == 4 * state_SIZE + state_SIZE_EMPTYTRANS(3) + 2*state_SIZE_RANGETRANS(1)+state_SIZE_RANGETRANS(2));
-   TEST( ! isempty_slist(&ndfa.states));
-   TEST( ndfa.isDFA     == 1);
-   helperstate[0] = (helper_state_t) { state_RANGE_ENDSTATE, 1, (size_t[]) { 1 }, (char32_t[]) { 'x' }, (char32_t[]) { 'x' }};
-   helperstate[1] = (helper_state_t) { state_RANGE, 1, (size_t[]) { 2 }, (char32_t[]) { 'y' }, (char32_t[]) { 'y' }};
-   helperstate[2] = (helper_state_t) { state_RANGE_ENDSTATE, 2, (size_t[]) { 1, 1 }, (char32_t[]) { 'x', 'z' }, (char32_t[]) { 'x', 'z' }};
-   helperstate[3] = (helper_state_t) { state_EMPTY, 1, (size_t[]) { 3 }, 0, 0};
-   TEST(0 == helper_compare_states(&ndfa, 4, helperstate))
-   // reset
+   // TEST oprepeatrange_automat: {0,0} is empty string
+   TEST(0 == helper_build_unit(&ndfa, false));
+   TEST(0 == oprepeatrange_automat(&ndfa, 0, 0));
+   TEST(0 == minimize_automat(&ndfa));
+   TEST(1 == isendstate_automat(&ndfa, 0));
+   TEST(0 == matchchar32_automat(&ndfa, 1, U"c", true));
    TEST(0 == free_automat(&ndfa));
-   TEST(0 == free_automat(&ndfa1));
-   reset_automatmman(mman);
 
-   // reset
-   TEST(0 == free_automat(&ndfa));
-   TEST(0 == free_automat(&ndfa1));
-   TEST(0 == free_automat(&ndfa2));
-   TEST(0 == delete_automatmman(&mman));
+   // TEST oprepeatrange_automat: simulated ERROR
+   for (unsigned isCharset = 0; isCharset <= 1; ++isCharset) {
+      TEST(0 == helper_build_unit(&ndfa, isCharset));
+      const size_t nrstate = nrstate_automat(&ndfa);
+      init_testerrortimer(&s_automat_errtimer, 1, ENOMEM);
+      TEST(ENOMEM == oprepeatrange_automat(&ndfa, 2, 3));
+      TEST(nrstate == nrstate_automat(&ndfa));
+      TEST(0 == free_automat(&ndfa));
+   }
 
    return 0;
 ONERR:
    free_automat(&ndfa);
-   free_automat(&ndfa1);
-   free_automat(&ndfa2);
-   delete_automatmman(&mman);
    return EINVAL;
 }
 
@@ -7181,6 +12199,19 @@ int unittest_proglang_automat()
    if (test_query())       goto ONERR;
    if (test_extend())      goto ONERR;
    if (test_optimize())    goto ONERR;
+   if (test_makedfapar())  goto ONERR;
+   if (test_matchutf8())   goto ONERR;
+   if (test_search())      goto ONERR;
+   if (test_lazydfa())     goto ONERR;
+   if (test_matchids())    goto ONERR;
+   if (test_minimize2())   goto ONERR;
+   if (test_image())       goto ONERR;
+   if (test_prefilter())   goto ONERR;
+   if (test_matcher())     goto ONERR;
+   if (test_matchtags())   goto ONERR;
+   if (test_threads())     goto ONERR;
+   if (test_compact())     goto ONERR;
+   if (test_repeatrange()) goto ONERR;
 
    return 0;
 ONERR:
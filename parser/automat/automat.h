@@ -19,9 +19,19 @@
 
 // forward
 struct automat_mman_t;
+struct state_t;
 
 // === exported types
 struct automat_t;
+struct automat_lazydfa_t;
+struct automat_image_t;
+struct automat_image_header_t;
+struct automat_image_state_t;
+struct automat_image_range_t;
+struct automat_prefilter_t;
+struct automat_matcher_t;
+struct automat_scratch_t;
+struct automat_search_t;
 
 
 // section: Functions
@@ -57,6 +67,49 @@ typedef struct automat_t {
    bool              isDFA;
 } automat_t;
 
+/* typedef: automat_matchspan_f
+ * Wird von <searchall_automat> für jeden gefundenen Treffer str[start..end-1] aufgerufen.
+ * Ein Rückgabewert != 0 bricht die Suche ab und wird von <searchall_automat> zurückgegeben. */
+typedef int (* automat_matchspan_f) (void* context, size_t start, size_t end);
+
+/* enums: automat_minimize_e
+ * Wählt das Verfahren von <minimize2_automat>.
+ *
+ * automat_minimize_BRZOZOWSKI - Zweimaliges Umkehren und Determinisieren (siehe <minimize_automat>).
+ *                               Kann im Zwischenschritt exponentiell viele Zustände erzeugen.
+ * automat_minimize_HOPCROFT   - Verfeinerung der Zustandspartition eines DFA, jeder der m Übergänge wird
+ *                               O(log n) mal betrachtet. Zeichenbereiche werden nicht in Zeichenklassen zerlegt.
+ * */
+typedef enum automat_minimize_e {
+   automat_minimize_BRZOZOWSKI,
+   automat_minimize_HOPCROFT,
+} automat_minimize_e;
+
+// group: constants
+
+/* define: automat_MAXMATCHID
+ * Die größte Muster-ID, die <opmatchid_automat> akzeptiert.
+ * Muster-IDs belegen die Zeichen 0x80000000 .. 0xfffeffff, darüber beginnen die Tags (siehe <automat_MINTAGCHAR>). */
+#define automat_MAXMATCHID \
+         ((uint32_t)0x7ffeffff)
+
+/* define: automat_MINTAGCHAR
+ * Das kleinste für Tags reservierte Zeichen (siehe <matchtags_automat>).
+ * Die Zeichen automat_MINTAGCHAR .. 0xffffffff überschneiden sich weder mit gültigen Eingabezeichen
+ * noch mit den Zeichen, mit denen <opmatchid_automat> eine Muster-ID markiert. */
+#define automat_MINTAGCHAR \
+         ((char32_t)0xffff0000)
+
+/* define: automat_MAXREPEAT
+ * Die größte endliche Anzahl Wiederholungen, die <oprepeatrange_automat> akzeptiert. */
+#define automat_MAXREPEAT \
+         ((size_t)1000)
+
+/* define: automat_REPEATINF
+ * Parameter maxcount von <oprepeatrange_automat> für eine unbegrenzte Anzahl Wiederholungen. */
+#define automat_REPEATINF \
+         SIZE_MAX
+
 // group: lifetime
 
 /* define: automat_FREE
@@ -116,6 +169,11 @@ static inline int isfree_automat(const automat_t* ndfa);
  * Gibt Anzahl Zustände des Automaten zurück. */
 size_t nrstate_automat(const automat_t* ndfa);
 
+/* function: sizeallocated_automat
+ * Gibt Anzahl Bytes zurück, die von den Zuständen des Automaten belegt werden.
+ * Nicht mitgezählt wird ungenutzter Speicher der Seiten von <automat_mman_t>. */
+size_t sizeallocated_automat(const automat_t* ndfa);
+
 /* function: isendstate_automat
  * Gibt true zurück, wenn der Zustand statenr ein Endzustand ist.
  * D.h. der bis zu diesem Zustand verarbeitete Eingabestring ist gültig.
@@ -144,9 +202,99 @@ int iserrorstate_automat(const automat_t* ndfa, size_t statenr/*0 == start, nrst
  * L - The value L is > 0. The string str[0..L-1] is recognized (matched) by ndfa.
  *     If parameter matchLongest was set to true then L gives the longest possible match.
  *     If parameter matchLongest was set to false then L is the shortest possible match.
+ *
+ * Threads:
+ * Der Automat wird nur gelesen und darf von mehreren Threads gleichzeitig verwendet werden.
+ * Ein NFA wird simuliert, wobei die Markierungen besuchter Zustände in einem internen
+ * <automat_scratch_t> gespeichert werden, der über die Zustandsnummer indiziert wird.
  */
 size_t matchchar32_automat(const automat_t* ndfa, size_t len, const char32_t str[len], bool matchLongest);
 
+/* function: matchutf8_automat
+ * Wie <matchchar32_automat>, nur dass str aus UTF-8 kodierten Bytes besteht.
+ * Die Eingabe wird nicht dekodiert, jedes Byte bewirkt genau einen Zustandsübergang.
+ * Es wird kein Speicher allokiert.
+ *
+ * Returns:
+ * 0 - Either ndfa was initialized with <initempty_automat>, ndfa is no DFA or the str is not matched by ndfa.
+ * L - The value L is > 0. The bytes str[0..L-1] are recognized (matched) by ndfa.
+ *     L is always the size of a sequence of complete UTF-8 encoded characters.
+ *
+ * Unchecked Precondition:
+ * - makeutf8_automat(ndfa) called before this function */
+size_t matchutf8_automat(const automat_t* ndfa, size_t len, const uint8_t str[len], bool matchLongest);
+
+/* function: search_automat
+ * Sucht den ersten Treffer in str, der an einer beliebigen Position beginnen darf.
+ * Gefunden wird der am weitesten links beginnende Treffer str[*matchstart..*matchend-1] und
+ * von allen an dieser Position beginnenden Treffern der längste.
+ *
+ * Jeder Aufruf übersetzt ndfa mit <init_automatsearch> und gibt die Suche danach wieder frei.
+ * Wird derselbe DFA mehrmals durchsucht, verwende <automat_search_t> direkt,
+ * dann wird nur einmal übersetzt und die Suche ist linear in der Länge von str.
+ *
+ * Returns:
+ * 0      - Treffer gefunden.
+ * ESRCH  - Kein Treffer in str.
+ * EINVAL - ndfa ist kein DFA.
+ * ENOMEM - Kein Speicher für die Übersetzung.
+ *
+ * Unchecked Precondition:
+ * - makedfa_automat(ndfa) or minimize_automat(ndfa) called before this function */
+int search_automat(const automat_t* ndfa, size_t len, const char32_t str[len], /*out*/size_t* matchstart, /*out*/size_t* matchend);
+
+/* function: searchall_automat
+ * Findet alle sich nicht überlappenden Treffer in str wie <search_automat>.
+ * Nach einem Treffer str[start..end-1] wird ab Position end weitergesucht.
+ * War der Treffer leer (start == end), dann ab Position end+1.
+ * Für jeden Treffer wird matchspan(context, start, end) aufgerufen.
+ *
+ * Returns:
+ * 0      - Alle Treffer wurden gemeldet.
+ * EINVAL - ndfa ist kein DFA.
+ * other  - Rückgabewert != 0 von matchspan. */
+int searchall_automat(const automat_t* ndfa, size_t len, const char32_t str[len], automat_matchspan_f matchspan, void* context);
+
+/* function: matchids_automat
+ * Ermittelt in einem einzigen Durchlauf, welche der mit <opmatchid_automat> markierten
+ * Muster ein Präfix von str erkennen (str[0..L-1] mit 0 <= L <= len).
+ * Für jede solche Muster-ID id < nrid wird ismatch[id] auf true gesetzt, alle anderen
+ * Einträge von ismatch werden auf false gesetzt.
+ * Soll ein Muster an beliebiger Stelle in str gefunden werden, muss es mit ".*" beginnen.
+ *
+ * Returns:
+ * Die Anzahl der erkannten Muster-IDs kleiner nrid. Ist ndfa kein DFA, wird 0 zurückgegeben.
+ *
+ * Unchecked Precondition:
+ * - makedfa_automat(ndfa) or minimize_automat(ndfa) called before this function */
+size_t matchids_automat(const automat_t* ndfa, size_t len, const char32_t str[len], size_t nrid, /*out*/bool ismatch[nrid]);
+
+/* function: matchtags_automat
+ * Ermittelt die Positionen von Markierungen (Tags) innerhalb von str[0..len-1].
+ * Die Zeichen tagfrom .. tagfrom+nrtag-1 dienen als Tags. Sie kommen in der Eingabe nicht vor,
+ * normalerweise wird dafür der Bereich ab <automat_MINTAGCHAR> verwendet.
+ * Ein Tag wird gelesen, ohne ein Zeichen von str zu verbrauchen.
+ *
+ * rdfa muss ein DFA der umgekehrten Sprache sein (siehe <initreverse_automat> und <minimize_automat>).
+ * Gesucht wird ein Wort der nicht umgekehrten Sprache, das ohne seine Tags genau str[0..len-1] ergibt.
+ * Dazu wird str einmal rückwärts gelesen, wobei für jede Position die erreichbaren Zustände mit ihrem
+ * Vorgänger gespeichert werden; danach wird der Pfad vorwärts rekonstruiert. Es gibt kein Backtracking,
+ * die Laufzeit ist O(len * nrstate_automat(rdfa)).
+ * Der Pfadgraph wird in scratch gespeichert, das bei Bedarf vergrößert wird und für weitere Aufrufe
+ * wiederverwendet werden kann. Nach einigen Aufrufen wird daher kein Speicher mehr allokiert.
+ *
+ * Für jedes Tag k enthält tagpos[k] die Position des letzten Vorkommens in str (0..len)
+ * bzw. SIZE_MAX, falls es nicht vorkommt. Gibt es mehrere Zerlegungen, wird bevorzugt,
+ * dass Zeichen von str möglichst früh gelesen werden, d.h. Tags stehen möglichst weit hinten.
+ * Bei "A a* B C a* D" und str == "aa" liefert das A=0, B=C=D=2.
+ *
+ * Returns:
+ * 0      - Zerlegung gefunden, tagpos ist gesetzt.
+ * ESRCH  - str[0..len-1] ist nicht in der Sprache (error is not logged).
+ * EINVAL - rdfa ist kein DFA, nrtag == 0 oder tagfrom+nrtag-1 läuft über.
+ * ENOMEM - scratch konnte nicht für die O(len * nrstate) Knoten des Pfadgraphen vergrößert werden. */
+int matchtags_automat(const automat_t* rdfa, struct automat_scratch_t* scratch, size_t len, const char32_t str[len], char32_t tagfrom, size_t nrtag, /*out*/size_t tagpos[nrtag]);
+
 /* function: print_automat
  * Gibt ein Folge von Zeilen der Form "a(0xaddrA): 'a-z'--> b(0xaddrB)" aus.
  * Ein '' steht für einen leeren Übergang(Transition), der keinen Buchstaben erwartet. */
@@ -181,12 +329,46 @@ int opsequence_automat(automat_t* restrict ndfa, automat_t* restrict ndfa2/*free
  * Wiederholung) auch erlaubt ist. */
 int oprepeat_automat(/*out*/automat_t* ndfa, bool isAtLeastOneTime);
 
+/* function: oprepeatrange_automat
+ * Erzeugt Automat ndfa = "(ndfa){mincount,maxcount}", d.h. das von ndfa erzeugte Muster
+ * wird mindestens mincount und höchstens maxcount mal wiederholt.
+ * Mit maxcount == <automat_REPEATINF> ist die Anzahl nach oben unbegrenzt.
+ *
+ * Die Wiederholungen werden als Kopien von ndfa auf demselben Heap erzeugt (siehe <initcopy_automat>).
+ * Die optionalen Wiederholungen werden geschachtelt "(X(X(X)?)?)?" statt "X?X?X?" aneinandergereiht,
+ * so dass der DFA nur linear mit maxcount wächst. Besteht ndfa nur aus einem Übergang
+ * für eine Zeichenmenge (z.B. "[0-9]"), wird statt der Kopien direkt eine Kette aus
+ * maxcount+2 Zuständen (bzw. mincount+2 für <automat_REPEATINF>) erzeugt, die bereits deterministisch ist.
+ *
+ * Returns:
+ * EINVAL - ndfa ist nicht initialisiert, mincount > maxcount oder
+ *          mincount bzw. endliches maxcount ist größer als <automat_MAXREPEAT>. */
+int oprepeatrange_automat(automat_t* ndfa, size_t mincount, size_t maxcount);
+
 /* function: opor_automat
  * Erzeugt Automat ndfa = "(ndfa)|(ndfa2)"
  * Der Speicher wird vom Heap von ndfa allokiert.
  * Falls ndfa2 nicht denselben Heap benutzt, wird der Inhalt kopiert. */
 int opor_automat(/*out*/automat_t* restrict ndfa, automat_t* restrict ndfa2/*freed after return*/);
 
+/* function: opmatchid_automat
+ * Markiert das Ende des von ndfa erkannten Musters mit der Muster-ID matchid.
+ * Intern wird ndfa = "(ndfa)<matchid>" erzeugt, wobei <matchid> ein Zeichen oberhalb
+ * von <maxchar_utf8> ist, das in keiner Eingabe vorkommt. Daher bleibt die Markierung
+ * durch <opor_automat>, <makedfa_automat> und <minimize_automat> hindurch erhalten.
+ *
+ * Mehrere markierte Automaten werden mit <opor_automat> zu einem einzigen verbunden,
+ * der dann mit <matchids_automat> alle Muster in einem Durchlauf prüft:
+ * > opmatchid_automat(&ndfa1, 1); opmatchid_automat(&ndfa2, 2);
+ * > opor_automat(&ndfa1, &ndfa2); minimize_automat(&ndfa1);
+ * > matchids_automat(&ndfa1, len, str, 3, ismatch);
+ *
+ * Ein markierter Automat erkennt mit <matchchar32_automat> oder <search_automat> keine Eingabe mehr.
+ *
+ * Returns:
+ * EINVAL - matchid > <automat_MAXMATCHID> or ndfa is freed. */
+int opmatchid_automat(automat_t* ndfa, uint32_t matchid);
+
 /* function: opand_automat
  * Erzeugt Automat ndfa = "(ndfa) & (ndfa2)".
  * Der erzeugte Automat erkennt Zeichenfolgen, die von beiden AUtomaten gemeinsam erkannt werden. */
@@ -201,6 +383,35 @@ int opandnot_automat(automat_t* restrict ndfa, automat_t* restrict ndfa2/*freed
  * Erzeugt Automat ndfa = "!(ndfa)" bzw. gleichbedeutend mit ndfa = "([\x00-\xffffffff]*) & !(ndfa)". */
 int opnot_automat(automat_t* restrict ndfa);
 
+// group: persistence
+
+/* function: save_automat
+ * Speichert den DFA ndfa im Binärformat <automat_image_t> in der Datei filename.
+ * Das Format enthält keine Zeiger, alle Zustände werden über ihre Nummer referenziert.
+ * Mit <load_automatimage> wird die Datei in den Speicher eingeblendet und kann ohne
+ * weitere Umwandlung mit <matchchar32_automatimage> verwendet werden.
+ *
+ * Die Daten werden zuerst in eine temporäre Datei im Verzeichnis von filename geschrieben,
+ * die nach fsync per rename die Datei filename ersetzt. Eine existierende Datei wird dadurch
+ * nie teilweise überschrieben und bereits eingeblendete Abbilder bleiben unverändert.
+ *
+ * Returns:
+ * EINVAL - ndfa is no DFA.
+ * E2BIG  - ndfa has too many states or transitions (more than 2^32-2).
+ *
+ * Unchecked Precondition:
+ * - makedfa_automat(ndfa) or minimize_automat(ndfa) called before this function */
+int save_automat(const automat_t* ndfa, const char* filename);
+
+/* function: saveutf8_automat
+ * Wie <save_automat>, aber für einen mit <makeutf8_automat> erzeugten DFA.
+ * Das Abbild wird als bytebasiert markiert (<automat_image_UTF8>) und kann nur
+ * mit <matchutf8_automatimage> verwendet werden.
+ *
+ * Unchecked Precondition:
+ * - makeutf8_automat(ndfa) called before this function */
+int saveutf8_automat(const automat_t* ndfa, const char* filename);
+
 // group: optimize
 
 /* function: makedfa_automat
@@ -214,6 +425,16 @@ int opnot_automat(automat_t* restrict ndfa);
  * */
 int makedfa_automat(automat_t* ndfa);
 
+/* function: makedfapar_automat
+ * Wie <makedfa_automat>, verwendet aber bis zu nrthread Threads.
+ * Bei nrthread == 0 wird die Anzahl der verfügbaren Prozessoren verwendet.
+ *
+ * Alle Multi-Zustände mit gleichem Abstand zum Startzustand werden parallel
+ * expandiert, wobei jeder Thread eigene Speicherverwalter nutzt.
+ * Das Ergebnis ist unabhängig von nrthread und gleicht dem von <makedfa_automat>.
+ * Lohnt sich erst bei Automaten mit vielen tausend DFA Zuständen. */
+int makedfapar_automat(automat_t* ndfa, unsigned nrthread);
+
 /* function: minimize_automat
  * Generiert einen auf minimale Anzahl an Zuständen optimierten deterministischen endlichen Automaten.
  * Der generierte Automat ist deterministisch (letzte Operation ist <makedfa_automat>).
@@ -230,6 +451,421 @@ int makedfa_automat(automat_t* ndfa);
  * */
 int minimize_automat(automat_t* ndfa);
 
+/* function: minimize2_automat
+ * Wie <minimize_automat>, aber mit wählbarem Verfahren algorithm (siehe <automat_minimize_e>).
+ * Mit <automat_minimize_HOPCROFT> wird ndfa zuerst mit <makedfa_automat> in einen DFA verwandelt,
+ * falls es noch keiner ist. Der DFA wird dann direkt minimiert, ohne Zwischenautomaten zu bauen.
+ *
+ * Returns:
+ * EINVAL - Unbekanntes Verfahren algorithm oder ndfa ist nicht initialisiert.
+ * E2BIG  - DFA hat zu viele Zustände oder Übergänge für <automat_minimize_HOPCROFT>. */
+int minimize2_automat(automat_t* ndfa, automat_minimize_e algorithm);
+
+/* function: makeutf8_automat
+ * Wandelt ndfa in einen gleichwertigen DFA um, der UTF-8 kodierte Bytes anstatt
+ * Unicode Zeichen erkennt. Jeder Übergang für einen Zeichenbereich [from..to] wird
+ * in Ketten von Übergängen für Bytebereiche umgewandelt, die genau die UTF-8 Kodierung
+ * aller Zeichen aus [from..to] erkennen. Zeichen größer <maxchar_utf8> werden ignoriert.
+ * Danach wird <makedfa_automat> aufgerufen, so dass gemeinsame Präfixe zusammengefasst werden.
+ *
+ * Das folgende Beispiel zeigt die Transformation:
+ * nfa ( start: [0x80-0x7ff]->e; e: <endstate> )
+ * dfa ( start: [0xc2-0xdf]->m; m: [0x80-0xbf]->e; e: <endstate> )
+ *
+ * Der erzeugte Automat darf nur mit <matchutf8_automat> verwendet werden. */
+int makeutf8_automat(automat_t* ndfa);
+
+/* function: compact_automat
+ * Kopiert alle Zustände und Übergänge von ndfa in einen neuen, nur von ndfa genutzten Heap und gibt den alten frei.
+ * Die Zustände werden in Breitensuche ab dem Startzustand angeordnet, jeder Zustand direkt gefolgt von seinen Übergängen.
+ * Die Bereichsübergänge eines Zustandes werden dabei zu möglichst wenigen Knoten zusammengefasst.
+ * Nicht erreichbare Zustände folgen danach, der Endzustand bleibt der letzte.
+ * Nach dem Aufbau eines Automaten verteilt sich dieser über viele Speicherseiten, die zum großen Teil
+ * aus nicht mehr genutzten Zwischenergebnissen bestehen. Für langlebige Automaten reduziert
+ * diese Funktion den Speicherverbrauch und erhöht die Lokalität beim Matchen.
+ * Teilen sich andere Automaten den alten Heap, wird dieser erst mit dem letzten von ihnen freigegeben.
+ *
+ * Returns:
+ * EINVAL - ndfa ist nicht initialisiert. */
+int compact_automat(automat_t* ndfa);
+
+
+
+/* struct: automat_lazydfa_t
+ * Simuliert den zu einem <automat_t> gehörenden DFA, ohne ihn vorab mit <makedfa_automat>
+ * zu erzeugen. Jeder DFA Zustand entspricht einer Menge von ndfa Zuständen und wird erst erzeugt,
+ * wenn er beim Matchen erreicht wird. Die Übergänge zwischen den erzeugten Zuständen werden
+ * ebenfalls erst beim ersten Durchlaufen berechnet und dann gespeichert.
+ *
+ * Alle erzeugten Zustände werden in einem Cache gehalten, dessen Größe begrenzt ist.
+ * Ist er voll, werden alle Zustände verworfen und das Matchen wird mit leerem Cache fortgesetzt.
+ * Speicherverbrauch und Laufzeit der Konstruktion bleiben damit auch für Muster wie
+ * "(a|b)*a(a|b){20}" begrenzt, deren DFA exponentiell viele Zustände besitzt.
+ *
+ * Der verwendete <automat_t> darf während der Lebensdauer von automat_lazydfa_t weder
+ * verändert noch freigegeben werden. */
+typedef struct automat_lazydfa_t automat_lazydfa_t;
+
+// group: lifetime
+
+/* function: new_automatlazydfa
+ * Erzeugt einen leeren Cache für DFA Zustände von ndfa.
+ * Übersteigt der belegte Speicher maxcachesize Bytes, wird der Cache geleert,
+ * bevor ein neuer Zustand hinzugefügt wird. */
+int new_automatlazydfa(/*out*/automat_lazydfa_t** lazy, const automat_t* ndfa, size_t maxcachesize);
+
+/* function: delete_automatlazydfa
+ * Gibt alle erzeugten Zustände und lazy selbst frei. */
+int delete_automatlazydfa(automat_lazydfa_t** lazy);
+
+// group: query
+
+/* function: nrstate_automatlazydfa
+ * Gibt die Anzahl der aktuell im Cache gespeicherten DFA Zustände zurück. */
+size_t nrstate_automatlazydfa(const automat_lazydfa_t* lazy);
+
+/* function: nrflush_automatlazydfa
+ * Gibt zurück, wie oft der Cache bisher geleert wurde. */
+size_t nrflush_automatlazydfa(const automat_lazydfa_t* lazy);
+
+/* function: matchchar32_automatlazydfa
+ * Liefert dasselbe Ergebnis wie <matchchar32_automat> für den zugrundeliegenden ndfa.
+ * Fehlende DFA Zustände und Übergänge werden erzeugt und im Cache gespeichert.
+ * Im Fehlerfall (ENOMEM) wird 0 zurückgegeben. */
+size_t matchchar32_automatlazydfa(automat_lazydfa_t* lazy, size_t len, const char32_t str[len], bool matchLongest);
+
+
+
+/* struct: automat_image_header_t
+ * Kopf einer mit <save_automat> gespeicherten Datei.
+ * Alle Werte sind in der Bytereihenfolge der Maschine gespeichert, die die Datei erzeugt hat.
+ * Auf eine Maschine mit anderer Bytereihenfolge passt magic nicht mehr.
+ *
+ * Aufbau der Datei:
+ * > automat_image_header_t header;
+ * > automat_image_state_t  states[header.nrstate+1]; // states[0] == start state
+ * > automat_image_range_t  ranges[header.nrrange];
+ *
+ * Die Übergänge des Zustandes s sind ranges[states[s].range .. states[s+1].range-1].
+ * Sie sind aufsteigend sortiert. Der Endzustand hat die Nummer nrstate-1.
+ * Die Prüfsumme (FNV-1a 64 Bit) wird über alle Bytes nach dem Kopf berechnet.
+ * Ist <automat_image_UTF8> in flags gesetzt, sind die Übergänge Bytebereiche. */
+typedef struct automat_image_header_t {
+   uint32_t magic;      // automat_image_MAGIC
+   uint16_t version;    // automat_image_VERSION
+   uint16_t headersize; // sizeof(automat_image_header_t)
+   uint32_t nrstate;    // number of states
+   uint32_t nrrange;    // number of range transitions of all states
+   uint32_t flags;      // 0 or automat_image_UTF8
+   uint32_t reserved;   // always 0
+   uint64_t checksum;   // FNV-1a over states and ranges
+} automat_image_header_t;
+
+/* struct: automat_image_state_t
+ * Beschreibt einen Zustand in einer mit <save_automat> gespeicherten Datei. */
+typedef struct automat_image_state_t {
+   uint32_t range;   // index of first transition in ranges
+   uint32_t isend;   // 1: state accepts input; 0: no end state
+} automat_image_state_t;
+
+/* struct: automat_image_range_t
+ * Beschreibt einen Übergang in einer mit <save_automat> gespeicherten Datei. */
+typedef struct automat_image_range_t {
+   char32_t from;    // inclusive
+   char32_t to;      // inclusive
+   uint32_t state;   // number of target state
+} automat_image_range_t;
+
+/* struct: automat_image_t
+ * Ein mit <save_automat> gespeicherter DFA, der per mmap in den Speicher eingeblendet wurde.
+ * Der Speicher wird nur gelesen, so dass mehrere Prozesse dieselben Seiten des Page-Caches
+ * gemeinsam nutzen. */
+typedef struct automat_image_t {
+   const void*                  addr;
+   size_t                       size;
+   size_t                       nrstate;
+   const automat_image_state_t* states;
+   const automat_image_range_t* ranges;
+   uint32_t                     flags;
+} automat_image_t;
+
+// group: constants
+
+/* define: automat_image_MAGIC
+ * Die ersten 4 Bytes einer Datei im Format <automat_image_t> ("AUTM"). */
+#define automat_image_MAGIC \
+         ((uint32_t)0x4d545541)
+
+/* define: automat_image_VERSION
+ * Die aktuelle Version des Dateiformates. */
+#define automat_image_VERSION \
+         ((uint16_t)2)
+
+/* define: automat_image_UTF8
+ * Wert von <automat_image_header_t.flags>: Abbild wurde mit <saveutf8_automat> gespeichert. */
+#define automat_image_UTF8 \
+         ((uint32_t)1)
+
+// group: lifetime
+
+/* define: automat_image_FREE
+ * Static initializer. */
+#define automat_image_FREE \
+         { 0, 0, 0, 0, 0, 0 }
+
+/* function: load_automatimage
+ * Blendet die mit <save_automat> oder <saveutf8_automat> erzeugte Datei filename in den Speicher ein.
+ * Kopf, Größe, Sortierung der Übergänge und alle Zustandsnummern werden immer überprüft,
+ * so dass auch ein beschädigtes Abbild beim Matchen keinen ungültigen Speicher liest.
+ * Die Prüfsumme wird nur bei isChecksum == true berechnet und verglichen.
+ *
+ * Returns:
+ * EINVAL - Datei ist kein gültiges Abbild (falsche Version oder Bytereihenfolge, Prüfsumme falsch).
+ * other  - Fehler beim Öffnen oder Einblenden der Datei. */
+int load_automatimage(/*out*/automat_image_t* img, const char* filename, bool isChecksum);
+
+/* function: free_automatimage
+ * Entfernt die eingeblendete Datei aus dem Speicher. */
+int free_automatimage(automat_image_t* img);
+
+// group: query
+
+/* function: matchchar32_automatimage
+ * Liefert dasselbe Ergebnis wie <matchchar32_automat> für den gespeicherten DFA.
+ * Liefert 0, falls das Abbild mit <saveutf8_automat> gespeichert wurde. */
+size_t matchchar32_automatimage(const automat_image_t* img, size_t len, const char32_t str[len], bool matchLongest);
+
+/* function: matchutf8_automatimage
+ * Liefert dasselbe Ergebnis wie <matchutf8_automat> für den gespeicherten DFA.
+ * Liefert 0, falls das Abbild nicht mit <saveutf8_automat> gespeichert wurde. */
+size_t matchutf8_automatimage(const automat_image_t* img, size_t len, const uint8_t str[len], bool matchLongest);
+
+
+
+/* define: automat_prefilter_MAXRANGE
+ * Maximale Anzahl an Zeichenbereichen der Anfangszeichen. */
+#define automat_prefilter_MAXRANGE \
+         4
+
+/* define: automat_prefilter_MAXLITERAL
+ * Maximale Länge des gespeicherten Präfixes, mit dem jeder Treffer beginnt. */
+#define automat_prefilter_MAXLITERAL \
+         16
+
+/* struct: automat_prefilter_t
+ * Aus einem DFA abgeleitete Bedingungen, die jeder nicht leere Treffer erfüllen muss.
+ * Jeder Treffer beginnt mit einem Zeichen aus den Bereichen from[i]..to[i] (i < nrrange)
+ * und mit den nrliteral Zeichen aus literal.
+ * <find_automatprefilter> überspringt damit alle Positionen, an denen kein Treffer beginnen kann.
+ * <search_automat> und <searchall_automat> verwenden den Filter, solange kein Zustand aktiv ist.
+ *
+ * Ist nrrange == 0, kann nichts übersprungen werden, weil der leere String ein Treffer ist
+ * oder der Startzustand zu viele Übergänge hat. */
+typedef struct automat_prefilter_t {
+   uint8_t  nrrange;
+   uint8_t  nrliteral;
+   char32_t from[automat_prefilter_MAXRANGE];
+   char32_t to[automat_prefilter_MAXRANGE];
+   char32_t literal[automat_prefilter_MAXLITERAL];
+} automat_prefilter_t;
+
+// group: lifetime
+
+/* define: automat_prefilter_FREE
+ * Static initializer. Filter überspringt nichts. */
+#define automat_prefilter_FREE \
+         { 0, 0, { 0 }, { 0 }, { 0 } }
+
+/* function: init_automatprefilter
+ * Berechnet aus dem Startzustand des DFA ndfa die Menge der Anfangszeichen und
+ * aus der Kette von Zuständen mit genau einem Übergang für ein einziges Zeichen
+ * den Präfix, mit dem jeder Treffer beginnt.
+ *
+ * Returns:
+ * EINVAL - ndfa ist kein DFA. */
+int init_automatprefilter(/*out*/automat_prefilter_t* filter, const automat_t* ndfa);
+
+// group: query
+
+/* function: find_automatprefilter
+ * Liefert die erste Position i >= offset, an der ein Treffer beginnen könnte:
+ * str[i] liegt in einem Bereich der Anfangszeichen und str[i..] beginnt mit filter->literal.
+ * Liefert len, falls es keine solche Position gibt.
+ * Die Anfangszeichen werden mit SSE2 (4 Zeichen) oder AVX2 (8 Zeichen) pro Schritt verglichen. */
+size_t find_automatprefilter(const automat_prefilter_t* filter, size_t offset, size_t len, const char32_t str[len]);
+
+
+
+/* struct: automat_matcher_t
+ * Matcht einen DFA gegen eine Eingabe, die in mehreren Teilen ankommt.
+ * Zwischen den Aufrufen von <feed_automatmatcher> werden der aktuelle Zustand des DFA,
+ * die Anzahl bisher gelesener Zeichen und die Länge des bisher besten Treffers gespeichert.
+ * Die Teile müssen deshalb nicht zu einem einzigen String zusammengesetzt werden.
+ *
+ * Das Ergebnis von <finish_automatmatcher> gleicht dem von <matchchar32_automat>
+ * bzw. <matchutf8_automat> für die Verkettung aller Teile.
+ *
+ * Example:
+ * > automat_matcher_t matcher;
+ * > init_automatmatcher(&matcher, &dfa, true);
+ * > while (!isdone_automatmatcher(&matcher) && (size = read(fd, buffer, sizeof(buffer))) > 0) {
+ * >    feedutf8_automatmatcher(&matcher, (size_t)size, buffer);
+ * > }
+ * > if (0 == finish_automatmatcher(&matcher, &matchedlen)) { ... match found ... } */
+typedef struct automat_matcher_t {
+   // group: private
+   const struct automat_t* ndfa;
+   const struct state_t*   state;   // current state; 0: further input does not change result
+   size_t   offset;     // number of characters (or bytes) consumed
+   size_t   matchedlen; // length of best match (valid if isMatch)
+   bool     isMatch;
+   bool     isLongest;
+} automat_matcher_t;
+
+// group: lifetime
+
+/* define: automat_matcher_FREE
+ * Static initializer. */
+#define automat_matcher_FREE \
+         { 0, 0, 0, 0, false, false }
+
+/* function: init_automatmatcher
+ * Bereitet matcher vor, um den DFA ndfa zu matchen. ndfa darf bis <finish_automatmatcher>
+ * nicht verändert werden. matchLongest hat dieselbe Bedeutung wie in <matchchar32_automat>.
+ *
+ * Returns:
+ * EINVAL - ndfa ist kein DFA. */
+int init_automatmatcher(/*out*/automat_matcher_t* matcher, const automat_t* ndfa, bool matchLongest);
+
+/* function: finish_automatmatcher
+ * Liefert in matchedlen die Länge des Treffers am Anfang aller übergebenen Teile
+ * und setzt matcher auf <automat_matcher_FREE> zurück.
+ *
+ * Returns:
+ * 0     - Treffer gefunden (auch leerer Treffer mit *matchedlen == 0).
+ * ESRCH - Kein Treffer. matchedlen wird nicht verändert. */
+int finish_automatmatcher(automat_matcher_t* matcher, /*out*/size_t* matchedlen);
+
+// group: query
+
+/* function: isdone_automatmatcher
+ * Liefert true, falls weitere Eingaben das Ergebnis nicht mehr verändern können,
+ * d.h. der DFA hat keinen Übergang für das zuletzt gelesene Zeichen oder
+ * bei matchLongest == false wurde schon ein Treffer gefunden. */
+bool isdone_automatmatcher(const automat_matcher_t* matcher);
+
+// group: update
+
+/* function: feed_automatmatcher
+ * Matcht die nächsten len Zeichen der Eingabe.
+ * Liefert die Anzahl verarbeiteter Zeichen. Ist sie kleiner als len,
+ * dann gilt <isdone_automatmatcher>. */
+size_t feed_automatmatcher(automat_matcher_t* matcher, size_t len, const char32_t chunk[len]);
+
+/* function: feedutf8_automatmatcher
+ * Wie <feed_automatmatcher>, aber für einen mit <makeutf8_automat> erzeugten DFA,
+ * der UTF-8 kodierte Bytes erwartet. Eine Multibyte-Sequenz darf auf zwei Teile verteilt sein,
+ * da der DFA jedes Byte einzeln verarbeitet. */
+size_t feedutf8_automatmatcher(automat_matcher_t* matcher, size_t len, const uint8_t chunk[len]);
+
+
+/* struct: automat_scratch_t
+ * Vom Aufrufer verwalteter Speicher für <matchtags_automat>.
+ * Der Pfadgraph wird hier gespeichert und nicht in den Zuständen des DFA.
+ *
+ * Threads:
+ * Alle Matchfunktionen sowie <initcopy_automat>, <initreverse_automat> und <init_automatsearch>
+ * lesen den Quellautomaten nur (jeder Zustand besitzt eine feste Nummer, über die der Speicher
+ * in automat_scratch_t indiziert wird). Ein einmal erzeugter Automat kann daher
+ * von beliebig vielen Threads gleichzeitig genutzt werden, wobei jeder Thread seinen eigenen
+ * automat_scratch_t verwendet. Ein automat_scratch_t kann für mehrere Aufrufe und auch für
+ * verschiedene DFAs wiederverwendet werden, sein Speicher wird bei Bedarf vergrößert.
+ * Automaten dürfen auf mehreren Threads erzeugt werden, solange sich zwei Threads nicht
+ * denselben Heap (Parameter use_mman) teilen. */
+typedef struct automat_scratch_t {
+   // group: private
+   size_t   size; // number of allocated bytes
+   void*    mem;  // memory used by the last called function
+} automat_scratch_t;
+
+// group: lifetime
+
+/* define: automat_scratch_FREE
+ * Static initializer. Der Speicher wird beim ersten Aufruf allokiert. */
+#define automat_scratch_FREE \
+         { 0, 0 }
+
+/* function: free_automatscratch
+ * Gibt den Speicher von scratch frei. */
+int free_automatscratch(automat_scratch_t* scratch);
+
+
+/* struct: automat_search_t
+ * Vorab übersetzte Suche nach Treffern eines DFA an beliebiger Position.
+ * Gefunden wird wie bei <search_automat> der am weitesten links beginnende Treffer
+ * und von allen dort beginnenden Treffern der längste.
+ *
+ * prefix ist ein DFA für ".*(ndfa)", dessen Zustände zusätzlich die Reihenfolge der Startpositionen
+ * aller aktiven Suchen kennen. Er wird vorwärts gelesen und liefert das Ende des Treffers.
+ * reverse ist ein DFA der umgekehrten Sprache von ndfa. Er wird vom Ende des Treffers aus rückwärts
+ * gelesen und liefert dessen Start. Bei der Suche nach einem Treffer wird jedes Zeichen daher
+ * höchstens zweimal gelesen, der Aufwand ist linear in der Länge von str und unabhängig
+ * von der Anzahl aktiver Zustände (zur Suche nach allen Treffern siehe <findall_automatsearch>).
+ * Solange keine Suche aktiv ist, überspringt filter alle Positionen, an denen kein Treffer beginnen kann.
+ *
+ * Threads:
+ * Die Suchfunktionen lesen automat_search_t nur. Eine einmal übersetzte Suche kann
+ * von beliebig vielen Threads gleichzeitig genutzt werden. */
+typedef struct automat_search_t {
+   automat_t            prefix;
+   automat_t            reverse;
+   automat_prefilter_t  filter;
+} automat_search_t;
+
+// group: lifetime
+
+/* define: automat_search_FREE
+ * Static initializer. */
+#define automat_search_FREE \
+         { automat_FREE, automat_FREE, automat_prefilter_FREE }
+
+/* function: init_automatsearch
+ * Übersetzt den DFA ndfa in eine Suche. ndfa wird nicht verändert und kann danach freigegeben werden.
+ * Die Anzahl der Zustände von prefix kann wie bei <makedfa_automat> im schlechtesten Fall
+ * exponentiell in der Anzahl der Zustände von ndfa wachsen.
+ *
+ * Returns:
+ * 0      - search ist initialisiert.
+ * EINVAL - ndfa ist kein DFA.
+ * ENOMEM - Kein Speicher. */
+int init_automatsearch(/*out*/automat_search_t* search, const automat_t* ndfa);
+
+/* function: free_automatsearch
+ * Gibt den Speicher von search frei. */
+int free_automatsearch(automat_search_t* search);
+
+// group: search
+
+/* function: find_automatsearch
+ * Liefert dasselbe Ergebnis wie <search_automat> für den DFA, aus dem search erzeugt wurde.
+ *
+ * Returns:
+ * 0      - Treffer gefunden.
+ * ESRCH  - Kein Treffer in str.
+ * EINVAL - search ist nicht initialisiert. */
+int find_automatsearch(const automat_search_t* search, size_t len, const char32_t str[len], /*out*/size_t* matchstart, /*out*/size_t* matchend);
+
+/* function: findall_automatsearch
+ * Liefert dieselben Treffer wie <searchall_automat> für den DFA, aus dem search erzeugt wurde.
+ * Nach einem Treffer wird ab dessen Ende mit dem Startzustand von prefix weitergesucht.
+ *
+ * Laufzeit:
+ * Um den längsten Treffer zu finden, liest prefix so lange weiter, bis kein Folgezustand mehr existiert.
+ * Die dabei hinter dem Ende des Treffers gelesenen Zeichen werden von der nächsten Suche
+ * erneut gelesen. Endet jeder Treffer kurz vor der Stelle, an der prefix keinen Folgezustand
+ * mehr hat, ist der Aufwand linear in len. Im schlechtesten Fall ist er quadratisch,
+ * etwa für "a|a+b" und str = "aaa...a", wo jeder Treffer "a" erst am Ende von str bestätigt wird. */
+int findall_automatsearch(const automat_search_t* search, size_t len, const char32_t str[len], automat_matchspan_f matchspan, void* context);
 
 // section: inline implementation
 
@@ -238,6 +874,11 @@ int minimize_automat(automat_t* ndfa);
 #define nrstate_automat(ndfa) \
          ((ndfa)->nrstate)
 
+/* define: sizeallocated_automat
+ * Implements <automat_t.sizeallocated_automat>. */
+#define sizeallocated_automat(ndfa) \
+         ((ndfa)->allocated)
+
 /* define: initmove_automat
  * Implements <automat_t.initmove_automat>. */
 static inline void initmove_automat(/*out*/automat_t* dest_ndfa, automat_t* src_ndfa/*freed after return*/)
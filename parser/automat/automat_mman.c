@@ -17,6 +17,8 @@
 
 #include "config.h"
 #include "automat_mman.h"
+#include <pthread.h>
+#include <sys/mman.h>
 #include "foreach.h"
 #include "slist.h"
 #include "test_errortimer.h"
@@ -36,6 +38,13 @@ typedef struct memory_page_t {
    /* variable: next
     * Verlinkt die Seiten zu einer einfach verketteten Liste. */
    slist_node_t *next; // links this page to next page (single linked list)
+   /* variable: ismapped
+    * Gibt an, ob die Seite Teil eines mit mmap allokierten <memory_chunk_SIZE> großen Blocks ist. */
+   uintptr_t    ismapped;
+   /* variable: nrused
+    * Nur in der ersten Seite eines Blocks gültig (<ismapped> != 0): Anzahl der benutzten Seiten des Blocks.
+    * Sinkt sie auf 0, wird der Block mit munmap freigegeben. Ist durch s_memory_pool.lock geschützt. */
+   size_t       nrused;
    /* variable: data
     * Beginn der gespeicherten Daten. Diese sind auf den long Datentyp ausgerichtet. */
    long         data[1]; // start of allocated dat aon this page
@@ -43,14 +52,42 @@ typedef struct memory_page_t {
 
 // group: static variables
 
+/* variable: s_memory_page_sizeallocated
+ * Summe aller allokierten Seiten. Wird atomar verändert, da mehrere Threads
+ * (siehe <makedfapar_automat>) jeweils eigene <automat_mman_t> verwenden. */
 static size_t s_memory_page_sizeallocated = 0;
 
+/* variable: s_memory_page_sizepeak
+ * Maximalwert von <s_memory_page_sizeallocated> seit dem letzten Aufruf von <RESETPEAK_PAGECACHE>. */
+static size_t s_memory_page_sizepeak = 0;
+
+/* variable: s_memory_pool
+ * Verwaltet die Art der Allokation neuer Seiten, die Obergrenze reservierten Speichers
+ * und die unbenutzten Seiten aller mit mmap allokierten Blöcke.
+ * Wird von allen Threads geteilt und ist durch lock geschützt. */
+static struct {
+   pthread_mutex_t         lock;
+   automat_mman_backing_e  backing;
+   size_t                  maxsize;  // upper limit of reserved
+   size_t                  reserved; // size of all pages allocated with malloc + size of all mmapped chunks
+   automat_mman_evict_f    evict;
+   void*                   context;  // parameter of evict
+   slist_t                 freepages; // unused pages of mmapped chunks which contain at least one used page
+} s_memory_pool = {
+   PTHREAD_MUTEX_INITIALIZER, automat_mman_backing_MALLOC, SIZE_MAX, 0, 0, 0, slist_INIT
+};
+
 // group: constants
 
 /* define: memory_page_SIZE
  * Die Größe in Bytes einer <memory_page_t>. */
 #define memory_page_SIZE (256*1024)
 
+/* define: memory_chunk_SIZE
+ * Die Größe in Bytes eines mit mmap allokierten Blocks, der in mehrere <memory_page_t> aufgeteilt wird.
+ * Entspricht der Größe einer Huge-Page auf x86_64. */
+#define memory_chunk_SIZE (2*1024*1024)
+
 #define memory_page_FREESIZE \
          (memory_page_SIZE - offsetof(memory_page_t, data))
 
@@ -62,27 +99,193 @@ slist_IMPLEMENT(_pagelist, memory_page_t, next)
 
 size_t SIZEALLOCATED_PAGECACHE(void)
 {
-   return s_memory_page_sizeallocated;
+   return __atomic_load_n(&s_memory_page_sizeallocated, __ATOMIC_RELAXED);
+}
+
+size_t SIZEPEAK_PAGECACHE(void)
+{
+   return __atomic_load_n(&s_memory_page_sizepeak, __ATOMIC_RELAXED);
+}
+
+void RESETPEAK_PAGECACHE(void)
+{
+   __atomic_store_n(&s_memory_page_sizepeak, SIZEALLOCATED_PAGECACHE(), __ATOMIC_RELAXED);
+}
+
+size_t SIZERESERVED_PAGECACHE(void)
+{
+   pthread_mutex_lock(&s_memory_pool.lock);
+   size_t size = s_memory_pool.reserved;
+   pthread_mutex_unlock(&s_memory_pool.lock);
+   return size;
+}
+
+// group: configuration
+
+void setbacking_automatmman(automat_mman_backing_e backing)
+{
+   pthread_mutex_lock(&s_memory_pool.lock);
+   s_memory_pool.backing = backing;
+   pthread_mutex_unlock(&s_memory_pool.lock);
+}
+
+void setlimit_automatmman(size_t maxsize, automat_mman_evict_f evict, void* context)
+{
+   pthread_mutex_lock(&s_memory_pool.lock);
+   s_memory_pool.maxsize = maxsize;
+   s_memory_pool.evict   = evict;
+   s_memory_pool.context = context;
+   pthread_mutex_unlock(&s_memory_pool.lock);
+}
+
+// group: helper
+
+/* function: chunk_memorypage
+ * Gibt die erste Seite des Blocks zurück, zu dem page gehört (page->ismapped != 0).
+ * Blöcke sind an <memory_chunk_SIZE> ausgerichtet. */
+static inline memory_page_t* chunk_memorypage(memory_page_t* page)
+{
+   return (memory_page_t*) ((uintptr_t)page & ~(uintptr_t)(memory_chunk_SIZE-1));
 }
 
 // group: lifetime
 
+/* function: newchunk_memorypage
+ * Allokiert einen Block von <memory_chunk_SIZE> Bytes mit mmap, der an seiner Größe ausgerichtet ist.
+ * Mit isHugeTLB wird zuerst MAP_HUGETLB versucht, ansonsten (oder falls keine Huge-Pages reserviert sind)
+ * wird der Kernel mit MADV_HUGEPAGE gebeten, transparente Huge-Pages zu verwenden. */
+static int newchunk_memorypage(/*out*/uint8_t** chunk, bool isHugeTLB)
+{
+   void* addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+   if (isHugeTLB) {
+      addr = mmap(0, memory_chunk_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+   }
+#else
+   (void) isHugeTLB;
+#endif
+
+   if (addr == MAP_FAILED) {
+      // allocate twice the size to align chunk
+      addr = mmap(0, 2*memory_chunk_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if (addr == MAP_FAILED) return ENOMEM;
+      uint8_t* start = (uint8_t*) (((uintptr_t)addr + memory_chunk_SIZE-1) & ~(uintptr_t)(memory_chunk_SIZE-1));
+      size_t   head  = (size_t) (start - (uint8_t*)addr);
+      if (head) munmap(addr, head);
+      munmap(start + memory_chunk_SIZE, memory_chunk_SIZE - head);
+      addr = start;
+#ifdef MADV_HUGEPAGE
+      (void) madvise(addr, memory_chunk_SIZE, MADV_HUGEPAGE);
+#endif
+   }
+
+   *chunk = addr;
+
+   return 0;
+}
+
+/* function: reserve_memorypage
+ * Reserviert size Bytes innerhalb der mit <setlimit_automatmman> gesetzten Obergrenze
+ * oder entnimmt eine unbenutzte Seite aus s_memory_pool.freepages.
+ * Wird die Obergrenze überschritten, wird einmalig die Funktion evict aufgerufen (ohne gesperrten Lock),
+ * damit sie Speicher freigeben kann.
+ *
+ * Returns:
+ * 0      - size Bytes reserviert oder *page != 0 ist eine wiederverwendete Seite.
+ * ENOMEM - Obergrenze überschritten. */
+static int reserve_memorypage(/*out*/memory_page_t** page, /*out*/automat_mman_backing_e* backing, /*out*/size_t* size)
+{
+   for (bool isEvicted = false; ; isEvicted = true) {
+      pthread_mutex_lock(&s_memory_pool.lock);
+      *page = 0;
+      if (! isempty_slist(&s_memory_pool.freepages)) {
+         *page = removefirst_pagelist(&s_memory_pool.freepages);
+         ++ chunk_memorypage(*page)->nrused;
+         pthread_mutex_unlock(&s_memory_pool.lock);
+         return 0;
+      }
+      *backing = s_memory_pool.backing;
+      *size    = (*backing == automat_mman_backing_MALLOC) ? memory_page_SIZE : memory_chunk_SIZE;
+      if (*size <= s_memory_pool.maxsize && s_memory_pool.reserved <= s_memory_pool.maxsize - *size) {
+         s_memory_pool.reserved += *size;
+         pthread_mutex_unlock(&s_memory_pool.lock);
+         return 0;
+      }
+      automat_mman_evict_f evict = s_memory_pool.evict;
+      void* context = s_memory_pool.context;
+      pthread_mutex_unlock(&s_memory_pool.lock);
+
+      if (isEvicted || !evict) return ENOMEM;
+      evict(context, *size);
+   }
+}
+
+/* function: unreserve_memorypage
+ * Macht <reserve_memorypage> rückgängig, falls die Allokation fehlschlägt,
+ * bzw. gibt size Bytes nach dem Freigeben einer Seite oder eines Blocks wieder frei. */
+static void unreserve_memorypage(size_t size)
+{
+   pthread_mutex_lock(&s_memory_pool.lock);
+   s_memory_pool.reserved -= size;
+   pthread_mutex_unlock(&s_memory_pool.lock);
+}
+
 /* function: new_memorypage
  * Weist page eine Speicherseite von <buffer_page_SIZE> Bytes zu.
- * Der Speicherinhalt von (*page)->data und (*page)->next sind undefiniert. */
+ * Der Speicherinhalt von (*page)->data und (*page)->next sind undefiniert.
+ * Abhängig von <setbacking_automatmman> wird die Seite mit malloc allokiert
+ * oder einem mit mmap allokierten Block entnommen. */
 static int new_memorypage(/*out*/memory_page_t ** page)
 {
    int err;
-   void * addr;
+   void * addr = 0;
+   memory_page_t* reused;
+   automat_mman_backing_e backing;
+   size_t reservesize;
 
    if (! PROCESS_testerrortimer(&s_automat_mman_errtimer, &err)) {
-      addr = malloc(memory_page_SIZE);
-      err = !addr ? ENOMEM : 0;
+      err = reserve_memorypage(&reused, &backing, &reservesize);
    }
-
    if (err) goto ONERR;
 
-   s_memory_page_sizeallocated += memory_page_SIZE; 
+   if (reused) {
+      addr = reused;
+   } else if (backing == automat_mman_backing_MALLOC) {
+      addr = malloc(memory_page_SIZE);
+      if (!addr) {
+         unreserve_memorypage(reservesize);
+         err = ENOMEM;
+         goto ONERR;
+      }
+      ((memory_page_t*)addr)->ismapped = 0;
+   } else {
+      uint8_t* chunk;
+      err = newchunk_memorypage(&chunk, backing == automat_mman_backing_HUGETLB);
+      if (err) {
+         unreserve_memorypage(reservesize);
+         goto ONERR;
+      }
+      // first page is returned, all other pages are stored in s_memory_pool.freepages
+      pthread_mutex_lock(&s_memory_pool.lock);
+      for (size_t offset = memory_chunk_SIZE; offset > memory_page_SIZE; ) {
+         offset -= memory_page_SIZE;
+         memory_page_t* free_page = (memory_page_t*) (chunk + offset);
+         free_page->ismapped = 1;
+         insertfirst_pagelist(&s_memory_pool.freepages, free_page);
+      }
+      pthread_mutex_unlock(&s_memory_pool.lock);
+      addr = chunk;
+      ((memory_page_t*)addr)->ismapped = 1;
+      ((memory_page_t*)addr)->nrused   = 1;
+   }
+
+   size_t size = __atomic_add_fetch(&s_memory_page_sizeallocated, memory_page_SIZE, __ATOMIC_RELAXED);
+   size_t peak = __atomic_load_n(&s_memory_page_sizepeak, __ATOMIC_RELAXED);
+   while (  size > peak
+            && ! __atomic_compare_exchange_n(&s_memory_page_sizepeak, &peak, size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      // peak updated with current value ==> retry
+   }
 
    // set out
    *page = (memory_page_t*) addr;
@@ -92,13 +295,42 @@ ONERR:
    return err;
 }
 
-/* function: free_automatmman
- * Gibt eine Speicherseite frei. */
+/* function: delete_memorypage
+ * Gibt eine Speicherseite frei.
+ * Seiten eines mit mmap allokierten Blocks werden zur Wiederverwendung in s_memory_pool.freepages
+ * gespeichert. Ist die letzte Seite eines Blocks frei, werden seine Seiten aus der Liste entfernt,
+ * der Block mit munmap freigegeben und s_memory_pool.reserved um <memory_chunk_SIZE> verringert. */
 static int delete_memorypage(memory_page_t * page)
 {
    int err = 0;
-   free(page);
-   s_memory_page_sizeallocated -= memory_page_SIZE; 
+   if (page->ismapped) {
+      memory_page_t* chunk = chunk_memorypage(page);
+      pthread_mutex_lock(&s_memory_pool.lock);
+      if (-- chunk->nrused) {
+         // pages of mmapped chunks are kept for reuse
+         insertfirst_pagelist(&s_memory_pool.freepages, page);
+         chunk = 0;
+      } else {
+         // remove all other pages of chunk from freepages
+         slist_t freepages = s_memory_pool.freepages;
+         s_memory_pool.freepages = (slist_t) slist_INIT;
+         while (! isempty_slist(&freepages)) {
+            memory_page_t* free_page = removefirst_pagelist(&freepages);
+            if (chunk_memorypage(free_page) != chunk) {
+               insertlast_pagelist(&s_memory_pool.freepages, free_page);
+            }
+         }
+      }
+      pthread_mutex_unlock(&s_memory_pool.lock);
+      if (chunk) {
+         if (munmap(chunk, memory_chunk_SIZE)) err = errno;
+         unreserve_memorypage(memory_chunk_SIZE);
+      }
+   } else {
+      free(page);
+      unreserve_memorypage(memory_page_SIZE);
+   }
+   __atomic_sub_fetch(&s_memory_page_sizeallocated, memory_page_SIZE, __ATOMIC_RELAXED);
    (void) PROCESS_testerrortimer(&s_automat_mman_errtimer, &err);
    return err;
 }
@@ -399,6 +631,20 @@ static int test_memorypage(void)
       TEST(SIZEALLOCATED_PAGECACHE() == oldsize + i * memory_page_SIZE);
    }
 
+   // TEST RESETPEAK_PAGECACHE, SIZEPEAK_PAGECACHE
+   RESETPEAK_PAGECACHE();
+   TEST(SIZEPEAK_PAGECACHE() == oldsize);
+   for (unsigned i = 0; i < lengthof(page); ++i) {
+      TEST(0 == new_memorypage(&page[i]));
+      TEST(SIZEPEAK_PAGECACHE() == oldsize + (i+1) * memory_page_SIZE);
+   }
+   for (unsigned i = 0; i < lengthof(page); ++i) {
+      TEST(0 == delete_memorypage(page[i]));
+      TEST(SIZEPEAK_PAGECACHE() == oldsize + lengthof(page) * memory_page_SIZE);
+   }
+   RESETPEAK_PAGECACHE();
+   TEST(SIZEPEAK_PAGECACHE() == oldsize);
+
    // TEST new_memorypage: simulated ERROR
    for (unsigned i = 10; i < 13; ++i) {
       memory_page_t * errpage = 0;
@@ -996,12 +1242,149 @@ ONERR:
    return EINVAL;
 }
 
+typedef struct helper_evict_t {
+   size_t count;    // number of calls
+   size_t size;     // last value of parameter size
+   size_t newlimit; // if != 0 the limit is raised to this value
+} helper_evict_t;
+
+static void helper_evict(void* context, size_t size)
+{
+   helper_evict_t* evict = context;
+   ++ evict->count;
+   evict->size = size;
+   if (evict->newlimit) setlimit_automatmman(evict->newlimit, &helper_evict, context);
+}
+
+static int test_backing(void)
+{
+   memory_page_t* page[2*(memory_chunk_SIZE/memory_page_SIZE)] = { 0 };
+   memory_page_t* errpage  = 0;
+   const size_t   oldsize  = SIZEALLOCATED_PAGECACHE();
+   const size_t   reserved = SIZERESERVED_PAGECACHE();
+   const size_t   P        = memory_chunk_SIZE/memory_page_SIZE;
+   helper_evict_t evict    = { 0, 0, 0 };
+
+   // TEST memory_chunk_SIZE
+   TEST(ispowerof2_int(memory_chunk_SIZE));
+   TEST(0 == memory_chunk_SIZE % memory_page_SIZE);
+
+   // TEST new_memorypage: automat_mman_backing_MALLOC
+   TEST(0 == new_memorypage(&page[0]));
+   TEST(0 == page[0]->ismapped);
+   TEST(reserved + memory_page_SIZE == SIZERESERVED_PAGECACHE());
+   TEST(0 == delete_memorypage(page[0]));
+   TEST(reserved == SIZERESERVED_PAGECACHE());
+
+   // TEST setbacking_automatmman: automat_mman_backing_HUGETLB (falls back to MMAP if no huge pages reserved)
+   setbacking_automatmman(automat_mman_backing_HUGETLB);
+   TEST(0 == new_memorypage(&page[0]));
+   TEST(1 == page[0]->ismapped);
+   TEST(0 == ((uintptr_t)page[0] & (memory_chunk_SIZE-1)));
+   TEST(reserved + memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+
+   // TEST setbacking_automatmman: automat_mman_backing_MMAP
+   setbacking_automatmman(automat_mman_backing_MMAP);
+   for (size_t i = 1; i < lengthof(page); ++i) {
+      TEST(0 == new_memorypage(&page[i]));
+      TEST(1 == page[i]->ismapped);
+      // pages of same chunk are used before new chunk is allocated
+      TEST(page[i] == (memory_page_t*) ((uint8_t*)page[i - i%P] + (i%P) * memory_page_SIZE));
+      TEST(0 == ((uintptr_t)page[i - i%P] & (memory_chunk_SIZE-1)));
+      TEST(reserved + (1 + i/P) * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+      TEST(oldsize + (i+1) * memory_page_SIZE == SIZEALLOCATED_PAGECACHE());
+   }
+
+   // TEST delete_memorypage: chunk is unmapped after its last page is freed (pages freed in ascending order)
+   for (size_t i = 0; i < lengthof(page); ++i) {
+      TEST(0 == delete_memorypage(page[i]));
+      TEST(oldsize + (lengthof(page)-1-i) * memory_page_SIZE == SIZEALLOCATED_PAGECACHE());
+      TEST(reserved + (2 - (i+1)/P) * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+      if ((i+1) % P == 0) {
+         // chunk is no more mapped
+         TEST(-1 == msync(page[i+1-P], memory_chunk_SIZE, MS_ASYNC));
+         TEST(ENOMEM == errno);
+      }
+   }
+
+   // TEST delete_memorypage: chunk is unmapped after its last page is freed (pages freed in descending order)
+   for (size_t i = 0; i < lengthof(page); ++i) {
+      TEST(0 == new_memorypage(&page[i]));
+   }
+   TEST(reserved + 2 * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+   for (size_t i = lengthof(page)-1; i < lengthof(page); --i) {
+      TEST(0 == delete_memorypage(page[i]));
+      TEST(reserved + (1 + (i != 0) - (i <= P)) * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+   }
+   TEST(reserved == SIZERESERVED_PAGECACHE());
+   TEST(oldsize == SIZEALLOCATED_PAGECACHE());
+
+   // TEST delete_memorypage: mapped pages are kept for reuse while the chunk contains a used page
+   for (size_t i = 0; i < lengthof(page); ++i) {
+      TEST(0 == new_memorypage(&page[i]));
+   }
+   for (size_t i = 0; i < lengthof(page); ++i) {
+      if (i % P == 0) continue;
+      TEST(0 == delete_memorypage(page[i]));
+      TEST(reserved + 2 * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+   }
+   TEST(oldsize + 2 * memory_page_SIZE == SIZEALLOCATED_PAGECACHE());
+
+   // TEST new_memorypage: unused pages are reused regardless of backing
+   setbacking_automatmman(automat_mman_backing_MALLOC);
+   for (size_t i = 0; i < lengthof(page); ++i) {
+      if (i % P == 0) continue;
+      TEST(0 == new_memorypage(&page[i]));
+      TEST(1 == page[i]->ismapped);
+      TEST(reserved + 2 * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+   }
+
+   // TEST setlimit_automatmman: ENOMEM
+   setlimit_automatmman(SIZERESERVED_PAGECACHE(), 0, 0);
+   TEST(ENOMEM == new_memorypage(&errpage));
+   TEST(0 == errpage);
+   TEST(reserved + 2 * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+   TEST(oldsize + lengthof(page) * memory_page_SIZE == SIZEALLOCATED_PAGECACHE());
+
+   // TEST setlimit_automatmman: evict is called once
+   setlimit_automatmman(SIZERESERVED_PAGECACHE(), &helper_evict, &evict);
+   TEST(ENOMEM == new_memorypage(&errpage));
+   TEST(0 == errpage);
+   TEST(1 == evict.count);
+   TEST(memory_page_SIZE == evict.size);
+
+   // TEST setlimit_automatmman: evict frees memory (raises limit)
+   evict.newlimit = SIZE_MAX;
+   TEST(0 == new_memorypage(&errpage));
+   TEST(0 != errpage);
+   TEST(0 == errpage->ismapped);
+   TEST(2 == evict.count);
+   TEST(reserved + 2 * memory_chunk_SIZE + memory_page_SIZE == SIZERESERVED_PAGECACHE());
+   TEST(0 == delete_memorypage(errpage));
+   TEST(reserved + 2 * memory_chunk_SIZE == SIZERESERVED_PAGECACHE());
+
+   // TEST setlimit_automatmman: SIZE_MAX ==> no limit
+   setlimit_automatmman(SIZE_MAX, 0, 0);
+   for (size_t i = 0; i < lengthof(page); ++i) {
+      TEST(0 == delete_memorypage(page[i]));
+   }
+   TEST(oldsize == SIZEALLOCATED_PAGECACHE());
+   TEST(reserved == SIZERESERVED_PAGECACHE());
+
+   return 0;
+ONERR:
+   setbacking_automatmman(automat_mman_backing_MALLOC);
+   setlimit_automatmman(SIZE_MAX, 0, 0);
+   return EINVAL;
+}
+
 int unittest_proglang_automat_mman()
 {
    if (test_memorypage())  goto ONERR;
    if (test_initfree())    goto ONERR;
    if (test_allocate())    goto ONERR;
    if (test_restore())     goto ONERR;
+   if (test_backing())     goto ONERR;
 
    return 0;
 ONERR:
@@ -1,6 +1,16 @@
 /* title: Ad-hoc-Memory-Manager
 
-   TODO: describe module interface
+   Verwaltet den Speicher (Heap) eines oder mehrerer <automat_t>.
+   Speicher wird seitenweise mit malloc allokiert und innerhalb einer Seite
+   fortlaufend vergeben. Freigegebene Seiten werden im Cache des jeweiligen
+   <automat_mman_t> für spätere Allokationen aufbewahrt.
+
+   Threads:
+   Ein <automat_mman_t> darf nur von einem Thread zur selben Zeit verändert werden.
+   Alle <automat_mman_t> teilen sich einen globalen Vorrat an Seiten, der durch einen
+   Mutex geschützt ist. Der Mutex wird nur beim Holen und Zurückgeben einer ganzen Seite
+   gesperrt, nicht bei <malloc_automatmman>, solange die aktuelle Seite ausreicht.
+   Die globalen Zähler von <SIZEALLOCATED_PAGECACHE> und <SIZEPEAK_PAGECACHE> werden atomar verändert.
 
    Copyright:
    This program is free software. See accompanying LICENSE file.
@@ -21,6 +31,31 @@
 struct automat_mman_t;
 struct automat_mman_state_t;
 
+/* enums: automat_mman_backing_e
+ * Art der Allokation neuer Speicherseiten, siehe <setbacking_automatmman>.
+ *
+ * automat_mman_backing_MALLOC  - Jede Seite wird mit malloc allokiert und beim Freigeben an free zurückgegeben.
+ * automat_mman_backing_MMAP    - Seiten werden aus 2 MiB großen, mit mmap allokierten Blöcken entnommen.
+ *                                Der Kernel wird mit madvise(MADV_HUGEPAGE) gebeten, transparente Huge-Pages
+ *                                zu verwenden. Freigegebene Seiten werden für spätere Allokationen aufbewahrt.
+ *                                Sind alle Seiten eines Blocks frei, wird der Block mit munmap freigegeben.
+ * automat_mman_backing_HUGETLB - Wie automat_mman_backing_MMAP, aber die Blöcke werden mit MAP_HUGETLB
+ *                                aus den reservierten Huge-Pages (/proc/sys/vm/nr_hugepages) allokiert.
+ *                                Sind keine verfügbar, wird wie bei automat_mman_backing_MMAP verfahren.
+ * */
+typedef enum automat_mman_backing_e {
+   automat_mman_backing_MALLOC,
+   automat_mman_backing_MMAP,
+   automat_mman_backing_HUGETLB,
+} automat_mman_backing_e;
+
+/* typedef: automat_mman_evict_f
+ * Wird aufgerufen, wenn eine neue Allokation von size Bytes die mit <setlimit_automatmman>
+ * gesetzte Obergrenze überschreiten würde. Die Funktion sollte nicht mehr benötigte Automaten
+ * (z.B. zwischengespeicherte) freigeben. Danach wird die Allokation einmal wiederholt.
+ * Sie wird ohne gesperrten Lock aufgerufen und darf selbst Automaten freigeben. */
+typedef void (* automat_mman_evict_f) (void* context, size_t size);
+
 
 // section: Functions
 
@@ -64,6 +99,21 @@ int delete_automatmman(struct automat_mman_t **mman);
 
 size_t SIZEALLOCATED_PAGECACHE(void);
 
+/* function: SIZEPEAK_PAGECACHE
+ * Gibt die maximale Anzahl gleichzeitig allokierter Bytes aller Speicherseiten
+ * seit dem letzten Aufruf von <RESETPEAK_PAGECACHE> zurück. */
+size_t SIZEPEAK_PAGECACHE(void);
+
+/* function: RESETPEAK_PAGECACHE
+ * Setzt den von <SIZEPEAK_PAGECACHE> gelieferten Wert auf <SIZEALLOCATED_PAGECACHE>. */
+void RESETPEAK_PAGECACHE(void);
+
+/* function: SIZERESERVED_PAGECACHE
+ * Gibt die Anzahl Bytes zurück, die auf die Obergrenze von <setlimit_automatmman> angerechnet werden.
+ * Das sind alle mit malloc allokierten Seiten und alle mit mmap allokierten Blöcke
+ * inklusive ihrer unbenutzten Seiten. */
+size_t SIZERESERVED_PAGECACHE(void);
+
 /* function: refcount_automatmman
  * Gibt Anzahl der Objekte an, die mman nutzen. */
 size_t refcount_automatmman(const struct automat_mman_t *mman);
@@ -76,6 +126,22 @@ size_t sizeallocated_automatmman(const struct automat_mman_t *mman);
  * Gibt allokierten aber nicht mehr genutzten Speicher in Bytes zurück. */
 size_t wasted_automatmman(const struct automat_mman_t *mman);
 
+// group: configuration
+
+/* function: setbacking_automatmman
+ * Legt fest, wie neue Speicherseiten für alle <automat_mman_t> allokiert werden.
+ * Große DFAs verteilen sich auf viele Seiten, beim Matchen wird dann häufig der TLB verfehlt.
+ * Mit <automat_mman_backing_MMAP> bzw. <automat_mman_backing_HUGETLB> liegen jeweils acht
+ * Seiten in einer einzigen 2 MiB Huge-Page. Bereits allokierte Seiten sind nicht betroffen.
+ * Default ist <automat_mman_backing_MALLOC>. */
+void setbacking_automatmman(automat_mman_backing_e backing);
+
+/* function: setlimit_automatmman
+ * Setzt die Obergrenze für <SIZERESERVED_PAGECACHE>. Würde sie von einer neuen Seite
+ * (bzw. einem neuen 2 MiB Block) überschritten, wird zuerst evict(context, size) aufgerufen, falls evict != 0.
+ * Reicht das nicht, schlägt die Allokation mit ENOMEM fehl. Der Wert SIZE_MAX hebt die Obergrenze auf. */
+void setlimit_automatmman(size_t maxsize, automat_mman_evict_f evict, void* context);
+
 // group: update
 
 /* function: reset_automatmman
@@ -0,0 +1,329 @@
+/* title: Benchmark automat_t
+
+   Compares time and peak memory of <minimize_automat> (Brzozowski)
+   with <minimize2_automat> (Hopcroft) for some large automata.
+   Measures the throughput of <search_automat> with a sparse match.
+   Measures the throughput of matching a large DFA for every <automat_mman_backing_e>.
+
+   Every measurement runs in its own child process. The child reports the time,
+   the peak number of bytes of all <automat_mman_t> pages (see <SIZEPEAK_PAGECACHE>)
+   and the number of states of the result. The parent adds the maximum resident
+   set size of the child, which also includes memory allocated with malloc.
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2016 Jörg Seebohn
+*/
+
+#include "config.h"
+#include "automat.h"
+#include "automat_mman.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+typedef struct bench_result_t {
+   int    err;
+   double msec;
+   size_t peak;
+   size_t nrstate;
+} bench_result_t;
+
+static int build_or1024(automat_t* ndfa)
+{
+   // '(\u0000|\u0001|...|\u0400)+' (see main.c)
+   int err = initmatch_automat(ndfa, 0, 1, (char32_t[1]){0}, (char32_t[1]){0});
+   for (char32_t c = 1; !err && c <= 1024; ++c) {
+      automat_t ndfa2 = automat_FREE;
+      err = initmatch_automat(&ndfa2, ndfa, 1, (char32_t[1]){c}, (char32_t[1]){c});
+      if (!err) err = opor_automat(ndfa, &ndfa2);
+   }
+   if (!err) err = oprepeat_automat(ndfa, 1);
+   return err;
+}
+
+static int build_words1024(automat_t* ndfa)
+{
+   // 'w0x|w1x|...|w1023x'
+   int err = 0;
+   for (unsigned i = 0; !err && i < 1024; ++i) {
+      char     word[16];
+      int      len = snprintf(word, sizeof(word), "w%ux", i);
+      automat_t seq = automat_FREE;
+      err = initempty_automat(&seq, i ? ndfa : 0);
+      for (int c = 0; !err && c < len; ++c) {
+         automat_t chr = automat_FREE;
+         char32_t  ch  = (char32_t) word[c];
+         err = initmatch_automat(&chr, &seq, 1, &ch, &ch);
+         if (!err) err = opsequence_automat(&seq, &chr);
+      }
+      if (err) break;
+      if (i) {
+         err = opor_automat(ndfa, &seq);
+      } else {
+         initmove_automat(ndfa, &seq);
+      }
+   }
+   return err;
+}
+
+static int build_ab(automat_t* ndfa, bool isPrefix, unsigned n)
+{
+   // isPrefix == false: '(a|b)*a(a|b){n}' (DFA exponential, reversed DFA small)
+   // isPrefix == true:  '(a|b){n}a(a|b)*' (DFA small, reversed DFA exponential)
+   int err = initempty_automat(ndfa, 0);
+   for (unsigned i = 0; !err && i < n+2; ++i) {
+      automat_t ndfa2   = automat_FREE;
+      const bool isA    = (i == (isPrefix ? n : 1));
+      const bool isStar = (i == (isPrefix ? n+1 : 0));
+      err = initmatch_automat(&ndfa2, ndfa, 1, (char32_t[]){ 'a' }, (char32_t[]){ isA ? 'a' : 'b' });
+      if (!err && isStar) err = oprepeat_automat(&ndfa2, false);
+      if (!err) err = opsequence_automat(ndfa, &ndfa2);
+   }
+   return err;
+}
+
+static int build_ranges800(automat_t* ndfa)
+{
+   // DFA of 'c1[^c1]*c1|...|c800[^c800]*c800' with ci == 16*i
+   // (every state has ranges which end at another ci, character classes split them)
+   int err = initempty_automat(ndfa, 0);
+   automat_t all = automat_FREE;
+   for (char32_t i = 1; !err && i <= 800; ++i) {
+      automat_t seq = automat_FREE;
+      automat_t chr = automat_FREE;
+      err = initmatch_automat(&seq, ndfa, 1, (char32_t[]){ 16*i }, (char32_t[]){ 16*i });
+      if (!err) err = initmatch_automat(&chr, ndfa, 2, (char32_t[]){ 0, 16*i+1 }, (char32_t[]){ 16*i-1, 0x10ffff });
+      if (!err) err = oprepeat_automat(&chr, false);
+      if (!err) err = opsequence_automat(&seq, &chr);
+      if (!err) err = initmatch_automat(&chr, ndfa, 1, (char32_t[]){ 16*i }, (char32_t[]){ 16*i });
+      if (!err) err = opsequence_automat(&seq, &chr);
+      if (err) break;
+      if (i > 1) {
+         err = opor_automat(&all, &seq);
+      } else {
+         initmove_automat(&all, &seq);
+      }
+   }
+   int err2 = free_automat(ndfa);
+   if (!err) err = err2;
+   if (!err) {
+      initmove_automat(ndfa, &all);
+      err = makedfa_automat(ndfa);
+   } else {
+      free_automat(&all);
+   }
+   return err;
+}
+
+static void measure(bench_result_t* result, int (*build) (automat_t*), bool isHopcroft)
+{
+   struct timespec start, end;
+   automat_t ndfa = automat_FREE;
+
+   result->err = build(&ndfa);
+   if (result->err) return;
+
+   RESETPEAK_PAGECACHE();
+   const size_t base = SIZEALLOCATED_PAGECACHE();
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   if (isHopcroft) {
+      result->err = minimize2_automat(&ndfa, automat_minimize_HOPCROFT);
+   } else {
+      result->err = minimize_automat(&ndfa);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   result->msec    = (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6;
+   result->peak    = SIZEPEAK_PAGECACHE() - base;
+   result->nrstate = nrstate_automat(&ndfa);
+   free_automat(&ndfa);
+}
+
+static int run_measure(const char* name, int (*build) (automat_t*), bool isHopcroft)
+{
+   int fd[2];
+   bench_result_t result = { .err = EINVAL };
+   struct rusage  usage;
+   int status;
+
+   if (pipe(fd)) return errno;
+   pid_t pid = fork();
+   if (pid == -1) return errno;
+   if (pid == 0) {
+      close(fd[0]);
+      measure(&result, build, isHopcroft);
+      ssize_t bytes = write(fd[1], &result, sizeof(result));
+      _exit(bytes == sizeof(result) ? 0 : 1);
+   }
+   close(fd[1]);
+   ssize_t bytes = read(fd[0], &result, sizeof(result));
+   close(fd[0]);
+   if (pid != wait4(pid, &status, 0, &usage) || bytes != sizeof(result)) return EINVAL;
+
+   if (result.err) {
+      printf("%-20s %-10s error %d\n", name, isHopcroft ? "hopcroft" : "brzozowski", result.err);
+   } else {
+      printf("%-20s %-10s %10.2f ms %10zu kB mman-peak %10ld kB maxrss %8zu states\n",
+            name, isHopcroft ? "hopcroft" : "brzozowski", result.msec, result.peak / 1024,
+            usage.ru_maxrss, result.nrstate);
+   }
+
+   return result.err;
+}
+
+static int build_ab_suffix(automat_t* ndfa) { return build_ab(ndfa, false, 12); }
+static int build_ab_prefix(automat_t* ndfa) { return build_ab(ndfa, true, 12); }
+
+/* function: run_search
+ * Sucht "needle|nail" in einem Text aus 16M Zeichen, der nur am Ende einen Treffer enthält.
+ * Zum Vergleich wird die Zeit einer einfachen Schleife angegeben, die nach dem Zeichen 'n' sucht. */
+static int run_search(void)
+{
+   const size_t len = 16*1024*1024;
+   struct timespec start, end;
+   automat_t ndfa  = automat_FREE;
+   automat_t ndfa2 = automat_FREE;
+   size_t    matchstart = 0, matchend = 0;
+   char32_t* text = malloc(len * sizeof(char32_t));
+   int err = text ? 0 : ENOMEM;
+
+   for (size_t i = 0; !err && i < len; ++i) text[i] = 'a' + i % 13;
+   if (!err) memcpy(&text[len-10], U"nail", 4 * sizeof(char32_t));
+   const char* word[2] = { "needle", "nail" };
+   for (int w = 0; !err && w < 2; ++w) {
+      automat_t* dest = w ? &ndfa2 : &ndfa;
+      err = initempty_automat(dest, w ? &ndfa : 0);
+      for (const char* c = word[w]; !err && *c; ++c) {
+         automat_t chr = automat_FREE;
+         err = initmatch_automat(&chr, dest, 1, (char32_t[]){ (char32_t)*c }, (char32_t[]){ (char32_t)*c });
+         if (!err) err = opsequence_automat(dest, &chr);
+      }
+   }
+   if (!err) err = opor_automat(&ndfa, &ndfa2);
+   if (!err) err = minimize2_automat(&ndfa, automat_minimize_HOPCROFT);
+
+   if (!err) {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      err = search_automat(&ndfa, len, text, &matchstart, &matchend);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      double msec = (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6;
+      printf("%-20s %-10s %10.2f ms %10.0f MB/s match %zu..%zu\n", "search-sparse", "automat", msec,
+               (double) (len * sizeof(char32_t)) / msec / 1e3, matchstart, matchend);
+
+      volatile size_t pos = len;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < len; ++i) {
+         if (text[i] == 'n') { pos = i; break; }
+      }
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      msec = (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6;
+      printf("%-20s %-10s %10.2f ms %10.0f MB/s first 'n' %zu\n", "search-sparse", "loop", msec,
+               (double) (len * sizeof(char32_t)) / msec / 1e3, (size_t)pos);
+   }
+
+   free_automat(&ndfa);
+   free_automat(&ndfa2);
+   free(text);
+   return err;
+}
+
+/* function: measure_backing
+ * Baut den DFA '(a|b)*a(a|b){16}' mit 2^17 Zuständen, dessen Seiten gemäß backing allokiert werden,
+ * und misst die Zeit, um ihn über einen zufälligen Text aus 'a' und 'b' laufen zu lassen.
+ * Die Zugriffe auf die Zustände sind zufällig verteilt, die Laufzeit wird von TLB-Misses bestimmt. */
+static void measure_backing(bench_result_t* result, automat_mman_backing_e backing)
+{
+   const size_t len = 8*1024*1024;
+   struct timespec start, end;
+   automat_t ndfa = automat_FREE;
+   automat_matcher_t matcher = automat_matcher_FREE;
+   char32_t* text = malloc(len * sizeof(char32_t));
+   size_t    matchedlen = 0;
+
+   result->err = text ? 0 : ENOMEM;
+   setbacking_automatmman(backing);
+   if (!result->err) result->err = build_ab(&ndfa, false, 16);
+   if (!result->err) result->err = minimize2_automat(&ndfa, automat_minimize_HOPCROFT);
+   if (!result->err) result->err = init_automatmatcher(&matcher, &ndfa, true);
+
+   if (!result->err) {
+      uint32_t rand = 12345;
+      for (size_t i = 0; i < len; ++i) {
+         rand = rand * 1103515245 + 12345;
+         text[i] = (rand & 0x10000) ? 'a' : 'b';
+      }
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      (void) feed_automatmatcher(&matcher, len, text);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      result->err = finish_automatmatcher(&matcher, &matchedlen);
+      result->msec = (double) (end.tv_sec - start.tv_sec) * 1e3 + (double) (end.tv_nsec - start.tv_nsec) / 1e6;
+      result->peak = SIZERESERVED_PAGECACHE();
+      result->nrstate = nrstate_automat(&ndfa);
+   }
+
+   free_automat(&ndfa);
+   free(text);
+}
+
+static int run_backing(const char* name, automat_mman_backing_e backing)
+{
+   int fd[2];
+   bench_result_t result = { .err = EINVAL };
+   int status;
+
+   if (pipe(fd)) return errno;
+   pid_t pid = fork();
+   if (pid == -1) return errno;
+   if (pid == 0) {
+      close(fd[0]);
+      measure_backing(&result, backing);
+      ssize_t bytes = write(fd[1], &result, sizeof(result));
+      _exit(bytes == sizeof(result) ? 0 : 1);
+   }
+   close(fd[1]);
+   ssize_t bytes = read(fd[0], &result, sizeof(result));
+   close(fd[0]);
+   if (pid != waitpid(pid, &status, 0) || bytes != sizeof(result)) return EINVAL;
+
+   if (result.err) {
+      printf("%-20s %-10s error %d\n", "match-large-dfa", name, result.err);
+   } else {
+      printf("%-20s %-10s %10.2f ms %10zu kB reserved %8zu states\n", "match-large-dfa", name,
+            result.msec, result.peak / 1024, result.nrstate);
+   }
+
+   return result.err;
+}
+
+int main(void)
+{
+   struct {
+      const char* name;
+      int      (* build) (automat_t*);
+   } testcase[] = {
+      { "or-1024-chars",  &build_or1024 },
+      { "or-1024-words",  &build_words1024 },
+      { "(a|b)*a(a|b){12}", &build_ab_suffix },
+      { "(a|b){12}a(a|b)*", &build_ab_prefix },
+      { "dfa-800-ranges",   &build_ranges800 },
+   };
+   int err = 0;
+
+   for (size_t i = 0; i < lengthof(testcase); ++i) {
+      for (int isHopcroft = 0; isHopcroft <= 1; ++isHopcroft) {
+         int err2 = run_measure(testcase[i].name, testcase[i].build, isHopcroft);
+         if (err2) err = err2;
+      }
+   }
+
+   if (run_search()) err = EINVAL;
+
+   if (run_backing("malloc", automat_mman_backing_MALLOC)) err = EINVAL;
+   if (run_backing("mmap", automat_mman_backing_MMAP)) err = EINVAL;
+   if (run_backing("hugetlb", automat_mman_backing_HUGETLB)) err = EINVAL;
+
+   return err ? 1 : 0;
+}
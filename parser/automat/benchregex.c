@@ -0,0 +1,253 @@
+/* title: Benchmark regexpr_t
+
+   Measures every step of <init_regexpr> and the throughput of <findall_automatsearch>
+   for a fixed set of patterns. The patterns are grouped into the categories
+   literal, char-class, alternation, set-difference ("&!"), unicode and repetition ("{m,n}").
+
+   Compile steps:
+   parse    - <initnfa_regexpr>: syntax analysis and construction of the NFA.
+   dfa      - <makedfa_automat> of the NFA.
+   minimize - <minimize2_automat> (Hopcroft) of the DFA.
+   compile  - <init_regexpr> as a whole (uses Brzozowski, no capture automaton).
+   Memory is the number of bytes used by the states of the automaton after parse, dfa and minimize
+   (see <sizeallocated_automat>) and the number of bytes kept by the compiled <regexpr_t>.
+   Unused memory of <automat_mman_t> pages is not counted, so a change of a few states is visible.
+
+   The text corpus is generated from a fixed vocabulary with a fixed seed,
+   so every run searches the same text. Match throughput is given in MB/s of the
+   UTF-8 encoded corpus, the time is the minimum of <benchregex_REPEAT> runs.
+
+   Output is CSV, one header line followed by one line per pattern:
+   > make benchregex && ./benchregex > result.csv
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2016 Jörg Seebohn
+*/
+
+#include "config.h"
+#include "regexpr.h"
+#include "utf8.h"
+#include <time.h>
+
+/* define: benchregex_CORPUSLEN
+ * Anzahl Zeichen des erzeugten Textes. */
+#define benchregex_CORPUSLEN (4*1024*1024)
+
+/* define: benchregex_REPEAT
+ * Anzahl Wiederholungen jeder Suche, das Minimum wird ausgegeben. */
+#define benchregex_REPEAT 3
+
+typedef struct benchregex_pattern_t {
+   const char* category;
+   const char* definition;
+} benchregex_pattern_t;
+
+typedef struct benchregex_result_t {
+   size_t nrstate_nfa;
+   size_t nrstate_dfa;
+   size_t nrstate_min;
+   size_t size_nfa;
+   size_t size_dfa;
+   size_t size_min;
+   double msec_parse;
+   double msec_dfa;
+   double msec_minimize;
+   double msec_compile;
+   size_t size;
+   double msec_match;
+   size_t nrmatch;
+} benchregex_result_t;
+
+static const benchregex_pattern_t s_pattern[] = {
+   { "literal",        "Holmes" },
+   { "literal",        "Sherlock\\ Holmes" },
+   { "literal",        "zzzz" },
+   { "char-class",     "[0-9]+" },
+   { "char-class",     "[A-Z][a-z]+" },
+   { "char-class",     "[a-z]+ing" },
+   { "char-class",     "[^ \\n]+_[^ \\n]+" },
+   { "alternation",    "Holmes|Watson|Moriarty|Lestrade|Hudson" },
+   { "alternation",    "(the|a|an)\\ [a-z]+" },
+   { "alternation",    "the|of|and|to|in|that|it|was|he|his|you|Baker|Street|London|morning|evening|nothing|something|king|ring|singing|café|Москва|東京" },
+   { "set-difference", "[a-z]+ &! (the|and|of)" },
+   { "set-difference", "[a-zA-Z0-9_]+ &! [0-9].*" },
+   { "set-difference", "[a-z]+ing &! .*(ring|king)" },
+   { "unicode",        "[α-ω]+" },
+   { "unicode",        "[а-яА-Я]+" },
+   { "unicode",        "[一-鿿]+" },
+   { "unicode",        "Stra(ss|ß)e|gr(ö|oe)(ß|ss)er" },
+   { "repetition",     "[0-9]{1,12}" },
+   { "repetition",     "[a-z]{3,8}ing" },
+   { "repetition",     "(the|a|an){1,3}\\ [A-Z][a-z]{2,}" },
+};
+
+static const char* s_vocabulary[] = {
+   "the", "of", "and", "to", "a", "an", "in", "that", "it", "was", "he", "I", "his", "you",
+   "Holmes", "Watson", "Sherlock", "Moriarty", "Lestrade", "Hudson", "Baker", "Street", "London",
+   "morning", "evening", "nothing", "something", "king", "ring", "singing", "1891", "221", "42",
+   "Straße", "Strasse", "größer", "café", "Ελλάδα", "αλφα", "Москва", "русская", "東京", "日本語",
+   "_var1", "x86_64",
+};
+
+static double msec_since(const struct timespec* start)
+{
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   return (double) (end.tv_sec - start->tv_sec) * 1e3 + (double) (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* function: init_corpus
+ * Erzeugt einen Text aus benchregex_CORPUSLEN Zeichen, der aus zufällig gewählten Wörtern
+ * von s_vocabulary besteht, getrennt durch Leerzeichen und gelegentlich einem Newline.
+ * In size wird die Größe des Textes in UTF-8 Kodierung zurückgegeben. */
+static int init_corpus(/*out*/char32_t** corpus, /*out*/size_t* size)
+{
+   char32_t* text = malloc(benchregex_CORPUSLEN * sizeof(char32_t));
+   uint32_t  random = 12345;
+   size_t    len = 0;
+   size_t    utf8size = 0;
+
+   if (!text) return ENOMEM;
+
+   while (len < benchregex_CORPUSLEN) {
+      random = random * 1103515245 + 12345;
+      const uint8_t* word = (const uint8_t*) s_vocabulary[(random >> 16) % lengthof(s_vocabulary)];
+      while (*word && len < benchregex_CORPUSLEN) {
+         uint8_t wordsize = decodechar_utf8(word, &text[len]);
+         if (!wordsize) break;
+         word     += wordsize;
+         utf8size += wordsize;
+         ++ len;
+      }
+      if (len < benchregex_CORPUSLEN) {
+         text[len++] = (random >> 24) % 12 ? ' ' : '\n';
+         ++ utf8size;
+      }
+   }
+
+   *corpus = text;
+   *size   = utf8size;
+   return 0;
+}
+
+static int count_match(void* context, size_t start, size_t end)
+{
+   (void) start;
+   (void) end;
+   ++ *(size_t*)context;
+   return 0;
+}
+
+static int measure(benchregex_result_t* result, const char* definition, size_t len, const char32_t corpus[len])
+{
+   int err;
+   struct timespec start;
+   automat_t  ndfa  = automat_FREE;
+   regexpr_t  regex = regexpr_FREE;
+   automat_search_t search = automat_search_FREE;
+   const size_t deflen = strlen(definition);
+
+   // === compile steps ===
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   err = initnfa_regexpr(&ndfa, deflen, definition, 0);
+   result->msec_parse = msec_since(&start);
+   if (err) goto ONERR;
+   result->nrstate_nfa = nrstate_automat(&ndfa);
+   result->size_nfa    = sizeallocated_automat(&ndfa);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   err = makedfa_automat(&ndfa);
+   result->msec_dfa = msec_since(&start);
+   if (err) goto ONERR;
+   result->nrstate_dfa = nrstate_automat(&ndfa);
+   result->size_dfa    = sizeallocated_automat(&ndfa);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   err = minimize2_automat(&ndfa, automat_minimize_HOPCROFT);
+   result->msec_minimize = msec_since(&start);
+   if (err) goto ONERR;
+   result->nrstate_min = nrstate_automat(&ndfa);
+   result->size_min    = sizeallocated_automat(&ndfa);
+   err = free_automat(&ndfa);
+   if (err) goto ONERR;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   err = init_regexpr(&regex, deflen, definition, 0);
+   result->msec_compile = msec_since(&start);
+   if (err) goto ONERR;
+   result->size = sizeallocated_automat(&regex.matcher) + sizeallocated_automat(&regex.capture);
+
+   // === match ===
+   err = init_automatsearch(&search, &regex.matcher);
+   if (err) goto ONERR;
+   for (unsigned r = 0; r < benchregex_REPEAT; ++r) {
+      size_t nrmatch = 0;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      err = findall_automatsearch(&search, len, corpus, &count_match, &nrmatch);
+      double msec = msec_since(&start);
+      if (err) goto ONERR;
+      if (!r || msec < result->msec_match) result->msec_match = msec;
+      result->nrmatch = nrmatch;
+   }
+
+   err = free_automatsearch(&search);
+   if (err) goto ONERR;
+   err = free_regexpr(&regex);
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   free_automatsearch(&search);
+   free_automat(&ndfa);
+   free_regexpr(&regex);
+   return err;
+}
+
+/* function: print_csvstring
+ * Gibt str als CSV-Feld in doppelten Anführungszeichen aus. */
+static void print_csvstring(const char* str)
+{
+   putchar('"');
+   for (; *str; ++str) {
+      if (*str == '"') putchar('"');
+      putchar(*str);
+   }
+   putchar('"');
+}
+
+int main(void)
+{
+   char32_t* corpus;
+   size_t    utf8size;
+   int err;
+
+   err = init_corpus(&corpus, &utf8size);
+   if (err) return 1;
+
+   printf("category,pattern,nfa_states,dfa_states,min_states,parse_ms,dfa_ms,minimize_ms,compile_ms,"
+          "nfa_bytes,dfa_bytes,min_bytes,size_bytes,match_ms,match_mb_s,matches\n");
+
+   for (size_t i = 0; i < lengthof(s_pattern); ++i) {
+      benchregex_result_t result = { 0 };
+      int err2 = measure(&result, s_pattern[i].definition, benchregex_CORPUSLEN, corpus);
+      if (err2) {
+         fprintf(stderr, "%s: error %d\n", s_pattern[i].definition, err2);
+         err = err2;
+         continue;
+      }
+      printf("%s,", s_pattern[i].category);
+      print_csvstring(s_pattern[i].definition);
+      printf(",%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%zu,%zu,%zu,%zu,%.3f,%.1f,%zu\n",
+            result.nrstate_nfa, result.nrstate_dfa, result.nrstate_min,
+            result.msec_parse, result.msec_dfa, result.msec_minimize, result.msec_compile,
+            result.size_nfa, result.size_dfa, result.size_min, result.size, result.msec_match,
+            (double) utf8size / result.msec_match / 1e3, result.nrmatch);
+   }
+
+   free(corpus);
+
+   return err ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/* title: Benchmark UTF-8 transcoding
+
+   Compares the throughput of <decode_utf8> and <encode_utf8>
+   with a loop calling <decodechar_utf8> or <encodechar_utf8> for every character.
+
+   The texts are generated from a fixed set of characters with a fixed seed:
+   ascii    - only ASCII characters.
+   latin    - mostly ASCII with some 2 byte sequences (German text).
+   cyrillic - 2 byte sequences separated by a few spaces.
+   cjk      - 3 byte sequences.
+
+   The text is transcoded in chunks of <benchutf8_CHUNKSIZE> bytes (decode)
+   or characters (encode) to exercise the handling of chunk boundaries.
+   Throughput is given in GB/s of the UTF-8 encoded text,
+   the time is the minimum of <benchutf8_REPEAT> runs.
+
+   Output is CSV, one header line followed by one line per text and function:
+   > make benchutf8 && ./benchutf8 > result.csv
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2016 Jörg Seebohn
+*/
+
+#include "config.h"
+#include "utf8.h"
+#include <time.h>
+
+/* define: benchutf8_TEXTLEN
+ * Anzahl Zeichen jedes erzeugten Textes. */
+#define benchutf8_TEXTLEN (16*1024*1024)
+
+/* define: benchutf8_CHUNKSIZE
+ * Größe eines Blocks, der mit einem Aufruf umgewandelt wird. */
+#define benchutf8_CHUNKSIZE (64*1024)
+
+/* define: benchutf8_REPEAT
+ * Anzahl Wiederholungen jeder Messung, das Minimum wird ausgegeben. */
+#define benchutf8_REPEAT 5
+
+typedef struct benchutf8_text_t {
+   const char* name;
+   // Zeichen, aus denen der Text zufällig zusammengesetzt wird
+   const char32_t* alphabet;
+} benchutf8_text_t;
+
+static const benchutf8_text_t s_text[] = {
+   { "ascii",    U"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,\n" },
+   { "latin",    U"abcdefghijklmnopqrstuvwxyz eeennnrrrsssttt ..,,äöüß" },
+   { "cyrillic", U"абвгдежзийклмнопрстуфхцчшщъыьэюяАБВГДЕЖЗ  " },
+   { "cjk",      U"日本語東京中国文字漢字大小上下山川田人口目" },
+};
+
+static double msec_since(const struct timespec* start)
+{
+   struct timespec end;
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   return (double) (end.tv_sec - start->tv_sec) * 1e3 + (double) (end.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* function: init_text
+ * Erzeugt einen Text aus benchutf8_TEXTLEN zufällig gewählten Zeichen aus alphabet. */
+static void init_text(char32_t text[benchutf8_TEXTLEN], const char32_t* alphabet)
+{
+   uint32_t random = 12345;
+   size_t   size   = 0;
+
+   while (alphabet[size]) ++size;
+
+   for (size_t i = 0; i < benchutf8_TEXTLEN; ++i) {
+      random  = random * 1103515245 + 12345;
+      text[i] = alphabet[(random >> 16) % size];
+   }
+}
+
+static size_t decode_loop(size_t size, const uint8_t in[size], size_t out_capacity, char32_t out[out_capacity], size_t * consumed)
+{
+   size_t i = 0;
+   size_t n = 0;
+   while (i < size && n < out_capacity) {
+      const unsigned len = sizePfirst_utf8(in[i]);
+      if (len > size - i) break;
+      if (! decodechar_utf8(in + i, &out[n])) break;
+      i += len;
+      n += 1;
+   }
+   *consumed = i;
+   return n;
+}
+
+static size_t encode_loop(size_t len, const char32_t in[len], size_t out_size, uint8_t out[out_size], size_t * consumed)
+{
+   size_t i = 0;
+   size_t n = 0;
+   for (; i < len; ++i) {
+      const uint8_t size = encodechar_utf8(in[i], out_size - n, out + n);
+      if (! size) break;
+      n += size;
+   }
+   *consumed = i;
+   return n;
+}
+
+/* function: measure_decode
+ * Dekodiert utf8[0..size-1] in Blöcken von benchutf8_CHUNKSIZE Bytes.
+ * Ein am Blockende unvollständiges Zeichen wird mit dem nächsten Block dekodiert.
+ * Gibt die Zeit in Millisekunden zurück oder einen Wert < 0 im Fehlerfall. */
+static double measure_decode(size_t (*decode) (size_t, const uint8_t*, size_t, char32_t*, size_t*), size_t size, const uint8_t utf8[size], char32_t text[benchutf8_TEXTLEN])
+{
+   struct timespec start;
+   size_t offset = 0;
+   size_t len    = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   while (offset < size) {
+      size_t chunk = size - offset < benchutf8_CHUNKSIZE ? size - offset : benchutf8_CHUNKSIZE;
+      size_t consumed;
+      len += decode(chunk, utf8 + offset, benchutf8_TEXTLEN - len, text + len, &consumed);
+      if (! consumed) return -1;
+      offset += consumed;
+   }
+   double msec = msec_since(&start);
+
+   return len == benchutf8_TEXTLEN ? msec : -1;
+}
+
+/* function: measure_encode
+ * Kodiert text in Blöcken von benchutf8_CHUNKSIZE Zeichen nach utf8.
+ * Gibt die Zeit in Millisekunden zurück oder einen Wert < 0 im Fehlerfall. */
+static double measure_encode(size_t (*encode) (size_t, const char32_t*, size_t, uint8_t*, size_t*), const char32_t text[benchutf8_TEXTLEN], size_t size, uint8_t utf8[size])
+{
+   struct timespec start;
+   size_t offset = 0;
+   size_t len    = 0;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   while (len < benchutf8_TEXTLEN) {
+      size_t chunk = benchutf8_TEXTLEN - len < benchutf8_CHUNKSIZE ? benchutf8_TEXTLEN - len : benchutf8_CHUNKSIZE;
+      size_t consumed;
+      offset += encode(chunk, text + len, size - offset, utf8 + offset, &consumed);
+      if (! consumed) return -1;
+      len += consumed;
+   }
+   double msec = msec_since(&start);
+
+   return offset == size ? msec : -1;
+}
+
+static void print_result(const char* text, const char* function, double msec, size_t size)
+{
+   printf("%s,%s,%.3f,%.2f\n", text, function, msec, (double) size / msec / 1e6);
+}
+
+int main(void)
+{
+   char32_t* text  = malloc(benchutf8_TEXTLEN * sizeof(char32_t));
+   char32_t* text2 = malloc(benchutf8_TEXTLEN * sizeof(char32_t));
+   uint8_t*  utf8  = malloc(benchutf8_TEXTLEN * maxsize_utf8());
+   int err = 0;
+
+   if (!text || !text2 || !utf8) return 1;
+
+   printf("text,function,ms,gb_s\n");
+
+   for (size_t t = 0; t < lengthof(s_text); ++t) {
+      size_t consumed;
+      init_text(text, s_text[t].alphabet);
+      const size_t size = encode_loop(benchutf8_TEXTLEN, text, benchutf8_TEXTLEN * maxsize_utf8(), utf8, &consumed);
+
+      double msec[4] = { 0 };
+      for (unsigned r = 0; r < benchutf8_REPEAT; ++r) {
+         double m[4] = {
+            measure_decode(&decode_loop, size, utf8, text2),
+            measure_decode(&decode_utf8, size, utf8, text2),
+            measure_encode(&encode_loop, text, size, utf8),
+            measure_encode(&encode_utf8, text, size, utf8),
+         };
+         for (unsigned i = 0; i < lengthof(m); ++i) {
+            if (m[i] < 0) {
+               fprintf(stderr, "%s: error\n", s_text[t].name);
+               err = 1;
+            }
+            if (!r || m[i] < msec[i]) msec[i] = m[i];
+         }
+      }
+
+      if (memcmp(text, text2, benchutf8_TEXTLEN * sizeof(char32_t))) {
+         fprintf(stderr, "%s: decoded text differs\n", s_text[t].name);
+         err = 1;
+      }
+
+      print_result(s_text[t].name, "decodechar_utf8", msec[0], size);
+      print_result(s_text[t].name, "decode_utf8", msec[1], size);
+      print_result(s_text[t].name, "encodechar_utf8", msec[2], size);
+      print_result(s_text[t].name, "encode_utf8", msec[3], size);
+   }
+
+   free(text);
+   free(text2);
+   free(utf8);
+
+   return err;
+}
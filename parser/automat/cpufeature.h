@@ -0,0 +1,65 @@
+/* title: CPU-Feature
+   Queries instruction set extensions of the cpu at program start.
+   All exported functions are implemented inline.
+
+   A module which has an AVX2 path and a fallback path defines its flag with
+   <cpufeature_IMPLEMENT_AVX2> instead of querying the cpu on every call.
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2016 Jörg Seebohn
+
+   file: cpufeature.h
+    Header file of <CPU-Feature>.
+*/
+#ifndef CKERN_PLATFORM_CPUFEATURE_HEADER
+#define CKERN_PLATFORM_CPUFEATURE_HEADER
+
+
+// section: Functions
+
+// group: query
+
+/* function: isavx2_cpufeature
+ * Returns true if the cpu supports the AVX2 instruction set.
+ * Always returns false on other architectures than x86. */
+static inline bool isavx2_cpufeature(void);
+
+// group: generic
+
+/* define: cpufeature_IMPLEMENT_AVX2
+ * Defines the flag static bool s_##_fsuffix##_isavx2 and the constructor initcpu_##_fsuffix,
+ * which sets the flag to the result of <isavx2_cpufeature>.
+ *
+ * The constructor runs before main, i.e. before any thread is started.
+ * Afterwards the flag is only read, so reading it from several threads is no data race.
+ * Single threaded unit tests may clear the flag temporarily to test the fallback path.
+ *
+ * Parameter:
+ * _fsuffix - The suffix of the module, e.g. memstreambyteset for s_memstreambyteset_isavx2. */
+#define cpufeature_IMPLEMENT_AVX2(_fsuffix) \
+         static bool s_##_fsuffix##_isavx2 = false;   \
+         __attribute__ ((constructor))                \
+         static void initcpu_##_fsuffix(void)         \
+         {                                            \
+            s_##_fsuffix##_isavx2 = isavx2_cpufeature(); \
+         }
+
+
+// section: inline implementation
+
+/* define: isavx2_cpufeature
+ * Implements <CPU-Feature.isavx2_cpufeature>. */
+static inline bool isavx2_cpufeature(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+         __builtin_cpu_init();
+         return 0 != __builtin_cpu_supports("avx2");
+#else
+         return false;
+#endif
+}
+
+#endif
@@ -28,6 +28,25 @@ int main()
    print_automat(&regex.matcher);
    free_regexpr(&regex);
 
+   // compile several regex into a single automaton
+   const char* rules[3] = { "[0-9]+", "[a-z]+[0-9]*", "a.*" };
+   bool ismatch[3];
+   regexpr_err_t errdescr;
+   int err = initset_regexpr(&regex, 3, (size_t[3]){ strlen(rules[0]), strlen(rules[1]), strlen(rules[2]) }, rules, &errdescr);
+   if (err) {
+      if (err == ESYNTAX || err == EILSEQ) {
+         printf("Error in rule %zu \"%s\" at column %zu\n", errdescr.index, rules[errdescr.index], (size_t) (errdescr.pos - rules[errdescr.index]) + 1);
+      } else {
+         printf("Error %d compiling set of regex\n", err);
+      }
+      return 1;
+   }
+   printf("\nCompiled set of regex \"%s\", \"%s\", \"%s\" has nrstates: %zd\n", rules[0], rules[1], rules[2], regex.matcher.nrstate);
+   printf("Try match 'abc1' matched nr of rules: %zu\n", matchids_automat(&regex.matcher, 4, U"abc1", 3, ismatch));
+   matchids_automat(&regex.matcher, 3, U"123", 3, ismatch);
+   printf("Try match '123' matched rules: %d %d %d\n", ismatch[0], ismatch[1], ismatch[2]);
+   free_regexpr(&regex);
+
    // build automaton without using regex
    printf("\nMake dfa from ndfa '(\\u0000|\\u0001|...|\\u0400)+' with 1024 ored states:\n");
    automat_t ndfa = automat_FREE;
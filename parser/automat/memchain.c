@@ -0,0 +1,516 @@
+/* title: MemoryChain impl
+
+   Implements <MemoryChain>.
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2016 Jörg Seebohn
+
+   file: C-kern/api/memory/memchain.h
+    Header file <MemoryChain>.
+
+   file: C-kern/memory/memchain.c
+    Implementation file <MemoryChain impl>.
+*/
+
+#include "config.h"
+#include "memchain.h"
+#include <stdarg.h>
+#include <sys/uio.h>
+#include "foreach.h"
+#include "test_errortimer.h"
+
+// === private types
+struct memchain_block_t;
+
+// forward
+#ifdef KONFIG_UNITTEST
+static test_errortimer_t s_memchain_errtimer;
+#endif
+
+
+// struct: memchain_block_t
+
+typedef struct memchain_block_t {
+   /* variable: next
+    * Links the block into <memchain_t.blocks> or <memchain_pool_t.freeblocks>. */
+   slist_node_t * next;
+   /* variable: size
+    * The number of bytes of data. */
+   size_t         size;
+   /* variable: used
+    * The number of written bytes. Only valid if the block is not the last of <memchain_t.blocks>. */
+   size_t         used;
+   /* variable: data
+    * Start of the stored data. */
+   uint8_t        data[];
+} memchain_block_t;
+
+// group: helper-types
+
+slist_IMPLEMENT(_blocklist, memchain_block_t, next)
+
+// group: lifetime
+
+/* function: new_memchainblock
+ * Allocates a block with at least minsize bytes of data.
+ * If minsize is not greater than <memchain_pool_t.blocksize> a cached block of pool is reused
+ * or a block of <memchain_pool_t.blocksize> is allocated. Else the block is allocated with minsize bytes. */
+static int new_memchainblock(memchain_pool_t * pool, size_t minsize, /*out*/memchain_block_t ** block)
+{
+   int err;
+   memchain_block_t * new_block = 0;
+
+   if (minsize <= pool->blocksize && ! isempty_blocklist(&pool->freeblocks)) {
+      new_block = removefirst_blocklist(&pool->freeblocks);
+      -- pool->nrfree;
+
+   } else {
+      const size_t size = minsize <= pool->blocksize ? pool->blocksize : minsize;
+      if (size > SIZE_MAX - sizeof(memchain_block_t)) {
+         err = ENOMEM;
+         goto ONERR;
+      }
+      if (! PROCESS_testerrortimer(&s_memchain_errtimer, &err)) {
+         new_block = malloc(sizeof(memchain_block_t) + size);
+         err = new_block ? 0 : ENOMEM;
+      }
+      if (err) goto ONERR;
+      new_block->next = 0;
+      new_block->size = size;
+   }
+
+   new_block->used = 0;
+
+   // set out
+   *block = new_block;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+/* function: delete_memchainblock
+ * Stores block in the cache of pool or frees it. */
+static void delete_memchainblock(memchain_pool_t * pool, memchain_block_t * block)
+{
+   if (block->size == pool->blocksize && pool->nrfree < pool->maxfree) {
+      insertfirst_blocklist(&pool->freeblocks, block);
+      ++ pool->nrfree;
+   } else {
+      free(block);
+   }
+}
+
+
+// section: memchain_pool_t
+
+// group: lifetime
+
+int free_memchainpool(memchain_pool_t * pool)
+{
+   while (! isempty_blocklist(&pool->freeblocks)) {
+      free(removefirst_blocklist(&pool->freeblocks));
+   }
+   pool->nrfree = 0;
+
+   return 0;
+}
+
+
+// section: memchain_t
+
+// group: lifetime
+
+int free_memchain(memchain_t * chain)
+{
+   while (! isempty_blocklist(&chain->blocks)) {
+      delete_memchainblock(chain->pool, removefirst_blocklist(&chain->blocks));
+   }
+
+   chain->next  = 0;
+   chain->end   = 0;
+   chain->start = 0;
+   chain->size  = 0;
+
+   return 0;
+}
+
+// group: query
+
+int iovec_memchain(const memchain_t * chain, size_t maxiov, /*out*/struct iovec * iov/*[maxiov]*/, /*out*/size_t * nriov)
+{
+   const memchain_block_t * last = last_blocklist(&chain->blocks);
+   size_t count = 0;
+
+   foreach (_blocklist, block, &chain->blocks) {
+      const size_t used = block == last ? (size_t) (chain->next - chain->start) : block->used;
+      if (! used) continue;
+      if (count < maxiov) {
+         iov[count].iov_base = block->data;
+         iov[count].iov_len  = used;
+      }
+      ++ count;
+   }
+
+   *nriov = count;
+
+   return count <= maxiov ? 0 : ENOBUFS;
+}
+
+// group: write
+
+/* function: appendblock_memchain
+ * Appends a new block with at least minsize bytes of free space to chain.
+ * The last block is closed, i.e. its number of written bytes is stored in <memchain_block_t.used>. */
+static int appendblock_memchain(memchain_t * chain, size_t minsize)
+{
+   int err;
+   memchain_block_t * block;
+
+   err = new_memchainblock(chain->pool, minsize, &block);
+   if (err) return err;
+
+   if (! isempty_blocklist(&chain->blocks)) {
+      memchain_block_t * last = last_blocklist(&chain->blocks);
+      last->used   = (size_t) (chain->next - chain->start);
+      chain->size += last->used;
+   }
+
+   insertlast_blocklist(&chain->blocks, block);
+   chain->start = block->data;
+   chain->next  = block->data;
+   chain->end   = block->data + block->size;
+
+   return 0;
+}
+
+int reserve_memchain(memchain_t * chain, size_t size, /*out*/uint8_t ** addr)
+{
+   int err;
+
+   if ((size_t) (chain->end - chain->next) < size) {
+      err = appendblock_memchain(chain, size);
+      if (err) goto ONERR;
+   }
+
+   *addr = chain->next;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int write_memchain(memchain_t * chain, size_t len, const uint8_t src[len])
+{
+   int err;
+
+   for (;;) {
+      const size_t free = (size_t) (chain->end - chain->next);
+      const size_t size = len < free ? len : free;
+      if (size) {
+         memcpy(chain->next, src, size);
+         chain->next += size;
+         src += size;
+         len -= size;
+      }
+      if (! len) break;
+      // a rest larger than a pooled block is stored in a single block of its own size
+      err = appendblock_memchain(chain, len);
+      if (err) goto ONERR;
+   }
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int printf_memchain(memchain_t * chain, const char * format, ...)
+{
+   int err;
+   va_list args;
+   size_t  free = (size_t) (chain->end - chain->next);
+
+   va_start(args, format);
+   int len = vsnprintf((char*) chain->next, free, format, args);
+   va_end(args);
+   if (len < 0) {
+      err = EINVAL;
+      goto ONERR;
+   }
+
+   if ((size_t) len >= free) {
+      // formatted string + \0 byte does not fit into last block
+      err = appendblock_memchain(chain, (size_t) len + 1);
+      if (err) goto ONERR;
+      va_start(args, format);
+      (void) vsnprintf((char*) chain->next, (size_t) len + 1, format, args);
+      va_end(args);
+   }
+
+   chain->next += len;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+
+static int test_pool(void)
+{
+   memchain_pool_t   pool = memchain_pool_FREE;
+   memchain_block_t* block[3] = { 0 };
+
+   // TEST memchain_pool_FREE
+   TEST(0 == pool.blocksize);
+   TEST(0 == pool.nrfree);
+   TEST(0 == pool.maxfree);
+   TEST(isempty_blocklist(&pool.freeblocks));
+
+   // TEST init_memchainpool
+   init_memchainpool(&pool, 128, 2);
+   TEST(128 == pool.blocksize);
+   TEST(0 == pool.nrfree);
+   TEST(2 == pool.maxfree);
+   TEST(isempty_blocklist(&pool.freeblocks));
+
+   // TEST new_memchainblock: allocate blocksize
+   for (size_t i = 0; i < lengthof(block); ++i) {
+      TEST(0 == new_memchainblock(&pool, i, &block[i]));
+      TEST(0 != block[i]);
+      TEST(128 == block[i]->size);
+      TEST(0 == block[i]->used);
+   }
+
+   // TEST delete_memchainblock: cache up to maxfree blocks
+   for (size_t i = 0; i < lengthof(block); ++i) {
+      delete_memchainblock(&pool, block[i]);
+      TEST((i < 2 ? i+1 : 2) == nrfree_memchainpool(&pool));
+   }
+
+   // TEST new_memchainblock: reuse cached block
+   TEST(0 == new_memchainblock(&pool, 128, &block[0]));
+   TEST(block[0] == block[1]);
+   TEST(1 == nrfree_memchainpool(&pool));
+   TEST(0 == block[0]->next);
+
+   // TEST new_memchainblock: minsize > blocksize ==> not cached
+   TEST(0 == new_memchainblock(&pool, 129, &block[2]));
+   TEST(129 == block[2]->size);
+   TEST(1 == nrfree_memchainpool(&pool));
+   delete_memchainblock(&pool, block[2]);
+   TEST(1 == nrfree_memchainpool(&pool));
+   delete_memchainblock(&pool, block[0]);
+   TEST(2 == nrfree_memchainpool(&pool));
+
+   // TEST new_memchainblock: ENOMEM
+   TEST(ENOMEM == new_memchainblock(&pool, SIZE_MAX, &block[2]));
+   init_testerrortimer(&s_memchain_errtimer, 1, ENOMEM);
+   TEST(ENOMEM == new_memchainblock(&pool, 129, &block[2]));
+   TEST(2 == nrfree_memchainpool(&pool));
+
+   // TEST free_memchainpool
+   TEST(0 == free_memchainpool(&pool));
+   TEST(0 == nrfree_memchainpool(&pool));
+   TEST(isempty_blocklist(&pool.freeblocks));
+   TEST(0 == free_memchainpool(&pool));
+
+   return 0;
+ONERR:
+   free_memchainpool(&pool);
+   return EINVAL;
+}
+
+static int test_initfree(void)
+{
+   memchain_pool_t pool  = memchain_pool_INIT(64, 10);
+   memchain_t      chain = memchain_FREE;
+   uint8_t *       addr;
+
+   // TEST memchain_FREE
+   TEST(0 == chain.next);
+   TEST(0 == chain.end);
+   TEST(0 == chain.start);
+   TEST(0 == chain.size);
+   TEST(isempty_blocklist(&chain.blocks));
+   TEST(0 == chain.pool);
+
+   // TEST init_memchain
+   init_memchain(&chain, &pool);
+   TEST(0 == chain.next);
+   TEST(0 == chain.end);
+   TEST(0 == chain.start);
+   TEST(0 == chain.size);
+   TEST(isempty_blocklist(&chain.blocks));
+   TEST(&pool == chain.pool);
+   TEST(0 == size_memchain(&chain));
+
+   // TEST free_memchain: blocks are returned to pool
+   for (unsigned i = 1; i <= 3; ++i) {
+      TEST(0 == reserve_memchain(&chain, 64, &addr));
+      commit_memchain(&chain, 64);
+      TEST(64*i == size_memchain(&chain));
+   }
+   TEST(0 == nrfree_memchainpool(&pool));
+   TEST(0 == free_memchain(&chain));
+   TEST(0 == chain.next);
+   TEST(0 == chain.end);
+   TEST(0 == chain.start);
+   TEST(0 == chain.size);
+   TEST(isempty_blocklist(&chain.blocks));
+   TEST(&pool == chain.pool);
+   TEST(3 == nrfree_memchainpool(&pool));
+
+   // TEST free_memchain: double free
+   TEST(0 == free_memchain(&chain));
+   TEST(3 == nrfree_memchainpool(&pool));
+
+   TEST(0 == free_memchainpool(&pool));
+
+   return 0;
+ONERR:
+   free_memchain(&chain);
+   free_memchainpool(&pool);
+   return EINVAL;
+}
+
+static int test_write(void)
+{
+   memchain_pool_t pool  = memchain_pool_INIT(16, 10);
+   memchain_t      chain = memchain_INIT(&pool);
+   uint8_t *       addr;
+   uint8_t         buffer[100];
+   struct iovec    iov[10];
+   size_t          nriov;
+
+   for (unsigned i = 0; i < sizeof(buffer); ++i) {
+      buffer[i] = (uint8_t) i;
+   }
+
+   // TEST iovec_memchain: empty chain
+   TEST(0 == iovec_memchain(&chain, 0, iov, &nriov));
+   TEST(0 == nriov);
+
+   // TEST reserve_memchain: empty chain
+   TEST(0 == reserve_memchain(&chain, 10, &addr));
+   TEST(addr == chain.next);
+   TEST(addr == chain.start);
+   TEST(addr+16 == chain.end);
+   TEST(0 == size_memchain(&chain));
+
+   // TEST commit_memchain
+   memcpy(addr, buffer, 10);
+   commit_memchain(&chain, 10);
+   TEST(addr+10 == chain.next);
+   TEST(10 == size_memchain(&chain));
+
+   // TEST reserve_memchain: free space of last block is big enough
+   TEST(0 == reserve_memchain(&chain, 6, &addr));
+   TEST(addr == chain.next);
+   TEST(addr == chain.start+10);
+   commit_memchain(&chain, 0);
+
+   // TEST reserve_memchain: append block ==> rest of last block is unused
+   TEST(0 == reserve_memchain(&chain, 7, &addr));
+   TEST(addr == chain.start);
+   TEST(10 == chain.size);
+   memcpy(addr, buffer+10, 7);
+   commit_memchain(&chain, 7);
+   TEST(17 == size_memchain(&chain));
+
+   // TEST reserve_memchain: size > blocksize
+   TEST(0 == reserve_memchain(&chain, 40, &addr));
+   TEST(addr+40 == chain.end);
+   memcpy(addr, buffer+17, 40);
+   commit_memchain(&chain, 40);
+   TEST(57 == size_memchain(&chain));
+
+   // TEST write_memchain: split over several blocks
+   TEST(0 == write_memchain(&chain, 33, buffer+57));
+   TEST(90 == size_memchain(&chain));
+   TEST(0 == write_memchain(&chain, 0, buffer));
+   TEST(90 == size_memchain(&chain));
+
+   // TEST printf_memchain: fits into last block
+   TEST(0 == write_memchain(&chain, 8, buffer+90));
+   TEST(98 == size_memchain(&chain));
+   TEST(0 == printf_memchain(&chain, "%d", 12));
+   TEST(100 == size_memchain(&chain));
+
+   // TEST printf_memchain: needs new block
+   TEST(0 == printf_memchain(&chain, "%s-%d", "abcdefghijklmnop", 1234));
+   TEST(121 == size_memchain(&chain));
+   TEST(0 == memcmp(chain.next - 21, "abcdefghijklmnop-1234", 22));
+
+   // TEST iovec_memchain: ENOBUFS
+   TEST(ENOBUFS == iovec_memchain(&chain, 2, iov, &nriov));
+   TEST(2 < nriov);
+
+   // TEST iovec_memchain: content
+   TEST(0 == iovec_memchain(&chain, nriov, iov, &nriov));
+   {
+      uint8_t result[121];
+      size_t  offset = 0;
+      for (size_t i = 0; i < nriov; ++i) {
+         TEST(0 < iov[i].iov_len);
+         TEST(offset + iov[i].iov_len <= sizeof(result));
+         memcpy(result + offset, iov[i].iov_base, iov[i].iov_len);
+         offset += iov[i].iov_len;
+      }
+      TEST(121 == offset);
+      TEST(0 == memcmp(result, buffer, 98));
+      TEST(0 == memcmp(result+98, "12", 2));
+      TEST(0 == memcmp(result+100, "abcdefghijklmnop-1234", 21));
+   }
+
+   // TEST write_memchain: ENOMEM
+   TEST(0 == free_memchain(&chain));
+   TEST(0 == free_memchainpool(&pool));
+   TEST(0 == write_memchain(&chain, 10, buffer));
+   init_testerrortimer(&s_memchain_errtimer, 1, ENOMEM);
+   TEST(ENOMEM == write_memchain(&chain, 20, buffer+10));
+   TEST(16 == size_memchain(&chain));
+   TEST(0 == memcmp(chain.start, buffer, 16));
+
+   // TEST reserve_memchain, printf_memchain: ENOMEM ==> chain not changed
+   init_testerrortimer(&s_memchain_errtimer, 1, ENOMEM);
+   TEST(ENOMEM == reserve_memchain(&chain, 1, &addr));
+   init_testerrortimer(&s_memchain_errtimer, 1, ENOMEM);
+   TEST(ENOMEM == printf_memchain(&chain, "%d", 1));
+   TEST(16 == size_memchain(&chain));
+   TEST(0 == iovec_memchain(&chain, lengthof(iov), iov, &nriov));
+   TEST(1 == nriov);
+
+   TEST(0 == free_memchain(&chain));
+   TEST(0 == free_memchainpool(&pool));
+
+   return 0;
+ONERR:
+   free_memchain(&chain);
+   free_memchainpool(&pool);
+   return EINVAL;
+}
+
+int unittest_memory_memchain()
+{
+   if (test_pool())        goto ONERR;
+   if (test_initfree())    goto ONERR;
+   if (test_write())       goto ONERR;
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+#endif
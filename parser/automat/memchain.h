@@ -0,0 +1,240 @@
+/* title: MemoryChain
+
+   Growable output stream which writes into a chain of memory blocks.
+   Unlike <memstream_t>, which is restricted to a single block of fixed size,
+   a <memchain_t> appends a new block whenever the free space of the last block
+   is exhausted. Blocks are taken from a <memchain_pool_t> and returned to it
+   if the chain is freed.
+
+   Use <reserve_memchain> and <commit_memchain> to format data directly into
+   the chain without an intermediate buffer. The written data is not copied
+   again at the end, <iovec_memchain> describes the blocks as an array of
+   struct iovec which can be given to writev.
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2016 Jörg Seebohn
+
+   file: C-kern/api/memory/memchain.h
+    Header file <MemoryChain>.
+
+   file: C-kern/memory/memchain.c
+    Implementation file <MemoryChain impl>.
+*/
+#ifndef CKERN_MEMORY_MEMCHAIN_HEADER
+#define CKERN_MEMORY_MEMCHAIN_HEADER
+
+#include "slist.h"
+
+// forward
+struct iovec;
+
+// == exported types
+struct memchain_t;
+struct memchain_pool_t;
+
+
+// section: Functions
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+/* function: unittest_memory_memchain
+ * Test <memchain_t> functionality. */
+int unittest_memory_memchain(void);
+#endif
+
+
+/* struct: memchain_pool_t
+ * Caches unused blocks of a fixed size for reuse by one or more <memchain_t>.
+ * A block which is requested with a size greater than <blocksize> is allocated
+ * with exactly this size and is never cached.
+ * The pool is not thread safe, use one pool per thread. */
+typedef struct memchain_pool_t {
+   /* variable: freeblocks
+    * List of unused blocks of size <blocksize>. */
+   slist_t  freeblocks;
+   /* variable: blocksize
+    * The number of data bytes of a block allocated by this pool. */
+   size_t   blocksize;
+   /* variable: nrfree
+    * The number of blocks stored in <freeblocks>. */
+   size_t   nrfree;
+   /* variable: maxfree
+    * The maximum number of blocks stored in <freeblocks>.
+    * A returned block is freed if <nrfree> has reached this value. */
+   size_t   maxfree;
+} memchain_pool_t;
+
+// group: lifetime
+
+/* define: memchain_pool_FREE
+ * Static initializer. */
+#define memchain_pool_FREE \
+         { slist_INIT, 0, 0, 0 }
+
+/* define: memchain_pool_INIT
+ * Static initializer. See <init_memchainpool>. */
+#define memchain_pool_INIT(blocksize, maxfree) \
+         { slist_INIT, (blocksize), 0, (maxfree) }
+
+/* function: init_memchainpool
+ * Initializes an empty pool which allocates blocks of blocksize data bytes.
+ * At most maxfree unused blocks are cached. */
+void init_memchainpool(/*out*/memchain_pool_t * pool, size_t blocksize, size_t maxfree);
+
+/* function: free_memchainpool
+ * Frees all cached blocks. All <memchain_t> using pool must be freed before. */
+int free_memchainpool(memchain_pool_t * pool);
+
+// group: query
+
+/* function: nrfree_memchainpool
+ * Returns the number of cached blocks. */
+size_t nrfree_memchainpool(const memchain_pool_t * pool);
+
+
+/* struct: memchain_t
+ * Growable output stream which writes into a chain of blocks of a <memchain_pool_t>.
+ * The members <next> and <end> describe the free space of the last block.
+ * They are compatible with <memstream_t>. Up to size_memstream(cast_memstream(chain,))
+ * bytes could be written with the functions of <memstream_t>. */
+typedef struct memchain_t {
+   /* variable: next
+    * Points to the next unwritten byte of the last block. */
+   uint8_t *   next;
+   /* variable: end
+    * Points one after the last byte of the last block. */
+   uint8_t *   end;
+   /* variable: start
+    * Points to the first byte of the last block. */
+   uint8_t *   start;
+   /* variable: size
+    * The number of written bytes of all blocks except the last. */
+   size_t      size;
+   /* variable: blocks
+    * List of allocated blocks in order of writing. */
+   slist_t     blocks;
+   /* variable: pool
+    * Allocates new blocks. */
+   memchain_pool_t * pool;
+} memchain_t;
+
+// group: lifetime
+
+/* define: memchain_FREE
+ * Static initializer. */
+#define memchain_FREE \
+         { 0, 0, 0, 0, slist_INIT, 0 }
+
+/* define: memchain_INIT
+ * Static initializer. See <init_memchain>. */
+#define memchain_INIT(pool) \
+         { 0, 0, 0, 0, slist_INIT, (pool) }
+
+/* function: init_memchain
+ * Initializes an empty chain. New blocks are allocated from pool.
+ * No memory is allocated until the first byte is written. */
+void init_memchain(/*out*/memchain_t * chain, memchain_pool_t * pool);
+
+/* function: free_memchain
+ * Returns all blocks to the pool. */
+int free_memchain(memchain_t * chain);
+
+// group: query
+
+/* function: size_memchain
+ * Returns the number of written bytes. */
+size_t size_memchain(const memchain_t * chain);
+
+/* function: iovec_memchain
+ * Describes the written data as array of iovec. Every non empty block is described
+ * by one entry in the order the data was written. The array could be given to writev.
+ * The returned pointers are valid until the chain is written to or freed.
+ *
+ * Returns:
+ * 0       - iov[0 .. *nriov-1] describes the written data.
+ * ENOBUFS - maxiov is too small. *nriov contains the needed number of entries. */
+int iovec_memchain(const memchain_t * chain, size_t maxiov, /*out*/struct iovec * iov/*[maxiov]*/, /*out*/size_t * nriov);
+
+// group: write
+
+/* function: reserve_memchain
+ * Ensures that at least size bytes of contiguous memory starting at chain->next are free.
+ * If the last block has not enough free space a new block is appended and the unused
+ * rest of the last block is lost. *addr is set to chain->next.
+ * Format the data into *addr and call <commit_memchain> with the number of written bytes.
+ *
+ * Returns:
+ * 0      - At least size bytes could be written to *addr.
+ * ENOMEM - The chain is not changed. */
+int reserve_memchain(memchain_t * chain, size_t size, /*out*/uint8_t ** addr);
+
+/* function: commit_memchain
+ * Marks size bytes written to the address returned from <reserve_memchain> as valid.
+ *
+ * Unchecked Precondition:
+ * size <= size reserved with <reserve_memchain> */
+void commit_memchain(memchain_t * chain, size_t size);
+
+/* function: write_memchain
+ * Appends len bytes from src to chain. The data is split over several blocks if necessary.
+ *
+ * Returns:
+ * 0      - All bytes appended.
+ * ENOMEM - Only a prefix of src could be appended. */
+int write_memchain(memchain_t * chain, size_t len, const uint8_t src[len]);
+
+/* function: printf_memchain
+ * Appends formatted output with printf style arguments (format, ...) to chain.
+ * The formatted output is never split over two blocks. If it does not fit into the
+ * free space of the last block a new block is appended and the output is formatted a second time.
+ * The terminating \0 byte is written but not counted as part of the data.
+ *
+ * Returns:
+ * 0      - The formatted string is appended.
+ * EINVAL - Format error, the chain is not changed.
+ * ENOMEM - The chain is not changed. */
+int printf_memchain(memchain_t * chain, const char * format, ...) __attribute__ ((__format__ (__printf__, 2, 3)));
+
+
+
+// section: inline implementation
+
+// group: memchain_pool_t
+
+/* define: init_memchainpool
+ * Implements <memchain_pool_t.init_memchainpool>. */
+#define init_memchainpool(pool, blocksize, maxfree) \
+         ((void)(*(pool) = (memchain_pool_t) memchain_pool_INIT(blocksize, maxfree)))
+
+/* define: nrfree_memchainpool
+ * Implements <memchain_pool_t.nrfree_memchainpool>. */
+#define nrfree_memchainpool(pool) \
+         ((pool)->nrfree)
+
+// group: memchain_t
+
+/* define: commit_memchain
+ * Implements <memchain_t.commit_memchain>. */
+#define commit_memchain(chain, size) \
+         ((void)((chain)->next += (size)))
+
+/* define: init_memchain
+ * Implements <memchain_t.init_memchain>. */
+#define init_memchain(chain, pool) \
+         ((void)(*(chain) = (memchain_t) memchain_INIT(pool)))
+
+/* define: size_memchain
+ * Implements <memchain_t.size_memchain>. */
+#define size_memchain(chain) \
+         ( __extension__ ({               \
+            const memchain_t * _c;        \
+            _c = (chain);                 \
+            _c->size + (size_t) (_c->next \
+                         - _c->start);    \
+         }))
+
+#endif
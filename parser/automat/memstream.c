@@ -0,0 +1,339 @@
+/* title: MemoryStream impl
+
+   Implements <MemoryStream>.
+
+   Copyright:
+   This program is free software. See accompanying LICENSE file.
+
+   Author:
+   (C) 2013 Jörg Seebohn
+
+   file: C-kern/api/memory/memstream.h
+    Header file <MemoryStream>.
+
+   file: C-kern/memory/memstream.c
+    Implementation file <MemoryStream impl>.
+*/
+
+#include "config.h"
+#include "memstream.h"
+#include "cpufeature.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+// section: memstream_byteset_t
+
+// group: global-variables
+
+// bits[0][0] bit 2 ==> ' ' (0x20), bits[0][9..13] bit 0 ==> '\t', '\n', '\v', '\f', '\r' (0x09..0x0D)
+const memstream_byteset_t g_memstream_space = {
+   { { 4, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0 }, { 0 } }
+};
+
+// bits[0][10] bit 0 ==> '\n' (0x0A), bits[0][13] bit 0 ==> '\r' (0x0D)
+const memstream_byteset_t g_memstream_lineend = {
+   { { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0 }, { 0 } }
+};
+
+// group: lifetime
+
+void init_memstreambyteset(/*out*/memstream_byteset_t * set, size_t nrbytes, const uint8_t bytes[nrbytes])
+{
+   memset(set, 0, sizeof(*set));
+   for (size_t i = 0; i < nrbytes; ++i) {
+      const uint8_t b = bytes[i];
+      set->bits[b >> 7][b & 15] = (uint8_t) (set->bits[b >> 7][b & 15] | (1u << ((b >> 4) & 7)));
+   }
+}
+
+// group: query
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* variable: s_memstreambyteset_isavx2
+ * True if <find_avx2> can be used. */
+cpufeature_IMPLEMENT_AVX2(memstreambyteset)
+
+/* function: find_avx2
+ * Returns the first byte in [start, end) whose membership in set is equal to isMember.
+ * Tests 32 bytes per step: The low nibble of every byte selects a row of <memstream_byteset_t.bits>
+ * (pshufb of bits[0] or bits[1] depending on the highest bit), the high nibble selects the bit
+ * within the row (pshufb of a table of single bits).
+ * Returns the address of the first unchecked byte if less than 32 bytes remain. */
+__attribute__ ((target("avx2")))
+static const uint8_t * find_avx2(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end, bool isMember)
+{
+   const __m256i bits0  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) set->bits[0]));
+   const __m256i bits1  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) set->bits[1]));
+   const __m256i bit    = _mm256_setr_epi8(
+                              1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                              1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+   const __m256i nibble = _mm256_set1_epi8(0x0F);
+   const uint32_t invert = isMember ? 0 : UINT32_MAX;
+
+   for (; end - start >= 32; start += 32) {
+      const __m256i bytes = _mm256_loadu_si256((const __m256i*) start);
+      const __m256i lo    = _mm256_and_si256(bytes, nibble);
+      const __m256i hi    = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+      // bytes >= 0x80 select bits1
+      const __m256i row   = _mm256_blendv_epi8(_mm256_shuffle_epi8(bits0, lo), _mm256_shuffle_epi8(bits1, lo), bytes);
+      const __m256i mask  = _mm256_shuffle_epi8(bit, hi);
+      const __m256i isin  = _mm256_cmpeq_epi8(_mm256_and_si256(row, mask), mask);
+      const uint32_t found = (uint32_t) _mm256_movemask_epi8(isin) ^ invert;
+      if (found) return start + __builtin_ctz(found);
+   }
+
+   return start;
+}
+
+#endif
+
+/* function: find_memstreambyteset
+ * Implements <findin_memstreambyteset> and <findnotin_memstreambyteset>.
+ * Uses <find_avx2> if the cpu supports it. */
+static inline const uint8_t * find_memstreambyteset(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end, bool isMember)
+{
+#if defined(__x86_64__) || defined(__i386__)
+   if (end - start >= 32 && s_memstreambyteset_isavx2) {
+      // continues at the found byte or at the unchecked rest
+      start = find_avx2(set, start, end, isMember);
+   }
+#endif
+
+   for (; start < end; ++start) {
+      if (isbyte_memstreambyteset(set, *start) == isMember) break;
+   }
+
+   return start;
+}
+
+const uint8_t * findin_memstreambyteset(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end)
+{
+   return find_memstreambyteset(set, start, end, true);
+}
+
+const uint8_t * findnotin_memstreambyteset(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end)
+{
+   return find_memstreambyteset(set, start, end, false);
+}
+
+
+
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+
+/* function: findscalar
+ * Reference implementation of <findin_memstreambyteset> and <findnotin_memstreambyteset>. */
+static const uint8_t * findscalar(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end, bool isMember)
+{
+   while (start < end && isbyte_memstreambyteset(set, *start) != isMember) ++start;
+   return start;
+}
+
+/* function: helper_compare_find
+ * Compares <findin_memstreambyteset> and <findnotin_memstreambyteset> with <findscalar>
+ * for every start offset and every length of buffer. */
+static int helper_compare_find(const memstream_byteset_t * set, size_t size, const uint8_t buffer[size])
+{
+   for (size_t off = 0; off < 32 && off <= size; ++off) {
+      for (size_t len = 0; off + len <= size; ++len) {
+         const uint8_t * start = buffer + off;
+         const uint8_t * end   = start + len;
+         TESTP(findscalar(set, start, end, true) == findin_memstreambyteset(set, start, end),
+               "off=%zu len=%zu", off, len);
+         TESTP(findscalar(set, start, end, false) == findnotin_memstreambyteset(set, start, end),
+               "off=%zu len=%zu", off, len);
+      }
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+static int test_byteset(void)
+{
+   memstream_byteset_t set;
+   uint8_t bytes[256];
+   uint8_t buffer[32+100];
+#if defined(__x86_64__) || defined(__i386__)
+   const bool isavx2 = s_memstreambyteset_isavx2;
+#endif
+
+   // TEST init_memstreambyteset: empty set
+   init_memstreambyteset(&set, 0, bytes);
+   for (unsigned b = 0; b < 256; ++b) {
+      TEST(! isbyte_memstreambyteset(&set, b));
+   }
+
+   // TEST init_memstreambyteset: every single byte value
+   for (unsigned b = 0; b < 256; ++b) {
+      bytes[0] = (uint8_t) b;
+      init_memstreambyteset(&set, 1, bytes);
+      for (unsigned b2 = 0; b2 < 256; ++b2) {
+         TEST((b == b2) == isbyte_memstreambyteset(&set, b2));
+      }
+   }
+
+   // TEST init_memstreambyteset: all byte values and duplicates
+   for (unsigned b = 0; b < 256; ++b) {
+      bytes[b] = (uint8_t) (b/2);
+   }
+   init_memstreambyteset(&set, 256, bytes);
+   for (unsigned b = 0; b < 256; ++b) {
+      TEST((b < 128) == isbyte_memstreambyteset(&set, b));
+   }
+
+   // TEST g_memstream_space, g_memstream_lineend
+   for (unsigned b = 0; b < 256; ++b) {
+      TEST((b == ' ' || (b >= '\t' && b <= '\r')) == isbyte_memstreambyteset(&g_memstream_space, b));
+      TEST((b == '\n' || b == '\r') == isbyte_memstreambyteset(&g_memstream_lineend, b));
+   }
+
+#if defined(__x86_64__) || defined(__i386__)
+   // run with scalar loop and with avx2 (if supported)
+   for (int isSIMD = 0; isSIMD <= isavx2; ++isSIMD) {
+      s_memstreambyteset_isavx2 = isSIMD;
+#endif
+
+      // TEST findin_memstreambyteset, findnotin_memstreambyteset: empty range
+      init_memstreambyteset(&set, 0, bytes);
+      TEST(buffer == findin_memstreambyteset(&set, buffer, buffer));
+      TEST(buffer == findnotin_memstreambyteset(&set, buffer, buffer));
+
+      // TEST findin_memstreambyteset, findnotin_memstreambyteset: single match at every position (low and high bytes)
+      static const uint8_t match[] = { 0x00, '\n', 0x7f, 0x80, 0xa5, 0xff };
+      for (size_t m = 0; m < lengthof(match); ++m) {
+         init_memstreambyteset(&set, 1, &match[m]);
+         for (size_t pos = 0; pos < sizeof(buffer); pos += (pos < 40 || pos > sizeof(buffer)-40 ? 1 : 7)) {
+            memset(buffer, match[m] ^ 0x01, sizeof(buffer));
+            buffer[pos] = match[m];
+            TEST(0 == helper_compare_find(&set, sizeof(buffer), buffer));
+            // whole buffer
+            TEST(&buffer[pos] == findin_memstreambyteset(&set, buffer, buffer+sizeof(buffer)));
+            memset(buffer, match[m], sizeof(buffer));
+            buffer[pos] = match[m] ^ 0x80;
+            TEST(&buffer[pos] == findnotin_memstreambyteset(&set, buffer, buffer+sizeof(buffer)));
+         }
+      }
+
+      // TEST findin_memstreambyteset, findnotin_memstreambyteset: no match
+      bytes[0] = 0x80; bytes[1] = 0x00;
+      init_memstreambyteset(&set, 2, bytes);
+      memset(buffer, 0x81, sizeof(buffer));
+      TEST(buffer+sizeof(buffer) == findin_memstreambyteset(&set, buffer, buffer+sizeof(buffer)));
+      TEST(buffer == findnotin_memstreambyteset(&set, buffer, buffer+sizeof(buffer)));
+      memset(buffer, 0x80, sizeof(buffer));
+      TEST(buffer == findin_memstreambyteset(&set, buffer, buffer+sizeof(buffer)));
+      TEST(buffer+sizeof(buffer) == findnotin_memstreambyteset(&set, buffer, buffer+sizeof(buffer)));
+
+      // TEST findin_memstreambyteset, findnotin_memstreambyteset: pseudo random content and sets
+      uint32_t random = 12345;
+      for (unsigned i = 0; i < 64; ++i) {
+         for (size_t b = 0; b < sizeof(buffer); ++b) {
+            random = random * 1103515245 + 12345;
+            // few byte values so that matches and misses are mixed
+            buffer[b] = (uint8_t) ((random >> 16) & 0x83) ^ (uint8_t) (i << 2);
+         }
+         for (unsigned b = 0; b < 4; ++b) {
+            random = random * 1103515245 + 12345;
+            bytes[b] = buffer[(random >> 16) % sizeof(buffer)];
+         }
+         init_memstreambyteset(&set, 1 + i % 4, bytes);
+         TEST(0 == helper_compare_find(&set, sizeof(buffer), buffer));
+      }
+
+#if defined(__x86_64__) || defined(__i386__)
+   }
+   s_memstreambyteset_isavx2 = isavx2;
+#endif
+
+   return 0;
+ONERR:
+#if defined(__x86_64__) || defined(__i386__)
+   s_memstreambyteset_isavx2 = isavx2;
+#endif
+   return EINVAL;
+}
+
+static int test_skip(void)
+{
+   memstream_t    memstr;
+   memstream_ro_t memstr2;
+   uint8_t        buffer[] = "  \t\v\f\r\nline1\r\nline2\rline3\nend";
+   uint8_t        * const end = buffer + sizeof(buffer) - 1;
+   const uint8_t  bytes[] = { 'l', 'e' };
+   memstream_byteset_t set;
+
+   // TEST skipspace_memstream
+   init_memstream(&memstr, buffer, end);
+   TEST(true == skipspace_memstream(&memstr));
+   TEST(memstr.next == buffer + 7);
+   TEST(memstr.end  == end);
+   TEST(true == skipspace_memstream(&memstr));
+   TEST(memstr.next == buffer + 7);
+
+   // TEST skipline_memstream: "\r\n" is one line end
+   TEST(true == skipline_memstream(&memstr));
+   TEST(memstr.next == buffer + 14);
+   TEST(0 == memcmp(memstr.next, "line2", 5));
+   // "\r" alone
+   TEST(true == skipline_memstream(&memstr));
+   TEST(0 == memcmp(memstr.next, "line3", 5));
+   // "\n" alone
+   TEST(true == skipline_memstream(&memstr));
+   TEST(0 == memcmp(memstr.next, "end", 3));
+   // no line end
+   TEST(false == skipline_memstream(&memstr));
+   TEST(memstr.next == end);
+
+   // TEST skipline_memstream: "\r" as last byte
+   init_memstream(&memstr, buffer + 7, buffer + 13);
+   TEST(true == skipline_memstream(&memstr));
+   TEST(memstr.next == buffer + 13);
+   TEST(memstr.end  == buffer + 13);
+
+   // TEST skipuntil_memstream
+   init_memstreambyteset(&set, lengthof(bytes), bytes);
+   init_memstream(&memstr, buffer, end);
+   TEST(true == skipuntil_memstream(&memstr, &set));
+   TEST(memstr.next == buffer + 7);
+   TEST(true == skipuntil_memstream(&memstr, &set));
+   TEST(memstr.next == buffer + 7);
+   init_memstream(&memstr, buffer, buffer + 7);
+   TEST(false == skipuntil_memstream(&memstr, &set));
+   TEST(memstr.next == buffer + 7);
+
+   // TEST skipwhile_memstream
+   init_memstream(&memstr, buffer + 7, end);
+   TEST(true == skipwhile_memstream(&memstr, &set));
+   TEST(memstr.next == buffer + 8);
+   init_memstream(&memstr, end - 3, end - 2);
+   TEST(false == skipwhile_memstream(&memstr, &set));
+   TEST(memstr.next == end - 2);
+
+   // TEST skipspace_memstream: memstream_ro_t and empty stream
+   init_memstream(&memstr2, (const uint8_t*)buffer, (const uint8_t*)buffer);
+   TEST(false == skipspace_memstream(&memstr2));
+   TEST(memstr2.next == buffer);
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+int unittest_memory_memstream()
+{
+   if (test_byteset())     goto ONERR;
+   if (test_skip())        goto ONERR;
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+#endif
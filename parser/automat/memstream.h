@@ -25,6 +25,7 @@ struct string_t;
 // == exported types
 struct memstream_t;
 struct memstream_ro_t;
+struct memstream_byteset_t;
 
 
 // section: Functions
@@ -67,6 +68,49 @@ void initPstr_memstreamro(/*out*/memstream_ro_t * memstr, const struct string_t
 memstream_ro_t * cast_memstreamro(void * obj, IDNAME nameprefix);
 
 
+/* struct: memstream_byteset_t
+ * Set of byte values searched by <skipuntil_memstream> and <skipwhile_memstream>.
+ * The set is stored as a bitmap indexed by the low and high nibble of a byte value.
+ * This allows to test 32 bytes at once with two table lookups (pshufb) if the cpu supports AVX2. */
+typedef struct memstream_byteset_t {
+   /* variable: bits
+    * Bit (b>>4)&7 of bits[b>>7][b&15] is set if byte value b is contained in the set. */
+   uint8_t bits[2][16];
+} memstream_byteset_t;
+
+// group: lifetime
+
+/* function: init_memstreambyteset
+ * Initializes set with nrbytes byte values. Duplicate values are allowed. */
+void init_memstreambyteset(/*out*/memstream_byteset_t * set, size_t nrbytes, const uint8_t bytes[nrbytes]);
+
+// group: query
+
+/* function: isbyte_memstreambyteset
+ * Returns true if byte is contained in set. */
+bool isbyte_memstreambyteset(const memstream_byteset_t * set, uint8_t byte);
+
+/* function: findin_memstreambyteset
+ * Returns the address of the first byte in [start, end) which is contained in set.
+ * The value end is returned if there is no such byte. */
+const uint8_t * findin_memstreambyteset(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end);
+
+/* function: findnotin_memstreambyteset
+ * Returns the address of the first byte in [start, end) which is not contained in set.
+ * The value end is returned if there is no such byte. */
+const uint8_t * findnotin_memstreambyteset(const memstream_byteset_t * set, const uint8_t * start, const uint8_t * end);
+
+// group: global-variables
+
+/* variable: g_memstream_space
+ * Contains the whitespace bytes ' ', '\t', '\n', '\v', '\f' and '\r'. */
+extern const memstream_byteset_t g_memstream_space;
+
+/* variable: g_memstream_lineend
+ * Contains the bytes '\n' and '\r'. */
+extern const memstream_byteset_t g_memstream_lineend;
+
+
 /* struct: memstream_t
  * Wraps a memory block which points to start and end address.
  * The start address is the lowest address of an allocated memory block.
@@ -169,6 +213,36 @@ int tryskip_memstream(memstream_t * memstr, size_t len);
  * size_memstream(memstr) >= 1 */
 uint8_t nextbyte_memstream(memstream_t * memstr);
 
+// group: scan
+// The functions work also with <memstream_ro_t>.
+
+/* function: findbyteset_memstream
+ * Finds the first byte of memstr contained in set.
+ * The returned value points to the position of the found byte.
+ * The value 0 is returned if *memstr* does not contain any byte of set. */
+/*const*/ uint8_t * findbyteset_memstream(const memstream_t * memstr, const memstream_byteset_t * set);
+
+/* function: skipuntil_memstream
+ * Increments memstr->next until it points to a byte contained in set.
+ * Returns true if such a byte was found. Else memstr->next is set to memstr->end and false is returned. */
+bool skipuntil_memstream(memstream_t * memstr, const memstream_byteset_t * set);
+
+/* function: skipwhile_memstream
+ * Increments memstr->next as long as it points to a byte contained in set.
+ * Returns true if a byte not contained in set was found. Else memstr->next is set to memstr->end and false is returned. */
+bool skipwhile_memstream(memstream_t * memstr, const memstream_byteset_t * set);
+
+/* function: skipspace_memstream
+ * Skips all whitespace bytes (see <g_memstream_space>).
+ * Returns true if memstr->next points to a non whitespace byte. */
+bool skipspace_memstream(memstream_t * memstr);
+
+/* function: skipline_memstream
+ * Skips all bytes up to and including the next line end.
+ * A line end is either "\n", "\r\n" or a single "\r".
+ * Returns true if a line end was found. Else memstr->next is set to memstr->end and false is returned. */
+bool skipline_memstream(memstream_t * memstr);
+
 // group: write
 
 /* function: printf_memstream
@@ -210,6 +284,17 @@ memstream_t * cast_memstream(void * obj, IDNAME nameprefix);
 
 // section: inline implementation
 
+// group: memstream_byteset_t
+
+/* define: isbyte_memstreambyteset
+ * Implements <memstream_byteset_t.isbyte_memstreambyteset>. */
+#define isbyte_memstreambyteset(set, byte) \
+         ( __extension__ ({                     \
+            const uint8_t _b = (uint8_t) (byte); \
+            (bool) (((set)->bits[_b >> 7][_b & 15] \
+                     >> ((_b >> 4) & 7)) & 1);   \
+         }))
+
 // group: memstream_ro_t
 
 /* define: cast_memstreamro
@@ -275,6 +360,16 @@ memstream_t * cast_memstream(void * obj, IDNAME nameprefix);
                      size_memstream(_m));    \
          }))
 
+/* define: findbyteset_memstream
+ * Implements <memstream_t.findbyteset_memstream>. */
+#define findbyteset_memstream(memstr, set) \
+         ( __extension__ ({                                 \
+            typeof(memstr) _m = (memstr);                   \
+            const uint8_t * _f = findin_memstreambyteset(   \
+                              (set), _m->next, _m->end);    \
+            (typeof(_m->next)) (_f == _m->end ? 0 : _f);    \
+         }))
+
 /* define: free_memstream
  * Implements <memstream_t.free_memstream>. */
 #define free_memstream(memstr) \
@@ -361,6 +456,50 @@ memstream_t * cast_memstream(void * obj, IDNAME nameprefix);
             _m->next += _l;               \
          } while (0)
 
+/* define: skipline_memstream
+ * Implements <memstream_t.skipline_memstream>. */
+#define skipline_memstream(memstr) \
+         ( __extension__ ({                                   \
+            typeof(memstr) _m = (memstr);                     \
+            bool _isfound = skipuntil_memstream(              \
+                              _m, &g_memstream_lineend);      \
+            if (_isfound) {                                   \
+               ++ _m->next;                                   \
+               if (  _m->next[-1] == '\r' && _m->next != _m->end \
+                     && _m->next[0] == '\n') {                \
+                  ++ _m->next;                                \
+               }                                              \
+            }                                                 \
+            _isfound;                                         \
+         }))
+
+/* define: skipspace_memstream
+ * Implements <memstream_t.skipspace_memstream>. */
+#define skipspace_memstream(memstr) \
+         (skipwhile_memstream((memstr), &g_memstream_space))
+
+/* define: skipuntil_memstream
+ * Implements <memstream_t.skipuntil_memstream>. */
+#define skipuntil_memstream(memstr, set) \
+         ( __extension__ ({                                 \
+            typeof(memstr) _m2 = (memstr);                  \
+            _m2->next = (typeof(_m2->next))                 \
+               findin_memstreambyteset(                     \
+                     (set), _m2->next, _m2->end);           \
+            (_m2->next != _m2->end);                        \
+         }))
+
+/* define: skipwhile_memstream
+ * Implements <memstream_t.skipwhile_memstream>. */
+#define skipwhile_memstream(memstr, set) \
+         ( __extension__ ({                                 \
+            typeof(memstr) _m2 = (memstr);                  \
+            _m2->next = (typeof(_m2->next))                 \
+               findnotin_memstreambyteset(                  \
+                     (set), _m2->next, _m2->end);           \
+            (_m2->next != _m2->end);                        \
+         }))
+
 /* define: tryskip_memstream
  * Implements <memstream_t.tryskip_memstream>. */
 #define tryskip_memstream(memstr, len) \
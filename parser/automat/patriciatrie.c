@@ -81,6 +81,97 @@ static inline int getbit(patriciatrie_t *tree, getkey_data_t *key, size_t bitoff
    return key->addr[byteoffset - key->offset] & (0x80>>(bitoffset%8));
 }
 
+/* function: first_different_byte
+ * Returns the smallest offset in [offset..len-1] where key1 and key2 differ or len if they are equal.
+ * Compares 8 bytes at a time. */
+static inline size_t first_different_byte(size_t offset, size_t len, const uint8_t key1[len], const uint8_t key2[len])
+{
+   for (; offset + sizeof(uint64_t) <= len; offset += sizeof(uint64_t)) {
+      uint64_t word1, word2;
+      memcpy(&word1, key1 + offset, sizeof(word1));
+      memcpy(&word2, key2 + offset, sizeof(word2));
+      uint64_t diff = word1 ^ word2;
+      if (diff) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+         return offset + (size_t)__builtin_ctzll(diff) / 8;
+#else
+         return offset + (size_t)__builtin_clzll(diff) / 8;
+#endif
+      }
+   }
+   for (; offset < len; ++offset) {
+      if (key1[offset] != key2[offset]) break;
+   }
+   return offset;
+}
+
+/* function: first_nonzero_byte
+ * Returns the smallest offset in [offset..len-1] where key contains a byte != 0 or len if all are 0.
+ * Tests 8 bytes at a time. */
+static inline size_t first_nonzero_byte(size_t offset, size_t len, const uint8_t key[len])
+{
+   for (; offset + sizeof(uint64_t) <= len; offset += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, key + offset, sizeof(word));
+      if (word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+         return offset + (size_t)__builtin_ctzll(word) / 8;
+#else
+         return offset + (size_t)__builtin_clzll(word) / 8;
+#endif
+      }
+   }
+   for (; offset < len; ++offset) {
+      if (key[offset]) break;
+   }
+   return offset;
+}
+
+/* function: first_different_bit_fullkey
+ * Implements <get_first_different_bit> for two keys which are stored in a single data block.
+ * The bytes at offset where both keys differ are returned in bf (foundkey) and bn (newkey).
+ * Returns EEXIST if both keys are equal. */
+static inline int first_different_bit_fullkey(
+      size_t sizef, const uint8_t keyf[sizef],
+      size_t sizen, const uint8_t keyn[sizen],
+      /*out*/size_t *offset,
+      /*out*/uint8_t *bf,
+      /*out*/uint8_t *bn)
+{
+   const size_t minsize = sizef < sizen ? sizef : sizen;
+   size_t off = first_different_byte(0, minsize, keyf, keyn);
+
+   if (off < minsize) {
+      *bf = keyf[off];
+      *bn = keyn[off];
+   } else if (sizef == sizen) {
+      return EEXIST;
+   } else if (sizen < sizef) {
+      // newkey continues with end marker 0xFF and artificial extension of 0
+      if (keyf[off] != 0xFF) {
+         *bf = keyf[off];
+         *bn = 0xFF;
+      } else {
+         off = first_nonzero_byte(off+1, sizef, keyf);
+         *bf = off < sizef ? keyf[off] : 0xFF/*end marker of foundkey*/;
+         *bn = 0;
+      }
+   } else {
+      // foundkey continues with end marker 0xFF and artificial extension of 0
+      if (keyn[off] != 0xFF) {
+         *bf = 0xFF;
+         *bn = keyn[off];
+      } else {
+         off = first_nonzero_byte(off+1, sizen, keyn);
+         *bf = 0;
+         *bn = off < sizen ? keyn[off] : 0xFF/*end marker of newkey*/;
+      }
+   }
+
+   *offset = off;
+   return 0;
+}
+
 /* function: get_first_different_bit
  * Determines the bit with the smallest offset which differs in foundkey and newkey.
  * Virtual end markers of 0xFF at end of each key are used to ensure that keys of different
@@ -119,6 +210,14 @@ static inline int get_first_different_bit(
    size_t offset = 0;
    uint8_t const *keyf = foundkey->addr;
    uint8_t const *keyn = newkey->addr;
+   if (  foundkey->endoffset == foundkey->streamsize
+         && newkey->endoffset == newkey->streamsize) {
+      // fast path: both keys are fully resident
+      if (first_different_bit_fullkey(foundkey->streamsize, keyf, newkey->streamsize, keyn, &offset, &bf, &bn)) {
+         return EEXIST;
+      }
+      goto FOUND_DIFFERENCE;
+   }
    for (;;) {
       size_t endoffset = foundkey->endoffset < newkey->endoffset ? foundkey->endoffset : newkey->endoffset;
       for (; offset < endoffset; ++offset) {
@@ -197,14 +296,11 @@ static inline int get_first_different_bit(
    }
 
 FOUND_DIFFERENCE: // == (bf != bn) ==
-   offset *= 8;
    bf ^= bn;
-   unsigned mask = 0x80;
-   for (; 0 == (mask & bf); mask >>= 1) {
-      ++ offset;
-   }
+   const unsigned bit  = (unsigned) __builtin_clz(bf) - (8*sizeof(unsigned) - 8);
+   const unsigned mask = 0x80u >> bit;
 
-   *newkey_bit_offset = offset;
+   *newkey_bit_offset = 8 * offset + bit;
    *newkey_bit_value  = (uint8_t) (bn & mask);
    return 0;
 }
@@ -221,6 +317,11 @@ static inline int is_key_equal(
       if (cmpkey->offset) {
          tree->keyadapt.getkey(cmpkey, 0);
       }
+      if (  foundkey.endoffset == foundkey.streamsize
+            && cmpkey->endoffset == cmpkey->streamsize) {
+         // fast path: both keys are fully resident
+         return first_different_byte(0, foundkey.streamsize, foundkey.addr, cmpkey->addr) == foundkey.streamsize;
+      }
       size_t offset = 0;
       uint8_t const *keyf = foundkey.addr;
       uint8_t const *keyc = cmpkey->addr;
@@ -293,6 +394,85 @@ static void findnode(patriciatrie_t *tree, getkey_data_t *key, patriciatrie_node
    *found_parent = parent;
 }
 
+/* function: lowerbound_patriciatrie
+ * Returns the node with the lowest key >= key (isupper == false) or > key (isupper == true).
+ * If no such node exists 0 is returned.
+ *
+ * Algorithm:
+ * The search for key ends at node whose key differs first at bit diff_bitoffset from key.
+ * All keys in the subtree reached by following key until the first node with bit_offset > diff_bitoffset
+ * share the bits of key before diff_bitoffset and differ at diff_bitoffset.
+ * If the bit of key is 0 all keys of the subtree are greater and its first node is the result.
+ * Else all keys of the subtree are smaller and the result is the first node of the right branch
+ * of the last node on the path whose left branch has been followed.
+ *
+ * Unchecked Precondition:
+ * - key->offset == 0 */
+static patriciatrie_node_t * lowerbound_patriciatrie(patriciatrie_t *tree, getkey_data_t *key, bool isupper)
+{
+   patriciatrie_node_t * parent;
+   patriciatrie_node_t * node;
+
+   if (!tree->root) return 0;
+
+   findnode(tree, key, &parent, &node);
+
+   size_t  diff_bitoffset;
+   uint8_t diff_bitvalue;
+   {
+      getkey_data_t foundkey;
+      init1_getkeydata(&foundkey, tree->keyadapt.getkey, cast_object(node, tree));
+      if (get_first_different_bit(tree, &foundkey, key, &diff_bitoffset, &diff_bitvalue)) {
+         // node has same key
+         if (!isupper) return node;
+         // subtree is node itself ==> return first node of higher branch
+         diff_bitoffset = (size_t)-1;
+         diff_bitvalue  = 1;
+      }
+   }
+
+   patriciatrie_node_t * higher_branch_parent = 0;
+   parent = 0;
+   node   = tree->root;
+   getbitinit(tree, key, node->bit_offset);
+   while (  (!parent || node->bit_offset > parent->bit_offset)
+            && node->bit_offset < diff_bitoffset) {
+      parent = node;
+      if (getbit(tree, key, node->bit_offset)) {
+         node = node->right;
+      } else {
+         higher_branch_parent = parent;
+         node = node->left;
+      }
+   }
+
+   if (!diff_bitvalue) {
+      // all keys of subtree are greater
+      if (!parent || node->bit_offset > parent->bit_offset) {
+         do {
+            parent = node;
+            node   = node->left;
+         } while (node->bit_offset > parent->bit_offset);
+      }
+      return node;
+   }
+
+   // a single node (left == right) tests an unused bit_offset and has no successor
+   if (  !higher_branch_parent
+         || higher_branch_parent->left == higher_branch_parent->right) {
+      return 0;
+   }
+
+   parent = higher_branch_parent;
+   node   = parent->right;
+   while (node->bit_offset > parent->bit_offset) {
+      parent = node;
+      node   = node->left;
+   }
+
+   return node;
+}
+
 int find_patriciatrie(patriciatrie_t *tree, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** found_node)
 {
    int err;
@@ -321,6 +501,75 @@ ONERR:
 
 // group: change
 
+int initbulk_patriciatrie(/*out*/patriciatrie_t *tree, getkey_adapter_t keyadapt, size_t nrnode, patriciatrie_node_t * nodes[nrnode])
+{
+   int err;
+   patriciatrie_t newtree = patriciatrie_INIT(0, keyadapt);
+
+   VALIDATE_INPARAM_TEST(nodes != 0 || nrnode == 0, ONERR, );
+
+   // node[i-1] stores the bit offset of the first different bit between key i-1 and key i
+   for (size_t i = 0; i < nrnode; ++i) {
+      getkey_data_t key;
+      init1_getkeydata(&key, keyadapt.getkey, cast_object(nodes[i], &newtree));
+      VALIDATE_INPARAM_TEST((key.addr != 0 || key.streamsize == 0) && key.streamsize < (((size_t)-1)/8), ONERR, );
+      if (i) {
+         getkey_data_t prevkey;
+         init1_getkeydata(&prevkey, keyadapt.getkey, cast_object(nodes[i-1], &newtree));
+         uint8_t bitvalue;
+         if (get_first_different_bit(&newtree, &prevkey, &key, &nodes[i-1]->bit_offset, &bitvalue)) {
+            err = EEXIST;
+            goto ONERR;
+         }
+         // bit of key i must be 1 ==> key i-1 < key i
+         VALIDATE_INPARAM_TEST(bitvalue != 0, ONERR, );
+      }
+   }
+
+   if (nrnode) {
+      // build cartesian tree of bit offsets (smallest offset is root) in O(nrnode)
+      // node[i-1] represents the inner node which separates key i-1 and key i
+      // stack is linked with right pointer, right child of a popped node is the node popped before or the key after it
+      patriciatrie_node_t * top = 0;
+      for (size_t i = 1; i < nrnode; ++i) {
+         patriciatrie_node_t * node = nodes[i-1];
+         patriciatrie_node_t * last = 0;
+         while (top && top->bit_offset > node->bit_offset) {
+            patriciatrie_node_t * below = top->right;
+            top->right = (last ? last : node);
+            last = top;
+            top  = below;
+         }
+         node->left  = (last ? last : node);
+         node->right = top;
+         top = node;
+      }
+
+      // the node with the greatest key is the only one with unused bit_offset
+      patriciatrie_node_t * leaf = nodes[nrnode-1];
+      leaf->bit_offset = 0;
+      leaf->left  = leaf;
+      leaf->right = leaf;
+
+      patriciatrie_node_t * last = 0;
+      while (top) {
+         patriciatrie_node_t * below = top->right;
+         top->right = (last ? last : leaf);
+         last = top;
+         top  = below;
+      }
+
+      newtree.root = (last ? last : leaf);
+   }
+
+   *tree = newtree;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
 int insert_patriciatrie(patriciatrie_t *tree, patriciatrie_node_t * newnode, /*err*/ patriciatrie_node_t** existing_node/*0 ==> not returned*/)
 {
    int err;
@@ -597,6 +846,7 @@ int initfirst_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patrici
 
    iter->next = node;
    iter->tree = tree;
+   iter->end  = 0;
    return 0;
 }
 
@@ -614,7 +864,77 @@ int initlast_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patricia
 
    iter->next = node;
    iter->tree = tree;
+   iter->end  = 0;
+   return 0;
+}
+
+
+int initlowerbound_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t len, const uint8_t key[len])
+{
+   int err;
+
+   VALIDATE_INPARAM_TEST((key != 0 || len == 0) && len < (((size_t)-1)/8), ONERR, );
+
+   getkey_data_t fullkey;
+   initfullkey_getkeydata(&fullkey, len, key);
+
+   iter->next = lowerbound_patriciatrie(tree, &fullkey, false);
+   iter->tree = tree;
+   iter->end  = 0;
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int initupperbound_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t len, const uint8_t key[len])
+{
+   int err;
+
+   VALIDATE_INPARAM_TEST((key != 0 || len == 0) && len < (((size_t)-1)/8), ONERR, );
+
+   getkey_data_t fullkey;
+   initfullkey_getkeydata(&fullkey, len, key);
+
+   iter->next = lowerbound_patriciatrie(tree, &fullkey, true);
+   iter->tree = tree;
+   iter->end  = 0;
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int initrange_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t lolen, const uint8_t lokey[lolen], size_t hilen, const uint8_t hikey[hilen])
+{
+   int err;
+
+   VALIDATE_INPARAM_TEST(   (lokey != 0 || lolen == 0) && lolen < (((size_t)-1)/8)
+                         && (hikey != 0 || hilen == 0) && hilen < (((size_t)-1)/8), ONERR, );
+
+   getkey_data_t lo;
+   getkey_data_t hi;
+   initfullkey_getkeydata(&lo, lolen, lokey);
+   initfullkey_getkeydata(&hi, hilen, hikey);
+
+   patriciatrie_node_t * next = 0;
+   patriciatrie_node_t * end  = 0;
+   size_t  diff_bitoffset;
+   uint8_t hi_bitvalue;
+   if (  ! get_first_different_bit(tree, &lo, &hi, &diff_bitoffset, &hi_bitvalue)
+         && hi_bitvalue/*lokey < hikey*/) {
+      next = lowerbound_patriciatrie(tree, &lo, false);
+      end  = lowerbound_patriciatrie(tree, &hi, false);
+      if (next == end) next = 0;
+   }
+
+   iter->next = next;
+   iter->tree = tree;
+   iter->end  = end;
    return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
 }
 
 // group: iterate
@@ -641,14 +961,16 @@ bool next_patriciatrieiterator(patriciatrie_iterator_t *iter, /*out*/patriciatri
       }
    } while (next->bit_offset > parent->bit_offset);
 
-   if (higher_branch_parent) {
+   // a single node (left == right) tests an unused bit_offset and has no successor
+   if (  higher_branch_parent
+         && higher_branch_parent->left != higher_branch_parent->right) {
       parent = higher_branch_parent;
       next = parent->right;
       while (next->bit_offset > parent->bit_offset) {
          parent = next;
          next = next->left;
       }
-      iter->next = next;
+      iter->next = (next != iter->end ? next : 0);
    } else {
       iter->next = 0;
    }
@@ -678,7 +1000,9 @@ bool prev_patriciatrieiterator(patriciatrie_iterator_t *iter, /*out*/patriciatri
       }
    } while (next->bit_offset > parent->bit_offset);
 
-   if (lower_branch_parent) {
+   // a single node (left == right) tests an unused bit_offset and has no predecessor
+   if (  lower_branch_parent
+         && lower_branch_parent->left != lower_branch_parent->right) {
       parent = lower_branch_parent;
       next = parent->left;
       while (next->bit_offset > parent->bit_offset) {
@@ -773,7 +1097,8 @@ bool next_patriciatrieprefixiter(patriciatrie_prefixiter_t *iter, /*out*/patrici
    } while (next->bit_offset > parent->bit_offset);
 
    if (  higher_branch_parent
-         && higher_branch_parent->bit_offset >= iter->prefix_bits) {
+         && higher_branch_parent->bit_offset >= iter->prefix_bits
+         && higher_branch_parent->left != higher_branch_parent->right) {
       parent = higher_branch_parent;
       next = parent->right;
       while (next->bit_offset > parent->bit_offset) {
@@ -787,3 +1112,1374 @@ bool next_patriciatrieprefixiter(patriciatrie_prefixiter_t *iter, /*out*/patrici
 
    return true;
 }
+
+
+// section: patriciatrie_concurrent_t
+
+// group: helper
+
+/* define: INNER_TAG
+ * Set in pointers to inner nodes of <patriciatrie_concurrent_t> to differentiate them from leaves. */
+#define INNER_TAG ((uintptr_t)1)
+
+static inline bool isinner_concurrent(patriciatrie_node_t *node)
+{
+   return ((uintptr_t)node & INNER_TAG) != 0;
+}
+
+static inline patriciatrie_node_t * inner_concurrent(patriciatrie_node_t *node)
+{
+   return (patriciatrie_node_t*) ((uintptr_t)node - INNER_TAG);
+}
+
+static inline patriciatrie_node_t * taginner_concurrent(patriciatrie_node_t *inner)
+{
+   return (patriciatrie_node_t*) ((uintptr_t)inner + INNER_TAG);
+}
+
+/* function: load_concurrent
+ * Reads a child pointer which could be changed by a concurrent writer. */
+static inline patriciatrie_node_t * load_concurrent(patriciatrie_node_t **child)
+{
+   return __atomic_load_n(child, __ATOMIC_ACQUIRE);
+}
+
+/* function: publish_concurrent
+ * Writes a child pointer. All changes to the new child are visible to a reader before the pointer itself. */
+static inline void publish_concurrent(patriciatrie_node_t **child, patriciatrie_node_t *node)
+{
+   __atomic_store_n(child, node, __ATOMIC_RELEASE);
+}
+
+/* function: findleaf_concurrent
+ * Returns the leaf whose key shares the longest prefix with key or 0 if tree is empty.
+ * If higher_branch is not 0 it is set to the last inner node on the path whose left child has been followed.
+ *
+ * Unchecked Precondition:
+ * - key->offset == 0 */
+static patriciatrie_node_t * findleaf_concurrent(patriciatrie_t *tree, getkey_data_t *key, /*out*/patriciatrie_node_t ** higher_branch)
+{
+   patriciatrie_node_t *node = load_concurrent(&tree->root);
+   patriciatrie_node_t *higher = 0;
+
+   while (isinner_concurrent(node)) {
+      patriciatrie_node_t *inner = inner_concurrent(node);
+      if (getbit(tree, key, inner->bit_offset)) {
+         node = load_concurrent(&inner->right);
+      } else {
+         higher = inner;
+         node = load_concurrent(&inner->left);
+      }
+   }
+
+   if (higher_branch) *higher_branch = higher;
+   return node;
+}
+
+/* function: firstleaf_concurrent
+ * Returns the leaf with the lowest key of the subtree node. */
+static inline patriciatrie_node_t * firstleaf_concurrent(patriciatrie_node_t *node)
+{
+   while (isinner_concurrent(node)) {
+      node = load_concurrent(&inner_concurrent(node)->left);
+   }
+   return node;
+}
+
+/* function: reclaim_patriciatrieconcurrent
+ * Advances the global epoch if every reader in a read section has seen the current epoch.
+ * Afterwards all nodes retired two or more epochs ago are freed.
+ *
+ * Unchecked Precondition:
+ * - tree->lock is held */
+static int reclaim_patriciatrieconcurrent(patriciatrie_concurrent_t *tree)
+{
+   int err = 0;
+   size_t epoch = tree->epoch;
+
+   // pairs with fence in enter_patriciatriereader: either the epoch of a reader is seen
+   // or the reader sees all nodes retired before
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   for (patriciatrie_reader_t *reader = tree->readers; reader; reader = reader->next) {
+      size_t rdepoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+      if (rdepoch != 0 && rdepoch != epoch) goto FREE_RETIRED;
+   }
+   ++ epoch;
+   __atomic_store_n(&tree->epoch, epoch, __ATOMIC_RELEASE);
+
+FREE_RETIRED:
+   ;
+   patriciatrie_node_t **prev = &tree->retired;
+   while (*prev && (*prev)->bit_offset + 2 > epoch) {
+      prev = &(*prev)->left;
+   }
+   patriciatrie_node_t *node = *prev;
+   *prev = 0;
+   while (node) {
+      patriciatrie_node_t *next = node->left;
+      free(node->right);
+      node->bit_offset = 0;
+      node->left  = 0;
+      node->right = 0;
+      if (tree->delete_f) {
+         int err2 = tree->delete_f(cast_object(node, &tree->trie));
+         if (err2) err = err2;
+      }
+      node = next;
+   }
+
+   return err;
+}
+
+// group: lifetime
+
+int init_patriciatrieconcurrent(/*out*/patriciatrie_concurrent_t *tree, getkey_adapter_t keyadapt, delete_adapter_f delete_f)
+{
+   int err;
+
+   err = pthread_mutex_init(&tree->lock, 0);
+   if (err) goto ONERR;
+
+   init_patriciatrie(&tree->trie, keyadapt);
+   tree->epoch    = 1;
+   tree->readers  = 0;
+   tree->retired  = 0;
+   tree->delete_f = delete_f;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int free_patriciatrieconcurrent(patriciatrie_concurrent_t *tree)
+{
+   int err = 0;
+
+   if (tree->epoch) {
+      // all nodes are unreachable (no readers) ==> free every retired node
+      tree->epoch += 2;
+      err = reclaim_patriciatrieconcurrent(tree);
+
+      // free inner nodes and delete leaves
+      // rotate left child of inner node up until it is a leaf, then free the inner node
+      patriciatrie_node_t *node = tree->trie.root;
+      tree->trie.root = 0;
+      while (node) {
+         patriciatrie_node_t *leaf = node;
+         if (isinner_concurrent(node)) {
+            patriciatrie_node_t *inner = inner_concurrent(node);
+            if (isinner_concurrent(inner->left)) {
+               patriciatrie_node_t *left = inner_concurrent(inner->left);
+               inner->left = left->right;
+               left->right = node;
+               node = taginner_concurrent(left);
+               continue;
+            }
+            leaf = inner->left;
+            node = inner->right;
+            free(inner);
+         } else {
+            node = 0;
+         }
+         if (tree->delete_f) {
+            int err2 = tree->delete_f(cast_object(leaf, &tree->trie));
+            if (err2) err = err2;
+         }
+      }
+
+      tree->epoch = 0;
+      tree->trie.keyadapt = (getkey_adapter_t) getkey_adapter_INIT(0,0);
+      int err2 = pthread_mutex_destroy(&tree->lock);
+      if (err2) err = err2;
+   }
+
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   TRACEEXITFREE_ERRLOG(err);
+   return err;
+}
+
+// group: search
+
+int find_patriciatrieconcurrent(patriciatrie_concurrent_t *tree, patriciatrie_reader_t *reader, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** found_node)
+{
+   int err;
+
+   VALIDATE_INPARAM_TEST((key != 0 || len == 0) && len < (((size_t)-1)/8) && reader->tree == tree, ONERR, );
+
+   getkey_data_t fullkey;
+   initfullkey_getkeydata(&fullkey, len, key);
+
+   enter_patriciatriereader(reader);
+   patriciatrie_node_t *node = findleaf_concurrent(&tree->trie, &fullkey, 0);
+   bool isfound = node && is_key_equal(&tree->trie, node, &fullkey);
+   leave_patriciatriereader(reader);
+
+   if (!isfound) return ESRCH;
+
+   *found_node = node;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+// group: change
+
+int insert_patriciatrieconcurrent(patriciatrie_concurrent_t *tree, patriciatrie_node_t * newnode, /*err*/patriciatrie_node_t** existing_node/*0 ==> not returned*/)
+{
+   int err;
+   patriciatrie_t * const trie = &tree->trie;
+   getkey_data_t newkey;
+   init1_getkeydata(&newkey, trie->keyadapt.getkey, cast_object(newnode, trie));
+
+   VALIDATE_INPARAM_TEST((newkey.addr != 0 || newkey.streamsize == 0) && newkey.streamsize < (((size_t)-1)/8), ONERR, );
+
+   pthread_mutex_lock(&tree->lock);
+
+   newnode->bit_offset = 0;
+   newnode->left  = 0;
+   newnode->right = 0;
+
+   if (!trie->root) {
+      publish_concurrent(&trie->root, newnode);
+      goto UNLOCK;
+   }
+
+   size_t  new_bitoffset;
+   uint8_t new_bitvalue;
+   {
+      patriciatrie_node_t *node = findleaf_concurrent(trie, &newkey, 0);
+      getkey_data_t foundkey;
+      init1_getkeydata(&foundkey, trie->keyadapt.getkey, cast_object(node, trie));
+      if (node == newnode || get_first_different_bit(trie, &foundkey, &newkey, &new_bitoffset, &new_bitvalue)) {
+         pthread_mutex_unlock(&tree->lock);
+         if (existing_node) *existing_node = node;
+         return EEXIST;   // found node has same key
+      }
+   }
+
+   patriciatrie_node_t *inner = malloc(sizeof(patriciatrie_node_t));
+   if (!inner) {
+      err = ENOMEM;
+      pthread_mutex_unlock(&tree->lock);
+      goto ONERR;
+   }
+
+   // search position in tree where new_bitoffset belongs to
+   patriciatrie_node_t **child = &trie->root;
+   getbitinit(trie, &newkey, 0);
+   while (  isinner_concurrent(*child)
+            && inner_concurrent(*child)->bit_offset < new_bitoffset) {
+      patriciatrie_node_t *parent = inner_concurrent(*child);
+      child = getbit(trie, &newkey, parent->bit_offset) ? &parent->right : &parent->left;
+   }
+
+   inner->bit_offset = new_bitoffset;
+   if (new_bitvalue) {
+      inner->left  = *child;
+      inner->right = newnode;
+   } else {
+      inner->left  = newnode;
+      inner->right = *child;
+   }
+   publish_concurrent(child, taginner_concurrent(inner));
+
+UNLOCK:
+   pthread_mutex_unlock(&tree->lock);
+
+   return 0;
+ONERR:
+   if (existing_node) *existing_node = 0; // err param
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int remove_patriciatrieconcurrent(patriciatrie_concurrent_t *tree, size_t len, const uint8_t key[len])
+{
+   int err;
+   patriciatrie_t * const trie = &tree->trie;
+
+   VALIDATE_INPARAM_TEST((key != 0 || len == 0) && len < (((size_t)-1)/8), ONERR, );
+
+   getkey_data_t fullkey;
+   initfullkey_getkeydata(&fullkey, len, key);
+
+   pthread_mutex_lock(&tree->lock);
+
+   patriciatrie_node_t **child  = &trie->root;
+   patriciatrie_node_t **pchild = 0;
+   patriciatrie_node_t  *parent = 0;
+   while (isinner_concurrent(*child)) {
+      pchild = child;
+      parent = inner_concurrent(*child);
+      child  = getbit(trie, &fullkey, parent->bit_offset) ? &parent->right : &parent->left;
+   }
+
+   patriciatrie_node_t *node = *child;
+   if (!node || ! is_key_equal(trie, node, &fullkey)) {
+      pthread_mutex_unlock(&tree->lock);
+      return ESRCH;
+   }
+
+   if (parent) {
+      // replace parent with sibling of node
+      publish_concurrent(pchild, child == &parent->left ? parent->right : parent->left);
+   } else {
+      publish_concurrent(&trie->root, 0);
+   }
+
+   // retire node and parent (readers do not access fields of leaf nodes)
+   node->bit_offset = tree->epoch;
+   node->left  = tree->retired;
+   node->right = parent;
+   tree->retired = node;
+
+   err = reclaim_patriciatrieconcurrent(tree);
+
+   pthread_mutex_unlock(&tree->lock);
+
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+
+// section: patriciatrie_reader_t
+
+// group: lifetime
+
+int init_patriciatriereader(/*out*/patriciatrie_reader_t *reader, patriciatrie_concurrent_t *tree)
+{
+   reader->tree      = tree;
+   reader->epoch     = 0;
+   reader->nestcount = 0;
+
+   pthread_mutex_lock(&tree->lock);
+   reader->next  = tree->readers;
+   tree->readers = reader;
+   pthread_mutex_unlock(&tree->lock);
+
+   return 0;
+}
+
+int free_patriciatriereader(patriciatrie_reader_t *reader)
+{
+   patriciatrie_concurrent_t *tree = reader->tree;
+
+   if (tree) {
+      pthread_mutex_lock(&tree->lock);
+      for (patriciatrie_reader_t **prev = &tree->readers; *prev; prev = &(*prev)->next) {
+         if (*prev == reader) {
+            *prev = reader->next;
+            break;
+         }
+      }
+      pthread_mutex_unlock(&tree->lock);
+      reader->next = 0;
+      reader->tree = 0;
+   }
+
+   return 0;
+}
+
+
+// section: patriciatrie_concurrentiter_t
+
+// group: lifetime
+
+int initfirst_patriciatrieconcurrentiter(/*out*/patriciatrie_concurrentiter_t *iter, patriciatrie_reader_t *reader)
+{
+   enter_patriciatriereader(reader);
+
+   iter->next   = firstleaf_concurrent(load_concurrent(&reader->tree->trie.root));
+   iter->reader = reader;
+   return 0;
+}
+
+int free_patriciatrieconcurrentiter(patriciatrie_concurrentiter_t *iter)
+{
+   if (iter->reader) {
+      leave_patriciatriereader(iter->reader);
+      iter->reader = 0;
+   }
+   iter->next = 0;
+
+   return 0;
+}
+
+// group: helper
+
+/* function: isgreater_concurrentiter
+ * Returns true if the key of node is greater than key. */
+static inline bool isgreater_concurrentiter(patriciatrie_t *trie, patriciatrie_node_t *node, getkey_data_t *key)
+{
+   getkey_data_t nodek;
+   init1_getkeydata(&nodek, trie->keyadapt.getkey, cast_object(node, trie));
+   size_t  diff_bitoffset;
+   uint8_t diff_bitvalue;
+   return ! get_first_different_bit(trie, &nodek, key, &diff_bitoffset, &diff_bitvalue)
+          && ! diff_bitvalue;
+}
+
+/* function: successor_concurrentiter
+ * Returns the leaf with the lowest key greater than key or 0.
+ * The result is only valid if the trie is not changed concurrently,
+ * see <next_patriciatrieconcurrentiter> which validates it. */
+static patriciatrie_node_t * successor_concurrentiter(patriciatrie_t *trie, getkey_data_t *key)
+{
+   patriciatrie_node_t *higher_branch;
+   getbitinit(trie, key, 0);
+   patriciatrie_node_t *leaf = findleaf_concurrent(trie, key, &higher_branch);
+
+   if (!leaf) return 0;
+
+   getkey_data_t leafk;
+   init1_getkeydata(&leafk, trie->keyadapt.getkey, cast_object(leaf, trie));
+   size_t  diff_bitoffset;
+   uint8_t diff_bitvalue;
+   if (! get_first_different_bit(trie, &leafk, key, &diff_bitoffset, &diff_bitvalue)) {
+      // key is not stored (removed concurrently)
+      // all keys of the subtree which contains leaf and is below diff_bitoffset
+      // share the bit value of leaf at diff_bitoffset
+      patriciatrie_node_t *subtree = load_concurrent(&trie->root);
+      higher_branch = 0;
+      getbitinit(trie, key, 0);
+      while (  isinner_concurrent(subtree)
+               && inner_concurrent(subtree)->bit_offset < diff_bitoffset) {
+         patriciatrie_node_t *inner = inner_concurrent(subtree);
+         if (getbit(trie, key, inner->bit_offset)) {
+            subtree = load_concurrent(&inner->right);
+         } else {
+            higher_branch = inner;
+            subtree = load_concurrent(&inner->left);
+         }
+      }
+      if (!diff_bitvalue) {
+         // keys in subtree are greater
+         return firstleaf_concurrent(subtree);
+      }
+   }
+
+   return higher_branch ? firstleaf_concurrent(load_concurrent(&higher_branch->right)) : 0;
+}
+
+// group: iterate
+
+bool next_patriciatrieconcurrentiter(patriciatrie_concurrentiter_t *iter, /*out*/patriciatrie_node_t ** node)
+{
+   if (!iter->next) return false;
+
+   *node = iter->next;
+
+   // iter->next is not freed before the read section is left ==> its key is valid
+   patriciatrie_t * const trie = &iter->reader->tree->trie;
+   getkey_data_t nodek;
+   init1_getkeydata(&nodek, trie->keyadapt.getkey, cast_object(iter->next, trie));
+
+   for (;;) {
+      // successor_concurrentiter descends more than once: a concurrent change in between
+      // could result in a lower key or in 0 although a greater key exists ==> validate and retry
+      patriciatrie_node_t *next = successor_concurrentiter(trie, &nodek);
+      if (next) {
+         if (isgreater_concurrentiter(trie, next, &nodek)) {
+            iter->next = next;
+            break;
+         }
+      } else {
+         patriciatrie_node_t *last = load_concurrent(&trie->root);
+         while (isinner_concurrent(last)) {
+            last = load_concurrent(&inner_concurrent(last)->right);
+         }
+         if (!last || ! isgreater_concurrentiter(trie, last, &nodek)) {
+            iter->next = 0;
+            break;
+         }
+      }
+   }
+
+   return true;
+}
+
+
+// section: patriciatrie_compact_t
+
+// group: helper
+
+static inline bool isleaf_compact(uint32_t ref)
+{
+   return (ref & patriciatrie_compact_LEAF) != 0;
+}
+
+/* function: prefetch_compact
+ * Prefetches the inner node or the leaf entry referenced by ref. */
+static inline void prefetch_compact(const patriciatrie_compact_t *tree, uint32_t ref)
+{
+   if (isleaf_compact(ref)) {
+      __builtin_prefetch(&tree->leaf[ref & ~patriciatrie_compact_LEAF]);
+   } else {
+      __builtin_prefetch(&tree->inner[ref]);
+   }
+}
+
+/* function: findleaf_compact
+ * Returns the index of the leaf whose key shares the longest prefix with key.
+ * If higher_branch is not 0 it is set to the index of the last inner node on the path
+ * whose child[0] has been followed or to <patriciatrie_compact_NULL>.
+ *
+ * Unchecked Precondition:
+ * - tree->root != patriciatrie_compact_NULL
+ * - key->offset == 0 */
+static uint32_t findleaf_compact(patriciatrie_compact_t *tree, getkey_data_t *key, /*out*/uint32_t *higher_branch)
+{
+   uint32_t ref    = tree->root;
+   uint32_t higher = patriciatrie_compact_NULL;
+
+   while (! isleaf_compact(ref)) {
+      const patriciatrie_compactnode_t *inner = &tree->inner[ref];
+      prefetch_compact(tree, inner->child[0]);
+      prefetch_compact(tree, inner->child[1]);
+      const int bit = (getbit(&tree->trie, key, inner->bit_offset) != 0);
+      if (!bit) higher = ref;
+      ref = inner->child[bit];
+   }
+
+   if (higher_branch) *higher_branch = higher;
+   return ref & ~patriciatrie_compact_LEAF;
+}
+
+/* function: firstleaf_compact
+ * Returns the index of the leaf with the lowest key of the subtree ref. */
+static inline uint32_t firstleaf_compact(const patriciatrie_compact_t *tree, uint32_t ref)
+{
+   while (! isleaf_compact(ref)) {
+      ref = tree->inner[ref].child[0];
+   }
+   return ref & ~patriciatrie_compact_LEAF;
+}
+
+/* function: growsize_compact
+ * Returns the doubled size of an array with size entries or 0 if the maximum index would be exceeded. */
+static inline uint32_t growsize_compact(uint32_t size)
+{
+   if (size >= patriciatrie_compact_LEAF) return 0;
+   return size ? (size <= patriciatrie_compact_LEAF/2 ? 2*size : patriciatrie_compact_LEAF) : 16;
+}
+
+/* function: allocinner_compact
+ * Returns the index of an unused inner node. */
+static int allocinner_compact(patriciatrie_compact_t *tree, /*out*/uint32_t *idx)
+{
+   if (tree->freeinner != patriciatrie_compact_NULL) {
+      *idx = tree->freeinner;
+      tree->freeinner = tree->inner[*idx].child[0];
+      return 0;
+   }
+
+   if (tree->endinner == tree->sizeinner) {
+      uint32_t newsize = growsize_compact(tree->sizeinner);
+      if (!newsize) return ENOMEM;
+      void *newinner = realloc(tree->inner, newsize * sizeof(patriciatrie_compactnode_t));
+      if (!newinner) return ENOMEM;
+      tree->inner     = newinner;
+      tree->sizeinner = newsize;
+   }
+
+   *idx = tree->endinner ++;
+   return 0;
+}
+
+static inline void freeinner_compact(patriciatrie_compact_t *tree, uint32_t idx)
+{
+   tree->inner[idx].child[0] = tree->freeinner;
+   tree->freeinner = idx;
+}
+
+/* function: allocleaf_compact
+ * Returns the index of an unused leaf. Unused leaves store the index of the next unused leaf
+ * shifted left by one with bit 0 set. Returns ENOMEM if <patriciatrie_compact_MAXLEAF> leaves are in use. */
+static int allocleaf_compact(patriciatrie_compact_t *tree, /*out*/uint32_t *idx)
+{
+   if (tree->freeleaf != patriciatrie_compact_NULL) {
+      *idx = tree->freeleaf;
+      tree->freeleaf = (uint32_t) ((uintptr_t)tree->leaf[*idx] >> 1);
+      return 0;
+   }
+
+   if (tree->endleaf == patriciatrie_compact_MAXLEAF) return ENOMEM;
+
+   if (tree->endleaf == tree->sizeleaf) {
+      uint32_t newsize = growsize_compact(tree->sizeleaf);
+      if (!newsize) return ENOMEM;
+      void *newleaf = realloc(tree->leaf, newsize * sizeof(patriciatrie_node_t*));
+      if (!newleaf) return ENOMEM;
+      tree->leaf     = newleaf;
+      tree->sizeleaf = newsize;
+   }
+
+   *idx = tree->endleaf ++;
+   return 0;
+}
+
+static inline void freeleaf_compact(patriciatrie_compact_t *tree, uint32_t idx)
+{
+   tree->leaf[idx] = (patriciatrie_node_t*) (((uintptr_t)tree->freeleaf << 1) | 1);
+   tree->freeleaf  = idx;
+}
+
+// group: lifetime
+
+void init_patriciatriecompact(/*out*/patriciatrie_compact_t *tree, getkey_adapter_t keyadapt)
+{
+   *tree = (patriciatrie_compact_t) patriciatrie_compact_FREE;
+   init_patriciatrie(&tree->trie, keyadapt);
+}
+
+int free_patriciatriecompact(patriciatrie_compact_t *tree, delete_adapter_f delete_f)
+{
+   int err = 0;
+
+   if (delete_f) {
+      for (uint32_t i = 0; i < tree->endleaf; ++i) {
+         if ((uintptr_t)tree->leaf[i] & 1) continue; // unused
+         int err2 = delete_f(cast_object(tree->leaf[i], &tree->trie));
+         if (err2) err = err2;
+      }
+   }
+
+   free(tree->inner);
+   free(tree->leaf);
+   *tree = (patriciatrie_compact_t) patriciatrie_compact_FREE;
+
+   if (err) goto ONERR;
+
+   return 0;
+ONERR:
+   TRACEEXITFREE_ERRLOG(err);
+   return err;
+}
+
+// group: search
+
+int find_patriciatriecompact(patriciatrie_compact_t *tree, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** found_node)
+{
+   int err;
+
+   VALIDATE_INPARAM_TEST((key != 0 || len == 0) && len < (((size_t)-1)/8), ONERR, );
+
+   if (isempty_patriciatriecompact(tree)) return ESRCH;
+
+   getkey_data_t fullkey;
+   initfullkey_getkeydata(&fullkey, len, key);
+   patriciatrie_node_t *node = tree->leaf[findleaf_compact(tree, &fullkey, 0)];
+
+   if (! is_key_equal(&tree->trie, node, &fullkey)) {
+      return ESRCH;
+   }
+
+   *found_node = node;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+// group: change
+
+int insert_patriciatriecompact(patriciatrie_compact_t *tree, patriciatrie_node_t * newnode, /*err*/patriciatrie_node_t** existing_node/*0 ==> not returned*/)
+{
+   int err;
+   uint32_t newleaf;
+   uint32_t newinner;
+   getkey_data_t newkey;
+   init1_getkeydata(&newkey, tree->trie.keyadapt.getkey, cast_object(newnode, &tree->trie));
+
+   VALIDATE_INPARAM_TEST((newkey.addr != 0 || newkey.streamsize == 0) && newkey.streamsize < UINT32_MAX/8, ONERR, );
+
+   if (isempty_patriciatriecompact(tree)) {
+      err = allocleaf_compact(tree, &newleaf);
+      if (err) goto ONERR;
+      newnode->bit_offset = 0;
+      newnode->left  = 0;
+      newnode->right = 0;
+      tree->leaf[newleaf] = newnode;
+      tree->root = newleaf | patriciatrie_compact_LEAF;
+      return 0;
+   }
+
+   size_t  new_bitoffset;
+   uint8_t new_bitvalue;
+   {
+      patriciatrie_node_t *node = tree->leaf[findleaf_compact(tree, &newkey, 0)];
+      getkey_data_t foundkey;
+      init1_getkeydata(&foundkey, tree->trie.keyadapt.getkey, cast_object(node, &tree->trie));
+      if (node == newnode || get_first_different_bit(&tree->trie, &foundkey, &newkey, &new_bitoffset, &new_bitvalue)) {
+         if (existing_node) *existing_node = node;
+         return EEXIST;   // found node has same key
+      }
+   }
+
+   err = allocleaf_compact(tree, &newleaf);
+   if (err) goto ONERR;
+   err = allocinner_compact(tree, &newinner);
+   if (err) {
+      freeleaf_compact(tree, newleaf);
+      goto ONERR;
+   }
+
+   newnode->bit_offset = 0;
+   newnode->left  = 0;
+   newnode->right = 0;
+   tree->leaf[newleaf] = newnode;
+
+   // search position in tree where new_bitoffset belongs to
+   uint32_t *ref = &tree->root;
+   getbitinit(&tree->trie, &newkey, 0);
+   while (  ! isleaf_compact(*ref)
+            && tree->inner[*ref].bit_offset < new_bitoffset) {
+      patriciatrie_compactnode_t *parent = &tree->inner[*ref];
+      ref = &parent->child[getbit(&tree->trie, &newkey, parent->bit_offset) != 0];
+   }
+
+   patriciatrie_compactnode_t *inner = &tree->inner[newinner];
+   inner->bit_offset = (uint32_t) new_bitoffset;
+   inner->child[new_bitvalue != 0] = newleaf | patriciatrie_compact_LEAF;
+   inner->child[new_bitvalue == 0] = *ref;
+   *ref = newinner;
+
+   return 0;
+ONERR:
+   if (existing_node) *existing_node = 0; // err param
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+int remove_patriciatriecompact(patriciatrie_compact_t *tree, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** removed_node)
+{
+   int err;
+
+   VALIDATE_INPARAM_TEST((key != 0 || len == 0) && len < (((size_t)-1)/8), ONERR, );
+
+   if (isempty_patriciatriecompact(tree)) return ESRCH;
+
+   getkey_data_t fullkey;
+   initfullkey_getkeydata(&fullkey, len, key);
+
+   uint32_t *ref  = &tree->root;
+   uint32_t *pref = 0;
+   while (! isleaf_compact(*ref)) {
+      pref = ref;
+      patriciatrie_compactnode_t *parent = &tree->inner[*ref];
+      ref = &parent->child[getbit(&tree->trie, &fullkey, parent->bit_offset) != 0];
+   }
+
+   const uint32_t leafidx = *ref & ~patriciatrie_compact_LEAF;
+   patriciatrie_node_t *node = tree->leaf[leafidx];
+   if (! is_key_equal(&tree->trie, node, &fullkey)) {
+      return ESRCH;
+   }
+
+   if (pref) {
+      // replace parent with sibling of node
+      const uint32_t parentidx = *pref;
+      patriciatrie_compactnode_t *parent = &tree->inner[parentidx];
+      *pref = parent->child[ref == &parent->child[0]];
+      freeinner_compact(tree, parentidx);
+   } else {
+      tree->root = patriciatrie_compact_NULL;
+   }
+   freeleaf_compact(tree, leafidx);
+
+   *removed_node = node;
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+
+// section: patriciatrie_compactiter_t
+
+// group: lifetime
+
+int initfirst_patriciatriecompactiter(/*out*/patriciatrie_compactiter_t *iter, patriciatrie_compact_t *tree)
+{
+   iter->next = isempty_patriciatriecompact(tree) ? 0 : tree->leaf[firstleaf_compact(tree, tree->root)];
+   iter->tree = tree;
+   return 0;
+}
+
+// group: iterate
+
+bool next_patriciatriecompactiter(patriciatrie_compactiter_t *iter, /*out*/patriciatrie_node_t ** node)
+{
+   if (!iter->next) return false;
+
+   *node = iter->next;
+
+   patriciatrie_compact_t * const tree = iter->tree;
+   getkey_data_t nextk;
+   init1_getkeydata(&nextk, tree->trie.keyadapt.getkey, cast_object(iter->next, &tree->trie));
+
+   uint32_t higher_branch;
+   (void) findleaf_compact(tree, &nextk, &higher_branch);
+
+   if (higher_branch != patriciatrie_compact_NULL) {
+      iter->next = tree->leaf[firstleaf_compact(tree, tree->inner[higher_branch].child[1])];
+   } else {
+      iter->next = 0;
+   }
+
+   return true;
+}
+
+
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+
+/* struct: testnode_t
+ * Object stored in the tested tries. */
+typedef struct testnode_t {
+   patriciatrie_node_t node;
+   size_t   len;        // size of key in bytes
+   uint8_t  key[48];
+   int      isdeleted;  // set by delete_testnode
+   int      isintree;   // used by <thread_testwriter>
+} testnode_t;
+
+static void getkey_testnode(/*inout*/getkey_data_t *key, size_t offset)
+{
+   testnode_t *node = key->object;
+   (void) offset;
+   init2_getkeydata(key, node->len, node->len, node->key);
+}
+
+static inline getkey_adapter_t keyadapter_testnode(void)
+{
+   return (getkey_adapter_t) getkey_adapter_INIT(offsetof(testnode_t, node), &getkey_testnode);
+}
+
+/* function: getkey_testnodestream
+ * Returns the key in blocks of 3 bytes. Tests the streaming path of key comparisons. */
+static void getkey_testnodestream(/*inout*/getkey_data_t *key, size_t offset)
+{
+   testnode_t *node = key->object;
+   const size_t size = node->len - offset < 3 ? node->len - offset : 3;
+   if (offset == 0) {
+      init2_getkeydata(key, node->len, size, node->key);
+   } else {
+      update_getkeydata(key, offset, size, node->key + offset);
+   }
+}
+
+static inline getkey_adapter_t keyadapterstream_testnode(void)
+{
+   return (getkey_adapter_t) getkey_adapter_INIT(offsetof(testnode_t, node), &getkey_testnodestream);
+}
+
+static int delete_testnode(void *obj)
+{
+   __atomic_store_n(&((testnode_t*)obj)->isdeleted, 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+/* function: inittestnode
+ * Sets key of node to the big endian representation of value with len bytes. */
+static void inittestnode(/*out*/testnode_t *node, size_t len, uint64_t value)
+{
+   memset(node, 0, sizeof(*node));
+   node->len = len;
+   for (size_t i = len; i > 0; --i, value >>= 8) {
+      node->key[i-1] = (uint8_t) value;
+   }
+}
+
+/* function: compare_testkey
+ * Reference implementation of the key order of all tries.
+ * Every key is extended with the end marker 0xFF followed by 0 bytes and compared bytewise. */
+static int compare_testkey(size_t len1, const uint8_t key1[len1], size_t len2, const uint8_t key2[len2])
+{
+   const size_t end = (len1 > len2 ? len1 : len2) + 2;
+   for (size_t i = 0; i < end; ++i) {
+      const unsigned b1 = i < len1 ? key1[i] : (i == len1 ? 0xFF : 0);
+      const unsigned b2 = i < len2 ? key2[i] : (i == len2 ? 0xFF : 0);
+      if (b1 != b2) return b1 < b2 ? -1 : 1;
+   }
+   return 0;
+}
+
+static int compare_testnode(const void *l, const void *r)
+{
+   const testnode_t *ln = *(testnode_t*const*)l;
+   const testnode_t *rn = *(testnode_t*const*)r;
+   return compare_testkey(ln->len, ln->key, rn->len, rn->key);
+}
+
+/* function: randomkey_testnode
+ * Sets a pseudo random key of 0..40 bytes. Keys share long prefixes and contain many 0x00 and 0xFF
+ * so that they differ at every bit offset, beyond the first 8 bytes and at the end marker. */
+static void randomkey_testnode(/*out*/testnode_t *node, uint32_t *random)
+{
+   static const uint8_t prefix[2][20] = {
+      { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20 },
+      { 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0x80, 0x80, 0x80, 0x80 },
+   };
+   memset(node, 0, sizeof(*node));
+   *random = *random * 1103515245 + 12345;
+   const uint32_t r = *random >> 8;
+   const size_t   plen = r % 21;
+   const size_t   tlen = (r / 21) % 21;
+   memcpy(node->key, prefix[(r / 441) % 2], plen);
+   for (size_t i = plen; i < plen + tlen; ++i) {
+      *random = *random * 1103515245 + 12345;
+      const uint8_t b = (uint8_t) (*random >> 16);
+      node->key[i] = (b & 0x30) == 0 ? 0 : (b & 0x30) == 0x10 ? 0xFF : (uint8_t) (1 << (b & 7));
+   }
+   node->len = plen + tlen;
+}
+
+/* function: lowerbound_testnode
+ * Returns the index of the first node in sorted[0..size-1] whose key is >= key (isupper: > key). */
+static size_t lowerbound_testnode(size_t size, testnode_t * sorted[size], const testnode_t *key, bool isupper)
+{
+   size_t i = 0;
+   while (i < size && compare_testkey(sorted[i]->len, sorted[i]->key, key->len, key->key) < (isupper ? 1 : 0)) ++i;
+   return i;
+}
+
+/* function: test_sorted
+ * Compares <patriciatrie_t> and <patriciatrie_compact_t> with a sorted array of nodes.
+ * Parameter isStream selects if keys are returned in blocks of 3 bytes (slow path of the key comparisons)
+ * or as a single block (fast path which compares 8 bytes at a time). */
+static int test_sorted(bool isStream)
+{
+   enum { NRNODE = 600, NRPROBE = 200 };
+   const getkey_adapter_t keyadapt = isStream ? keyadapterstream_testnode() : keyadapter_testnode();
+   testnode_t  * nodes  = malloc(NRNODE * sizeof(testnode_t));
+   testnode_t ** sorted = malloc(NRNODE * sizeof(testnode_t*));
+   patriciatrie_node_t ** bulk = malloc(NRNODE * sizeof(patriciatrie_node_t*));
+   patriciatrie_t         tree  = patriciatrie_FREE;
+   patriciatrie_compact_t ctree = patriciatrie_compact_FREE;
+   patriciatrie_iterator_t iter = patriciatrie_iterator_FREE;
+   patriciatrie_compactiter_t citer;
+   patriciatrie_node_t * found;
+   testnode_t probe;
+   uint32_t   random = 7;
+   size_t     size   = 0;
+
+   TEST(nodes && sorted && bulk);
+
+   // TEST insert_patriciatrie: random keys, EEXIST for duplicates
+   init_patriciatrie(&tree, keyadapt);
+   for (unsigned i = 0; i < NRNODE; ++i) {
+      randomkey_testnode(&nodes[i], &random);
+      int err = insert_patriciatrie(&tree, &nodes[i].node, &found);
+      if (err == EEXIST) {
+         const testnode_t *existing = (const testnode_t*) ((uint8_t*)found - offsetof(testnode_t, node));
+         TEST(0 == compare_testkey(existing->len, existing->key, nodes[i].len, nodes[i].key));
+      } else {
+         TEST(0 == err);
+         sorted[size++] = &nodes[i];
+      }
+   }
+   qsort(sorted, size, sizeof(sorted[0]), &compare_testnode);
+   for (size_t i = 1; i < size; ++i) {
+      TEST(0 > compare_testkey(sorted[i-1]->len, sorted[i-1]->key, sorted[i]->len, sorted[i]->key));
+   }
+   TEST(size > NRNODE/2);
+
+   for (int step = 0; step < 2; ++step) {
+
+      // TEST next_patriciatrieiterator, prev_patriciatrieiterator: same order as sorted
+      TEST(0 == initfirst_patriciatrieiterator(&iter, &tree));
+      for (size_t i = 0; i < size; ++i) {
+         TEST(next_patriciatrieiterator(&iter, &found));
+         TEST(found == &sorted[i]->node);
+      }
+      TEST(! next_patriciatrieiterator(&iter, &found));
+      TEST(0 == initlast_patriciatrieiterator(&iter, &tree));
+      for (size_t i = size; i-- > 0; ) {
+         TEST(prev_patriciatrieiterator(&iter, &found));
+         TEST(found == &sorted[i]->node);
+      }
+      TEST(! prev_patriciatrieiterator(&iter, &found));
+
+      // TEST find_patriciatrie: every stored key
+      for (size_t i = 0; i < size; ++i) {
+         TEST(0 == find_patriciatrie(&tree, sorted[i]->len, sorted[i]->key, &found));
+         TEST(found == &sorted[i]->node);
+      }
+
+      for (unsigned p = 0; p < NRPROBE; ++p) {
+         testnode_t probe2;
+         randomkey_testnode(&probe, &random);
+         randomkey_testnode(&probe2, &random);
+         const size_t lb = lowerbound_testnode(size, sorted, &probe, false);
+         const size_t ub = lowerbound_testnode(size, sorted, &probe, true);
+
+         // TEST find_patriciatrie: random keys
+         if (lb < ub) {
+            TEST(0 == find_patriciatrie(&tree, probe.len, probe.key, &found));
+            TEST(found == &sorted[lb]->node);
+         } else {
+            TEST(ESRCH == find_patriciatrie(&tree, probe.len, probe.key, &found));
+         }
+
+         // TEST initlowerbound_patriciatrieiterator, initupperbound_patriciatrieiterator
+         TEST(0 == initlowerbound_patriciatrieiterator(&iter, &tree, probe.len, probe.key));
+         for (size_t i = lb; i < size && i < lb + 3; ++i) {
+            TEST(next_patriciatrieiterator(&iter, &found));
+            TEST(found == &sorted[i]->node);
+         }
+         if (lb == size) TEST(! next_patriciatrieiterator(&iter, &found));
+         TEST(0 == initupperbound_patriciatrieiterator(&iter, &tree, probe.len, probe.key));
+         for (size_t i = ub; i < size && i < ub + 3; ++i) {
+            TEST(next_patriciatrieiterator(&iter, &found));
+            TEST(found == &sorted[i]->node);
+         }
+         if (ub == size) TEST(! next_patriciatrieiterator(&iter, &found));
+
+         // TEST initrange_patriciatrieiterator: [probe, probe2)
+         const size_t hb = lowerbound_testnode(size, sorted, &probe2, false);
+         TEST(0 == initrange_patriciatrieiterator(&iter, &tree, probe.len, probe.key, probe2.len, probe2.key));
+         for (size_t i = lb; i < hb; ++i) {
+            TEST(next_patriciatrieiterator(&iter, &found));
+            TEST(found == &sorted[i]->node);
+         }
+         TEST(! next_patriciatrieiterator(&iter, &found));
+      }
+
+      if (step) break;
+
+      // TEST remove_patriciatrie: every third node
+      size_t size2 = 0;
+      for (size_t i = 0; i < size; ++i) {
+         if (i % 3 == 1) {
+            TEST(0 == remove_patriciatrie(&tree, sorted[i]->len, sorted[i]->key, &found));
+            TEST(found == &sorted[i]->node);
+            TEST(ESRCH == remove_patriciatrie(&tree, sorted[i]->len, sorted[i]->key, &found));
+         } else {
+            sorted[size2++] = sorted[i];
+         }
+      }
+      size = size2;
+   }
+   TEST(0 == free_patriciatrie(&tree, 0));
+
+   // TEST initbulk_patriciatrie: EINVAL for unsorted keys, EEXIST for equal keys
+   for (size_t i = 0; i < size; ++i) {
+      bulk[i] = &sorted[i]->node;
+   }
+   bulk[size/2] = &sorted[size/2+1]->node;
+   bulk[size/2+1] = &sorted[size/2]->node;
+   TEST(EINVAL == initbulk_patriciatrie(&tree, keyadapt, size, bulk));
+   bulk[size/2+1] = &sorted[size/2+1]->node;
+   TEST(EEXIST == initbulk_patriciatrie(&tree, keyadapt, size, bulk));
+   TEST(isempty_patriciatrie(&tree));
+
+   // TEST initbulk_patriciatrie: same result as inserting
+   bulk[size/2] = &sorted[size/2]->node;
+   TEST(0 == initbulk_patriciatrie(&tree, keyadapt, size, bulk));
+   TEST(0 == initfirst_patriciatrieiterator(&iter, &tree));
+   for (size_t i = 0; i < size; ++i) {
+      TEST(next_patriciatrieiterator(&iter, &found));
+      TEST(found == &sorted[i]->node);
+      TEST(0 == find_patriciatrie(&tree, sorted[i]->len, sorted[i]->key, &found));
+      TEST(found == &sorted[i]->node);
+   }
+   TEST(! next_patriciatrieiterator(&iter, &found));
+   for (size_t i = 0; i < size; ++i) {
+      TEST(0 == remove_patriciatrie(&tree, sorted[i]->len, sorted[i]->key, &found));
+      TEST(found == &sorted[i]->node);
+   }
+   TEST(isempty_patriciatrie(&tree));
+
+   // TEST insert_patriciatriecompact, find_patriciatriecompact, next_patriciatriecompactiter
+   init_patriciatriecompact(&ctree, keyadapt);
+   for (size_t i = size; i-- > 0; ) {
+      TEST(0 == insert_patriciatriecompact(&ctree, &sorted[i]->node, 0));
+   }
+   for (size_t i = 0; i < size; ++i) {
+      TEST(EEXIST == insert_patriciatriecompact(&ctree, &sorted[i]->node, &found));
+      TEST(found == &sorted[i]->node);
+   }
+   TEST(0 == initfirst_patriciatriecompactiter(&citer, &ctree));
+   for (size_t i = 0; i < size; ++i) {
+      TEST(next_patriciatriecompactiter(&citer, &found));
+      TEST(found == &sorted[i]->node);
+   }
+   TEST(! next_patriciatriecompactiter(&citer, &found));
+   TEST(0 == free_patriciatriecompactiter(&citer));
+   for (unsigned p = 0; p < NRPROBE; ++p) {
+      randomkey_testnode(&probe, &random);
+      const size_t lb = lowerbound_testnode(size, sorted, &probe, false);
+      const size_t ub = lowerbound_testnode(size, sorted, &probe, true);
+      TEST((lb < ub ? 0 : ESRCH) == find_patriciatriecompact(&ctree, probe.len, probe.key, &found));
+      if (lb < ub) TEST(found == &sorted[lb]->node);
+   }
+
+   // TEST remove_patriciatriecompact
+   for (size_t i = 0; i < size; ++i) {
+      TEST(0 == remove_patriciatriecompact(&ctree, sorted[i]->len, sorted[i]->key, &found));
+      TEST(found == &sorted[i]->node);
+      TEST(ESRCH == find_patriciatriecompact(&ctree, sorted[i]->len, sorted[i]->key, &found));
+      if (i + 1 < size) {
+         TEST(0 == find_patriciatriecompact(&ctree, sorted[i+1]->len, sorted[i+1]->key, &found));
+         TEST(found == &sorted[i+1]->node);
+      }
+   }
+   TEST(isempty_patriciatriecompact(&ctree));
+   TEST(0 == free_patriciatriecompact(&ctree, 0));
+
+   free(bulk);
+   free(sorted);
+   free(nodes);
+
+   return 0;
+ONERR:
+   free_patriciatriecompact(&ctree, 0);
+   free(bulk);
+   free(sorted);
+   free(nodes);
+   return EINVAL;
+}
+
+// == concurrent ==
+
+/* struct: testconcurrent_t
+ * Shared state of all threads of <test_concurrent>.
+ * Even keys are stable, they are inserted before the threads start and never removed.
+ * Odd keys are inserted and removed by the writers, writer w owns every key with (key/2) % NRWRITER == w. */
+typedef struct testconcurrent_t {
+   patriciatrie_concurrent_t tree;
+   testnode_t  node[512];
+   int         nrwriter;   // number of running writers
+   unsigned    nriter;     // number of iterations done by all readers
+   int         err;        // set to EINVAL by a failing thread
+   pthread_barrier_t start;
+} testconcurrent_t;
+
+#define testconcurrent_NRWRITER 2
+#define testconcurrent_NRREADER 3
+
+static inline unsigned keyvalue_testconcurrent(patriciatrie_node_t *node)
+{
+   const testnode_t *tnode = (const testnode_t*) ((uint8_t*)node - offsetof(testnode_t, node));
+   return (unsigned) tnode->key[0] << 8 | tnode->key[1];
+}
+
+typedef struct testthread_t {
+   testconcurrent_t *shared;
+   unsigned          nr;      // number of writer or reader
+} testthread_t;
+
+static void* thread_testwriter(void *arg)
+{
+   testthread_t     *thread = arg;
+   testconcurrent_t *shared = thread->shared;
+   uint32_t random = 1 + thread->nr;
+
+   pthread_barrier_wait(&shared->start);
+
+   // change the trie until every reader has iterated several times
+   for (unsigned i = 0; i < 20000 || __atomic_load_n(&shared->nriter, __ATOMIC_RELAXED) < 200 * testconcurrent_NRREADER; ++i) {
+      if (__atomic_load_n(&shared->err, __ATOMIC_RELAXED)) break;
+      random = random * 1103515245 + 12345;
+      unsigned   k    = 2 * (((random >> 16) % (lengthof(shared->node)/2/testconcurrent_NRWRITER)) * testconcurrent_NRWRITER + thread->nr) + 1;
+      testnode_t *node = &shared->node[k];
+      if (node->isintree) {
+         __atomic_store_n(&node->isdeleted, 0, __ATOMIC_RELAXED);
+         if (0 != remove_patriciatrieconcurrent(&shared->tree, node->len, node->key)) goto ONERR;
+         node->isintree = 0;
+      } else if (__atomic_load_n(&node->isdeleted, __ATOMIC_ACQUIRE)) {
+         // a removed node is reused only after it has been deleted (no reader accesses it)
+         patriciatrie_node_t *existing;
+         if (0 != insert_patriciatrieconcurrent(&shared->tree, &node->node, &existing)) goto ONERR;
+         node->isintree = 1;
+      }
+   }
+
+   __atomic_sub_fetch(&shared->nrwriter, 1, __ATOMIC_RELEASE);
+   return 0;
+ONERR:
+   __atomic_store_n(&shared->err, EINVAL, __ATOMIC_RELAXED);
+   __atomic_sub_fetch(&shared->nrwriter, 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+static void* thread_testreader(void *arg)
+{
+   testthread_t     *thread = arg;
+   testconcurrent_t *shared = thread->shared;
+   patriciatrie_reader_t reader = patriciatrie_reader_FREE;
+   patriciatrie_concurrentiter_t iter = patriciatrie_concurrentiter_FREE;
+   patriciatrie_node_t *found;
+
+   init_patriciatriereader(&reader, &shared->tree);
+   pthread_barrier_wait(&shared->start);
+
+   while (  0 != __atomic_load_n(&shared->nrwriter, __ATOMIC_ACQUIRE)
+            && 0 == __atomic_load_n(&shared->err, __ATOMIC_RELAXED)) {
+      // TEST next_patriciatrieconcurrentiter: keys are ascending and no stable key is missing
+      unsigned nrstable = 0;
+      int      prevkey  = -1;
+      TEST(0 == initfirst_patriciatrieconcurrentiter(&iter, &reader));
+      while (next_patriciatrieconcurrentiter(&iter, &found)) {
+         int key = (int) keyvalue_testconcurrent(found);
+         TESTP(prevkey < key, "prevkey=%d key=%d", prevkey, key);
+         if (key % 2 == 0) {
+            TESTP(key == 2 * (int)nrstable, "key=%d expected=%u", key, 2*nrstable);
+            ++ nrstable;
+         }
+         prevkey = key;
+      }
+      TEST(0 == free_patriciatrieconcurrentiter(&iter));
+      TEST(lengthof(shared->node)/2 == nrstable);
+      __atomic_add_fetch(&shared->nriter, 1, __ATOMIC_RELAXED);
+
+      // TEST find_patriciatrieconcurrent: stable keys are found
+      for (unsigned k = thread->nr * 2; k < lengthof(shared->node); k += 2 * testconcurrent_NRREADER) {
+         TEST(0 == find_patriciatrieconcurrent(&shared->tree, &reader, shared->node[k].len, shared->node[k].key, &found));
+         TEST(found == &shared->node[k].node);
+      }
+   }
+
+   TEST(0 == free_patriciatriereader(&reader));
+   return 0;
+ONERR:
+   free_patriciatrieconcurrentiter(&iter);
+   free_patriciatriereader(&reader);
+   __atomic_store_n(&shared->err, EINVAL, __ATOMIC_RELAXED);
+   return 0;
+}
+
+static int test_concurrent(void)
+{
+   testconcurrent_t *shared = malloc(sizeof(testconcurrent_t));
+   pthread_t     tid[testconcurrent_NRWRITER + testconcurrent_NRREADER];
+   testthread_t  thread[lengthof(tid)];
+   unsigned      nrthread = 0;
+   bool          isbarrier = false;
+   bool          istree    = false;
+
+   TEST(0 != shared);
+   for (unsigned k = 0; k < lengthof(shared->node); ++k) {
+      inittestnode(&shared->node[k], 2, k);
+      shared->node[k].isdeleted = (k % 2);
+   }
+   shared->nrwriter = testconcurrent_NRWRITER;
+   shared->nriter   = 0;
+   shared->err      = 0;
+   TEST(0 == pthread_barrier_init(&shared->start, 0, lengthof(tid)));
+   isbarrier = true;
+
+   // prepare: insert stable keys
+   TEST(0 == init_patriciatrieconcurrent(&shared->tree, keyadapter_testnode(), &delete_testnode));
+   istree = true;
+   for (unsigned k = 0; k < lengthof(shared->node); k += 2) {
+      TEST(0 == insert_patriciatrieconcurrent(&shared->tree, &shared->node[k].node, 0));
+   }
+
+   // TEST insert_patriciatrieconcurrent, remove_patriciatrieconcurrent, next_patriciatrieconcurrentiter:
+   //      writers change odd keys while readers iterate
+   for (; nrthread < lengthof(tid); ++nrthread) {
+      thread[nrthread] = (testthread_t) {
+         shared, nrthread < testconcurrent_NRWRITER ? nrthread : nrthread - testconcurrent_NRWRITER
+      };
+      TEST(0 == pthread_create(&tid[nrthread], 0,
+                  nrthread < testconcurrent_NRWRITER ? &thread_testwriter : &thread_testreader, &thread[nrthread]));
+   }
+   for (; nrthread > 0; --nrthread) {
+      TEST(0 == pthread_join(tid[nrthread-1], 0));
+   }
+   TEST(0 == shared->err);
+
+   // TEST free_patriciatrieconcurrent: every node is deleted
+   TEST(0 == free_patriciatrieconcurrent(&shared->tree));
+   istree = false;
+   for (unsigned k = 0; k < lengthof(shared->node); ++k) {
+      TEST(shared->node[k].isdeleted);
+   }
+
+   TEST(0 == pthread_barrier_destroy(&shared->start));
+   free(shared);
+
+   return 0;
+ONERR:
+   if (nrthread) {
+      __atomic_store_n(&shared->err, EINVAL, __ATOMIC_RELAXED);
+      // threads wait at the barrier until all are started
+      for (; nrthread > 0; --nrthread) {
+         pthread_join(tid[nrthread-1], 0);
+      }
+   }
+   if (istree) free_patriciatrieconcurrent(&shared->tree);
+   if (isbarrier) pthread_barrier_destroy(&shared->start);
+   free(shared);
+   return EINVAL;
+}
+
+// == compact ==
+
+static int test_compactlimit(void)
+{
+   patriciatrie_compact_t tree;
+   patriciatrie_node_t  * existing;
+   testnode_t             node[2];
+
+   init_patriciatriecompact(&tree, keyadapter_testnode());
+   for (unsigned i = 0; i < lengthof(node); ++i) {
+      inittestnode(&node[i], 1, i);
+   }
+
+   // TEST patriciatrie_compact_MAXLEAF
+   TEST(patriciatrie_compact_NULL != (patriciatrie_compact_MAXLEAF-1) + patriciatrie_compact_LEAF);
+   TEST(patriciatrie_compact_NULL == patriciatrie_compact_MAXLEAF + patriciatrie_compact_LEAF);
+
+   // TEST insert_patriciatriecompact: ENOMEM if patriciatrie_compact_MAXLEAF leaves are used
+   // simulate full leaf array (leaf and inner arrays are not accessed)
+   tree.sizeleaf = patriciatrie_compact_MAXLEAF;
+   tree.endleaf  = patriciatrie_compact_MAXLEAF;
+   TEST(ENOMEM == insert_patriciatriecompact(&tree, &node[0].node, &existing));
+   TEST(0 == existing);
+   TEST(isempty_patriciatriecompact(&tree));
+   TEST(patriciatrie_compact_NULL == tree.freeleaf);
+
+   // TEST insert_patriciatriecompact: less than patriciatrie_compact_MAXLEAF leaves
+   init_patriciatriecompact(&tree, keyadapter_testnode());
+   for (unsigned i = 0; i < lengthof(node); ++i) {
+      TEST(0 == insert_patriciatriecompact(&tree, &node[i].node, 0));
+   }
+   TEST(lengthof(node) == tree.endleaf);
+   TEST(0 == free_patriciatriecompact(&tree, 0));
+
+   return 0;
+ONERR:
+   free_patriciatriecompact(&tree, 0);
+   return EINVAL;
+}
+
+int unittest_ds_inmem_patriciatrie()
+{
+   if (test_sorted(false))  goto ONERR;
+   if (test_sorted(true))   goto ONERR;
+   if (test_compactlimit()) goto ONERR;
+   if (test_concurrent())  goto ONERR;
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+#endif
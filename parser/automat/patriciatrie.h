@@ -25,11 +25,18 @@
 #define CKERN_DS_INMEM_PATRICIATRIE_HEADER
 
 #include "patriciatrie_node.h"
+#include <pthread.h>
 
 // === exported types
 struct patriciatrie_t;
 struct patriciatrie_iterator_t;
 struct patriciatrie_prefixiter_t;
+struct patriciatrie_concurrent_t;
+struct patriciatrie_reader_t;
+struct patriciatrie_concurrentiter_t;
+struct patriciatrie_compact_t;
+struct patriciatrie_compactnode_t;
+struct patriciatrie_compactiter_t;
 struct getkey_adapter_t;
 struct getkey_data_t;
 
@@ -207,6 +214,14 @@ typedef struct patriciatrie_t {
  * So do not delete <typeadapt_t> as long as this object lives. */
 static inline void init_patriciatrie(/*out*/patriciatrie_t *tree, getkey_adapter_t keyadapt);
 
+/* function: initbulk_patriciatrie
+ * Inits tree with nrnode nodes whose keys are sorted in ascending order in O(nrnode) time.
+ * Only the first different bit of every pair of consecutive keys is computed, no node is searched from the root.
+ * The order of keys is the same as returned by <next_patriciatrieiterator>, see <initlowerbound_patriciatrieiterator>.
+ * EEXIST is returned if two keys are equal and EINVAL if the keys are not sorted. In case of an error
+ * tree is not changed and the content of the nodes is undefined. */
+int initbulk_patriciatrie(/*out*/patriciatrie_t *tree, getkey_adapter_t keyadapt, size_t nrnode, patriciatrie_node_t * nodes[nrnode]);
+
 /* function: free_patriciatrie
  * Frees all resources. Calling it twice is safe. */
 int free_patriciatrie(patriciatrie_t *tree, delete_adapter_f delete_f/*0 ==> not called*/);
@@ -289,13 +304,14 @@ void patriciatrie_IMPLEMENT(IDNAME _fsuffix, TYPENAME object_t, IDNAME nodename,
 typedef struct patriciatrie_iterator_t {
    patriciatrie_node_t * next;
    patriciatrie_t      *tree;
+   patriciatrie_node_t * end; // first node not returned by <next_patriciatrieiterator>, 0 ==> last node of tree
 } patriciatrie_iterator_t;
 
 // group: lifetime
 
 /* define: patriciatrie_iterator_FREE
  * Static initializer. */
-#define patriciatrie_iterator_FREE { 0, 0 }
+#define patriciatrie_iterator_FREE { 0, 0, 0 }
 
 /* function: initfirst_patriciatrieiterator
  * Initializes an iterator for <patriciatrie_t>. */
@@ -305,6 +321,25 @@ int initfirst_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patrici
  * Initializes an iterator of <patriciatrie_t>. */
 int initlast_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree);
 
+/* function: initlowerbound_patriciatrieiterator
+ * Initializes an iterator of <patriciatrie_t> which starts at the node with the lowest key >= key.
+ * The start node is searched in O(key bits). Keys are compared bytewise where every key
+ * is extended with the virtual end marker byte 0xFF followed by 0 bytes. */
+int initlowerbound_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t len, const uint8_t key[len]);
+
+/* function: initupperbound_patriciatrieiterator
+ * Initializes an iterator of <patriciatrie_t> which starts at the node with the lowest key > key.
+ * See <initlowerbound_patriciatrieiterator>. */
+int initupperbound_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t len, const uint8_t key[len]);
+
+/* function: initrange_patriciatrieiterator
+ * Initializes an iterator of <patriciatrie_t> which returns all nodes with lokey <= key < hikey in ascending order.
+ * The range is empty if hikey <= lokey. Both bounds are searched in O(key bits).
+ *
+ * Unchecked Precondition:
+ * - The node with the lowest key >= hikey is not removed as long as the iterator is used. */
+int initrange_patriciatrieiterator(/*out*/patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t lolen, const uint8_t lokey[lolen], size_t hilen, const uint8_t hikey[hilen]);
+
 /* function: free_patriciatrieiterator
  * Frees an iterator of <patriciatrie_t>. */
 int free_patriciatrieiterator(patriciatrie_iterator_t *iter);
@@ -314,7 +349,7 @@ int free_patriciatrieiterator(patriciatrie_iterator_t *iter);
 /* function: next_patriciatrieiterator
  * Returns next node of tree in ascending order.
  * The first call after <initfirst_patriciatrieiterator> returns the node with the lowest key.
- * In case no next node exists false is returned and parameter node is not changed. */
+ * In case no next node exists or the end of the range is reached false is returned and parameter node is not changed. */
 bool next_patriciatrieiterator(patriciatrie_iterator_t *iter, /*out*/patriciatrie_node_t ** node);
 
 /* function: prev_patriciatrieiterator
@@ -357,6 +392,298 @@ int free_patriciatrieprefixiter(patriciatrie_iterator_t *iter);
 bool next_patriciatrieprefixiter(patriciatrie_prefixiter_t *iter, /*out*/patriciatrie_node_t ** node);
 
 
+/* struct: patriciatrie_concurrent_t
+ * Implements a crit-bit tree which supports lock-free readers.
+ *
+ * Readers:
+ * Every thread which reads the trie registers a <patriciatrie_reader_t>.
+ * <find_patriciatrieconcurrent> and <next_patriciatrieconcurrentiter> run without any lock
+ * and are not blocked by writers. Writers (<insert_patriciatrieconcurrent>, <remove_patriciatrieconcurrent>)
+ * are serialized with a mutex.
+ *
+ * Difference to patriciatrie_t:
+ * A <patriciatrie_t> stores a bit offset in every node and rewires up to three nodes
+ * during an insert or remove. A reader running concurrently could observe a half done change.
+ * This trie stores the user nodes only as leaves. Every inner node is allocated by the trie.
+ * Its bit offset never changes after it has been published but its child pointers do:
+ * An insert publishes a new inner node with a single atomic pointer write into the root or
+ * into a child pointer of an existing inner node. A remove replaces the parent inner node of the
+ * removed leaf with its other child also with a single atomic pointer write.
+ * A reader therefore sees every child pointer either before or after a change, but two
+ * descents of the same reader could see different trees.
+ * The fields of the <patriciatrie_node_t> of a stored object are not used as long as it is
+ * part of the trie.
+ *
+ * Memory reclamation:
+ * Removed inner nodes and removed objects could still be accessed by readers.
+ * They are put into a retired list and freed or deleted (see delete_f in <init_patriciatrieconcurrent>)
+ * after all readers which could have seen them left their read section (epoch based reclamation).
+ * Every read section is tagged with the value of a global epoch counter. A writer increments the
+ * counter only if all active readers entered their section in the current epoch. A node retired in epoch e
+ * is freed if the counter reaches e+2.
+ *
+ * Performance:
+ * Same as <patriciatrie_t> plus one malloc for every insert. */
+typedef struct patriciatrie_concurrent_t {
+   patriciatrie_t        trie;     // trie.root: pointer to leaf or tagged pointer to inner node
+   pthread_mutex_t       lock;     // serializes writers and changes of readers
+   size_t                epoch;    // global epoch counter (>= 1), changed only with lock held
+   struct patriciatrie_reader_t * readers; // list of registered readers
+   patriciatrie_node_t * retired;  // removed user nodes (newest first), bit_offset: epoch, left: next, right: removed inner node
+   delete_adapter_f      delete_f; // deletes removed objects, 0 ==> not called
+} patriciatrie_concurrent_t;
+
+// group: lifetime
+
+/* function: init_patriciatrieconcurrent
+ * Inits an empty trie. The function delete_f is called for every object
+ * after it has been removed and no reader accesses it any longer.
+ * It is also called in <free_patriciatrieconcurrent> for every stored object. */
+int init_patriciatrieconcurrent(/*out*/patriciatrie_concurrent_t *tree, getkey_adapter_t keyadapt, delete_adapter_f delete_f/*0 ==> not called*/);
+
+/* function: free_patriciatrieconcurrent
+ * Frees all inner nodes and deletes all stored and retired objects.
+ *
+ * Unchecked Precondition:
+ * - All <patriciatrie_reader_t> of this trie are freed. */
+int free_patriciatrieconcurrent(patriciatrie_concurrent_t *tree);
+
+// group: query
+
+/* function: isempty_patriciatrieconcurrent
+ * Returns true if tree contains no elements. */
+bool isempty_patriciatrieconcurrent(const patriciatrie_concurrent_t *tree);
+
+// group: search
+
+/* function: find_patriciatrieconcurrent
+ * Searches for a node with equal key. If it exists it is returned in found_node else ESRCH is returned.
+ * The function enters and leaves the read section of reader. The returned node is valid until the
+ * read section is left. Wrap the call into <enter_patriciatriereader> and <leave_patriciatriereader>
+ * if another thread could remove it concurrently.
+ * Does not block and could be called concurrently with any other function except free. */
+int find_patriciatrieconcurrent(patriciatrie_concurrent_t *tree, struct patriciatrie_reader_t *reader, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** found_node);
+
+// group: change
+
+/* function: insert_patriciatrieconcurrent
+ * Inserts a new node into the tree only if it is unique.
+ * If another node exists with the same key nothing is inserted and the function returns EEXIST.
+ * In case of an error existing_node is set to 0 or to an existing node in case of error == EEXIST.
+ * ENOMEM is returned if no inner node could be allocated. */
+int insert_patriciatrieconcurrent(patriciatrie_concurrent_t *tree, patriciatrie_node_t * newnode, /*err*/patriciatrie_node_t** existing_node/*0 ==> not returned*/);
+
+/* function: remove_patriciatrieconcurrent
+ * Removes the node whose key equals searchkey.
+ * The object is deleted with delete_f after all readers which could access it have left their read section.
+ * ESRCH is returned if no node with searchkey exists. */
+int remove_patriciatrieconcurrent(patriciatrie_concurrent_t *tree, size_t len, const uint8_t key[len]);
+
+
+/* struct: patriciatrie_reader_t
+ * Stores the read state of a single thread which reads a <patriciatrie_concurrent_t>.
+ * A reader is owned by a single thread. */
+typedef struct patriciatrie_reader_t {
+   struct patriciatrie_reader_t * next; // links all readers of tree
+   patriciatrie_concurrent_t    * tree;
+   size_t                         epoch; // epoch of tree at the time the read section was entered, 0 ==> not in read section
+   size_t                         nestcount; // number of nested calls to <enter_patriciatriereader>
+} patriciatrie_reader_t;
+
+// group: lifetime
+
+/* define: patriciatrie_reader_FREE
+ * Static initializer. */
+#define patriciatrie_reader_FREE \
+         { 0, 0, 0, 0 }
+
+/* function: init_patriciatriereader
+ * Registers reader at tree. */
+int init_patriciatriereader(/*out*/patriciatrie_reader_t *reader, patriciatrie_concurrent_t *tree);
+
+/* function: free_patriciatriereader
+ * Unregisters reader. Calling it twice is safe.
+ *
+ * Unchecked Precondition:
+ * - reader is not in a read section */
+int free_patriciatriereader(patriciatrie_reader_t *reader);
+
+// group: synchronize
+
+/* function: enter_patriciatriereader
+ * Enters a read section. No node which is reachable from the trie is freed before
+ * the read section is left. Calls could be nested. */
+static inline void enter_patriciatriereader(patriciatrie_reader_t *reader);
+
+/* function: leave_patriciatriereader
+ * Leaves a read section which was entered with <enter_patriciatriereader>. */
+static inline void leave_patriciatriereader(patriciatrie_reader_t *reader);
+
+
+/* struct: patriciatrie_concurrentiter_t
+ * Iterates over elements contained in <patriciatrie_concurrent_t> without locking.
+ * The iterator keeps the read section of its reader entered during its lifetime.
+ * Nodes inserted or removed concurrently could be returned or not. */
+typedef struct patriciatrie_concurrentiter_t {
+   patriciatrie_node_t   * next;
+   patriciatrie_reader_t * reader;
+} patriciatrie_concurrentiter_t;
+
+// group: lifetime
+
+/* define: patriciatrie_concurrentiter_FREE
+ * Static initializer. */
+#define patriciatrie_concurrentiter_FREE \
+         { 0, 0 }
+
+/* function: initfirst_patriciatrieconcurrentiter
+ * Initializes an iterator for the tree reader is registered at and enters the read section of reader. */
+int initfirst_patriciatrieconcurrentiter(/*out*/patriciatrie_concurrentiter_t *iter, patriciatrie_reader_t *reader);
+
+/* function: free_patriciatrieconcurrentiter
+ * Leaves the read section of the reader. Calling it twice is safe. */
+int free_patriciatrieconcurrentiter(patriciatrie_concurrentiter_t *iter);
+
+// group: iterate
+
+/* function: next_patriciatrieconcurrentiter
+ * Returns next node of tree in ascending order.
+ * The next node is the node with the lowest key greater than the key of the last returned node,
+ * even if the last returned node has been removed concurrently. The keys of the returned nodes
+ * are therefore strictly ascending. If a concurrent change is detected during the search it is repeated.
+ * In case no next node exists false is returned and parameter node is not changed. */
+bool next_patriciatrieconcurrentiter(patriciatrie_concurrentiter_t *iter, /*out*/patriciatrie_node_t ** node);
+
+
+/* struct: patriciatrie_compactnode_t
+ * Inner node of <patriciatrie_compact_t>.
+ * A child with bit <patriciatrie_compact_LEAF> set is an index into <patriciatrie_compact_t.leaf>
+ * else it is an index into <patriciatrie_compact_t.inner>. */
+typedef struct patriciatrie_compactnode_t {
+   uint32_t bit_offset; // bit offset of the bit to test
+   uint32_t child[2];   // child[0]: bit is 0, child[1]: bit is 1
+} patriciatrie_compactnode_t;
+
+/* define: patriciatrie_compact_LEAF
+ * Tags a child index as index of a leaf. */
+#define patriciatrie_compact_LEAF ((uint32_t)1 << 31)
+
+/* define: patriciatrie_compact_NULL
+ * Index of a non existing node (empty tree or end of free list). */
+#define patriciatrie_compact_NULL ((uint32_t)-1)
+
+/* define: patriciatrie_compact_MAXLEAF
+ * Maximum number of nodes stored in a <patriciatrie_compact_t>.
+ * The leaf index patriciatrie_compact_LEAF-1 is never used, tagged with <patriciatrie_compact_LEAF>
+ * it would be equal to <patriciatrie_compact_NULL>. */
+#define patriciatrie_compact_MAXLEAF (patriciatrie_compact_LEAF-1)
+
+/* struct: patriciatrie_compact_t
+ * Implements a crit-bit tree whose inner nodes are stored outside of the user objects.
+ *
+ * Layout:
+ * The inner nodes of type <patriciatrie_compactnode_t> are 12 bytes large and stored in a single array.
+ * Their children are referenced with 32 bit indexes. A second array stores the pointers to the
+ * <patriciatrie_node_t> of all inserted objects. The fields of this node are unused.
+ * Both arrays grow by doubling their size. Unused entries are kept in a free list.
+ *
+ * Performance:
+ * A lookup reads only inner nodes and prefetches both children of every visited node.
+ * Only the key of the found leaf is read from a user object. A <patriciatrie_t> reads the node
+ * embedded in a user object at every step which costs a cache miss per step for large tries.
+ *
+ * Limits:
+ * The size of a key must be less than UINT32_MAX/8 bytes and at most 2^31-1 nodes could be stored. */
+typedef struct patriciatrie_compact_t {
+   patriciatrie_t              trie;      // only trie.keyadapt is used
+   patriciatrie_compactnode_t* inner;     // array of inner nodes
+   patriciatrie_node_t      ** leaf;      // array of inserted nodes
+   uint32_t                    root;      // index of root node or patriciatrie_compact_NULL
+   uint32_t                    sizeinner; // allocated number of entries in inner
+   uint32_t                    endinner;  // inner[endinner..sizeinner-1] were never used
+   uint32_t                    freeinner; // first unused inner node, child[0] links the free list
+   uint32_t                    sizeleaf;  // allocated number of entries in leaf
+   uint32_t                    endleaf;   // leaf[endleaf..sizeleaf-1] were never used
+   uint32_t                    freeleaf;  // first unused leaf, the index of the next unused leaf is stored in leaf[freeleaf]
+} patriciatrie_compact_t;
+
+// group: lifetime
+
+/* define: patriciatrie_compact_FREE
+ * Static initializer. */
+#define patriciatrie_compact_FREE \
+         { patriciatrie_FREE, 0, 0, patriciatrie_compact_NULL, 0, 0, patriciatrie_compact_NULL, 0, 0, patriciatrie_compact_NULL }
+
+/* function: init_patriciatriecompact
+ * Inits an empty tree object. */
+void init_patriciatriecompact(/*out*/patriciatrie_compact_t *tree, getkey_adapter_t keyadapt);
+
+/* function: free_patriciatriecompact
+ * Frees the node arrays. For every stored object delete_f is called. Calling it twice is safe. */
+int free_patriciatriecompact(patriciatrie_compact_t *tree, delete_adapter_f delete_f/*0 ==> not called*/);
+
+// group: query
+
+/* function: isempty_patriciatriecompact
+ * Returns true if tree contains no elements. */
+bool isempty_patriciatriecompact(const patriciatrie_compact_t *tree);
+
+// group: search
+
+/* function: find_patriciatriecompact
+ * Searches for a node with equal key. If it exists it is returned in found_node else ESRCH is returned. */
+int find_patriciatriecompact(patriciatrie_compact_t *tree, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** found_node);
+
+// group: change
+
+/* function: insert_patriciatriecompact
+ * Inserts a new node into the tree only if it is unique.
+ * If another node exists with the same key nothing is inserted and the function returns EEXIST.
+ * In case of an error existing_node is set to 0 or to an existing node in case of error == EEXIST.
+ * ENOMEM is returned if the node arrays could not be grown or if <patriciatrie_compact_MAXLEAF> nodes are stored. */
+int insert_patriciatriecompact(patriciatrie_compact_t *tree, patriciatrie_node_t * newnode, /*err*/patriciatrie_node_t** existing_node/*0 ==> not returned*/);
+
+/* function: remove_patriciatriecompact
+ * Removes a node if its key equals searchkey.
+ * The removed node is not freed but a pointer to it is returned in *removed_node* to the caller.
+ * ESRCH is returned if no node with searchkey exists. */
+int remove_patriciatriecompact(patriciatrie_compact_t *tree, size_t len, const uint8_t key[len], /*out*/patriciatrie_node_t ** removed_node);
+
+
+/* struct: patriciatrie_compactiter_t
+ * Iterates over elements contained in <patriciatrie_compact_t>.
+ * The iterator supports removing or deleting of the current node. */
+typedef struct patriciatrie_compactiter_t {
+   patriciatrie_node_t    * next;
+   patriciatrie_compact_t * tree;
+} patriciatrie_compactiter_t;
+
+// group: lifetime
+
+/* define: patriciatrie_compactiter_FREE
+ * Static initializer. */
+#define patriciatrie_compactiter_FREE \
+         { 0, 0 }
+
+/* function: initfirst_patriciatriecompactiter
+ * Initializes an iterator for <patriciatrie_compact_t>. */
+int initfirst_patriciatriecompactiter(/*out*/patriciatrie_compactiter_t *iter, patriciatrie_compact_t *tree);
+
+/* function: free_patriciatriecompactiter
+ * Frees an iterator of <patriciatrie_compact_t>. */
+int free_patriciatriecompactiter(patriciatrie_compactiter_t *iter);
+
+// group: iterate
+
+/* function: next_patriciatriecompactiter
+ * Returns next node of tree in ascending order.
+ * The first call after <initfirst_patriciatriecompactiter> returns the node with the lowest key.
+ * In case no next node exists false is returned and parameter node is not changed. */
+bool next_patriciatriecompactiter(patriciatrie_compactiter_t *iter, /*out*/patriciatrie_node_t ** node);
+
+
+
+
 // section: inline implementation
 
 // group: getkey_data_t
@@ -415,6 +742,47 @@ static inline void update_getkeydata(getkey_data_t *key, size_t offset, size_t s
 #define free_patriciatrieprefixiter(iter)    \
          ((iter)->next = 0, 0)
 
+// group: patriciatrie_reader_t
+
+/* define: enter_patriciatriereader
+ * Implements <patriciatrie_reader_t.enter_patriciatriereader>.
+ * The fence orders the announced epoch before all following reads of the trie. */
+static inline void enter_patriciatriereader(patriciatrie_reader_t *reader)
+{
+         if (0 == reader->nestcount ++) {
+            __atomic_store_n(&reader->epoch, __atomic_load_n(&reader->tree->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+         }
+}
+
+/* define: leave_patriciatriereader
+ * Implements <patriciatrie_reader_t.leave_patriciatriereader>. */
+static inline void leave_patriciatriereader(patriciatrie_reader_t *reader)
+{
+         if (0 == -- reader->nestcount) {
+            __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+         }
+}
+
+// group: patriciatrie_concurrent_t
+
+/* define: isempty_patriciatrieconcurrent
+ * Implements <patriciatrie_concurrent_t.isempty_patriciatrieconcurrent>. */
+#define isempty_patriciatrieconcurrent(tree) \
+         (0 == __atomic_load_n(&(tree)->trie.root, __ATOMIC_ACQUIRE))
+
+// group: patriciatrie_compact_t
+
+/* define: isempty_patriciatriecompact
+ * Implements <patriciatrie_compact_t.isempty_patriciatriecompact>. */
+#define isempty_patriciatriecompact(tree) \
+         (patriciatrie_compact_NULL == (tree)->root)
+
+/* define: free_patriciatriecompactiter
+ * Implements <patriciatrie_compactiter_t.free_patriciatriecompactiter> as NOOP. */
+#define free_patriciatriecompactiter(iter)   \
+         ((iter)->next = 0, 0)
+
 // group: patriciatrie_t
 
 /* define: init_patriciatrie
@@ -435,6 +803,9 @@ static inline void init_patriciatrie(/*out*/patriciatrie_t *tree, getkey_adapter
    typedef object_t              *  iteratedtype##_fsuffix;    \
    static inline int  initfirst##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree) __attribute__ ((always_inline)); \
    static inline int  initlast##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree) __attribute__ ((always_inline)); \
+   static inline int  initlowerbound##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t keylength, const uint8_t searchkey[keylength]) __attribute__ ((always_inline)); \
+   static inline int  initupperbound##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t keylength, const uint8_t searchkey[keylength]) __attribute__ ((always_inline)); \
+   static inline int  initrange##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t lolength, const uint8_t lokey[lolength], size_t hilength, const uint8_t hikey[hilength]) __attribute__ ((always_inline)); \
    static inline int  free##_fsuffix##iterator(patriciatrie_iterator_t *iter) __attribute__ ((always_inline)); \
    static inline bool next##_fsuffix##iterator(patriciatrie_iterator_t *iter, object_t ** node) __attribute__ ((always_inline)); \
    static inline bool prev##_fsuffix##iterator(patriciatrie_iterator_t *iter, object_t ** node) __attribute__ ((always_inline)); \
@@ -498,6 +869,15 @@ static inline void init_patriciatrie(/*out*/patriciatrie_t *tree, getkey_adapter
    static inline int  initlast##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree) { \
       return initlast_patriciatrieiterator(iter, tree); \
    } \
+   static inline int  initlowerbound##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t keylength, const uint8_t searchkey[keylength]) { \
+      return initlowerbound_patriciatrieiterator(iter, tree, keylength, searchkey); \
+   } \
+   static inline int  initupperbound##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t keylength, const uint8_t searchkey[keylength]) { \
+      return initupperbound_patriciatrieiterator(iter, tree, keylength, searchkey); \
+   } \
+   static inline int  initrange##_fsuffix##iterator(patriciatrie_iterator_t *iter, patriciatrie_t *tree, size_t lolength, const uint8_t lokey[lolength], size_t hilength, const uint8_t hikey[hilength]) { \
+      return initrange_patriciatrieiterator(iter, tree, lolength, lokey, hilength, hikey); \
+   } \
    static inline int  free##_fsuffix##iterator(patriciatrie_iterator_t *iter) { \
       return free_patriciatrieiterator(iter); \
    } \
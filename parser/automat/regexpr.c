@@ -56,11 +56,22 @@ void log_regexprerr(const regexpr_err_t *err, uint8_t channel)
 typedef struct buffer_t {
    automat_t         mman;
    memstream_ro_t    input;
+   unsigned          nrgroup; // number of parsed groups
+   bool              isTag;   // true: groups are marked with <group_TAGCHAR>
+   uint64_t          notag;   // bit g-1 set: group g is not captured
    /*== out ==*/
    automat_t         result;
    regexpr_err_t     err;
 } buffer_t;
 
+// group: constants
+
+/* define: group_TAGCHAR
+ * Das Tag, das den Anfang (isEnd == 0) bzw. das Ende (isEnd == 1) der Gruppe group markiert.
+ * Die Tags liegen im für Tags reservierten Bereich ab <automat_MINTAGCHAR>. */
+#define group_TAGCHAR(group, isEnd) \
+         (automat_MINTAGCHAR + 2 * (char32_t)(group) + (char32_t)(isEnd))
+
 // group: lifetime
 
 int init_buffer(/*out*/buffer_t* buffer, size_t len, const char str[len]) \
@@ -70,6 +81,9 @@ int init_buffer(/*out*/buffer_t* buffer, size_t len, const char str[len]) \
    err = initempty_automat(&buffer->mman, 0);
    if (err) goto ONERR;
    buffer->input = (memstream_ro_t) memstream_INIT((const uint8_t*)str, (const uint8_t*)str + len);
+   buffer->nrgroup = 0;
+   buffer->isTag   = false;
+   buffer->notag   = 0;
 
    return 0;
 ONERR:
@@ -89,6 +103,35 @@ ONERR:
    return err;
 }
 
+// group: query
+
+/* function: istag_buffer
+ * Liefert true, falls Anfang und Ende der Gruppe group mit Tags markiert werden. */
+static inline bool istag_buffer(const buffer_t* buffer, unsigned group)
+{
+   return buffer->isTag && group <= regexpr_MAXGROUP && 0 == (buffer->notag & ((uint64_t)1 << (group-1)));
+}
+
+/* function: hastag_buffer
+ * Liefert true, falls mindestens eine der bisher gelesenen Gruppen erfasst wird. */
+static inline bool hastag_buffer(const buffer_t* buffer)
+{
+   unsigned nrgroup = buffer->nrgroup < regexpr_MAXGROUP ? buffer->nrgroup : regexpr_MAXGROUP;
+   uint64_t all = nrgroup == 64 ? (uint64_t)-1 : ((uint64_t)1 << nrgroup) - 1;
+   return 0 != (all & ~buffer->notag);
+}
+
+// group: update
+
+/* function: marknotag_buffer
+ * Markiert alle Gruppen mit einer Nummer größer als firstgroup als nicht erfasst. */
+static inline void marknotag_buffer(buffer_t* buffer, unsigned firstgroup)
+{
+   for (unsigned group = firstgroup; group < buffer->nrgroup && group < regexpr_MAXGROUP; ++group) {
+      buffer->notag |= (uint64_t)1 << group;
+   }
+}
+
 // group: parsing
 
 /* function: read_next
@@ -140,6 +183,7 @@ static inline int parse_utf8(buffer_t* buffer, uint8_t next, char32_t* chr)
       buffer->err.chr  = next;
       buffer->err.pos  = (const char*) buffer->input.next - 1;
       buffer->err.expect = 0;
+      buffer->err.index  = 0;
       nrbytes = nrbytes > size_memstream(&buffer->input)+1 ? size_memstream(&buffer->input)+1 : nrbytes;
       buffer->err.unexpected[0] = (char) next;
       for (size_t i = 1; i < nrbytes; ++i) {
@@ -185,6 +229,7 @@ static inline int ERR_EXPECT_OR_UNMATCHED(buffer_t* buffer, const char* expect,
    buffer->err.chr  = next;
    buffer->err.pos  = (const char*) buffer->input.next - !isEndOfFile;
    buffer->err.expect = expect;
+   buffer->err.index  = 0;
 
    if (! isEndOfFile && ! issinglebyte_utf8(next)) {
       int err = parse_utf8(buffer, next, &buffer->err.chr);
@@ -223,6 +268,34 @@ static int operator_not(buffer_t* buffer)
    return err;
 }
 
+/* function: operator_tag
+ * Umschließt buffer->result mit den Tags der Gruppe group. */
+static int operator_tag(buffer_t* buffer, unsigned group)
+{
+   int err;
+   automat_t tag;
+
+   err = initmatch_automat(&tag, &buffer->mman, 1, (char32_t[]){ group_TAGCHAR(group, 0) }, (char32_t[]){ group_TAGCHAR(group, 0) });
+   if (err) return err;
+
+   if (!PROCESS_testerrortimer(&s_regex_errtimer, &err)) {
+      err = opsequence_automat(&tag, &buffer->result);
+   }
+   if (err) {
+      free_automat(&tag);
+      return err;
+   }
+   initmove_automat(&buffer->result, &tag);
+
+   err = initmatch_automat(&tag, &buffer->mman, 1, (char32_t[]){ group_TAGCHAR(group, 1) }, (char32_t[]){ group_TAGCHAR(group, 1) });
+   if (err) return err;
+
+   err = opsequence_automat(&buffer->result, &tag);
+   if (err) free_automat(&tag);
+
+   return err;
+}
+
 static int operator_optional(buffer_t* buffer)
 {
    int err;
@@ -252,6 +325,64 @@ static test_errortimer_t   s_regex_errtimer = test_errortimer_FREE;
 
 // group: parsing
 
+/* function: parse_count
+ * Liest eine Dezimalzahl zwischen minvalue und <automat_MAXREPEAT>. */
+static int parse_count(buffer_t* buffer, size_t minvalue, /*out*/size_t* count)
+{
+   uint8_t next = read_next(buffer);
+   size_t  value = 0;
+
+   if (next < '0' || next > '9') {
+      return ERR_EXPECT_OR_UNMATCHED(buffer, "<number>", next, next == ' ');
+   }
+   for (;;) {
+      value = 10 * value + (size_t) (next - '0');
+      if (value > automat_MAXREPEAT) {
+         return ERR_EXPECT_OR_UNMATCHED(buffer, "<number <= 1000>", next, false);
+      }
+      uint8_t digit = peek_next(buffer);
+      if (digit < '0' || digit > '9') break;
+      skip_next(buffer);
+      next = digit;
+   }
+   if (value < minvalue) {
+      return ERR_EXPECT_OR_UNMATCHED(buffer, "<number >= min>", next, false);
+   }
+
+   *count = value;
+   return 0;
+}
+
+/* function: parse_repeatrange
+ * Liest die Anzahl Wiederholungen "m}", "m,}" bzw. "m,n}" nach einem '{'.
+ * Für "m,}" wird in maxcount <automat_REPEATINF> zurückgegeben. */
+static int parse_repeatrange(buffer_t* buffer, /*out*/size_t* mincount, /*out*/size_t* maxcount)
+{
+   int err;
+   uint8_t next;
+
+   err = parse_count(buffer, 0, mincount);
+   if (err) return err;
+   *maxcount = *mincount;
+
+   next = read_next(buffer);
+   if (next == ',') {
+      if (peek_next(buffer) == '}') {
+         *maxcount = automat_REPEATINF;
+      } else {
+         err = parse_count(buffer, *mincount, maxcount);
+         if (err) return err;
+      }
+      next = read_next(buffer);
+   }
+
+   if (next != '}') {
+      return ERR_EXPECT_OR_UNMATCHED(buffer, "}", next, next == ' ');
+   }
+
+   return 0;
+}
+
 /* function: parse_atom
  * Erwartet wird mindestens ein Zeichen.
  * '.', '[' und '(' und '\\' werden gesondert behandelt. */
@@ -266,6 +397,7 @@ static int parse_atom(buffer_t* buffer)
       err = initempty_automat(&buffer->result, &buffer->mman);
       if (err) goto ONERR;
    } else if (next == '(') {
+      const unsigned group = ++ buffer->nrgroup;
       err = parse_regexpr(buffer);
       if (err) goto ONERR;
       next = read_next(buffer);
@@ -273,6 +405,10 @@ static int parse_atom(buffer_t* buffer)
          err = ERR_EXPECT_OR_UNMATCHED(buffer, ")", next, next == ' ');
          goto ONERR;
       }
+      if (istag_buffer(buffer, group)) {
+         err = operator_tag(buffer, group);
+         if (err) goto ONERR;
+      }
    } else if (next == '[') {
       bool isFirst = true;
       bool isNot = (peek_next(buffer) == '^');
@@ -353,12 +489,13 @@ static int parse_sequence(buffer_t* buffer)
          next = peek_next(buffer);
       }
 
-      if (next == '*' || next == '+' || next == '|' || next == '&' || next == ')' || next == ']' || next == '?') {
+      if (next == '*' || next == '+' || next == '|' || next == '&' || next == ')' || next == ']' || next == '?' || next == '{') {
          skip_next(buffer);
          err = ERR_EXPECT_OR_UNMATCHED(buffer, "<char>", next, false);
          goto ONERR;
       }
 
+      const unsigned firstgroup = buffer->nrgroup;
       err = parse_atom(buffer);
       if (err) goto ONERR;
 
@@ -373,9 +510,19 @@ static int parse_sequence(buffer_t* buffer)
          err = operator_optional(buffer);
          if (err) goto ONERR;
          next = peek_next(buffer);
+      } else if (next == '{') {
+         size_t mincount, maxcount;
+         skip_next(buffer);
+         err = parse_repeatrange(buffer, &mincount, &maxcount);
+         if (err) goto ONERR;
+         err = oprepeatrange_automat(&buffer->result, mincount, maxcount);
+         if (err) goto ONERR;
+         next = peek_next(buffer);
       }
 
       if (isNot) {
+         // groups of negated atom are not captured
+         marknotag_buffer(buffer, firstgroup);
          err = opnot_automat(&buffer->result);
          if (err) goto ONERR;
       }
@@ -407,6 +554,8 @@ static int parse_regexpr(buffer_t* buffer)
    int err;
    uint8_t op = 0;
    uint8_t next = peek_next(buffer);
+   bool    isAnd = false;
+   const unsigned firstgroup = buffer->nrgroup;
    automat_t regexresult;
 
    for (;;) {
@@ -442,6 +591,7 @@ static int parse_regexpr(buffer_t* buffer)
          next = peek_next(buffer);
       } else if (next == '&') {
          op = next;
+         isAnd = true;
          skip_next(buffer);
          if (isnext_memstream(&buffer->input) && *next_memstream(&buffer->input) == '!') {
             op = '!';
@@ -455,6 +605,11 @@ static int parse_regexpr(buffer_t* buffer)
 
    initmove_automat(&buffer->result, &regexresult);
 
+   if (isAnd) {
+      // groups of operands of '&' and '&!' are not captured
+      marknotag_buffer(buffer, firstgroup);
+   }
+
    return 0;
 ONERR:
    if (op) {
@@ -470,6 +625,9 @@ int free_regexpr(regexpr_t* regex)
    int err;
 
    err = free_automat(&regex->matcher);
+   int err2 = free_automat(&regex->capture);
+   if (err2) err = err2;
+   regex->nrgroup = 0;
    PROCESS_testerrortimer(&s_regex_errtimer, &err);
    if (err) goto ONERR;
 
@@ -479,11 +637,125 @@ ONERR:
    return err;
 }
 
+/* function: parse_definition
+ * Analysiert definition[0..len-1] und speichert den erzeugten Automaten in buffer->result.
+ * Der Speicher wird vom Heap von buffer->mman allokiert. */
+static int parse_definition(buffer_t* buffer, size_t len, const char definition[len])
+{
+   int err;
+
+   buffer->input  = (memstream_ro_t) memstream_INIT((const uint8_t*)definition, (const uint8_t*)definition + len);
+   buffer->result = (automat_t) automat_FREE;
+   buffer->nrgroup = 0;
+
+   if (!PROCESS_testerrortimer(&s_regex_errtimer, &err)) {
+      err = parse_regexpr(buffer);
+   }
+   if (err) goto ONERR;
+
+   uint8_t next = read_next(buffer);
+   if (next != ' ') {
+      err = ERR_EXPECT_OR_UNMATCHED(buffer, 0, next, false);
+      goto ONERR;
+   }
+
+   return 0;
+ONERR:
+   (void) free_automat(&buffer->result);
+   return err;
+}
+
+/* function: build_regexpr
+ * Implementiert <init_regexpr> (isCapture == false) und <initcapture_regexpr> (isCapture == true). */
+static int build_regexpr(/*out*/regexpr_t* regex, size_t len, const char definition[len], bool isCapture, /*err*/regexpr_err_t *errdescr)
+{
+   int err;
+   int isBuffer = 0;
+   buffer_t  buffer;
+   automat_t plain   = automat_FREE;
+   automat_t tagged  = automat_FREE;
+   automat_t capture = automat_FREE;
+
+   if (!PROCESS_testerrortimer(&s_regex_errtimer, &err)) {
+      err = init_buffer(&buffer, len, definition);
+   }
+   if (err) goto ONERR;
+
+   buffer.result = (automat_t) automat_FREE;
+   isBuffer = 1;
+
+   err = parse_definition(&buffer, len, definition);
+   if (err) goto ONERR;
+   initmove_automat(&plain, &buffer.result);
+
+   const unsigned nrgroup = ! isCapture ? 0 : buffer.nrgroup < regexpr_MAXGROUP ? buffer.nrgroup : regexpr_MAXGROUP;
+   if (isCapture && hastag_buffer(&buffer)) {
+      // parse again and mark groups with tags (buffer.notag is set by first pass)
+      buffer.isTag = true;
+      err = parse_definition(&buffer, len, definition);
+      if (err) goto ONERR;
+      initmove_automat(&tagged, &buffer.result);
+   }
+
+   err = free_buffer(&buffer);
+   PROCESS_testerrortimer(&s_regex_errtimer, &err);
+   if (err) goto ONERR;
+
+   err = minimize_automat(&plain);
+   PROCESS_testerrortimer(&s_regex_errtimer, &err);
+   if (err) goto ONERR;
+
+   if (! isfree_automat(&tagged)) {
+      // matchtags_automat expects DFA of reversed language
+      err = initreverse_automat(&capture, &tagged, 0);
+      if (err) goto ONERR;
+      err = free_automat(&tagged);
+      if (err) goto ONERR;
+      err = minimize_automat(&capture);
+      PROCESS_testerrortimer(&s_regex_errtimer, &err);
+      if (err) goto ONERR;
+   }
+
+   // set out
+   regex->matcher = plain;
+   regex->capture = capture;
+   regex->nrgroup = (uint8_t) nrgroup;
+
+   return 0;
+ONERR:
+   if (errdescr && (err == ESYNTAX || err == EILSEQ)) {
+      *errdescr = buffer.err;
+   }
+
+   (void) free_automat(&plain);
+   (void) free_automat(&tagged);
+   (void) free_automat(&capture);
+   if (isBuffer) {
+      (void) free_automat(&buffer.result);
+      (void) free_buffer(&buffer);
+   }
+   if (err != ESYNTAX && err != EILSEQ) {
+      TRACEEXIT_ERRLOG(err);
+   }
+   return err;
+}
+
 int init_regexpr(/*out*/regexpr_t* regex, size_t len, const char definition[len], /*err*/regexpr_err_t *errdescr)
+{
+   return build_regexpr(regex, len, definition, false, errdescr);
+}
+
+int initcapture_regexpr(/*out*/regexpr_t* regex, size_t len, const char definition[len], /*err*/regexpr_err_t *errdescr)
+{
+   return build_regexpr(regex, len, definition, true, errdescr);
+}
+
+int initnfa_regexpr(/*out*/automat_t* ndfa, size_t len, const char definition[len], /*err*/regexpr_err_t *errdescr)
 {
    int err;
    int isBuffer = 0;
-   buffer_t buffer;
+   buffer_t  buffer = { .err = { .type = 0 } }; // ONERR reads buffer.err also if init_buffer fails
+   automat_t plain = automat_FREE;
 
    if (!PROCESS_testerrortimer(&s_regex_errtimer, &err)) {
       err = init_buffer(&buffer, len, definition);
@@ -493,34 +765,87 @@ int init_regexpr(/*out*/regexpr_t* regex, size_t len, const char definition[len]
    buffer.result = (automat_t) automat_FREE;
    isBuffer = 1;
 
+   err = parse_definition(&buffer, len, definition);
+   if (err) goto ONERR;
+   initmove_automat(&plain, &buffer.result);
+
+   err = free_buffer(&buffer);
+   PROCESS_testerrortimer(&s_regex_errtimer, &err);
+   if (err) goto ONERR;
+
+   // set out
+   initmove_automat(ndfa, &plain);
+
+   return 0;
+ONERR:
+   if (errdescr && (err == ESYNTAX || err == EILSEQ)) {
+      *errdescr = buffer.err;
+   }
+
+   (void) free_automat(&plain);
+   if (isBuffer) {
+      (void) free_automat(&buffer.result);
+      (void) free_buffer(&buffer);
+   }
+   if (err != ESYNTAX && err != EILSEQ) {
+      TRACEEXIT_ERRLOG(err);
+   }
+   return err;
+}
+
+int initset_regexpr(/*out*/regexpr_t* regex, size_t nrregex, const size_t len[nrregex], const char* const definition[nrregex], /*err*/regexpr_err_t *errdescr)
+{
+   int err;
+   int isBuffer = 0;
+   size_t    i  = 0;
+   buffer_t  buffer;
+   automat_t all = automat_FREE;
+
+   VALIDATE_INPARAM_TEST(0 < nrregex && nrregex-1 <= automat_MAXMATCHID, ONERR, );
+
    if (!PROCESS_testerrortimer(&s_regex_errtimer, &err)) {
-      err = parse_regexpr(&buffer);
+      err = init_buffer(&buffer, len[0], definition[0]);
    }
    if (err) goto ONERR;
 
-   uint8_t next = read_next(&buffer);
-   if (next != ' ') {
-      err = ERR_EXPECT_OR_UNMATCHED(&buffer, 0, next, false);
-      goto ONERR;
+   buffer.result = (automat_t) automat_FREE;
+   isBuffer = 1;
+
+   for (; i < nrregex; ++i) {
+      err = parse_definition(&buffer, len[i], definition[i]);
+      if (err) goto ONERR;
+      err = opmatchid_automat(&buffer.result, (uint32_t)i);
+      if (err) goto ONERR;
+      if (i) {
+         err = opor_automat(&all, &buffer.result);
+         if (err) goto ONERR;
+      } else {
+         initmove_automat(&all, &buffer.result);
+      }
    }
 
+   isBuffer = 0;
    err = free_buffer(&buffer);
    PROCESS_testerrortimer(&s_regex_errtimer, &err);
    if (err) goto ONERR;
 
-   err = minimize_automat(&buffer.result);
+   err = minimize_automat(&all);
    PROCESS_testerrortimer(&s_regex_errtimer, &err);
    if (err) goto ONERR;
 
    // set out
-   regex->matcher = buffer.result;
+   regex->matcher = all;
+   regex->capture = (automat_t) automat_FREE;
+   regex->nrgroup = 0;
 
    return 0;
 ONERR:
    if (errdescr && (err == ESYNTAX || err == EILSEQ)) {
       *errdescr = buffer.err;
+      errdescr->index = i;
    }
 
+   (void) free_automat(&all);
    if (isBuffer) {
       (void) free_automat(&buffer.result);
       (void) free_buffer(&buffer);
@@ -530,3 +855,294 @@ ONERR:
    }
    return err;
 }
+
+// group: query
+
+int matchcapture_regexpr(const regexpr_t* regex, automat_scratch_t* scratch, size_t len, const char32_t str[len], size_t nrgroup, /*out*/size_t start[nrgroup], /*out*/size_t end[nrgroup])
+{
+   int err;
+   automat_matcher_t matcher;
+   size_t matchedlen;
+   size_t nrtag = 0;
+   size_t tagpos[2*(regexpr_MAXGROUP+1)];
+
+   err = init_automatmatcher(&matcher, &regex->matcher, true);
+   if (err) goto ONERR;
+   feed_automatmatcher(&matcher, len, str);
+   err = finish_automatmatcher(&matcher, &matchedlen);
+   if (err) return err;
+
+   if (! isfree_automat(&regex->capture)) {
+      nrtag = 2 * ((size_t)regex->nrgroup + 1);
+      err = matchtags_automat(&regex->capture, scratch, matchedlen, str, group_TAGCHAR(0, 0), nrtag, tagpos);
+      if (err) goto ONERR;
+   }
+
+   for (size_t g = 0; g < nrgroup; ++g) {
+      if (g == 0) {
+         start[0] = 0;
+         end[0]   = matchedlen;
+      } else if (2*g < nrtag && tagpos[2*g] != SIZE_MAX) {
+         start[g] = tagpos[2*g];
+         end[g]   = tagpos[2*g+1];
+      } else {
+         start[g] = SIZE_MAX;
+         end[g]   = SIZE_MAX;
+      }
+   }
+
+   return 0;
+ONERR:
+   TRACEEXIT_ERRLOG(err);
+   return err;
+}
+
+
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+
+/* function: helper_match
+ * Liefert die Länge der längsten Übereinstimmung von regex am Anfang von str. */
+static size_t helper_match(const regexpr_t* regex, const char32_t* str)
+{
+   size_t len = 0;
+   while (str[len]) ++len;
+   return matchchar32_automat(&regex->matcher, len, str, true);
+}
+
+static int test_initfree(void)
+{
+   regexpr_t     regex = regexpr_FREE;
+   regexpr_err_t errdescr;
+   const char*   definition;
+   int           err;
+
+   // TEST regexpr_FREE
+   TEST( isfree_automat(&regex.matcher));
+   TEST( isfree_automat(&regex.capture));
+   TEST( 0 == regex.nrgroup);
+
+   // TEST init_regexpr
+   TEST( 0 == init_regexpr(&regex, 3, "abc", 0));
+   TEST( ! isfree_automat(&regex.matcher));
+   TEST( isfree_automat(&regex.capture));
+   TEST( 1 == nrgroup_regexpr(&regex));
+   TEST( 3 == helper_match(&regex, U"abcd"));
+   TEST( 0 == helper_match(&regex, U"ab"));
+
+   // TEST free_regexpr: double free
+   TEST( 0 == free_regexpr(&regex));
+   TEST( isfree_automat(&regex.matcher));
+   TEST( isfree_automat(&regex.capture));
+   TEST( 0 == free_regexpr(&regex));
+
+   // TEST init_regexpr: ESYNTAX
+   definition = "(ab";
+   TEST( ESYNTAX == init_regexpr(&regex, strlen(definition), definition, &errdescr));
+   TEST( isfree_automat(&regex.matcher));
+   TEST( 1 == errdescr.type/*end of input*/);
+   TEST( 0 == errdescr.index);
+   definition = "a{3,2}";
+   TEST( ESYNTAX == init_regexpr(&regex, strlen(definition), definition, &errdescr));
+   TEST( definition < errdescr.pos && errdescr.pos <= definition + strlen(definition));
+
+   // TEST init_regexpr: EILSEQ
+   definition = "a\xC0";
+   TEST( EILSEQ == init_regexpr(&regex, strlen(definition), definition, &errdescr));
+   TEST( isfree_automat(&regex.matcher));
+
+   // TEST init_regexpr, initcapture_regexpr, initnfa_regexpr: simulated error
+   for (unsigned iscapture = 0; iscapture <= 2; ++iscapture) {
+      definition = "(a|b)+ &! ab";
+      for (unsigned i = 1; ; ++i) {
+         automat_t ndfa = automat_FREE;
+         init_testerrortimer(&s_regex_errtimer, i, ENOMEM);
+         err = iscapture == 2 ? initnfa_regexpr(&ndfa, strlen(definition), definition, &errdescr)
+             : iscapture      ? initcapture_regexpr(&regex, strlen(definition), definition, &errdescr)
+             :                  init_regexpr(&regex, strlen(definition), definition, &errdescr);
+         if (! err) {
+            // timer did not fire: all error paths were tested
+            TEST( isenabled_testerrortimer(&s_regex_errtimer));
+            TEST( 0 == free_automat(&ndfa));
+            break;
+         }
+         TESTP( ENOMEM == err, "iscapture=%u i=%u err=%d", iscapture, i, err);
+         TEST( isfree_automat(&ndfa));
+         TEST( isfree_automat(&regex.matcher));
+         TEST( isfree_automat(&regex.capture));
+      }
+      free_testerrortimer(&s_regex_errtimer);
+      TEST( 0 == free_regexpr(&regex));
+   }
+
+   return 0;
+ONERR:
+   free_testerrortimer(&s_regex_errtimer);
+   free_regexpr(&regex);
+   return EINVAL;
+}
+
+static int test_syntax(void)
+{
+   regexpr_t regex = regexpr_FREE;
+   static const struct {
+      const char*     definition;
+      const char32_t* str;
+      size_t          matchedlen;
+   } testcase[] = {
+      { "a+b+c+ &! abbc",            U"abbc",    0 },
+      { "a+b+c+ &! abbc",            U"aabbbcc", 7 },
+      { "[a-zA-Z0-9_]+ &! [0-9].*",  U"1_",      0 },
+      { "[a-zA-Z0-9_]+ &! [0-9].*",  U"_1Za",    4 },
+      { "[^0-9]+",                   U"ab1",     2 },
+      { "(a|bc)*",                   U"abcbca",  6 },
+      { "a? b",                      U"b",       1 },
+      { "a\\ b",                     U"a b",     3 },
+      { "[a-z] & x",                 U"x",       1 },
+      { "[a-z] & x",                 U"y",       0 },
+      { "!a",                        U"b",       1 },
+      { ".*",                        U"\n\x7fffffff", 2 },
+      { "a{2}",                      U"aaa",     2 },
+      { "a{2,}",                     U"aaaa",    4 },
+      { "a{2,}",                     U"a",       0 },
+      { "[0-9]{1,3}",                U"12345",   3 },
+      { "(ab){0,2}c",                U"ababc",   5 },
+      { "(ab){0,2}c",                U"abababc", 0 },
+      { "äö|東京",                    U"東京",     2 },
+   };
+
+   // TEST init_regexpr: language of definition
+   for (unsigned i = 0; i < lengthof(testcase); ++i) {
+      TESTP( 0 == init_regexpr(&regex, strlen(testcase[i].definition), testcase[i].definition, 0), "i=%u", i);
+      TESTP( testcase[i].matchedlen == helper_match(&regex, testcase[i].str), "i=%u", i);
+      TEST( 0 == free_regexpr(&regex));
+   }
+
+   // TEST initnfa_regexpr: same language as init_regexpr
+   for (unsigned i = 0; i < lengthof(testcase); ++i) {
+      automat_t ndfa = automat_FREE;
+      TEST( 0 == initnfa_regexpr(&ndfa, strlen(testcase[i].definition), testcase[i].definition, 0));
+      TEST( 0 == minimize_automat(&ndfa));
+      size_t len = 0;
+      while (testcase[i].str[len]) ++len;
+      TESTP( testcase[i].matchedlen == matchchar32_automat(&ndfa, len, testcase[i].str, true), "i=%u", i);
+      TEST( 0 == free_automat(&ndfa));
+   }
+
+   return 0;
+ONERR:
+   free_regexpr(&regex);
+   return EINVAL;
+}
+
+static int test_set(void)
+{
+   regexpr_t     regex = regexpr_FREE;
+   regexpr_err_t errdescr;
+   const char*   rules[3] = { "[0-9]+", "[a-z]+[0-9]*", "a.*" };
+   const size_t  len[3]   = { strlen(rules[0]), strlen(rules[1]), strlen(rules[2]) };
+   bool          ismatch[3];
+
+   // TEST initset_regexpr
+   TEST( 0 == initset_regexpr(&regex, 3, len, rules, &errdescr));
+   TEST( 1 == nrgroup_regexpr(&regex));
+   TEST( 2 == matchids_automat(&regex.matcher, 4, U"abc1", 3, ismatch));
+   TEST( !ismatch[0] && ismatch[1] && ismatch[2]);
+   TEST( 1 == matchids_automat(&regex.matcher, 3, U"123", 3, ismatch));
+   TEST( ismatch[0] && !ismatch[1] && !ismatch[2]);
+   TEST( 0 == matchids_automat(&regex.matcher, 2, U"_a", 3, ismatch));
+   TEST( 0 == free_regexpr(&regex));
+
+   // TEST initset_regexpr: EINVAL
+   TEST( EINVAL == initset_regexpr(&regex, 0, len, rules, &errdescr));
+   TEST( isfree_automat(&regex.matcher));
+
+   // TEST initset_regexpr: ESYNTAX in second definition
+   rules[1] = "[a-z";
+   const size_t len2[3] = { len[0], strlen(rules[1]), len[2] };
+   TEST( ESYNTAX == initset_regexpr(&regex, 3, len2, rules, &errdescr));
+   TEST( 1 == errdescr.index);
+   TEST( rules[1] <= errdescr.pos && errdescr.pos <= rules[1] + len2[1]);
+   TEST( isfree_automat(&regex.matcher));
+
+   return 0;
+ONERR:
+   free_regexpr(&regex);
+   return EINVAL;
+}
+
+static int test_capture(void)
+{
+   regexpr_t         regex   = regexpr_FREE;
+   automat_scratch_t scratch = automat_scratch_FREE;
+   size_t            start[4];
+   size_t            end[4];
+   const char*       definition;
+
+   // TEST matchcapture_regexpr: ambiguous split, front group gets longer match
+   definition = "(a*)(a*)";
+   TEST( 0 == initcapture_regexpr(&regex, strlen(definition), definition, 0));
+   TEST( 3 == nrgroup_regexpr(&regex));
+   TEST( 0 == matchcapture_regexpr(&regex, &scratch, 3, U"aab", 3, start, end));
+   TEST( 0 == start[0] && 2 == end[0]);
+   TEST( 0 == start[1] && 2 == end[1]);
+   TEST( 2 == start[2] && 2 == end[2]);
+   TEST( 0 == free_regexpr(&regex));
+
+   // TEST matchcapture_regexpr: last repetition, group not taking part
+   definition = "((ab)|c)+(x)?";
+   TEST( 0 == initcapture_regexpr(&regex, strlen(definition), definition, 0));
+   TEST( 4 == nrgroup_regexpr(&regex));
+   TEST( 0 == matchcapture_regexpr(&regex, &scratch, 6, U"cabab!", 4, start, end));
+   TEST( 0 == start[0] && 5 == end[0]);
+   TEST( 3 == start[1] && 5 == end[1]);
+   TEST( 3 == start[2] && 5 == end[2]);
+   TEST( SIZE_MAX == start[3] && SIZE_MAX == end[3]);
+   TEST( ESRCH == matchcapture_regexpr(&regex, &scratch, 1, U"x", 4, start, end));
+   TEST( 0 == free_regexpr(&regex));
+
+   // TEST matchcapture_regexpr: init_regexpr does not capture groups
+   TEST( 0 == init_regexpr(&regex, strlen(definition), definition, 0));
+   TEST( 1 == nrgroup_regexpr(&regex));
+   TEST( isfree_automat(&regex.capture));
+   TEST( 0 == matchcapture_regexpr(&regex, &scratch, 3, U"abx", 3, start, end));
+   TEST( 0 == start[0] && 3 == end[0]);
+   TEST( SIZE_MAX == start[1] && SIZE_MAX == end[1]);
+   TEST( SIZE_MAX == start[2] && SIZE_MAX == end[2]);
+   TEST( 0 == free_regexpr(&regex));
+
+   // TEST matchcapture_regexpr: groups below "&!" are not captured
+   definition = "(a+) &! aa";
+   TEST( 0 == initcapture_regexpr(&regex, strlen(definition), definition, 0));
+   TEST( 0 == matchcapture_regexpr(&regex, &scratch, 3, U"aaa", 2, start, end));
+   TEST( 0 == start[0] && 3 == end[0]);
+   TEST( SIZE_MAX == start[1] && SIZE_MAX == end[1]);
+   TEST( 0 == free_regexpr(&regex));
+
+   // TEST matchcapture_regexpr: EINVAL
+   TEST( EINVAL == matchcapture_regexpr(&regex, &scratch, 1, U"a", 1, start, end));
+
+   TEST( 0 == free_automatscratch(&scratch));
+
+   return 0;
+ONERR:
+   free_regexpr(&regex);
+   free_automatscratch(&scratch);
+   return EINVAL;
+}
+
+int unittest_proglang_regexpr()
+{
+   if (test_initfree())    goto ONERR;
+   if (test_syntax())      goto ONERR;
+   if (test_set())         goto ONERR;
+   if (test_capture())     goto ONERR;
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+#endif
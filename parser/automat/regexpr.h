@@ -46,6 +46,9 @@ typedef struct regexpr_err_t {
    const char* pos;
    const char* expect;
    char        unexpected[8];
+   /* variable: index
+    * Index der fehlerhaften Definition bei <initset_regexpr>, sonst immer 0. */
+   size_t      index;
 } regexpr_err_t;
 
 // group: log
@@ -66,11 +69,12 @@ void log_regexprerr(const regexpr_err_t *err, uint8_t channel);
  * > re   = seq? ( ( '|' | '&' | '&!' ) seq? )* ;
  * > seq  = ( not? atom repeat? )+ ;
  * > not  = '!' ; // operator not is applied after repeat operator
- * > repeat = ( '*' | '+' | '?' ) ; // operator repeat is applied before possible not operator
+ * > repeat = ( '*' | '+' | '?' | '{' count ( ',' count? )? '}' ) ; // operator repeat is applied before possible not operator
+ * > count  = ( '0' | '1' | ... | '9' )+ ; // 0 <= count <= automat_MAXREPEAT
  * > atom = '(' re ')' | char | set ;
  * > set  = '[' '^'? ( char ( '-' char )? )+ ']' ; // ^ == match not the chars definied in the set
  * > char = '.' | no-special-char | '\' ( special-char | control-code ) ;
- * > special-char = '.' | '[' | ']' | '(' | ')' | '*' | '+' | '|' | '&' | ' ';
+ * > special-char = '.' | '[' | ']' | '(' | ')' | '*' | '+' | '|' | '&' | '{' | ' ';
  * > control-code = 'n' | 'r' | 't' ;
  * > no-special-char = 'a' | 'A' | 'b' | 'B' ...
  *
@@ -95,6 +99,13 @@ void log_regexprerr(const regexpr_err_t *err, uint8_t channel);
  * - Der String "a+" erzeugt die Eingabesprache "a", "aa", "aaa", usw.
  * - Der String "a?" erzeugt die Eingabesprache "" bzw. "a".
  *
+ * Mit "{m}", "{m,}" und "{m,n}" wird das Atom genau m mal, mindestens m mal bzw.
+ * mindestens m und höchstens n mal wiederholt (siehe <oprepeatrange_automat>).
+ *
+ * - Der String "a{2}" erzeugt die Eingabesprache "aa".
+ * - Der String "a{2,}" erzeugt die Eingabesprache "aa", "aaa", "aaaa", usw.
+ * - Der String "[0-9]{1,3}" erzeugt die Eingabesprache aus ein bis drei Ziffern.
+ *
  * Die Regel "atom =" definiert eine Menge (set), einen einzelnen Buchstaben (char)
  * bzw. einen weiteren regulären Ausdruck der in '(' und ')' eingeschlossen ist.
  * Der String "(a|b)" definiert also die Sprache "a" bzw. "b", die Klammern dienen
@@ -121,17 +132,34 @@ void log_regexprerr(const regexpr_err_t *err, uint8_t channel);
  * Leerzeichen werden immer überlesen und sie können zur besseren Lesbarkeit überall
  * eingestreut werden. Nur Leerezeichen, die mit "\\" maskiert wurden, werden als
  * normales Eingabezeichen verstanden.
+ *
+ * Gruppen:
+ * Jedes Klammerpaar "(" re ")" bildet eine Gruppe. Die Gruppen werden in der Reihenfolge
+ * ihrer öffnenden Klammer ab 1 nummeriert, Gruppe 0 ist die gesamte Übereinstimmung.
+ * Wird regex mit <initcapture_regexpr> erzeugt, liefert <matchcapture_regexpr> die Position jeder
+ * Gruppe innerhalb der Eingabe. <init_regexpr> erfasst keine Gruppen.
+ * Gruppen innerhalb eines mit "!" negierten Atoms und Gruppen innerhalb eines Ausdrucks,
+ * der "&" oder "&!" verwendet, werden nicht erfasst, da ihnen keine eindeutige Position
+ * im Eingabetext entspricht. Ebenso werden nur die ersten <regexpr_MAXGROUP> Gruppen erfasst.
  * */
 typedef struct regexpr_t {
    automat_t matcher;
+   automat_t capture;   // reversed DFA with tags marking start and end of groups (see <matchtags_automat>)
+   uint8_t   nrgroup;   // number of groups without group 0 (at most regexpr_MAXGROUP)
 } regexpr_t;
 
+// group: constants
+
+/* define: regexpr_MAXGROUP
+ * Die größte Gruppennummer, die von <matchcapture_regexpr> erfasst wird. */
+#define regexpr_MAXGROUP 64
+
 // group: lifetime
 
 /* define: regexpr_FREE
  * Static initializer. */
 #define regexpr_FREE \
-         { automat_FREE }
+         { automat_FREE, automat_FREE, 0 }
 
 /* function: init_regexpr
  * Initiailisiert regex mit der strukturelle Repräsentation des durch definition in Textform definierten regulären Ausdrucks.
@@ -152,19 +180,90 @@ typedef struct regexpr_t {
  * ESYNTAX - definition[len] contains a syntax error (error is not logged), errdescr is set.
  * EILSEQ  - definition[len] contains an illegaly encoded utf8 character (error is not logged).
  *           errdescr is set.
+ *
+ * Gruppen werden nicht erfasst, <nrgroup_regexpr> liefert 1. Siehe <initcapture_regexpr>.
  * */
 int init_regexpr(/*out*/regexpr_t* regex, size_t len, const char definition[len], /*err*/regexpr_err_t *errdescr);
 
+/* function: initcapture_regexpr
+ * Wie <init_regexpr>, erfasst aber zusätzlich die Gruppen von definition.
+ * Enthält definition Gruppen, wird ein zweiter Automat für <matchcapture_regexpr> erzeugt.
+ * Das kostet zusätzliche Übersetzungszeit und Speicher, daher muss es explizit angefordert werden.
+ *
+ * Returns:
+ * Siehe <init_regexpr>. */
+int initcapture_regexpr(/*out*/regexpr_t* regex, size_t len, const char definition[len], /*err*/regexpr_err_t *errdescr);
+
+/* function: initset_regexpr
+ * Übersetzt nrregex reguläre Ausdrücke in einen einzigen Automaten.
+ * Jeder Ausdruck definition[i] der Länge len[i] wird mit der Muster-ID i markiert (siehe <opmatchid_automat>),
+ * danach werden alle Automaten mit "|" verbunden und der Ergebnisautomat wird minimiert.
+ * Mit <matchids_automat>(&regex->matcher, ...) werden dann alle Ausdrücke in einem einzigen
+ * Durchlauf geprüft. <matchchar32_automat> erkennt mit diesem Automaten keine Eingabe.
+ *
+ * Returns:
+ * EINVAL  - nrregex == 0 or nrregex-1 > <automat_MAXMATCHID>.
+ * ESYNTAX - One definition contains a syntax error (error is not logged), errdescr is set.
+ *           errdescr->pos points into the erroneous definition, errdescr->index is its index.
+ * EILSEQ  - One definition contains an illegaly encoded utf8 character (error is not logged).
+ *           errdescr is set, errdescr->index is the index of the erroneous definition.
+ *
+ * Gruppen werden nicht erfasst, <nrgroup_regexpr> liefert 1.
+ * */
+int initset_regexpr(/*out*/regexpr_t* regex, size_t nrregex, const size_t len[nrregex], const char* const definition[nrregex], /*err*/regexpr_err_t *errdescr);
+
+/* function: initnfa_regexpr
+ * Übersetzt definition nur in einen nicht-deterministischen Automaten ndfa, wie er von <init_regexpr>
+ * vor dem Aufruf von <minimize_automat> erzeugt wird. Gruppen werden nicht markiert.
+ * Dient dazu, die Schritte der Übersetzung einzeln zu messen oder den Automaten selbst weiterzuverarbeiten.
+ *
+ * Returns:
+ * ESYNTAX - definition[len] contains a syntax error (error is not logged), errdescr is set.
+ * EILSEQ  - definition[len] contains an illegaly encoded utf8 character (error is not logged).
+ *           errdescr is set. */
+int initnfa_regexpr(/*out*/automat_t* ndfa, size_t len, const char definition[len], /*err*/regexpr_err_t *errdescr);
+
 /* function: free_regexpr
  * Gibt von regex belegten Speicher frei. */
 int free_regexpr(regexpr_t* regex);
 
 // group: query
 
-// TODO: add query functions to regexpr_t
+/* function: nrgroup_regexpr
+ * Liefert die Anzahl der Gruppen inklusive Gruppe 0, höchstens <regexpr_MAXGROUP>+1. */
+static inline size_t nrgroup_regexpr(const regexpr_t* regex);
+
+/* function: matchcapture_regexpr
+ * Sucht wie <matchchar32_automat>(&regex->matcher, len, str, true) die längste Übereinstimmung
+ * am Anfang von str und liefert zusätzlich die Position der Gruppen.
+ * Gruppe g umfasst str[start[g]..end[g]-1], start[0] == 0 und end[0] ist die Länge der Übereinstimmung.
+ * Für eine Gruppe, die nicht erfasst wird oder an der Übereinstimmung nicht beteiligt ist,
+ * wird start[g] == end[g] == SIZE_MAX gesetzt. Wird eine Gruppe wiederholt, gilt die letzte Wiederholung.
+ * Ist die Zerlegung mehrdeutig, erhalten vordere Gruppen die längere Übereinstimmung,
+ * d.h. "(a*)(a*)" liefert für "aa" die Gruppen 1 == "aa" und 2 == "".
+ *
+ * Es werden zwei DFAs nacheinander verwendet: regex->matcher ermittelt das Ende der Übereinstimmung,
+ * danach ermittelt <matchtags_automat> mit regex->capture die Gruppen. Es gibt kein Backtracking,
+ * die Laufzeit ist linear in der Länge der Übereinstimmung.
+ * Der Speicher für die Rekonstruktion wird von scratch belegt, das für weitere Aufrufe
+ * wiederverwendet werden sollte. Wurde regex mit <init_regexpr> erzeugt, wird scratch nicht benutzt.
+ *
+ * Returns:
+ * 0      - Übereinstimmung gefunden, start[0..nrgroup-1] und end[0..nrgroup-1] sind gesetzt.
+ * ESRCH  - Keine Übereinstimmung (error is not logged).
+ * EINVAL - regex ist nicht initialisiert.
+ * ENOMEM - scratch konnte für die Rekonstruktion der Gruppen nicht vergrößert werden. */
+int matchcapture_regexpr(const regexpr_t* regex, struct automat_scratch_t* scratch, size_t len, const char32_t str[len], size_t nrgroup, /*out*/size_t start[nrgroup], /*out*/size_t end[nrgroup]);
 
 
 // section: inline implementation
 
+/* define: nrgroup_regexpr
+ * Implements <regexpr_t.nrgroup_regexpr>. */
+static inline size_t nrgroup_regexpr(const regexpr_t* regex)
+{
+         return (size_t) regex->nrgroup + 1;
+}
+
 
 #endif
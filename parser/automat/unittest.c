@@ -0,0 +1,33 @@
+#include "config.h"
+#include "automat.h"
+#include "automat_mman.h"
+#include "memchain.h"
+#include "memstream.h"
+#include "patriciatrie.h"
+#include "regexpr.h"
+#include "utf8.h"
+#include <stdio.h>
+
+/* function: run_unittest
+ * Calls unittest and prints its name and the result. Returns 0 if the test passed. */
+static int run_unittest(const char * name, int (*unittest) (void))
+{
+   int err = unittest();
+   printf("%s: %s\n", name, err ? "FAILED" : "OK");
+   return err != 0;
+}
+
+int main()
+{
+   int nrfailed = 0;
+
+   nrfailed += run_unittest("memory_memstream", &unittest_memory_memstream);
+   nrfailed += run_unittest("memory_memchain", &unittest_memory_memchain);
+   nrfailed += run_unittest("proglang_automat_mman", &unittest_proglang_automat_mman);
+   nrfailed += run_unittest("proglang_automat", &unittest_proglang_automat);
+   nrfailed += run_unittest("proglang_regexpr", &unittest_proglang_regexpr);
+   nrfailed += run_unittest("ds_inmem_patriciatrie", &unittest_ds_inmem_patriciatrie);
+   nrfailed += run_unittest("string_utf8", &unittest_string_utf8);
+
+   return nrfailed ? 1 : 0;
+}
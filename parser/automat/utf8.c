@@ -17,7 +17,11 @@
 #include "config.h"
 #include "utf8.h"
 #include "memstream.h"
+#include "cpufeature.h"
 #include "test_errortimer.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 // section: utf8
 
@@ -188,30 +192,162 @@ uint8_t encodechar_utf8(char32_t uchar, size_t strsize, /*out*/uint8_t strstart[
    return 0;
 }
 
+size_t decode_utf8(size_t size, const uint8_t in[size], size_t out_capacity, /*out*/char32_t out[out_capacity], /*out*/size_t * consumed)
+{
+   size_t i = 0;  // offset into in
+   size_t n = 0;  // number of decoded characters
+
+#ifdef __SSE2__
+   const __m128i zero = _mm_setzero_si128();
+
+   while (i + 16 <= size && n + 16 <= out_capacity) {
+      const __m128i bytes = _mm_loadu_si128((const __m128i*) (in + i));
+      const int     mask  = _mm_movemask_epi8(bytes);
+
+      if (! mask) {
+         // 16 ASCII bytes
+         const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+         const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+         _mm_storeu_si128((__m128i*) (out + n),      _mm_unpacklo_epi16(lo, zero));
+         _mm_storeu_si128((__m128i*) (out + n + 4),  _mm_unpackhi_epi16(lo, zero));
+         _mm_storeu_si128((__m128i*) (out + n + 8),  _mm_unpacklo_epi16(hi, zero));
+         _mm_storeu_si128((__m128i*) (out + n + 12), _mm_unpackhi_epi16(hi, zero));
+         i += 16;
+         n += 16;
+         continue;
+      }
+
+      if (mask == 0xFFFF) {
+         // 8 two byte sequences: 16 bit little endian value = 0b10xxxxxx110xxxxx (first byte 0xC0, 0xC1 is invalid)
+         const __m128i istwo   = _mm_cmpeq_epi16(_mm_and_si128(bytes, _mm_set1_epi16((short)0xC0E0)), _mm_set1_epi16((short)0x80C0));
+         const __m128i isvalid = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_and_si128(bytes, _mm_set1_epi16(0x1E)), zero), istwo);
+         if (_mm_movemask_epi8(isvalid) == 0xFFFF) {
+            const __m128i first  = _mm_slli_epi16(_mm_and_si128(bytes, _mm_set1_epi16(0x1F)), 6);
+            const __m128i follow = _mm_and_si128(_mm_srli_epi16(bytes, 8), _mm_set1_epi16(0x3F));
+            const __m128i chr    = _mm_or_si128(first, follow);
+            _mm_storeu_si128((__m128i*) (out + n),     _mm_unpacklo_epi16(chr, zero));
+            _mm_storeu_si128((__m128i*) (out + n + 4), _mm_unpackhi_epi16(chr, zero));
+            i += 16;
+            n += 8;
+            continue;
+         }
+      }
+
+      // mixed block: copy leading ASCII bytes and decode a single multibyte sequence
+      for (unsigned nrascii = (unsigned) __builtin_ctz((unsigned) mask); nrascii; --nrascii) {
+         out[n++] = in[i++];
+      }
+      if (sizePfirst_utf8(in[i]) > size - i) break;
+      const uint8_t len = decodechar_utf8(in + i, &out[n]);
+      if (! len) break;
+      i += len;
+      n += 1;
+   }
+#endif
+
+   while (i < size && n < out_capacity) {
+      const unsigned len = sizePfirst_utf8(in[i]);
+      if (len > size - i) break; // incomplete sequence at end of chunk
+      if (! decodechar_utf8(in + i, &out[n])) break;
+      i += len;
+      n += 1;
+   }
+
+   *consumed = i;
+   return n;
+}
+
+size_t encode_utf8(size_t len, const char32_t in[len], size_t out_size, /*out*/uint8_t out[out_size], /*out*/size_t * consumed)
+{
+   size_t i = 0;  // number of encoded characters
+   size_t n = 0;  // offset into out
+
+#ifdef __SSE2__
+   const __m128i zero = _mm_setzero_si128();
+
+   while (i + 8 <= len && n + 16 <= out_size) {
+      const __m128i c0  = _mm_loadu_si128((const __m128i*) (in + i));
+      const __m128i c1  = _mm_loadu_si128((const __m128i*) (in + i + 4));
+      const __m128i all = _mm_or_si128(c0, c1);
+
+      if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, _mm_set1_epi32(~0x7F)), zero))) {
+         // 8 ASCII characters
+         const __m128i chr = _mm_packs_epi32(c0, c1);
+         _mm_storel_epi64((__m128i*) (out + n), _mm_packus_epi16(chr, chr));
+         i += 8;
+         n += 8;
+         continue;
+      }
+
+      if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(all, _mm_set1_epi32(~0x7FF)), zero))) {
+         // all characters <= 0x7FF (signed compare is valid)
+         const __m128i isascii = _mm_or_si128(_mm_cmplt_epi32(c0, _mm_set1_epi32(0x80)), _mm_cmplt_epi32(c1, _mm_set1_epi32(0x80)));
+         if (! _mm_movemask_epi8(isascii)) {
+            // 8 two byte sequences
+            const __m128i chr    = _mm_packs_epi32(c0, c1);
+            const __m128i first  = _mm_or_si128(_mm_srli_epi16(chr, 6), _mm_set1_epi16(0xC0));
+            const __m128i follow = _mm_or_si128(_mm_and_si128(chr, _mm_set1_epi16(0x3F)), _mm_set1_epi16(0x80));
+            _mm_storeu_si128((__m128i*) (out + n), _mm_or_si128(first, _mm_slli_epi16(follow, 8)));
+            i += 8;
+            n += 16;
+            continue;
+         }
+      }
+
+      // mixed block: encode 8 characters one at a time
+      const size_t end = i + 8;
+      for (; i < end; ++i) {
+         const uint8_t size = encodechar_utf8(in[i], out_size - n, out + n);
+         if (! size) break;
+         n += size;
+      }
+      if (i < end) break;
+   }
+#endif
+
+   for (; i < len; ++i) {
+      const uint8_t size = encodechar_utf8(in[i], out_size - n, out + n);
+      if (! size) break;
+      n += size;
+   }
+
+   *consumed = i;
+   return n;
+}
+
 size_t length_utf8(const uint8_t *strstart, const uint8_t *strend)
 {
    size_t len = 0;
 
    if (strstart < strend) {
-      const uint8_t* next = strstart;
-
-      if ((size_t)(strend - strstart) >= maxsize_utf8()) {
-         const uint8_t* end = strend - maxsize_utf8();
-         do {
-            const unsigned sizechr = sizePfirst_utf8(*next);
-            next += sizechr;
-            len  += 1;
-         } while (next <= end);
+      const size_t size = (size_t) (strend - strstart);
+      size_t       off  = 0;
+
+      // count all bytes which are not a continuation byte 0b10xxxxxx
+
+#ifdef __SSE2__
+      const __m128i mincont = _mm_set1_epi8((char)0xC0);
+      for (; off + 64 <= size; off += 64) {
+         uint64_t iscont = 0;
+         for (unsigned i = 0; i < 4; ++i) {
+            const __m128i bytes = _mm_loadu_si128((const __m128i*) (strstart + off + 16*i));
+            // signed compare: 0x80 .. 0xBF < 0xC0 (-64) and 0x00 .. 0x7F, 0xC0 .. 0xFF >= 0xC0
+            iscont |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmplt_epi8(bytes, mincont)) << (16*i);
+         }
+         len += 64 - (size_t) __builtin_popcountll(iscont);
+      }
+#endif
+
+      for (; off + sizeof(uint64_t) <= size; off += sizeof(uint64_t)) {
+         uint64_t word;
+         memcpy(&word, strstart + off, sizeof(word));
+         // bit 7 set and bit 6 cleared
+         const uint64_t iscont = word & ~(word << 1) & UINT64_C(0x8080808080808080);
+         len += sizeof(uint64_t) - (size_t) __builtin_popcountll(iscont);
       }
 
-      while (next < strend) {
-         const unsigned sizechr = sizePfirst_utf8(*next);
-         if ((size_t)(strend-next) < sizechr) {
-            next = strend;
-         } else {
-            next += sizechr;
-         }
-         ++ len;
+      for (; off < size; ++off) {
+         len += ((strstart[off] & 0xC0) != 0x80);
       }
    }
 
@@ -220,18 +356,31 @@ size_t length_utf8(const uint8_t *strstart, const uint8_t *strend)
 
 const uint8_t * find_utf8(size_t size, const uint8_t str[size], char32_t uchar)
 {
-   const uint8_t *found;
-   uint8_t        utf8[maxsize_utf8()];
-   uint8_t        len = encodechar_utf8(uchar, sizeof(utf8), utf8);
-
-   if (! len) return 0;
-
-   for (found = memchr(str, utf8[0], size); found; found += len, found = memchr(found, utf8[0], (size_t) (str + size - found))) {
-      for (unsigned i = 1; i < len; ++i) {
-         if (utf8[i] != found[i]) goto CONTINUE;
+   uint8_t utf8[maxsize_utf8()];
+   uint8_t len = encodechar_utf8(uchar, sizeof(utf8), utf8);
+   size_t  off = 0;
+
+   if (! len || len > size) return 0;
+
+   if (len == 1) return memchr(str, utf8[0], size);
+
+#ifdef __SSE2__
+   // compare first and last byte of the sequence at 16 positions and verify candidates
+   const __m128i first = _mm_set1_epi8((char)utf8[0]);
+   const __m128i last  = _mm_set1_epi8((char)utf8[len-1]);
+   for (; off + 15 + len <= size; off += 16) {
+      const __m128i bytes0 = _mm_loadu_si128((const __m128i*) (str + off));
+      const __m128i bytes1 = _mm_loadu_si128((const __m128i*) (str + off + len - 1));
+      unsigned candidate = (unsigned) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bytes0, first), _mm_cmpeq_epi8(bytes1, last)));
+      for (; candidate; candidate &= candidate - 1) {
+         const uint8_t *found = str + off + (unsigned) __builtin_ctz(candidate);
+         if (0 == memcmp(found, utf8, len)) return found;
       }
-      return found;
-      CONTINUE: ;
+   }
+#endif
+
+   for (; off + len <= size; ++off) {
+      if (str[off] == utf8[0] && 0 == memcmp(str + off, utf8, len)) return str + off;
    }
 
    return 0;
@@ -240,6 +389,197 @@ const uint8_t * find_utf8(size_t size, const uint8_t str[size], char32_t uchar)
 
 // section: utf8validator_t
 
+// group: helper
+
+/* function: backup_utf8validator
+ * Returns offset of the first byte of a multibyte sequence which starts before offset and ends after it.
+ * If there is no such sequence offset is returned. */
+static inline size_t backup_utf8validator(size_t offset, const uint8_t data[offset])
+{
+   for (unsigned i = 1; i < maxsize_utf8() && i <= offset; ++i) {
+      const uint8_t b = data[offset-i];
+      if (b < 0x80) break;       // single byte
+      if (b >= 0xC0) {           // first byte
+         if (sizePfirst_utf8(b) > i) return offset - i;
+         break;
+      }
+   }
+   return offset;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* variable: s_utf8validator_isavx2
+ * True if <validprefix_avx2> can be used. */
+cpufeature_IMPLEMENT_AVX2(utf8validator)
+
+/* function: validprefix_avx2
+ * Validates 32 bytes per step with the lookup table algorithm of Keiser and Lemire
+ * ("Validating UTF-8 In Less Than One Instruction Per Byte").
+ * Every byte pair (previous, current) is classified with three table lookups indexed by
+ * the high and low nibble of the previous byte and the high nibble of the current byte.
+ * The AND of the lookups is non zero for an invalid pair. A block of only ASCII
+ * bytes is checked with a single movemask.
+ *
+ * Differences to the published algorithm:
+ * Surrogates and values above 0x10FFFF are valid (see <validate_utf8validator>).
+ * 5 and 6 byte sequences (first byte 0xF8 .. 0xFD) are not handled and reported as error.
+ *
+ * Returns the number of bytes of data which are valid. The returned offset is at
+ * the start of a character and it is before the first error.
+ * The caller has to validate the rest. */
+__attribute__ ((target("avx2")))
+static size_t validprefix_avx2(size_t size, const uint8_t data[size])
+{
+   #define TOO_SHORT   (1<<0)   // first byte followed by single or first byte
+   #define TOO_LONG    (1<<1)   // single byte followed by continuation
+   #define OVERLONG_3  (1<<2)   // 0xE0 0x80..0x9F
+   #define TOO_LARGE   (1<<3)   // 0xF8..0xFF 0x90..0xBF
+   #define OVERLONG_2  (1<<5)   // 0xC0..0xC1 continuation
+   #define TWO_CONTS   (1<<7)   // continuation followed by continuation (xored with must be continuation)
+   #define TOO_LARGE_1000 (1<<6) // 0xF8..0xFF 0x80..0x8F
+   #define OVERLONG_4  (1<<6)   // 0xF0 0x80..0x8F
+   #define CARRY       (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+   const __m256i byte_1_high_table = _mm256_setr_epi8(
+      // 0_______ ________ <ASCII in byte 1>
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      // 10______ ________ <continuation in byte 1>
+      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      // 1100____ ________ <two byte lead in byte 1>
+      TOO_SHORT | OVERLONG_2,
+      // 1101____ ________ <two byte lead in byte 1>
+      TOO_SHORT,
+      // 1110____ ________ <three byte lead in byte 1>
+      TOO_SHORT | OVERLONG_3,
+      // 1111____ ________ <four+ byte lead in byte 1>
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+      // second lane
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3,
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+
+   const __m256i byte_1_low_table = _mm256_setr_epi8(
+      // ____0000 ________
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+      // ____0001 ________
+      CARRY | OVERLONG_2,
+      // ____001_ ________
+      CARRY, CARRY,
+      // ____01__ ________ (0xF4 .. 0xF7 are valid)
+      CARRY, CARRY, CARRY, CARRY,
+      // ____1___ ________ (0xF8 .. 0xFF not handled)
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      // second lane
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2,
+      CARRY, CARRY, CARRY, CARRY, CARRY, CARRY,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000);
+
+   const __m256i byte_2_high_table = _mm256_setr_epi8(
+      // ________ 0_______ <ASCII in byte 2>
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      // ________ 1000____
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+      // ________ 1001____
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      // ________ 101_____
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+      // ________ 11______
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      // second lane
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | TOO_LARGE,
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+   #undef TOO_SHORT
+   #undef TOO_LONG
+   #undef OVERLONG_3
+   #undef TOO_LARGE
+   #undef OVERLONG_2
+   #undef TWO_CONTS
+   #undef TOO_LARGE_1000
+   #undef OVERLONG_4
+   #undef CARRY
+
+   const __m256i nibble   = _mm256_set1_epi8(0x0F);
+   // a value > max_incomplete[i] at position i marks a sequence continued in the next block
+   const __m256i max_incomplete = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0-1), (char)(0xE0-1), (char)(0xC0-1));
+   __m256i prev_input      = _mm256_setzero_si256();
+   __m256i prev_incomplete = _mm256_setzero_si256();
+   size_t  offset = 0;
+
+   for (; offset + 32 <= size; offset += 32) {
+      const __m256i input = _mm256_loadu_si256((const __m256i*) (data + offset));
+
+      if (! _mm256_movemask_epi8(input)) {
+         // ASCII fast path: a sequence started in the last block is not completed
+         if (! _mm256_testz_si256(prev_incomplete, prev_incomplete)) break;
+         prev_input = input;
+         continue;
+      }
+
+      // prevN: input shifted right by N bytes with the last N bytes of prev_input shifted in
+      const __m256i prev_shift = _mm256_permute2x128_si256(prev_input, input, 0x21);
+      const __m256i prev1 = _mm256_alignr_epi8(input, prev_shift, 16-1);
+      const __m256i prev2 = _mm256_alignr_epi8(input, prev_shift, 16-2);
+      const __m256i prev3 = _mm256_alignr_epi8(input, prev_shift, 16-3);
+
+      const __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+      const __m256i byte_1_low  = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+      const __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+      const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+      // third byte of 3 and 4 byte sequences and fourth byte of 4 byte sequences must be continuation bytes
+      const __m256i is_third_byte  = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0-0x80)));
+      const __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0-0x80)));
+      const __m256i must23_80 = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+
+      const __m256i error = _mm256_xor_si256(must23_80, special_cases);
+      if (! _mm256_testz_si256(error, error)) break;
+
+      prev_input      = input;
+      prev_incomplete = _mm256_subs_epu8(input, max_incomplete);
+   }
+
+   return backup_utf8validator(offset, data);
+}
+
+#endif
+
+/* function: validprefix_utf8validator
+ * Returns the number of bytes of data which are valid utf8 and end at the start of a character.
+ * Uses <validprefix_avx2> if the cpu supports it. Else only ASCII characters are skipped 8 bytes at a time.
+ * The rest of the data must be validated by the caller. */
+static size_t validprefix_utf8validator(size_t size, const uint8_t data[size])
+{
+#if defined(__x86_64__) || defined(__i386__)
+   if (s_utf8validator_isavx2) return validprefix_avx2(size, data);
+#endif
+
+   size_t offset = 0;
+   for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, data + offset, sizeof(word));
+      if (word & UINT64_C(0x8080808080808080)) break;
+   }
+   return offset;
+}
+
+// group: validate
+
 int validate_utf8validator(utf8validator_t * utf8validator, size_t size, const uint8_t data[size], /*err*/size_t *erroffset)
 {
    static_assert(sizeof(utf8validator->prefix) == maxsize_utf8(), "prefix contains at least 1 byte less");
@@ -265,6 +605,8 @@ int validate_utf8validator(utf8validator_t * utf8validator, size_t size, const u
       goto VALIDATE;
    }
 
+   if (next < endnext) next += validprefix_utf8validator((size_t) (endnext - next), next);
+
    for (;;) {
 
       if (next >= endnext) {
@@ -275,6 +617,7 @@ int validate_utf8validator(utf8validator_t * utf8validator, size_t size, const u
             size_missing = 0;
             if ((size_t)(endnext - next) >= maxsize_utf8()) {
                endnext -= maxsize_utf8();
+               next += validprefix_utf8validator((size_t) (endnext - next), next);
                goto VALIDATE;
             }
          }
@@ -382,7 +725,7 @@ VALIDATE:
          if ((next[3] & 0xC0) != 0x80) { erroff = 3; goto ONERR; }
          if ((next[4] & 0xC0) != 0x80) { erroff = 4; goto ONERR; }
          next += 5;
-         continue;
+         goto VALIDPREFIX;
 
       case 252:
          // 6 byte sequence
@@ -399,13 +742,17 @@ VALIDATE:
          if ((next[4] & 0xC0) != 0x80) { erroff = 4; goto ONERR; }
          if ((next[5] & 0xC0) != 0x80) { erroff = 5; goto ONERR; }
          next += 6;
-         continue;
+         goto VALIDPREFIX;
 
       case 254: case 255:
          goto ONERR;
 
       }// switch (firstbyte)
 
+VALIDPREFIX:
+      // 5 and 6 byte sequences are not handled by validprefix_utf8validator ==> continue with it
+      if (next < endnext) next += validprefix_utf8validator((size_t) (endnext - next), next);
+
    }// for(;;)
 
    return 0;
@@ -428,3 +775,234 @@ ONERR:
    if (erroffset) *erroffset = erroff + (size_t) (next - data);
    return EILSEQ;
 }
+
+
+
+// group: test
+
+#ifdef KONFIG_UNITTEST
+
+/* variable: s_utf8_testseq
+ * Byte sequences used to build test strings. Entries with isvalid == false are rejected by <validate_utf8validator>. */
+static const struct {
+   bool        isvalid;
+   const char* seq;
+} s_utf8_testseq[] = {
+   { true, "a" }, { true, "\x7f" }, { true, "\xC2\x80" }, { true, "\xDF\xBF" },
+   { true, "\xE0\xA0\x80" }, { true, "\xE1\x80\x80" }, { true, "\xED\xA0\x80" }, { true, "\xEF\xBF\xBF" },
+   { true, "\xF0\x90\x80\x80" }, { true, "\xF4\x8F\xBF\xBF" }, { true, "\xF7\xBF\xBF\xBF" },
+   { true, "\xF8\x88\x80\x80\x80" }, { true, "\xFC\x84\x80\x80\x80\x80" },
+   { false, "\x80" }, { false, "\xBF" }, { false, "\xC0\x80" }, { false, "\xC1\xBF" }, { false, "\xC2" },
+   { false, "\xE0\x80\x80" }, { false, "\xE0\x9F\xBF" }, { false, "\xE1\x80" }, { false, "\xF0\x80\x80\x80" },
+   { false, "\xF0\x90\x80" }, { false, "\xF8\x80\x80\x80\x80" }, { false, "\xFE" }, { false, "\xFF" },
+};
+
+/* function: randomstring_utf8
+ * Fills str[0..size-1] with runs of ASCII characters, runs of 2 byte sequences and multibyte sequences.
+ * With isvalid == false an invalid sequence is inserted with a probability of 1/8 per sequence.
+ * Returns the number of used bytes. */
+static size_t randomstring_utf8(size_t size, uint8_t str[size], bool isvalid, uint32_t *random)
+{
+   size_t len = 0;
+
+   for (;;) {
+      *random = *random * 1103515245 + 12345;
+      const uint32_t r = *random >> 8;
+      if (r % 4 == 1 || r % 4 == 3) {
+         size_t run = 1 + (r >> 2) % 40;
+         if (run > size - len) break;
+         for (size_t i = 0; i < run; ++i) str[len++] = (uint8_t) (' ' + (r + i) % 90);
+      } else if (r % 4 == 2) {
+         // run of 2 byte sequences
+         size_t run = 2 * (1 + (r >> 2) % 16);
+         if (run > size - len) break;
+         for (size_t i = 0; i < run; i += 2) {
+            // overlong first byte 0xC0 or 0xC1 or first byte instead of continuation byte if invalid sequences are allowed
+            str[len++] = (uint8_t) (! isvalid && (r >> 12) % 16 == i ? 0xC0 + i % 4 / 2 : 0xC2 + (r + i) % 30);
+            str[len++] = (uint8_t) (! isvalid && (r >> 16) % 16 == i ? 0xC2 : 0x80 + (r >> 3) % 64);
+         }
+      } else {
+         size_t s = (r >> 1) % lengthof(s_utf8_testseq);
+         if (! s_utf8_testseq[s].isvalid && (isvalid || (r >> 8) % 8)) s = (r >> 11) % 13;
+         const size_t seqlen = strlen(s_utf8_testseq[s].seq);
+         if (seqlen > size - len) break;
+         memcpy(str + len, s_utf8_testseq[s].seq, seqlen);
+         len += seqlen;
+      }
+   }
+
+   return len;
+}
+
+/* function: helper_validate
+ * Validates data in two chunks data[0..split-1] and data[split..size-1].
+ * The error code and error offset of both calls are stored in result. */
+static void helper_validate(size_t size, const uint8_t data[size], size_t split, /*out*/size_t result[4])
+{
+   utf8validator_t utf8validator = utf8validator_INIT;
+   result[1] = result[3] = (size_t)-1;
+   result[0] = (size_t) validate_utf8validator(&utf8validator, split, data, &result[1]);
+   if (result[0]) init_utf8validator(&utf8validator);
+   result[2] = (size_t) validate_utf8validator(&utf8validator, size - split, data + split, &result[3]);
+   if (! result[2]) result[2] = sizeprefix_utf8validator(&utf8validator) ? 1000 : 0;
+}
+
+static int test_validate(void)
+{
+   uint8_t  buffer[32+160];
+   uint8_t  str[160];
+   uint32_t random = 3;
+   size_t   result[2][4];
+#if defined(__x86_64__) || defined(__i386__)
+   const bool isavx2 = s_utf8validator_isavx2;
+#endif
+
+   // TEST validate_utf8validator: valid sequences
+   for (unsigned s = 0; s < lengthof(s_utf8_testseq); ++s) {
+      utf8validator_t utf8validator = utf8validator_INIT;
+      const size_t    len = strlen(s_utf8_testseq[s].seq);
+      size_t          erroffset = 0;
+      memset(buffer, 'x', sizeof(buffer));
+      memcpy(buffer + 40, s_utf8_testseq[s].seq, len);
+      int err = validate_utf8validator(&utf8validator, 40 + len + 40, buffer, &erroffset);
+      TESTP(s_utf8_testseq[s].isvalid == (err == 0), "s=%u", s);
+      TESTP(err == 0 || (erroffset >= 40 && erroffset < 40 + len + 1), "s=%u erroffset=%zu", s, erroffset);
+   }
+
+   // TEST validate_utf8validator: AVX2 and scalar path give the same result at every offset, length and split
+   for (unsigned t = 0; t < 60; ++t) {
+      const size_t size = randomstring_utf8(sizeof(str), str, t % 2, &random);
+      for (size_t off = 0; off < 32; ++off) {
+         memcpy(buffer + off, str, size);
+         for (size_t len = 0; len <= size; ++len) {
+            const size_t split = (off * 7 + len) % (len + 1);
+            for (int isSIMD = 0; isSIMD < 2; ++isSIMD) {
+#if defined(__x86_64__) || defined(__i386__)
+               s_utf8validator_isavx2 = isSIMD && isavx2;
+#endif
+               helper_validate(len, buffer + off, split, result[isSIMD]);
+               if (! split) {
+                  // single chunk validated with second call
+                  TEST(0 == result[isSIMD][0]);
+               }
+            }
+            TESTP(0 == memcmp(result[0], result[1], sizeof(result[0])),
+                  "t=%u off=%zu len=%zu split=%zu", t, off, len, split);
+         }
+      }
+   }
+
+#if defined(__x86_64__) || defined(__i386__)
+   s_utf8validator_isavx2 = isavx2;
+#endif
+
+   return 0;
+ONERR:
+#if defined(__x86_64__) || defined(__i386__)
+   s_utf8validator_isavx2 = isavx2;
+#endif
+   return EINVAL;
+}
+
+/* function: decodescalar
+ * Reference implementation of <decode_utf8>. */
+static size_t decodescalar(size_t size, const uint8_t in[size], size_t out_capacity, /*out*/char32_t out[out_capacity], /*out*/size_t * consumed)
+{
+   size_t i = 0;
+   size_t n = 0;
+   while (i < size && n < out_capacity) {
+      const unsigned len = sizePfirst_utf8(in[i]);
+      if (len > size - i || ! decodechar_utf8(in + i, &out[n])) break;
+      i += len;
+      n += 1;
+   }
+   *consumed = i;
+   return n;
+}
+
+static int test_bulk(void)
+{
+   uint8_t  buffer[32+160];
+   uint8_t  str[160];
+   char32_t chars[2][160];
+   uint8_t  bytes[2][6*160];
+   uint32_t random = 5;
+   size_t   consumed[2];
+
+   // TEST decode_utf8, length_utf8, find_utf8: SSE2 path gives same result as scalar reference
+   for (unsigned t = 0; t < 60; ++t) {
+      const size_t size = randomstring_utf8(sizeof(str), str, t % 2, &random);
+      for (size_t off = 0; off < 16; ++off) {
+         memcpy(buffer + off, str, size);
+         const uint8_t *in = buffer + off;
+         for (size_t len = 0; len <= size; ++len) {
+            // decode_utf8
+            for (size_t capacity = len; ; capacity /= 3) {
+               const size_t n0 = decodescalar(len, in, capacity, chars[0], &consumed[0]);
+               const size_t n1 = decode_utf8(len, in, capacity, chars[1], &consumed[1]);
+               TESTP(n0 == n1 && consumed[0] == consumed[1], "t=%u off=%zu len=%zu capacity=%zu", t, off, len, capacity);
+               TEST(0 == memcmp(chars[0], chars[1], n0 * sizeof(char32_t)));
+               if (! capacity) break;
+            }
+            // length_utf8
+            size_t nrchar = 0;
+            for (size_t i = 0; i < len; ++i) nrchar += ((in[i] & 0xC0) != 0x80);
+            TESTP(nrchar == length_utf8(in, in + len), "t=%u off=%zu len=%zu", t, off, len);
+         }
+         // find_utf8
+         static const char32_t findchar[] = { 'a', 0x80, 0x7FF, 0x800, 0xFFFF, 0x10000, 0x10FFFF };
+         for (unsigned c = 0; c < lengthof(findchar); ++c) {
+            uint8_t utf8[6];
+            const uint8_t clen = encodechar_utf8(findchar[c], sizeof(utf8), utf8);
+            for (size_t len = 0; len <= size; len += 1 + len / 8) {
+               const uint8_t *found = 0;
+               for (size_t i = 0; i + clen <= len; ++i) {
+                  if (0 == memcmp(in + i, utf8, clen)) { found = in + i; break; }
+               }
+               TESTP(found == find_utf8(len, in, findchar[c]), "t=%u off=%zu len=%zu c=%u", t, off, len, c);
+            }
+         }
+      }
+   }
+
+   // TEST encode_utf8: SSE2 path gives same result as scalar reference
+   static const char32_t maxchar[] = { 0x7F, 0x7FF, 0xFFFF, 0x10FFFF, 0x7FFFFFFF, 0xFFFFFFFF };
+   for (unsigned t = 0; t < 200; ++t) {
+      const size_t len = t % 40;
+      for (size_t i = 0; i < len; ++i) {
+         random = random * 1103515245 + 12345;
+         // mostly ASCII and 2 byte characters so that blocks of 8 characters are encoded in one step
+         const unsigned class = (t % 4 == 0) ? (random >> 24) % lengthof(maxchar) : (t % 2);
+         chars[0][i] = (char32_t) ((random >> 4) % ((uint64_t)maxchar[class] + 1));
+         if (class == 1 && chars[0][i] < 0x80) chars[0][i] += 0x80;
+      }
+      for (size_t out_size = 6*len; ; out_size = out_size * 2 / 3) {
+         size_t n0 = 0;
+         for (consumed[0] = 0; consumed[0] < len; ++consumed[0]) {
+            const uint8_t s = encodechar_utf8(chars[0][consumed[0]], out_size - n0, bytes[0] + n0);
+            if (! s) break;
+            n0 += s;
+         }
+         const size_t n1 = encode_utf8(len, chars[0], out_size, bytes[1], &consumed[1]);
+         TESTP(n0 == n1 && consumed[0] == consumed[1], "t=%u out_size=%zu", t, out_size);
+         TEST(0 == memcmp(bytes[0], bytes[1], n0));
+         if (! out_size) break;
+      }
+   }
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+int unittest_string_utf8()
+{
+   if (test_validate())    goto ONERR;
+   if (test_bulk())        goto ONERR;
+
+   return 0;
+ONERR:
+   return EINVAL;
+}
+
+#endif
@@ -92,10 +92,11 @@ uint8_t sizechar_utf8(char32_t uchar);
 
 /* function: length_utf8
  * Returns number of UTF-8 characters encoded in string buffer.
- * The first byte of a multibyte sequence determines its size.
+ * Every byte which is not a continuation byte (0b10xxxxxx) is counted as one character.
+ * The bytes are counted 64 at a time with SSE2 or 8 at a time without it.
  * This function assumes that utf8 encodings are correct and does not check
  * the encoding of bytes following the first.
- * Illegal encoded start bytes are not counted but skipped.
+ * Continuation bytes without a start byte are not counted but skipped.
  * The last multibyte sequence is counted as one character even if
  * one or more bytes are missing.
  *
@@ -108,7 +109,10 @@ size_t length_utf8(const uint8_t * strstart, const uint8_t * strend);
 
 /* function: find_utf8
  * Searches for unicode character in utf8 encoded string str of size bytes.
- * The returned value points to the start addr of the multibyte sequence.
+ * The returned value points to the start addr of the first occurrence of the multibyte sequence.
+ * A single byte character is searched with memchr. For a multibyte sequence SSE2 tests
+ * 16 positions at once by comparing the first and the last byte of the sequence,
+ * matching positions are verified with memcmp.
  * A return value of 0 inidcates that str[size] does not contain the multibyte sequence
  * or that uchar is bigger than <maxchar_utf8> and therefore invalid. */
 const uint8_t * find_utf8(size_t size, const uint8_t str[size], char32_t uchar);
@@ -151,6 +155,30 @@ uint8_t decodechar_utf8(const uint8_t strstart[/*maxsize_utf8() or big enough*/]
  * or strsize is not big enough. */
 uint8_t encodechar_utf8(char32_t uchar, size_t strsize, /*out*/uint8_t strstart[strsize]);
 
+/* function: decode_utf8
+ * Decodes the utf-8 encoded bytes in[0..size-1] into at most out_capacity characters stored in out.
+ * The number of decoded characters is returned and the number of read bytes in consumed.
+ * Blocks of 16 ASCII bytes and blocks of 8 two-byte sequences are decoded with SSE2.
+ *
+ * Decoding stops before the first multibyte sequence which is not fully contained in in,
+ * if out is full or before an invalid first byte (see <decodechar_utf8>).
+ * A multibyte sequence which crosses a chunk boundary is therefore not consumed.
+ * Prepend in[*consumed..size-1] to the next chunk.
+ * If *consumed < size and neither out is full nor the last sequence is incomplete
+ * in[*consumed] is an invalid first byte (EILSEQ).
+ * Like <decodechar_utf8> the function checks only the first byte of a multibyte sequence. */
+size_t decode_utf8(size_t size, const uint8_t in[size], size_t out_capacity, /*out*/char32_t out[out_capacity], /*out*/size_t * consumed);
+
+/* function: encode_utf8
+ * Encodes the characters in[0..len-1] into at most out_size bytes stored in out.
+ * The number of written bytes is returned and the number of encoded characters in consumed.
+ * Blocks of 8 characters which are all ASCII or all encoded with two bytes are encoded with SSE2.
+ *
+ * Encoding stops before the first character which does not fit into out
+ * or which is greater than <maxchar_utf8> (see <encodechar_utf8>).
+ * A character is never written partially at the end of out. */
+size_t encode_utf8(size_t len, const char32_t in[len], size_t out_size, /*out*/uint8_t out[out_size], /*out*/size_t * consumed);
+
 /* function: skipchar_utf8
  * Skips the next utf-8 encoded character.
  * The encoded byte sequence is *not* checked for correctness.